@@ -7,6 +7,15 @@
 
 #include "Crypto/certificate.h"
 #include "Crypto/certificate_p.h"
+#include "Crypto/x509certificate_p.h"
+
+#include <utility>
+
+template <>
+Sailfish::Crypto::CertificateData *QSharedDataPointer<Sailfish::Crypto::CertificateData>::clone()
+{
+    return d->clone();
+}
 
 Sailfish::Crypto::CertificateData::CertificateData()
     : m_type(Sailfish::Crypto::Certificate::Invalid)
@@ -23,7 +32,6 @@ Sailfish::Crypto::CertificateData::~CertificateData()
 }
 
 Sailfish::Crypto::Certificate::Certificate()
-    : m_data(nullptr)
 {
 }
 
@@ -32,34 +40,35 @@ Sailfish::Crypto::Certificate::Certificate(Sailfish::Crypto::CertificateData *da
 {
 }
 
-
 Sailfish::Crypto::Certificate::Certificate(const Sailfish::Crypto::Certificate &other)
-    : m_data(other.m_data ? other.m_data->clone() : Q_NULLPTR)
+    : m_data(other.m_data)
+{
+}
+
+Sailfish::Crypto::Certificate::Certificate(Sailfish::Crypto::Certificate &&other)
+    : m_data(std::move(other.m_data))
 {
 }
 
 Sailfish::Crypto::Certificate::~Certificate()
 {
-    delete m_data;
 }
 
 Sailfish::Crypto::Certificate &Sailfish::Crypto::Certificate::operator=(const Sailfish::Crypto::Certificate &other)
 {
-    if (this != &other) {
-        delete m_data;
-        if (other.m_data) {
-            m_data = other.m_data->clone();
-        } else {
-            m_data = Q_NULLPTR;
-        }
-    }
+    m_data = other.m_data;
+    return *this;
+}
 
+Sailfish::Crypto::Certificate &Sailfish::Crypto::Certificate::operator=(Sailfish::Crypto::Certificate &&other)
+{
+    m_data.swap(other.m_data);
     return *this;
 }
 
 Sailfish::Crypto::Certificate::Type Sailfish::Crypto::Certificate::type() const
 {
-    return m_data ? m_data->m_type : Sailfish::Crypto::Certificate::Invalid;
+    return m_data ? m_data.constData()->m_type : Sailfish::Crypto::Certificate::Invalid;
 }
 
 QByteArray Sailfish::Crypto::Certificate::publicKey() const
@@ -70,9 +79,10 @@ QByteArray Sailfish::Crypto::Certificate::publicKey() const
 
 QByteArray Sailfish::Crypto::Certificate::toEncoded(Sailfish::Crypto::Certificate::Encoding encoding) const
 {
-    // the default implementation always returns an invalid byte array.
-    Q_UNUSED(encoding);
-    return QByteArray();
+    // the default implementation only returns the encoding the certificate was constructed from.
+    return (m_data && encoding == Sailfish::Crypto::Certificate::DistinguishedEncodingRules)
+            ? m_data.constData()->m_encoded
+            : QByteArray();
 }
 
 Sailfish::Crypto::Certificate
@@ -81,9 +91,12 @@ Sailfish::Crypto::Certificate::fromEncoded(
         Sailfish::Crypto::Certificate::Type type,
         Sailfish::Crypto::Certificate::Encoding encoding)
 {
-    // TODO: parse the encoded certificate, return the constructed certificate of the appropriate type.
-    Q_UNUSED(encoded);
-    Q_UNUSED(type);
-    Q_UNUSED(encoding);
-    return Sailfish::Crypto::Certificate();
+    // the certificate is only decoded when its fields are first accessed.
+    if (type != Sailfish::Crypto::Certificate::X509
+            || encoding != Sailfish::Crypto::Certificate::DistinguishedEncodingRules
+            || encoded.isEmpty()) {
+        // TODO: support other certificate types and encodings.
+        return Sailfish::Crypto::Certificate();
+    }
+    return Sailfish::Crypto::Certificate(new Sailfish::Crypto::X509CertificateData(encoded));
 }
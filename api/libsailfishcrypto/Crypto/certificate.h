@@ -15,6 +15,7 @@
 #include <QtCore/QVector>
 #include <QtCore/QHash>
 #include <QtCore/QVariantMap>
+#include <QtCore/QSharedDataPointer>
 
 #include <QtDBus/QDBusArgument>
 #include <QtDBus/QDBusMetaType>
@@ -53,9 +54,11 @@ public:
 
     Certificate();
     Certificate(const Certificate &other);
+    Certificate(Certificate &&other);
     virtual ~Certificate();
 
     Certificate &operator=(const Certificate &other);
+    Certificate &operator=(Certificate &&other);
 
     Certificate::Type type() const;
     virtual QByteArray publicKey() const;
@@ -65,7 +68,7 @@ public:
 protected:
     friend class X509Certificate;
     Certificate(CertificateData *data);
-    CertificateData *m_data;
+    QSharedDataPointer<CertificateData> m_data;
 };
 
 QDBusArgument &operator<<(QDBusArgument &argument, const Sailfish::Crypto::Certificate &certificate) SAILFISH_CRYPTO_API;
@@ -75,6 +78,7 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, Sailfish::Crypto:
 
 } // namespace Sailfish
 
+Q_DECLARE_TYPEINFO(Sailfish::Crypto::Certificate, Q_MOVABLE_TYPE);
 Q_DECLARE_METATYPE(Sailfish::Crypto::Certificate)
 Q_DECLARE_METATYPE(QVector<Sailfish::Crypto::Certificate>)
 
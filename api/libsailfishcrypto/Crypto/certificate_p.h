@@ -10,12 +10,15 @@
 
 #include "Crypto/certificate.h"
 
+#include <QtCore/QByteArray>
+#include <QtCore/QSharedData>
+
 namespace Sailfish {
 
 namespace Crypto {
 
 // exists solely so that Certificate-derived types can store arbitrary data
-class CertificateData
+class CertificateData : public QSharedData
 {
 public:
     CertificateData();
@@ -23,10 +26,15 @@ public:
     virtual ~CertificateData();
     virtual CertificateData *clone() const = 0;
     Certificate::Type m_type;
+    QByteArray m_encoded; // the DER encoding the certificate was constructed from, if any
 };
 
 } // namespace Crypto
 
 } // namespace Sailfish
 
+// copies of certificates share their data until modified, when the data is cloned by type.
+template <>
+Sailfish::Crypto::CertificateData *QSharedDataPointer<Sailfish::Crypto::CertificateData>::clone();
+
 #endif // LIBSAILFISHCRYPTO_CERTIFICATE_H
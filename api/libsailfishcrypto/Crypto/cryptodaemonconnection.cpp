@@ -21,13 +21,41 @@
 #include <QtDBus/QDBusArgument>
 #include <QtDBus/QDBusMetaType>
 
+#include <QtCore/QStandardPaths>
+#include <QtCore/QFileInfo>
+
 Q_LOGGING_CATEGORY(lcSailfishCryptoDaemonConnection, "org.sailfishos.crypto.daemon.connection")
 
+namespace {
+    const int MinimumReconnectDelay = 250;
+    const int MaximumReconnectDelay = 30000;
+
+    // Must match the socket file which the daemon listens on.
+    QString wellKnownPeerToPeerAddress()
+    {
+        const QString path = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+        if (path.isEmpty()) {
+            return QString();
+        }
+
+        const QString socketFile = QString::fromUtf8("%1/%2").arg(path, QLatin1String("sailfishsecretsd-p2pSocket"));
+        if (!QFileInfo(socketFile).exists()) {
+            return QString();
+        }
+
+        return QString::fromUtf8("unix:path=%1").arg(socketFile);
+    }
+}
+
 Sailfish::Crypto::CryptoDaemonConnectionPrivate::CryptoDaemonConnectionPrivate(CryptoDaemonConnection *parent)
     : QObject(parent)
     , m_connection(QLatin1String("org.sailfishos.crypto.daemon.invalidConnection"))
     , m_parent(parent)
+    , m_reconnectDelay(MinimumReconnectDelay)
 {
+    m_reconnectTimer.setSingleShot(true);
+    QObject::connect(&m_reconnectTimer, &QTimer::timeout,
+                     this, &Sailfish::Crypto::CryptoDaemonConnectionPrivate::reconnect);
 }
 
 bool Sailfish::Crypto::CryptoDaemonConnectionPrivate::connect()
@@ -36,35 +64,54 @@ bool Sailfish::Crypto::CryptoDaemonConnectionPrivate::connect()
         return true;
     }
 
-    // Step one: query the crypto daemon's "discovery" SessionBusObject for the PeerToPeer address.
-    QDBusInterface iface("org.sailfishos.crypto.daemon.discovery",
-                         "/Sailfish/Crypto/Discovery",
-                         "org.sailfishos.crypto.daemon.discovery",
-                         QDBusConnection::sessionBus());
-    if (!iface.isValid()) {
-        qCWarning(lcSailfishCryptoDaemonConnection) << "Unable to connect to the crypto daemon discovery service!";
-        return false;
+    // Step one: try the well-known socket in the user's runtime directory,
+    // which avoids a round trip to the discovery service via the session bus.
+    static int connectionCount = 0;
+    QString name = QString::fromLatin1("sailfishcryptod-connection-%1").arg(connectionCount++);
+    QDBusConnection p2pc(name);
+    const QString wellKnownAddress = wellKnownPeerToPeerAddress();
+    if (!wellKnownAddress.isEmpty()) {
+        qCDebug(lcSailfishCryptoDaemonConnection) << "Connecting to crypto daemon via well-known p2p address:" << wellKnownAddress
+                                                  << "with connection name:" << name;
+        p2pc = QDBusConnection::connectToPeer(wellKnownAddress, name);
+        if (!p2pc.isConnected()) {
+            qCDebug(lcSailfishCryptoDaemonConnection) << "Unable to connect via well-known p2p address, falling back to discovery:"
+                                                      << p2pc.lastError().message();
+            QDBusConnection::disconnectFromPeer(name);
+            name = QString::fromLatin1("sailfishcryptod-connection-%1").arg(connectionCount++);
+        }
     }
 
-    QDBusReply<QString> reply = iface.call("peerToPeerAddress");
-    if (!reply.isValid()) {
-        qCWarning(lcSailfishCryptoDaemonConnection) << "Unable to query the peer to peer socket address from the crypto daemon!";
-        return false;
-    }
+    if (!p2pc.isConnected()) {
+        // Step two: query the crypto daemon's "discovery" SessionBusObject for the PeerToPeer address.
+        QDBusInterface iface("org.sailfishos.crypto.daemon.discovery",
+                             "/Sailfish/Crypto/Discovery",
+                             "org.sailfishos.crypto.daemon.discovery",
+                             QDBusConnection::sessionBus());
+        if (!iface.isValid()) {
+            qCWarning(lcSailfishCryptoDaemonConnection) << "Unable to connect to the crypto daemon discovery service!";
+            return false;
+        }
 
-    // Step two: connect to the PeerToPeer address.
-    static int connectionCount = 0;
-    const QString address = reply.value();
-    const QString name = QString::fromLatin1("sailfishcryptod-connection-%1").arg(connectionCount++);
+        QDBusReply<QString> reply = iface.call("peerToPeerAddress");
+        if (!reply.isValid()) {
+            qCWarning(lcSailfishCryptoDaemonConnection) << "Unable to query the peer to peer socket address from the crypto daemon!";
+            return false;
+        }
 
-    qCDebug(lcSailfishCryptoDaemonConnection) << "Connecting to crypto daemon via p2p address:" << address
-                                               << "with connection name:" << name;
+        // Step three: connect to the PeerToPeer address.
+        const QString address = reply.value();
 
-    QDBusConnection p2pc = QDBusConnection::connectToPeer(address, name);
-    if (!p2pc.isConnected()) {
-        qCWarning(lcSailfishCryptoDaemonConnection) << "Unable to connect to crypto daemon:" << p2pc.lastError()
-                                                     << p2pc.lastError().type() << p2pc.lastError().name();
-        return false;
+        qCDebug(lcSailfishCryptoDaemonConnection) << "Connecting to crypto daemon via p2p address:" << address
+                                                  << "with connection name:" << name;
+
+        p2pc = QDBusConnection::connectToPeer(address, name);
+        if (!p2pc.isConnected()) {
+            qCWarning(lcSailfishCryptoDaemonConnection) << "Unable to connect to crypto daemon:" << p2pc.lastError()
+                                                        << p2pc.lastError().type() << p2pc.lastError().name();
+            QDBusConnection::disconnectFromPeer(name);
+            return false;
+        }
     }
 
     m_connection = p2pc;
@@ -76,15 +123,44 @@ bool Sailfish::Crypto::CryptoDaemonConnectionPrivate::connect()
 
     qCDebug(lcSailfishCryptoDaemonConnection) << "Connected to crypto daemon via connection:" << m_connection.name();
 
+    m_reconnectTimer.stop();
+    m_reconnectDelay = MinimumReconnectDelay;
+    if (!m_parent.isNull()) {
+        emit m_parent->connected();
+    }
+
     return true;
 }
 
+void Sailfish::Crypto::CryptoDaemonConnectionPrivate::disconnectFromDaemon()
+{
+    m_reconnectTimer.stop();
+    const QString name = m_connection.name();
+    m_connection = QDBusConnection(QLatin1String("org.sailfishos.crypto.daemon.invalidConnection"));
+    if (name != m_connection.name()) {
+        QDBusConnection::disconnectFromPeer(name);
+    }
+}
+
 void Sailfish::Crypto::CryptoDaemonConnectionPrivate::disconnected()
 {
     qCDebug(lcSailfishCryptoDaemonConnection) << "Disconnected from crypto daemon via connection:" << m_connection.name();
+    disconnectFromDaemon();
     if (!m_parent.isNull()) {
         emit m_parent->disconnected();
     }
+
+    // The daemon may have been restarted, so try to reconnect with backoff.
+    m_reconnectTimer.start(m_reconnectDelay);
+}
+
+void Sailfish::Crypto::CryptoDaemonConnectionPrivate::reconnect()
+{
+    if (!connect()) {
+        m_reconnectDelay = qMin(m_reconnectDelay * 2, MaximumReconnectDelay);
+        qCDebug(lcSailfishCryptoDaemonConnection) << "Unable to reconnect to crypto daemon, retrying in" << m_reconnectDelay << "msecs";
+        m_reconnectTimer.start(m_reconnectDelay);
+    }
 }
 
 // -------------------------------------------
@@ -96,6 +172,9 @@ Sailfish::Crypto::CryptoDaemonConnection::CryptoDaemonConnection()
     registerDBusTypes();
 }
 
+// All managers in the process share a single peer-to-peer connection, so that
+// only the first one pays for daemon discovery and connection setup, and the
+// asynchronous calls of every manager are pipelined over the same socket.
 static Sailfish::Crypto::CryptoDaemonConnection *connectionInstance = Q_NULLPTR;
 Sailfish::Crypto::CryptoDaemonConnection* Sailfish::Crypto::CryptoDaemonConnection::instance()
 {
@@ -103,11 +182,9 @@ Sailfish::Crypto::CryptoDaemonConnection* Sailfish::Crypto::CryptoDaemonConnecti
         connectionInstance = new Sailfish::Crypto::CryptoDaemonConnection;
     }
 
-    (void)connectionInstance->m_refCount.ref();
-    if (!connectionInstance->m_refCount.deref()) {
+    if (connectionInstance->m_refCount.fetchAndAddOrdered(1) == 0) {
         connectionInstance->m_data = new Sailfish::Crypto::CryptoDaemonConnectionPrivate(connectionInstance);
     }
-    connectionInstance->m_refCount.ref();
     return connectionInstance;
 }
 
@@ -115,29 +192,23 @@ void Sailfish::Crypto::CryptoDaemonConnection::releaseInstance()
 {
     if (connectionInstance) {
         if (!connectionInstance->m_refCount.deref()) {
+            connectionInstance->m_data->disconnectFromDaemon();
             connectionInstance->m_data->deleteLater();
             connectionInstance->m_data = Q_NULLPTR;
             connectionInstance->deleteLater();
+            connectionInstance = Q_NULLPTR;
         }
     }
 }
 
 bool Sailfish::Crypto::CryptoDaemonConnection::connect()
 {
-    (void)m_refCount.ref();
-    if (m_refCount.deref()) {
-        return m_data->connect();
-    }
-    return false;
+    return m_data ? m_data->connect() : false;
 }
 
 QDBusConnection *Sailfish::Crypto::CryptoDaemonConnection::connection()
 {
-    (void)m_refCount.ref();
-    if (m_refCount.deref()) {
-        return m_data->connection();
-    }
-    return Q_NULLPTR;
+    return m_data ? m_data->connection() : Q_NULLPTR;
 }
 
 // caller takes ownership of the returned instance, alternatively it is parented to the given \a parent object.
@@ -164,12 +235,16 @@ void Sailfish::Crypto::CryptoDaemonConnection::registerDBusTypes()
     qRegisterMetaType<Sailfish::Crypto::Key::Operations>("Sailfish::Crypto::Key::Operations");
     qRegisterMetaType<Sailfish::Crypto::Key::Identifier>("Sailfish::Crypto::Key::Identifier");
     qRegisterMetaType<QVector<Sailfish::Crypto::Key::Identifier> >("QVector<Sailfish::Crypto::Key::Identifier>");
+    qRegisterMetaType<Sailfish::Crypto::Key::FilterData>("Sailfish::Crypto::Key::FilterData");
     qRegisterMetaType<Sailfish::Crypto::Key>("Sailfish::Crypto::Key");
     qRegisterMetaType<Sailfish::Crypto::Certificate>("Sailfish::Crypto::Certificate");
     qRegisterMetaType<QVector<Sailfish::Crypto::Certificate> >("QVector<Sailfish::Crypto::Certificate>");
+    qRegisterMetaType<QVector<QVector<Sailfish::Crypto::Certificate> > >("QVector<QVector<Sailfish::Crypto::Certificate> >");
     qRegisterMetaType<Sailfish::Crypto::Result>("Sailfish::Crypto::Result");
     qRegisterMetaType<Sailfish::Crypto::CryptoPluginInfo>("Sailfish::Crypto::CryptoPluginInfo");
     qRegisterMetaType<QVector<Sailfish::Crypto::CryptoPluginInfo> >("QVector<Sailfish::Crypto::CryptoPluginInfo>");
+    qRegisterMetaType<QVector<QByteArray> >("QVector<QByteArray>");
+    qRegisterMetaType<QVector<bool> >("QVector<bool>");
 
     qDBusRegisterMetaType<Sailfish::Crypto::Key::Origin>();
     qDBusRegisterMetaType<Sailfish::Crypto::Key::Algorithm>();
@@ -185,10 +260,14 @@ void Sailfish::Crypto::CryptoDaemonConnection::registerDBusTypes()
     qDBusRegisterMetaType<Sailfish::Crypto::Key::Operations>();
     qDBusRegisterMetaType<Sailfish::Crypto::Key::Identifier>();
     qDBusRegisterMetaType<QVector<Sailfish::Crypto::Key::Identifier> >();
+    qDBusRegisterMetaType<Sailfish::Crypto::Key::FilterData>();
     qDBusRegisterMetaType<Sailfish::Crypto::Key>();
     qDBusRegisterMetaType<Sailfish::Crypto::Certificate>();
     qDBusRegisterMetaType<QVector<Sailfish::Crypto::Certificate> >();
+    qDBusRegisterMetaType<QVector<QVector<Sailfish::Crypto::Certificate> > >();
     qDBusRegisterMetaType<Sailfish::Crypto::Result>();
     qDBusRegisterMetaType<Sailfish::Crypto::CryptoPluginInfo>();
     qDBusRegisterMetaType<QVector<Sailfish::Crypto::CryptoPluginInfo> >();
+    qDBusRegisterMetaType<QVector<QByteArray> >();
+    qDBusRegisterMetaType<QVector<bool> >();
 }
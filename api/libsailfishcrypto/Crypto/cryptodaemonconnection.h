@@ -42,6 +42,9 @@ public:
     static void registerDBusTypes();
 
 signals:
+    // emitted whenever a new connection to the daemon has been established,
+    // including after automatically reconnecting following disconnected().
+    void connected();
     void disconnected();
 
 private:
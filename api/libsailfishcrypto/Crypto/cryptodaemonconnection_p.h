@@ -15,6 +15,7 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QPointer>
+#include <QtCore/QTimer>
 
 namespace Sailfish {
 
@@ -29,14 +30,20 @@ public:
     CryptoDaemonConnectionPrivate(CryptoDaemonConnection *parent = Q_NULLPTR);
     QDBusConnection *connection() { return &m_connection; }
     bool connect();
+    void disconnectFromDaemon();
 
 public Q_SLOTS:
     void disconnected();
 
+private Q_SLOTS:
+    void reconnect();
+
 private:
     friend class CryptoDaemonConnection;
     QDBusConnection m_connection;
     QPointer<CryptoDaemonConnection> m_parent;
+    QTimer m_reconnectTimer;
+    int m_reconnectDelay; // msecs, doubled after every failed attempt
 };
 
 } // namespace Crypto
@@ -19,12 +19,36 @@
 #include <QtDBus/QDBusMetaType>
 
 #include <QtCore/QPointer>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
 #include <QtCore/QLoggingCategory>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QDir>
 
 Q_LOGGING_CATEGORY(lcSailfishCrypto, "org.sailfishos.crypto")
 
+const QString Sailfish::Crypto::CryptoManager::FastestCryptosystemProvider = QStringLiteral("org.sailfishos.crypto.provider.fastest");
+const QString Sailfish::Crypto::CryptoManager::HardwarePreferredCryptosystemProvider = QStringLiteral("org.sailfishos.crypto.provider.hardwarepreferred");
+const QString Sailfish::Crypto::CryptoManager::DefaultCsprngEngineName = QStringLiteral("default");
+
+namespace {
+    // The plugin info only changes when plugins are installed, so it is shared
+    // by every manager in the process, and revalidated once per daemon connection.
+    struct PluginInfoCache
+    {
+        PluginInfoCache() : generation(0), valid(false) {}
+        QString validatedConnectionName;
+        quint64 generation;
+        bool valid;
+        QVector<Sailfish::Crypto::CryptoPluginInfo> cryptoPlugins;
+        QStringList storagePlugins;
+    };
+    Q_GLOBAL_STATIC(PluginInfoCache, pluginInfoCache)
+
+    // serialises the sending of each request and its deadline, see CryptoManagerPrivate::asyncCall().
+    Q_GLOBAL_STATIC(QMutex, requestDeadlineMutex)
+}
+
 Sailfish::Crypto::CryptoManagerPrivate::CryptoManagerPrivate(CryptoManager *parent)
     : QObject(parent)
     , m_parent(parent)
@@ -32,7 +56,14 @@ Sailfish::Crypto::CryptoManagerPrivate::CryptoManagerPrivate(CryptoManager *pare
     , m_interface(m_crypto->connect()
                   ? m_crypto->createApiInterface(QLatin1String("/Sailfish/Crypto"), QLatin1String("org.sailfishos.crypto"), this)
                   : Q_NULLPTR)
+    , m_requestTimeout(-1)
 {
+    // The connection is shared with every other manager in the process,
+    // and is re-established automatically if the daemon goes away.
+    QObject::connect(m_crypto, &Sailfish::Crypto::CryptoDaemonConnection::connected,
+                     this, &Sailfish::Crypto::CryptoManagerPrivate::connected);
+    QObject::connect(m_crypto, &Sailfish::Crypto::CryptoDaemonConnection::disconnected,
+                     this, &Sailfish::Crypto::CryptoManagerPrivate::disconnected);
 }
 
 Sailfish::Crypto::CryptoManagerPrivate::~CryptoManagerPrivate()
@@ -40,6 +71,44 @@ Sailfish::Crypto::CryptoManagerPrivate::~CryptoManagerPrivate()
     Sailfish::Crypto::CryptoDaemonConnection::releaseInstance();
 }
 
+void Sailfish::Crypto::CryptoManagerPrivate::connected()
+{
+    // the interface is bound to a particular connection, so recreate it.
+    delete m_interface;
+    m_interface = m_crypto->createApiInterface(QLatin1String("/Sailfish/Crypto"), QLatin1String("org.sailfishos.crypto"), this);
+}
+
+void Sailfish::Crypto::CryptoManagerPrivate::disconnected()
+{
+    if (m_interface) {
+        m_interface->deleteLater();
+        m_interface = Q_NULLPTR;
+    }
+}
+
+QDBusPendingCall
+Sailfish::Crypto::CryptoManagerPrivate::asyncCall(const QString &method, const QVariantList &arguments)
+{
+    if (m_requestTimeout < 0) {
+        return m_interface->asyncCallWithArgumentList(method, arguments);
+    }
+
+    QDBusMessage deadline = QDBusMessage::createMethodCall(m_interface->service(), m_interface->path(),
+                                                           m_interface->interface(), QStringLiteral("setNextRequestDeadline"));
+    deadline << method << qint64(m_requestTimeout);
+    QDBusMessage call = QDBusMessage::createMethodCall(m_interface->service(), m_interface->path(),
+                                                       m_interface->interface(), method);
+    call.setArguments(arguments);
+
+    // the daemon applies the deadline to the next call of the method which it receives
+    // via the (shared) connection, so the two messages mustn't be interleaved with
+    // those sent by another thread.  The deadline itself expects no reply.
+    QMutexLocker locker(requestDeadlineMutex());
+    QDBusConnection connection = m_interface->connection();
+    connection.send(deadline);
+    return connection.asyncCall(call, m_requestTimeout);
+}
+
 /*!
   \brief Constructs a new CryptoManager instance with the given \a parent.
  */
@@ -61,6 +130,31 @@ bool Sailfish::Crypto::CryptoManager::isInitialised() const
     return m_data->m_interface;
 }
 
+/*!
+  \brief Sets the time in milliseconds for which the replies to requests made
+         after this call are awaited to \a msecs.
+
+  Each such request is given a deadline of \a msecs from when it is sent.
+  If the request has not been started by the daemon before its deadline,
+  it is failed without being performed, rather than doing work whose
+  result would not be received.  Requests which involve user interaction
+  may take arbitrarily long, so the timeout should allow for that.
+
+  A negative value (the default) removes the deadline.
+ */
+void Sailfish::Crypto::CryptoManager::setRequestTimeout(int msecs)
+{
+    m_data->m_requestTimeout = msecs < 0 ? -1 : msecs;
+}
+
+/*!
+  \brief Returns the request timeout in milliseconds, or -1 if requests have no deadline
+ */
+int Sailfish::Crypto::CryptoManager::requestTimeout() const
+{
+    return m_data->m_requestTimeout;
+}
+
 /*!
  * \brief Returns information about crypto plugins as well as the names of storage plugins
  */
@@ -74,11 +168,64 @@ Sailfish::Crypto::CryptoManager::getPluginInfo()
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::CryptoPluginInfo>, QStringList> reply
-            = m_data->m_interface->asyncCall("getPluginInfo");
+            = m_data->asyncCall(QStringLiteral("getPluginInfo"));
 
     return reply;
 }
 
+/*!
+ * \brief Returns the same information as getPluginInfo(), from a cache shared by every manager in the process
+ *
+ * The first call after the connection to the daemon is (re-)established blocks while the daemon
+ * is asked whether the installed plugins have changed, which it answers without queueing the
+ * request.  The plugin info is only fetched again if they have.  Subsequent calls return
+ * immediately.
+ */
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoManager::cachedPluginInfo(
+        QVector<Sailfish::Crypto::CryptoPluginInfo> *cryptoPlugins,
+        QStringList *storagePlugins)
+{
+    if (!m_data->m_interface) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::DaemonError,
+                                        QStringLiteral("Not connected to daemon"));
+    }
+
+    PluginInfoCache *cache = pluginInfoCache();
+    const QString connectionName = m_data->m_crypto->connection()->name();
+    if (!cache->valid || cache->validatedConnectionName != connectionName) {
+        QDBusPendingReply<Sailfish::Crypto::Result, quint64> generationReply
+                = m_data->m_interface->call("getPluginInfoGeneration");
+        if (!generationReply.isValid()) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::DaemonError,
+                                            generationReply.error().message());
+        } else if (generationReply.argumentAt<0>().code() == Sailfish::Crypto::Result::Failed) {
+            return generationReply.argumentAt<0>();
+        }
+
+        const quint64 generation = generationReply.argumentAt<1>();
+        if (!cache->valid || cache->generation != generation) {
+            QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::CryptoPluginInfo>, QStringList> reply
+                    = m_data->m_interface->call("getPluginInfo");
+            if (!reply.isValid()) {
+                return Sailfish::Crypto::Result(Sailfish::Crypto::Result::DaemonError,
+                                                reply.error().message());
+            } else if (reply.argumentAt<0>().code() == Sailfish::Crypto::Result::Failed) {
+                return reply.argumentAt<0>();
+            }
+            cache->cryptoPlugins = reply.argumentAt<1>();
+            cache->storagePlugins = reply.argumentAt<2>();
+            cache->generation = generation;
+            cache->valid = true;
+        }
+        cache->validatedConnectionName = connectionName;
+    }
+
+    *cryptoPlugins = cache->cryptoPlugins;
+    *storagePlugins = cache->storagePlugins;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
 /*!
  * \brief Attempts to verify the validity of the first certificate in the given certificate chain
  *
@@ -97,13 +244,40 @@ Sailfish::Crypto::CryptoManager::validateCertificateChain(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, bool> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "validateCertificateChain",
                 QVariantList() << QVariant::fromValue<QVector<Sailfish::Crypto::Certificate> >(chain)
                                << QVariant::fromValue<QString>(cryptosystemProviderName));
     return reply;
 }
 
+/*!
+ * \brief Attempts to verify the validity of the first certificate in each of the given certificate \a chains
+ *
+ * The cryptosystem provider identified by the given \a cryptosystemProviderName validates
+ * the chains concurrently, and validates chains which occur more than once in the batch
+ * (or which it has recently validated) only once.  The reply contains the validity of each
+ * chain, in order.  If the validation of any chain fails, the whole batch fails.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> >
+Sailfish::Crypto::CryptoManager::validateCertificateChains(
+        const QVector<QVector<Sailfish::Crypto::Certificate> > &chains,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> >(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> > reply
+            = m_data->asyncCall(
+                "validateCertificateChains",
+                QVariantList() << QVariant::fromValue<QVector<QVector<Sailfish::Crypto::Certificate> > >(chains)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
 /*!
  * \brief Uses the cryptosystem provider identified by \a cryptosystemProviderName to generate a key according to the specified \a keyTemplate.
  *
@@ -122,7 +296,7 @@ Sailfish::Crypto::CryptoManager::generateKey(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "generateKey",
                 QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key>(keyTemplate)
                                << QVariant::fromValue<QString>(cryptosystemProviderName));
@@ -156,7 +330,7 @@ Sailfish::Crypto::CryptoManager::generateStoredKey(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "generateStoredKey",
                 QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key>(keyTemplate)
                                << QVariant::fromValue<QString>(cryptosystemProviderName)
@@ -181,7 +355,7 @@ Sailfish::Crypto::CryptoManager::storedKey(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "storedKey",
                 QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key::Identifier>(identifier));
     // TODO: does this also need collectionName ? or is name a combo of secretName+collectionName somehow?
@@ -211,7 +385,7 @@ Sailfish::Crypto::CryptoManager::deleteStoredKey(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "deleteStoredKey",
                 QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key::Identifier>(identifier));
     return reply;
@@ -237,7 +411,62 @@ Sailfish::Crypto::CryptoManager::storedKeyIdentifiers() // TODO: UI interaction
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier> > reply
-            = m_data->m_interface->asyncCall("storedKeyIdentifiers");
+            = m_data->asyncCall(QStringLiteral("storedKeyIdentifiers"));
+    return reply;
+}
+
+/*!
+ * \brief Returns up to \a limit names of stored keys which the application is permitted to enumerate.
+ *
+ * The identifiers are returned in the order the keys were stored.  The first
+ * page is requested with a \a cursor of zero; each reply also returns the
+ * cursor from which the next page may be requested, which is zero once every
+ * identifier has been returned.  The daemon may return fewer identifiers than
+ * requested.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier>, qint64>
+Sailfish::Crypto::CryptoManager::storedKeyIdentifiers(
+        qint64 cursor,
+        int limit)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier>, qint64>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier>, qint64> reply
+            = m_data->asyncCall(
+                "storedKeyIdentifiers",
+                QVariantList() << QVariant::fromValue<qint64>(cursor)
+                               << QVariant::fromValue<int>(limit));
+    return reply;
+}
+
+/*!
+ * \brief Returns the names of stored keys whose filter data matches the given \a filter.
+ *
+ * A key matches if its filter data contains every field of the \a filter,
+ * with the same value.  The lookup is performed by the daemon via an index,
+ * so clients needn't retrieve each stored key to inspect its filter data.
+ * An empty \a filter matches every stored key.
+ *
+ * The identifiers are returned in the order the keys were stored.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier> >
+Sailfish::Crypto::CryptoManager::findKeys(
+        const Sailfish::Crypto::Key::FilterData &filter)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier> >(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier> > reply
+            = m_data->asyncCall(
+                "findKeys",
+                QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key::FilterData>(filter));
     return reply;
 }
 
@@ -264,7 +493,7 @@ Sailfish::Crypto::CryptoManager::sign(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "sign",
                 QVariantList() << QVariant::fromValue<QByteArray>(data)
                                << QVariant::fromValue<Sailfish::Crypto::Key>(key)
@@ -275,7 +504,7 @@ Sailfish::Crypto::CryptoManager::sign(
 }
 
 /*!
- * \brief Attempt to verify the given signed \a data with the provided \a key assuming padding mode \a padding and hash function \a digest.
+ * \brief Attempt to verify the \a signature of the given signed \a data with the provided \a key assuming padding mode \a padding and hash function \a digest.
  *
  * The \a key may be a key reference (that is, a key containing just an identifier)
  * which references a securely stored key managed by the crypto daemon,
@@ -285,6 +514,7 @@ Sailfish::Crypto::CryptoManager::sign(
 QDBusPendingReply<Sailfish::Crypto::Result, bool>
 Sailfish::Crypto::CryptoManager::verify(
         const QByteArray &data,
+        const QByteArray &signature,
         const Sailfish::Crypto::Key &key,
         Sailfish::Crypto::Key::SignaturePadding padding,
         Sailfish::Crypto::Key::Digest digest,
@@ -297,9 +527,10 @@ Sailfish::Crypto::CryptoManager::verify(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, bool> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "verify",
                 QVariantList() << QVariant::fromValue<QByteArray>(data)
+                               << QVariant::fromValue<QByteArray>(signature)
                                << QVariant::fromValue<Sailfish::Crypto::Key>(key)
                                << QVariant::fromValue<Sailfish::Crypto::Key::SignaturePadding>(padding)
                                << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
@@ -332,7 +563,7 @@ Sailfish::Crypto::CryptoManager::encrypt(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "encrypt",
                 QVariantList() << QVariant::fromValue<QByteArray>(data)
                                << QVariant::fromValue<Sailfish::Crypto::Key>(key)
@@ -368,7 +599,7 @@ Sailfish::Crypto::CryptoManager::decrypt(
     }
 
     QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "decrypt",
                 QVariantList() << QVariant::fromValue<QByteArray>(data)
                                << QVariant::fromValue<Sailfish::Crypto::Key>(key)
@@ -379,3 +610,393 @@ Sailfish::Crypto::CryptoManager::decrypt(
     return reply;
 }
 
+/*!
+ * \brief Attempt to encrypt the contents of the given memfd \a data with the provided \a key
+ *        with block mode \a blockMode, padding mode \a padding, and hash function \a digest.
+ *
+ * This behaves identically to the encrypt() overload which takes a QByteArray, except that
+ * the data is passed to and returned from the crypto daemon as file descriptors rather than
+ * being copied into the DBus messages, which is preferable for large payloads.
+ * The memfd must have been created with \c MFD_ALLOW_SEALING and sealed with at least
+ * \c F_SEAL_WRITE and \c F_SEAL_SHRINK, otherwise the request will fail.
+ * The returned memfd is sealed and may be mmap()ed by the caller.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QDBusUnixFileDescriptor>
+Sailfish::Crypto::CryptoManager::encrypt(
+        const QDBusUnixFileDescriptor &data,
+        const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QDBusUnixFileDescriptor> reply
+            = m_data->asyncCall(
+                "encryptFd",
+                QVariantList() << QVariant::fromValue<QDBusUnixFileDescriptor>(data)
+                               << QVariant::fromValue<Sailfish::Crypto::Key>(key)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Attempt to decrypt the contents of the given memfd \a data with the provided \a key
+ *        assuming block mode \a blockMode, padding mode \a padding, and hash function \a digest.
+ *
+ * This behaves identically to the decrypt() overload which takes a QByteArray, except that
+ * the data is passed to and returned from the crypto daemon as file descriptors rather than
+ * being copied into the DBus messages, which is preferable for large payloads.
+ * The memfd must have been created with \c MFD_ALLOW_SEALING and sealed with at least
+ * \c F_SEAL_WRITE and \c F_SEAL_SHRINK, otherwise the request will fail.
+ * The returned memfd is sealed and may be mmap()ed by the caller.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QDBusUnixFileDescriptor>
+Sailfish::Crypto::CryptoManager::decrypt(
+        const QDBusUnixFileDescriptor &data,
+        const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QDBusUnixFileDescriptor> reply
+            = m_data->asyncCall(
+                "decryptFd",
+                QVariantList() << QVariant::fromValue<QDBusUnixFileDescriptor>(data)
+                               << QVariant::fromValue<Sailfish::Crypto::Key>(key)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Attempt to sign each item of the given \a data with the provided \a key with padding mode \a padding and hash function \a digest.
+ *
+ * This behaves as if sign() were called for each item, except that the key is
+ * resolved (and, for a key reference, read from secure storage) only once, and
+ * the whole batch is sent to the crypto daemon in one message.  The daemon may
+ * sign the items concurrently.  If any item cannot be signed, the request fails
+ * and no signatures are returned; otherwise the signatures are returned in the
+ * same order as the \a data.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> >
+Sailfish::Crypto::CryptoManager::signBatch(
+        const QVector<QByteArray> &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> >(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> > reply
+            = m_data->asyncCall(
+                "signBatch",
+                QVariantList() << QVariant::fromValue<QVector<QByteArray> >(data)
+                               << QVariant::fromValue<Sailfish::Crypto::Key>(key)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::SignaturePadding>(padding)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Attempt to verify each of the \a signatures of the corresponding item of the given signed \a data
+ *        with the provided \a key assuming padding mode \a padding and hash function \a digest.
+ *
+ * There must be as many signatures as items of data.  As for signBatch(), the key
+ * is resolved once for the whole batch.  The reply contains whether each signature
+ * was verified, in the same order as the \a data.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> >
+Sailfish::Crypto::CryptoManager::verifyBatch(
+        const QVector<QByteArray> &data,
+        const QVector<QByteArray> &signatures,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> >(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> > reply
+            = m_data->asyncCall(
+                "verifyBatch",
+                QVariantList() << QVariant::fromValue<QVector<QByteArray> >(data)
+                               << QVariant::fromValue<QVector<QByteArray> >(signatures)
+                               << QVariant::fromValue<Sailfish::Crypto::Key>(key)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::SignaturePadding>(padding)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Attempt to encrypt each item of the given \a data with the provided \a key with
+ *        block mode \a blockMode, padding mode \a padding, and hash function \a digest.
+ *
+ * As for signBatch(), the key is resolved once for the whole batch, and the
+ * ciphertexts are returned in the same order as the \a data.  Each item is
+ * encrypted separately, as if by encrypt().
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> >
+Sailfish::Crypto::CryptoManager::encryptBatch(
+        const QVector<QByteArray> &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> >(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> > reply
+            = m_data->asyncCall(
+                "encryptBatch",
+                QVariantList() << QVariant::fromValue<QVector<QByteArray> >(data)
+                               << QVariant::fromValue<Sailfish::Crypto::Key>(key)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Attempt to generate \a numberBytes cryptographically secure random bytes
+ *        with the CSPRNG \a csprngEngineName of the given crypto plugin.
+ *
+ * The crypto plugin may serve small requests from a buffer of random data which it
+ * keeps for each worker thread, so that random data for nonces and initialisation
+ * vectors is cheap to request.  Requests which are larger than such a buffer are
+ * generated directly into the reply.  The \a cryptosystemProviderName must be the
+ * name of a plugin, rather than a provider policy.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QByteArray>
+Sailfish::Crypto::CryptoManager::generateRandomData(
+        quint64 numberBytes,
+        const QString &csprngEngineName,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QByteArray>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply
+            = m_data->asyncCall(
+                "generateRandomData",
+                QVariantList() << QVariant::fromValue<quint64>(numberBytes)
+                               << QVariant::fromValue<QString>(csprngEngineName)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Attempt to generate the digest of the given \a data with the hash function \a digest.
+ *
+ * Digests need no key.  To digest data which is too large to send in one
+ * message, initialise a cipher session with the Key::GenerateDigest operation
+ * and an empty key instead.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QByteArray>
+Sailfish::Crypto::CryptoManager::generateDigest(
+        const QByteArray &data,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QByteArray>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply
+            = m_data->asyncCall(
+                "generateDigest",
+                QVariantList() << QVariant::fromValue<QByteArray>(data)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Attempt to calculate the HMAC of the given \a data with the secret key
+ *        of the provided \a key and hash function \a digest.
+ *
+ * The \a key may be a key reference, so that the key never leaves the daemon.
+ * To authenticate data which is too large to send in one message, initialise
+ * a cipher session with the Key::CalculateMac operation instead.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QByteArray>
+Sailfish::Crypto::CryptoManager::calculateMac(
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result, QByteArray>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply
+            = m_data->asyncCall(
+                "calculateMac",
+                QVariantList() << QVariant::fromValue<QByteArray>(data)
+                               << QVariant::fromValue<Sailfish::Crypto::Key>(key)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Attempt to begin a cipher session which will \a operation (either
+ *        Key::Encrypt or Key::Decrypt) data with the provided \a key with
+ *        block mode \a blockMode, padding mode \a padding, and hash function \a digest.
+ *
+ * A Key::GenerateDigest session (whose \a key is empty) or a Key::CalculateMac
+ * session ignores the \a blockMode and \a padding, and produces no output
+ * until it is finalised, when the digest or HMAC of all of the data is returned.
+ *
+ * The \a key may be a key reference, in which case the key is read from secure
+ * storage once, when the session is initialised.  The crypto plugin keeps its
+ * cipher context and the key until the session is finalised, so that the data
+ * can be passed to updateCipherSession() in chunks of any size.
+ *
+ * The reply contains the token which identifies the session in subsequent calls.
+ * Each client may have a limited number of open sessions.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, quint32>
+Sailfish::Crypto::CryptoManager::initialiseCipherSession(
+        const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+        Sailfish::Crypto::Key::Operation operation,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, quint32> reply
+            = m_data->asyncCall(
+                "initialiseCipherSession",
+                QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key>(key)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Operation>(operation)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding)
+                               << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Pass the next chunk of \a data through the cipher session identified
+ *        by \a cipherSessionToken.
+ *
+ * The reply contains the output generated from the data passed so far, which may
+ * be shorter than \a data as incomplete blocks are buffered by the session.
+ * The caller must wait for the reply before passing the next chunk.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QByteArray>
+Sailfish::Crypto::CryptoManager::updateCipherSession(
+        const QByteArray &data,
+        quint32 cipherSessionToken,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply
+            = m_data->asyncCall(
+                "updateCipherSession",
+                QVariantList() << QVariant::fromValue<QByteArray>(data)
+                               << QVariant::fromValue<quint32>(cipherSessionToken)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Finish the cipher session identified by \a cipherSessionToken.
+ *
+ * The reply contains the final output of the session (for example, the last
+ * padded block of ciphertext).  The session is closed, even if this fails.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result, QByteArray>
+Sailfish::Crypto::CryptoManager::finaliseCipherSession(
+        quint32 cipherSessionToken,
+        const QString &cryptosystemProviderName)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply
+            = m_data->asyncCall(
+                "finaliseCipherSession",
+                QVariantList() << QVariant::fromValue<quint32>(cipherSessionToken)
+                               << QVariant::fromValue<QString>(cryptosystemProviderName));
+    return reply;
+}
+
+/*!
+ * \brief Requests the Crypto service to cancel all outstanding requests
+ *        which were made by this process.
+ *
+ * The pending replies of all cancelled requests will return an error.
+ * Requests whose result is already available are not cancelled.
+ * Any cipher sessions left open by this process are also closed.
+ */
+QDBusPendingReply<Sailfish::Crypto::Result>
+Sailfish::Crypto::CryptoManager::cancelRequests()
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Crypto::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Crypto::Result> reply
+            = m_data->asyncCall(QStringLiteral("cancelRequests"));
+    return reply;
+}
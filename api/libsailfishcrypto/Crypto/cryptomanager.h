@@ -17,6 +17,7 @@
 #include <QtDBus/QDBusPendingReply>
 #include <QtDBus/QDBusMetaType>
 #include <QtDBus/QDBusArgument>
+#include <QtDBus/QDBusUnixFileDescriptor>
 
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
@@ -36,16 +37,42 @@ class SAILFISH_CRYPTO_API CryptoManager : public QObject
     Q_OBJECT
 
 public:
+    // Provider policies which may be passed instead of a cryptosystemProviderName
+    // to generateKey(), generateStoredKey(), sign(), verify(), encrypt() and decrypt().
+    // The daemon routes the request to the plugin which supports the key algorithm
+    // and operation with the best throughput measured when the plugin was installed,
+    // preferring plugins which perform the operation in a TEE or secure peripheral
+    // in the case of HardwarePreferredCryptosystemProvider.
+    static const QString FastestCryptosystemProvider;
+    static const QString HardwarePreferredCryptosystemProvider;
+
+    // The cryptographically secure random number generator which every
+    // plugin supporting generateRandomData() provides.
+    static const QString DefaultCsprngEngineName;
+
     CryptoManager(QObject *parent = Q_NULLPTR);
 
     bool isInitialised() const;
 
+    // Requests made after this call are given up on after msecs, and are failed
+    // by the daemon without being performed if they haven't started by then.
+    // A negative value (the default) removes the deadline.
+    void setRequestTimeout(int msecs);
+    int requestTimeout() const;
+
     QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::CryptoPluginInfo>, QStringList> getPluginInfo();
+    Sailfish::Crypto::Result cachedPluginInfo(
+            QVector<Sailfish::Crypto::CryptoPluginInfo> *cryptoPlugins,
+            QStringList *storagePlugins);
 
     QDBusPendingReply<Sailfish::Crypto::Result, bool> validateCertificateChain(
             const QVector<Sailfish::Crypto::Certificate> &chain,
             const QString &cryptosystemProviderName);
 
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> > validateCertificateChains(
+            const QVector<QVector<Sailfish::Crypto::Certificate> > &chains,
+            const QString &cryptosystemProviderName);
+
     QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> generateKey(
             const Sailfish::Crypto::Key &keyTemplate,
             const QString &cryptosystemProviderName);
@@ -63,6 +90,13 @@ public:
 
     QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier> > storedKeyIdentifiers();
 
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier>, qint64> storedKeyIdentifiers(
+            qint64 cursor,
+            int limit);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier> > findKeys(
+            const Sailfish::Crypto::Key::FilterData &filter);
+
     QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> sign(
             const QByteArray &data,
             const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
@@ -72,6 +106,7 @@ public:
 
     QDBusPendingReply<Sailfish::Crypto::Result, bool> verify(
             const QByteArray &data,
+            const QByteArray &signature,
             const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
             Sailfish::Crypto::Key::SignaturePadding padding,
             Sailfish::Crypto::Key::Digest digest,
@@ -93,8 +128,84 @@ public:
             Sailfish::Crypto::Key::Digest digest,
             const QString &cryptosystemProviderName);
 
-    // do we also need "continueEncrypt(data, ...)" etc?  Do we need "cipher sessions"?  what about denial of service / resource exhaustion etc?
-    // do we also need "generateRandom()" methods?
+    // as above, but the data is passed and returned as sealed memfds
+    QDBusPendingReply<Sailfish::Crypto::Result, QDBusUnixFileDescriptor> encrypt(
+            const QDBusUnixFileDescriptor &data,
+            const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QDBusUnixFileDescriptor> decrypt(
+            const QDBusUnixFileDescriptor &data,
+            const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName);
+
+    // as above, but for many items of data with the same key, in a single request
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> > signBatch(
+            const QVector<QByteArray> &data,
+            const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> > verifyBatch(
+            const QVector<QByteArray> &data,
+            const QVector<QByteArray> &signatures,
+            const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> > encryptBatch(
+            const QVector<QByteArray> &data,
+            const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> generateRandomData(
+            quint64 numberBytes,
+            const QString &csprngEngineName,
+            const QString &cryptosystemProviderName);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> generateDigest(
+            const QByteArray &data,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> calculateMac(
+            const QByteArray &data,
+            const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName);
+
+    // cipher sessions encrypt, decrypt, digest or MAC data in chunks, with constant memory use in the daemon
+    QDBusPendingReply<Sailfish::Crypto::Result, quint32> initialiseCipherSession(
+            const Sailfish::Crypto::Key &key, // or keyreference, i.e. Key(keyName)
+            Sailfish::Crypto::Key::Operation operation,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> updateCipherSession(
+            const QByteArray &data,
+            quint32 cipherSessionToken,
+            const QString &cryptosystemProviderName);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> finaliseCipherSession(
+            quint32 cipherSessionToken,
+            const QString &cryptosystemProviderName);
+
+    // cancel all outstanding requests made by this process, and close its cipher sessions
+    QDBusPendingReply<Sailfish::Crypto::Result> cancelRequests();
+
     // We also need to return the available cryptographic service providers (and storage providers).
     // We also need to return data about CSPs e.g. what sort of keys / operations they provide.
 
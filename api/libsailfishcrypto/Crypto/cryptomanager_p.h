@@ -12,6 +12,7 @@
 #include "Crypto/cryptodaemonconnection.h"
 
 #include <QtDBus/QDBusInterface>
+#include <QtDBus/QDBusPendingCall>
 #include <QtCore/QObject>
 
 namespace Sailfish {
@@ -27,11 +28,20 @@ public:
     CryptoManagerPrivate(CryptoManager *parent = Q_NULLPTR);
     ~CryptoManagerPrivate();
 
+private Q_SLOTS:
+    void connected();
+    void disconnected();
+
 private:
+    // calls the method, with the deadline of the request timeout if one is set.
+    QDBusPendingCall asyncCall(const QString &method, const QVariantList &arguments = QVariantList());
+
+
     friend class CryptoManager;
     Sailfish::Crypto::CryptoManager *m_parent;
     Sailfish::Crypto::CryptoDaemonConnection *m_crypto;
     QDBusInterface *m_interface;
+    int m_requestTimeout;
 };
 
 } // namespace Crypto
@@ -218,3 +218,170 @@ Sailfish::Crypto::CryptoPlugin::CryptoPlugin(QObject *parent)
 Sailfish::Crypto::CryptoPlugin::~CryptoPlugin()
 {
 }
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::generateRandomData(
+        const QString &csprngEngineName,
+        quint64 numberBytes,
+        QByteArray *randomData)
+{
+    Q_UNUSED(csprngEngineName);
+    Q_UNUSED(numberBytes);
+    Q_UNUSED(randomData);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                    QLatin1String("This crypto plugin does not support random data generation"));
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::generateDigest(
+        const QByteArray &data,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *digestValue)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(digest);
+    Q_UNUSED(digestValue);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                    QLatin1String("This crypto plugin does not support digests"));
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::calculateMac(
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *mac)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(key);
+    Q_UNUSED(digest);
+    Q_UNUSED(mac);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                    QLatin1String("This crypto plugin does not support MACs"));
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::initialiseCipherSession(
+        quint64 clientId,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Operation operation,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        quint32 *cipherSessionToken)
+{
+    Q_UNUSED(clientId);
+    Q_UNUSED(key);
+    Q_UNUSED(operation);
+    Q_UNUSED(blockMode);
+    Q_UNUSED(padding);
+    Q_UNUSED(digest);
+    Q_UNUSED(cipherSessionToken);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                    QLatin1String("This crypto plugin does not support cipher sessions"));
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::updateCipherSession(
+        quint64 clientId,
+        const QByteArray &data,
+        quint32 cipherSessionToken,
+        QByteArray *generatedData)
+{
+    Q_UNUSED(clientId);
+    Q_UNUSED(data);
+    Q_UNUSED(cipherSessionToken);
+    Q_UNUSED(generatedData);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                    QLatin1String("This crypto plugin does not support cipher sessions"));
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::finaliseCipherSession(
+        quint64 clientId,
+        quint32 cipherSessionToken,
+        QByteArray *generatedData)
+{
+    Q_UNUSED(clientId);
+    Q_UNUSED(cipherSessionToken);
+    Q_UNUSED(generatedData);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                    QLatin1String("This crypto plugin does not support cipher sessions"));
+}
+
+void
+Sailfish::Crypto::CryptoPlugin::closeCipherSessions(quint64 clientId)
+{
+    Q_UNUSED(clientId);
+}
+
+bool
+Sailfish::Crypto::CryptoPlugin::supportsAsynchronousOperations() const
+{
+    return false;
+}
+
+int
+Sailfish::Crypto::CryptoPlugin::maximumPendingOperations() const
+{
+    return 1;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::beginSign(
+        quint64 operationId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest)
+{
+    QByteArray signature;
+    const Sailfish::Crypto::Result result = sign(data, key, padding, digest, &signature);
+    emit signCompleted(operationId, result, signature);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::beginVerify(
+        quint64 operationId,
+        const QByteArray &data,
+        const QByteArray &signature,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest)
+{
+    bool verified = false;
+    const Sailfish::Crypto::Result result = verify(data, signature, key, padding, digest, &verified);
+    emit verifyCompleted(operationId, result, verified);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::beginEncrypt(
+        quint64 operationId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest)
+{
+    QByteArray encrypted;
+    const Sailfish::Crypto::Result result = encrypt(data, key, blockMode, padding, digest, &encrypted);
+    emit encryptCompleted(operationId, result, encrypted);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::CryptoPlugin::beginDecrypt(
+        quint64 operationId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest)
+{
+    QByteArray decrypted;
+    const Sailfish::Crypto::Result result = decrypt(data, key, blockMode, padding, digest, &decrypted);
+    emit decryptCompleted(operationId, result, decrypted);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+}
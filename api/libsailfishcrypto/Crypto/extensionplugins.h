@@ -23,7 +23,7 @@
 #include <QtDBus/QDBusArgument>
 #include <QtDBus/QDBusMetaType>
 
-#define Sailfish_Crypto_CryptoPlugin_IID "org.sailfishos.crypto.CryptoPlugin/1.0"
+#define Sailfish_Crypto_CryptoPlugin_IID "org.sailfishos.crypto.CryptoPlugin/2.0"
 
 namespace Sailfish {
 
@@ -91,6 +91,7 @@ public:
 
     virtual Sailfish::Crypto::Result verify(
             const QByteArray &data,
+            const QByteArray &signature,
             const Sailfish::Crypto::Key &key,
             Sailfish::Crypto::Key::SignaturePadding padding,
             Sailfish::Crypto::Key::Digest digest,
@@ -111,6 +112,111 @@ public:
             Sailfish::Crypto::Key::EncryptionPadding padding,
             Sailfish::Crypto::Key::Digest digest,
             QByteArray *decrypted) = 0;
+
+    // Fills the output with the given number of random bytes from the named
+    // engine, which is CryptoManager::DefaultCsprngEngineName unless the
+    // plugin documents others.  May be called from several threads at once.
+    // The default implementation returns UnsupportedOperation.
+    virtual Sailfish::Crypto::Result generateRandomData(
+            const QString &csprngEngineName,
+            quint64 numberBytes,
+            QByteArray *randomData);
+
+    // Digests need no key, and are advertised under Key::AlgorithmUnknown in
+    // supportedOperations() and supportedDigests().  MACs are HMACs keyed
+    // with the secret key of the given key.
+    // The default implementations return UnsupportedOperation.
+    virtual Sailfish::Crypto::Result generateDigest(
+            const QByteArray &data,
+            Sailfish::Crypto::Key::Digest digest,
+            QByteArray *digestValue);
+
+    virtual Sailfish::Crypto::Result calculateMac(
+            const QByteArray &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::Digest digest,
+            QByteArray *mac);
+
+    // Cipher sessions encrypt or decrypt data in chunks, keeping the cipher
+    // context and key material in the plugin until the session is finalised.
+    // Sessions are identified by a token which is unique per client.
+    // GenerateDigest and CalculateMac sessions produce no output until
+    // they are finalised, when the digest or MAC of all of the data is returned.
+    // The default implementations return UnsupportedOperation.
+    virtual Sailfish::Crypto::Result initialiseCipherSession(
+            quint64 clientId,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::Operation operation,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            quint32 *cipherSessionToken);
+
+    virtual Sailfish::Crypto::Result updateCipherSession(
+            quint64 clientId,
+            const QByteArray &data,
+            quint32 cipherSessionToken,
+            QByteArray *generatedData);
+
+    // the session is closed, whether or not finalisation succeeds.
+    virtual Sailfish::Crypto::Result finaliseCipherSession(
+            quint64 clientId,
+            quint32 cipherSessionToken,
+            QByteArray *generatedData);
+
+    // closes any cipher sessions of the given client without finalising them.
+    virtual void closeCipherSessions(quint64 clientId);
+
+    // Plugins backed by slow hardware (a TEE or a secure element) may sign, verify,
+    // encrypt and decrypt asynchronously, so that the daemon can serve other clients
+    // in the meantime.  Each beginX() returns Pending once the job has been submitted,
+    // and the matching xCompleted() signal is later emitted with the same operationId
+    // (possibly from another thread).  The daemon only uses the asynchronous variants
+    // if supportsAsynchronousOperations() returns true, and submits at most
+    // maximumPendingOperations() jobs at once; more than one job may be pipelined
+    // to the hardware if its transport allows it.  Other operations, and operations
+    // with requests for several items, use the synchronous methods above.
+    // The default implementations return false and 1, and perform the operation
+    // via the synchronous method before returning.
+    virtual bool supportsAsynchronousOperations() const;
+    virtual int maximumPendingOperations() const;
+
+    virtual Sailfish::Crypto::Result beginSign(
+            quint64 operationId,
+            const QByteArray &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest);
+
+    virtual Sailfish::Crypto::Result beginVerify(
+            quint64 operationId,
+            const QByteArray &data,
+            const QByteArray &signature,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest);
+
+    virtual Sailfish::Crypto::Result beginEncrypt(
+            quint64 operationId,
+            const QByteArray &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest);
+
+    virtual Sailfish::Crypto::Result beginDecrypt(
+            quint64 operationId,
+            const QByteArray &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest);
+
+Q_SIGNALS:
+    void signCompleted(quint64 operationId, const Sailfish::Crypto::Result &result, const QByteArray &signature);
+    void verifyCompleted(quint64 operationId, const Sailfish::Crypto::Result &result, bool verified);
+    void encryptCompleted(quint64 operationId, const Sailfish::Crypto::Result &result, const QByteArray &encrypted);
+    void decryptCompleted(quint64 operationId, const Sailfish::Crypto::Result &result, const QByteArray &decrypted);
 };
 
 class CryptoPluginInfoData;
@@ -9,6 +9,8 @@
 #include "Crypto/key_p.h"
 #include "Crypto/x509certificate.h"
 
+#include <utility>
+
 Sailfish::Crypto::KeyData::KeyData()
     : m_origin(Sailfish::Crypto::Key::OriginUnknown)
     , m_algorithm(Sailfish::Crypto::Key::AlgorithmUnknown)
@@ -21,7 +23,9 @@ Sailfish::Crypto::KeyData::KeyData()
 }
 
 Sailfish::Crypto::KeyData::KeyData(const KeyData &other)
-    : m_customParameters(other.m_customParameters)
+    : QSharedData(other)
+    , m_customParameters(other.m_customParameters)
+    , m_filterData(other.m_filterData)
     , m_publicKey(other.m_publicKey)
     , m_privateKey(other.m_privateKey)
     , m_secretKey(other.m_secretKey)
@@ -38,30 +42,10 @@ Sailfish::Crypto::KeyData::KeyData(const KeyData &other)
 {
 }
 
-Sailfish::Crypto::KeyData &Sailfish::Crypto::KeyData::operator=(const KeyData &other)
-{
-    if (this != &other) {
-        m_customParameters = other.m_customParameters;
-        m_publicKey = other.m_publicKey;
-        m_privateKey = other.m_privateKey;
-        m_secretKey = other.m_secretKey;
-        m_validityStart = other.m_validityStart;
-        m_validityEnd = other.m_validityEnd;
-        m_identifier = other.m_identifier;
-        m_origin = other.m_origin;
-        m_algorithm = other.m_algorithm;
-        m_blockModes = other.m_blockModes;
-        m_encryptionPaddings = other.m_encryptionPaddings;
-        m_signaturePaddings = other.m_signaturePaddings;
-        m_digests = other.m_digests;
-        m_operations = other.m_operations;
-    }
-    return *this;
-}
-
 bool Sailfish::Crypto::KeyData::identical(const Sailfish::Crypto::KeyData &other) const
 {
     return m_customParameters == other.m_customParameters
+        && m_filterData == other.m_filterData
         && m_publicKey == other.m_publicKey
         && m_privateKey == other.m_privateKey
         && m_secretKey == other.m_secretKey
@@ -120,24 +104,20 @@ Sailfish::Crypto::Key::Key()
 
 /*!
  * \brief Constructs a copy of the \a other key
+ *
+ * The key data is implicitly shared, and is only copied when either key is modified.
  */
 Sailfish::Crypto::Key::Key(const Sailfish::Crypto::Key &other)
-    : m_data(new Sailfish::Crypto::KeyData)
+    : m_data(other.m_data)
+{
+}
+
+/*!
+ * \brief Constructs a key by moving the data of the \a other key, which may then only be assigned to or destroyed
+ */
+Sailfish::Crypto::Key::Key(Sailfish::Crypto::Key &&other)
+    : m_data(std::move(other.m_data))
 {
-    setCustomParameters(other.customParameters());
-    setPublicKey(other.publicKey());
-    setPrivateKey(other.privateKey());
-    setSecretKey(other.secretKey());
-    setValidityStart(other.validityStart());
-    setValidityEnd(other.validityEnd());
-    setIdentifier(other.identifier());
-    setOrigin(other.origin());
-    setAlgorithm(other.algorithm());
-    setBlockModes(other.blockModes());
-    setEncryptionPaddings(other.encryptionPaddings());
-    setSignaturePaddings(other.signaturePaddings());
-    setDigests(other.digests());
-    setOperations(other.operations());
 }
 
 /*!
@@ -158,22 +138,16 @@ Sailfish::Crypto::Key::Key(const QString &name, const QString &collection)
  */
 Sailfish::Crypto::Key& Sailfish::Crypto::Key::operator=(const Sailfish::Crypto::Key &other)
 {
-    if (this != &other) {
-        setCustomParameters(other.customParameters());
-        setPublicKey(other.publicKey());
-        setPrivateKey(other.privateKey());
-        setSecretKey(other.secretKey());
-        setValidityStart(other.validityStart());
-        setValidityEnd(other.validityEnd());
-        setIdentifier(other.identifier());
-        setOrigin(other.origin());
-        setAlgorithm(other.algorithm());
-        setBlockModes(other.blockModes());
-        setEncryptionPaddings(other.encryptionPaddings());
-        setSignaturePaddings(other.signaturePaddings());
-        setDigests(other.digests());
-        setOperations(other.operations());
-    }
+    m_data = other.m_data;
+    return *this;
+}
+
+/*!
+ * \brief Moves the data of the \a other key to this key, and returns a reference to this key
+ */
+Sailfish::Crypto::Key& Sailfish::Crypto::Key::operator=(Sailfish::Crypto::Key &&other)
+{
+    m_data.swap(other.m_data);
     return *this;
 }
 
@@ -182,13 +156,12 @@ Sailfish::Crypto::Key& Sailfish::Crypto::Key::operator=(const Sailfish::Crypto::
  */
 Sailfish::Crypto::Key::~Key()
 {
-    delete m_data;
 }
 
 /*!
  * \brief Returns true if the underlying data and metadata in this key are identical to those in \a other, otherwise false
  */
-bool Sailfish::Crypto::Key::operator==(const Sailfish::Crypto::Key &other)
+bool Sailfish::Crypto::Key::operator==(const Sailfish::Crypto::Key &other) const
 {
     return m_data->identical(*other.m_data);
 }
@@ -196,7 +169,7 @@ bool Sailfish::Crypto::Key::operator==(const Sailfish::Crypto::Key &other)
 /*!
  * \brief Returns true if this key should sort before the \a other key
  */
-bool Sailfish::Crypto::Key::operator<(const Sailfish::Crypto::Key &other)
+bool Sailfish::Crypto::Key::operator<(const Sailfish::Crypto::Key &other) const
 {
     return m_data->lessThan(*other.m_data);
 }
@@ -438,6 +411,60 @@ void Sailfish::Crypto::Key::setCustomParameters(const QVector<QByteArray> &param
     m_data->m_customParameters = parameters;
 }
 
+/*!
+ * \brief Returns the filter data associated with this key
+ */
+Sailfish::Crypto::Key::FilterData Sailfish::Crypto::Key::filterData() const
+{
+    return m_data->m_filterData;
+}
+
+/*!
+ * \brief Sets the filter data associated with this key to \a data.
+ *
+ * The filter data of a stored key is indexed by the daemon, so that
+ * clients may find the keys matching some filter via
+ * CryptoManager::findKeys() without retrieving each key.
+ * The filter data is not secret, and should not contain sensitive
+ * information.
+ */
+void Sailfish::Crypto::Key::setFilterData(const Sailfish::Crypto::Key::FilterData &data)
+{
+    m_data->m_filterData = data;
+}
+
+/*!
+ * \brief Returns the fields of the filter data associated with this key
+ */
+QStringList Sailfish::Crypto::Key::filterDataFields() const
+{
+    return m_data->m_filterData.keys();
+}
+
+/*!
+ * \brief Returns the filter data value of the given \a field
+ */
+QString Sailfish::Crypto::Key::filterData(const QString &field) const
+{
+    return m_data->m_filterData.value(field);
+}
+
+/*!
+ * \brief Sets the filter data value of the given \a field to \a value
+ */
+void Sailfish::Crypto::Key::setFilterData(const QString &field, const QString &value)
+{
+    m_data->m_filterData.insert(field, value);
+}
+
+/*!
+ * \brief Returns true if this key has filter data for the given \a field
+ */
+bool Sailfish::Crypto::Key::hasFilterData(const QString &field) const
+{
+    return m_data->m_filterData.contains(field);
+}
+
 /*!
  * \brief Extracts metadata and the public key from the given \a certificate and returns a Key encapsulating that data
  */
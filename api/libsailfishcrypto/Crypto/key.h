@@ -15,6 +15,9 @@
 #include <QtCore/QByteArray>
 #include <QtCore/QVector>
 #include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QStringList>
+#include <QtCore/QSharedDataPointer>
 
 #include <QtDBus/QDBusArgument>
 #include <QtDBus/QDBusMetaType>
@@ -118,18 +121,25 @@ public:
         Sign                = 1,
         Verify              = 2,
         Encrypt             = 4,
-        Decrypt             = 8
+        Decrypt             = 8,
+        GenerateDigest      = 16,
+        CalculateMac        = 32
     };
     Q_DECLARE_FLAGS(Operations, Operation)
 
+    // field names mapped to values, by which stored keys may be found.
+    typedef QMap<QString, QString> FilterData;
+
     Key();
     Key(const Sailfish::Crypto::Key &other);
+    Key(Sailfish::Crypto::Key &&other);
     explicit Key(const QString &keyName, const QString &collection);
     virtual ~Key();
 
     Sailfish::Crypto::Key & operator=(const Sailfish::Crypto::Key &other);
-    bool operator==(const Sailfish::Crypto::Key &other);
-    bool operator<(const Sailfish::Crypto::Key &other);
+    Sailfish::Crypto::Key & operator=(Sailfish::Crypto::Key &&other);
+    bool operator==(const Sailfish::Crypto::Key &other) const;
+    bool operator<(const Sailfish::Crypto::Key &other) const;
 
     class Identifier {
     public:
@@ -203,12 +213,19 @@ public:
     QVector<QByteArray> customParameters() const;
     void setCustomParameters(const QVector<QByteArray> &parameters);
 
+    Sailfish::Crypto::Key::FilterData filterData() const;
+    void setFilterData(const Sailfish::Crypto::Key::FilterData &data);
+    QStringList filterDataFields() const;
+    QString filterData(const QString &field) const;
+    void setFilterData(const QString &field, const QString &value);
+    bool hasFilterData(const QString &field) const;
+
     static Sailfish::Crypto::Key fromCertificate(const Sailfish::Crypto::Certificate &certificate);
     static Sailfish::Crypto::Key deserialise(const QByteArray &data);
     static QByteArray serialise(const Sailfish::Crypto::Key &key);
 
 protected:
-    KeyData *m_data;
+    QSharedDataPointer<KeyData> m_data;
 };
 
 QDBusArgument &operator<<(QDBusArgument &argument, const Sailfish::Crypto::Key &key) SAILFISH_CRYPTO_API;
@@ -247,6 +264,7 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, Sailfish::Crypto:
 
 } // namespace Sailfish
 
+Q_DECLARE_TYPEINFO(Sailfish::Crypto::Key, Q_MOVABLE_TYPE);
 Q_DECLARE_METATYPE(Sailfish::Crypto::Key)
 Q_DECLARE_METATYPE(Sailfish::Crypto::Key::Identifier)
 Q_DECLARE_METATYPE(QVector<Sailfish::Crypto::Key::Identifier>)
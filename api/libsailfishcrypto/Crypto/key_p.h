@@ -14,24 +14,26 @@
 #include <QtCore/QByteArray>
 #include <QtCore/QVector>
 #include <QtCore/QHash>
+#include <QtCore/QMap>
 #include <QtCore/QDateTime>
+#include <QtCore/QSharedData>
 
 namespace Sailfish {
 
 namespace Crypto {
 
-class KeyData
+class KeyData : public QSharedData
 {
 public:
     KeyData();
     KeyData(const KeyData &other);
-    KeyData &operator=(const KeyData &other);
 
     bool identical(const Sailfish::Crypto::KeyData &other) const;
     bool keysEqual(const Sailfish::Crypto::KeyData &other) const;
     bool lessThan(const Sailfish::Crypto::KeyData &other) const;
 
     QVector<QByteArray> m_customParameters;
+    Sailfish::Crypto::Key::FilterData m_filterData;
     QByteArray m_publicKey;
     QByteArray m_privateKey;
     QByteArray m_secretKey;
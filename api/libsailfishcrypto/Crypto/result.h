@@ -50,6 +50,12 @@ public:
 
         CryptoPluginEncryptionError = 40,
         CryptoPluginDecryptionError,
+        CryptoPluginInvalidCipherSessionToken,
+        CryptoPluginCipherSessionLimitReached,
+        CryptoPluginKeyGenerationError,
+        CryptoPluginSigningError,
+        CryptoPluginVerificationError,
+        CryptoPluginDigestError,
 
         NetworkError = 98,
         NetworkSslError = 99,
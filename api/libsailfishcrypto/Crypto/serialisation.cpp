@@ -17,9 +17,11 @@
 
 #include <QtCore/QString>
 #include <QtCore/QLoggingCategory>
-#include <QtCore/QBuffer>
 #include <QtCore/QDataStream>
 #include <QtCore/QByteArray>
+#include <QtCore/QtEndian>
+
+#include <string.h>
 
 Q_LOGGING_CATEGORY(lcSailfishCryptoSerialisation, "org.sailfishos.crypto.serialisation")
 
@@ -27,29 +29,186 @@ namespace Sailfish {
 
 namespace Crypto {
 
-Sailfish::Crypto::Key
-Sailfish::Crypto::Key::deserialise(const QByteArray &data)
+namespace {
+
+// Keys are serialised with a header of a "magic number" and a version,
+// written in big-endian order.  Version 100 is followed by a QDataStream,
+// and version 200 by the fixed layout below, in little-endian order:
+//   7 x quint32: origin, algorithm, operations, block modes,
+//                encryption paddings, signature paddings, digests
+//   2 x qint64:  validity start and end, as UTC msecs since epoch
+//   5 x (quint32 size, bytes): name and collection name (UTF-8),
+//                public, private and secret key
+//   quint32 count, then count x (quint32 size, bytes): custom parameters
+// Version 210 appends the filter data:
+//   quint32 count, then count x 2 x (quint32 size, bytes): field and value (UTF-8)
+const quint32 KeyMagic = 0x4B657900; // Key\0
+const qint32 KeyStreamVersion = 100; // version 1.0.0
+const qint32 KeyFixedLayoutVersion = 200; // version 2.0.0
+const qint32 KeyFilterDataLayoutVersion = 210; // version 2.1.0
+const int KeyHeaderSize = 2 * sizeof(quint32);
+const int KeyFixedFieldsSize = 7 * sizeof(quint32) + 2 * sizeof(qint64);
+const qint64 InvalidTimestamp = Q_INT64_C(-0x7fffffffffffffff) - 1;
+
+void appendUInt32(char **out, quint32 value)
 {
-    QBuffer buffer;
-    buffer.setData(data);
-    buffer.open(QIODevice::ReadOnly);
+    qToLittleEndian<quint32>(value, reinterpret_cast<uchar *>(*out));
+    *out += sizeof(quint32);
+}
 
-    QDataStream in(&buffer);
+void appendInt64(char **out, qint64 value)
+{
+    qToLittleEndian<qint64>(value, reinterpret_cast<uchar *>(*out));
+    *out += sizeof(qint64);
+}
 
-    quint32 magic;
-    in >> magic;
-    if (magic != 0x4B657900) {
-        qCWarning(lcSailfishCryptoSerialisation) << "Cannot deserialise key, bad magic number:" << magic;
-        return Sailfish::Crypto::Key();
+void appendBytes(char **out, const QByteArray &bytes)
+{
+    appendUInt32(out, static_cast<quint32>(bytes.size()));
+    memcpy(*out, bytes.constData(), bytes.size());
+    *out += bytes.size();
+}
+
+qint64 toTimestamp(const QDateTime &dateTime)
+{
+    return dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : InvalidTimestamp;
+}
+
+QDateTime fromTimestamp(qint64 timestamp)
+{
+    return timestamp == InvalidTimestamp ? QDateTime() : QDateTime::fromMSecsSinceEpoch(timestamp, Qt::UTC);
+}
+
+// Reads the fields of the fixed layout in place, checking the bounds of each.
+struct KeyReader
+{
+    KeyReader(const char *begin, const char *finish) : pos(begin), end(finish), ok(true) {}
+
+    quint32 readUInt32() {
+        if (!ok || end - pos < static_cast<int>(sizeof(quint32))) {
+            ok = false;
+            return 0;
+        }
+        const quint32 value = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(pos));
+        pos += sizeof(quint32);
+        return value;
     }
 
-    qint32 version;
-    in >> version;
-    if (version != 100) {
-        qCWarning(lcSailfishCryptoSerialisation) << "Cannot deserialise key, bad version number:" << version;
+    qint64 readInt64() {
+        if (!ok || end - pos < static_cast<int>(sizeof(qint64))) {
+            ok = false;
+            return 0;
+        }
+        const qint64 value = qFromLittleEndian<qint64>(reinterpret_cast<const uchar *>(pos));
+        pos += sizeof(qint64);
+        return value;
+    }
+
+    // returns a pointer to the size bytes within the blob.
+    const char *readBytes(int *size) {
+        const quint32 length = readUInt32();
+        if (!ok || static_cast<quint32>(end - pos) < length) {
+            ok = false;
+            *size = 0;
+            return pos;
+        }
+        const char *bytes = pos;
+        pos += length;
+        *size = static_cast<int>(length);
+        return bytes;
+    }
+
+    QByteArray readByteArray() {
+        int size = 0;
+        const char *bytes = readBytes(&size);
+        return size ? QByteArray(bytes, size) : QByteArray();
+    }
+
+    QString readString() {
+        int size = 0;
+        const char *bytes = readBytes(&size);
+        return size ? QString::fromUtf8(bytes, size) : QString();
+    }
+
+    const char *pos;
+    const char *end;
+    bool ok;
+};
+
+Sailfish::Crypto::Key deserialiseFixedLayout(const QByteArray &data, bool hasFilterData)
+{
+    KeyReader in(data.constData() + KeyHeaderSize, data.constData() + data.size());
+
+    const quint32 origin = in.readUInt32();
+    const quint32 algorithm = in.readUInt32();
+    const quint32 operations = in.readUInt32();
+    const quint32 blockModes = in.readUInt32();
+    const quint32 encryptionPaddings = in.readUInt32();
+    const quint32 signaturePaddings = in.readUInt32();
+    const quint32 digests = in.readUInt32();
+    const qint64 validityStart = in.readInt64();
+    const qint64 validityEnd = in.readInt64();
+
+    const QString name = in.readString();
+    const QString collectionName = in.readString();
+    const QByteArray publicKey = in.readByteArray();
+    const QByteArray privateKey = in.readByteArray();
+    const QByteArray secretKey = in.readByteArray();
+
+    // each custom parameter takes at least its size field, which bounds the count.
+    const quint32 customParameterCount = in.readUInt32();
+    QVector<QByteArray> customParameters;
+    if (in.ok && customParameterCount <= static_cast<quint32>(in.end - in.pos) / sizeof(quint32)) {
+        customParameters.reserve(customParameterCount);
+        for (quint32 i = 0; in.ok && i < customParameterCount; ++i) {
+            customParameters.append(in.readByteArray());
+        }
+    } else {
+        in.ok = false;
+    }
+
+    Sailfish::Crypto::Key::FilterData filterData;
+    if (hasFilterData) {
+        const quint32 filterDataCount = in.readUInt32();
+        if (in.ok && filterDataCount <= static_cast<quint32>(in.end - in.pos) / (2 * sizeof(quint32))) {
+            for (quint32 i = 0; in.ok && i < filterDataCount; ++i) {
+                const QString field = in.readString();
+                filterData.insert(field, in.readString());
+            }
+        } else {
+            in.ok = false;
+        }
+    }
+
+    if (!in.ok) {
+        qCWarning(lcSailfishCryptoSerialisation) << "Cannot deserialise key, truncated data of size:" << data.size();
         return Sailfish::Crypto::Key();
     }
 
+    Sailfish::Crypto::Key retn;
+    retn.setIdentifier(Sailfish::Crypto::Key::Identifier(name, collectionName));
+    retn.setOrigin(static_cast<Sailfish::Crypto::Key::Origin>(origin));
+    retn.setAlgorithm(static_cast<Sailfish::Crypto::Key::Algorithm>(algorithm));
+    retn.setOperations(static_cast<Sailfish::Crypto::Key::Operations>(operations));
+    retn.setBlockModes(static_cast<Sailfish::Crypto::Key::BlockModes>(blockModes));
+    retn.setEncryptionPaddings(static_cast<Sailfish::Crypto::Key::EncryptionPaddings>(encryptionPaddings));
+    retn.setSignaturePaddings(static_cast<Sailfish::Crypto::Key::SignaturePaddings>(signaturePaddings));
+    retn.setDigests(static_cast<Sailfish::Crypto::Key::Digests>(digests));
+    retn.setPublicKey(publicKey);
+    retn.setPrivateKey(privateKey);
+    retn.setSecretKey(secretKey);
+    retn.setValidityStart(fromTimestamp(validityStart));
+    retn.setValidityEnd(fromTimestamp(validityEnd));
+    retn.setCustomParameters(customParameters);
+    retn.setFilterData(filterData);
+    return retn;
+}
+
+// keys stored before the fixed layout was introduced are still read.
+Sailfish::Crypto::Key deserialiseStream(const QByteArray &data)
+{
+    QDataStream in(data);
+    in.skipRawData(KeyHeaderSize);
     in.setVersion(QDataStream::Qt_5_6);
 
     QString name, collectionName;
@@ -79,8 +238,6 @@ Sailfish::Crypto::Key::deserialise(const QByteArray &data)
 
     in >> customParameters;
 
-    buffer.close();
-
     Sailfish::Crypto::Key retn;
     retn.setIdentifier(Sailfish::Crypto::Key::Identifier(name, collectionName));
     retn.setOrigin(static_cast<Sailfish::Crypto::Key::Origin>(iorigin));
@@ -100,44 +257,95 @@ Sailfish::Crypto::Key::deserialise(const QByteArray &data)
     return retn;
 }
 
-QByteArray
-Sailfish::Crypto::Key::serialise(const Sailfish::Crypto::Key &key)
-{
-    QByteArray byteArray;
-    QBuffer buffer(&byteArray);
-    buffer.open(QIODevice::WriteOnly);
-
-    QDataStream out(&buffer);
+} // namespace
 
-    // Write a header with a "magic number" and a version
-    out << (quint32)0x4B657900; // Key\0
-    out << (qint32)100;         // version 1.0.0
+Sailfish::Crypto::Key
+Sailfish::Crypto::Key::deserialise(const QByteArray &data)
+{
+    if (data.size() < KeyHeaderSize) {
+        qCWarning(lcSailfishCryptoSerialisation) << "Cannot deserialise key, data too short:" << data.size();
+        return Sailfish::Crypto::Key();
+    }
 
-    // Set the output format version
-    out.setVersion(QDataStream::Qt_5_6);
+    const quint32 magic = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.constData()));
+    if (magic != KeyMagic) {
+        qCWarning(lcSailfishCryptoSerialisation) << "Cannot deserialise key, bad magic number:" << magic;
+        return Sailfish::Crypto::Key();
+    }
 
-    out << key.identifier().name();
-    out << key.identifier().collectionName();
+    const qint32 version = qFromBigEndian<qint32>(reinterpret_cast<const uchar *>(data.constData() + sizeof(quint32)));
+    if (version == KeyFilterDataLayoutVersion || version == KeyFixedLayoutVersion) {
+        return deserialiseFixedLayout(data, version == KeyFilterDataLayoutVersion);
+    } else if (version == KeyStreamVersion) {
+        return deserialiseStream(data);
+    }
 
-    out << static_cast<int>(key.origin());
-    out << static_cast<int>(key.algorithm());
-    out << static_cast<int>(key.operations());
-    out << static_cast<int>(key.blockModes());
-    out << static_cast<int>(key.encryptionPaddings());
-    out << static_cast<int>(key.signaturePaddings());
-    out << static_cast<int>(key.digests());
+    qCWarning(lcSailfishCryptoSerialisation) << "Cannot deserialise key, bad version number:" << version;
+    return Sailfish::Crypto::Key();
+}
 
-    out << key.publicKey();
-    out << key.privateKey();
-    out << key.secretKey();
+QByteArray
+Sailfish::Crypto::Key::serialise(const Sailfish::Crypto::Key &key)
+{
+    const QByteArray name = key.identifier().name().toUtf8();
+    const QByteArray collectionName = key.identifier().collectionName().toUtf8();
+    const QByteArray publicKey = key.publicKey();
+    const QByteArray privateKey = key.privateKey();
+    const QByteArray secretKey = key.secretKey();
+    const QVector<QByteArray> customParameters = key.customParameters();
+    const Sailfish::Crypto::Key::FilterData filterData = key.filterData();
+    QVector<QByteArray> filterDataStrings;
+    filterDataStrings.reserve(2 * filterData.size());
+    for (Sailfish::Crypto::Key::FilterData::const_iterator it = filterData.constBegin(); it != filterData.constEnd(); ++it) {
+        filterDataStrings.append(it.key().toUtf8());
+        filterDataStrings.append(it.value().toUtf8());
+    }
 
-    out << key.validityStart();
-    out << key.validityEnd();
+    // the blob is sized up front, and written in place.
+    int size = KeyHeaderSize + KeyFixedFieldsSize
+             + 7 * sizeof(quint32) + name.size() + collectionName.size()
+             + publicKey.size() + privateKey.size() + secretKey.size();
+    Q_FOREACH (const QByteArray &customParameter, customParameters) {
+        size += sizeof(quint32) + customParameter.size();
+    }
+    Q_FOREACH (const QByteArray &filterDataString, filterDataStrings) {
+        size += sizeof(quint32) + filterDataString.size();
+    }
 
-    out << key.customParameters();
+    QByteArray byteArray(size, Qt::Uninitialized);
+    char *out = byteArray.data();
+
+    qToBigEndian<quint32>(KeyMagic, reinterpret_cast<uchar *>(out));
+    qToBigEndian<qint32>(KeyFilterDataLayoutVersion, reinterpret_cast<uchar *>(out + sizeof(quint32)));
+    out += KeyHeaderSize;
+
+    appendUInt32(&out, static_cast<quint32>(key.origin()));
+    appendUInt32(&out, static_cast<quint32>(key.algorithm()));
+    appendUInt32(&out, static_cast<quint32>(key.operations()));
+    appendUInt32(&out, static_cast<quint32>(key.blockModes()));
+    appendUInt32(&out, static_cast<quint32>(key.encryptionPaddings()));
+    appendUInt32(&out, static_cast<quint32>(key.signaturePaddings()));
+    appendUInt32(&out, static_cast<quint32>(key.digests()));
+    appendInt64(&out, toTimestamp(key.validityStart()));
+    appendInt64(&out, toTimestamp(key.validityEnd()));
+
+    appendBytes(&out, name);
+    appendBytes(&out, collectionName);
+    appendBytes(&out, publicKey);
+    appendBytes(&out, privateKey);
+    appendBytes(&out, secretKey);
+
+    appendUInt32(&out, static_cast<quint32>(customParameters.size()));
+    Q_FOREACH (const QByteArray &customParameter, customParameters) {
+        appendBytes(&out, customParameter);
+    }
 
-    buffer.close();
+    appendUInt32(&out, static_cast<quint32>(filterData.size()));
+    Q_FOREACH (const QByteArray &filterDataString, filterDataStrings) {
+        appendBytes(&out, filterDataString);
+    }
 
+    Q_ASSERT(out == byteArray.constData() + byteArray.size());
     return byteArray;
 }
 
@@ -339,11 +547,7 @@ QDataStream& operator<<(QDataStream& out, const Sailfish::Crypto::CryptoPlugin::
 Sailfish::Crypto::CryptoPluginInfo
 Sailfish::Crypto::CryptoPluginInfo::deserialise(const QByteArray &data)
 {
-    QBuffer buffer;
-    buffer.setData(data);
-    buffer.open(QIODevice::ReadOnly);
-
-    QDataStream in(&buffer);
+    QDataStream in(data);
 
     quint32 magic;
     in >> magic;
@@ -381,8 +585,6 @@ Sailfish::Crypto::CryptoPluginInfo::deserialise(const QByteArray &data)
     in >> supportedDigests;
     in >> supportedOperations;
 
-    buffer.close();
-
     Sailfish::Crypto::CryptoPluginInfo retn;
     retn.setName(name);
     retn.setCanStoreKeys(canStoreKeys);
@@ -401,10 +603,7 @@ QByteArray
 Sailfish::Crypto::CryptoPluginInfo::serialise(const Sailfish::Crypto::CryptoPluginInfo &pluginInfo)
 {
     QByteArray byteArray;
-    QBuffer buffer(&byteArray);
-    buffer.open(QIODevice::WriteOnly);
-
-    QDataStream out(&buffer);
+    QDataStream out(&byteArray, QIODevice::WriteOnly);
 
     // Write a header with a "magic number" and a version
     out << (quint32)0x43504900; // CPI\0
@@ -423,8 +622,6 @@ Sailfish::Crypto::CryptoPluginInfo::serialise(const Sailfish::Crypto::CryptoPlug
     out << pluginInfo.supportedDigests();
     out << pluginInfo.supportedOperations();
 
-    buffer.close();
-
     return byteArray;
 }
 
@@ -719,7 +916,7 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, Sailfish::Crypto:
     QString message;
 
     argument.beginStructure();
-    argument >> code >> errorCode >> message;
+    argument >> code >> errorCode >> storageErrorCode >> message;
     argument.endStructure();
 
     result.setCode(static_cast<Sailfish::Crypto::Result::ResultCode>(code));
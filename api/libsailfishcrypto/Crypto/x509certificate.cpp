@@ -6,40 +6,323 @@
  */
 
 #include "Crypto/x509certificate.h"
-#include "Crypto/certificate_p.h"
-
-namespace Sailfish {
-    namespace Crypto {
-        /*!
-         * \internal
-         */
-        class X509CertificateData : public Sailfish::Crypto::CertificateData
+#include "Crypto/x509certificate_p.h"
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+namespace {
+    // DER tags of the elements of a certificate, as per X.690 and RFC5280.
+    const quint8 TagBoolean = 0x01;
+    const quint8 TagInteger = 0x02;
+    const quint8 TagBitString = 0x03;
+    const quint8 TagOctetString = 0x04;
+    const quint8 TagObjectIdentifier = 0x06;
+    const quint8 TagUtf8String = 0x0c;
+    const quint8 TagUtcTime = 0x17;
+    const quint8 TagGeneralizedTime = 0x18;
+    const quint8 TagBmpString = 0x1e;
+    const quint8 TagSequence = 0x30;
+    const quint8 TagSet = 0x31;
+    const quint8 TagVersion = 0xa0;            // [0] EXPLICIT
+    const quint8 TagIssuerUniqueId = 0x81;     // [1] IMPLICIT
+    const quint8 TagSubjectUniqueId = 0x82;    // [2] IMPLICIT
+    const quint8 TagExtensions = 0xa3;         // [3] EXPLICIT
+
+    // Reads the elements of a DER encoding in turn.  Once an element is
+    // missing or malformed, every later read fails too.
+    class DerReader
+    {
+    public:
+        explicit DerReader(const QByteArray &der) : m_der(der), m_pos(0), m_ok(true) {}
+
+        bool ok() const { return m_ok; }
+        bool atEnd() const { return m_pos >= m_der.size(); }
+        bool nextIs(quint8 tag) const { return m_ok && !atEnd() && quint8(m_der.at(m_pos)) == tag; }
+
+        // Returns the contents of the next element, whatever its tag.
+        QByteArray readAny(quint8 *tag)
+        {
+            if (!m_ok || m_pos + 2 > m_der.size()) {
+                m_ok = false;
+                return QByteArray();
+            }
+            *tag = quint8(m_der.at(m_pos));
+            int offset = m_pos + 1;
+            qint64 length = quint8(m_der.at(offset++));
+            if (length & 0x80) {
+                const int lengthBytes = length & 0x7f;
+                if (lengthBytes == 0 || lengthBytes > 4 || offset + lengthBytes > m_der.size()) {
+                    m_ok = false;
+                    return QByteArray();
+                }
+                length = 0;
+                for (int i = 0; i < lengthBytes; ++i) {
+                    length = (length << 8) | quint8(m_der.at(offset++));
+                }
+            }
+            if (length > m_der.size() - offset) {
+                m_ok = false;
+                return QByteArray();
+            }
+            m_pos = offset + int(length);
+            return m_der.mid(offset, int(length));
+        }
+
+        // Returns the contents of the next element, which must have the given tag.
+        QByteArray read(quint8 tag)
         {
-        public:
-            X509CertificateData() : Sailfish::Crypto::CertificateData(Sailfish::Crypto::Certificate::X509) {}
-            ~X509CertificateData() {}
-            Sailfish::Crypto::CertificateData *clone() const {
-                Sailfish::Crypto::X509CertificateData *retn = new Sailfish::Crypto::X509CertificateData;
-                retn->tbsCertificate = this->tbsCertificate;
-                retn->signatureAlgorithm = this->signatureAlgorithm;
-                retn->signatureValue = this->signatureValue;
-                return retn;
+            if (!nextIs(tag)) {
+                m_ok = false;
+                return QByteArray();
+            }
+            quint8 readTag = 0;
+            return readAny(&readTag);
+        }
+
+    private:
+        QByteArray m_der;
+        int m_pos;
+        bool m_ok;
+    };
+
+    QString decodeObjectIdentifier(const QByteArray &contents)
+    {
+        QStringList arcs;
+        quint64 value = 0;
+        for (int i = 0; i < contents.size(); ++i) {
+            value = (value << 7) | (quint8(contents.at(i)) & 0x7f);
+            if (quint8(contents.at(i)) & 0x80) {
+                continue;
+            }
+            if (arcs.isEmpty()) {
+                // the first two arcs are combined into the first subidentifier.
+                const quint64 first = qMin(value / 40, Q_UINT64_C(2));
+                arcs << QString::number(first) << QString::number(value - first * 40);
+            } else {
+                arcs << QString::number(value);
+            }
+            value = 0;
+        }
+        return arcs.join(QLatin1Char('.'));
+    }
+
+    QDateTime decodeTime(quint8 tag, const QByteArray &contents)
+    {
+        // DER requires the seconds and UTC ("Z") to be given.  UTCTime years
+        // from 50 onwards are in the twentieth century, as per RFC5280.
+        QString time = QString::fromLatin1(contents);
+        if (tag == TagUtcTime) {
+            time.prepend(time.left(2).toInt() >= 50 ? QLatin1String("19") : QLatin1String("20"));
+        } else if (tag != TagGeneralizedTime) {
+            return QDateTime();
+        }
+        if (time.size() != 15 || !time.endsWith(QLatin1Char('Z'))) {
+            return QDateTime();
+        }
+        return QDateTime(QDate::fromString(time.left(8), QStringLiteral("yyyyMMdd")),
+                         QTime::fromString(time.mid(8, 6), QStringLiteral("HHmmss")),
+                         Qt::UTC);
+    }
+
+    QString decodeString(quint8 tag, const QByteArray &contents)
+    {
+        if (tag == TagUtf8String) {
+            return QString::fromUtf8(contents);
+        } else if (tag == TagBmpString) {
+            QString decoded;
+            for (int i = 0; i + 1 < contents.size(); i += 2) {
+                decoded.append(QChar(ushort((quint8(contents.at(i)) << 8) | quint8(contents.at(i + 1)))));
+            }
+            return decoded;
+        }
+        // PrintableString, IA5String etc.
+        return QString::fromLatin1(contents);
+    }
+
+    // The octets of an integer or identifier, separated by colons.
+    QString separatedOctets(const QByteArray &contents)
+    {
+        QStringList octets;
+        for (int i = 0; i < contents.size(); ++i) {
+            octets << QString::fromLatin1(contents.mid(i, 1).toHex());
+        }
+        return octets.join(QLatin1Char(':'));
+    }
+
+    QString attributeTypeName(const QString &oid)
+    {
+        if (oid == QLatin1String("2.5.4.3")) return QStringLiteral("CN");
+        if (oid == QLatin1String("2.5.4.11")) return QStringLiteral("OU");
+        if (oid == QLatin1String("2.5.4.10")) return QStringLiteral("O");
+        if (oid == QLatin1String("2.5.4.7")) return QStringLiteral("L");
+        if (oid == QLatin1String("2.5.4.8")) return QStringLiteral("S");
+        if (oid == QLatin1String("2.5.4.6")) return QStringLiteral("C");
+        if (oid == QLatin1String("2.5.4.46")) return QStringLiteral("DNQualifier");
+        if (oid == QLatin1String("2.5.4.5")) return QStringLiteral("SerialNumber");
+        return oid;
+    }
+
+    Sailfish::Crypto::X509Certificate::AlgorithmIdentifier decodeAlgorithmIdentifier(DerReader *reader)
+    {
+        // the parameters are specific to each algorithm, and aren't decoded.
+        DerReader algorithm(reader->read(TagSequence));
+        const QString oid = decodeObjectIdentifier(algorithm.read(TagObjectIdentifier));
+        return Sailfish::Crypto::X509Certificate::AlgorithmIdentifier(algorithm.ok() ? oid : QString());
+    }
+
+    bool decodeName(DerReader *reader, Sailfish::Crypto::X509Certificate::TbsCertificate::EntityName *name)
+    {
+        DerReader rdnSequence(reader->read(TagSequence));
+        while (rdnSequence.ok() && !rdnSequence.atEnd()) {
+            DerReader rdn(rdnSequence.read(TagSet));
+            while (rdn.ok() && !rdn.atEnd()) {
+                DerReader attribute(rdn.read(TagSequence));
+                const QString type = attributeTypeName(decodeObjectIdentifier(attribute.read(TagObjectIdentifier)));
+                quint8 valueTag = 0;
+                const QByteArray value = attribute.readAny(&valueTag);
+                if (!attribute.ok()) {
+                    return false;
+                }
+                name->relativeDistinguishedNames.append(
+                        Sailfish::Crypto::X509Certificate::TbsCertificate::RelativeDistinguishedName(
+                                type, decodeString(valueTag, value)));
+            }
+            if (!rdn.ok()) {
+                return false;
             }
-            Sailfish::Crypto::X509Certificate::TbsCertificate tbsCertificate;
-            Sailfish::Crypto::X509Certificate::AlgorithmIdentifier signatureAlgorithm;
-            QByteArray signatureValue;
-
-            static X509CertificateData *clone(const X509CertificateData &other) {
-                X509CertificateData *retn = new X509CertificateData;
-                retn->tbsCertificate = other.tbsCertificate;
-                retn->signatureAlgorithm = other.signatureAlgorithm;
-                retn->signatureValue = other.signatureValue;
-                return retn;
+        }
+        return reader->ok() && rdnSequence.ok();
+    }
+
+    bool decodeExtensions(DerReader *reader, QVector<Sailfish::Crypto::X509Certificate::TbsCertificate::Extension> *extensions)
+    {
+        DerReader explicitTag(reader->read(TagExtensions));
+        DerReader sequence(explicitTag.read(TagSequence));
+        while (sequence.ok() && !sequence.atEnd()) {
+            DerReader extension(sequence.read(TagSequence));
+            const QString extnID = decodeObjectIdentifier(extension.read(TagObjectIdentifier));
+            const bool critical = extension.nextIs(TagBoolean) && extension.read(TagBoolean) != QByteArray(1, '\0');
+            // the value is encoded as specified by the extension, so is given in hex.
+            const QByteArray extnValue = extension.read(TagOctetString);
+            if (!extension.ok()) {
+                return false;
+            }
+            extensions->append(Sailfish::Crypto::X509Certificate::TbsCertificate::Extension(
+                    extnID, critical, QString::fromLatin1(extnValue.toHex())));
+        }
+        return explicitTag.ok() && sequence.ok();
+    }
+
+    // Decodes the fields of a DER-encoded certificate, as per RFC5280.
+    // Returns false if the encoding is not a valid certificate.
+    bool decodeFields(const QByteArray &encoded, Sailfish::Crypto::X509CertificateFields *fields)
+    {
+        DerReader der(encoded);
+        DerReader certificate(der.read(TagSequence));
+        DerReader tbs(certificate.read(TagSequence));
+
+        Sailfish::Crypto::X509Certificate::TbsCertificate &tbsCertificate(fields->tbsCertificate);
+        int version = 0;  // v1
+        if (tbs.nextIs(TagVersion)) {
+            DerReader explicitTag(tbs.read(TagVersion));
+            const QByteArray value = explicitTag.read(TagInteger);
+            if (!explicitTag.ok() || value.size() != 1) {
+                return false;
             }
-        };
+            version = quint8(value.at(0));
+        }
+        tbsCertificate.version = QString::number(version + 1);
+        tbsCertificate.serialNumber = separatedOctets(tbs.read(TagInteger));
+        tbsCertificate.signature = decodeAlgorithmIdentifier(&tbs);
+        if (!decodeName(&tbs, &tbsCertificate.issuer)) {
+            return false;
+        }
+
+        DerReader validity(tbs.read(TagSequence));
+        quint8 timeTag = 0;
+        QByteArray time = validity.readAny(&timeTag);
+        tbsCertificate.validity.notBefore = decodeTime(timeTag, time);
+        time = validity.readAny(&timeTag);
+        tbsCertificate.validity.notAfter = decodeTime(timeTag, time);
+        if (!validity.ok() || !tbsCertificate.validity.notBefore.isValid() || !tbsCertificate.validity.notAfter.isValid()) {
+            return false;
+        }
+
+        if (!decodeName(&tbs, &tbsCertificate.subject)) {
+            return false;
+        }
+        DerReader subjectPublicKeyInfo(tbs.read(TagSequence));
+        tbsCertificate.subjectPublicKeyInfo.algorithm = decodeAlgorithmIdentifier(&subjectPublicKeyInfo);
+        // bit strings start with the number of unused bits, which is zero for keys and signatures.
+        tbsCertificate.subjectPublicKeyInfo.subjectPublicKey = subjectPublicKeyInfo.read(TagBitString).mid(1);
+        if (!subjectPublicKeyInfo.ok()) {
+            return false;
+        }
+
+        if (tbs.nextIs(TagIssuerUniqueId)) {
+            tbsCertificate.issuerUniqueID = separatedOctets(tbs.read(TagIssuerUniqueId).mid(1));
+        }
+        if (tbs.nextIs(TagSubjectUniqueId)) {
+            tbsCertificate.subjectUniqueID = separatedOctets(tbs.read(TagSubjectUniqueId).mid(1));
+        }
+        if (tbs.nextIs(TagExtensions) && !decodeExtensions(&tbs, &tbsCertificate.extensions)) {
+            return false;
+        }
+
+        fields->signatureAlgorithm = decodeAlgorithmIdentifier(&certificate);
+        fields->signatureValue = certificate.read(TagBitString).mid(1);
+        return der.ok() && tbs.ok() && certificate.ok();
     }
 }
 
+Sailfish::Crypto::X509CertificateData::X509CertificateData()
+    : Sailfish::Crypto::CertificateData(Sailfish::Crypto::Certificate::X509)
+    , m_fields(new Sailfish::Crypto::X509CertificateFields)
+{
+}
+
+Sailfish::Crypto::X509CertificateData::X509CertificateData(const QByteArray &encoded)
+    : Sailfish::Crypto::CertificateData(Sailfish::Crypto::Certificate::X509)
+{
+    m_encoded = encoded;
+
+    // the fields are decoded here rather than on first use, so that they
+    // are never modified once the data may be shared with other threads.
+    Sailfish::Crypto::X509CertificateFields *fields = new Sailfish::Crypto::X509CertificateFields;
+    if (!decodeFields(encoded, fields)) {
+        *fields = Sailfish::Crypto::X509CertificateFields();
+    }
+    m_fields = QSharedPointer<const Sailfish::Crypto::X509CertificateFields>(fields);
+}
+
+Sailfish::Crypto::X509CertificateData::~X509CertificateData()
+{
+}
+
+Sailfish::Crypto::CertificateData *Sailfish::Crypto::X509CertificateData::clone() const
+{
+    // the decoded fields are shared rather than copied, as they are never modified in place.
+    Sailfish::Crypto::X509CertificateData *retn = new Sailfish::Crypto::X509CertificateData;
+    retn->m_encoded = m_encoded;
+    retn->m_fields = m_fields;
+    return retn;
+}
+
+const Sailfish::Crypto::X509CertificateFields &Sailfish::Crypto::X509CertificateData::fields() const
+{
+    return *m_fields;
+}
+
+Sailfish::Crypto::X509CertificateFields *Sailfish::Crypto::X509CertificateData::detachedFields()
+{
+    // the encoding no longer matches the certificate once its fields are modified.
+    Sailfish::Crypto::X509CertificateFields *detached = new Sailfish::Crypto::X509CertificateFields(*m_fields);
+    m_fields = QSharedPointer<const Sailfish::Crypto::X509CertificateFields>(detached);
+    m_encoded.clear();
+    return detached;
+}
+
 namespace {
     /*!
      * \brief internal
@@ -61,17 +344,14 @@ namespace {
 /*!
  * \brief Returns an X509 certificate populated from the data contained in the given \a certificate.
  *
- * This creates a deep-copy of the underlying data.
+ * The data is implicitly shared with the given \a certificate, and only copied when either is modified.
  */
 Sailfish::Crypto::X509Certificate
 Sailfish::Crypto::X509Certificate::fromCertificate(
         const Sailfish::Crypto::Certificate &certificate)
 {
     if (certificate.type() == Sailfish::Crypto::Certificate::X509) {
-        //return Sailfish::Crypto::X509Certificate(certificate);
-        return Sailfish::Crypto::X509Certificate(
-                    Sailfish::Crypto::X509CertificateData::clone(
-                        *(const_d_ptr(certificate.m_data))));
+        return Sailfish::Crypto::X509Certificate(certificate);
     } else {
         return Sailfish::Crypto::X509Certificate();
     }
@@ -89,7 +369,7 @@ Sailfish::Crypto::X509Certificate::X509Certificate(Sailfish::Crypto::X509Certifi
  * \internal
  */
 Sailfish::Crypto::X509Certificate::X509Certificate(const Sailfish::Crypto::Certificate &certificate)
-    : Sailfish::Crypto::Certificate(Sailfish::Crypto::X509CertificateData::clone(*(const_d_ptr(certificate.m_data))))
+    : Sailfish::Crypto::Certificate(certificate)
 {
 }
 
@@ -104,10 +384,10 @@ Sailfish::Crypto::X509Certificate::X509Certificate()
 /*!
  * \brief Constructs an X509 certificate populated from the data contained in the \a other X509 certificate.
  *
- * This creates a deep-copy of the underlying data.
+ * The data is implicitly shared with the \a other certificate, and only copied when either is modified.
  */
 Sailfish::Crypto::X509Certificate::X509Certificate(const Sailfish::Crypto::X509Certificate &other)
-    : Sailfish::Crypto::Certificate(Sailfish::Crypto::X509CertificateData::clone(*(const_d_ptr(other.m_data))))
+    : Sailfish::Crypto::Certificate(other)
 {
 }
 
@@ -116,7 +396,7 @@ Sailfish::Crypto::X509Certificate::X509Certificate(const Sailfish::Crypto::X509C
  */
 Sailfish::Crypto::X509Certificate::~X509Certificate()
 {
-    // base class deletes m_data.
+    // base class releases m_data.
 }
 
 /*!
@@ -124,7 +404,7 @@ Sailfish::Crypto::X509Certificate::~X509Certificate()
  */
 QByteArray Sailfish::Crypto::X509Certificate::publicKey() const
 {
-    return const_d_ptr(m_data)->tbsCertificate.subjectPublicKeyInfo.subjectPublicKey;
+    return const_d_ptr(m_data.constData())->fields().tbsCertificate.subjectPublicKeyInfo.subjectPublicKey;
 }
 
 /*!
@@ -132,9 +412,8 @@ QByteArray Sailfish::Crypto::X509Certificate::publicKey() const
  */
 QByteArray Sailfish::Crypto::X509Certificate::toEncoded(Sailfish::Crypto::Certificate::Encoding encoding) const
 {
-    // TODO!
-    Q_UNUSED(encoding);
-    return QByteArray();
+    // TODO: encode certificates which were constructed from their fields.
+    return Sailfish::Crypto::Certificate::toEncoded(encoding);
 }
 
 /*!
@@ -143,7 +422,7 @@ QByteArray Sailfish::Crypto::X509Certificate::toEncoded(Sailfish::Crypto::Certif
 Sailfish::Crypto::X509Certificate::TbsCertificate
 Sailfish::Crypto::X509Certificate::tbsCertificate() const
 {
-    return const_d_ptr(m_data)->tbsCertificate;
+    return const_d_ptr(m_data.constData())->fields().tbsCertificate;
 }
 
 /*!
@@ -152,7 +431,7 @@ Sailfish::Crypto::X509Certificate::tbsCertificate() const
 void Sailfish::Crypto::X509Certificate::setTbsCertificate(
         const Sailfish::Crypto::X509Certificate::TbsCertificate &certificate)
 {
-    d_ptr(m_data)->tbsCertificate = certificate;
+    d_ptr(m_data.data())->detachedFields()->tbsCertificate = certificate;
 }
 
 /*!
@@ -161,7 +440,7 @@ void Sailfish::Crypto::X509Certificate::setTbsCertificate(
 Sailfish::Crypto::X509Certificate::AlgorithmIdentifier
 Sailfish::Crypto::X509Certificate::signatureAlgorithm() const
 {
-    return const_d_ptr(m_data)->signatureAlgorithm;
+    return const_d_ptr(m_data.constData())->fields().signatureAlgorithm;
 }
 
 /*!
@@ -170,7 +449,7 @@ Sailfish::Crypto::X509Certificate::signatureAlgorithm() const
 void Sailfish::Crypto::X509Certificate::setSignatureAlgorithm(
         const Sailfish::Crypto::X509Certificate::AlgorithmIdentifier &algorithm)
 {
-    d_ptr(m_data)->signatureAlgorithm = algorithm;
+    d_ptr(m_data.data())->detachedFields()->signatureAlgorithm = algorithm;
 }
 
 /*!
@@ -178,7 +457,7 @@ void Sailfish::Crypto::X509Certificate::setSignatureAlgorithm(
  */
 QByteArray Sailfish::Crypto::X509Certificate::signatureValue() const
 {
-    return const_d_ptr(m_data)->signatureValue;
+    return const_d_ptr(m_data.constData())->fields().signatureValue;
 }
 
 /*!
@@ -186,5 +465,5 @@ QByteArray Sailfish::Crypto::X509Certificate::signatureValue() const
  */
 void Sailfish::Crypto::X509Certificate::setSignatureValue(const QByteArray &signature)
 {
-    d_ptr(m_data)->signatureValue = signature;
+    d_ptr(m_data.data())->detachedFields()->signatureValue = signature;
 }
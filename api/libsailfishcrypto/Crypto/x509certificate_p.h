@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef LIBSAILFISHCRYPTO_X509CERTIFICATE_P_H
+#define LIBSAILFISHCRYPTO_X509CERTIFICATE_P_H
+
+#include "Crypto/x509certificate.h"
+#include "Crypto/certificate_p.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QSharedPointer>
+
+namespace Sailfish {
+
+namespace Crypto {
+
+// The decoded fields of an X509 certificate, which are shared
+// (and never modified) by every copy of the certificate.
+struct X509CertificateFields
+{
+    Sailfish::Crypto::X509Certificate::TbsCertificate tbsCertificate;
+    Sailfish::Crypto::X509Certificate::AlgorithmIdentifier signatureAlgorithm;
+    QByteArray signatureValue;
+};
+
+class X509CertificateData : public Sailfish::Crypto::CertificateData
+{
+public:
+    X509CertificateData();
+    explicit X509CertificateData(const QByteArray &encoded);
+    ~X509CertificateData();
+    Sailfish::Crypto::CertificateData *clone() const Q_DECL_OVERRIDE;
+
+    // the fields decoded from the encoded certificate when it was constructed,
+    // or empty if it couldn't be decoded.
+    const Sailfish::Crypto::X509CertificateFields &fields() const;
+    // returns fields which are not shared with any other copy, for modification.
+    Sailfish::Crypto::X509CertificateFields *detachedFields();
+
+    QSharedPointer<const Sailfish::Crypto::X509CertificateFields> m_fields;
+};
+
+} // namespace Crypto
+
+} // namespace Sailfish
+
+#endif // LIBSAILFISHCRYPTO_X509CERTIFICATE_P_H
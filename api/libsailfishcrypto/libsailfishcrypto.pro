@@ -27,7 +27,8 @@ PRIVATE_HEADERS += \
     $$PWD/Crypto/cryptodaemonconnection_p.h \
     $$PWD/Crypto/cryptomanager_p.h \
     $$PWD/Crypto/extensionplugins_p.h \
-    $$PWD/Crypto/key_p.h
+    $$PWD/Crypto/key_p.h \
+    $$PWD/Crypto/x509certificate_p.h
 
 HEADERS += \
     $$PUBLIC_HEADERS \
@@ -283,6 +283,27 @@ Sailfish::Secrets::EncryptionPlugin::~EncryptionPlugin()
 {
 }
 
+void
+Sailfish::Secrets::EncryptionPlugin::releaseKey(const QByteArray &key)
+{
+    Q_UNUSED(key);
+}
+
+bool
+Sailfish::Secrets::EncryptionPlugin::supportsAsynchronousOperations() const
+{
+    return false;
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::EncryptionPlugin::beginDecryptSecret(quint64 operationId, const QByteArray &encrypted, const QByteArray &key)
+{
+    QByteArray plaintext;
+    const Sailfish::Secrets::Result result = decryptSecret(encrypted, key, &plaintext);
+    emit decryptSecretCompleted(operationId, result, plaintext);
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+}
+
 Sailfish::Secrets::StoragePlugin::StoragePlugin(QObject *parent)
     : QObject(parent)
 {
@@ -292,6 +313,105 @@ Sailfish::Secrets::StoragePlugin::~StoragePlugin()
 {
 }
 
+Sailfish::Secrets::Result
+Sailfish::Secrets::StoragePlugin::getSecrets(const QString &collectionName, const QStringList &secretNames, QMap<QString, QByteArray> *secrets)
+{
+    Q_FOREACH (const QString &secretName, secretNames) {
+        QByteArray secret;
+        const Sailfish::Secrets::Result result = getSecret(collectionName, secretName, &secret);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            secrets->insert(secretName, secret);
+        } else if (result.errorCode() != Sailfish::Secrets::Result::InvalidSecretError) {
+            return result;
+        }
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::StoragePlugin::setSecrets(const QString &collectionName, const QMap<QString, QByteArray> &secrets)
+{
+    for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); it++) {
+        const Sailfish::Secrets::Result result = setSecret(collectionName, it.key(), it.value());
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::StoragePlugin::removeSecrets(const QString &collectionName, const QStringList &secretNames)
+{
+    Q_FOREACH (const QString &secretName, secretNames) {
+        const Sailfish::Secrets::Result result = removeSecret(collectionName, secretName);
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::StoragePlugin::enumerateSecrets(const QString &, const QString &, int, QMap<QString, QByteArray> *, QString *)
+{
+    // the interface has no way to find the names of the stored secrets.
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                     QLatin1String("This storage plugin does not support enumerating secrets"));
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::StoragePlugin::createCollectionWithDurability(const QString &collectionName, Sailfish::Secrets::StoragePlugin::Durability durability)
+{
+    // storing the collection more durably than requested is always safe.
+    Q_UNUSED(durability);
+    return createCollection(collectionName);
+}
+
+void
+Sailfish::Secrets::StoragePlugin::setWriteBatching(bool)
+{
+}
+
+bool
+Sailfish::Secrets::StoragePlugin::hasPendingWrites() const
+{
+    return false;
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::StoragePlugin::flush()
+{
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+bool
+Sailfish::Secrets::StoragePlugin::shareDatabaseConnection(const QString &, const QString &, QMutex *)
+{
+    return false;
+}
+
+int
+Sailfish::Secrets::StoragePlugin::performMaintenance(int)
+{
+    return 0;
+}
+
+bool
+Sailfish::Secrets::StoragePlugin::supportsAsynchronousOperations() const
+{
+    return false;
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::StoragePlugin::beginGetSecret(quint64 operationId, const QString &collectionName, const QString &secretName)
+{
+    QByteArray secret;
+    const Sailfish::Secrets::Result result = getSecret(collectionName, secretName, &secret);
+    emit getSecretCompleted(operationId, result, secret);
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+}
+
 Sailfish::Secrets::EncryptedStoragePlugin::EncryptedStoragePlugin(QObject *parent)
     : QObject(parent)
 {
@@ -301,6 +421,53 @@ Sailfish::Secrets::EncryptedStoragePlugin::~EncryptedStoragePlugin()
 {
 }
 
+Sailfish::Secrets::Result
+Sailfish::Secrets::EncryptedStoragePlugin::getSecrets(const QString &collectionName, const QStringList &secretNames, QMap<QString, QByteArray> *secrets)
+{
+    Q_FOREACH (const QString &secretName, secretNames) {
+        QByteArray secret;
+        const Sailfish::Secrets::Result result = getSecret(collectionName, secretName, &secret);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            secrets->insert(secretName, secret);
+        } else if (result.errorCode() != Sailfish::Secrets::Result::InvalidSecretError) {
+            return result;
+        }
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::EncryptedStoragePlugin::setSecrets(const QString &collectionName, const QMap<QString, QByteArray> &secrets)
+{
+    for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); it++) {
+        const Sailfish::Secrets::Result result = setSecret(collectionName, it.key(), it.value());
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::EncryptedStoragePlugin::removeSecrets(const QString &collectionName, const QStringList &secretNames)
+{
+    Q_FOREACH (const QString &secretName, secretNames) {
+        const Sailfish::Secrets::Result result = removeSecret(collectionName, secretName);
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::EncryptedStoragePlugin::enumerateSecrets(const QString &, const QString &, int, QMap<QString, QByteArray> *, QString *)
+{
+    // the interface has no way to find the names of the stored secrets.
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                     QLatin1String("This storage plugin does not support enumerating secrets"));
+}
+
 Sailfish::Secrets::AuthenticationPlugin::AuthenticationPlugin(QObject *parent)
     : QObject(parent)
 {
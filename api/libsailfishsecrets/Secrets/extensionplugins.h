@@ -13,13 +13,18 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QMap>
 #include <QtCore/QByteArray>
 #include <QtCore/QVector>
 
-#define Sailfish_Secrets_StoragePlugin_IID "org.sailfishos.secrets.StoragePlugin/1.0"
-#define Sailfish_Secrets_EncryptionPlugin_IID "org.sailfishos.secrets.EncryptionPlugin/1.0"
-#define Sailfish_Secrets_EncryptedStoragePlugin_IID "org.sailfishos.secrets.EncryptedStoragePlugin/1.0"
+QT_BEGIN_NAMESPACE
+class QMutex;
+QT_END_NAMESPACE
+
+#define Sailfish_Secrets_StoragePlugin_IID "org.sailfishos.secrets.StoragePlugin/2.0"
+#define Sailfish_Secrets_EncryptionPlugin_IID "org.sailfishos.secrets.EncryptionPlugin/2.0"
+#define Sailfish_Secrets_EncryptedStoragePlugin_IID "org.sailfishos.secrets.EncryptedStoragePlugin/2.0"
 #define Sailfish_Secrets_AuthenticationPlugin_IID "org.sailfishos.secrets.AuthenticationPlugin/1.0"
 
 namespace Sailfish {
@@ -41,7 +46,8 @@ public:
 
     enum EncryptionAlgorithm {
         NoAlgorithm = 0,
-        AES_256_CBC
+        AES_256_CBC,
+        AES_256_GCM     // authenticated, with a random nonce stored with each ciphertext
     };
     Q_ENUM(EncryptionAlgorithm)
 
@@ -54,8 +60,25 @@ public:
     virtual Sailfish::Secrets::EncryptionPlugin::EncryptionType encryptionType() const = 0;
     virtual Sailfish::Secrets::EncryptionPlugin::EncryptionAlgorithm encryptionAlgorithm() const = 0;
 
+    // These may be called concurrently from multiple threads (e.g. when prefetching a collection).
     virtual Sailfish::Secrets::Result encryptSecret(const QByteArray &plaintext, const QByteArray &key, QByteArray *encrypted) = 0;
     virtual Sailfish::Secrets::Result decryptSecret(const QByteArray &encrypted, const QByteArray &key, QByteArray *plaintext) = 0;
+
+    // Called when a key is no longer in use (e.g. its collection has been relocked),
+    // so that any material derived from it may be discarded.  The default does nothing.
+    virtual void releaseKey(const QByteArray &key);
+
+    // Plugins backed by slow hardware (e.g. a secure element) may decrypt asynchronously,
+    // so that the daemon can serve other clients in the meantime.  beginDecryptSecret()
+    // returns Pending once the operation has started, and decryptSecretCompleted() is later
+    // emitted with the same operationId (possibly from another thread).  The daemon only
+    // uses the asynchronous variant if supportsAsynchronousOperations() returns true.
+    // The default implementations return false, and decrypt via decryptSecret() before returning.
+    virtual bool supportsAsynchronousOperations() const;
+    virtual Sailfish::Secrets::Result beginDecryptSecret(quint64 operationId, const QByteArray &encrypted, const QByteArray &key);
+
+Q_SIGNALS:
+    void decryptSecretCompleted(quint64 operationId, const Sailfish::Secrets::Result &result, const QByteArray &plaintext);
 };
 
 class EncryptionPluginInfoPrivate;
@@ -94,6 +117,13 @@ public:
     };
     Q_ENUM(StorageType)
 
+    enum Durability {
+        FullDurability = 0,         // survives power loss, every commit is synced
+        NormalDurability,           // survives a crash of the daemon, but the most recent commits may be lost on power loss
+        InMemoryDurability          // stored in-memory only, lost when the daemon exits
+    };
+    Q_ENUM(Durability)
+
     StoragePlugin(QObject *parent = Q_NULLPTR);
     virtual ~StoragePlugin();
 
@@ -108,12 +138,65 @@ public:
     virtual Sailfish::Secrets::Result getSecret(const QString &collectionName, const QString &secretName, QByteArray *secret) = 0;
     virtual Sailfish::Secrets::Result removeSecret(const QString &collectionName, const QString &secretName) = 0;
 
+    // secrets which don't exist are omitted from the returned map.
+    // the default implementation calls getSecret() for each secret.
+    virtual Sailfish::Secrets::Result getSecrets(const QString &collectionName, const QStringList &secretNames, QMap<QString, QByteArray> *secrets);
+    // the default implementation calls setSecret() for each secret.
+    virtual Sailfish::Secrets::Result setSecrets(const QString &collectionName, const QMap<QString, QByteArray> &secrets);
+    // secrets which don't exist are ignored.
+    // the default implementation calls removeSecret() for each secret.
+    virtual Sailfish::Secrets::Result removeSecrets(const QString &collectionName, const QStringList &secretNames);
+    // returns up to maxCount secrets whose names sort after the given cursor (or from the
+    // first secret, if the cursor is empty), and the cursor from which to continue, which
+    // is empty once every secret has been returned.
+    // the default implementation returns OperationNotSupportedError.
+    virtual Sailfish::Secrets::Result enumerateSecrets(const QString &collectionName, const QString &cursor, int maxCount,
+                                                       QMap<QString, QByteArray> *secrets, QString *nextCursor);
+
+    // the default implementation calls createCollection(), i.e. stores the collection with FullDurability.
+    virtual Sailfish::Secrets::Result createCollectionWithDurability(const QString &collectionName, Sailfish::Secrets::StoragePlugin::Durability durability);
+
     virtual Sailfish::Secrets::Result reencryptSecrets(
             const QString &collectionName,          // if non-empty, all secrets in this collection will be re-encrypted
             const QVector<QString> &secretNames,    // if collectionName is empty, these standalone secrets will be re-encrypted.
             const QByteArray &oldkey,
             const QByteArray &newkey,
             Sailfish::Secrets::EncryptionPlugin *plugin) = 0;
+
+    // when enabled, the plugin may defer making writes durable until flush() is called.
+    // the default implementations do not batch writes.
+    virtual void setWriteBatching(bool enabled);
+    virtual bool hasPendingWrites() const;
+    virtual Sailfish::Secrets::Result flush();
+
+    // first-party plugins which store their data via QtSql's sqlite driver may move
+    // onto the given connection (attaching their database to it as schemaName),
+    // so that their writes are committed atomically with the daemon's metadata.
+    // The accessMutex must be held while the connection is used.
+    // The default implementation does not support this, and returns false.
+    virtual bool shareDatabaseConnection(const QString &connectionName, const QString &schemaName, QMutex *accessMutex);
+
+    // called periodically while the daemon is idle, so that the plugin may checkpoint,
+    // compact or otherwise maintain its storage using at most roughly pageBudget pages
+    // (of 4 KiB) of I/O.  Returns the number of pages used, or -1 if the storage was busy.
+    // The default implementation does nothing, and returns 0.
+    virtual int performMaintenance(int pageBudget);
+
+    // Plugins backed by slow hardware (e.g. a secure peripheral) may read asynchronously,
+    // so that the daemon can serve other clients in the meantime.  beginGetSecret()
+    // returns Pending once the operation has started, and getSecretCompleted() is later
+    // emitted with the same operationId (possibly from another thread).  The daemon only
+    // uses the asynchronous variant if supportsAsynchronousOperations() returns true.
+    // The default implementations return false, and read via getSecret() before returning.
+    virtual bool supportsAsynchronousOperations() const;
+    virtual Sailfish::Secrets::Result beginGetSecret(quint64 operationId, const QString &collectionName, const QString &secretName);
+
+Q_SIGNALS:
+    void getSecretCompleted(quint64 operationId, const Sailfish::Secrets::Result &result, const QByteArray &secret);
+
+    // may be emitted during reencryptSecrets() by plugins which re-encrypt in chunks.
+    // the collectionName is empty when standalone secrets are being re-encrypted.
+    void reencryptionProgress(const QString &collectionName, int reencryptedCount, int totalCount);
 };
 
 class StoragePluginInfoPrivate;
@@ -161,6 +244,21 @@ public:
     virtual Sailfish::Secrets::Result getSecret(const QString &collectionName, const QString &secretName, QByteArray *secret) = 0;
     virtual Sailfish::Secrets::Result removeSecret(const QString &collectionName, const QString &secretName) = 0;
 
+    // secrets which don't exist are omitted from the returned map.
+    // the default implementation calls getSecret() for each secret.
+    virtual Sailfish::Secrets::Result getSecrets(const QString &collectionName, const QStringList &secretNames, QMap<QString, QByteArray> *secrets);
+    // the default implementation calls setSecret() for each secret.
+    virtual Sailfish::Secrets::Result setSecrets(const QString &collectionName, const QMap<QString, QByteArray> &secrets);
+    // secrets which don't exist are ignored.
+    // the default implementation calls removeSecret() for each secret.
+    virtual Sailfish::Secrets::Result removeSecrets(const QString &collectionName, const QStringList &secretNames);
+    // returns up to maxCount secrets whose names sort after the given cursor (or from the
+    // first secret, if the cursor is empty), and the cursor from which to continue, which
+    // is empty once every secret has been returned.
+    // the default implementation returns OperationNotSupportedError.
+    virtual Sailfish::Secrets::Result enumerateSecrets(const QString &collectionName, const QString &cursor, int maxCount,
+                                                       QMap<QString, QByteArray> *secrets, QString *nextCursor);
+
     virtual Sailfish::Secrets::Result setSecret(const QString &collectionName, const QString &secretName, const QByteArray &secret, const QByteArray &key) = 0;
     virtual Sailfish::Secrets::Result accessSecret(const QString &collectionName, const QString &secretName, const QByteArray &key, QByteArray *secret) = 0;
 };
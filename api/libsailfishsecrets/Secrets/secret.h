@@ -14,6 +14,10 @@
 #include <QtCore/QByteArray>
 #include <QtCore/QVector>
 #include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QtEndian>
+
+#include <string.h>
 
 namespace Sailfish {
 
@@ -30,47 +34,86 @@ public:
     };
 
     virtual ~Secret() {}
-    Secret(const Secret &other) : m_data(other.m_data) {}
-    Secret(const QByteArray &blob = QByteArray()) {
-        m_data.append(typeString(Blob).toUtf8());
+    Secret(const Secret &other) : m_type(other.m_type), m_data(other.m_data) {}
+    Secret(const QByteArray &blob = QByteArray()) : m_type(Blob) {
         if (blob.size()) {
             m_data.append(blob);
         }
     }
 
     bool operator==(const Secret &other) const {
-        return m_data == other.m_data;
+        return m_type == other.m_type && m_data == other.m_data;
     }
     bool operator<(const Secret &other) const {
-        return m_data < other.m_data;
+        return m_type < other.m_type || (m_type == other.m_type && m_data < other.m_data);
     }
 
-    Type type() const { return typeFromString(QString::fromUtf8(m_data.value(0))); }
+    Type type() const { return m_type; }
     QVector<QByteArray> data() const {
-        return m_data.size() > 1 ? m_data.mid(1) : QVector<QByteArray>();
+        return m_data;
     }
     QByteArray blob() const {
-        return m_data.size() > 1 ? m_data[1] : QByteArray();
+        return m_data.value(0);
     }
 
+    // The encoding is a marker byte (which cannot begin the legacy encoding),
+    // a version byte, then the type and the number of components as
+    // little-endian quint32s, followed by each component prefixed by its size.
     QByteArray toByteArray() const {
-        QByteArray retn;
-        for (auto d : m_data) {
-            retn.append(d.toBase64(QByteArray::Base64UrlEncoding));
-            retn.append(':');
+        int size = EncodingHeaderSize;
+        for (const QByteArray &d : m_data) {
+            size += sizeof(quint32) + d.size();
+        }
+        QByteArray retn(size, Qt::Uninitialized);
+        uchar *out = reinterpret_cast<uchar *>(retn.data());
+        *out++ = EncodingMarker;
+        *out++ = EncodingVersion;
+        qToLittleEndian<quint32>(static_cast<quint32>(m_type), out);
+        qToLittleEndian<quint32>(static_cast<quint32>(m_data.size()), out + sizeof(quint32));
+        out += 2 * sizeof(quint32);
+        for (const QByteArray &d : m_data) {
+            qToLittleEndian<quint32>(static_cast<quint32>(d.size()), out);
+            memcpy(out + sizeof(quint32), d.constData(), d.size());
+            out += sizeof(quint32) + d.size();
         }
-        retn.chop(1);
         return retn;
     }
 
     static Secret fromByteArray(const QByteArray &data) {
-        // data must be a : separated list of base64url-encoded byte arrays
+        if (data.isEmpty() || static_cast<uchar>(data.at(0)) != EncodingMarker) {
+            return fromLegacyByteArray(data);
+        }
+
+        // a malformed encoding results in an Unknown secret with no data.
         Secret retn;
-        retn.m_data.clear();
-        const QList<QByteArray> split = data.split(':');
-        for (auto s : split) {
-            retn.m_data.append(QByteArray::fromBase64(s, QByteArray::Base64UrlEncoding));
+        retn.m_type = Unknown;
+        const uchar *in = reinterpret_cast<const uchar *>(data.constData());
+        const uchar *end = in + data.size();
+        if (data.size() < EncodingHeaderSize || in[1] != EncodingVersion) {
+            return retn;
+        }
+        const quint32 type = qFromLittleEndian<quint32>(in + 2);
+        const quint32 count = qFromLittleEndian<quint32>(in + 2 + sizeof(quint32));
+        in += EncodingHeaderSize;
+        if (count > static_cast<quint32>(end - in) / sizeof(quint32)) {
+            return retn;
         }
+        QVector<QByteArray> components;
+        components.reserve(count);
+        for (quint32 i = 0; i < count; ++i) {
+            if (end - in < static_cast<int>(sizeof(quint32))) {
+                return retn;
+            }
+            const quint32 length = qFromLittleEndian<quint32>(in);
+            in += sizeof(quint32);
+            if (static_cast<quint32>(end - in) < length) {
+                return retn;
+            }
+            components.append(QByteArray(reinterpret_cast<const char *>(in), length));
+            in += length;
+        }
+        retn.m_type = type <= PrivateKey ? static_cast<Type>(type) : Unknown;
+        retn.m_data = components;
         return retn;
     }
 
@@ -97,6 +140,24 @@ protected:
         return stringToType.value(string, Unknown);
     }
 
+    // data must be a : separated list of base64url-encoded byte arrays, the first of which is the type
+    static Secret fromLegacyByteArray(const QByteArray &data) {
+        Secret retn;
+        const QList<QByteArray> split = data.split(':');
+        retn.m_type = typeFromString(QString::fromUtf8(QByteArray::fromBase64(split.first(), QByteArray::Base64UrlEncoding)));
+        for (int i = 1; i < split.size(); ++i) {
+            retn.m_data.append(QByteArray::fromBase64(split.at(i), QByteArray::Base64UrlEncoding));
+        }
+        return retn;
+    }
+
+    enum {
+        EncodingMarker = 0x00,
+        EncodingVersion = 0x01,
+        EncodingHeaderSize = 2 + 2 * sizeof(quint32)
+    };
+
+    Type m_type;
     QVector<QByteArray> m_data;
 };
 
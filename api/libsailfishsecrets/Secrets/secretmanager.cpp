@@ -19,6 +19,8 @@
 #include <QtDBus/QDBusMetaType>
 
 #include <QtCore/QPointer>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
 #include <QtCore/QLoggingCategory>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QDir>
@@ -32,6 +34,26 @@ const QString Sailfish::Secrets::SecretManager::DefaultStoragePluginName = QStri
 const QString Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName = QStringLiteral("org.sailfishos.secrets.plugin.encryption.openssl");
 const QString Sailfish::Secrets::SecretManager::DefaultEncryptedStoragePluginName = QStringLiteral("org.sailfishos.secrets.plugin.encryptedstorage.sqlcipher");
 
+namespace {
+    // The plugin info only changes when plugins are installed, so it is shared
+    // by every manager in the process, and revalidated once per daemon connection.
+    struct PluginInfoCache
+    {
+        PluginInfoCache() : generation(0), valid(false) {}
+        QString validatedConnectionName;
+        quint64 generation;
+        bool valid;
+        QMap<QString, Sailfish::Secrets::StoragePluginInfo> storagePluginInfo;
+        QMap<QString, Sailfish::Secrets::EncryptionPluginInfo> encryptionPluginInfo;
+        QMap<QString, Sailfish::Secrets::EncryptedStoragePluginInfo> encryptedStoragePluginInfo;
+        QMap<QString, Sailfish::Secrets::AuthenticationPluginInfo> authenticationPluginInfo;
+    };
+    Q_GLOBAL_STATIC(PluginInfoCache, pluginInfoCache)
+
+    // serialises the sending of each request and its deadline, see SecretManagerPrivate::asyncCall().
+    Q_GLOBAL_STATIC(QMutex, requestDeadlineMutex)
+}
+
 Sailfish::Secrets::SecretManagerPrivate::SecretManagerPrivate(SecretManager *parent)
     : QObject(parent)
     , m_parent(parent)
@@ -41,14 +63,193 @@ Sailfish::Secrets::SecretManagerPrivate::SecretManagerPrivate(SecretManager *par
     , m_interface(m_secrets->connect()
                   ? m_secrets->createApiInterface(QLatin1String("/Sailfish/Secrets"), QLatin1String("org.sailfishos.secrets"), this)
                   : Q_NULLPTR)
+    , m_initialised(false)
+    , m_requestTimeout(-1)
 {
+    // The connection is shared with every other manager in the process,
+    // and is re-established automatically if the daemon goes away.
+    QObject::connect(m_secrets, &Sailfish::Secrets::SecretsDaemonConnection::connected,
+                     this, &Sailfish::Secrets::SecretManagerPrivate::connected);
+    QObject::connect(m_secrets, &Sailfish::Secrets::SecretsDaemonConnection::disconnected,
+                     this, &Sailfish::Secrets::SecretManagerPrivate::disconnected);
+    if (m_interface) {
+        connectNotificationSignals();
+    }
 }
 
 Sailfish::Secrets::SecretManagerPrivate::~SecretManagerPrivate()
 {
+    if (!m_notificationCollectionNames.isEmpty()) {
+        m_notificationCollectionNames.clear();
+        if (m_interface) {
+            subscribeNotifications();
+        }
+    }
+    if (m_uiService) {
+        m_uiService->removeManager(this);
+    }
     Sailfish::Secrets::SecretsDaemonConnection::releaseInstance();
 }
 
+QDBusPendingReply<Sailfish::Secrets::Result>
+Sailfish::Secrets::SecretManagerPrivate::subscribeNotifications()
+{
+    const QStringList collectionNames = m_secrets->setNotificationCollectionNames(this, m_notificationCollectionNames);
+    return m_interface->asyncCallWithArgumentList(
+                QStringLiteral("subscribeNotifications"),
+                QVariantList() << QVariant::fromValue<QStringList>(collectionNames));
+}
+
+void Sailfish::Secrets::SecretManagerPrivate::connectNotificationSignals()
+{
+    QDBusConnection *connection = m_secrets->connection();
+    connection->connect(QString(), QLatin1String("/Sailfish/Secrets"), QLatin1String("org.sailfishos.secrets"),
+                        QLatin1String("collectionLocked"), this, SLOT(collectionLockedNotification(QString)));
+    connection->connect(QString(), QLatin1String("/Sailfish/Secrets"), QLatin1String("org.sailfishos.secrets"),
+                        QLatin1String("collectionUnlocked"), this, SLOT(collectionUnlockedNotification(QString)));
+    connection->connect(QString(), QLatin1String("/Sailfish/Secrets"), QLatin1String("org.sailfishos.secrets"),
+                        QLatin1String("secretChanged"), this, SLOT(secretChangedNotification(QString,QString)));
+}
+
+// the daemon sends the notifications subscribed to by any manager sharing the connection.
+void Sailfish::Secrets::SecretManagerPrivate::collectionLockedNotification(const QString &collectionName)
+{
+    if (m_notificationCollectionNames.contains(collectionName)) {
+        emit m_parent->collectionLocked(collectionName);
+    }
+}
+
+void Sailfish::Secrets::SecretManagerPrivate::collectionUnlockedNotification(const QString &collectionName)
+{
+    if (m_notificationCollectionNames.contains(collectionName)) {
+        emit m_parent->collectionUnlocked(collectionName);
+    }
+}
+
+void Sailfish::Secrets::SecretManagerPrivate::secretChangedNotification(const QString &collectionName, const QString &secretName)
+{
+    if (m_notificationCollectionNames.contains(collectionName)) {
+        emit m_parent->secretChanged(collectionName, secretName);
+    }
+}
+
+void Sailfish::Secrets::SecretManagerPrivate::connected()
+{
+    // the interface is bound to a particular connection, so recreate it.
+    delete m_interface;
+    m_interface = m_secrets->createApiInterface(QLatin1String("/Sailfish/Secrets"), QLatin1String("org.sailfishos.secrets"), this);
+    connectNotificationSignals();
+    if (!m_notificationCollectionNames.isEmpty()) {
+        // the daemon forgets subscriptions when the connection is lost.
+        subscribeNotifications();
+    }
+    if (m_initialised) {
+        QMetaObject::invokeMethod(m_parent, "isInitialisedChanged", Qt::QueuedConnection);
+    }
+}
+
+void Sailfish::Secrets::SecretManagerPrivate::disconnected()
+{
+    if (m_interface) {
+        m_interface->deleteLater();
+        m_interface = Q_NULLPTR;
+        if (m_initialised) {
+            QMetaObject::invokeMethod(m_parent, "isInitialisedChanged", Qt::QueuedConnection);
+        }
+    }
+}
+
+QDBusPendingCall
+Sailfish::Secrets::SecretManagerPrivate::asyncCall(const QString &method, const QVariantList &arguments)
+{
+    if (m_requestTimeout < 0) {
+        return m_interface->asyncCallWithArgumentList(method, arguments);
+    }
+
+    QDBusMessage deadline = QDBusMessage::createMethodCall(m_interface->service(), m_interface->path(),
+                                                           m_interface->interface(), QStringLiteral("setNextRequestDeadline"));
+    deadline << method << qint64(m_requestTimeout);
+    QDBusMessage call = QDBusMessage::createMethodCall(m_interface->service(), m_interface->path(),
+                                                       m_interface->interface(), method);
+    call.setArguments(arguments);
+
+    // the daemon applies the deadline to the next call of the method which it receives
+    // via the (shared) connection, so the two messages mustn't be interleaved with
+    // those sent by another thread.  The deadline itself expects no reply.
+    QMutexLocker locker(requestDeadlineMutex());
+    QDBusConnection connection = m_interface->connection();
+    connection.send(deadline);
+    return connection.asyncCall(call, m_requestTimeout);
+}
+
+bool Sailfish::Secrets::SecretManagerPrivate::initialisePluginInfo()
+{
+    PluginInfoCache *cache = pluginInfoCache();
+    const QString connectionName = m_secrets->connection()->name();
+    if (!cache->valid || cache->validatedConnectionName != connectionName) {
+        // the daemon answers this without queueing the request.
+        QDBusPendingReply<Sailfish::Secrets::Result, quint64> generationReply
+                = m_interface->call("getPluginInfoGeneration");
+        if (!generationReply.isValid()) {
+            qCWarning(lcSailfishSecrets) << "Unable to initialise plugin info due to DBus error:"
+                                         << generationReply.error().message();
+            return false;
+        }
+        const quint64 generation = generationReply.argumentAt<1>();
+
+        if (!cache->valid || cache->generation != generation) {
+            QDBusPendingReply<Sailfish::Secrets::Result,
+                              QVector<Sailfish::Secrets::StoragePluginInfo>,
+                              QVector<Sailfish::Secrets::EncryptionPluginInfo>,
+                              QVector<Sailfish::Secrets::EncryptedStoragePluginInfo>,
+                              QVector<Sailfish::Secrets::AuthenticationPluginInfo> > reply
+                    = m_interface->call("getPluginInfo");
+            reply.waitForFinished();
+            if (!reply.isValid()) {
+                qCWarning(lcSailfishSecrets) << "Unable to initialise plugin info due to DBus error:"
+                                             << reply.error().message();
+                return false;
+            }
+            Sailfish::Secrets::Result result = reply.argumentAt<0>();
+            if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+                qCWarning(lcSailfishSecrets) << "Unable to initialise plugin info due to error:"
+                                             << result.errorCode() << ":" << result.errorMessage();
+                return false;
+            }
+
+            cache->storagePluginInfo.clear();
+            cache->encryptionPluginInfo.clear();
+            cache->encryptedStoragePluginInfo.clear();
+            cache->authenticationPluginInfo.clear();
+            QVector<Sailfish::Secrets::StoragePluginInfo> storagePlugins = reply.argumentAt<1>();
+            QVector<Sailfish::Secrets::EncryptionPluginInfo> encryptionPlugins = reply.argumentAt<2>();
+            QVector<Sailfish::Secrets::EncryptedStoragePluginInfo> encryptedStoragePlugins = reply.argumentAt<3>();
+            QVector<Sailfish::Secrets::AuthenticationPluginInfo> authenticationPlugins = reply.argumentAt<4>();
+            for (auto p : storagePlugins) {
+                cache->storagePluginInfo.insert(p.name(), p);
+            }
+            for (auto p : encryptionPlugins) {
+                cache->encryptionPluginInfo.insert(p.name(), p);
+            }
+            for (auto p : encryptedStoragePlugins) {
+                cache->encryptedStoragePluginInfo.insert(p.name(), p);
+            }
+            for (auto p : authenticationPlugins) {
+                cache->authenticationPluginInfo.insert(p.name(), p);
+            }
+            cache->generation = generation;
+            cache->valid = true;
+        }
+        cache->validatedConnectionName = connectionName;
+    }
+
+    m_storagePluginInfo = cache->storagePluginInfo;
+    m_encryptionPluginInfo = cache->encryptionPluginInfo;
+    m_encryptedStoragePluginInfo = cache->encryptedStoragePluginInfo;
+    m_authenticationPluginInfo = cache->authenticationPluginInfo;
+    return true;
+}
+
 Sailfish::Secrets::Result
 Sailfish::Secrets::SecretManagerPrivate::registerUiService(
         Sailfish::Secrets::SecretManager::UserInteractionMode mode,
@@ -56,7 +257,8 @@ Sailfish::Secrets::SecretManagerPrivate::registerUiService(
 {
     if (mode == Sailfish::Secrets::SecretManager::InProcessUserInteractionMode) {
         if (!m_uiService) {
-            m_uiService = new Sailfish::Secrets::UiService(this);
+            m_uiService = Sailfish::Secrets::UiService::instance();
+            m_uiService->addManager(this);
         }
         if (!m_uiService->registerServer()) {
             Sailfish::Secrets::Result result(Sailfish::Secrets::Result::UiServiceUnavailableError,
@@ -87,41 +289,9 @@ Sailfish::Secrets::SecretManager::SecretManager(Sailfish::Secrets::SecretManager
         m_data->m_initialised = true;
         QMetaObject::invokeMethod(this, "isInitialisedChanged", Qt::QueuedConnection);
     } else if (mode == Sailfish::Secrets::SecretManager::SynchronousInitialisationMode) {
-        QDBusPendingReply<Sailfish::Secrets::Result,
-                          QVector<Sailfish::Secrets::StoragePluginInfo>,
-                          QVector<Sailfish::Secrets::EncryptionPluginInfo>,
-                          QVector<Sailfish::Secrets::EncryptedStoragePluginInfo>,
-                          QVector<Sailfish::Secrets::AuthenticationPluginInfo> > reply
-                = m_data->m_interface->call("getPluginInfo");
-        reply.waitForFinished();
-        if (reply.isValid()) {
-            Sailfish::Secrets::Result result = reply.argumentAt<0>();
-            if (result.code() == Sailfish::Secrets::Result::Succeeded) {
-                QVector<Sailfish::Secrets::StoragePluginInfo> storagePlugins = reply.argumentAt<1>();
-                QVector<Sailfish::Secrets::EncryptionPluginInfo> encryptionPlugins = reply.argumentAt<2>();
-                QVector<Sailfish::Secrets::EncryptedStoragePluginInfo> encryptedStoragePlugins = reply.argumentAt<3>();
-                QVector<Sailfish::Secrets::AuthenticationPluginInfo> authenticationPlugins = reply.argumentAt<4>();
-                for (auto p : storagePlugins) {
-                    m_data->m_storagePluginInfo.insert(p.name(), p);
-                }
-                for (auto p : encryptionPlugins) {
-                    m_data->m_encryptionPluginInfo.insert(p.name(), p);
-                }
-                for (auto p : encryptedStoragePlugins) {
-                    m_data->m_encryptedStoragePluginInfo.insert(p.name(), p);
-                }
-                for (auto p : authenticationPlugins) {
-                    m_data->m_authenticationPluginInfo.insert(p.name(), p);
-                }
-                m_data->m_initialised = true;
-                QMetaObject::invokeMethod(this, "isInitialisedChanged", Qt::QueuedConnection);
-            } else {
-                qCWarning(lcSailfishSecrets) << "Unable to initialise plugin info due to error:"
-                                             << result.errorCode() << ":" << result.errorMessage();
-            }
-        } else {
-            qCWarning(lcSailfishSecrets) << "Unable to initialise plugin info due to DBus error:"
-                                         << reply.error().message();
+        if (m_data->initialisePluginInfo()) {
+            m_data->m_initialised = true;
+            QMetaObject::invokeMethod(this, "isInitialisedChanged", Qt::QueuedConnection);
         }
     } else {
         // TODO : asynchronous initialisation
@@ -136,6 +306,31 @@ bool Sailfish::Secrets::SecretManager::isInitialised() const
     return m_data->m_interface && m_data->m_initialised;
 }
 
+/*!
+  \brief Sets the time in milliseconds for which the replies to requests made
+         after this call are awaited to \a msecs.
+
+  Each such request is given a deadline of \a msecs from when it is sent.
+  If the request has not been started by the daemon before its deadline,
+  it is failed without being performed, rather than doing work whose
+  result would not be received.  Requests which involve user interaction
+  may take arbitrarily long, so the timeout should allow for that.
+
+  A negative value (the default) removes the deadline.
+ */
+void Sailfish::Secrets::SecretManager::setRequestTimeout(int msecs)
+{
+    m_data->m_requestTimeout = msecs < 0 ? -1 : msecs;
+}
+
+/*!
+  \brief Returns the request timeout in milliseconds, or -1 if requests have no deadline
+ */
+int Sailfish::Secrets::SecretManager::requestTimeout() const
+{
+    return m_data->m_requestTimeout;
+}
+
 /*!
   \brief Registers the given \a view with the SecretManager.
   The \a view the UiView instance which will display any UI required during secret request
@@ -241,6 +436,13 @@ Sailfish::Secrets::SecretManager::authenticationPluginInfo()
  *
  * If the \a storagePluginName is the same as the \a encryptionPluginName
  * then the plugin is assumed to be a Sailfish::Secrets::EncryptedStoragePlugin.
+ *
+ * The storage plugin will store the collection's secrets with the requested
+ * \a durability if it supports doing so, or more durably otherwise.  Secrets
+ * which can be recreated (e.g. session tokens) need not pay the cost of
+ * \c FullDurability, but will be lost on power loss (\c NormalDurability)
+ * or whenever the Secrets service exits (\c InMemoryDurability).
+ * Encrypted storage plugins always store collections with \c FullDurability.
  */
 QDBusPendingReply<Sailfish::Secrets::Result>
 Sailfish::Secrets::SecretManager::createCollection(
@@ -248,7 +450,8 @@ Sailfish::Secrets::SecretManager::createCollection(
         const QString &storagePluginName,
         const QString &encryptionPluginName,
         Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic unlockSemantic,
-        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode)
+        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+        Sailfish::Secrets::StoragePlugin::Durability durability)
 {
     if (!m_data->m_interface) {
         return QDBusPendingReply<Sailfish::Secrets::Result>(
@@ -257,13 +460,14 @@ Sailfish::Secrets::SecretManager::createCollection(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "createCollection",
                 QVariantList() << QVariant::fromValue<QString>(collectionName)
                                << QVariant::fromValue<QString>(storagePluginName)
                                << QVariant::fromValue<QString>(encryptionPluginName)
                                << QVariant::fromValue<Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic>(unlockSemantic)
-                               << QVariant::fromValue<Sailfish::Secrets::SecretManager::AccessControlMode>(accessControlMode));
+                               << QVariant::fromValue<Sailfish::Secrets::SecretManager::AccessControlMode>(accessControlMode)
+                               << QVariant::fromValue<Sailfish::Secrets::StoragePlugin::Durability>(durability));
     return reply;
 }
 
@@ -292,6 +496,9 @@ Sailfish::Secrets::SecretManager::createCollection(
  * the documentation for \l registerUiView() for more information); otherwise,
  * a system-mediated authentication flow will be triggered to obtain the
  * authentication key from the user.
+ *
+ * The collection is stored with the given \a durability, as for the
+ * DeviceLock-protected variant of this method.
  */
 QDBusPendingReply<Sailfish::Secrets::Result>
 Sailfish::Secrets::SecretManager::createCollection(
@@ -302,7 +509,8 @@ Sailfish::Secrets::SecretManager::createCollection(
         Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic unlockSemantic,
         int customLockTimeoutMs,
         Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        Sailfish::Secrets::StoragePlugin::Durability durability)
 {
     if (!m_data->m_interface) {
         return QDBusPendingReply<Sailfish::Secrets::Result>(
@@ -319,7 +527,7 @@ Sailfish::Secrets::SecretManager::createCollection(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "createCollection",
                 QVariantList() << QVariant::fromValue<QString>(collectionName)
                                << QVariant::fromValue<QString>(storagePluginName)
@@ -329,7 +537,8 @@ Sailfish::Secrets::SecretManager::createCollection(
                                << QVariant::fromValue<int>(customLockTimeoutMs)
                                << QVariant::fromValue<Sailfish::Secrets::SecretManager::AccessControlMode>(accessControlMode)
                                << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
-                               << QVariant::fromValue<QString>(uiServiceAddress));
+                               << QVariant::fromValue<QString>(uiServiceAddress)
+                               << QVariant::fromValue<Sailfish::Secrets::StoragePlugin::Durability>(durability));
     return reply;
 }
 
@@ -359,7 +568,7 @@ Sailfish::Secrets::SecretManager::deleteCollection(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "deleteCollection",
                 QVariantList() << QVariant::fromValue<QString>(collectionName)
                                << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode));
@@ -416,7 +625,7 @@ Sailfish::Secrets::SecretManager::setSecret(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "setSecret",
                 QVariantList() << QVariant::fromValue<QString>(collectionName)
                                << QVariant::fromValue<QString>(secretName)
@@ -426,6 +635,88 @@ Sailfish::Secrets::SecretManager::setSecret(
     return reply;
 }
 
+/*!
+ * \brief Requests the Secrets service to store the contents of the given
+ * memfd \a secret into the collection identified by the given \a collectionName
+ * as the secret identified by the given \a secretName.
+ *
+ * This behaves identically to the setSecret() overload which takes a QByteArray,
+ * except that the secret data is passed to the Secrets service as a file descriptor
+ * rather than being copied into the request message, which is preferable for large secrets.
+ * The memfd must have been created with \c MFD_ALLOW_SEALING and sealed with at least
+ * \c F_SEAL_WRITE and \c F_SEAL_SHRINK, otherwise the request will fail.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result>
+Sailfish::Secrets::SecretManager::setSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        const QDBusUnixFileDescriptor &secret,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QString uiServiceAddress;
+    Sailfish::Secrets::Result uiServiceResult = m_data->registerUiService(userInteractionMode, &uiServiceAddress);
+    if (uiServiceResult.code() == Sailfish::Secrets::Result::Failed) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                QDBusMessage().createReply(
+                        QVariantList() << QVariant::fromValue<Sailfish::Secrets::Result>(uiServiceResult)));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply
+            = m_data->asyncCall(
+                "setSecretFd",
+                QVariantList() << QVariant::fromValue<QString>(collectionName)
+                               << QVariant::fromValue<QString>(secretName)
+                               << QVariant::fromValue<QDBusUnixFileDescriptor>(secret)
+                               << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
+                               << QVariant::fromValue<QString>(uiServiceAddress));
+    return reply;
+}
+
+/*!
+ * \brief Requests the Secrets service to store each of the given \a secrets
+ * (keyed by secret name) into the collection identified by the given \a collectionName.
+ *
+ * This behaves as if setSecret() were called for each secret, except that the
+ * permission checks and any authentication flow are performed once for the whole
+ * request, and all of the secrets are written within a single database transaction.
+ * As such this is the preferred way to store a large number of secrets at once.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result>
+Sailfish::Secrets::SecretManager::setSecrets(
+        const QString &collectionName,
+        const QMap<QString, QByteArray> &secrets,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QString uiServiceAddress;
+    Sailfish::Secrets::Result uiServiceResult = m_data->registerUiService(userInteractionMode, &uiServiceAddress);
+    if (uiServiceResult.code() == Sailfish::Secrets::Result::Failed) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                QDBusMessage().createReply(
+                        QVariantList() << QVariant::fromValue<Sailfish::Secrets::Result>(uiServiceResult)));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply
+            = m_data->asyncCall(
+                "setSecrets",
+                QVariantList() << QVariant::fromValue<QString>(collectionName)
+                               << QVariant::fromValue<QMap<QString, QByteArray> >(secrets)
+                               << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
+                               << QVariant::fromValue<QString>(uiServiceAddress));
+    return reply;
+}
+
 /*!
  * \brief Requests the Secrets service to store the given \a secret with the given
  * \a secretName which is a standalone secret (not associated with a collection)
@@ -466,7 +757,7 @@ Sailfish::Secrets::SecretManager::setSecret(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "setSecret",
                 QVariantList() << QVariant::fromValue<QString>(storagePluginName)
                                << QVariant::fromValue<QString>(encryptionPluginName)
@@ -541,7 +832,7 @@ Sailfish::Secrets::SecretManager::setSecret(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "setSecret",
                 QVariantList() << QVariant::fromValue<QString>(storagePluginName)
                                << QVariant::fromValue<QString>(encryptionPluginName)
@@ -606,7 +897,7 @@ Sailfish::Secrets::SecretManager::getSecret(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "getSecret",
                 QVariantList() << QVariant::fromValue<QString>(collectionName)
                                << QVariant::fromValue<QString>(secretName)
@@ -615,6 +906,87 @@ Sailfish::Secrets::SecretManager::getSecret(
     return reply;
 }
 
+/*!
+ * \brief Requests the Secrets service to retrieve the secret identified by the
+ * given \a secretName from the collection identified by the given \a collectionName,
+ * returning it as a sealed, read-only memfd.
+ *
+ * This behaves identically to getSecret(), except that the secret data is returned
+ * as a file descriptor rather than being copied into the reply message, which is
+ * preferable for large secrets.  The caller may mmap() the returned file descriptor
+ * to read the secret data.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result, QDBusUnixFileDescriptor>
+Sailfish::Secrets::SecretManager::getSecretFd(
+        const QString &collectionName,
+        const QString &secretName,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QString uiServiceAddress;
+    Sailfish::Secrets::Result uiServiceResult = m_data->registerUiService(userInteractionMode, &uiServiceAddress);
+    if (uiServiceResult.code() == Sailfish::Secrets::Result::Failed) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                QDBusMessage().createReply(
+                        QVariantList() << QVariant::fromValue<Sailfish::Secrets::Result>(uiServiceResult)));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QDBusUnixFileDescriptor> reply
+            = m_data->asyncCall(
+                "getSecretFd",
+                QVariantList() << QVariant::fromValue<QString>(collectionName)
+                               << QVariant::fromValue<QString>(secretName)
+                               << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
+                               << QVariant::fromValue<QString>(uiServiceAddress));
+    return reply;
+}
+
+
+/*!
+ * \brief Requests the Secrets service to retrieve the secrets identified by the
+ * given \a secretNames from the collection identified by the given \a collectionName.
+ *
+ * The secrets are returned in a map keyed by secret name, and any of the given
+ * secrets which do not exist in the collection are omitted from the map.
+ * Permission checks and any authentication flow required to unlock the collection
+ * are performed once for the whole request, as described for getSecret(), so this
+ * is much cheaper than requesting each secret separately.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result, QMap<QString, QByteArray> >
+Sailfish::Secrets::SecretManager::getSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QString uiServiceAddress;
+    Sailfish::Secrets::Result uiServiceResult = m_data->registerUiService(userInteractionMode, &uiServiceAddress);
+    if (uiServiceResult.code() == Sailfish::Secrets::Result::Failed) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                QDBusMessage().createReply(
+                        QVariantList() << QVariant::fromValue<Sailfish::Secrets::Result>(uiServiceResult)));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QMap<QString, QByteArray> > reply
+            = m_data->asyncCall(
+                "getSecrets",
+                QVariantList() << QVariant::fromValue<QString>(collectionName)
+                               << QVariant::fromValue<QStringList>(secretNames)
+                               << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
+                               << QVariant::fromValue<QString>(uiServiceAddress));
+    return reply;
+}
+
 
 /*!
  * \brief Requests the Secrets service to retrieve the secret identified by the
@@ -660,7 +1032,7 @@ Sailfish::Secrets::SecretManager::getSecret(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "getSecret",
                 QVariantList() << QVariant::fromValue<QString>(secretName)
                                << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
@@ -708,7 +1080,7 @@ Sailfish::Secrets::SecretManager::deleteSecret(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "deleteSecret",
                 QVariantList() << QVariant::fromValue<QString>(collectionName)
                                << QVariant::fromValue<QString>(secretName)
@@ -743,9 +1115,241 @@ Sailfish::Secrets::SecretManager::deleteSecret(
     }
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply
-            = m_data->m_interface->asyncCallWithArgumentList(
+            = m_data->asyncCall(
                 "deleteSecret",
                 QVariantList() << QVariant::fromValue<QString>(secretName)
                                << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode));
     return reply;
 }
+
+/*!
+ * \brief Requests the Secrets service to read and decrypt every secret in the
+ *        collection identified by the given \a collectionName whenever it is unlocked,
+ *        if \a prefetchOnUnlock is true.
+ *
+ * Subsequent reads of secrets from the collection are then served from the
+ * daemon's in-memory cache of decrypted secrets until the collection is
+ * relocked.  This has no effect if the daemon's secret cache is disabled,
+ * or if the collection is stored in an encrypted storage plugin.
+ *
+ * Only the application which created the collection may change this setting.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result>
+Sailfish::Secrets::SecretManager::setCollectionPrefetchOnUnlock(
+        const QString &collectionName,
+        bool prefetchOnUnlock)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply
+            = m_data->asyncCall(
+                "setCollectionPrefetchOnUnlock",
+                QVariantList() << QVariant::fromValue<QString>(collectionName)
+                               << QVariant::fromValue<bool>(prefetchOnUnlock));
+    return reply;
+}
+
+/*!
+ * \brief Requests the Secrets service to change the device lock key from
+ *        \a oldDeviceLockKey to \a newDeviceLockKey.
+ *
+ * The data keys of the device lock collections are rewrapped with the new
+ * key, so their secrets needn't be re-encrypted.  The request fails if any
+ * device lock data is encrypted with the device lock key itself, i.e. a
+ * standalone device lock secret or a device lock collection stored by an
+ * encrypted storage plugin.
+ *
+ * Until the Secrets service is integrated with the device lock, the key
+ * may only be changed while the service runs in autotest mode.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result>
+Sailfish::Secrets::SecretManager::modifyDeviceLockKey(
+        const QByteArray &oldDeviceLockKey,
+        const QByteArray &newDeviceLockKey)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply
+            = m_data->asyncCall(
+                "modifyDeviceLockKey",
+                QVariantList() << QVariant::fromValue<QByteArray>(oldDeviceLockKey)
+                               << QVariant::fromValue<QByteArray>(newDeviceLockKey));
+    return reply;
+}
+
+/*!
+ * \brief Requests the Secrets service to return the names of the collections
+ *        which were created by this application.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result, QStringList>
+Sailfish::Secrets::SecretManager::collectionNames()
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result, QStringList>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList> reply
+            = m_data->asyncCall(QStringLiteral("collectionNames"));
+    return reply;
+}
+
+/*!
+ * \brief Requests the Secrets service to return up to \a limit names of the
+ *        secrets in the collection identified by the given \a collectionName.
+ *
+ * The names are returned in the order the secrets were added.  The first page
+ * is requested with a \a cursor of zero; each reply also returns the cursor
+ * from which the next page may be requested, which is zero once every name
+ * has been returned.  Secrets added while paging are returned on a later page,
+ * and no name is returned twice.  The daemon may return fewer names than
+ * requested.
+ *
+ * The collection must be unlocked, for example by reading one of its secrets,
+ * and must not be stored in an encrypted storage plugin.  Only the application
+ * which created the collection may enumerate it.  Secrets written by an older
+ * version of the daemon are only returned once they have been set again.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result, QStringList, qint64>
+Sailfish::Secrets::SecretManager::secretNames(
+        const QString &collectionName,
+        qint64 cursor,
+        int limit)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result, QStringList, qint64>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList, qint64> reply
+            = m_data->asyncCall(
+                "secretNames",
+                QVariantList() << QVariant::fromValue<QString>(collectionName)
+                               << QVariant::fromValue<qint64>(cursor)
+                               << QVariant::fromValue<int>(limit));
+    return reply;
+}
+
+/*!
+ * \brief Requests the Secrets service to write the collections owned by this
+ *        application, and their secrets, to the given \a archive.
+ *
+ * The archive is written to the file descriptor (e.g. of a file or a pipe)
+ * as a sequence of frames, each encrypted with the given \a archiveKey, so
+ * that neither the daemon nor the reader holds the whole archive in memory.
+ * The number of secrets written is returned in the reply.
+ *
+ * No user interaction is performed: collections which are locked are skipped,
+ * so the application should unlock (e.g. by reading one of their secrets) any
+ * custom lock collections it wants exported first.  Collections stored in an
+ * encrypted storage plugin, and secrets written by an older version of the
+ * daemon which have not been set since, are also skipped.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result, int>
+Sailfish::Secrets::SecretManager::exportSecrets(
+        const QDBusUnixFileDescriptor &archive,
+        const QByteArray &archiveKey)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result, int>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result, int> reply
+            = m_data->asyncCall(
+                "exportSecrets",
+                QVariantList() << QVariant::fromValue<QDBusUnixFileDescriptor>(archive)
+                               << QVariant::fromValue<QByteArray>(archiveKey));
+    return reply;
+}
+
+/*!
+ * \brief Requests the Secrets service to restore the collections and secrets
+ *        of the given \a archive, which was written by exportSecrets() with
+ *        the given \a archiveKey.
+ *
+ * Device lock collections which do not exist are created; custom lock
+ * collections must be created (and unlocked) by the application before the
+ * import.  The secrets of each frame of the archive are written to their
+ * collection in a single batch.  The number of secrets written is returned
+ * in the reply.  If the import fails part way through, the secrets written
+ * before the failure are kept.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result, int>
+Sailfish::Secrets::SecretManager::importSecrets(
+        const QDBusUnixFileDescriptor &archive,
+        const QByteArray &archiveKey)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result, int>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result, int> reply
+            = m_data->asyncCall(
+                "importSecrets",
+                QVariantList() << QVariant::fromValue<QDBusUnixFileDescriptor>(archive)
+                               << QVariant::fromValue<QByteArray>(archiveKey));
+    return reply;
+}
+
+/*!
+ * \brief Requests the Secrets service to cancel all outstanding requests
+ *        which were made by this process.
+ *
+ * Requests which have not yet been handled are dropped, and requests which
+ * are waiting on asynchronous operations (e.g. user interaction flows) are
+ * abandoned.  The pending replies of all cancelled requests will return an
+ * error.  Requests whose result is already available are not cancelled.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result>
+Sailfish::Secrets::SecretManager::cancelRequests()
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply
+            = m_data->asyncCall(QStringLiteral("cancelRequests"));
+    return reply;
+}
+
+/*!
+ * \brief Subscribes to notifications about the collections with the given \a collectionNames
+ *
+ * After the subscription succeeds, the collectionLocked(), collectionUnlocked()
+ * and secretChanged() signals are emitted whenever the lock state of one of
+ * those collections changes (for example, due to a custom lock timeout),
+ * or a secret in one of them is set or deleted.  Notifications are only
+ * delivered for collections which this application is permitted to access.
+ *
+ * Each call replaces the previous subscription of this manager, and an
+ * empty list of names unsubscribes.  The subscription is re-established
+ * automatically if the connection to the daemon is lost.
+ */
+QDBusPendingReply<Sailfish::Secrets::Result>
+Sailfish::Secrets::SecretManager::subscribeNotifications(const QStringList &collectionNames)
+{
+    if (!m_data->m_interface) {
+        return QDBusPendingReply<Sailfish::Secrets::Result>(
+                    QDBusMessage::createError(QDBusError::Other,
+                                              QStringLiteral("Not connected to daemon")));
+    }
+
+    m_data->m_notificationCollectionNames = collectionNames;
+    return m_data->subscribeNotifications();
+}
@@ -16,9 +16,11 @@
 #include <QtDBus/QDBusPendingReply>
 #include <QtDBus/QDBusMetaType>
 #include <QtDBus/QDBusArgument>
+#include <QtDBus/QDBusUnixFileDescriptor>
 
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
+#include <QtCore/QMap>
 #include <QtCore/QByteArray>
 #include <QtCore/QString>
 
@@ -76,6 +78,12 @@ public:
     SecretManager(Sailfish::Secrets::SecretManager::InitialisationMode mode = AsynchronousInitialisationMode, QObject *parent = Q_NULLPTR);
     bool isInitialised() const;
 
+    // Requests made after this call are given up on after msecs, and are failed
+    // by the daemon without being performed if they haven't started by then.
+    // A negative value (the default) removes the deadline.
+    void setRequestTimeout(int msecs);
+    int requestTimeout() const;
+
     // for In-Process UI flows via ApplicationSpecificAuthentication plugins only.
     void registerUiView(Sailfish::Secrets::UiView *view);
 
@@ -91,7 +99,8 @@ public:
             const QString &storagePluginName,
             const QString &encryptionPluginName,
             Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic unlockSemantic,
-            Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode);
+            Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+            Sailfish::Secrets::StoragePlugin::Durability durability = Sailfish::Secrets::StoragePlugin::FullDurability);
 
     // create a CustomLock-protected collection
     QDBusPendingReply<Sailfish::Secrets::Result> createCollection(
@@ -102,7 +111,8 @@ public:
             Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic unlockSemantic,
             int customLockTimeoutMs,
             Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
-            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            Sailfish::Secrets::StoragePlugin::Durability durability = Sailfish::Secrets::StoragePlugin::FullDurability);
 
     // delete a collection
     QDBusPendingReply<Sailfish::Secrets::Result> deleteCollection(
@@ -116,6 +126,19 @@ public:
             const QByteArray &secret,
             Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
 
+    // set a secret in a collection from a sealed memfd
+    QDBusPendingReply<Sailfish::Secrets::Result> setSecret(
+            const QString &collectionName,
+            const QString &secretName,
+            const QDBusUnixFileDescriptor &secret,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
+
+    // set multiple secrets in a collection
+    QDBusPendingReply<Sailfish::Secrets::Result> setSecrets(
+            const QString &collectionName,
+            const QMap<QString, QByteArray> &secrets,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
+
     // set a standalone DeviceLock-protected secret
     QDBusPendingReply<Sailfish::Secrets::Result> setSecret(
             const QString &storagePluginName,
@@ -144,6 +167,18 @@ public:
             const QString &secretName,
             Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
 
+    // get a secret in a collection as a sealed memfd
+    QDBusPendingReply<Sailfish::Secrets::Result, QDBusUnixFileDescriptor> getSecretFd(
+            const QString &collectionName,
+            const QString &secretName,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
+
+    // get multiple secrets in a collection
+    QDBusPendingReply<Sailfish::Secrets::Result, QMap<QString, QByteArray> > getSecrets(
+            const QString &collectionName,
+            const QStringList &secretNames,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
+
     // get a standalone secret
     QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> getSecret(
             const QString &secretName,
@@ -160,8 +195,46 @@ public:
             const QString &secretName,
             Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
 
+    // read and decrypt all of the secrets in a collection whenever it is unlocked
+    QDBusPendingReply<Sailfish::Secrets::Result> setCollectionPrefetchOnUnlock(
+            const QString &collectionName,
+            bool prefetchOnUnlock);
+
+    // change the device lock key which unlocks the device lock collections
+    QDBusPendingReply<Sailfish::Secrets::Result> modifyDeviceLockKey(
+            const QByteArray &oldDeviceLockKey,
+            const QByteArray &newDeviceLockKey);
+
+    // get the names of the collections owned by this application
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList> collectionNames();
+
+    // get a page of the names of the secrets in a collection
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList, qint64> secretNames(
+            const QString &collectionName,
+            qint64 cursor = 0,
+            int limit = 100);
+
+    // write this application's collections and secrets to an encrypted archive
+    QDBusPendingReply<Sailfish::Secrets::Result, int> exportSecrets(
+            const QDBusUnixFileDescriptor &archive,
+            const QByteArray &archiveKey);
+
+    // restore the collections and secrets of an archive written by exportSecrets()
+    QDBusPendingReply<Sailfish::Secrets::Result, int> importSecrets(
+            const QDBusUnixFileDescriptor &archive,
+            const QByteArray &archiveKey);
+
+    // cancel all outstanding requests made by this process
+    QDBusPendingReply<Sailfish::Secrets::Result> cancelRequests();
+
+    // receive lock state and secret change notifications for the given collections
+    QDBusPendingReply<Sailfish::Secrets::Result> subscribeNotifications(const QStringList &collectionNames);
+
 Q_SIGNALS:
     void isInitialisedChanged();
+    void collectionLocked(const QString &collectionName);
+    void collectionUnlocked(const QString &collectionName);
+    void secretChanged(const QString &collectionName, const QString &secretName);
 
 private:
     Sailfish::Secrets::SecretManagerPrivate *m_data;
@@ -175,6 +248,8 @@ QDBusArgument &operator<<(QDBusArgument &argument, const Sailfish::Secrets::Secr
 const QDBusArgument &operator>>(const QDBusArgument &argument, Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic &semantic) SAILFISH_SECRETS_API;
 QDBusArgument &operator<<(QDBusArgument &argument, const Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic semantic) SAILFISH_SECRETS_API;
 const QDBusArgument &operator>>(const QDBusArgument &argument, Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic &semantic) SAILFISH_SECRETS_API;
+QDBusArgument &operator<<(QDBusArgument &argument, const Sailfish::Secrets::StoragePlugin::Durability durability) SAILFISH_SECRETS_API;
+const QDBusArgument &operator>>(const QDBusArgument &argument, Sailfish::Secrets::StoragePlugin::Durability &durability) SAILFISH_SECRETS_API;
 
 } // namespace Secrets
 
@@ -184,5 +259,6 @@ Q_DECLARE_METATYPE(Sailfish::Secrets::SecretManager::UserInteractionMode)
 Q_DECLARE_METATYPE(Sailfish::Secrets::SecretManager::AccessControlMode)
 Q_DECLARE_METATYPE(Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic)
 Q_DECLARE_METATYPE(Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic)
+Q_DECLARE_METATYPE(Sailfish::Secrets::StoragePlugin::Durability)
 
 #endif // LIBSAILFISHSECRETS_SECRETMANAGER_H
@@ -15,8 +15,10 @@
 #include "Secrets/uiservice_p.h"
 
 #include <QtDBus/QDBusInterface>
+#include <QtDBus/QDBusPendingCall>
 
 #include <QtCore/QObject>
+#include <QtCore/QPointer>
 
 namespace Sailfish {
 
@@ -31,21 +33,38 @@ public:
     SecretManagerPrivate(SecretManager *parent = Q_NULLPTR);
     ~SecretManagerPrivate();
 
-    // ui communication happens via a peer-to-peer dbus connection in which the sailfishsecretsd process becomes the client.
-    void handleUiConnection(const QDBusConnection &connection);
+private Q_SLOTS:
+    void connected();
+    void disconnected();
+    void collectionLockedNotification(const QString &collectionName);
+    void collectionUnlockedNotification(const QString &collectionName);
+    void secretChangedNotification(const QString &collectionName, const QString &secretName);
 
     // register the ui service if required, and return it's address.
     Sailfish::Secrets::Result registerUiService(Sailfish::Secrets::SecretManager::UserInteractionMode mode, QString *address);
 
+    // send the daemon the combined notification subscription of all managers in this process.
+    QDBusPendingReply<Sailfish::Secrets::Result> subscribeNotifications();
+    void connectNotificationSignals();
+
+    // populate the plugin info from the cache shared by every manager in this process,
+    // which is fetched from the daemon only if the installed plugins have changed.
+    bool initialisePluginInfo();
+
+    // calls the method, with the deadline of the request timeout if one is set.
+    QDBusPendingCall asyncCall(const QString &method, const QVariantList &arguments = QVariantList());
+
 private:
     friend class SecretManager;
     friend class UiService;
     SecretManager *m_parent;
-    UiService *m_uiService;
+    QPointer<UiService> m_uiService; // shared by every manager in the process.
     UiView *m_uiView;
     Sailfish::Secrets::SecretsDaemonConnection *m_secrets;
     QDBusInterface *m_interface;
     bool m_initialised;
+    int m_requestTimeout;
+    QStringList m_notificationCollectionNames;
 
     QMap<QString, Sailfish::Secrets::StoragePluginInfo> m_storagePluginInfo;
     QMap<QString, Sailfish::Secrets::EncryptionPluginInfo> m_encryptionPluginInfo;
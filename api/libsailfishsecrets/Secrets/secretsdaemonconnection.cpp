@@ -20,13 +20,41 @@
 #include <QtDBus/QDBusArgument>
 #include <QtDBus/QDBusMetaType>
 
+#include <QtCore/QStandardPaths>
+#include <QtCore/QFileInfo>
+
 Q_LOGGING_CATEGORY(lcSailfishSecretsDaemonConnection, "org.sailfishos.secrets.daemon.connection")
 
+namespace {
+    const int MinimumReconnectDelay = 250;
+    const int MaximumReconnectDelay = 30000;
+
+    // Must match the socket file which the daemon listens on.
+    QString wellKnownPeerToPeerAddress()
+    {
+        const QString path = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+        if (path.isEmpty()) {
+            return QString();
+        }
+
+        const QString socketFile = QString::fromUtf8("%1/%2").arg(path, QLatin1String("sailfishsecretsd-p2pSocket"));
+        if (!QFileInfo(socketFile).exists()) {
+            return QString();
+        }
+
+        return QString::fromUtf8("unix:path=%1").arg(socketFile);
+    }
+}
+
 Sailfish::Secrets::SecretsDaemonConnectionPrivate::SecretsDaemonConnectionPrivate(SecretsDaemonConnection *parent)
     : QObject(parent)
     , m_connection(QLatin1String("org.sailfishos.secrets.daemon.invalidConnection"))
     , m_parent(parent)
+    , m_reconnectDelay(MinimumReconnectDelay)
 {
+    m_reconnectTimer.setSingleShot(true);
+    QObject::connect(&m_reconnectTimer, &QTimer::timeout,
+                     this, &Sailfish::Secrets::SecretsDaemonConnectionPrivate::reconnect);
 }
 
 bool Sailfish::Secrets::SecretsDaemonConnectionPrivate::connect()
@@ -35,35 +63,54 @@ bool Sailfish::Secrets::SecretsDaemonConnectionPrivate::connect()
         return true;
     }
 
-    // Step one: query the secret daemon's "discovery" SessionBusObject for the PeerToPeer address.
-    QDBusInterface iface("org.sailfishos.secrets.daemon.discovery",
-                         "/Sailfish/Secrets/Discovery",
-                         "org.sailfishos.secrets.daemon.discovery",
-                         QDBusConnection::sessionBus());
-    if (!iface.isValid()) {
-        qCWarning(lcSailfishSecretsDaemonConnection) << "Unable to connect to the secrets daemon discovery service!";
-        return false;
+    // Step one: try the well-known socket in the user's runtime directory,
+    // which avoids a round trip to the discovery service via the session bus.
+    static int connectionCount = 0;
+    QString name = QString::fromLatin1("sailfishsecretsd-connection-%1").arg(connectionCount++);
+    QDBusConnection p2pc(name);
+    const QString wellKnownAddress = wellKnownPeerToPeerAddress();
+    if (!wellKnownAddress.isEmpty()) {
+        qCDebug(lcSailfishSecretsDaemonConnection) << "Connecting to secrets daemon via well-known p2p address:" << wellKnownAddress
+                                                   << "with connection name:" << name;
+        p2pc = QDBusConnection::connectToPeer(wellKnownAddress, name);
+        if (!p2pc.isConnected()) {
+            qCDebug(lcSailfishSecretsDaemonConnection) << "Unable to connect via well-known p2p address, falling back to discovery:"
+                                                       << p2pc.lastError().message();
+            QDBusConnection::disconnectFromPeer(name);
+            name = QString::fromLatin1("sailfishsecretsd-connection-%1").arg(connectionCount++);
+        }
     }
 
-    QDBusReply<QString> reply = iface.call("peerToPeerAddress");
-    if (!reply.isValid()) {
-        qCWarning(lcSailfishSecretsDaemonConnection) << "Unable to query the peer to peer socket address from the secrets daemon!";
-        return false;
-    }
+    if (!p2pc.isConnected()) {
+        // Step two: query the secrets daemon's "discovery" SessionBusObject for the PeerToPeer address.
+        QDBusInterface iface("org.sailfishos.secrets.daemon.discovery",
+                             "/Sailfish/Secrets/Discovery",
+                             "org.sailfishos.secrets.daemon.discovery",
+                             QDBusConnection::sessionBus());
+        if (!iface.isValid()) {
+            qCWarning(lcSailfishSecretsDaemonConnection) << "Unable to connect to the secrets daemon discovery service!";
+            return false;
+        }
 
-    // Step two: connect to the PeerToPeer address.
-    static int connectionCount = 0;
-    const QString address = reply.value();
-    const QString name = QString::fromLatin1("sailfishsecretsd-connection-%1").arg(connectionCount++);
+        QDBusReply<QString> reply = iface.call("peerToPeerAddress");
+        if (!reply.isValid()) {
+            qCWarning(lcSailfishSecretsDaemonConnection) << "Unable to query the peer to peer socket address from the secrets daemon!";
+            return false;
+        }
 
-    qCDebug(lcSailfishSecretsDaemonConnection) << "Connecting to secrets daemon via p2p address:" << address
-                                               << "with connection name:" << name;
+        // Step three: connect to the PeerToPeer address.
+        const QString address = reply.value();
 
-    QDBusConnection p2pc = QDBusConnection::connectToPeer(address, name);
-    if (!p2pc.isConnected()) {
-        qCWarning(lcSailfishSecretsDaemonConnection) << "Unable to connect to secrets daemon:" << p2pc.lastError()
-                                                     << p2pc.lastError().type() << p2pc.lastError().name();
-        return false;
+        qCDebug(lcSailfishSecretsDaemonConnection) << "Connecting to secrets daemon via p2p address:" << address
+                                                   << "with connection name:" << name;
+
+        p2pc = QDBusConnection::connectToPeer(address, name);
+        if (!p2pc.isConnected()) {
+            qCWarning(lcSailfishSecretsDaemonConnection) << "Unable to connect to secrets daemon:" << p2pc.lastError()
+                                                         << p2pc.lastError().type() << p2pc.lastError().name();
+            QDBusConnection::disconnectFromPeer(name);
+            return false;
+        }
     }
 
     m_connection = p2pc;
@@ -75,15 +122,44 @@ bool Sailfish::Secrets::SecretsDaemonConnectionPrivate::connect()
 
     qCDebug(lcSailfishSecretsDaemonConnection) << "Connected to secrets daemon via connection:" << m_connection.name();
 
+    m_reconnectTimer.stop();
+    m_reconnectDelay = MinimumReconnectDelay;
+    if (!m_parent.isNull()) {
+        emit m_parent->connected();
+    }
+
     return true;
 }
 
+void Sailfish::Secrets::SecretsDaemonConnectionPrivate::disconnectFromDaemon()
+{
+    m_reconnectTimer.stop();
+    const QString name = m_connection.name();
+    m_connection = QDBusConnection(QLatin1String("org.sailfishos.secrets.daemon.invalidConnection"));
+    if (name != m_connection.name()) {
+        QDBusConnection::disconnectFromPeer(name);
+    }
+}
+
 void Sailfish::Secrets::SecretsDaemonConnectionPrivate::disconnected()
 {
     qCDebug(lcSailfishSecretsDaemonConnection) << "Disconnected from secrets daemon via connection:" << m_connection.name();
+    disconnectFromDaemon();
     if (!m_parent.isNull()) {
         emit m_parent->disconnected();
     }
+
+    // The daemon may have been restarted, so try to reconnect with backoff.
+    m_reconnectTimer.start(m_reconnectDelay);
+}
+
+void Sailfish::Secrets::SecretsDaemonConnectionPrivate::reconnect()
+{
+    if (!connect()) {
+        m_reconnectDelay = qMin(m_reconnectDelay * 2, MaximumReconnectDelay);
+        qCDebug(lcSailfishSecretsDaemonConnection) << "Unable to reconnect to secrets daemon, retrying in" << m_reconnectDelay << "msecs";
+        m_reconnectTimer.start(m_reconnectDelay);
+    }
 }
 
 // -------------------------------------------
@@ -95,6 +171,9 @@ Sailfish::Secrets::SecretsDaemonConnection::SecretsDaemonConnection()
     registerDBusTypes();
 }
 
+// All managers in the process share a single peer-to-peer connection, so that
+// only the first one pays for daemon discovery and connection setup, and the
+// asynchronous calls of every manager are pipelined over the same socket.
 static Sailfish::Secrets::SecretsDaemonConnection *connectionInstance = Q_NULLPTR;
 Sailfish::Secrets::SecretsDaemonConnection* Sailfish::Secrets::SecretsDaemonConnection::instance()
 {
@@ -102,11 +181,9 @@ Sailfish::Secrets::SecretsDaemonConnection* Sailfish::Secrets::SecretsDaemonConn
         connectionInstance = new Sailfish::Secrets::SecretsDaemonConnection;
     }
 
-    (void)connectionInstance->m_refCount.ref();
-    if (!connectionInstance->m_refCount.deref()) {
+    if (connectionInstance->m_refCount.fetchAndAddOrdered(1) == 0) {
         connectionInstance->m_data = new Sailfish::Secrets::SecretsDaemonConnectionPrivate(connectionInstance);
     }
-    connectionInstance->m_refCount.ref();
     return connectionInstance;
 }
 
@@ -114,29 +191,44 @@ void Sailfish::Secrets::SecretsDaemonConnection::releaseInstance()
 {
     if (connectionInstance) {
         if (!connectionInstance->m_refCount.deref()) {
+            connectionInstance->m_data->disconnectFromDaemon();
             connectionInstance->m_data->deleteLater();
             connectionInstance->m_data = Q_NULLPTR;
             connectionInstance->deleteLater();
+            connectionInstance = Q_NULLPTR;
         }
     }
 }
 
 bool Sailfish::Secrets::SecretsDaemonConnection::connect()
 {
-    (void)m_refCount.ref();
-    if (m_refCount.deref()) {
-        return m_data->connect();
-    }
-    return false;
+    return m_data ? m_data->connect() : false;
 }
 
 QDBusConnection *Sailfish::Secrets::SecretsDaemonConnection::connection()
 {
-    (void)m_refCount.ref();
-    if (m_refCount.deref()) {
-        return m_data->connection();
+    return m_data ? m_data->connection() : Q_NULLPTR;
+}
+
+QStringList Sailfish::Secrets::SecretsDaemonConnection::setNotificationCollectionNames(
+        const QObject *subscriber,
+        const QStringList &collectionNames)
+{
+    if (!m_data) {
+        return QStringList();
+    }
+
+    if (collectionNames.isEmpty()) {
+        m_data->m_notificationCollectionNames.remove(subscriber);
+    } else {
+        m_data->m_notificationCollectionNames.insert(subscriber, collectionNames);
+    }
+
+    QSet<QString> allCollectionNames;
+    Q_FOREACH (const QStringList &names, m_data->m_notificationCollectionNames) {
+        allCollectionNames.unite(names.toSet());
     }
-    return Q_NULLPTR;
+    return allCollectionNames.toList();
 }
 
 // caller takes ownership of the returned instance, alternatively it is parented to the given \a parent object.
@@ -153,6 +245,7 @@ void Sailfish::Secrets::SecretsDaemonConnection::registerDBusTypes()
     qRegisterMetaType<Sailfish::Secrets::SecretManager::AccessControlMode>("Sailfish::Secrets::SecretManager::AccessControlMode");
     qRegisterMetaType<Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic>("Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic");
     qRegisterMetaType<Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic>("Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic");
+    qRegisterMetaType<Sailfish::Secrets::StoragePlugin::Durability>("Sailfish::Secrets::StoragePlugin::Durability");
     qRegisterMetaType<Sailfish::Secrets::EncryptionPluginInfo>("Sailfish::Secrets::EncryptionPluginInfo");
     qRegisterMetaType<QVector<Sailfish::Secrets::EncryptionPluginInfo> >("QVector<Sailfish::Secrets::EncryptionPluginInfo>");
     qRegisterMetaType<Sailfish::Secrets::StoragePluginInfo>("Sailfish::Secrets::StoragePluginInfo");
@@ -162,6 +255,7 @@ void Sailfish::Secrets::SecretsDaemonConnection::registerDBusTypes()
     qRegisterMetaType<Sailfish::Secrets::AuthenticationPluginInfo>("Sailfish::Secrets::AuthenticationPluginInfo");
     qRegisterMetaType<QVector<Sailfish::Secrets::AuthenticationPluginInfo> >("QVector<Sailfish::Secrets::AuthenticationPluginInfo>");
     qRegisterMetaType<Sailfish::Secrets::Result>("Sailfish::Secrets::Result");
+    qRegisterMetaType<QMap<QString, QByteArray> >("QMap<QString,QByteArray>");
     qRegisterMetaType<Sailfish::Secrets::UiRequest>("Sailfish::Secrets::UiRequest");
     qRegisterMetaType<Sailfish::Secrets::UiResponse>("Sailfish::Secrets::UiResponse");
 
@@ -170,6 +264,7 @@ void Sailfish::Secrets::SecretsDaemonConnection::registerDBusTypes()
     qDBusRegisterMetaType<Sailfish::Secrets::SecretManager::AccessControlMode>();
     qDBusRegisterMetaType<Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic>();
     qDBusRegisterMetaType<Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic>();
+    qDBusRegisterMetaType<Sailfish::Secrets::StoragePlugin::Durability>();
     qDBusRegisterMetaType<Sailfish::Secrets::EncryptionPluginInfo>();
     qDBusRegisterMetaType<QVector<Sailfish::Secrets::EncryptionPluginInfo> >();
     qDBusRegisterMetaType<Sailfish::Secrets::StoragePluginInfo>();
@@ -179,6 +274,7 @@ void Sailfish::Secrets::SecretsDaemonConnection::registerDBusTypes()
     qDBusRegisterMetaType<Sailfish::Secrets::AuthenticationPluginInfo>();
     qDBusRegisterMetaType<QVector<Sailfish::Secrets::AuthenticationPluginInfo> >();
     qDBusRegisterMetaType<Sailfish::Secrets::Result>();
+    qDBusRegisterMetaType<QMap<QString, QByteArray> >();
     qDBusRegisterMetaType<Sailfish::Secrets::UiRequest>();
     qDBusRegisterMetaType<Sailfish::Secrets::UiResponse>();
 }
@@ -15,6 +15,7 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QAtomicInt>
 #include <QtCore/QLoggingCategory>
 
@@ -39,9 +40,16 @@ public:
                                        const QString &interface,
                                        QObject *parent = Q_NULLPTR);
 
+    // the daemon keeps one notification subscription per connection, so the
+    // subscriptions of every manager sharing the connection are combined.
+    QStringList setNotificationCollectionNames(const QObject *subscriber, const QStringList &collectionNames);
+
     static void registerDBusTypes();
 
 signals:
+    // emitted whenever a new connection to the daemon has been established,
+    // including after automatically reconnecting following disconnected().
+    void connected();
     void disconnected();
 
 private:
@@ -15,6 +15,9 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QPointer>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
 
 namespace Sailfish {
 
@@ -29,14 +32,21 @@ public:
     SecretsDaemonConnectionPrivate(SecretsDaemonConnection *parent = Q_NULLPTR);
     QDBusConnection *connection() { return &m_connection; }
     bool connect();
+    void disconnectFromDaemon();
 
 public Q_SLOTS:
     void disconnected();
 
+private Q_SLOTS:
+    void reconnect();
+
 private:
     friend class SecretsDaemonConnection;
     QDBusConnection m_connection;
     QPointer<SecretsDaemonConnection> m_parent;
+    QTimer m_reconnectTimer;
+    int m_reconnectDelay; // msecs, doubled after every failed attempt
+    QHash<const QObject*, QStringList> m_notificationCollectionNames;
 };
 
 } // namespace Secrets
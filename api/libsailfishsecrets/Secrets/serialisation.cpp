@@ -168,6 +168,25 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, Sailfish::Secrets
     return argument;
 }
 
+QDBusArgument &operator<<(QDBusArgument &argument, const Sailfish::Secrets::StoragePlugin::Durability durability)
+{
+    int idurability = static_cast<int>(durability);
+    argument.beginStructure();
+    argument << idurability;
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, Sailfish::Secrets::StoragePlugin::Durability &durability)
+{
+    int idurability = 0;
+    argument.beginStructure();
+    argument >> idurability;
+    argument.endStructure();
+    durability = static_cast<Sailfish::Secrets::StoragePlugin::Durability>(idurability);
+    return argument;
+}
+
 QDBusArgument &operator<<(QDBusArgument &argument, const Sailfish::Secrets::StoragePluginInfo &info)
 {
     int type = static_cast<int>(info.storageType());
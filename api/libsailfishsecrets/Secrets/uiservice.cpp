@@ -11,6 +11,7 @@
 #include "uiview.h"
 #include "uirequest.h"
 
+#include <QtCore/QCoreApplication>
 #include <QtCore/QDir>
 #include <QtCore/QUuid>
 #include <QtCore/QPointer>
@@ -29,7 +30,8 @@ const QString Sailfish::Secrets::UiResponse::ErrorMessage = QStringLiteral("Erro
 const QString Sailfish::Secrets::UiResponse::Confirmation = QStringLiteral("Confirmation");
 const QString Sailfish::Secrets::UiResponse::AuthenticationKey = QStringLiteral("AuthenticationKey");
 
-void Sailfish::Secrets::SecretManagerPrivate::handleUiConnection(const QDBusConnection &connection)
+// ui communication happens via a peer-to-peer dbus connection in which the sailfishsecretsd process becomes the client.
+void Sailfish::Secrets::UiService::handleUiConnection(const QDBusConnection &connection)
 {
     qCDebug(lcSailfishSecretsUi) << "UiService received new client p2p connection:" << connection.name();
     QDBusConnection clientConnection(connection);
@@ -37,7 +39,7 @@ void Sailfish::Secrets::SecretManagerPrivate::handleUiConnection(const QDBusConn
 #if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
                                          QLatin1String("org.sailfishos.secrets.ui"),
 #endif
-                                         m_uiService,
+                                         this,
                                          QDBusConnection::ExportAllSlots | QDBusConnection::ExportAllSignals)) {
         qCWarning(lcSailfishSecretsUi) << "Could not register object for ui connection!";
     } else {
@@ -45,15 +47,54 @@ void Sailfish::Secrets::SecretManagerPrivate::handleUiConnection(const QDBusConn
     }
 }
 
-Sailfish::Secrets::UiService::UiService(SecretManagerPrivate *parent)
+Sailfish::Secrets::UiService::UiService(QObject *parent)
     : QObject(parent)
-    , m_parent(parent)
     , m_dbusServer(Q_NULLPTR)
     , m_activeConnection(QLatin1String("org.sailfishos.secrets.ui.invalidConnection"))
     , m_activeRequestState(Inactive)
 {
 }
 
+// The socket file is named after the process, so there can only be one server
+// in the process.  It is destroyed along with the application.
+static QPointer<Sailfish::Secrets::UiService> uiServiceInstance;
+Sailfish::Secrets::UiService *Sailfish::Secrets::UiService::instance()
+{
+    if (!uiServiceInstance) {
+        uiServiceInstance = new Sailfish::Secrets::UiService(QCoreApplication::instance());
+    }
+    return uiServiceInstance.data();
+}
+
+void Sailfish::Secrets::UiService::addManager(Sailfish::Secrets::SecretManagerPrivate *manager)
+{
+    m_managers.append(QPointer<Sailfish::Secrets::SecretManagerPrivate>(manager));
+}
+
+void Sailfish::Secrets::UiService::removeManager(Sailfish::Secrets::SecretManagerPrivate *manager)
+{
+    m_managers.removeAll(QPointer<Sailfish::Secrets::SecretManagerPrivate>(manager));
+    if (m_activeManager == manager) {
+        m_activeManager = Q_NULLPTR;
+    }
+}
+
+bool Sailfish::Secrets::UiService::performRequestInView(const Sailfish::Secrets::UiRequest &request)
+{
+    Q_FOREACH (const QPointer<Sailfish::Secrets::SecretManagerPrivate> &manager, m_managers) {
+        if (manager && manager->m_uiView && manager->m_uiView->performRequest(this, request)) {
+            m_activeManager = manager;
+            return true;
+        }
+    }
+    return false;
+}
+
+Sailfish::Secrets::UiView *Sailfish::Secrets::UiService::activeView() const
+{
+    return m_activeManager ? m_activeManager->m_uiView : Q_NULLPTR;
+}
+
 bool Sailfish::Secrets::UiService::registerServer()
 {
     if (!m_address.isEmpty()) {
@@ -78,7 +119,7 @@ bool Sailfish::Secrets::UiService::registerServer()
 
     m_dbusServer = new QDBusServer(address, this);
     connect(m_dbusServer, &QDBusServer::newConnection,
-            m_parent, &Sailfish::Secrets::SecretManagerPrivate::handleUiConnection);
+            this, &Sailfish::Secrets::UiService::handleUiConnection);
 
     m_address = address;
     qCDebug(lcSailfishSecretsUi) << "UiService listening for ui p2p connections on address:" << m_address;
@@ -118,7 +159,7 @@ void Sailfish::Secrets::UiService::performUiRequest(
         result = Sailfish::Secrets::Result(
                     Sailfish::Secrets::Result::UiServiceRequestBusyError,
                     QLatin1String("Ui service is busy handling another request"));
-    } else if (!m_parent->m_uiView || !m_parent->m_uiView->performRequest(this, request)) {
+    } else if (!performRequestInView(request)) {
         result = Sailfish::Secrets::Result(
                     Sailfish::Secrets::Result::UiViewUnavailableError,
                     QLatin1String("Cannot perform ui request: view busy or no view registered"));
@@ -162,7 +203,7 @@ void Sailfish::Secrets::UiService::continueUiRequest(
         result = Sailfish::Secrets::Result(
                     Sailfish::Secrets::Result::UiServiceRequestBusyError,
                     QString::fromLatin1("Cannot continue non-waiting ui request: %1").arg(requestId));
-    } else if (!m_parent->m_uiView || !m_parent->m_uiView->continueRequest(this, request)) {
+    } else if (!activeView() || !activeView()->continueRequest(this, request)) {
         result = Sailfish::Secrets::Result(
                     Sailfish::Secrets::Result::UiViewUnavailableError,
                     QLatin1String("Cannot continue ui request: view busy or no view registered"));
@@ -186,7 +227,7 @@ void Sailfish::Secrets::UiService::cancelUiRequest(
         result = Sailfish::Secrets::Result(
                     Sailfish::Secrets::Result::UiServiceRequestInvalidError,
                     QString::fromLatin1("Cannot cancel non-active ui request: %1").arg(requestId));
-    } else if (!m_parent->m_uiView || !m_parent->m_uiView->cancelRequest(this)) {
+    } else if (!activeView() || !activeView()->cancelRequest(this)) {
         result = Sailfish::Secrets::Result(
                     Sailfish::Secrets::Result::UiViewUnavailableError,
                     QLatin1String("Cannot cancel ui request: view busy or no view registered"));
@@ -195,6 +236,7 @@ void Sailfish::Secrets::UiService::cancelUiRequest(
         // but set the connection state to inactive, so that we can accept new clients.
         m_activeRequestState = Sailfish::Secrets::UiService::Inactive;
         m_activeRequestId = QString();
+        m_activeManager = Q_NULLPTR;
         result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
     }
 }
@@ -216,7 +258,7 @@ void Sailfish::Secrets::UiService::finishUiRequest(
         result = Sailfish::Secrets::Result(
                     Sailfish::Secrets::Result::UiServiceRequestBusyError,
                     QString::fromLatin1("Cannot finish non-waiting ui request: %1").arg(requestId));
-    } else if (!m_parent->m_uiView || !m_parent->m_uiView->finishRequest(this)) {
+    } else if (!activeView() || !activeView()->finishRequest(this)) {
         result = Sailfish::Secrets::Result(
                     Sailfish::Secrets::Result::UiViewUnavailableError,
                     QLatin1String("Cannot finish ui request: view busy or no view registered"));
@@ -225,6 +267,7 @@ void Sailfish::Secrets::UiService::finishUiRequest(
         // but set the connection state to inactive, so that we can accept new clients.
         m_activeRequestState = Sailfish::Secrets::UiService::Inactive;
         m_activeRequestId = QString();
+        m_activeManager = Q_NULLPTR;
         result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
     }
 }
@@ -236,6 +279,7 @@ void Sailfish::Secrets::UiService::clientDisconnected()
     m_activeReply = QDBusMessage();
     m_activeRequestId = QString();
     m_activeRequestState = Sailfish::Secrets::UiService::Inactive;
+    m_activeManager = Q_NULLPTR;
 }
 
 // -------------- View:
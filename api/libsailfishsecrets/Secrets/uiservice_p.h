@@ -20,6 +20,7 @@
 #include <QtDBus/QDBusPendingCallWatcher>
 
 #include <QtCore/QObject>
+#include <QtCore/QPointer>
 #include <QtCore/QVariantMap>
 #include <QtCore/QList>
 #include <QtCore/QString>
@@ -36,6 +37,11 @@ class SecretManagerPrivate;
  *  with the UserInteractionMode set to InProcessUserInteractionMode.
  *  It talks to the sailfishsecretsd via P2P DBus connection, and triggers
  *  interaction within the UiView registered with the manager.
+ *
+ *  A single instance (and server socket) is shared by every manager in the
+ *  process, and is kept until the application exits, so that only the first
+ *  in-process request pays for setting up the server.  Each ui request is
+ *  performed by the first of those managers whose view is not busy.
  */
 class UiService : public QObject, protected QDBusContext
 {
@@ -75,7 +81,10 @@ class UiService : public QObject, protected QDBusContext
     "")
 
 public:
-    UiService(SecretManagerPrivate *parent = Q_NULLPTR);
+    static UiService *instance();
+    void addManager(SecretManagerPrivate *manager);
+    void removeManager(SecretManagerPrivate *manager);
+
     QString address() const { return m_address; }
     bool registerServer();
     void sendResponse(const Sailfish::Secrets::Result &error,
@@ -100,10 +109,16 @@ public Q_SLOTS:
                          Sailfish::Secrets::Result &result);
 
 private Q_SLOTS:
+    void handleUiConnection(const QDBusConnection &connection);
     void clientDisconnected();
 
 private:
-    SecretManagerPrivate *m_parent;
+    UiService(QObject *parent = Q_NULLPTR);
+    bool performRequestInView(const Sailfish::Secrets::UiRequest &request);
+    Sailfish::Secrets::UiView *activeView() const;
+
+    QList<QPointer<SecretManagerPrivate> > m_managers;
+    QPointer<SecretManagerPrivate> m_activeManager;
     QDBusServer *m_dbusServer;
     QString m_address;
 
@@ -24,6 +24,9 @@ Sailfish::Secrets::Plugin::InProcessUiView::InProcessUiView(QQuickItem *parent)
     : QQuickItem(parent), Sailfish::Secrets::UiView()
     , m_childItem(Q_NULLPTR)
     , m_adapter(new Sailfish::Secrets::Plugin::InProcessUiViewPrivate(this))
+    , m_component(Q_NULLPTR)
+    , m_preload(false)
+    , m_childItemPending(false)
 {
 }
 
@@ -68,32 +71,24 @@ void Sailfish::Secrets::Plugin::InProcessUiView::performRequest(const Sailfish::
 {
     if (request.type() == Sailfish::Secrets::UiRequest::InvalidRequest) {
         qCWarning(lcSailfishSecretsUiView) << "InProcessUiView unable to perform invalid request!";
-        Sailfish::Secrets::Result result(Sailfish::Secrets::Result::UiViewRequestError,
-                                         QStringLiteral("Unable to perform invalid request"));
-        Sailfish::Secrets::UiResponse response;
-        QMetaObject::invokeMethod(this, "sendResponseAsync", Qt::QueuedConnection,
-                                  Q_ARG(Sailfish::Secrets::Result, result),
-                                  Q_ARG(Sailfish::Secrets::UiResponse, response));
+        sendErrorResponse(Sailfish::Secrets::Result::UiViewRequestError,
+                          QStringLiteral("Unable to perform invalid request"));
         return;
     }
 
     QQuickItem *parent = parentItem();
     if (!parent) {
         qCWarning(lcSailfishSecretsUiView) << "Error creating in-process ui view: invalid parent item";
-        Sailfish::Secrets::Result result(Sailfish::Secrets::Result::UiViewParentError,
-                                         QStringLiteral("Invalid parent item, view cannot be shown"));
-        Sailfish::Secrets::UiResponse response;
-        QMetaObject::invokeMethod(this, "sendResponseAsync", Qt::QueuedConnection,
-                                  Q_ARG(Sailfish::Secrets::Result, result),
-                                  Q_ARG(Sailfish::Secrets::UiResponse, response));
+        sendErrorResponse(Sailfish::Secrets::Result::UiViewParentError,
+                          QStringLiteral("Invalid parent item, view cannot be shown"));
         return;
     }
 
     // fill the parent item
     setHeight(parent->height());
     setWidth(parent->width());
-    connect(parent, &QQuickItem::widthChanged, this, &InProcessUiView::parentSizeChanged);
-    connect(parent, &QQuickItem::heightChanged, this, &InProcessUiView::parentSizeChanged);
+    connect(parent, &QQuickItem::widthChanged, this, &InProcessUiView::parentSizeChanged, Qt::UniqueConnection);
+    connect(parent, &QQuickItem::heightChanged, this, &InProcessUiView::parentSizeChanged, Qt::UniqueConnection);
 
     // create the in-process view as a child item
     QUrl sourceUrl = request.uiViewQmlFileUrl().isEmpty()
@@ -102,36 +97,111 @@ void Sailfish::Secrets::Plugin::InProcessUiView::performRequest(const Sailfish::
     m_adapter->setRequestType(request.type());
 
     qCDebug(lcSailfishSecretsUiView) << "Creating InProcessUiView with source url:" << sourceUrl;
-    QQmlComponent *component = new QQmlComponent(qmlEngine(parent), sourceUrl, parent);
-    if (!component->errors().isEmpty()) {
-        qCWarning(lcSailfishSecretsUiView) << "Error creating in-process ui view:" << component->errors();
-        Sailfish::Secrets::Result result(Sailfish::Secrets::Result::UiViewError,
-                                         QStringLiteral("QML file failed to compile: %1").arg(component->errors().first().toString()));
-        Sailfish::Secrets::UiResponse response;
-        QMetaObject::invokeMethod(this, "sendResponseAsync", Qt::QueuedConnection,
-                                  Q_ARG(Sailfish::Secrets::Result, result),
-                                  Q_ARG(Sailfish::Secrets::UiResponse, response));
+    if (viewComponent(sourceUrl, qmlEngine(parent), QQmlComponent::PreferSynchronous)->isLoading()) {
+        // still being compiled after being preloaded.
+        m_childItemPending = true;
         return;
-    } else {
-        QObject *childObject = component->beginCreate(qmlContext(parent));
-        m_childItem = qobject_cast<QQuickItem*>(childObject);
-        if (!m_childItem) {
-            qCWarning(lcSailfishSecretsUiView) << "Error creating in-process ui view child item:" << component->errors();
-            Sailfish::Secrets::Result result(Sailfish::Secrets::Result::UiViewChildError,
-                                             QStringLiteral("Could not instantiate QML child item"));
-            Sailfish::Secrets::UiResponse response;
-            QMetaObject::invokeMethod(this, "sendResponseAsync", Qt::QueuedConnection,
-                                      Q_ARG(Sailfish::Secrets::Result, result),
-                                      Q_ARG(Sailfish::Secrets::UiResponse, response));
-            return;
-        } else {
-            qCDebug(lcSailfishSecretsUiView) << "Successfully created in-process child item with parent:"
-                                                << this << "and embed parent:" << this->parent();
-            m_childItem->setParent(this);
-            m_childItem->setParentItem(this);
-            qmlEngine(parent)->rootContext()->setContextProperty("adapter", m_adapter);
-            component->completeCreate();
+    }
+    createChildItem();
+}
+
+QQmlComponent *Sailfish::Secrets::Plugin::InProcessUiView::viewComponent(
+        const QUrl &sourceUrl,
+        QQmlEngine *engine,
+        QQmlComponent::CompilationMode mode)
+{
+    // the compiled component is kept, so that subsequent requests only instantiate it.
+    if (m_component && m_component->url() != sourceUrl) {
+        m_component->deleteLater();
+        m_component = Q_NULLPTR;
+    }
+    if (!m_component) {
+        m_component = new QQmlComponent(engine, this);
+        connect(m_component, &QQmlComponent::statusChanged,
+                this, &Sailfish::Secrets::Plugin::InProcessUiView::componentStatusChanged);
+        m_component->loadUrl(sourceUrl, mode);
+    }
+    return m_component;
+}
+
+void Sailfish::Secrets::Plugin::InProcessUiView::componentStatusChanged()
+{
+    if (m_childItemPending && m_component && !m_component->isLoading()) {
+        m_childItemPending = false;
+        createChildItem();
+    }
+}
+
+void Sailfish::Secrets::Plugin::InProcessUiView::createChildItem()
+{
+    QQuickItem *parent = parentItem();
+    if (!parent) {
+        qCWarning(lcSailfishSecretsUiView) << "Error creating in-process ui view: invalid parent item";
+        sendErrorResponse(Sailfish::Secrets::Result::UiViewParentError,
+                          QStringLiteral("Invalid parent item, view cannot be shown"));
+        return;
+    }
+
+    if (!m_component->errors().isEmpty()) {
+        qCWarning(lcSailfishSecretsUiView) << "Error creating in-process ui view:" << m_component->errors();
+        sendErrorResponse(Sailfish::Secrets::Result::UiViewError,
+                          QStringLiteral("QML file failed to compile: %1").arg(m_component->errors().first().toString()));
+        // try again with the next request.
+        m_component->deleteLater();
+        m_component = Q_NULLPTR;
+        return;
+    }
+
+    QObject *childObject = m_component->beginCreate(qmlContext(parent));
+    m_childItem = qobject_cast<QQuickItem*>(childObject);
+    if (!m_childItem) {
+        qCWarning(lcSailfishSecretsUiView) << "Error creating in-process ui view child item:" << m_component->errors();
+        delete childObject;
+        sendErrorResponse(Sailfish::Secrets::Result::UiViewChildError,
+                          QStringLiteral("Could not instantiate QML child item"));
+        return;
+    }
+
+    qCDebug(lcSailfishSecretsUiView) << "Successfully created in-process child item with parent:"
+                                     << this << "and embed parent:" << this->parent();
+    m_childItem->setParent(this);
+    m_childItem->setParentItem(this);
+    qmlEngine(parent)->rootContext()->setContextProperty("adapter", m_adapter);
+    m_component->completeCreate();
+}
+
+void Sailfish::Secrets::Plugin::InProcessUiView::sendErrorResponse(
+        Sailfish::Secrets::Result::ErrorCode errorCode,
+        const QString &errorMessage)
+{
+    Sailfish::Secrets::Result result(errorCode, errorMessage);
+    Sailfish::Secrets::UiResponse response;
+    QMetaObject::invokeMethod(this, "sendResponseHelper", Qt::QueuedConnection,
+                              Q_ARG(Sailfish::Secrets::Result, result),
+                              Q_ARG(Sailfish::Secrets::UiResponse, response));
+}
+
+bool Sailfish::Secrets::Plugin::InProcessUiView::preload() const
+{
+    return m_preload;
+}
+
+void Sailfish::Secrets::Plugin::InProcessUiView::setPreload(bool preload)
+{
+    if (m_preload != preload) {
+        m_preload = preload;
+        if (m_preload && isComponentComplete() && qmlEngine(this)) {
+            viewComponent(QUrl(QStringLiteral("qrc:/defaultUiView.qml")), qmlEngine(this), QQmlComponent::Asynchronous);
         }
+        emit preloadChanged();
+    }
+}
+
+void Sailfish::Secrets::Plugin::InProcessUiView::componentComplete()
+{
+    QQuickItem::componentComplete();
+    if (m_preload && qmlEngine(this)) {
+        viewComponent(QUrl(QStringLiteral("qrc:/defaultUiView.qml")), qmlEngine(this), QQmlComponent::Asynchronous);
     }
 }
 
@@ -143,6 +213,7 @@ void Sailfish::Secrets::Plugin::InProcessUiView::continueRequest(const Sailfish:
 
 void Sailfish::Secrets::Plugin::InProcessUiView::cancelRequest()
 {
+    m_childItemPending = false;
     if (m_childItem) {
         m_childItem->deleteLater();
         m_childItem = 0;
@@ -152,6 +223,7 @@ void Sailfish::Secrets::Plugin::InProcessUiView::cancelRequest()
 
 void Sailfish::Secrets::Plugin::InProcessUiView::finishRequest()
 {
+    m_childItemPending = false;
     if (m_childItem) {
         m_childItem->deleteLater();
         m_childItem = 0;
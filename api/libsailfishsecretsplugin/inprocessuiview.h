@@ -12,6 +12,7 @@
 #include "Secrets/uirequest.h"
 
 #include <QtQuick/QQuickItem>
+#include <QtQml/QQmlComponent>
 
 namespace Sailfish {
 
@@ -25,6 +26,7 @@ class InProcessUiView : public QQuickItem, public UiView
     Q_OBJECT
     Q_PROPERTY(QObject *adapter READ adapter CONSTANT)
     Q_PROPERTY(QObject *secretManager READ secretManager WRITE setSecretManager NOTIFY secretManagerChanged)
+    Q_PROPERTY(bool preload READ preload WRITE setPreload NOTIFY preloadChanged)
     Q_ENUMS(ConfirmationValue)
     Q_ENUMS(RequestType)
 
@@ -49,12 +51,20 @@ public:
     QObject *secretManager() const;
     Q_INVOKABLE void setSecretManager(QObject *manager);
 
+    // If set, the default view is compiled in the background as soon
+    // as the item is created, rather than when the first request is
+    // performed.  The compiled view is kept for subsequent requests.
+    bool preload() const;
+    void setPreload(bool preload);
+
 Q_SIGNALS:
     void cancelled();
     void finished();
     void secretManagerChanged();
+    void preloadChanged();
 
 protected:
+    void componentComplete() Q_DECL_OVERRIDE;
     void performRequest(const Sailfish::Secrets::UiRequest &request) Q_DECL_OVERRIDE;
     void continueRequest(const Sailfish::Secrets::UiRequest &request) Q_DECL_OVERRIDE;
     void cancelRequest() Q_DECL_OVERRIDE;
@@ -62,6 +72,7 @@ protected:
 
 private Q_SLOTS:
     void parentSizeChanged();
+    void componentStatusChanged();
 
 public:
     QObject *adapter() const;
@@ -70,8 +81,15 @@ private:
     friend class InProcessUiViewPrivate;
     Q_INVOKABLE void sendResponseHelper(const Sailfish::Secrets::Result &result,
                                         const Sailfish::Secrets::UiResponse &response);
+    void sendErrorResponse(Sailfish::Secrets::Result::ErrorCode errorCode, const QString &errorMessage);
+    QQmlComponent *viewComponent(const QUrl &sourceUrl, QQmlEngine *engine, QQmlComponent::CompilationMode mode);
+    void createChildItem();
+
     QQuickItem *m_childItem;
     InProcessUiViewPrivate *m_adapter;
+    QQmlComponent *m_component;
+    bool m_preload;
+    bool m_childItemPending; // created once the component has finished loading.
 };
 
 } // namespace Plugin
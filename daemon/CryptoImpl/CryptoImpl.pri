@@ -3,9 +3,13 @@ DEPENDPATH = $$INCLUDEPATH
 
 HEADERS += \
     $$PWD/crypto_p.h \
+    $$PWD/cryptokeypool_p.h \
+    $$PWD/cryptopluginhost_p.h \
     $$PWD/cryptorequestprocessor_p.h
 
 SOURCES += \
     $$PWD/crypto.cpp \
+    $$PWD/cryptokeypool.cpp \
+    $$PWD/cryptopluginhost.cpp \
     $$PWD/cryptorequestprocessor.cpp
 
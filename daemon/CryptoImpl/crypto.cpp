@@ -8,6 +8,9 @@
 #include "crypto_p.h"
 #include "cryptorequestprocessor_p.h"
 #include "logging_p.h"
+#include "sharedmemory_p.h"
+
+#include "SecretsImpl/secrets_p.h"
 
 #include "Crypto/key.h"
 #include "Crypto/certificate.h"
@@ -18,6 +21,40 @@
 #include <QtCore/QString>
 #include <QtCore/QVector>
 #include <QtCore/QByteArray>
+#include <QtCore/QThread>
+
+namespace {
+    // Fd requests return their output as a sealed memfd rather than inline.
+    QVariant outputPayload(int requestType, const QByteArray &data, Sailfish::Crypto::Result *result)
+    {
+        if (requestType != Sailfish::Crypto::Daemon::ApiImpl::EncryptFdRequest
+                && requestType != Sailfish::Crypto::Daemon::ApiImpl::DecryptFdRequest) {
+            return QVariant::fromValue<QByteArray>(data);
+        }
+
+        QDBusUnixFileDescriptor fd;
+        if (result->code() == Sailfish::Crypto::Result::Succeeded) {
+            QString errorString;
+            fd = Sailfish::Secrets::Daemon::createSealedMemfd(data, &errorString);
+            if (!fd.isValid()) {
+                *result = Sailfish::Crypto::Result(Sailfish::Crypto::Result::DaemonError, errorString);
+            }
+        }
+        return QVariant::fromValue<QDBusUnixFileDescriptor>(fd);
+    }
+
+    // The key in the given parameter of a request, or an empty key if that
+    // parameter isn't a key (so that a misplaced index can't read e.g. a
+    // signature as key material).
+    Sailfish::Crypto::Key requestKey(const QList<QVariant> &inParams, int index)
+    {
+        if (index >= inParams.size()
+                || inParams.at(index).userType() != qMetaTypeId<Sailfish::Crypto::Key>()) {
+            return Sailfish::Crypto::Key();
+        }
+        return inParams.at(index).value<Sailfish::Crypto::Key>();
+    }
+}
 
 Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::CryptoDBusObject(
         Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue *parent)
@@ -43,6 +80,25 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::getPluginInfo(
                                   result);
 }
 
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::getPluginInfoGeneration(
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        quint64 &generation)
+{
+    Q_UNUSED(message);
+    generation = m_requestQueue->pluginInfoGeneration();
+    result = Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::setNextRequestDeadline(
+        const QString &method,
+        qint64 timeoutMsecs,
+        const QDBusMessage &message)
+{
+    Q_UNUSED(message);  // no reply is sent
+    m_requestQueue->setNextRequestDeadline(connection(), method, timeoutMsecs);
+}
+
 void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::validateCertificateChain(
         const QVector<Sailfish::Crypto::Certificate> &chain,
         const QString &cryptosystemProviderName,
@@ -61,6 +117,24 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::validateCertificateCha
                                   result);
 }
 
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::validateCertificateChains(
+        const QVector<QVector<Sailfish::Crypto::Certificate> > &chains,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QVector<bool> &valid)
+{
+    Q_UNUSED(valid);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QVector<QVector<Sailfish::Crypto::Certificate> > >(chains);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::ValidateCertificateChainsRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
 void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::generateKey(
         const Sailfish::Crypto::Key &keyTemplate,
         const QString &cryptosystemProviderName,
@@ -143,6 +217,42 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::storedKeyIdentifiers(
                                   result);
 }
 
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::storedKeyIdentifiers(
+        qint64 cursor,
+        int limit,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QVector<Sailfish::Crypto::Key::Identifier> &identifiers,
+        qint64 &nextCursor)
+{
+    Q_UNUSED(identifiers);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    Q_UNUSED(nextCursor);   // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<qint64>(cursor)
+             << QVariant::fromValue<int>(limit);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::StoredKeyIdentifiersPageRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::findKeys(
+        const Sailfish::Crypto::Key::FilterData &filter,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QVector<Sailfish::Crypto::Key::Identifier> &identifiers)
+{
+    Q_UNUSED(identifiers);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::FilterData>(filter);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::FindKeysRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
 void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::sign(
         const QByteArray &data,
         const Sailfish::Crypto::Key &key,
@@ -169,6 +279,7 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::sign(
 
 void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::verify(
         const QByteArray &data,
+        const QByteArray &signature,
         const Sailfish::Crypto::Key &key,
         Sailfish::Crypto::Key::SignaturePadding padding,
         Sailfish::Crypto::Key::Digest digest,
@@ -180,6 +291,7 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::verify(
     Q_UNUSED(verified);  // outparam, set in handlePendingRequest / handleFinishedRequest
     QList<QVariant> inParams;
     inParams << QVariant::fromValue<QByteArray>(data);
+    inParams << QVariant::fromValue<QByteArray>(signature);
     inParams << QVariant::fromValue<Sailfish::Crypto::Key>(key);
     inParams << QVariant::fromValue<Sailfish::Crypto::Key::SignaturePadding>(padding);
     inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
@@ -243,6 +355,277 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::decrypt(
                                   result);
 }
 
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::encryptFd(
+        const QDBusUnixFileDescriptor &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QDBusUnixFileDescriptor &encrypted)
+{
+    Q_UNUSED(encrypted);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QDBusUnixFileDescriptor>(data);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::EncryptFdRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::decryptFd(
+        const QDBusUnixFileDescriptor &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QDBusUnixFileDescriptor &decrypted)
+{
+    Q_UNUSED(decrypted);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QDBusUnixFileDescriptor>(data);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::DecryptFdRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::signBatch(
+        const QVector<QByteArray> &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QVector<QByteArray> &signatures)
+{
+    Q_UNUSED(signatures);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QVector<QByteArray> >(data);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::SignaturePadding>(padding);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::SignBatchRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::verifyBatch(
+        const QVector<QByteArray> &data,
+        const QVector<QByteArray> &signatures,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QVector<bool> &verified)
+{
+    Q_UNUSED(verified);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QVector<QByteArray> >(data);
+    inParams << QVariant::fromValue<QVector<QByteArray> >(signatures);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::SignaturePadding>(padding);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::VerifyBatchRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::encryptBatch(
+        const QVector<QByteArray> &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QVector<QByteArray> &encrypted)
+{
+    Q_UNUSED(encrypted);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QVector<QByteArray> >(data);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::EncryptBatchRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::generateRandomData(
+        quint64 numberBytes,
+        const QString &csprngEngineName,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QByteArray &randomData)
+{
+    Q_UNUSED(randomData);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<quint64>(numberBytes);
+    inParams << QVariant::fromValue<QString>(csprngEngineName);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::GenerateRandomDataRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::generateDigest(
+        const QByteArray &data,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QByteArray &digestValue)
+{
+    Q_UNUSED(digestValue);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QByteArray>(data);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::GenerateDigestRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::calculateMac(
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QByteArray &mac)
+{
+    Q_UNUSED(mac);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QByteArray>(data);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::CalculateMacRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::initialiseCipherSession(
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Operation operation,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        quint32 &cipherSessionToken)
+{
+    Q_UNUSED(cipherSessionToken);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Operation>(operation);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding);
+    inParams << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::InitialiseCipherSessionRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::updateCipherSession(
+        const QByteArray &data,
+        quint32 cipherSessionToken,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QByteArray &generatedData)
+{
+    Q_UNUSED(generatedData);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QByteArray>(data);
+    inParams << QVariant::fromValue<quint32>(cipherSessionToken);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::UpdateCipherSessionRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::finaliseCipherSession(
+        quint32 cipherSessionToken,
+        const QString &cryptosystemProviderName,
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result,
+        QByteArray &generatedData)
+{
+    Q_UNUSED(generatedData);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<quint32>(cipherSessionToken);
+    inParams << QVariant::fromValue<QString>(cryptosystemProviderName);
+    m_requestQueue->handleRequest(Sailfish::Crypto::Daemon::ApiImpl::FinaliseCipherSessionRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject::cancelRequests(
+        const QDBusMessage &message,
+        Sailfish::Crypto::Result &result)
+{
+    Q_UNUSED(message);
+    pid_t callerPid = 0;
+    if (!Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::connectionPid(connection(), &callerPid)) {
+        result = Sailfish::Crypto::Result(Sailfish::Crypto::Result::DaemonError,
+                                          QLatin1String("Could not determine PID of caller"));
+        return;
+    }
+
+    m_requestQueue->cancelRequests(callerPid);
+    m_requestQueue->closeCipherSessions(callerPid);
+    result = Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
 //-----------------------------------
 
 Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::CryptoRequestQueue(
@@ -256,8 +639,11 @@ Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::CryptoRequestQueue(
           parent,
           pluginDir,
           autotestMode)
+    , m_secrets(secrets)
 {
     Sailfish::Crypto::CryptoDaemonConnection::registerDBusTypes();
+    connect(m_secrets, &Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::groupCommitFinished,
+            this, &Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::sendDeferredMessages);
 
     m_requestProcessor = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor(secrets, this);
     if (!m_requestProcessor->loadPlugins(pluginDir, autotestMode)) {
@@ -265,6 +651,9 @@ Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::CryptoRequestQueue(
         return;
     }
 
+    // requests which only require the crypto plugin can run in parallel.
+    setMaxWorkerThreads(QThread::idealThreadCount());
+
     setDBusObject(new Sailfish::Crypto::Daemon::ApiImpl::CryptoDBusObject(this));
     qCDebug(lcSailfishCryptoDaemon) << "Crypto: initialisation succeeded, awaiting client connections.";
 }
@@ -279,20 +668,575 @@ QString Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::requestTypeToStri
         case InvalidRequest:                   return QLatin1String("InvalidRequest");
         case GetPluginInfoRequest:             return QLatin1String("GetPluginInfoRequest");
         case ValidateCertificateChainRequest:  return QLatin1String("ValidateCertificateChainRequest");
+        case ValidateCertificateChainsRequest: return QLatin1String("ValidateCertificateChainsRequest");
         case GenerateKeyRequest:               return QLatin1String("GenerateKeyRequest");
         case GenerateStoredKeyRequest:         return QLatin1String("GenerateStoredKeyRequest");
         case StoredKeyRequest:                 return QLatin1String("StoredKeyRequest");
         case DeleteStoredKeyRequest:           return QLatin1String("DeleteStoredKeyRequest");
         case StoredKeyIdentifiersRequest:      return QLatin1String("StoredKeyIdentifiersRequest");
+        case StoredKeyIdentifiersPageRequest:  return QLatin1String("StoredKeyIdentifiersPageRequest");
+        case FindKeysRequest:                  return QLatin1String("FindKeysRequest");
         case SignRequest:                      return QLatin1String("SignRequest");
         case VerifyRequest:                    return QLatin1String("VerifyRequest");
         case EncryptRequest:                   return QLatin1String("EncryptRequest");
         case DecryptRequest:                   return QLatin1String("DecryptRequest");
+        case EncryptFdRequest:                 return QLatin1String("EncryptFdRequest");
+        case DecryptFdRequest:                 return QLatin1String("DecryptFdRequest");
+        case InitialiseCipherSessionRequest:   return QLatin1String("InitialiseCipherSessionRequest");
+        case UpdateCipherSessionRequest:       return QLatin1String("UpdateCipherSessionRequest");
+        case FinaliseCipherSessionRequest:     return QLatin1String("FinaliseCipherSessionRequest");
+        case SignBatchRequest:                 return QLatin1String("SignBatchRequest");
+        case VerifyBatchRequest:               return QLatin1String("VerifyBatchRequest");
+        case EncryptBatchRequest:              return QLatin1String("EncryptBatchRequest");
+        case GenerateDigestRequest:            return QLatin1String("GenerateDigestRequest");
+        case CalculateMacRequest:              return QLatin1String("CalculateMacRequest");
+        case GenerateRandomDataRequest:        return QLatin1String("GenerateRandomDataRequest");
         default: break;
     }
     return QLatin1String("Unknown Crypto Request!");
 }
 
+bool Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::isPriorityRequest(
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const
+{
+    return request->type == GetPluginInfoRequest
+        || request->type == StoredKeyIdentifiersRequest
+        || request->type == StoredKeyIdentifiersPageRequest
+        || request->type == FindKeysRequest;
+}
+
+QString Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::coalescingKey(
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const
+{
+    if (request->type != StoredKeyRequest || request->inParams.size() != 1) {
+        return QString();
+    }
+
+    const Sailfish::Crypto::Key::Identifier identifier = request->inParams.first().value<Sailfish::Crypto::Key::Identifier>();
+    return QStringLiteral("%1:%2:%3:%4")
+            .arg(request->type)
+            .arg(request->remotePid)
+            .arg(identifier.collectionName(), identifier.name());
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleCancelledRequest(
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request)
+{
+    // any secrets request performed on behalf of this request will still
+    // complete, but its result will be ignored by the request processor.
+    m_requestProcessor->cancelPendingRequest(request->requestId);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::closeCipherSessions(pid_t callerPid)
+{
+    m_requestProcessor->closeCipherSessions(callerPid);
+}
+
+quint64 Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::pluginInfoGeneration() const
+{
+    return m_requestProcessor->pluginInfoGeneration();
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::setKeyPool(const QString &specification)
+{
+    m_requestProcessor->setKeyPool(specification);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::setPluginHosts(const QString &specification)
+{
+    m_requestProcessor->setPluginHosts(specification);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::setPluginJobQueueDepth(int depth)
+{
+    m_requestProcessor->setPluginJobQueueDepth(depth);
+}
+
+QString Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::applicationId(pid_t callerPid) const
+{
+    return m_secrets->applicationId(callerPid);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::memoryUsage(QMap<QString, qint64> *usage) const
+{
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::memoryUsage(usage);
+    m_requestProcessor->memoryUsage(usage);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::releaseMemory()
+{
+    m_requestProcessor->releaseMemory();
+}
+
+QVariantMap Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::statistics() const
+{
+    QVariantMap stats = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::statistics();
+    stats.insert(QStringLiteral("pluginHosts"), m_requestProcessor->pluginHostStatistics());
+    return stats;
+}
+
+bool Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::isAsynchronousPluginRequest(
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request,
+        const Sailfish::Crypto::Key &key) const
+{
+    // requests for several items always use the synchronous plugin methods.
+    Sailfish::Crypto::Key::Operation operation = Sailfish::Crypto::Key::OperationUnknown;
+    switch (request->type) {
+        case SignRequest:       operation = Sailfish::Crypto::Key::Sign;    break;
+        case VerifyRequest:     operation = Sailfish::Crypto::Key::Verify;  break;
+        case EncryptRequest:
+        case EncryptFdRequest:  operation = Sailfish::Crypto::Key::Encrypt; break;
+        case DecryptRequest:
+        case DecryptFdRequest:  operation = Sailfish::Crypto::Key::Decrypt; break;
+        default:                return false;
+    }
+
+    // the cryptosystem provider name is the last parameter of each of these requests.
+    return !request->inParams.isEmpty()
+            && m_requestProcessor->providerIsAsynchronous(request->inParams.last().value<QString>(), key.algorithm(), operation);
+}
+
+bool Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::messagesDeferred() const
+{
+    return deferredMessageCount() > 0 || m_secrets->groupCommitPending();
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::messageDeferred()
+{
+    m_secrets->scheduleGroupCommit(deferredMessageCount());
+}
+
+qint64 Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::parameterSize(const QVariant &parameter) const
+{
+    if (parameter.userType() == qMetaTypeId<Sailfish::Crypto::Key>()) {
+        const Sailfish::Crypto::Key key = parameter.value<Sailfish::Crypto::Key>();
+        qint64 size = key.publicKey().size() + key.privateKey().size() + key.secretKey().size();
+        Q_FOREACH (const QByteArray &customParameter, key.customParameters()) {
+            size += customParameter.size();
+        }
+        return size;
+    } else if (parameter.userType() == qMetaTypeId<QVector<QByteArray> >()) {
+        qint64 size = 0;
+        Q_FOREACH (const QByteArray &data, parameter.value<QVector<QByteArray> >()) {
+            size += data.size();
+        }
+        return size;
+    } else if (parameter.userType() == qMetaTypeId<QVector<Sailfish::Crypto::Certificate> >()) {
+        // encoding each certificate just to measure it would be too expensive,
+        // so assume each is about as large as a typical DER-encoded certificate.
+        return parameter.value<QVector<Sailfish::Crypto::Certificate> >().size() * 2048;
+    } else if (parameter.userType() == qMetaTypeId<QVector<QVector<Sailfish::Crypto::Certificate> > >()) {
+        qint64 size = 0;
+        Q_FOREACH (const QVector<Sailfish::Crypto::Certificate> &chain, parameter.value<QVector<QVector<Sailfish::Crypto::Certificate> > >()) {
+            size += chain.size() * 2048;
+        }
+        return size;
+    }
+    return Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::parameterSize(parameter);
+}
+
+bool Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::isWorkerRequest(
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const
+{
+    // Only requests which are handled entirely by the crypto plugin may be
+    // handled on a worker thread.  Requests which involve a key reference
+    // must read the key from secrets storage, and so are handled on the main thread.
+    switch (request->type) {
+        case ValidateCertificateChainRequest:
+        case ValidateCertificateChainsRequest:
+        case GenerateKeyRequest:
+        case GenerateDigestRequest:
+        case GenerateRandomDataRequest:
+            return true;
+        case SignRequest:
+        case SignBatchRequest:
+        case CalculateMacRequest:
+        case DecryptRequest:
+        case DecryptFdRequest: {
+            // the key follows the data.
+            const Sailfish::Crypto::Key key = requestKey(request->inParams, 1);
+            return (!key.privateKey().isEmpty() || !key.secretKey().isEmpty())
+                    && !isAsynchronousPluginRequest(request, key);
+        }
+        case VerifyRequest:
+        case VerifyBatchRequest: {
+            // the key follows the data and the signature.
+            const Sailfish::Crypto::Key key = requestKey(request->inParams, 2);
+            return (!key.publicKey().isEmpty() || !key.privateKey().isEmpty() || !key.secretKey().isEmpty())
+                    && !isAsynchronousPluginRequest(request, key);
+        }
+        case EncryptRequest:
+        case EncryptFdRequest:
+        case EncryptBatchRequest: {
+            const Sailfish::Crypto::Key key = requestKey(request->inParams, 1);
+            return (!key.publicKey().isEmpty() || !key.privateKey().isEmpty() || !key.secretKey().isEmpty())
+                    && !isAsynchronousPluginRequest(request, key);
+        }
+        case InitialiseCipherSessionRequest: {
+            if (request->inParams.size() < 2) {
+                return false;
+            }
+            const Sailfish::Crypto::Key key = requestKey(request->inParams, 0);
+            const Sailfish::Crypto::Key::Operation operation = request->inParams.at(1).value<Sailfish::Crypto::Key::Operation>();
+            return !key.privateKey().isEmpty() || !key.secretKey().isEmpty()
+                    || (operation == Sailfish::Crypto::Key::Encrypt && !key.publicKey().isEmpty())
+                    || operation == Sailfish::Crypto::Key::GenerateDigest;
+        }
+        case UpdateCipherSessionRequest:
+        case FinaliseCipherSessionRequest:
+            // the session state is owned (and locked) by the crypto plugin.
+            // clients must wait for the reply to each update before sending the next.
+            return true;
+        default:
+            return false;
+    }
+}
+
+QList<QVariant> Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleWorkerRequest(
+        pid_t callerPid,
+        quint64 requestId,
+        int type,
+        const QList<QVariant> &inParams)
+{
+    QList<QVariant> params(inParams);
+    QList<QVariant> outParams;
+    switch (type) {
+        case ValidateCertificateChainRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling ValidateCertificateChainRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            bool validated = false;
+            QVector<Sailfish::Crypto::Certificate> chain = params.size() ? params.takeFirst().value<QVector<Sailfish::Crypto::Certificate> >() : QVector<Sailfish::Crypto::Certificate>();
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->validateCertificateChain(
+                        callerPid,
+                        requestId,
+                        chain,
+                        cryptosystemProviderName,
+                        &validated);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<bool>(validated);
+            break;
+        }
+        case ValidateCertificateChainsRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling ValidateCertificateChainsRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QVector<bool> validated;
+            QVector<QVector<Sailfish::Crypto::Certificate> > chains = params.size() ? params.takeFirst().value<QVector<QVector<Sailfish::Crypto::Certificate> > >() : QVector<QVector<Sailfish::Crypto::Certificate> >();
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->validateCertificateChains(
+                        callerPid,
+                        requestId,
+                        chains,
+                        cryptosystemProviderName,
+                        &validated);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QVector<bool> >(validated);
+            break;
+        }
+        case GenerateKeyRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling GenerateKeyRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            Sailfish::Crypto::Key key;
+            Sailfish::Crypto::Key templateKey = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->generateKey(
+                        callerPid,
+                        requestId,
+                        templateKey,
+                        cryptosystemProviderName,
+                        &key);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+            break;
+        }
+        case SignRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling SignRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QByteArray signature;
+            QByteArray data = params.size() ? params.takeFirst().value<QByteArray>() : QByteArray();
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::SignaturePadding padding = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>() : Sailfish::Crypto::Key::SignaturePaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->sign(
+                        callerPid,
+                        requestId,
+                        data,
+                        key,
+                        padding,
+                        digest,
+                        cryptosystemProviderName,
+                        &signature);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QByteArray>(signature);
+            break;
+        }
+        case VerifyRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling VerifyRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            bool verified = false;
+            QByteArray data = params.size() ? params.takeFirst().value<QByteArray>() : QByteArray();
+            QByteArray signature = params.size() ? params.takeFirst().value<QByteArray>() : QByteArray();
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::SignaturePadding padding = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>() : Sailfish::Crypto::Key::SignaturePaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->verify(
+                        callerPid,
+                        requestId,
+                        data,
+                        signature,
+                        key,
+                        padding,
+                        digest,
+                        cryptosystemProviderName,
+                        &verified);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<bool>(verified);
+            break;
+        }
+        case EncryptRequest:
+        case EncryptFdRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling" << requestTypeToString(type) << "from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QByteArray encrypted;
+            // a memfd payload remains mapped until the request has been handled.
+            Sailfish::Secrets::Daemon::MappedMemfd mapping;
+            QByteArray data;
+            QString errorString;
+            const bool payloadMapped = Sailfish::Secrets::Daemon::payloadData(params.size() ? params.takeFirst() : QVariant(), &mapping, &data, &errorString);
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::BlockMode blockMode = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::BlockMode>() : Sailfish::Crypto::Key::BlockModeUnknown;
+            Sailfish::Crypto::Key::EncryptionPadding padding = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>() : Sailfish::Crypto::Key::EncryptionPaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = payloadMapped
+                    ? m_requestProcessor->encrypt(
+                              callerPid,
+                              requestId,
+                              data,
+                              key,
+                              blockMode,
+                              padding,
+                              digest,
+                              cryptosystemProviderName,
+                              &encrypted)
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::SerialisationError, errorString);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QByteArray>(encrypted);
+            break;
+        }
+        case DecryptRequest:
+        case DecryptFdRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling" << requestTypeToString(type) << "from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QByteArray decrypted;
+            // a memfd payload remains mapped until the request has been handled.
+            Sailfish::Secrets::Daemon::MappedMemfd mapping;
+            QByteArray data;
+            QString errorString;
+            const bool payloadMapped = Sailfish::Secrets::Daemon::payloadData(params.size() ? params.takeFirst() : QVariant(), &mapping, &data, &errorString);
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::BlockMode blockMode = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::BlockMode>() : Sailfish::Crypto::Key::BlockModeUnknown;
+            Sailfish::Crypto::Key::EncryptionPadding padding = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>() : Sailfish::Crypto::Key::EncryptionPaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = payloadMapped
+                    ? m_requestProcessor->decrypt(
+                              callerPid,
+                              requestId,
+                              data,
+                              key,
+                              blockMode,
+                              padding,
+                              digest,
+                              cryptosystemProviderName,
+                              &decrypted)
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::SerialisationError, errorString);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QByteArray>(decrypted);
+            break;
+        }
+        case SignBatchRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling SignBatchRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QVector<QByteArray> signatures;
+            QVector<QByteArray> data = params.size() ? params.takeFirst().value<QVector<QByteArray> >() : QVector<QByteArray>();
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::SignaturePadding padding = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>() : Sailfish::Crypto::Key::SignaturePaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->signBatch(
+                        callerPid,
+                        requestId,
+                        data,
+                        key,
+                        padding,
+                        digest,
+                        cryptosystemProviderName,
+                        &signatures);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QVector<QByteArray> >(signatures);
+            break;
+        }
+        case VerifyBatchRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling VerifyBatchRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QVector<bool> verified;
+            QVector<QByteArray> data = params.size() ? params.takeFirst().value<QVector<QByteArray> >() : QVector<QByteArray>();
+            QVector<QByteArray> signatures = params.size() ? params.takeFirst().value<QVector<QByteArray> >() : QVector<QByteArray>();
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::SignaturePadding padding = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>() : Sailfish::Crypto::Key::SignaturePaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->verifyBatch(
+                        callerPid,
+                        requestId,
+                        data,
+                        signatures,
+                        key,
+                        padding,
+                        digest,
+                        cryptosystemProviderName,
+                        &verified);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QVector<bool> >(verified);
+            break;
+        }
+        case EncryptBatchRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling EncryptBatchRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QVector<QByteArray> encrypted;
+            QVector<QByteArray> data = params.size() ? params.takeFirst().value<QVector<QByteArray> >() : QVector<QByteArray>();
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::BlockMode blockMode = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::BlockMode>() : Sailfish::Crypto::Key::BlockModeUnknown;
+            Sailfish::Crypto::Key::EncryptionPadding padding = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>() : Sailfish::Crypto::Key::EncryptionPaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->encryptBatch(
+                        callerPid,
+                        requestId,
+                        data,
+                        key,
+                        blockMode,
+                        padding,
+                        digest,
+                        cryptosystemProviderName,
+                        &encrypted);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QVector<QByteArray> >(encrypted);
+            break;
+        }
+        case GenerateRandomDataRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling GenerateRandomDataRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QByteArray randomData;
+            quint64 numberBytes = params.size() ? params.takeFirst().value<quint64>() : 0;
+            QString csprngEngineName = params.size() ? params.takeFirst().value<QString>() : QString();
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->generateRandomData(
+                        callerPid,
+                        requestId,
+                        numberBytes,
+                        csprngEngineName,
+                        cryptosystemProviderName,
+                        &randomData);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QByteArray>(randomData);
+            break;
+        }
+        case GenerateDigestRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling GenerateDigestRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QByteArray digestValue;
+            QByteArray data = params.size() ? params.takeFirst().value<QByteArray>() : QByteArray();
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->generateDigest(
+                        callerPid,
+                        requestId,
+                        data,
+                        digest,
+                        cryptosystemProviderName,
+                        &digestValue);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QByteArray>(digestValue);
+            break;
+        }
+        case CalculateMacRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling CalculateMacRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QByteArray mac;
+            QByteArray data = params.size() ? params.takeFirst().value<QByteArray>() : QByteArray();
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->calculateMac(
+                        callerPid,
+                        requestId,
+                        data,
+                        key,
+                        digest,
+                        cryptosystemProviderName,
+                        &mac);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QByteArray>(mac);
+            break;
+        }
+        case InitialiseCipherSessionRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling InitialiseCipherSessionRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            quint32 cipherSessionToken = 0;
+            Sailfish::Crypto::Key key = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::Operation operation = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Operation>() : Sailfish::Crypto::Key::OperationUnknown;
+            Sailfish::Crypto::Key::BlockMode blockMode = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::BlockMode>() : Sailfish::Crypto::Key::BlockModeUnknown;
+            Sailfish::Crypto::Key::EncryptionPadding padding = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>() : Sailfish::Crypto::Key::EncryptionPaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = params.size() ? params.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->initialiseCipherSession(
+                        callerPid,
+                        requestId,
+                        key,
+                        operation,
+                        blockMode,
+                        padding,
+                        digest,
+                        cryptosystemProviderName,
+                        &cipherSessionToken);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<quint32>(cipherSessionToken);
+            break;
+        }
+        case UpdateCipherSessionRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling UpdateCipherSessionRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QByteArray generatedData;
+            QByteArray data = params.size() ? params.takeFirst().value<QByteArray>() : QByteArray();
+            quint32 cipherSessionToken = params.size() ? params.takeFirst().value<quint32>() : 0;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->updateCipherSession(
+                        callerPid,
+                        requestId,
+                        data,
+                        cipherSessionToken,
+                        cryptosystemProviderName,
+                        &generatedData);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QByteArray>(generatedData);
+            break;
+        }
+        case FinaliseCipherSessionRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling FinaliseCipherSessionRequest from client:" << callerPid << ", request number:" << requestId << "on worker thread";
+            QByteArray generatedData;
+            quint32 cipherSessionToken = params.size() ? params.takeFirst().value<quint32>() : 0;
+            QString cryptosystemProviderName = params.size() ? params.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->finaliseCipherSession(
+                        callerPid,
+                        requestId,
+                        cipherSessionToken,
+                        cryptosystemProviderName,
+                        &generatedData);
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                      << QVariant::fromValue<QByteArray>(generatedData);
+            break;
+        }
+        default: {
+            qCWarning(lcSailfishCryptoDaemon) << "Cannot handle request:" << requestId
+                                               << "with type:" << requestTypeToString(type) << "on worker thread";
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(
+                             Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                      QLatin1String("Internal error: request cannot be handled on worker thread")));
+            break;
+        }
+    }
+    return outParams;
+}
+
 void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest(
         Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request,
         bool *completed)
@@ -312,9 +1256,9 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QVector<Sailfish::Crypto::CryptoPluginInfo> >(cryptoPlugins)
-                                                                        << QVariant::fromValue<QStringList>(storagePlugins));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<Sailfish::Crypto::CryptoPluginInfo> >(cryptoPlugins)
+                                                                                << QVariant::fromValue<QStringList>(storagePlugins), request->message);
                 *completed = true;
             }
             break;
@@ -324,10 +1268,32 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
             bool validated = false;
             QVector<Sailfish::Crypto::Certificate> chain = request->inParams.size() ? request->inParams.takeFirst().value<QVector<Sailfish::Crypto::Certificate> >() : QVector<Sailfish::Crypto::Certificate>();
             QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
-            Sailfish::Crypto::Result result = m_requestProcessor->validateCertificateChain(
+            Sailfish::Crypto::Result result = m_requestProcessor->validateCertificateChain(
+                        request->remotePid,
+                        request->requestId,
+                        chain,
+                        cryptosystemProviderName,
+                        &validated);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<bool>(validated), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case ValidateCertificateChainsRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling ValidateCertificateChainsRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QVector<bool> validated;
+            QVector<QVector<Sailfish::Crypto::Certificate> > chains = request->inParams.size() ? request->inParams.takeFirst().value<QVector<QVector<Sailfish::Crypto::Certificate> > >() : QVector<QVector<Sailfish::Crypto::Certificate> >();
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->validateCertificateChains(
                         request->remotePid,
                         request->requestId,
-                        chain,
+                        chains,
                         cryptosystemProviderName,
                         &validated);
             // send the reply to the calling peer.
@@ -335,8 +1301,8 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<bool>(validated));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<bool> >(validated), request->message);
                 *completed = true;
             }
             break;
@@ -357,8 +1323,8 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<Sailfish::Crypto::Key>(key));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<Sailfish::Crypto::Key>(key), request->message);
                 *completed = true;
             }
             break;
@@ -381,8 +1347,8 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<Sailfish::Crypto::Key>(key));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<Sailfish::Crypto::Key>(key), request->message);
                 *completed = true;
             }
             break;
@@ -390,19 +1356,26 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
         case StoredKeyRequest: {
             qCDebug(lcSailfishCryptoDaemon) << "Handling StoredKeyRequest from client:" << request->remotePid << ", request number:" << request->requestId;
             Sailfish::Crypto::Key key;
-            QString name = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Key::Identifier identifier = request->inParams.size()
+                    ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Identifier>()
+                    : Sailfish::Crypto::Key::Identifier();
             Sailfish::Crypto::Result result = m_requestProcessor->storedKey(
                         request->remotePid,
                         request->requestId,
-                        name,
+                        identifier,
                         &key);
             // send the reply to the calling peer.
             if (result.code() == Sailfish::Crypto::Result::Pending) {
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<Sailfish::Crypto::Key>(key));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<Sailfish::Crypto::Key>(key), request->message);
+                if (!request->coalescingKey.isEmpty()) {
+                    // share the result with any identical requests.
+                    request->outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                       << QVariant::fromValue<Sailfish::Crypto::Key>(key);
+                }
                 *completed = true;
             }
             break;
@@ -419,7 +1392,7 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result), request->message);
                 *completed = true;
             }
             break;
@@ -436,12 +1409,45 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QVector<Sailfish::Crypto::Key::Identifier> >(identifiers));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<Sailfish::Crypto::Key::Identifier> >(identifiers), request->message);
                 *completed = true;
             }
             break;
         }
+        case StoredKeyIdentifiersPageRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling StoredKeyIdentifiersPageRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            qint64 cursor = request->inParams.size() ? request->inParams.takeFirst().value<qint64>() : 0;
+            int limit = request->inParams.size() ? request->inParams.takeFirst().value<int>() : 0;
+            QVector<Sailfish::Crypto::Key::Identifier> identifiers;
+            qint64 nextCursor = 0;
+            Sailfish::Crypto::Result result = m_requestProcessor->storedKeyIdentifiers(
+                        request->remotePid,
+                        request->requestId,
+                        cursor,
+                        limit,
+                        &identifiers,
+                        &nextCursor);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                            << QVariant::fromValue<QVector<Sailfish::Crypto::Key::Identifier> >(identifiers)
+                                                                            << QVariant::fromValue<qint64>(nextCursor), request->message);
+            *completed = true;
+            break;
+        }
+        case FindKeysRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling FindKeysRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            Sailfish::Crypto::Key::FilterData filter = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::FilterData>() : Sailfish::Crypto::Key::FilterData();
+            QVector<Sailfish::Crypto::Key::Identifier> identifiers;
+            Sailfish::Crypto::Result result = m_requestProcessor->findKeys(
+                        request->remotePid,
+                        request->requestId,
+                        filter,
+                        &identifiers);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                            << QVariant::fromValue<QVector<Sailfish::Crypto::Key::Identifier> >(identifiers), request->message);
+            *completed = true;
+            break;
+        }
         case SignRequest: {
             qCDebug(lcSailfishCryptoDaemon) << "Handling SignRequest from client:" << request->remotePid << ", request number:" << request->requestId;
             QByteArray signature;
@@ -464,8 +1470,8 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QByteArray>(signature));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QByteArray>(signature), request->message);
                 *completed = true;
             }
             break;
@@ -474,6 +1480,7 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
             qCDebug(lcSailfishCryptoDaemon) << "Handling VerifyRequest from client:" << request->remotePid << ", request number:" << request->requestId;
             bool verified;
             QByteArray data = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
+            QByteArray signature = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
             Sailfish::Crypto::Key key = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
             Sailfish::Crypto::Key::SignaturePadding padding = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>() : Sailfish::Crypto::Key::SignaturePaddingUnknown;
             Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
@@ -482,6 +1489,7 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                         request->remotePid,
                         request->requestId,
                         data,
+                        signature,
                         key,
                         padding,
                         digest,
@@ -492,22 +1500,156 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<bool>(verified));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<bool>(verified), request->message);
                 *completed = true;
             }
             break;
         }
-        case EncryptRequest: {
-            qCDebug(lcSailfishCryptoDaemon) << "Handling EncryptRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+        case EncryptRequest:
+        case EncryptFdRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling" << requestTypeToString(request->type) << "from client:" << request->remotePid << ", request number:" << request->requestId;
             QByteArray encrypted;
-            QByteArray data = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
+            // a memfd payload remains mapped until the request has been handled.
+            Sailfish::Secrets::Daemon::MappedMemfd mapping;
+            QByteArray data;
+            QString errorString;
+            const bool payloadMapped = Sailfish::Secrets::Daemon::payloadData(request->inParams.size() ? request->inParams.takeFirst() : QVariant(), &mapping, &data, &errorString);
+            Sailfish::Crypto::Key key = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::BlockMode blockMode = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::BlockMode>() : Sailfish::Crypto::Key::BlockModeUnknown;
+            Sailfish::Crypto::Key::EncryptionPadding padding = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>() : Sailfish::Crypto::Key::EncryptionPaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = payloadMapped
+                    ? m_requestProcessor->encrypt(
+                              request->remotePid,
+                              request->requestId,
+                              data,
+                              key,
+                              blockMode,
+                              padding,
+                              digest,
+                              cryptosystemProviderName,
+                              &encrypted)
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::SerialisationError, errorString);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                const QVariant output = outputPayload(request->type, encrypted, &result);
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << output, request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case DecryptRequest:
+        case DecryptFdRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling" << requestTypeToString(request->type) << "from client:" << request->remotePid << ", request number:" << request->requestId;
+            QByteArray decrypted;
+            // a memfd payload remains mapped until the request has been handled.
+            Sailfish::Secrets::Daemon::MappedMemfd mapping;
+            QByteArray data;
+            QString errorString;
+            const bool payloadMapped = Sailfish::Secrets::Daemon::payloadData(request->inParams.size() ? request->inParams.takeFirst() : QVariant(), &mapping, &data, &errorString);
+            Sailfish::Crypto::Key key = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::BlockMode blockMode = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::BlockMode>() : Sailfish::Crypto::Key::BlockModeUnknown;
+            Sailfish::Crypto::Key::EncryptionPadding padding = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>() : Sailfish::Crypto::Key::EncryptionPaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = payloadMapped
+                    ? m_requestProcessor->decrypt(
+                              request->remotePid,
+                              request->requestId,
+                              data,
+                              key,
+                              blockMode,
+                              padding,
+                              digest,
+                              cryptosystemProviderName,
+                              &decrypted)
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::SerialisationError, errorString);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                const QVariant output = outputPayload(request->type, decrypted, &result);
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << output, request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case SignBatchRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling SignBatchRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QVector<QByteArray> signatures;
+            QVector<QByteArray> data = request->inParams.size() ? request->inParams.takeFirst().value<QVector<QByteArray> >() : QVector<QByteArray>();
+            Sailfish::Crypto::Key key = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::SignaturePadding padding = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>() : Sailfish::Crypto::Key::SignaturePaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->signBatch(
+                        request->remotePid,
+                        request->requestId,
+                        data,
+                        key,
+                        padding,
+                        digest,
+                        cryptosystemProviderName,
+                        &signatures);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<QByteArray> >(signatures), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case VerifyBatchRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling VerifyBatchRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QVector<bool> verified;
+            QVector<QByteArray> data = request->inParams.size() ? request->inParams.takeFirst().value<QVector<QByteArray> >() : QVector<QByteArray>();
+            QVector<QByteArray> signatures = request->inParams.size() ? request->inParams.takeFirst().value<QVector<QByteArray> >() : QVector<QByteArray>();
+            Sailfish::Crypto::Key key = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::SignaturePadding padding = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>() : Sailfish::Crypto::Key::SignaturePaddingUnknown;
+            Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->verifyBatch(
+                        request->remotePid,
+                        request->requestId,
+                        data,
+                        signatures,
+                        key,
+                        padding,
+                        digest,
+                        cryptosystemProviderName,
+                        &verified);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<bool> >(verified), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case EncryptBatchRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling EncryptBatchRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QVector<QByteArray> encrypted;
+            QVector<QByteArray> data = request->inParams.size() ? request->inParams.takeFirst().value<QVector<QByteArray> >() : QVector<QByteArray>();
             Sailfish::Crypto::Key key = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
             Sailfish::Crypto::Key::BlockMode blockMode = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::BlockMode>() : Sailfish::Crypto::Key::BlockModeUnknown;
             Sailfish::Crypto::Key::EncryptionPadding padding = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>() : Sailfish::Crypto::Key::EncryptionPaddingUnknown;
             Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
             QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
-            Sailfish::Crypto::Result result = m_requestProcessor->encrypt(
+            Sailfish::Crypto::Result result = m_requestProcessor->encryptBatch(
                         request->remotePid,
                         request->requestId,
                         data,
@@ -522,42 +1664,140 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handlePendingRequest
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QByteArray>(encrypted));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<QByteArray> >(encrypted), request->message);
                 *completed = true;
             }
             break;
         }
-        case DecryptRequest: {
-            qCDebug(lcSailfishCryptoDaemon) << "Handling DecryptRequest from client:" << request->remotePid << ", request number:" << request->requestId;
-            QByteArray decrypted;
+        case GenerateRandomDataRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling GenerateRandomDataRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QByteArray randomData;
+            quint64 numberBytes = request->inParams.size() ? request->inParams.takeFirst().value<quint64>() : 0;
+            QString csprngEngineName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->generateRandomData(
+                        request->remotePid,
+                        request->requestId,
+                        numberBytes,
+                        csprngEngineName,
+                        cryptosystemProviderName,
+                        &randomData);
+            // send the reply to the calling peer.
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                            << QVariant::fromValue<QByteArray>(randomData), request->message);
+            *completed = true;
+            break;
+        }
+        case GenerateDigestRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling GenerateDigestRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QByteArray digestValue;
+            QByteArray data = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
+            Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->generateDigest(
+                        request->remotePid,
+                        request->requestId,
+                        data,
+                        digest,
+                        cryptosystemProviderName,
+                        &digestValue);
+            // send the reply to the calling peer.
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                            << QVariant::fromValue<QByteArray>(digestValue), request->message);
+            *completed = true;
+            break;
+        }
+        case CalculateMacRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling CalculateMacRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QByteArray mac;
             QByteArray data = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
             Sailfish::Crypto::Key key = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->calculateMac(
+                        request->remotePid,
+                        request->requestId,
+                        data,
+                        key,
+                        digest,
+                        cryptosystemProviderName,
+                        &mac);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QByteArray>(mac), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case InitialiseCipherSessionRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling InitialiseCipherSessionRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            quint32 cipherSessionToken = 0;
+            Sailfish::Crypto::Key key = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key>() : Sailfish::Crypto::Key();
+            Sailfish::Crypto::Key::Operation operation = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Operation>() : Sailfish::Crypto::Key::OperationUnknown;
             Sailfish::Crypto::Key::BlockMode blockMode = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::BlockMode>() : Sailfish::Crypto::Key::BlockModeUnknown;
             Sailfish::Crypto::Key::EncryptionPadding padding = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>() : Sailfish::Crypto::Key::EncryptionPaddingUnknown;
             Sailfish::Crypto::Key::Digest digest = request->inParams.size() ? request->inParams.takeFirst().value<Sailfish::Crypto::Key::Digest>() : Sailfish::Crypto::Key::DigestUnknown;
             QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
-            Sailfish::Crypto::Result result = m_requestProcessor->decrypt(
+            Sailfish::Crypto::Result result = m_requestProcessor->initialiseCipherSession(
                         request->remotePid,
                         request->requestId,
-                        data,
                         key,
+                        operation,
                         blockMode,
                         padding,
                         digest,
                         cryptosystemProviderName,
-                        &decrypted);
+                        &cipherSessionToken);
             // send the reply to the calling peer.
             if (result.code() == Sailfish::Crypto::Result::Pending) {
                 // waiting for asynchronous flow to complete
                 *completed = false;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QByteArray>(decrypted));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<quint32>(cipherSessionToken), request->message);
                 *completed = true;
             }
             break;
         }
+        case UpdateCipherSessionRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling UpdateCipherSessionRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QByteArray generatedData;
+            QByteArray data = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
+            quint32 cipherSessionToken = request->inParams.size() ? request->inParams.takeFirst().value<quint32>() : 0;
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->updateCipherSession(
+                        request->remotePid,
+                        request->requestId,
+                        data,
+                        cipherSessionToken,
+                        cryptosystemProviderName,
+                        &generatedData);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                            << QVariant::fromValue<QByteArray>(generatedData), request->message);
+            *completed = true;
+            break;
+        }
+        case FinaliseCipherSessionRequest: {
+            qCDebug(lcSailfishCryptoDaemon) << "Handling FinaliseCipherSessionRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QByteArray generatedData;
+            quint32 cipherSessionToken = request->inParams.size() ? request->inParams.takeFirst().value<quint32>() : 0;
+            QString cryptosystemProviderName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Crypto::Result result = m_requestProcessor->finaliseCipherSession(
+                        request->remotePid,
+                        request->requestId,
+                        cipherSessionToken,
+                        cryptosystemProviderName,
+                        &generatedData);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                            << QVariant::fromValue<QByteArray>(generatedData), request->message);
+            *completed = true;
+            break;
+        }
         default: {
             qCWarning(lcSailfishCryptoDaemon) << "Cannot handle request:" << request->requestId
                                                << "with invalid type:" << requestTypeToString(request->type);
@@ -588,9 +1828,9 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 QStringList storagePlugins = request->outParams.size()
                         ? request->outParams.takeFirst().value<QStringList>()
                         : QStringList();
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QVector<Sailfish::Crypto::CryptoPluginInfo> >(cryptoPlugins)
-                                                                        << QVariant::fromValue<QStringList>(storagePlugins));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<Sailfish::Crypto::CryptoPluginInfo> >(cryptoPlugins)
+                                                                                << QVariant::fromValue<QStringList>(storagePlugins), request->message);
                 *completed = true;
             }
             break;
@@ -606,8 +1846,25 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 *completed = true;
             } else {
                 bool validated = request->outParams.size() ? request->outParams.takeFirst().value<bool>() : false;
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<bool>(validated));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<bool>(validated), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case ValidateCertificateChainsRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of ValidateCertificateChainsRequest request"));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << "ValidateCertificateChainsRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QVector<bool> validated = request->outParams.size() ? request->outParams.takeFirst().value<QVector<bool> >() : QVector<bool>();
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<bool> >(validated), request->message);
                 *completed = true;
             }
             break;
@@ -625,8 +1882,8 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 Sailfish::Crypto::Key key = request->outParams.size()
                         ? request->outParams.takeFirst().value<Sailfish::Crypto::Key>()
                         : Sailfish::Crypto::Key();
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<Sailfish::Crypto::Key>(key));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<Sailfish::Crypto::Key>(key), request->message);
                 *completed = true;
             }
             break;
@@ -644,8 +1901,8 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 Sailfish::Crypto::Key key = request->outParams.size()
                         ? request->outParams.takeFirst().value<Sailfish::Crypto::Key>()
                         : Sailfish::Crypto::Key();
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<Sailfish::Crypto::Key>(key));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<Sailfish::Crypto::Key>(key), request->message);
                 *completed = true;
             }
             break;
@@ -663,8 +1920,8 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 Sailfish::Crypto::Key key = request->outParams.size()
                         ? request->outParams.takeFirst().value<Sailfish::Crypto::Key>()
                         : Sailfish::Crypto::Key();
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<Sailfish::Crypto::Key>(key));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<Sailfish::Crypto::Key>(key), request->message);
                 *completed = true;
             }
             break;
@@ -679,7 +1936,7 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 qCWarning(lcSailfishCryptoDaemon) << "DeleteStoredKeyRequest:" << request->requestId << "finished as pending!";
                 *completed = true;
             } else {
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result), request->message);
                 *completed = true;
             }
             break;
@@ -697,12 +1954,42 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 QVector<Sailfish::Crypto::Key::Identifier> identifiers = request->outParams.size()
                         ? request->outParams.takeFirst().value<QVector<Sailfish::Crypto::Key::Identifier> >()
                         : QVector<Sailfish::Crypto::Key::Identifier>();
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QVector<Sailfish::Crypto::Key::Identifier> >(identifiers));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<Sailfish::Crypto::Key::Identifier> >(identifiers), request->message);
                 *completed = true;
             }
             break;
         }
+        case StoredKeyIdentifiersPageRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of StoredKeyIdentifiersPageRequest request"));
+            QVector<Sailfish::Crypto::Key::Identifier> identifiers = request->outParams.size()
+                    ? request->outParams.takeFirst().value<QVector<Sailfish::Crypto::Key::Identifier> >()
+                    : QVector<Sailfish::Crypto::Key::Identifier>();
+            qint64 nextCursor = request->outParams.size()
+                    ? request->outParams.takeFirst().value<qint64>()
+                    : 0;
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                            << QVariant::fromValue<QVector<Sailfish::Crypto::Key::Identifier> >(identifiers)
+                                                                            << QVariant::fromValue<qint64>(nextCursor), request->message);
+            *completed = true;
+            break;
+        }
+        case FindKeysRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of FindKeysRequest request"));
+            QVector<Sailfish::Crypto::Key::Identifier> identifiers = request->outParams.size()
+                    ? request->outParams.takeFirst().value<QVector<Sailfish::Crypto::Key::Identifier> >()
+                    : QVector<Sailfish::Crypto::Key::Identifier>();
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                            << QVariant::fromValue<QVector<Sailfish::Crypto::Key::Identifier> >(identifiers), request->message);
+            *completed = true;
+            break;
+        }
         case SignRequest: {
             Sailfish::Crypto::Result result = request->outParams.size()
                     ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
@@ -716,8 +2003,8 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 QByteArray signature = request->outParams.size()
                         ? request->outParams.takeFirst().toByteArray()
                         : QByteArray();
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QByteArray>(signature));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QByteArray>(signature), request->message);
                 *completed = true;
             }
             break;
@@ -735,46 +2022,203 @@ void Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue::handleFinishedReques
                 bool verified = request->outParams.size()
                         ? request->outParams.takeFirst().toBool()
                         : false;
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<bool>(verified));
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<bool>(verified), request->message);
                 *completed = true;
             }
             break;
         }
-        case EncryptRequest: {
+        case EncryptRequest:
+        case EncryptFdRequest: {
             Sailfish::Crypto::Result result = request->outParams.size()
                     ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
                     : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
-                                                QLatin1String("Unable to determine result of EncryptRequest request"));
+                                                QString::fromLatin1("Unable to determine result of %1 request").arg(requestTypeToString(request->type)));
             if (result.code() == Sailfish::Crypto::Result::Pending) {
                 // shouldn't happen!
-                qCWarning(lcSailfishCryptoDaemon) << "EncryptRequest:" << request->requestId << "finished as pending!";
+                qCWarning(lcSailfishCryptoDaemon) << requestTypeToString(request->type) << request->requestId << "finished as pending!";
                 *completed = true;
             } else {
                 QByteArray encrypted = request->outParams.size()
                         ? request->outParams.takeFirst().toByteArray()
                         : QByteArray();
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QByteArray>(encrypted));
+                const QVariant output = outputPayload(request->type, encrypted, &result);
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << output, request->message);
                 *completed = true;
             }
             break;
         }
-        case DecryptRequest: {
+        case DecryptRequest:
+        case DecryptFdRequest: {
             Sailfish::Crypto::Result result = request->outParams.size()
                     ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
                     : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
-                                                QLatin1String("Unable to determine result of DecryptRequest request"));
+                                                QString::fromLatin1("Unable to determine result of %1 request").arg(requestTypeToString(request->type)));
             if (result.code() == Sailfish::Crypto::Result::Pending) {
                 // shouldn't happen!
-                qCWarning(lcSailfishCryptoDaemon) << "DecryptRequest:" << request->requestId << "finished as pending!";
+                qCWarning(lcSailfishCryptoDaemon) << requestTypeToString(request->type) << request->requestId << "finished as pending!";
                 *completed = true;
             } else {
                 QByteArray decrypted = request->outParams.size()
                         ? request->outParams.takeFirst().toByteArray()
                         : QByteArray();
-                request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
-                                                                        << QVariant::fromValue<QByteArray>(decrypted));
+                const QVariant output = outputPayload(request->type, decrypted, &result);
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << output, request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case SignBatchRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of SignBatchRequest request"));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << "SignBatchRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QVector<QByteArray> signatures = request->outParams.size()
+                        ? request->outParams.takeFirst().value<QVector<QByteArray> >()
+                        : QVector<QByteArray>();
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<QByteArray> >(signatures), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case VerifyBatchRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of VerifyBatchRequest request"));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << "VerifyBatchRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QVector<bool> verified = request->outParams.size()
+                        ? request->outParams.takeFirst().value<QVector<bool> >()
+                        : QVector<bool>();
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<bool> >(verified), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case EncryptBatchRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of EncryptBatchRequest request"));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << "EncryptBatchRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QVector<QByteArray> encrypted = request->outParams.size()
+                        ? request->outParams.takeFirst().value<QVector<QByteArray> >()
+                        : QVector<QByteArray>();
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QVector<QByteArray> >(encrypted), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case GenerateRandomDataRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of GenerateRandomDataRequest request"));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << "GenerateRandomDataRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QByteArray randomData = request->outParams.size()
+                        ? request->outParams.takeFirst().toByteArray()
+                        : QByteArray();
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QByteArray>(randomData), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case GenerateDigestRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of GenerateDigestRequest request"));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << "GenerateDigestRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QByteArray output = request->outParams.size()
+                        ? request->outParams.takeFirst().toByteArray()
+                        : QByteArray();
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QByteArray>(output), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case CalculateMacRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of CalculateMacRequest request"));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << "CalculateMacRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QByteArray output = request->outParams.size()
+                        ? request->outParams.takeFirst().toByteArray()
+                        : QByteArray();
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QByteArray>(output), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case InitialiseCipherSessionRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of InitialiseCipherSessionRequest request"));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << "InitialiseCipherSessionRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                quint32 cipherSessionToken = request->outParams.size()
+                        ? request->outParams.takeFirst().value<quint32>()
+                        : 0;
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<quint32>(cipherSessionToken), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case UpdateCipherSessionRequest:
+        case FinaliseCipherSessionRequest: {
+            Sailfish::Crypto::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Crypto::Result>()
+                    : Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                                QString::fromLatin1("Unable to determine result of %1 request").arg(requestTypeToString(request->type)));
+            if (result.code() == Sailfish::Crypto::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishCryptoDaemon) << requestTypeToString(request->type) << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QByteArray generatedData = request->outParams.size()
+                        ? request->outParams.takeFirst().toByteArray()
+                        : QByteArray();
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Crypto::Result>(result)
+                                                                                << QVariant::fromValue<QByteArray>(generatedData), request->message);
                 *completed = true;
             }
             break;
@@ -15,6 +15,7 @@
 #include "Crypto/extensionplugins.h"
 
 #include <QtDBus/QDBusContext>
+#include <QtDBus/QDBusUnixFileDescriptor>
 
 namespace Sailfish {
 
@@ -46,6 +47,16 @@ class CryptoDBusObject : public QObject, protected QDBusContext
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QVector<Sailfish::Crypto::CryptoPluginInfo>\" />\n"
     "      </method>\n"
+    "      <method name=\"getPluginInfoGeneration\">\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"generation\" type=\"t\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"setNextRequestDeadline\">\n"
+    "          <arg name=\"method\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"timeoutMsecs\" type=\"x\" direction=\"in\" />\n"
+    "          <annotation name=\"org.freedesktop.DBus.Method.NoReply\" value=\"true\" />\n"
+    "      </method>\n"
     "      <method name=\"validateCertificateChain\">\n"
     "          <arg name=\"chain\" type=\"a(iay)\" direction=\"in\" />\n"
     "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
@@ -54,6 +65,15 @@ class CryptoDBusObject : public QObject, protected QDBusContext
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"QVector<Sailfish::Crypto::Certificate>\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
     "      </method>\n"
+    "      <method name=\"validateCertificateChains\">\n"
+    "          <arg name=\"chains\" type=\"aa(iay)\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"valid\" type=\"ab\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"QVector<QVector<Sailfish::Crypto::Certificate> >\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QVector<bool>\" />\n"
+    "      </method>\n"
     "      <method name=\"generateKey\">\n"
     "          <arg name=\"keyTemplate\" type=\"(ay)\" direction=\"in\" />\n"
     "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
@@ -93,6 +113,23 @@ class CryptoDBusObject : public QObject, protected QDBusContext
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QVector<Sailfish::Crypto::Key::Identifier>\" />\n"
     "      </method>\n"
+    "      <method name=\"storedKeyIdentifiers\">\n"
+    "          <arg name=\"cursor\" type=\"x\" direction=\"in\" />\n"
+    "          <arg name=\"limit\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"identifiers\" type=\"a(ss)\" direction=\"out\" />\n"
+    "          <arg name=\"nextCursor\" type=\"x\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QVector<Sailfish::Crypto::Key::Identifier>\" />\n"
+    "      </method>\n"
+    "      <method name=\"findKeys\">\n"
+    "          <arg name=\"filter\" type=\"a{ss}\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"identifiers\" type=\"a(ss)\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"Sailfish::Crypto::Key::FilterData\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QVector<Sailfish::Crypto::Key::Identifier>\" />\n"
+    "      </method>\n"
     "      <method name=\"sign\">\n"
     "          <arg name=\"data\" type=\"ay\" direction=\"in\" />\n"
     "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
@@ -108,15 +145,16 @@ class CryptoDBusObject : public QObject, protected QDBusContext
     "      </method>\n"
     "      <method name=\"verify\">\n"
     "          <arg name=\"data\" type=\"ay\" direction=\"in\" />\n"
+    "          <arg name=\"signature\" type=\"ay\" direction=\"in\" />\n"
     "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
     "          <arg name=\"padding\" type=\"i\" direction=\"in\" />\n"
     "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
     "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
     "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
     "          <arg name=\"verified\" type=\"b\" direction=\"out\" />\n"
-    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Crypto::Key\" />\n"
-    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key::SignaturePadding\" />\n"
-    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Crypto::Key::SignaturePadding\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
     "      </method>\n"
     "      <method name=\"encrypt\">\n"
@@ -149,6 +187,148 @@ class CryptoDBusObject : public QObject, protected QDBusContext
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
     "      </method>\n"
+    "      <method name=\"encryptFd\">\n"
+    "          <arg name=\"data\" type=\"h\" direction=\"in\" />\n"
+    "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
+    "          <arg name=\"blockMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"padding\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"encrypted\" type=\"h\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Crypto::Key\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key::BlockMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Crypto::Key::EncryptionPadding\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"decryptFd\">\n"
+    "          <arg name=\"data\" type=\"h\" direction=\"in\" />\n"
+    "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
+    "          <arg name=\"blockMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"padding\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"decrypted\" type=\"h\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Crypto::Key\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key::BlockMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Crypto::Key::EncryptionPadding\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"signBatch\">\n"
+    "          <arg name=\"data\" type=\"aay\" direction=\"in\" />\n"
+    "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
+    "          <arg name=\"padding\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"signatures\" type=\"aay\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"QVector<QByteArray>\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Crypto::Key\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key::SignaturePadding\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QVector<QByteArray>\" />\n"
+    "      </method>\n"
+    "      <method name=\"verifyBatch\">\n"
+    "          <arg name=\"data\" type=\"aay\" direction=\"in\" />\n"
+    "          <arg name=\"signatures\" type=\"aay\" direction=\"in\" />\n"
+    "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
+    "          <arg name=\"padding\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"verified\" type=\"ab\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"QVector<QByteArray>\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"QVector<QByteArray>\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Crypto::Key::SignaturePadding\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QVector<bool>\" />\n"
+    "      </method>\n"
+    "      <method name=\"encryptBatch\">\n"
+    "          <arg name=\"data\" type=\"aay\" direction=\"in\" />\n"
+    "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
+    "          <arg name=\"blockMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"padding\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"encrypted\" type=\"aay\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"QVector<QByteArray>\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Crypto::Key\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key::BlockMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Crypto::Key::EncryptionPadding\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QVector<QByteArray>\" />\n"
+    "      </method>\n"
+    "      <method name=\"generateRandomData\">\n"
+    "          <arg name=\"numberBytes\" type=\"t\" direction=\"in\" />\n"
+    "          <arg name=\"csprngEngineName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"randomData\" type=\"ay\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"generateDigest\">\n"
+    "          <arg name=\"data\" type=\"ay\" direction=\"in\" />\n"
+    "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"digestValue\" type=\"ay\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"calculateMac\">\n"
+    "          <arg name=\"data\" type=\"ay\" direction=\"in\" />\n"
+    "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
+    "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"mac\" type=\"ay\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Crypto::Key\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"initialiseCipherSession\">\n"
+    "          <arg name=\"key\" type=\"(ay)\" direction=\"in\" />\n"
+    "          <arg name=\"operation\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"blockMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"padding\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"digest\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"cipherSessionToken\" type=\"u\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"Sailfish::Crypto::Key\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Crypto::Key::Operation\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Crypto::Key::BlockMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Crypto::Key::EncryptionPadding\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Crypto::Key::Digest\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"updateCipherSession\">\n"
+    "          <arg name=\"data\" type=\"ay\" direction=\"in\" />\n"
+    "          <arg name=\"cipherSessionToken\" type=\"u\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"generatedData\" type=\"ay\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"finaliseCipherSession\">\n"
+    "          <arg name=\"cipherSessionToken\" type=\"u\" direction=\"in\" />\n"
+    "          <arg name=\"cryptosystemProviderName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <arg name=\"generatedData\" type=\"ay\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"cancelRequests\">\n"
+    "          <arg name=\"result\" type=\"(iiis)\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Crypto::Result\" />\n"
+    "      </method>\n"
     "  </interface>\n"
     "")
 
@@ -162,6 +342,18 @@ public Q_SLOTS:
             QVector<Sailfish::Crypto::CryptoPluginInfo> &cryptoPlugins,
             QStringList &storagePlugins);
 
+    // answered without queueing the request, as it only changes when plugins are installed.
+    void getPluginInfoGeneration(
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            quint64 &generation);
+
+    // the deadline of the next request sent via this connection, see RequestQueue::setNextRequestDeadline().
+    void setNextRequestDeadline(
+            const QString &method,
+            qint64 timeoutMsecs,
+            const QDBusMessage &message);
+
     void validateCertificateChain(
             const QVector<Sailfish::Crypto::Certificate> &chain,
             const QString &cryptosystemProviderName,
@@ -169,6 +361,13 @@ public Q_SLOTS:
             Sailfish::Crypto::Result &result,
             bool &valid);
 
+    void validateCertificateChains(
+            const QVector<QVector<Sailfish::Crypto::Certificate> > &chains,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QVector<bool> &valid);
+
     void generateKey(
             const Sailfish::Crypto::Key &keyTemplate,
             const QString &cryptosystemProviderName,
@@ -200,6 +399,20 @@ public Q_SLOTS:
             Sailfish::Crypto::Result &result,
             QVector<Sailfish::Crypto::Key::Identifier> &identifiers);
 
+    void storedKeyIdentifiers(
+            qint64 cursor,
+            int limit,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QVector<Sailfish::Crypto::Key::Identifier> &identifiers,
+            qint64 &nextCursor);
+
+    void findKeys(
+            const Sailfish::Crypto::Key::FilterData &filter,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QVector<Sailfish::Crypto::Key::Identifier> &identifiers);
+
     void sign(
             const QByteArray &data,
             const Sailfish::Crypto::Key &key,
@@ -212,6 +425,7 @@ public Q_SLOTS:
 
     void verify(
             const QByteArray &data,
+            const QByteArray &signature,
             const Sailfish::Crypto::Key &key,
             Sailfish::Crypto::Key::SignaturePadding padding,
             Sailfish::Crypto::Key::Digest digest,
@@ -242,6 +456,115 @@ public Q_SLOTS:
             Sailfish::Crypto::Result &result,
             QByteArray &decrypted);
 
+    void encryptFd(
+            const QDBusUnixFileDescriptor &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QDBusUnixFileDescriptor &encrypted);
+
+    void decryptFd(
+            const QDBusUnixFileDescriptor &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QDBusUnixFileDescriptor &decrypted);
+
+    void signBatch(
+            const QVector<QByteArray> &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QVector<QByteArray> &signatures);
+
+    void verifyBatch(
+            const QVector<QByteArray> &data,
+            const QVector<QByteArray> &signatures,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QVector<bool> &verified);
+
+    void encryptBatch(
+            const QVector<QByteArray> &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QVector<QByteArray> &encrypted);
+
+    void generateRandomData(
+            quint64 numberBytes,
+            const QString &csprngEngineName,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QByteArray &randomData);
+
+    void generateDigest(
+            const QByteArray &data,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QByteArray &digestValue);
+
+    void calculateMac(
+            const QByteArray &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QByteArray &mac);
+
+    void initialiseCipherSession(
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::Operation operation,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            quint32 &cipherSessionToken);
+
+    void updateCipherSession(
+            const QByteArray &data,
+            quint32 cipherSessionToken,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QByteArray &generatedData);
+
+    void finaliseCipherSession(
+            quint32 cipherSessionToken,
+            const QString &cryptosystemProviderName,
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result,
+            QByteArray &generatedData);
+
+    void cancelRequests(
+            const QDBusMessage &message,
+            Sailfish::Crypto::Result &result);
+
 private:
     Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue *m_requestQueue;
 };
@@ -262,7 +585,44 @@ public:
     void handleFinishedRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, bool *completed) Q_DECL_OVERRIDE;
     QString requestTypeToString(int type) const Q_DECL_OVERRIDE;
 
+    bool isWorkerRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const Q_DECL_OVERRIDE;
+    QList<QVariant> handleWorkerRequest(pid_t callerPid, quint64 requestId, int type, const QList<QVariant> &inParams) Q_DECL_OVERRIDE;
+    bool isPriorityRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const Q_DECL_OVERRIDE;
+    QString coalescingKey(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const Q_DECL_OVERRIDE;
+    qint64 parameterSize(const QVariant &parameter) const Q_DECL_OVERRIDE;
+    QString applicationId(pid_t callerPid) const Q_DECL_OVERRIDE;
+    void handleCancelledRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) Q_DECL_OVERRIDE;
+    void memoryUsage(QMap<QString, qint64> *usage) const Q_DECL_OVERRIDE;
+    void releaseMemory() Q_DECL_OVERRIDE;
+    QVariantMap statistics() const Q_DECL_OVERRIDE;
+
+    // closes any cipher sessions which the given client has left open.
+    void closeCipherSessions(pid_t callerPid);
+
+    // see RequestProcessor::pluginInfoGeneration().
+    quint64 pluginInfoGeneration() const;
+
+    // keys of the given algorithms are generated ahead of time.  See KeyPool::configure().
+    void setKeyPool(const QString &specification);
+
+    // the given plugins are loaded by separate host processes.  See RequestProcessor::setPluginHosts().
+    void setPluginHosts(const QString &specification);
+
+    // the number of operations submitted at once to each hardware-backed plugin.
+    // See RequestProcessor::setPluginJobQueueDepth().
+    void setPluginJobQueueDepth(int depth);
+
+protected:
+    // keys are stored via the secrets daemon, so replies wait for its group commit.
+    bool messagesDeferred() const Q_DECL_OVERRIDE;
+    void messageDeferred() Q_DECL_OVERRIDE;
+
 private:
+    // true if the request is submitted to the job queue of an asynchronous plugin.
+    bool isAsynchronousPluginRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request,
+                                     const Sailfish::Crypto::Key &key) const;
+
+    Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue *m_secrets;
     Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor *m_requestProcessor;
 };
 
@@ -278,7 +638,21 @@ enum RequestType {
     SignRequest,
     VerifyRequest,
     EncryptRequest,
-    DecryptRequest
+    DecryptRequest,
+    EncryptFdRequest,
+    DecryptFdRequest,
+    InitialiseCipherSessionRequest,
+    UpdateCipherSessionRequest,
+    FinaliseCipherSessionRequest,
+    SignBatchRequest,
+    VerifyBatchRequest,
+    EncryptBatchRequest,
+    GenerateDigestRequest,
+    CalculateMacRequest,
+    GenerateRandomDataRequest,
+    ValidateCertificateChainsRequest,
+    StoredKeyIdentifiersPageRequest,
+    FindKeysRequest
 };
 
 } // ApiImpl
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "CryptoImpl/cryptokeypool_p.h"
+
+#include "logging_p.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QStringList>
+
+namespace {
+    // each pooled key holds its private key in secure memory, which is limited.
+    const int MaxPooledKeysPerAlgorithm = 8;
+
+    // the key sizes of the RSA and DSA algorithms, in the order of the enum values.
+    const int PooledKeySizes[] = { 512, 1024, 2048, 3072, 4096 };
+
+    Sailfish::Crypto::Key::Algorithm pooledAlgorithm(const QString &family, int bits)
+    {
+        int base = 0;
+        if (family.compare(QLatin1String("rsa"), Qt::CaseInsensitive) == 0) {
+            base = Sailfish::Crypto::Key::Rsa512;
+        } else if (family.compare(QLatin1String("dsa"), Qt::CaseInsensitive) == 0) {
+            base = Sailfish::Crypto::Key::Dsa512;
+        } else {
+            return Sailfish::Crypto::Key::AlgorithmUnknown;
+        }
+
+        for (size_t i = 0; i < sizeof(PooledKeySizes) / sizeof(PooledKeySizes[0]); ++i) {
+            if (PooledKeySizes[i] == bits) {
+                return static_cast<Sailfish::Crypto::Key::Algorithm>(base + int(i));
+            }
+        }
+        return Sailfish::Crypto::Key::AlgorithmUnknown;
+    }
+}
+
+Sailfish::Crypto::Daemon::ApiImpl::KeyPool::KeyPool(
+        const Sailfish::Secrets::Daemon::PluginMap<Sailfish::Crypto::CryptoPlugin> &cryptoPlugins,
+        QObject *parent)
+    : QThread(parent)
+    , m_cryptoPlugins(cryptoPlugins)
+{
+}
+
+Sailfish::Crypto::Daemon::ApiImpl::KeyPool::~KeyPool()
+{
+    requestInterruption();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_refill.wakeAll();
+    }
+    // waits for any key which is being generated.
+    wait();
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::KeyPool::configure(const QString &specification)
+{
+    QList<Sailfish::Crypto::Daemon::ApiImpl::KeyPool::Entry> entries;
+    Q_FOREACH (const QString &entrySpecification, specification.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        const QStringList fields = entrySpecification.trimmed().split(QLatin1Char(':'));
+        bool bitsOk = false;
+        bool countOk = true;
+        const int bits = fields.value(2).toInt(&bitsOk);
+        const int count = fields.size() > 3 ? fields.at(3).toInt(&countOk) : 1;
+        const Sailfish::Crypto::Key::Algorithm algorithm = pooledAlgorithm(fields.value(1), bits);
+        if (fields.size() < 3 || fields.size() > 4 || fields.at(0).isEmpty()
+                || !bitsOk || !countOk || count <= 0
+                || algorithm == Sailfish::Crypto::Key::AlgorithmUnknown) {
+            qCWarning(lcSailfishCryptoDaemon) << "ignoring invalid key pool entry:" << entrySpecification;
+            continue;
+        }
+
+        Sailfish::Crypto::Daemon::ApiImpl::KeyPool::Entry entry;
+        entry.cryptosystemProviderName = fields.at(0);
+        entry.algorithm = algorithm;
+        entry.count = qMin(count, MaxPooledKeysPerAlgorithm);
+        entries.append(entry);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_entries = entries;
+    if (m_entries.isEmpty()) {
+        return;
+    }
+
+    if (isRunning()) {
+        m_refill.wakeAll();
+    } else {
+        // key generation only competes for otherwise idle CPU time.
+        start(QThread::IdlePriority);
+    }
+}
+
+qint64
+Sailfish::Crypto::Daemon::ApiImpl::KeyPool::pooledKeyBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 bytes = 0;
+    Q_FOREACH (const Entry &entry, m_entries) {
+        Q_FOREACH (const PooledKey &key, entry.keys) {
+            bytes += key.privateKey.allocatedSize() + key.publicKey.size();
+        }
+    }
+    return bytes;
+}
+
+bool
+Sailfish::Crypto::Daemon::ApiImpl::KeyPool::take(
+        const QString &cryptosystemProviderName,
+        const Sailfish::Crypto::Key &keyTemplate,
+        Sailfish::Crypto::Key *key)
+{
+    // custom parameters may affect how the plugin generates the key.
+    if (!keyTemplate.customParameters().isEmpty()) {
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < m_entries.size(); ++i) {
+        Sailfish::Crypto::Daemon::ApiImpl::KeyPool::Entry &entry(m_entries[i]);
+        if (entry.algorithm != keyTemplate.algorithm()
+                || entry.cryptosystemProviderName != cryptosystemProviderName
+                || entry.keys.isEmpty()) {
+            continue;
+        }
+
+        const Sailfish::Crypto::Daemon::ApiImpl::KeyPool::PooledKey pooledKey = entry.keys.takeFirst();
+        m_refill.wakeAll();
+        locker.unlock();
+
+        // copied out of secure memory, as the key is returned to the client.
+        *key = keyTemplate;
+        key->setPrivateKey(QByteArray(pooledKey.privateKey.rawData().constData(), pooledKey.privateKey.size()));
+        key->setPublicKey(pooledKey.publicKey);
+        return true;
+    }
+
+    return false;
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::KeyPool::run()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!isInterruptionRequested()) {
+        int index = 0;
+        for (; index < m_entries.size(); ++index) {
+            if (!m_entries.at(index).failed && m_entries.at(index).keys.size() < m_entries.at(index).count) {
+                break;
+            }
+        }
+        if (index == m_entries.size()) {
+            m_refill.wait(&m_mutex);
+            continue;
+        }
+
+        const QString cryptosystemProviderName = m_entries.at(index).cryptosystemProviderName;
+        Sailfish::Crypto::Key keyTemplate;
+        keyTemplate.setAlgorithm(m_entries.at(index).algorithm);
+
+        // clients may take keys from the pool while this one is generated.
+        locker.unlock();
+        Sailfish::Crypto::CryptoPlugin *plugin = m_cryptoPlugins.value(cryptosystemProviderName);
+        Sailfish::Crypto::Key key;
+        const bool generated = plugin
+                && plugin->generateKey(keyTemplate, &key).code() == Sailfish::Crypto::Result::Succeeded
+                && !key.privateKey().isEmpty();
+        locker.relock();
+
+        // the pool may have been reconfigured meanwhile.
+        for (index = 0; index < m_entries.size(); ++index) {
+            Sailfish::Crypto::Daemon::ApiImpl::KeyPool::Entry &entry(m_entries[index]);
+            if (entry.algorithm != keyTemplate.algorithm()
+                    || entry.cryptosystemProviderName != cryptosystemProviderName) {
+                continue;
+            }
+            if (!generated) {
+                qCWarning(lcSailfishCryptoDaemon) << "unable to generate pooled keys of algorithm:" << int(entry.algorithm)
+                                                  << "with provider:" << cryptosystemProviderName;
+                entry.failed = true;
+            } else if (entry.keys.size() < entry.count) {
+                Sailfish::Crypto::Daemon::ApiImpl::KeyPool::PooledKey pooledKey;
+                pooledKey.privateKey = Sailfish::Secrets::Daemon::SecureByteArray(key.privateKey());
+                pooledKey.publicKey = key.publicKey();
+                // a key which can't be held in secure memory is discarded.
+                if (pooledKey.privateKey.size() == key.privateKey().size()) {
+                    entry.keys.append(pooledKey);
+                }
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHCRYPTO_APIIMPL_KEYPOOL_P_H
+#define SAILFISHCRYPTO_APIIMPL_KEYPOOL_P_H
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QByteArray>
+
+#include "Crypto/key.h"
+#include "Crypto/extensionplugins.h"
+
+#include "pluginregistry_p.h"
+#include "securememory_p.h"
+
+namespace Sailfish {
+
+namespace Crypto {
+
+namespace Daemon {
+
+namespace ApiImpl {
+
+// Keys for algorithms which are slow to generate (large RSA and DSA keys)
+// which are generated ahead of time on an idle-priority thread, so that
+// a request to generate one needn't wait.  The private keys are held in
+// secure memory until they are handed out, and each one which is handed
+// out is replaced in the background.
+class KeyPool : public QThread
+{
+    Q_OBJECT
+
+public:
+    KeyPool(const Sailfish::Secrets::Daemon::PluginMap<Sailfish::Crypto::CryptoPlugin> &cryptoPlugins,
+            QObject *parent = Q_NULLPTR);
+    ~KeyPool();
+
+    // Parses a comma-separated list of "<provider>:<rsa|dsa>:<bits>[:<count>]"
+    // entries, and starts filling the pool.  An empty list disables the pool.
+    void configure(const QString &specification);
+
+    // Thread-safe.  Returns true if a pooled key was available for the template,
+    // which is returned with the key material filled in, as the plugin would.
+    bool take(const QString &cryptosystemProviderName,
+              const Sailfish::Crypto::Key &keyTemplate,
+              Sailfish::Crypto::Key *key);
+
+    // Thread-safe.  The bytes held by the pooled keys.
+    qint64 pooledKeyBytes() const;
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    struct PooledKey {
+        Sailfish::Secrets::Daemon::SecureByteArray privateKey;
+        QByteArray publicKey;
+    };
+    struct Entry {
+        Entry() : algorithm(Sailfish::Crypto::Key::AlgorithmUnknown), count(0), failed(false) {}
+        QString cryptosystemProviderName;
+        Sailfish::Crypto::Key::Algorithm algorithm;
+        int count;
+        bool failed; // the plugin can't generate these keys, so stop trying.
+        QList<PooledKey> keys;
+    };
+
+    Sailfish::Secrets::Daemon::PluginMap<Sailfish::Crypto::CryptoPlugin> m_cryptoPlugins;
+    mutable QMutex m_mutex;
+    QWaitCondition m_refill;
+    QList<Entry> m_entries;
+};
+
+} // namespace ApiImpl
+
+} // namespace Daemon
+
+} // namespace Crypto
+
+} // namespace Sailfish
+
+#endif // SAILFISHCRYPTO_APIIMPL_KEYPOOL_P_H
@@ -0,0 +1,1023 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "cryptopluginhost_p.h"
+#include "logging_p.h"
+
+#include "Crypto/certificate.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QPluginLoader>
+#include <QtCore/QDataStream>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+
+#include <sys/prctl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+
+namespace {
+    // each direction of a host's channel holds this many bytes of messages.
+    const int RingSize = 1024 * 1024;
+    // an operation which takes longer than this is assumed to have hung the host.
+    const int CallTimeoutMs = 60 * 1000;
+    const int MinimumRestartDelayMs = 100;
+    const int MaximumRestartDelayMs = 30 * 1000;
+    // hosts perform one operation at a time, so this many are queued to each.
+    const int PendingOperationsPerHost = 2;
+
+    enum CallType {
+        ValidateCertificateChainCall = 1,
+        GenerateKeyCall,
+        GenerateAndStoreKeyCall,
+        StoredKeyCall,
+        DeleteStoredKeyCall,
+        StoredKeyIdentifiersCall,
+        SignCall,
+        VerifyCall,
+        EncryptCall,
+        DecryptCall,
+        GenerateRandomDataCall,
+        GenerateDigestCall,
+        CalculateMacCall,
+        InitialiseCipherSessionCall,
+        UpdateCipherSessionCall,
+        FinaliseCipherSessionCall,
+        CloseCipherSessionsCall
+    };
+
+    Sailfish::Crypto::Result hostError(const QString &errorMessage)
+    {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::DaemonError, errorMessage);
+    }
+
+    QByteArray signRequest(const QByteArray &data, const Sailfish::Crypto::Key &key,
+                           Sailfish::Crypto::Key::SignaturePadding padding, Sailfish::Crypto::Key::Digest digest)
+    {
+        QByteArray request;
+        QDataStream out(&request, QIODevice::WriteOnly);
+        out << qint32(SignCall) << data << Sailfish::Crypto::Key::serialise(key) << qint32(padding) << qint32(digest);
+        return request;
+    }
+
+    QByteArray verifyRequest(const QByteArray &data, const QByteArray &signature, const Sailfish::Crypto::Key &key,
+                             Sailfish::Crypto::Key::SignaturePadding padding, Sailfish::Crypto::Key::Digest digest)
+    {
+        QByteArray request;
+        QDataStream out(&request, QIODevice::WriteOnly);
+        out << qint32(VerifyCall) << data << signature << Sailfish::Crypto::Key::serialise(key) << qint32(padding) << qint32(digest);
+        return request;
+    }
+
+    QByteArray cipherRequest(CallType call, const QByteArray &data, const Sailfish::Crypto::Key &key,
+                             Sailfish::Crypto::Key::BlockMode blockMode, Sailfish::Crypto::Key::EncryptionPadding padding,
+                             Sailfish::Crypto::Key::Digest digest)
+    {
+        QByteArray request;
+        QDataStream out(&request, QIODevice::WriteOnly);
+        out << qint32(call) << data << Sailfish::Crypto::Key::serialise(key) << qint32(blockMode) << qint32(padding) << qint32(digest);
+        return request;
+    }
+
+    QByteArray identifierRequest(CallType call, const Sailfish::Crypto::Key::Identifier &identifier)
+    {
+        QByteArray request;
+        QDataStream out(&request, QIODevice::WriteOnly);
+        out << qint32(call) << identifier.name() << identifier.collectionName();
+        return request;
+    }
+
+    QByteArray byteArrayOutput(const Sailfish::Crypto::Result &result, const QByteArray &outputs)
+    {
+        QByteArray output;
+        if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+            QDataStream in(outputs);
+            in >> output;
+        }
+        return output;
+    }
+
+    // Performs the request in the host process, and returns the serialised outputs.
+    QByteArray perform(Sailfish::Crypto::CryptoPlugin *plugin, QDataStream &in, Sailfish::Crypto::Result *result)
+    {
+        qint32 call = 0;
+        in >> call;
+
+        QByteArray outputs;
+        QDataStream out(&outputs, QIODevice::WriteOnly);
+        QByteArray data, signature, serialisedKey, output;
+        QString name, collectionName;
+        qint32 blockMode = 0, padding = 0, digest = 0, operation = 0;
+        quint64 clientId = 0;
+        quint32 cipherSessionToken = 0;
+        switch (call) {
+            case ValidateCertificateChainCall: {
+                QVector<qint32> types;
+                QVector<QByteArray> encoded;
+                in >> types >> encoded;
+                QVector<Sailfish::Crypto::Certificate> chain;
+                for (int i = 0; i < types.size() && i < encoded.size(); ++i) {
+                    chain.append(Sailfish::Crypto::Certificate::fromEncoded(
+                                     encoded.at(i), static_cast<Sailfish::Crypto::Certificate::Type>(types.at(i))));
+                }
+                bool validated = false;
+                *result = plugin->validateCertificateChain(chain, &validated);
+                out << validated;
+                break;
+            }
+            case GenerateKeyCall:
+            case GenerateAndStoreKeyCall: {
+                in >> serialisedKey;
+                Sailfish::Crypto::Key key;
+                *result = call == GenerateKeyCall
+                        ? plugin->generateKey(Sailfish::Crypto::Key::deserialise(serialisedKey), &key)
+                        : plugin->generateAndStoreKey(Sailfish::Crypto::Key::deserialise(serialisedKey), &key);
+                out << Sailfish::Crypto::Key::serialise(key);
+                break;
+            }
+            case StoredKeyCall: {
+                in >> name >> collectionName;
+                Sailfish::Crypto::Key key;
+                *result = plugin->storedKey(Sailfish::Crypto::Key::Identifier(name, collectionName), &key);
+                out << Sailfish::Crypto::Key::serialise(key);
+                break;
+            }
+            case DeleteStoredKeyCall: {
+                in >> name >> collectionName;
+                *result = plugin->deleteStoredKey(Sailfish::Crypto::Key::Identifier(name, collectionName));
+                break;
+            }
+            case StoredKeyIdentifiersCall: {
+                QVector<Sailfish::Crypto::Key::Identifier> identifiers;
+                *result = plugin->storedKeyIdentifiers(&identifiers);
+                out << qint32(identifiers.size());
+                Q_FOREACH (const Sailfish::Crypto::Key::Identifier &identifier, identifiers) {
+                    out << identifier.name() << identifier.collectionName();
+                }
+                break;
+            }
+            case SignCall: {
+                in >> data >> serialisedKey >> padding >> digest;
+                *result = plugin->sign(data, Sailfish::Crypto::Key::deserialise(serialisedKey),
+                                       static_cast<Sailfish::Crypto::Key::SignaturePadding>(padding),
+                                       static_cast<Sailfish::Crypto::Key::Digest>(digest), &output);
+                out << output;
+                break;
+            }
+            case VerifyCall: {
+                in >> data >> signature >> serialisedKey >> padding >> digest;
+                bool verified = false;
+                *result = plugin->verify(data, signature, Sailfish::Crypto::Key::deserialise(serialisedKey),
+                                         static_cast<Sailfish::Crypto::Key::SignaturePadding>(padding),
+                                         static_cast<Sailfish::Crypto::Key::Digest>(digest), &verified);
+                out << verified;
+                break;
+            }
+            case EncryptCall:
+            case DecryptCall: {
+                in >> data >> serialisedKey >> blockMode >> padding >> digest;
+                *result = call == EncryptCall
+                        ? plugin->encrypt(data, Sailfish::Crypto::Key::deserialise(serialisedKey),
+                                          static_cast<Sailfish::Crypto::Key::BlockMode>(blockMode),
+                                          static_cast<Sailfish::Crypto::Key::EncryptionPadding>(padding),
+                                          static_cast<Sailfish::Crypto::Key::Digest>(digest), &output)
+                        : plugin->decrypt(data, Sailfish::Crypto::Key::deserialise(serialisedKey),
+                                          static_cast<Sailfish::Crypto::Key::BlockMode>(blockMode),
+                                          static_cast<Sailfish::Crypto::Key::EncryptionPadding>(padding),
+                                          static_cast<Sailfish::Crypto::Key::Digest>(digest), &output);
+                out << output;
+                break;
+            }
+            case GenerateRandomDataCall: {
+                quint64 numberBytes = 0;
+                in >> name >> numberBytes;
+                *result = plugin->generateRandomData(name, numberBytes, &output);
+                out << output;
+                break;
+            }
+            case GenerateDigestCall: {
+                in >> data >> digest;
+                *result = plugin->generateDigest(data, static_cast<Sailfish::Crypto::Key::Digest>(digest), &output);
+                out << output;
+                break;
+            }
+            case CalculateMacCall: {
+                in >> data >> serialisedKey >> digest;
+                *result = plugin->calculateMac(data, Sailfish::Crypto::Key::deserialise(serialisedKey),
+                                               static_cast<Sailfish::Crypto::Key::Digest>(digest), &output);
+                out << output;
+                break;
+            }
+            case InitialiseCipherSessionCall: {
+                in >> clientId >> serialisedKey >> operation >> blockMode >> padding >> digest;
+                *result = plugin->initialiseCipherSession(clientId, Sailfish::Crypto::Key::deserialise(serialisedKey),
+                                                          static_cast<Sailfish::Crypto::Key::Operation>(operation),
+                                                          static_cast<Sailfish::Crypto::Key::BlockMode>(blockMode),
+                                                          static_cast<Sailfish::Crypto::Key::EncryptionPadding>(padding),
+                                                          static_cast<Sailfish::Crypto::Key::Digest>(digest),
+                                                          &cipherSessionToken);
+                out << cipherSessionToken;
+                break;
+            }
+            case UpdateCipherSessionCall: {
+                in >> clientId >> data >> cipherSessionToken;
+                *result = plugin->updateCipherSession(clientId, data, cipherSessionToken, &output);
+                out << output;
+                break;
+            }
+            case FinaliseCipherSessionCall: {
+                in >> clientId >> cipherSessionToken;
+                *result = plugin->finaliseCipherSession(clientId, cipherSessionToken, &output);
+                out << output;
+                break;
+            }
+            case CloseCipherSessionsCall: {
+                in >> clientId;
+                plugin->closeCipherSessions(clientId);
+                *result = Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+                break;
+            }
+            default:
+                in.setStatus(QDataStream::ReadCorruptData);
+                break;
+        }
+
+        if (in.status() != QDataStream::Ok) {
+            *result = Sailfish::Crypto::Result(Sailfish::Crypto::Result::SerialisationError,
+                                               QLatin1String("Malformed plugin host request"));
+            outputs.clear();
+        }
+        return outputs;
+    }
+}
+
+Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::CryptoPluginHostProcess(
+        const QString &pluginFilePath,
+        QObject *parent)
+    : QObject(parent)
+    , m_pluginFilePath(pluginFilePath)
+    , m_reader(this)
+    , m_nextCallId(0)
+    , m_running(false)
+    , m_stopping(0)
+    , m_restartDelayMs(MinimumRestartDelayMs)
+    , m_exitCount(0)
+{
+    // the plugin's own logging goes wherever the daemon's does.
+    m_process.setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(&m_process, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+            this, &Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::processFinished);
+}
+
+Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::~CryptoPluginHostProcess()
+{
+    m_stopping.store(1);
+    m_process.disconnect(this);
+    if (m_channel.isValid()) {
+        // wakes the reader, which sees that we are stopping.
+        Sailfish::Secrets::Daemon::PluginHostChannel::signal(m_channel.responseFd());
+    }
+    m_reader.wait();
+    if (m_process.state() != QProcess::NotRunning) {
+        m_process.kill();
+        m_process.waitForFinished(1000);
+    }
+}
+
+bool Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::start()
+{
+    QString errorString;
+    if (!m_channel.create(RingSize, &errorString)) {
+        qCWarning(lcSailfishCryptoDaemon) << "Unable to create plugin host channel:" << errorString;
+        return false;
+    }
+
+    // the descriptors are inherited, so only one host may be started at a time, from the main thread.
+    m_process.start(QCoreApplication::applicationFilePath(),
+                    QStringList() << QStringLiteral("--crypto-plugin-host")
+                                  << m_pluginFilePath
+                                  << QString::number(m_channel.memoryFd())
+                                  << QString::number(m_channel.requestFd())
+                                  << QString::number(m_channel.responseFd()));
+    const bool started = m_process.waitForStarted();
+    m_channel.releaseHostDescriptors();
+    if (!started) {
+        qCWarning(lcSailfishCryptoDaemon) << "Unable to start plugin host for:" << m_pluginFilePath << m_process.errorString();
+        m_channel.close();
+        return false;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running = true;
+    }
+    m_reader.start();
+    return true;
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::processFinished()
+{
+    qCWarning(lcSailfishCryptoDaemon) << "Plugin host for:" << m_pluginFilePath << "exited with status:" << m_process.exitCode();
+
+    // the reader sees the host exit too, and fails the operations which were pending.
+    m_reader.wait();
+    m_channel.close();
+    m_exitCount++;
+
+    // a plugin which fails at once is not restarted in a busy loop.
+    QTimer::singleShot(m_restartDelayMs, this, &Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::restart);
+    m_restartDelayMs = qMin(m_restartDelayMs * 2, MaximumRestartDelayMs);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::restart()
+{
+    if (m_stopping.load() || m_process.state() != QProcess::NotRunning) {
+        return;
+    } else if (start()) {
+        m_restartDelayMs = MinimumRestartDelayMs;
+    } else {
+        QTimer::singleShot(m_restartDelayMs, this, &Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::restart);
+        m_restartDelayMs = qMin(m_restartDelayMs * 2, MaximumRestartDelayMs);
+    }
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::kill()
+{
+    if (m_process.state() != QProcess::NotRunning) {
+        qCWarning(lcSailfishCryptoDaemon) << "Killing unresponsive plugin host for:" << m_pluginFilePath;
+        m_process.kill();
+    }
+}
+
+int Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::pendingCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running ? m_pending.size() : INT_MAX;
+}
+
+QVariantMap Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::statistics() const
+{
+    QVariantMap stats;
+    stats.insert(QStringLiteral("pid"), QVariant::fromValue<qint64>(m_process.processId()));
+    stats.insert(QStringLiteral("exitCount"), m_exitCount);
+    QMutexLocker locker(&m_mutex);
+    stats.insert(QStringLiteral("running"), m_running);
+    stats.insert(QStringLiteral("pendingCount"), m_pending.size());
+    return stats;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::write(
+        const QByteArray &request,
+        const PendingCall &pending,
+        quint64 *callId)
+{
+    if (!m_running) {
+        return hostError(QLatin1String("The plugin host is not running"));
+    }
+
+    *callId = ++m_nextCallId;
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out << *callId;
+    message.append(request);
+    if (message.size() > m_channel.maximumMessageSize()) {
+        return hostError(QLatin1String("The request is too large for the plugin host"));
+    } else if (!m_channel.writeRequest(message)) {
+        return hostError(QLatin1String("The plugin host is busy"));
+    }
+    m_pending.insert(*callId, pending);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::call(
+        const QByteArray &request,
+        QByteArray *outputs)
+{
+    QMutexLocker locker(&m_mutex);
+    quint64 callId = 0;
+    const Sailfish::Crypto::Result result = write(request, PendingCall(), &callId);
+    if (result.code() == Sailfish::Crypto::Result::Failed) {
+        return result;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_responses.contains(callId)) {
+        const qint64 remaining = CallTimeoutMs - timer.elapsed();
+        if (!m_running) {
+            m_pending.remove(callId);
+            return hostError(QLatin1String("The plugin host exited"));
+        } else if (remaining <= 0 || !m_responded.wait(&m_mutex, remaining)) {
+            if (m_responses.contains(callId)) {
+                break;
+            }
+            m_pending.remove(callId);
+            QMetaObject::invokeMethod(this, "kill", Qt::QueuedConnection);
+            return hostError(QLatin1String("The plugin host did not respond"));
+        }
+    }
+
+    const Response response = m_responses.take(callId);
+    *outputs = response.outputs;
+    return response.result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::submit(
+        const QByteArray &request,
+        quint64 operationId,
+        Sailfish::Crypto::Key::Operation operation)
+{
+    QMutexLocker locker(&m_mutex);
+    PendingCall pending;
+    pending.operationId = operationId;
+    pending.operation = operation;
+    pending.asynchronous = true;
+    quint64 callId = 0;
+    return write(request, pending, &callId);
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::ResponseReader::run()
+{
+    struct pollfd fds[2];
+    fds[0].fd = m_host->m_channel.responseFd();
+    fds[0].events = POLLIN;
+    fds[1].fd = m_host->m_channel.hostExitedFd();
+    fds[1].events = POLLIN;
+
+    while (!m_host->m_stopping.load()) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents) {
+            Sailfish::Secrets::Daemon::PluginHostChannel::clearSignal(fds[0].fd);
+            m_host->readResponses();
+        }
+        if (fds[1].revents) {
+            // the host may have responded just before it exited.
+            m_host->readResponses();
+            break;
+        }
+    }
+    m_host->hostExited();
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::readResponses()
+{
+    QByteArray message;
+    while (m_channel.readResponse(&message)) {
+        quint64 callId = 0;
+        qint32 code = 0, errorCode = 0, storageErrorCode = 0;
+        QString errorMessage;
+        Response response;
+        QDataStream in(message);
+        in >> callId >> code >> errorCode >> storageErrorCode >> errorMessage >> response.outputs;
+        if (in.status() != QDataStream::Ok) {
+            qCWarning(lcSailfishCryptoDaemon) << "Ignoring malformed response from plugin host for:" << m_pluginFilePath;
+            continue;
+        }
+        response.result.setCode(code);
+        response.result.setErrorCode(errorCode);
+        response.result.setStorageErrorCode(storageErrorCode);
+        response.result.setErrorMessage(errorMessage);
+
+        QMutexLocker locker(&m_mutex);
+        if (!m_pending.contains(callId)) {
+            // the call timed out.
+            continue;
+        }
+        const PendingCall pending = m_pending.take(callId);
+        if (pending.asynchronous) {
+            locker.unlock();
+            emit operationCompleted(pending.operationId, pending.operation, response.result, response.outputs);
+        } else {
+            m_responses.insert(callId, response);
+            m_responded.wakeAll();
+        }
+    }
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::hostExited()
+{
+    QList<PendingCall> failed;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running = false;
+        Q_FOREACH (const PendingCall &pending, m_pending) {
+            if (pending.asynchronous) {
+                failed.append(pending);
+            }
+        }
+        m_pending.clear();
+        m_responded.wakeAll();
+    }
+
+    if (!m_stopping.load()) {
+        Q_FOREACH (const PendingCall &pending, failed) {
+            emit operationCompleted(pending.operationId, pending.operation,
+                                    hostError(QLatin1String("The plugin host exited")), QByteArray());
+        }
+    }
+}
+
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::RemoteCryptoPlugin(
+        const QString &pluginFilePath,
+        const Sailfish::Crypto::CryptoPluginInfo &info,
+        bool testPlugin,
+        int processCount,
+        QObject *parent)
+    : Sailfish::Crypto::CryptoPlugin(parent)
+    , m_info(info)
+    , m_testPlugin(testPlugin)
+{
+    for (int i = 0; i < qMax(processCount, 1); ++i) {
+        Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *host
+                = new Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess(pluginFilePath, this);
+        if (!host->start()) {
+            delete host;
+            continue;
+        }
+        connect(host, &Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess::operationCompleted,
+                this, &Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::hostOperationCompleted,
+                Qt::DirectConnection);
+        m_hosts.append(host);
+    }
+}
+
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::~RemoteCryptoPlugin()
+{
+}
+
+QVariantList Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::hostStatistics() const
+{
+    QVariantList hosts;
+    Q_FOREACH (Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *host, m_hosts) {
+        hosts.append(host->statistics());
+    }
+    return hosts;
+}
+
+Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::leastBusyHost() const
+{
+    Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *leastBusy = m_hosts.first();
+    int leastPending = leastBusy->pendingCount();
+    for (int i = 1; i < m_hosts.size() && leastPending > 0; ++i) {
+        const int pending = m_hosts.at(i)->pendingCount();
+        if (pending < leastPending) {
+            leastBusy = m_hosts.at(i);
+            leastPending = pending;
+        }
+    }
+    return leastBusy;
+}
+
+Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::sessionHost(quint64 clientId) const
+{
+    // the session state is in the plugin instance of the host which initialised it.
+    return m_hosts.at(int(clientId % quint64(m_hosts.size())));
+}
+
+int Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::maximumPendingOperations() const
+{
+    return m_hosts.size() * PendingOperationsPerHost;
+}
+
+void Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::hostOperationCompleted(
+        quint64 operationId,
+        int operation,
+        const Sailfish::Crypto::Result &result,
+        const QByteArray &outputs)
+{
+    switch (operation) {
+        case Sailfish::Crypto::Key::Sign:
+            emit signCompleted(operationId, result, byteArrayOutput(result, outputs));
+            break;
+        case Sailfish::Crypto::Key::Verify: {
+            bool verified = false;
+            if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+                QDataStream in(outputs);
+                in >> verified;
+            }
+            emit verifyCompleted(operationId, result, verified);
+            break;
+        }
+        case Sailfish::Crypto::Key::Encrypt:
+            emit encryptCompleted(operationId, result, byteArrayOutput(result, outputs));
+            break;
+        default:
+            emit decryptCompleted(operationId, result, byteArrayOutput(result, outputs));
+            break;
+    }
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::validateCertificateChain(
+        const QVector<Sailfish::Crypto::Certificate> &chain,
+        bool *validated)
+{
+    QVector<qint32> types;
+    QVector<QByteArray> encoded;
+    Q_FOREACH (const Sailfish::Crypto::Certificate &certificate, chain) {
+        types.append(qint32(certificate.type()));
+        encoded.append(certificate.toEncoded());
+    }
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(ValidateCertificateChainCall) << types << encoded;
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(request, &outputs);
+    QDataStream in(outputs);
+    *validated = false;
+    in >> *validated;
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::generateKey(
+        const Sailfish::Crypto::Key &keyTemplate,
+        Sailfish::Crypto::Key *key)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(GenerateKeyCall) << Sailfish::Crypto::Key::serialise(keyTemplate);
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(request, &outputs);
+    if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+        *key = Sailfish::Crypto::Key::deserialise(byteArrayOutput(result, outputs));
+    }
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::generateAndStoreKey(
+        const Sailfish::Crypto::Key &keyTemplate,
+        Sailfish::Crypto::Key *keyMetadata)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(GenerateAndStoreKeyCall) << Sailfish::Crypto::Key::serialise(keyTemplate);
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(request, &outputs);
+    if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+        *keyMetadata = Sailfish::Crypto::Key::deserialise(byteArrayOutput(result, outputs));
+    }
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::storedKey(
+        const Sailfish::Crypto::Key::Identifier &identifier,
+        Sailfish::Crypto::Key *key)
+{
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(identifierRequest(StoredKeyCall, identifier), &outputs);
+    if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+        *key = Sailfish::Crypto::Key::deserialise(byteArrayOutput(result, outputs));
+    }
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::deleteStoredKey(
+        const Sailfish::Crypto::Key::Identifier &identifier)
+{
+    QByteArray outputs;
+    return leastBusyHost()->call(identifierRequest(DeleteStoredKeyCall, identifier), &outputs);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::storedKeyIdentifiers(
+        QVector<Sailfish::Crypto::Key::Identifier> *identifiers)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(StoredKeyIdentifiersCall);
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(request, &outputs);
+    if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+        QDataStream in(outputs);
+        qint32 count = 0;
+        in >> count;
+        for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            QString name, collectionName;
+            in >> name >> collectionName;
+            identifiers->append(Sailfish::Crypto::Key::Identifier(name, collectionName));
+        }
+    }
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::sign(
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *signature)
+{
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(signRequest(data, key, padding, digest), &outputs);
+    *signature = byteArrayOutput(result, outputs);
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::verify(
+        const QByteArray &data,
+        const QByteArray &signature,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        bool *verified)
+{
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(verifyRequest(data, signature, key, padding, digest), &outputs);
+    QDataStream in(outputs);
+    *verified = false;
+    in >> *verified;
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::encrypt(
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *encrypted)
+{
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(
+                cipherRequest(EncryptCall, data, key, blockMode, padding, digest), &outputs);
+    *encrypted = byteArrayOutput(result, outputs);
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::decrypt(
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *decrypted)
+{
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(
+                cipherRequest(DecryptCall, data, key, blockMode, padding, digest), &outputs);
+    *decrypted = byteArrayOutput(result, outputs);
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::generateRandomData(
+        const QString &csprngEngineName,
+        quint64 numberBytes,
+        QByteArray *randomData)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(GenerateRandomDataCall) << csprngEngineName << numberBytes;
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(request, &outputs);
+    *randomData = byteArrayOutput(result, outputs);
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::generateDigest(
+        const QByteArray &data,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *digestValue)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(GenerateDigestCall) << data << qint32(digest);
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(request, &outputs);
+    *digestValue = byteArrayOutput(result, outputs);
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::calculateMac(
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *mac)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(CalculateMacCall) << data << Sailfish::Crypto::Key::serialise(key) << qint32(digest);
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = leastBusyHost()->call(request, &outputs);
+    *mac = byteArrayOutput(result, outputs);
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::initialiseCipherSession(
+        quint64 clientId,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Operation operation,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        quint32 *cipherSessionToken)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(InitialiseCipherSessionCall) << clientId << Sailfish::Crypto::Key::serialise(key)
+        << qint32(operation) << qint32(blockMode) << qint32(padding) << qint32(digest);
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = sessionHost(clientId)->call(request, &outputs);
+    QDataStream in(outputs);
+    *cipherSessionToken = 0;
+    in >> *cipherSessionToken;
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::updateCipherSession(
+        quint64 clientId,
+        const QByteArray &data,
+        quint32 cipherSessionToken,
+        QByteArray *generatedData)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(UpdateCipherSessionCall) << clientId << data << cipherSessionToken;
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = sessionHost(clientId)->call(request, &outputs);
+    *generatedData = byteArrayOutput(result, outputs);
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::finaliseCipherSession(
+        quint64 clientId,
+        quint32 cipherSessionToken,
+        QByteArray *generatedData)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(FinaliseCipherSessionCall) << clientId << cipherSessionToken;
+
+    QByteArray outputs;
+    const Sailfish::Crypto::Result result = sessionHost(clientId)->call(request, &outputs);
+    *generatedData = byteArrayOutput(result, outputs);
+    return result;
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::closeCipherSessions(
+        quint64 clientId)
+{
+    QByteArray request;
+    QDataStream out(&request, QIODevice::WriteOnly);
+    out << qint32(CloseCipherSessionsCall) << clientId;
+
+    QByteArray outputs;
+    sessionHost(clientId)->call(request, &outputs);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::beginSign(
+        quint64 operationId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest)
+{
+    return leastBusyHost()->submit(signRequest(data, key, padding, digest), operationId, Sailfish::Crypto::Key::Sign);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::beginVerify(
+        quint64 operationId,
+        const QByteArray &data,
+        const QByteArray &signature,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest)
+{
+    return leastBusyHost()->submit(verifyRequest(data, signature, key, padding, digest), operationId, Sailfish::Crypto::Key::Verify);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::beginEncrypt(
+        quint64 operationId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest)
+{
+    return leastBusyHost()->submit(cipherRequest(EncryptCall, data, key, blockMode, padding, digest),
+                                   operationId, Sailfish::Crypto::Key::Encrypt);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin::beginDecrypt(
+        quint64 operationId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest)
+{
+    return leastBusyHost()->submit(cipherRequest(DecryptCall, data, key, blockMode, padding, digest),
+                                   operationId, Sailfish::Crypto::Key::Decrypt);
+}
+
+int Sailfish::Crypto::Daemon::ApiImpl::runCryptoPluginHost(const QStringList &arguments)
+{
+    // the host must not outlive the daemon, whose requests it serves.
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    if (arguments.size() != 6) {
+        qCWarning(lcSailfishCryptoDaemon) << "Invalid plugin host arguments";
+        return 1;
+    }
+
+    QString errorString;
+    Sailfish::Secrets::Daemon::PluginHostChannel channel;
+    if (!channel.attach(arguments.at(3).toInt(), arguments.at(4).toInt(), arguments.at(5).toInt(), &errorString)) {
+        qCWarning(lcSailfishCryptoDaemon) << "Unable to attach plugin host channel:" << errorString;
+        return 1;
+    }
+
+    QPluginLoader loader(arguments.at(2));
+    Sailfish::Crypto::CryptoPlugin *plugin = qobject_cast<Sailfish::Crypto::CryptoPlugin*>(loader.instance());
+    if (!plugin) {
+        qCWarning(lcSailfishCryptoDaemon) << "Unable to load hosted plugin:" << arguments.at(2) << loader.errorString();
+        return 1;
+    }
+
+    struct pollfd fds[1];
+    fds[0].fd = channel.requestFd();
+    fds[0].events = POLLIN;
+    QByteArray request;
+    for (;;) {
+        fds[0].revents = 0;
+        if (poll(fds, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        Sailfish::Secrets::Daemon::PluginHostChannel::clearSignal(channel.requestFd());
+
+        while (channel.readRequest(&request)) {
+            quint64 callId = 0;
+            QDataStream in(request);
+            in >> callId;
+            Sailfish::Crypto::Result result;
+            const QByteArray outputs = perform(plugin, in, &result);
+            request.fill('\0');
+
+            QByteArray response;
+            QDataStream out(&response, QIODevice::WriteOnly);
+            out << callId << qint32(result.code()) << qint32(result.errorCode())
+                << qint32(result.storageErrorCode()) << result.errorMessage() << outputs;
+            if (response.size() > channel.maximumMessageSize()) {
+                response.clear();
+                QDataStream tooLarge(&response, QIODevice::WriteOnly);
+                tooLarge << callId << qint32(Sailfish::Crypto::Result::Failed) << qint32(Sailfish::Crypto::Result::DaemonError)
+                         << qint32(0) << QStringLiteral("The response is too large for the plugin host") << QByteArray();
+            }
+
+            // the daemon reads responses as soon as they are signalled, so room is soon made.
+            while (!channel.writeResponse(response)) {
+                usleep(1000);
+            }
+        }
+    }
+}
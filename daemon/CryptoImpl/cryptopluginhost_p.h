@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHCRYPTO_APIIMPL_CRYPTOPLUGINHOST_P_H
+#define SAILFISHCRYPTO_APIIMPL_CRYPTOPLUGINHOST_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+#include <QtCore/QProcess>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtCore/QByteArray>
+#include <QtCore/QVariantMap>
+
+#include "Crypto/key.h"
+#include "Crypto/result.h"
+#include "Crypto/extensionplugins.h"
+
+#include "pluginhostchannel_p.h"
+
+namespace Sailfish {
+
+namespace Crypto {
+
+namespace Daemon {
+
+namespace ApiImpl {
+
+// One process which loads a crypto plugin on behalf of the daemon, and performs
+// the operations written to its channel one at a time.  The process is restarted
+// if it exits, and killed (and so restarted) if an operation times out; the
+// operations it had not completed fail.
+class CryptoPluginHostProcess : public QObject
+{
+    Q_OBJECT
+
+public:
+    CryptoPluginHostProcess(const QString &pluginFilePath, QObject *parent = Q_NULLPTR);
+    ~CryptoPluginHostProcess();
+
+    bool start();
+
+    // Thread-safe.  Writes the request, and waits for and returns its response.
+    Sailfish::Crypto::Result call(const QByteArray &request, QByteArray *outputs);
+    // Thread-safe.  Writes the request, whose response is emitted by operationCompleted().
+    Sailfish::Crypto::Result submit(const QByteArray &request, quint64 operationId, Sailfish::Crypto::Key::Operation operation);
+
+    // Thread-safe.  The requests written which haven't been responded to.
+    int pendingCount() const;
+
+    // Main thread only.  The process id of the host (zero while it is being
+    // restarted), how often it has exited, and its pending requests.
+    QVariantMap statistics() const;
+
+Q_SIGNALS:
+    // emitted from the thread which reads the responses.
+    void operationCompleted(quint64 operationId, int operation, const Sailfish::Crypto::Result &result, const QByteArray &outputs);
+
+private Q_SLOTS:
+    void processFinished();
+    void restart();
+    void kill();
+
+private:
+    struct PendingCall {
+        PendingCall() : operationId(0), operation(Sailfish::Crypto::Key::OperationUnknown), asynchronous(false) {}
+        quint64 operationId;
+        Sailfish::Crypto::Key::Operation operation;
+        bool asynchronous;
+    };
+    struct Response {
+        Sailfish::Crypto::Result result;
+        QByteArray outputs;
+    };
+
+    class ResponseReader : public QThread
+    {
+    public:
+        ResponseReader(Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *host) : m_host(host) {}
+    protected:
+        void run() Q_DECL_OVERRIDE;
+    private:
+        Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *m_host;
+    };
+
+    Sailfish::Crypto::Result write(const QByteArray &request, const PendingCall &pending, quint64 *callId);
+    void readResponses();
+    void hostExited();
+
+    QString m_pluginFilePath;
+    QProcess m_process;
+    Sailfish::Secrets::Daemon::PluginHostChannel m_channel;
+    ResponseReader m_reader;
+    mutable QMutex m_mutex;
+    QWaitCondition m_responded;
+    QHash<quint64, PendingCall> m_pending; // by call id
+    QHash<quint64, Response> m_responses; // of synchronous calls, by call id
+    quint64 m_nextCallId;
+    bool m_running;
+    QAtomicInt m_stopping;
+    int m_restartDelayMs;
+    int m_exitCount;
+};
+
+// Stands in for a crypto plugin which is loaded by host processes instead of by
+// the daemon, so that a plugin which is slow, or which crashes, neither stalls
+// nor takes down the daemon, and so that its operations may run on several cores.
+// The plugin's capabilities are those introspected when it was installed.
+// Sign, verify, encrypt and decrypt are submitted asynchronously; the other
+// operations wait for their host.  The cipher sessions of a client are all
+// performed by the same host.
+class RemoteCryptoPlugin : public Sailfish::Crypto::CryptoPlugin
+{
+    Q_OBJECT
+
+public:
+    RemoteCryptoPlugin(const QString &pluginFilePath, const Sailfish::Crypto::CryptoPluginInfo &info,
+                       bool testPlugin, int processCount, QObject *parent = Q_NULLPTR);
+    ~RemoteCryptoPlugin();
+
+    bool isValid() const { return !m_hosts.isEmpty(); }
+
+    // Main thread only.  The statistics of each host, for the statistics DBus interface.
+    QVariantList hostStatistics() const;
+
+    bool isTestPlugin() const Q_DECL_OVERRIDE { return m_testPlugin; }
+    QString name() const Q_DECL_OVERRIDE { return m_info.name(); }
+    bool canStoreKeys() const Q_DECL_OVERRIDE { return m_info.canStoreKeys(); }
+    Sailfish::Crypto::CryptoPlugin::EncryptionType encryptionType() const Q_DECL_OVERRIDE { return m_info.encryptionType(); }
+    QVector<Sailfish::Crypto::Key::Algorithm> supportedAlgorithms() const Q_DECL_OVERRIDE { return m_info.supportedAlgorithms(); }
+    QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::BlockModes> supportedBlockModes() const Q_DECL_OVERRIDE { return m_info.supportedBlockModes(); }
+    QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::EncryptionPaddings> supportedEncryptionPaddings() const Q_DECL_OVERRIDE { return m_info.supportedEncryptionPaddings(); }
+    QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::SignaturePaddings> supportedSignaturePaddings() const Q_DECL_OVERRIDE { return m_info.supportedSignaturePaddings(); }
+    QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::Digests> supportedDigests() const Q_DECL_OVERRIDE { return m_info.supportedDigests(); }
+    QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::Operations> supportedOperations() const Q_DECL_OVERRIDE { return m_info.supportedOperations(); }
+
+    Sailfish::Crypto::Result validateCertificateChain(const QVector<Sailfish::Crypto::Certificate> &chain, bool *validated) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result generateKey(const Sailfish::Crypto::Key &keyTemplate, Sailfish::Crypto::Key *key) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result generateAndStoreKey(const Sailfish::Crypto::Key &keyTemplate, Sailfish::Crypto::Key *keyMetadata) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result storedKey(const Sailfish::Crypto::Key::Identifier &identifier, Sailfish::Crypto::Key *key) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result deleteStoredKey(const Sailfish::Crypto::Key::Identifier &identifier) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result storedKeyIdentifiers(QVector<Sailfish::Crypto::Key::Identifier> *identifiers) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result sign(const QByteArray &data, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::SignaturePadding padding, Sailfish::Crypto::Key::Digest digest, QByteArray *signature) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result verify(const QByteArray &data, const QByteArray &signature, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::SignaturePadding padding, Sailfish::Crypto::Key::Digest digest, bool *verified) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result encrypt(const QByteArray &data, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::BlockMode blockMode, Sailfish::Crypto::Key::EncryptionPadding padding, Sailfish::Crypto::Key::Digest digest, QByteArray *encrypted) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result decrypt(const QByteArray &data, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::BlockMode blockMode, Sailfish::Crypto::Key::EncryptionPadding padding, Sailfish::Crypto::Key::Digest digest, QByteArray *decrypted) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result generateRandomData(const QString &csprngEngineName, quint64 numberBytes, QByteArray *randomData) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result generateDigest(const QByteArray &data, Sailfish::Crypto::Key::Digest digest, QByteArray *digestValue) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result calculateMac(const QByteArray &data, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::Digest digest, QByteArray *mac) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result initialiseCipherSession(quint64 clientId, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::Operation operation, Sailfish::Crypto::Key::BlockMode blockMode, Sailfish::Crypto::Key::EncryptionPadding padding, Sailfish::Crypto::Key::Digest digest, quint32 *cipherSessionToken) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result updateCipherSession(quint64 clientId, const QByteArray &data, quint32 cipherSessionToken, QByteArray *generatedData) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result finaliseCipherSession(quint64 clientId, quint32 cipherSessionToken, QByteArray *generatedData) Q_DECL_OVERRIDE;
+    void closeCipherSessions(quint64 clientId) Q_DECL_OVERRIDE;
+
+    bool supportsAsynchronousOperations() const Q_DECL_OVERRIDE { return true; }
+    int maximumPendingOperations() const Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result beginSign(quint64 operationId, const QByteArray &data, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::SignaturePadding padding, Sailfish::Crypto::Key::Digest digest) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result beginVerify(quint64 operationId, const QByteArray &data, const QByteArray &signature, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::SignaturePadding padding, Sailfish::Crypto::Key::Digest digest) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result beginEncrypt(quint64 operationId, const QByteArray &data, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::BlockMode blockMode, Sailfish::Crypto::Key::EncryptionPadding padding, Sailfish::Crypto::Key::Digest digest) Q_DECL_OVERRIDE;
+    Sailfish::Crypto::Result beginDecrypt(quint64 operationId, const QByteArray &data, const Sailfish::Crypto::Key &key, Sailfish::Crypto::Key::BlockMode blockMode, Sailfish::Crypto::Key::EncryptionPadding padding, Sailfish::Crypto::Key::Digest digest) Q_DECL_OVERRIDE;
+
+private:
+    void hostOperationCompleted(quint64 operationId, int operation, const Sailfish::Crypto::Result &result, const QByteArray &outputs);
+    Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *leastBusyHost() const;
+    Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess *sessionHost(quint64 clientId) const;
+
+    Sailfish::Crypto::CryptoPluginInfo m_info;
+    bool m_testPlugin;
+    QList<Sailfish::Crypto::Daemon::ApiImpl::CryptoPluginHostProcess*> m_hosts;
+};
+
+// The main function of a plugin host process, which the daemon starts as
+// "sailfishsecretsd --crypto-plugin-host <plugin> <memfd> <request eventfd> <response eventfd>".
+int runCryptoPluginHost(const QStringList &arguments);
+
+} // namespace ApiImpl
+
+} // namespace Daemon
+
+} // namespace Crypto
+
+} // namespace Sailfish
+
+#endif // SAILFISHCRYPTO_APIIMPL_CRYPTOPLUGINHOST_P_H
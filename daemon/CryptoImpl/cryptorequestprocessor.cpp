@@ -6,59 +6,470 @@
  */
 
 #include "CryptoImpl/cryptorequestprocessor_p.h"
+#include "CryptoImpl/cryptopluginhost_p.h"
+
+#include "Crypto/x509certificate.h"
 
 #include "SecretsImpl/secrets_p.h"
 #include "Secrets/result.h"
 
+#include "applicationaccounting_p.h"
 #include "logging_p.h"
+#include "tracing_p.h"
 
-#include <QtCore/QDir>
-#include <QtCore/QPluginLoader>
 #include <QtCore/QObject>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QDataStream>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QtEndian>
+#include <QtConcurrent/QtConcurrent>
+
+namespace {
+    // each algorithm is benchmarked for about this long, with this much data per operation.
+    const qint64 BenchmarkDurationNs = 20 * 1000 * 1000;
+    const int BenchmarkDataSize = 16 * 1024;
+
+    // the stored keys which are kept in memory, across all applications.
+    const int MaxCachedStoredKeys = 64;
+
+    qint64 cachedStoredKeySize(const Sailfish::Crypto::Key &key)
+    {
+        return key.secretKey().size() + key.privateKey().size() + key.publicKey().size();
+    }
+
+    // accounts a stored key cache entry being added (or, with sign -1, removed) to its application.
+    void accountCachedStoredKey(const QString &applicationId, const Sailfish::Crypto::Key &key, int sign)
+    {
+        Sailfish::Secrets::Daemon::ApplicationAccounting::instance()->recordCacheBytes(
+                applicationId, sign * cachedStoredKeySize(key));
+    }
+
+    // the certificate chains whose validation outcome is kept in memory, and for how long at most.
+    const int MaxCachedCertificateChains = 128;
+    const int CertificateChainCacheLifetimeSecs = 10 * 60;
+
+    // random data is returned in a single reply, well within the D-Bus message size limit.
+    const quint64 MaxRandomDataSize = 32 * 1024 * 1024;
+
+    // Identifies the chain as validated by the given provider.  Returns an empty
+    // fingerprint if any certificate in the chain has no encoded form.
+    QByteArray certificateChainFingerprint(
+            const QVector<Sailfish::Crypto::Certificate> &chain,
+            const QString &cryptosystemProviderName)
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        hash.addData(cryptosystemProviderName.toUtf8());
+        Q_FOREACH (const Sailfish::Crypto::Certificate &certificate, chain) {
+            const QByteArray encoded = certificate.toEncoded();
+            if (encoded.isEmpty()) {
+                return QByteArray();
+            }
+            const quint32 size = qToBigEndian<quint32>(static_cast<quint32>(encoded.size()));
+            hash.addData(reinterpret_cast<const char *>(&size), sizeof(size));
+            hash.addData(encoded);
+        }
+        return hash.result();
+    }
+
+    // One item of data in a batch request, and the outcome of the operation on it.
+    struct BatchItem {
+        BatchItem() : verified(false) {}
+        QByteArray data;
+        QByteArray signature; // only used by verifyBatch
+        QByteArray output;
+        bool verified;
+        Sailfish::Crypto::Result result;
+    };
+
+    // Performs the operation of a batch request on one item, on the global thread pool.
+    struct BatchOperation {
+        typedef void result_type;
+        BatchOperation(Sailfish::Crypto::CryptoPlugin *plugin,
+                       Sailfish::Crypto::Daemon::ApiImpl::RequestType requestType,
+                       const Sailfish::Crypto::Key &key,
+                       Sailfish::Crypto::Key::SignaturePadding signaturePadding,
+                       Sailfish::Crypto::Key::BlockMode blockMode,
+                       Sailfish::Crypto::Key::EncryptionPadding encryptionPadding,
+                       Sailfish::Crypto::Key::Digest digest)
+            : m_plugin(plugin), m_requestType(requestType), m_key(key), m_signaturePadding(signaturePadding)
+            , m_blockMode(blockMode), m_encryptionPadding(encryptionPadding), m_digest(digest) {}
+        void operator()(BatchItem &item) const {
+            switch (m_requestType) {
+                case Sailfish::Crypto::Daemon::ApiImpl::SignBatchRequest:
+                    item.result = m_plugin->sign(item.data, m_key, m_signaturePadding, m_digest, &item.output);
+                    break;
+                case Sailfish::Crypto::Daemon::ApiImpl::VerifyBatchRequest:
+                    item.result = m_plugin->verify(item.data, item.signature, m_key, m_signaturePadding, m_digest, &item.verified);
+                    break;
+                default:
+                    item.result = m_plugin->encrypt(item.data, m_key, m_blockMode, m_encryptionPadding, m_digest, &item.output);
+                    break;
+            }
+        }
+        Sailfish::Crypto::CryptoPlugin *m_plugin;
+        Sailfish::Crypto::Daemon::ApiImpl::RequestType m_requestType;
+        Sailfish::Crypto::Key m_key;
+        Sailfish::Crypto::Key::SignaturePadding m_signaturePadding;
+        Sailfish::Crypto::Key::BlockMode m_blockMode;
+        Sailfish::Crypto::Key::EncryptionPadding m_encryptionPadding;
+        Sailfish::Crypto::Key::Digest m_digest;
+    };
+
+    // One distinct chain in a validateCertificateChains() request, and the outcome of validating it.
+    struct CertificateChainItem {
+        CertificateChainItem() : valid(false), cached(false) {}
+        QVector<Sailfish::Crypto::Certificate> chain;
+        QByteArray fingerprint;
+        bool valid;
+        bool cached;
+        Sailfish::Crypto::Result result;
+    };
+
+    // Validates one chain which has no cached outcome, on the global thread pool.
+    struct CertificateChainValidationOperation {
+        typedef void result_type;
+        CertificateChainValidationOperation(Sailfish::Crypto::CryptoPlugin *plugin)
+            : m_plugin(plugin) {}
+        void operator()(CertificateChainItem &item) const {
+            if (!item.cached) {
+                item.result = m_plugin->validateCertificateChain(item.chain, &item.valid);
+            }
+        }
+        Sailfish::Crypto::CryptoPlugin *m_plugin;
+    };
+
+    // The batch fails as a whole if the operation fails for any item.
+    Sailfish::Crypto::Result performBatch(
+            const BatchOperation &operation,
+            const QVector<QByteArray> &data,
+            const QVector<QByteArray> &signatures,
+            QVector<QByteArray> *outputs,
+            QVector<bool> *verified)
+    {
+        if (operation.m_requestType == Sailfish::Crypto::Daemon::ApiImpl::VerifyBatchRequest
+                && signatures.size() != data.size()) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginVerificationError,
+                                            QLatin1String("The number of signatures does not match the number of data items"));
+        }
+
+        QVector<BatchItem> items(data.size());
+        for (int i = 0; i < items.size(); ++i) {
+            items[i].data = data.at(i);
+            if (i < signatures.size()) {
+                items[i].signature = signatures.at(i);
+            }
+        }
+
+        if (items.size() > 1) {
+            QtConcurrent::blockingMap(items, operation);
+        } else if (items.size() == 1) {
+            operation(items[0]);
+        }
+
+        Q_FOREACH (const BatchItem &item, items) {
+            if (item.result.code() != Sailfish::Crypto::Result::Succeeded) {
+                return item.result;
+            }
+        }
+        Q_FOREACH (const BatchItem &item, items) {
+            if (outputs) {
+                outputs->append(item.output);
+            }
+            if (verified) {
+                verified->append(item.verified);
+            }
+        }
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
+    template <typename T>
+    T lowestFlag(QFlags<T> flags)
+    {
+        for (int bit = 0; bit < 31; ++bit) {
+            const T flag = static_cast<T>(1 << bit);
+            if (flags.testFlag(flag)) {
+                return flag;
+            }
+        }
+        return static_cast<T>(0);
+    }
+
+    // Measures the throughput of encryption (or signing, for algorithms
+    // which can't encrypt) with each algorithm the plugin supports, in
+    // bytes per second.  Algorithms which fail are left out.
+    QMap<int, qint64> benchmarkCryptoPlugin(Sailfish::Crypto::CryptoPlugin *plugin)
+    {
+        QMap<int, qint64> throughput;
+        const QByteArray data(BenchmarkDataSize, 'x');
+        const QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::Operations> operations = plugin->supportedOperations();
+        Q_FOREACH (Sailfish::Crypto::Key::Algorithm algorithm, plugin->supportedAlgorithms()) {
+            const bool encrypt = operations.value(algorithm) & Sailfish::Crypto::Key::Encrypt;
+            if (!encrypt && !(operations.value(algorithm) & Sailfish::Crypto::Key::Sign)) {
+                continue;
+            }
+
+            Sailfish::Crypto::Key keyTemplate;
+            keyTemplate.setAlgorithm(algorithm);
+            keyTemplate.setOperations(operations.value(algorithm));
+            Sailfish::Crypto::Key key;
+            if (plugin->generateKey(keyTemplate, &key).code() != Sailfish::Crypto::Result::Succeeded) {
+                continue;
+            }
+
+            const Sailfish::Crypto::Key::BlockMode blockMode = lowestFlag(plugin->supportedBlockModes().value(algorithm));
+            const Sailfish::Crypto::Key::EncryptionPadding encryptionPadding = lowestFlag(plugin->supportedEncryptionPaddings().value(algorithm));
+            const Sailfish::Crypto::Key::SignaturePadding signaturePadding = lowestFlag(plugin->supportedSignaturePaddings().value(algorithm));
+            const Sailfish::Crypto::Key::Digest digest = lowestFlag(plugin->supportedDigests().value(algorithm));
+
+            QElapsedTimer timer;
+            timer.start();
+            qint64 bytes = 0;
+            bool succeeded = true;
+            while (succeeded && (bytes == 0 || timer.nsecsElapsed() < BenchmarkDurationNs)) {
+                QByteArray output;
+                succeeded = (encrypt
+                             ? plugin->encrypt(data, key, blockMode, encryptionPadding, digest, &output)
+                             : plugin->sign(data, key, signaturePadding, digest, &output)).code()
+                        == Sailfish::Crypto::Result::Succeeded;
+                bytes += data.size();
+            }
+            if (succeeded) {
+                throughput.insert(algorithm, bytes * 1000 * 1000 * 1000 / qMax(timer.nsecsElapsed(), qint64(1)));
+            }
+        }
+        return throughput;
+    }
+
+    // The plugin info is cached by the plugin registry, so that plugins need not be loaded to report it.
+    // As it is only introspected when the plugin is installed or updated, it is benchmarked then too.
+    bool introspectCryptoPlugin(QObject *object, QString *name, bool *testPlugin, QByteArray *info)
+    {
+        Sailfish::Crypto::CryptoPlugin *plugin = qobject_cast<Sailfish::Crypto::CryptoPlugin*>(object);
+        if (!plugin) {
+            return false;
+        }
+        *name = plugin->name();
+        *testPlugin = plugin->isTestPlugin();
+        QDataStream out(info, QIODevice::WriteOnly);
+        out << Sailfish::Crypto::CryptoPluginInfo::serialise(Sailfish::Crypto::CryptoPluginInfo(plugin))
+            << benchmarkCryptoPlugin(plugin)
+            << plugin->supportsAsynchronousOperations();
+        return true;
+    }
+
+    QObject *createRemoteCryptoPlugin(const QString &filePath, const QString &name, bool testPlugin, const QByteArray &info, int processCount)
+    {
+        Q_UNUSED(name);
+        QByteArray serialisedInfo;
+        QDataStream in(info);
+        in >> serialisedInfo;
+        Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin *plugin = new Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin(
+                filePath, Sailfish::Crypto::CryptoPluginInfo::deserialise(serialisedInfo), testPlugin, processCount);
+        if (!plugin->isValid()) {
+            delete plugin;
+            return Q_NULLPTR;
+        }
+        return plugin;
+    }
+}
 
 Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::RequestProcessor(Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue *secrets,
                  Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue *parent)
     : QObject(parent), m_requestQueue(parent), m_secrets(secrets)
+    , m_cryptoPlugins(&m_pluginRegistry, QLatin1String(Sailfish_Crypto_CryptoPlugin_IID))
+    , m_pluginJobQueueDepth(0)
+    , m_keyPool(m_cryptoPlugins)
 {
+    m_pluginRegistry.registerInterface(QLatin1String(Sailfish_Crypto_CryptoPlugin_IID), introspectCryptoPlugin);
+    // direct, as the plugin may be loaded by a worker thread, and is used as soon as it is returned.
+    connect(&m_pluginRegistry, &Sailfish::Secrets::Daemon::PluginRegistry::pluginLoaded,
+            this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginLoaded,
+            Qt::DirectConnection);
     connect(m_secrets, &Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::storedKeyCompleted,
             this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoredKeyCompleted);
     connect(m_secrets, &Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::storeKeyCompleted,
             this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoreKeyCompleted);
     connect(m_secrets, &Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::deleteStoredKeyCompleted,
             this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsDeleteStoredKeyCompleted);
+    connect(m_secrets, &Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::storedKeysInvalidated,
+            this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoredKeysInvalidated);
 }
 
 bool
 Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::loadPlugins(const QString &pluginDir, bool autotestMode)
 {
     qCDebug(lcSailfishCryptoDaemon) << "Loading crypto plugins from directory:" << pluginDir;
-    QDir dir(pluginDir);
-    Q_FOREACH (const QString &pluginFile, dir.entryList(QDir::Files | QDir::NoDot | QDir::NoDotDot, QDir::Name)) {
-        // load the plugin and query it for its data.
-        QPluginLoader loader(pluginFile);
-        QObject *plugin = loader.instance();
-        Sailfish::Crypto::CryptoPlugin *cryptoPlugin = qobject_cast<Sailfish::Crypto::CryptoPlugin*>(plugin);
-        if (cryptoPlugin) {
-            if (cryptoPlugin->isTestPlugin() != autotestMode) {
-                qCDebug(lcSailfishCryptoDaemon) << "ignoring crypto plugin:" << pluginFile << "due to mode";
-                loader.unload();
-                continue;
-            } else if (cryptoPlugin->name().isEmpty() || m_cryptoPlugins.contains(cryptoPlugin->name())) {
-                qCDebug(lcSailfishCryptoDaemon) << "ignoring crypto plugin:" << pluginFile << "with duplicate name:" << cryptoPlugin->name();
-                loader.unload();
-                continue;
-            } else {
-                qCDebug(lcSailfishCryptoDaemon) << "loading crypto plugin:" << pluginFile << "with name:" << cryptoPlugin->name();
-                m_cryptoPlugins.insert(cryptoPlugin->name(), cryptoPlugin);
+
+    // the plugins themselves are only loaded once a request requires them.
+    QString cacheFilePath = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/system/privileged/Crypto/sailfishcryptod");
+    if (autotestMode) {
+        cacheFilePath.append(QLatin1String("-test"));
+    }
+    cacheFilePath.append(QLatin1String("/plugins.json"));
+    if (!m_pluginRegistry.scan(pluginDir, cacheFilePath, autotestMode)) {
+        return false;
+    }
+
+    QMap<QString, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::ProviderProfile> providerProfiles;
+    Q_FOREACH (const QString &name, m_cryptoPlugins.keys()) {
+        QByteArray serialisedInfo;
+        QMap<int, qint64> throughput;
+        bool asynchronous = false;
+        QDataStream in(m_cryptoPlugins.info(name));
+        in >> serialisedInfo >> throughput >> asynchronous;
+        providerProfiles.insert(name, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::ProviderProfile(
+                                    Sailfish::Crypto::CryptoPluginInfo::deserialise(serialisedInfo), throughput, asynchronous));
+    }
+
+    QMutexLocker locker(&m_providerProfilesMutex);
+    m_providerProfiles = providerProfiles;
+
+    return true;
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::setPluginHosts(const QString &specification)
+{
+    QMap<QString, int> processCounts;
+    m_providerProfilesMutex.lock();
+    Q_FOREACH (const QString &entrySpecification, specification.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        const QStringList fields = entrySpecification.trimmed().split(QLatin1Char(':'));
+        bool countOk = true;
+        const int count = fields.size() > 1 ? fields.at(1).toInt(&countOk) : 1;
+        if (fields.size() > 2 || fields.at(0).isEmpty() || !countOk || count <= 0
+                || !m_providerProfiles.contains(fields.at(0))) {
+            qCWarning(lcSailfishCryptoDaemon) << "ignoring invalid plugin host entry:" << entrySpecification;
+            continue;
+        }
+        processCounts.insert(fields.at(0), count);
+        // the host performs its operations asynchronously, whether or not the plugin does.
+        m_providerProfiles[fields.at(0)].asynchronous = true;
+    }
+    m_providerProfilesMutex.unlock();
+
+    m_pluginRegistry.setOutOfProcess(QLatin1String(Sailfish_Crypto_CryptoPlugin_IID), processCounts, createRemoteCryptoPlugin);
+
+    // the hosts are started now, from the main thread, rather than by whichever thread first uses them.
+    Q_FOREACH (const QString &name, processCounts.keys()) {
+        if (!m_cryptoPlugins.value(name)) {
+            qCWarning(lcSailfishCryptoDaemon) << "unable to host plugin:" << name;
+        }
+    }
+}
+
+QVariantMap
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginHostStatistics() const
+{
+    QVariantMap stats;
+    Q_FOREACH (Sailfish::Crypto::CryptoPlugin *plugin, m_cryptoPlugins.loaded()) {
+        const Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin *remote
+                = qobject_cast<const Sailfish::Crypto::Daemon::ApiImpl::RemoteCryptoPlugin*>(plugin);
+        if (remote) {
+            stats.insert(remote->name(), remote->hostStatistics());
+        }
+    }
+    return stats;
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginLoaded(
+        const QString &interfaceId,
+        const QString &name,
+        QObject *plugin)
+{
+    Q_UNUSED(interfaceId);
+    Q_UNUSED(name);
+
+    // queued, as the plugin may complete the job before beginX() returns.
+    Sailfish::Crypto::CryptoPlugin *cryptoPlugin = qobject_cast<Sailfish::Crypto::CryptoPlugin*>(plugin);
+    if (!cryptoPlugin || !cryptoPlugin->supportsAsynchronousOperations()) {
+        return;
+    }
+    connect(cryptoPlugin, &Sailfish::Crypto::CryptoPlugin::signCompleted,
+            this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginSignCompleted,
+            Qt::QueuedConnection);
+    connect(cryptoPlugin, &Sailfish::Crypto::CryptoPlugin::verifyCompleted,
+            this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginVerifyCompleted,
+            Qt::QueuedConnection);
+    connect(cryptoPlugin, &Sailfish::Crypto::CryptoPlugin::encryptCompleted,
+            this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginEncryptCompleted,
+            Qt::QueuedConnection);
+    connect(cryptoPlugin, &Sailfish::Crypto::CryptoPlugin::decryptCompleted,
+            this, &Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginDecryptCompleted,
+            Qt::QueuedConnection);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::cancelPendingRequest(quint64 requestId)
+{
+    m_pendingRequests.remove(requestId);
+
+    // a submitted job can't be withdrawn from the plugin, but its completion is ignored.
+    m_submittedPluginJobs.remove(requestId);
+    QMap<QString, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJobQueue>::iterator it = m_pluginJobQueues.begin();
+    for (; it != m_pluginJobQueues.end(); ++it) {
+        for (int i = it->waiting.size() - 1; i >= 0; --i) {
+            if (it->waiting.at(i).requestId == requestId) {
+                it->waiting.removeAt(i);
             }
-        } else {
-            qCWarning(lcSailfishCryptoDaemon) << "ignoring plugin:" << pluginFile << "- not a crypto plugin or Qt version mismatch";
-            loader.unload();
+        }
+    }
+}
+
+bool
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::providerIsAsynchronous(
+        const QString &cryptosystemProviderName,
+        Sailfish::Crypto::Key::Algorithm algorithm,
+        Sailfish::Crypto::Key::Operation operation) const
+{
+    const QString resolvedProviderName = resolveCryptosystemProvider(cryptosystemProviderName, algorithm, operation);
+    QMutexLocker locker(&m_providerProfilesMutex);
+    return m_providerProfiles.value(resolvedProviderName).asynchronous;
+}
+
+QString
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::resolveCryptosystemProvider(
+        const QString &cryptosystemProviderName,
+        Sailfish::Crypto::Key::Algorithm algorithm,
+        Sailfish::Crypto::Key::Operation operation) const
+{
+    const bool hardwarePreferred = cryptosystemProviderName == Sailfish::Crypto::CryptoManager::HardwarePreferredCryptosystemProvider;
+    if (!hardwarePreferred && cryptosystemProviderName != Sailfish::Crypto::CryptoManager::FastestCryptosystemProvider) {
+        return cryptosystemProviderName;
+    }
+
+    QString best;
+    bool bestIsHardware = false;
+    qint64 bestThroughput = 0;
+    QMutexLocker locker(&m_providerProfilesMutex);
+    QMap<QString, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::ProviderProfile>::const_iterator it = m_providerProfiles.constBegin();
+    for (; it != m_providerProfiles.constEnd(); ++it) {
+        // key generation is possible for any supported algorithm.
+        const bool supported = operation == Sailfish::Crypto::Key::OperationUnknown
+                ? it->info.supportedAlgorithms().contains(algorithm)
+                : (it->info.supportedOperations().value(algorithm) & operation);
+        if (!supported) {
             continue;
         }
+
+        const bool isHardware = it->info.encryptionType() == Sailfish::Crypto::CryptoPlugin::TrustedExecutionSoftwareEncryption
+                || it->info.encryptionType() == Sailfish::Crypto::CryptoPlugin::SecurePeripheralEncryption;
+        const qint64 throughput = it->throughput.value(algorithm);
+        const bool better = best.isEmpty()
+                || (hardwarePreferred && isHardware != bestIsHardware ? isHardware : throughput > bestThroughput);
+        if (better) {
+            best = it.key();
+            bestIsHardware = isHardware;
+            bestThroughput = throughput;
+        }
     }
 
-    return true;
+    qCDebug(lcSailfishCryptoDaemon) << "routing" << cryptosystemProviderName << "request to:" << best;
+    return best;
 }
 
 Sailfish::Crypto::Result
@@ -78,14 +489,23 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::getPluginInfo(
         return retn;
     }
 
-    QMap<QString, Sailfish::Crypto::CryptoPlugin*>::const_iterator it = m_cryptoPlugins.constBegin();
-    for (; it != m_cryptoPlugins.constEnd(); it++) {
-        cryptoPlugins->append(Sailfish::Crypto::CryptoPluginInfo(it.value()));
+    // answered from the plugin metadata cache, without loading the plugins.
+    QMutexLocker locker(&m_providerProfilesMutex);
+    Q_FOREACH (const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::ProviderProfile &profile, m_providerProfiles) {
+        cryptoPlugins->append(profile.info);
     }
 
     return retn;
 }
 
+quint64
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginInfoGeneration() const
+{
+    // the storage plugin names are part of the plugin info too.
+    const quint64 storageGeneration = m_secrets->pluginInfoGeneration();
+    return m_pluginRegistry.generation() ^ ((storageGeneration << 1) | (storageGeneration >> 63));
+}
+
 Sailfish::Crypto::Result
 Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::validateCertificateChain(
         pid_t callerPid,
@@ -103,7 +523,78 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::validateCertificateChain(
                                         QLatin1String("No such cryptographic service provider plugin exists"));
     }
 
-    return m_cryptoPlugins[cryptosystemProviderName]->validateCertificateChain(chain, valid);
+    const QByteArray fingerprint = certificateChainFingerprint(chain, cryptosystemProviderName);
+    if (!fingerprint.isEmpty() && cachedCertificateChainValidation(fingerprint, valid)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
+    Sailfish::Crypto::Result result = m_cryptoPlugins[cryptosystemProviderName]->validateCertificateChain(chain, valid);
+    if (result.code() == Sailfish::Crypto::Result::Succeeded && !fingerprint.isEmpty()) {
+        cacheCertificateChainValidation(fingerprint, chain, *valid);
+    }
+    return result;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::validateCertificateChains(
+        pid_t callerPid,
+        quint64 requestId,
+        const QVector<QVector<Sailfish::Crypto::Certificate> > &chains,
+        const QString &cryptosystemProviderName,
+        QVector<bool> *valid)
+{
+    // TODO: access control!
+    Q_UNUSED(callerPid);
+    Q_UNUSED(requestId);
+
+    if (!m_cryptoPlugins.contains(cryptosystemProviderName)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    // identical chains in the batch are validated once, and chains with a cached outcome not at all.
+    QVector<CertificateChainItem> items;
+    QVector<int> itemIndexes;
+    QMap<QByteArray, int> fingerprintIndexes;
+    Q_FOREACH (const QVector<Sailfish::Crypto::Certificate> &chain, chains) {
+        const QByteArray fingerprint = certificateChainFingerprint(chain, cryptosystemProviderName);
+        if (!fingerprint.isEmpty() && fingerprintIndexes.contains(fingerprint)) {
+            itemIndexes.append(fingerprintIndexes.value(fingerprint));
+            continue;
+        }
+        CertificateChainItem item;
+        item.chain = chain;
+        item.fingerprint = fingerprint;
+        item.cached = !fingerprint.isEmpty() && cachedCertificateChainValidation(fingerprint, &item.valid);
+        if (!fingerprint.isEmpty()) {
+            fingerprintIndexes.insert(fingerprint, items.size());
+        }
+        itemIndexes.append(items.size());
+        items.append(item);
+    }
+
+    const CertificateChainValidationOperation operation(m_cryptoPlugins[cryptosystemProviderName]);
+    if (items.size() > 1) {
+        QtConcurrent::blockingMap(items, operation);
+    } else if (items.size() == 1) {
+        operation(items[0]);
+    }
+
+    // the batch fails as a whole if validation fails for any chain.
+    Q_FOREACH (const CertificateChainItem &item, items) {
+        if (item.result.code() != Sailfish::Crypto::Result::Succeeded) {
+            return item.result;
+        }
+    }
+    Q_FOREACH (const CertificateChainItem &item, items) {
+        if (!item.cached && !item.fingerprint.isEmpty()) {
+            cacheCertificateChainValidation(item.fingerprint, item.chain, item.valid);
+        }
+    }
+    Q_FOREACH (int index, itemIndexes) {
+        valid->append(items.at(index).valid);
+    }
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
 }
 
 Sailfish::Crypto::Result
@@ -111,18 +602,23 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::generateKey(
         pid_t callerPid,
         quint64 requestId,
         const Sailfish::Crypto::Key &keyTemplate,
-        const QString &cryptosystemProviderName,
+        const QString &requestedProviderName,
         Sailfish::Crypto::Key *key)
 {
     // TODO: access control!
     Q_UNUSED(callerPid);
     Q_UNUSED(requestId);
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, keyTemplate.algorithm(), Sailfish::Crypto::Key::OperationUnknown);
 
     if (!m_cryptoPlugins.contains(cryptosystemProviderName)) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
                                         QLatin1String("No such cryptographic service provider plugin exists"));
     }
 
+    if (m_keyPool.take(cryptosystemProviderName, keyTemplate, key)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
     return m_cryptoPlugins[cryptosystemProviderName]->generateKey(keyTemplate, key);
 }
 
@@ -131,10 +627,12 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::generateStoredKey(
         pid_t callerPid,
         quint64 requestId,
         const Sailfish::Crypto::Key &keyTemplate,
-        const QString &cryptosystemProviderName,
+        const QString &requestedProviderName,
         const QString &storageProviderName,
         Sailfish::Crypto::Key *key)
 {
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, keyTemplate.algorithm(), Sailfish::Crypto::Key::OperationUnknown);
+
     Sailfish::Secrets::Result secretsResult;
     if (keyTemplate.identifier().name().isEmpty()) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidKeyIdentifier,
@@ -167,7 +665,7 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::generateStoredKey(
         }
 
         // generate the key and store it via the same plugin.
-        secretsResult = m_secrets->addKeyEntry(callerPid, requestId, keyTemplate.identifier(), cryptosystemProviderName, storageProviderName);
+        secretsResult = m_secrets->addKeyEntry(callerPid, requestId, keyTemplate.identifier(), cryptosystemProviderName, storageProviderName, keyTemplate.filterData());
         if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
             Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Failed);
             retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
@@ -186,12 +684,15 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::generateStoredKey(
 
     // generate the key
     Sailfish::Crypto::Key fullKey;
-    Sailfish::Crypto::Result keyResult = m_cryptoPlugins[cryptosystemProviderName]->generateKey(keyTemplate, &fullKey);
-    if (keyResult.code() == Sailfish::Crypto::Result::Failed) {
-        return keyResult;
+    if (!m_keyPool.take(cryptosystemProviderName, keyTemplate, &fullKey)) {
+        Sailfish::Crypto::Result keyResult = m_cryptoPlugins[cryptosystemProviderName]->generateKey(keyTemplate, &fullKey);
+        if (keyResult.code() == Sailfish::Crypto::Result::Failed) {
+            return keyResult;
+        }
     }
+    fullKey.setFilterData(keyTemplate.filterData());
 
-    secretsResult = m_secrets->addKeyEntry(callerPid, requestId, keyTemplate.identifier(), cryptosystemProviderName, storageProviderName);
+    secretsResult = m_secrets->addKeyEntry(callerPid, requestId, keyTemplate.identifier(), cryptosystemProviderName, storageProviderName, keyTemplate.filterData());
     if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
         Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Failed);
         retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
@@ -212,12 +713,14 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::generateStoredKey(
         return retn;
     } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
         // asynchronous operation, will call back to generateStoredKey2().
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyContinuation;
+        continuation->key = fullKey;
         m_pendingRequests.insert(requestId,
                                  Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                      callerPid,
                                      requestId,
                                      Sailfish::Crypto::Daemon::ApiImpl::GenerateStoredKeyRequest,
-                                     QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key>(fullKey)));
+                                     continuation));
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
     }
 
@@ -299,16 +802,19 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::storedKey(
         return retn;
     } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
         // asynchronous flow required, will eventually call back to storedKey2().
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyIdentifierContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyIdentifierContinuation;
+        continuation->identifier = identifier;
         m_pendingRequests.insert(requestId,
                                  Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                      callerPid,
                                      requestId,
                                      Sailfish::Crypto::Daemon::ApiImpl::StoredKeyRequest,
-                                     QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key::Identifier>(identifier)));
+                                     continuation));
         retn.setCode(Sailfish::Crypto::Result::Pending);
         return retn;
     }
 
+    cacheStoredKey(callerPid, identifier, serialisedKey);
     *key = Sailfish::Crypto::Key::deserialise(serialisedKey);
     return retn;
 }
@@ -336,6 +842,9 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::deleteStoredKey(
 
     Sailfish::Crypto::Result retn = Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
 
+    // even if the deletion fails, the key is read from storage again by the next request.
+    secretsStoredKeysInvalidated(identifier.collectionName(), identifier.name());
+
     QString cryptoPluginName, storagePluginName;
     Sailfish::Secrets::Result secretsResult = m_secrets->keyEntry(callerPid, requestId, identifier, &cryptoPluginName, &storagePluginName);
     if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
@@ -366,12 +875,14 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::deleteStoredKey(
         // TODO: if that fails, re-try later etc.
     } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
         // asynchronous flow, will call back to deleteStoredKey2().
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyIdentifierContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyIdentifierContinuation;
+        continuation->identifier = identifier;
         m_pendingRequests.insert(requestId,
                                  Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                      callerPid,
                                      requestId,
                                      Sailfish::Crypto::Daemon::ApiImpl::DeleteStoredKeyRequest,
-                                     QVariantList() << QVariant::fromValue<Sailfish::Crypto::Key::Identifier>(identifier)));
+                                     continuation));
         retn.setCode(Sailfish::Crypto::Result::Pending);
     } else {
         retn.setCode(Sailfish::Crypto::Result::Failed);
@@ -417,6 +928,55 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::storedKeyIdentifiers(
     return retn;
 }
 
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::storedKeyIdentifiers(
+        pid_t callerPid,
+        quint64 requestId,
+        qint64 cursor,
+        int limit,
+        QVector<Sailfish::Crypto::Key::Identifier> *identifiers,
+        qint64 *nextCursor)
+{
+    // bounds the size of the reply, whatever the caller asks for.
+    const int MaxKeyIdentifiersPerPage = 1000;
+
+    *nextCursor = 0;
+    if (cursor < 0 || limit <= 0) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                        QLatin1String("Invalid cursor or limit given"));
+    }
+
+    Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Succeeded);
+    Sailfish::Secrets::Result secretsResult = m_secrets->keyEntryIdentifiers(callerPid, requestId, cursor,
+                                                                              qMin(limit, MaxKeyIdentifiersPerPage),
+                                                                              identifiers, nextCursor);
+    if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
+        retn.setCode(Sailfish::Crypto::Result::Failed);
+        retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
+        retn.setStorageErrorCode(secretsResult.errorCode());
+        retn.setErrorMessage(secretsResult.errorMessage());
+    }
+    return retn;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::findKeys(
+        pid_t callerPid,
+        quint64 requestId,
+        const Sailfish::Crypto::Key::FilterData &filter,
+        QVector<Sailfish::Crypto::Key::Identifier> *identifiers)
+{
+    Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Succeeded);
+    Sailfish::Secrets::Result secretsResult = m_secrets->findKeyEntries(callerPid, requestId, filter, identifiers);
+    if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
+        retn.setCode(Sailfish::Crypto::Result::Failed);
+        retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
+        retn.setStorageErrorCode(secretsResult.errorCode());
+        retn.setErrorMessage(secretsResult.errorMessage());
+    }
+    return retn;
+}
+
 Sailfish::Crypto::Result
 Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::sign(
         pid_t callerPid,
@@ -425,11 +985,13 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::sign(
         const Sailfish::Crypto::Key &key,
         Sailfish::Crypto::Key::SignaturePadding padding,
         Sailfish::Crypto::Key::Digest digest,
-        const QString &cryptosystemProviderName,
+        const QString &requestedProviderName,
         QByteArray *signature)
 {
     // TODO: Access Control
 
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, key.algorithm(), Sailfish::Crypto::Key::Sign);
+
     Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
     if (cryptoPlugin == Q_NULLPTR) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
@@ -450,6 +1012,10 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::sign(
     Sailfish::Crypto::Key fullKey;
     if (key.privateKey().isEmpty() && key.secretKey().isEmpty()) {
         // the key is a key reference, attempt to read the full key from storage.
+        if (cachedStoredKey(callerPid, key.identifier(), &fullKey)) {
+            // read from storage by an earlier request of this application.
+            return signWithPlugin(cryptoPlugin, requestId, data, fullKey, padding, digest, signature);
+        }
         Sailfish::Secrets::Result secretsResult(Sailfish::Secrets::Result::Succeeded);
         Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Succeeded);
         if (key.identifier().name().isEmpty()) {
@@ -481,24 +1047,28 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::sign(
             return retn;
         } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
             // asynchronous flow required, will call back to sign2().
+            Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation;
+            continuation->data = data;
+            continuation->padding = padding;
+            continuation->digest = digest;
+            continuation->cryptoPluginName = cryptosystemProviderName;
+            continuation->identifier = key.identifier();
             m_pendingRequests.insert(requestId,
                                      Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                          callerPid,
                                          requestId,
                                          Sailfish::Crypto::Daemon::ApiImpl::SignRequest,
-                                         QVariantList() << QVariant::fromValue<QByteArray>(data)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::SignaturePadding>(padding)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
-                                                        << QVariant::fromValue<QString>(cryptosystemProviderName)));
+                                         continuation));
             return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
         }
 
+        cacheStoredKey(callerPid, key.identifier(), serialisedKey);
         fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
     } else {
         fullKey = key;
     }
 
-    return cryptoPlugin->sign(data, fullKey, padding, digest, signature);
+    return signWithPlugin(cryptoPlugin, requestId, data, fullKey, padding, digest, signature);
 }
 
 void
@@ -516,7 +1086,10 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::sign2(
     QByteArray signature;
     if (result.code() == Sailfish::Crypto::Result::Succeeded) {
         Sailfish::Crypto::Key fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
-        Sailfish::Crypto::Result cryptoResult = m_cryptoPlugins[cryptoPluginName]->sign(data, fullKey, padding, digest, &signature);
+        Sailfish::Crypto::Result cryptoResult = signWithPlugin(m_cryptoPlugins[cryptoPluginName], requestId, data, fullKey, padding, digest, &signature);
+        if (cryptoResult.code() == Sailfish::Crypto::Result::Pending) {
+            return; // finished once the plugin completes the job.
+        }
         outParams << QVariant::fromValue<Sailfish::Crypto::Result>(cryptoResult);
     } else {
         outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
@@ -530,14 +1103,17 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::verify(
         pid_t callerPid,
         quint64 requestId,
         const QByteArray &data,
+        const QByteArray &signature,
         const Sailfish::Crypto::Key &key,
         Sailfish::Crypto::Key::SignaturePadding padding,
         Sailfish::Crypto::Key::Digest digest,
-        const QString &cryptosystemProviderName,
+        const QString &requestedProviderName,
         bool *verified)
 {
     // TODO: Access Control
 
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, key.algorithm(), Sailfish::Crypto::Key::Verify);
+
     Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
     if (cryptoPlugin == Q_NULLPTR) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
@@ -558,6 +1134,10 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::verify(
     Sailfish::Crypto::Key fullKey;
     if (key.publicKey().isEmpty() && key.privateKey().isEmpty() && key.secretKey().isEmpty()) { // can use public key to verify
         // the key is a key reference, attempt to read the full key from storage.
+        if (cachedStoredKey(callerPid, key.identifier(), &fullKey)) {
+            // read from storage by an earlier request of this application.
+            return verifyWithPlugin(cryptoPlugin, requestId, data, signature, fullKey, padding, digest, verified);
+        }
         Sailfish::Secrets::Result secretsResult(Sailfish::Secrets::Result::Succeeded);
         Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Succeeded);
         if (key.identifier().name().isEmpty()) {
@@ -589,24 +1169,29 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::verify(
             return retn;
         } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
             // asynchronous flow required, will call back to verify2().
+            Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation;
+            continuation->data = data;
+            continuation->signature = signature;
+            continuation->padding = padding;
+            continuation->digest = digest;
+            continuation->cryptoPluginName = cryptosystemProviderName;
+            continuation->identifier = key.identifier();
             m_pendingRequests.insert(requestId,
                                      Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                          callerPid,
                                          requestId,
                                          Sailfish::Crypto::Daemon::ApiImpl::VerifyRequest,
-                                         QVariantList() << QVariant::fromValue<QByteArray>(data)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::SignaturePadding>(padding)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
-                                                        << QVariant::fromValue<QString>(cryptosystemProviderName)));
+                                         continuation));
             return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
         }
 
+        cacheStoredKey(callerPid, key.identifier(), serialisedKey);
         fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
     } else {
         fullKey = key;
     }
 
-    return cryptoPlugin->verify(data, fullKey, padding, digest, verified);
+    return verifyWithPlugin(cryptoPlugin, requestId, data, signature, fullKey, padding, digest, verified);
 }
 
 void
@@ -615,6 +1200,7 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::verify2(
         const Sailfish::Crypto::Result &result,
         const QByteArray &serialisedKey,
         const QByteArray &data,
+        const QByteArray &signature,
         Sailfish::Crypto::Key::SignaturePadding padding,
         Sailfish::Crypto::Key::Digest digest,
         const QString &cryptoPluginName)
@@ -624,7 +1210,10 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::verify2(
     bool verified = false;
     if (result.code() == Sailfish::Crypto::Result::Succeeded) {
         Sailfish::Crypto::Key fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
-        Sailfish::Crypto::Result cryptoResult = m_cryptoPlugins[cryptoPluginName]->verify(data, fullKey, padding, digest, &verified);
+        Sailfish::Crypto::Result cryptoResult = verifyWithPlugin(m_cryptoPlugins[cryptoPluginName], requestId, data, signature, fullKey, padding, digest, &verified);
+        if (cryptoResult.code() == Sailfish::Crypto::Result::Pending) {
+            return; // finished once the plugin completes the job.
+        }
         outParams << QVariant::fromValue<Sailfish::Crypto::Result>(cryptoResult);
     } else {
         outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
@@ -642,11 +1231,13 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::encrypt(
         Sailfish::Crypto::Key::BlockMode blockMode,
         Sailfish::Crypto::Key::EncryptionPadding padding,
         Sailfish::Crypto::Key::Digest digest,
-        const QString &cryptosystemProviderName,
+        const QString &requestedProviderName,
         QByteArray *encrypted)
 {
     // TODO: Access Control
 
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, key.algorithm(), Sailfish::Crypto::Key::Encrypt);
+
     Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
     if (cryptoPlugin == Q_NULLPTR) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
@@ -670,6 +1261,10 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::encrypt(
     Sailfish::Crypto::Key fullKey;
     if (key.publicKey().isEmpty() && key.privateKey().isEmpty() && key.secretKey().isEmpty()) { // can use public key to encrypt
         // the key is a key reference, attempt to read the full key from storage.
+        if (cachedStoredKey(callerPid, key.identifier(), &fullKey)) {
+            // read from storage by an earlier request of this application.
+            return encryptWithPlugin(cryptoPlugin, requestId, data, fullKey, blockMode, padding, digest, encrypted);
+        }
         Sailfish::Secrets::Result secretsResult(Sailfish::Secrets::Result::Succeeded);
         Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Succeeded);
         if (key.identifier().name().isEmpty()) {
@@ -701,25 +1296,29 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::encrypt(
             return retn;
         } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
             // asynchronous flow required, will call back to encrypt2().
+            Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation;
+            continuation->data = QByteArray(data.constData(), data.size()); // deep copy, as it may refer to a mapped memfd
+            continuation->blockMode = blockMode;
+            continuation->padding = padding;
+            continuation->digest = digest;
+            continuation->cryptoPluginName = cryptosystemProviderName;
+            continuation->identifier = key.identifier();
             m_pendingRequests.insert(requestId,
                                      Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                          callerPid,
                                          requestId,
                                          Sailfish::Crypto::Daemon::ApiImpl::EncryptRequest,
-                                         QVariantList() << QVariant::fromValue<QByteArray>(data)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
-                                                        << QVariant::fromValue<QString>(cryptosystemProviderName)));
+                                         continuation));
             return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
         }
 
+        cacheStoredKey(callerPid, key.identifier(), serialisedKey);
         fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
     } else {
         fullKey = key;
     }
 
-    return cryptoPlugin->encrypt(data, fullKey, blockMode, padding, digest, encrypted);
+    return encryptWithPlugin(cryptoPlugin, requestId, data, fullKey, blockMode, padding, digest, encrypted);
 }
 
 void
@@ -738,7 +1337,10 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::encrypt2(
     QByteArray encrypted;
     if (result.code() == Sailfish::Crypto::Result::Succeeded) {
         Sailfish::Crypto::Key fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
-        Sailfish::Crypto::Result cryptoResult = m_cryptoPlugins[cryptoPluginName]->encrypt(data, fullKey, blockMode, padding, digest, &encrypted);
+        Sailfish::Crypto::Result cryptoResult = encryptWithPlugin(m_cryptoPlugins[cryptoPluginName], requestId, data, fullKey, blockMode, padding, digest, &encrypted);
+        if (cryptoResult.code() == Sailfish::Crypto::Result::Pending) {
+            return; // finished once the plugin completes the job.
+        }
         outParams << QVariant::fromValue<Sailfish::Crypto::Result>(cryptoResult);
     } else {
         outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
@@ -756,11 +1358,13 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::decrypt(
         Sailfish::Crypto::Key::BlockMode blockMode,
         Sailfish::Crypto::Key::EncryptionPadding padding,
         Sailfish::Crypto::Key::Digest digest,
-        const QString &cryptosystemProviderName,
+        const QString &requestedProviderName,
         QByteArray *decrypted)
 {
     // TODO: Access Control
 
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, key.algorithm(), Sailfish::Crypto::Key::Decrypt);
+
     Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
     if (cryptoPlugin == Q_NULLPTR) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
@@ -784,6 +1388,10 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::decrypt(
     Sailfish::Crypto::Key fullKey;
     if (key.privateKey().isEmpty() && key.secretKey().isEmpty()) {
         // the key is a key reference, attempt to read the full key from storage.
+        if (cachedStoredKey(callerPid, key.identifier(), &fullKey)) {
+            // read from storage by an earlier request of this application.
+            return decryptWithPlugin(cryptoPlugin, requestId, data, fullKey, blockMode, padding, digest, decrypted);
+        }
         Sailfish::Secrets::Result secretsResult(Sailfish::Secrets::Result::Succeeded);
         Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Succeeded);
         if (key.identifier().name().isEmpty()) {
@@ -815,25 +1423,29 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::decrypt(
             return retn;
         } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
             // asynchronous flow required, will call back to decrypt2().
+            Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation;
+            continuation->data = QByteArray(data.constData(), data.size()); // deep copy, as it may refer to a mapped memfd
+            continuation->blockMode = blockMode;
+            continuation->padding = padding;
+            continuation->digest = digest;
+            continuation->cryptoPluginName = cryptosystemProviderName;
+            continuation->identifier = key.identifier();
             m_pendingRequests.insert(requestId,
                                      Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                          callerPid,
                                          requestId,
                                          Sailfish::Crypto::Daemon::ApiImpl::DecryptRequest,
-                                         QVariantList() << QVariant::fromValue<QByteArray>(data)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::BlockMode>(blockMode)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::EncryptionPadding>(padding)
-                                                        << QVariant::fromValue<Sailfish::Crypto::Key::Digest>(digest)
-                                                        << QVariant::fromValue<QString>(cryptosystemProviderName)));
+                                         continuation));
             return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
         }
 
+        cacheStoredKey(callerPid, key.identifier(), serialisedKey);
         fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
     } else {
         fullKey = key;
     }
 
-    return cryptoPlugin->decrypt(data, fullKey, blockMode, padding, digest, decrypted);
+    return decryptWithPlugin(cryptoPlugin, requestId, data, fullKey, blockMode, padding, digest, decrypted);
 }
 
 void
@@ -852,7 +1464,10 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::decrypt2(
     QByteArray decrypted;
     if (result.code() == Sailfish::Crypto::Result::Succeeded) {
         Sailfish::Crypto::Key fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
-        Sailfish::Crypto::Result cryptoResult = m_cryptoPlugins[cryptoPluginName]->decrypt(data, fullKey, blockMode, padding, digest, &decrypted);
+        Sailfish::Crypto::Result cryptoResult = decryptWithPlugin(m_cryptoPlugins[cryptoPluginName], requestId, data, fullKey, blockMode, padding, digest, &decrypted);
+        if (cryptoResult.code() == Sailfish::Crypto::Result::Pending) {
+            return; // finished once the plugin completes the job.
+        }
         outParams << QVariant::fromValue<Sailfish::Crypto::Result>(cryptoResult);
     } else {
         outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
@@ -861,85 +1476,714 @@ Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::decrypt2(
     m_requestQueue->requestFinished(requestId, outParams);
 }
 
-
-// asynchronous operation (retrieve stored key) has completed.
-void Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoredKeyCompleted(
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::signBatch(
+        pid_t callerPid,
         quint64 requestId,
-        const Sailfish::Secrets::Result &result,
-        const QByteArray &serialisedKey)
+        const QVector<QByteArray> &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &requestedProviderName,
+        QVector<QByteArray> *signatures)
 {
-    // look up the pending request in our list
-    if (m_pendingRequests.contains(requestId)) {
-        // transform the error code.
-        Sailfish::Crypto::Result returnResult;
-        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
-            returnResult.setCode(Sailfish::Crypto::Result::Succeeded);
-        } else {
-            returnResult.setCode(Sailfish::Crypto::Result::Failed);
-            returnResult.setErrorCode(Sailfish::Crypto::Result::StorageError);
-            returnResult.setStorageErrorCode(result.errorCode());
-            returnResult.setErrorMessage(result.errorMessage());
-        }
+    // TODO: Access Control
 
-        // call the appropriate method to complete the request
-        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest pr = m_pendingRequests.take(requestId);
-        switch (pr.requestType) {
-            case StoredKeyRequest: {
-                storedKey2(requestId, returnResult, serialisedKey);
-                break;
-            }
-            case SignRequest: {
-                QByteArray data = pr.parameters.takeFirst().value<QByteArray>();
-                Sailfish::Crypto::Key::SignaturePadding padding = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>();
-                Sailfish::Crypto::Key::Digest digest = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::Digest>();
-                QString cryptoPluginName = pr.parameters.takeFirst().value<QString>();
-                sign2(requestId, returnResult, serialisedKey, data, padding, digest, cryptoPluginName);
-                break;
-            }
-            case VerifyRequest: {
-                QByteArray data = pr.parameters.takeFirst().value<QByteArray>();
-                Sailfish::Crypto::Key::SignaturePadding padding = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::SignaturePadding>();
-                Sailfish::Crypto::Key::Digest digest = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::Digest>();
-                QString cryptoPluginName = pr.parameters.takeFirst().value<QString>();
-                verify2(requestId, returnResult, serialisedKey, data, padding, digest, cryptoPluginName);
-                break;
-            }
-            case EncryptRequest: {
-                QByteArray data = pr.parameters.takeFirst().value<QByteArray>();
-                Sailfish::Crypto::Key::BlockMode blockMode = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::BlockMode>();
-                Sailfish::Crypto::Key::EncryptionPadding padding = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>();
-                Sailfish::Crypto::Key::Digest digest = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::Digest>();
-                QString cryptoPluginName = pr.parameters.takeFirst().value<QString>();
-                encrypt2(requestId, returnResult, serialisedKey, data, blockMode, padding, digest, cryptoPluginName);
-                break;
-            }
-            case DecryptRequest: {
-                QByteArray data = pr.parameters.takeFirst().value<QByteArray>();
-                Sailfish::Crypto::Key::BlockMode blockMode = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::BlockMode>();
-                Sailfish::Crypto::Key::EncryptionPadding padding = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::EncryptionPadding>();
-                Sailfish::Crypto::Key::Digest digest = pr.parameters.takeFirst().value<Sailfish::Crypto::Key::Digest>();
-                QString cryptoPluginName = pr.parameters.takeFirst().value<QString>();
-                decrypt2(requestId, returnResult, serialisedKey, data, blockMode, padding, digest, cryptoPluginName);
-                break;
-            }
-            default: {
-                qCWarning(lcSailfishCryptoDaemon) << "Secrets completed storedKey() operation for request:" << requestId << "of invalid type:" << pr.requestType;
-                break;
-            }
-        }
-    } else {
-        qCWarning(lcSailfishCryptoDaemon) << "Secrets completed storedKey() operation for unknown request:" << requestId;
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, key.algorithm(), Sailfish::Crypto::Key::Sign);
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
     }
-}
 
-// asynchronous operation (store key) has completed.
-void Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoreKeyCompleted(
-        quint64 requestId,
-        const Sailfish::Secrets::Result &result)
-{
-    // look up the pending request in our list
-    if (m_pendingRequests.contains(requestId)) {
-        // transform the error code.
+    if (!(cryptoPlugin->supportedOperations().value(key.algorithm()) & Sailfish::Crypto::Key::Sign)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                        QLatin1String("The specified cryptographic service provider does not supported sign operations"));
+    } else if (!(cryptoPlugin->supportedSignaturePaddings().value(key.algorithm()) & padding)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedSignaturePadding,
+                                        QLatin1String("The specified cryptographic service provider does not supported that signature padding"));
+    } else if (!(cryptoPlugin->supportedDigests().value(key.algorithm()) & digest)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                        QLatin1String("The specified cryptographic service provider does not supported that digest"));
+    }
+
+    Sailfish::Crypto::Key fullKey = key;
+    if (key.privateKey().isEmpty() && key.secretKey().isEmpty()) {
+        // the key is a key reference, attempt to read the full key from storage.
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation;
+        continuation->data = data;
+        continuation->signaturePadding = padding;
+        continuation->digest = digest;
+        continuation->cryptoPluginName = cryptosystemProviderName;
+        Sailfish::Crypto::Result keyResult = batchStoredKey(callerPid, requestId, Sailfish::Crypto::Daemon::ApiImpl::SignBatchRequest, key, continuation, &fullKey);
+        if (keyResult.code() != Sailfish::Crypto::Result::Succeeded) {
+            return keyResult;
+        }
+    }
+
+    return performBatch(BatchOperation(cryptoPlugin, Sailfish::Crypto::Daemon::ApiImpl::SignBatchRequest, fullKey,
+                                       padding, Sailfish::Crypto::Key::BlockModeUnknown, Sailfish::Crypto::Key::EncryptionPaddingUnknown, digest),
+                        data, QVector<QByteArray>(), signatures, Q_NULLPTR);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::verifyBatch(
+        pid_t callerPid,
+        quint64 requestId,
+        const QVector<QByteArray> &data,
+        const QVector<QByteArray> &signatures,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &requestedProviderName,
+        QVector<bool> *verified)
+{
+    // TODO: Access Control
+
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, key.algorithm(), Sailfish::Crypto::Key::Verify);
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    if (!(cryptoPlugin->supportedOperations().value(key.algorithm()) & Sailfish::Crypto::Key::Verify)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                        QLatin1String("The specified cryptographic service provider does not supported verify operations"));
+    } else if (!(cryptoPlugin->supportedSignaturePaddings().value(key.algorithm()) & padding)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedSignaturePadding,
+                                        QLatin1String("The specified cryptographic service provider does not supported that signature padding"));
+    } else if (!(cryptoPlugin->supportedDigests().value(key.algorithm()) & digest)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                        QLatin1String("The specified cryptographic service provider does not supported that digest"));
+    }
+
+    Sailfish::Crypto::Key fullKey = key;
+    if (key.publicKey().isEmpty() && key.privateKey().isEmpty() && key.secretKey().isEmpty()) { // can use public key to verify
+        // the key is a key reference, attempt to read the full key from storage.
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation;
+        continuation->data = data;
+        continuation->signatures = signatures;
+        continuation->signaturePadding = padding;
+        continuation->digest = digest;
+        continuation->cryptoPluginName = cryptosystemProviderName;
+        Sailfish::Crypto::Result keyResult = batchStoredKey(callerPid, requestId, Sailfish::Crypto::Daemon::ApiImpl::VerifyBatchRequest, key, continuation, &fullKey);
+        if (keyResult.code() != Sailfish::Crypto::Result::Succeeded) {
+            return keyResult;
+        }
+    }
+
+    return performBatch(BatchOperation(cryptoPlugin, Sailfish::Crypto::Daemon::ApiImpl::VerifyBatchRequest, fullKey,
+                                       padding, Sailfish::Crypto::Key::BlockModeUnknown, Sailfish::Crypto::Key::EncryptionPaddingUnknown, digest),
+                        data, signatures, Q_NULLPTR, verified);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::encryptBatch(
+        pid_t callerPid,
+        quint64 requestId,
+        const QVector<QByteArray> &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &requestedProviderName,
+        QVector<QByteArray> *encrypted)
+{
+    // TODO: Access Control
+
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, key.algorithm(), Sailfish::Crypto::Key::Encrypt);
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    if (!(cryptoPlugin->supportedOperations().value(key.algorithm()) & Sailfish::Crypto::Key::Encrypt)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                        QLatin1String("The specified cryptographic service provider does not supported encrypt operations"));
+    } else if (!(cryptoPlugin->supportedBlockModes().value(key.algorithm()) & blockMode)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedBlockMode,
+                                        QLatin1String("The specified cryptographic service provider does not support that block mode"));
+    } else if (!(cryptoPlugin->supportedEncryptionPaddings().value(key.algorithm()) & padding)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedEncryptionPadding,
+                                        QLatin1String("The specified cryptographic service provider does not supported that encryption padding"));
+    } else if (!(cryptoPlugin->supportedDigests().value(key.algorithm()) & digest)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                        QLatin1String("The specified cryptographic service provider does not supported that digest"));
+    }
+
+    Sailfish::Crypto::Key fullKey = key;
+    if (key.publicKey().isEmpty() && key.privateKey().isEmpty() && key.secretKey().isEmpty()) { // can use public key to encrypt
+        // the key is a key reference, attempt to read the full key from storage.
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation;
+        continuation->data = data;
+        continuation->blockMode = blockMode;
+        continuation->encryptionPadding = padding;
+        continuation->digest = digest;
+        continuation->cryptoPluginName = cryptosystemProviderName;
+        Sailfish::Crypto::Result keyResult = batchStoredKey(callerPid, requestId, Sailfish::Crypto::Daemon::ApiImpl::EncryptBatchRequest, key, continuation, &fullKey);
+        if (keyResult.code() != Sailfish::Crypto::Result::Succeeded) {
+            return keyResult;
+        }
+    }
+
+    return performBatch(BatchOperation(cryptoPlugin, Sailfish::Crypto::Daemon::ApiImpl::EncryptBatchRequest, fullKey,
+                                       Sailfish::Crypto::Key::SignaturePaddingUnknown, blockMode, padding, digest),
+                        data, QVector<QByteArray>(), encrypted, Q_NULLPTR);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::batchStoredKey(
+        pid_t callerPid,
+        quint64 requestId,
+        Sailfish::Crypto::Daemon::ApiImpl::RequestType requestType,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation *continuation,
+        Sailfish::Crypto::Key *fullKey)
+{
+    if (cachedStoredKey(callerPid, key.identifier(), fullKey)) {
+        delete continuation;
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
+    if (key.identifier().name().isEmpty()) {
+        delete continuation;
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidKeyIdentifier,
+                                        QLatin1String("Reference key has empty name"));
+    }
+
+    QVector<Sailfish::Crypto::Key::Identifier> identifiers;
+    Sailfish::Secrets::Result secretsResult = m_secrets->keyEntryIdentifiers(callerPid, requestId, &identifiers);
+    if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
+        delete continuation;
+        Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Failed);
+        retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
+        retn.setStorageErrorCode(secretsResult.errorCode());
+        retn.setErrorMessage(secretsResult.errorMessage());
+        return retn;
+    } else if (!identifiers.contains(key.identifier())) {
+        delete continuation;
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidKeyIdentifier,
+                                        QLatin1String("Reference key identifier doesn't exist"));
+    }
+
+    QByteArray serialisedKey;
+    secretsResult = m_secrets->storedKey(callerPid, requestId, key.identifier(), &serialisedKey);
+    if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
+        delete continuation;
+        Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Failed);
+        retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
+        retn.setStorageErrorCode(secretsResult.errorCode());
+        retn.setErrorMessage(secretsResult.errorMessage());
+        return retn;
+    } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
+        // asynchronous flow required, will call back to batch2().
+        continuation->identifier = key.identifier();
+        m_pendingRequests.insert(requestId,
+                                 Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                     callerPid,
+                                     requestId,
+                                     requestType,
+                                     continuation));
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+    }
+
+    delete continuation;
+    cacheStoredKey(callerPid, key.identifier(), serialisedKey);
+    *fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::batch2(
+        quint64 requestId,
+        Sailfish::Crypto::Daemon::ApiImpl::RequestType requestType,
+        const Sailfish::Crypto::Result &result,
+        const QByteArray &serialisedKey,
+        const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation &continuation)
+{
+    // finish the request.
+    QList<QVariant> outParams;
+    QVector<QByteArray> outputs;
+    QVector<bool> verified;
+    if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+        Sailfish::Crypto::Key fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
+        Sailfish::Crypto::Result cryptoResult = performBatch(
+                    BatchOperation(m_cryptoPlugins[continuation.cryptoPluginName], requestType, fullKey,
+                                   continuation.signaturePadding, continuation.blockMode, continuation.encryptionPadding, continuation.digest),
+                    continuation.data, continuation.signatures, &outputs, &verified);
+        outParams << QVariant::fromValue<Sailfish::Crypto::Result>(cryptoResult);
+    } else {
+        outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
+    }
+    if (requestType == Sailfish::Crypto::Daemon::ApiImpl::VerifyBatchRequest) {
+        outParams << QVariant::fromValue<QVector<bool> >(verified);
+    } else {
+        outParams << QVariant::fromValue<QVector<QByteArray> >(outputs);
+    }
+    m_requestQueue->requestFinished(requestId, outParams);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::generateRandomData(
+        pid_t callerPid,
+        quint64 requestId,
+        quint64 numberBytes,
+        const QString &csprngEngineName,
+        const QString &cryptosystemProviderName,
+        QByteArray *randomData)
+{
+    Q_UNUSED(callerPid);
+    Q_UNUSED(requestId);
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    if (numberBytes > MaxRandomDataSize) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                        QString::fromLatin1("Cannot generate more than %1 bytes of random data in one request").arg(MaxRandomDataSize));
+    }
+
+    return cryptoPlugin->generateRandomData(csprngEngineName, numberBytes, randomData);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::generateDigest(
+        pid_t callerPid,
+        quint64 requestId,
+        const QByteArray &data,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &requestedProviderName,
+        QByteArray *digestValue)
+{
+    Q_UNUSED(callerPid);
+    Q_UNUSED(requestId);
+
+    // digests need no key, so plugins advertise them under the unknown algorithm.
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, Sailfish::Crypto::Key::AlgorithmUnknown, Sailfish::Crypto::Key::GenerateDigest);
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    if (!(cryptoPlugin->supportedOperations().value(Sailfish::Crypto::Key::AlgorithmUnknown) & Sailfish::Crypto::Key::GenerateDigest)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                        QLatin1String("The specified cryptographic service provider does not supported digest operations"));
+    } else if (!(cryptoPlugin->supportedDigests().value(Sailfish::Crypto::Key::AlgorithmUnknown) & digest)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                        QLatin1String("The specified cryptographic service provider does not supported that digest"));
+    }
+
+    return cryptoPlugin->generateDigest(data, digest, digestValue);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::calculateMac(
+        pid_t callerPid,
+        quint64 requestId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &requestedProviderName,
+        QByteArray *mac)
+{
+    // TODO: Access Control
+
+    const QString cryptosystemProviderName = resolveCryptosystemProvider(requestedProviderName, key.algorithm(), Sailfish::Crypto::Key::CalculateMac);
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    // the MAC digests are those which the plugin can generate without a key.
+    if (!(cryptoPlugin->supportedOperations().value(key.algorithm()) & Sailfish::Crypto::Key::CalculateMac)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                        QLatin1String("The specified cryptographic service provider does not supported MAC operations"));
+    } else if (!(cryptoPlugin->supportedDigests().value(Sailfish::Crypto::Key::AlgorithmUnknown) & digest)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                        QLatin1String("The specified cryptographic service provider does not supported that digest"));
+    }
+
+    Sailfish::Crypto::Key fullKey;
+    if (key.secretKey().isEmpty()) {
+        // the key is a key reference, attempt to read the full key from storage.
+        if (cachedStoredKey(callerPid, key.identifier(), &fullKey)) {
+            // read from storage by an earlier request of this application.
+            return cryptoPlugin->calculateMac(data, fullKey, digest, mac);
+        }
+        Sailfish::Secrets::Result secretsResult(Sailfish::Secrets::Result::Succeeded);
+        if (key.identifier().name().isEmpty()) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidKeyIdentifier,
+                                            QLatin1String("Reference key has empty name"));
+        } else {
+            QVector<Sailfish::Crypto::Key::Identifier> identifiers;
+            secretsResult = m_secrets->keyEntryIdentifiers(callerPid, requestId, &identifiers);
+            if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
+                Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Failed);
+                retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
+                retn.setStorageErrorCode(secretsResult.errorCode());
+                retn.setErrorMessage(secretsResult.errorMessage());
+                return retn;
+            }
+            if (!identifiers.contains(key.identifier())) {
+                return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidKeyIdentifier,
+                                                QLatin1String("Reference key identifier doesn't exist"));
+            }
+        }
+
+        QByteArray serialisedKey;
+        secretsResult = m_secrets->storedKey(callerPid, requestId, key.identifier(), &serialisedKey);
+        if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
+            Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Failed);
+            retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
+            retn.setStorageErrorCode(secretsResult.errorCode());
+            retn.setErrorMessage(secretsResult.errorMessage());
+            return retn;
+        } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
+            // asynchronous flow required, will call back to calculateMac2().
+            Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation;
+            continuation->data = data;
+            continuation->digest = digest;
+            continuation->cryptoPluginName = cryptosystemProviderName;
+            continuation->identifier = key.identifier();
+            m_pendingRequests.insert(requestId,
+                                     Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                         callerPid,
+                                         requestId,
+                                         Sailfish::Crypto::Daemon::ApiImpl::CalculateMacRequest,
+                                         continuation));
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+        }
+
+        cacheStoredKey(callerPid, key.identifier(), serialisedKey);
+        fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
+    } else {
+        fullKey = key;
+    }
+
+    return cryptoPlugin->calculateMac(data, fullKey, digest, mac);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::calculateMac2(
+        quint64 requestId,
+        const Sailfish::Crypto::Result &result,
+        const QByteArray &serialisedKey,
+        const QByteArray &data,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptoPluginName)
+{
+    // finish the request.
+    QList<QVariant> outParams;
+    QByteArray mac;
+    if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+        Sailfish::Crypto::Key fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
+        Sailfish::Crypto::Result cryptoResult = m_cryptoPlugins[cryptoPluginName]->calculateMac(data, fullKey, digest, &mac);
+        outParams << QVariant::fromValue<Sailfish::Crypto::Result>(cryptoResult);
+    } else {
+        outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
+    }
+    outParams << QVariant::fromValue<QByteArray>(mac);
+    m_requestQueue->requestFinished(requestId, outParams);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::initialiseCipherSession(
+        pid_t callerPid,
+        quint64 requestId,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Operation operation,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptosystemProviderName,
+        quint32 *cipherSessionToken)
+{
+    // TODO: Access Control
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    if (operation == Sailfish::Crypto::Key::GenerateDigest || operation == Sailfish::Crypto::Key::CalculateMac) {
+        // digest and MAC sessions have no block mode or padding, and a digest session no key.
+        const Sailfish::Crypto::Key::Algorithm algorithm = operation == Sailfish::Crypto::Key::GenerateDigest
+                ? Sailfish::Crypto::Key::AlgorithmUnknown
+                : key.algorithm();
+        if (!(cryptoPlugin->supportedOperations().value(algorithm) & operation)) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                            QLatin1String("The specified cryptographic service provider does not supported that operation"));
+        } else if (!(cryptoPlugin->supportedDigests().value(Sailfish::Crypto::Key::AlgorithmUnknown) & digest)) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                            QLatin1String("The specified cryptographic service provider does not supported that digest"));
+        } else if (operation == Sailfish::Crypto::Key::GenerateDigest) {
+            return cryptoPlugin->initialiseCipherSession(callerPid, Sailfish::Crypto::Key(), operation, blockMode, padding, digest, cipherSessionToken);
+        }
+    } else if (operation != Sailfish::Crypto::Key::Encrypt && operation != Sailfish::Crypto::Key::Decrypt) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                        QLatin1String("Cipher sessions support only encrypt, decrypt, digest and MAC operations"));
+    } else if (!(cryptoPlugin->supportedOperations().value(key.algorithm()) & operation)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                        QLatin1String("The specified cryptographic service provider does not supported that operation"));
+    } else if (!(cryptoPlugin->supportedBlockModes().value(key.algorithm()) & blockMode)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedBlockMode,
+                                        QLatin1String("The specified cryptographic service provider does not support that block mode"));
+    } else if (!(cryptoPlugin->supportedEncryptionPaddings().value(key.algorithm()) & padding)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedEncryptionPadding,
+                                        QLatin1String("The specified cryptographic service provider does not supported that encryption padding"));
+    } else if (!(cryptoPlugin->supportedDigests().value(key.algorithm()) & digest)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                        QLatin1String("The specified cryptographic service provider does not supported that digest"));
+    }
+
+    // a public key is only sufficient for encryption.
+    const bool keyReference = key.privateKey().isEmpty() && key.secretKey().isEmpty()
+            && (operation != Sailfish::Crypto::Key::Encrypt || key.publicKey().isEmpty());
+    Sailfish::Crypto::Key fullKey;
+    if (keyReference) {
+        // the key is a key reference, attempt to read the full key from storage.
+        // it is read once here, and then kept by the plugin for the lifetime of the session.
+        if (cachedStoredKey(callerPid, key.identifier(), &fullKey)) {
+            // read from storage by an earlier request of this application.
+            return cryptoPlugin->initialiseCipherSession(callerPid, fullKey, operation, blockMode, padding, digest, cipherSessionToken);
+        }
+        Sailfish::Secrets::Result secretsResult(Sailfish::Secrets::Result::Succeeded);
+        Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Succeeded);
+        if (key.identifier().name().isEmpty()) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidKeyIdentifier,
+                                            QLatin1String("Reference key has empty name"));
+        } else {
+            QVector<Sailfish::Crypto::Key::Identifier> identifiers;
+            secretsResult = m_secrets->keyEntryIdentifiers(callerPid, requestId, &identifiers);
+            if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
+                retn.setCode(Sailfish::Crypto::Result::Failed);
+                retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
+                retn.setStorageErrorCode(secretsResult.errorCode());
+                retn.setErrorMessage(secretsResult.errorMessage());
+                return retn;
+            }
+            if (!identifiers.contains(key.identifier())) {
+                return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidKeyIdentifier,
+                                                QLatin1String("Reference key identifier doesn't exist"));
+            }
+        }
+
+        QByteArray serialisedKey;
+        secretsResult = m_secrets->storedKey(callerPid, requestId, key.identifier(), &serialisedKey);
+        if (secretsResult.code() == Sailfish::Secrets::Result::Failed) {
+            Sailfish::Crypto::Result retn(Sailfish::Crypto::Result::Failed);
+            retn.setErrorCode(Sailfish::Crypto::Result::StorageError);
+            retn.setStorageErrorCode(secretsResult.errorCode());
+            retn.setErrorMessage(secretsResult.errorMessage());
+            return retn;
+        } else if (secretsResult.code() == Sailfish::Secrets::Result::Pending) {
+            // asynchronous flow required, will call back to initialiseCipherSession2().
+            Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation *continuation = new Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation;
+            continuation->operation = operation;
+            continuation->blockMode = blockMode;
+            continuation->padding = padding;
+            continuation->digest = digest;
+            continuation->cryptoPluginName = cryptosystemProviderName;
+            continuation->identifier = key.identifier();
+            m_pendingRequests.insert(requestId,
+                                     Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                         callerPid,
+                                         requestId,
+                                         Sailfish::Crypto::Daemon::ApiImpl::InitialiseCipherSessionRequest,
+                                         continuation));
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+        }
+
+        cacheStoredKey(callerPid, key.identifier(), serialisedKey);
+        fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
+    } else {
+        fullKey = key;
+    }
+
+    return cryptoPlugin->initialiseCipherSession(callerPid, fullKey, operation, blockMode, padding, digest, cipherSessionToken);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::initialiseCipherSession2(
+        pid_t callerPid,
+        quint64 requestId,
+        const Sailfish::Crypto::Result &result,
+        const QByteArray &serialisedKey,
+        Sailfish::Crypto::Key::Operation operation,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        const QString &cryptoPluginName)
+{
+    // finish the request.
+    QList<QVariant> outParams;
+    quint32 cipherSessionToken = 0;
+    if (result.code() == Sailfish::Crypto::Result::Succeeded) {
+        Sailfish::Crypto::Key fullKey = Sailfish::Crypto::Key::deserialise(serialisedKey);
+        Sailfish::Crypto::Result cryptoResult = m_cryptoPlugins[cryptoPluginName]->initialiseCipherSession(
+                    callerPid, fullKey, operation, blockMode, padding, digest, &cipherSessionToken);
+        outParams << QVariant::fromValue<Sailfish::Crypto::Result>(cryptoResult);
+    } else {
+        outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
+    }
+    outParams << QVariant::fromValue<quint32>(cipherSessionToken);
+    m_requestQueue->requestFinished(requestId, outParams);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::updateCipherSession(
+        pid_t callerPid,
+        quint64 requestId,
+        const QByteArray &data,
+        quint32 cipherSessionToken,
+        const QString &cryptosystemProviderName,
+        QByteArray *generatedData)
+{
+    Q_UNUSED(requestId);
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    // sessions are keyed by caller, so a client cannot use another client's session.
+    return cryptoPlugin->updateCipherSession(callerPid, data, cipherSessionToken, generatedData);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::finaliseCipherSession(
+        pid_t callerPid,
+        quint64 requestId,
+        quint32 cipherSessionToken,
+        const QString &cryptosystemProviderName,
+        QByteArray *generatedData)
+{
+    Q_UNUSED(requestId);
+
+    Sailfish::Crypto::CryptoPlugin* cryptoPlugin = m_cryptoPlugins.value(cryptosystemProviderName);
+    if (cryptoPlugin == Q_NULLPTR) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::InvalidCryptographicServiceProvider,
+                                        QLatin1String("No such cryptographic service provider plugin exists"));
+    }
+
+    return cryptoPlugin->finaliseCipherSession(callerPid, cipherSessionToken, generatedData);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::closeCipherSessions(pid_t callerPid)
+{
+    Q_FOREACH (Sailfish::Crypto::CryptoPlugin *cryptoPlugin, m_cryptoPlugins.loaded()) {
+        cryptoPlugin->closeCipherSessions(callerPid);
+    }
+}
+
+// asynchronous operation (retrieve stored key) has completed.
+void Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoredKeyCompleted(
+        quint64 requestId,
+        const Sailfish::Secrets::Result &result,
+        const QByteArray &serialisedKey)
+{
+    // look up the pending request in our list
+    if (m_pendingRequests.contains(requestId)) {
+        // transform the error code.
+        Sailfish::Crypto::Result returnResult;
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            returnResult.setCode(Sailfish::Crypto::Result::Succeeded);
+        } else {
+            returnResult.setCode(Sailfish::Crypto::Result::Failed);
+            returnResult.setErrorCode(Sailfish::Crypto::Result::StorageError);
+            returnResult.setStorageErrorCode(result.errorCode());
+            returnResult.setErrorMessage(result.errorMessage());
+        }
+
+        // call the appropriate method to complete the request
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest pr = m_pendingRequests.take(requestId);
+        const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation *storedKeyContinuation
+                = dynamic_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation*>(pr.continuation.data());
+        if (storedKeyContinuation && returnResult.code() == Sailfish::Crypto::Result::Succeeded) {
+            cacheStoredKey(pr.callerPid, storedKeyContinuation->identifier, serialisedKey);
+        }
+        switch (pr.requestType) {
+            case StoredKeyRequest: {
+                storedKey2(requestId, returnResult, serialisedKey);
+                break;
+            }
+            case SignRequest: {
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation*>(pr.continuation.data());
+                sign2(requestId, returnResult, serialisedKey, continuation->data, continuation->padding, continuation->digest, continuation->cryptoPluginName);
+                break;
+            }
+            case VerifyRequest: {
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation*>(pr.continuation.data());
+                verify2(requestId, returnResult, serialisedKey, continuation->data, continuation->signature, continuation->padding, continuation->digest, continuation->cryptoPluginName);
+                break;
+            }
+            case EncryptRequest: {
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation*>(pr.continuation.data());
+                encrypt2(requestId, returnResult, serialisedKey, continuation->data, continuation->blockMode, continuation->padding, continuation->digest, continuation->cryptoPluginName);
+                break;
+            }
+            case DecryptRequest: {
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation*>(pr.continuation.data());
+                decrypt2(requestId, returnResult, serialisedKey, continuation->data, continuation->blockMode, continuation->padding, continuation->digest, continuation->cryptoPluginName);
+                break;
+            }
+            case CalculateMacRequest: {
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::SignatureContinuation*>(pr.continuation.data());
+                calculateMac2(requestId, returnResult, serialisedKey, continuation->data, continuation->digest, continuation->cryptoPluginName);
+                break;
+            }
+            case SignBatchRequest:
+            case VerifyBatchRequest:
+            case EncryptBatchRequest: {
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation*>(pr.continuation.data());
+                batch2(requestId, pr.requestType, returnResult, serialisedKey, *continuation);
+                break;
+            }
+            case InitialiseCipherSessionRequest: {
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CipherContinuation*>(pr.continuation.data());
+                initialiseCipherSession2(pr.callerPid, requestId, returnResult, serialisedKey, continuation->operation, continuation->blockMode, continuation->padding, continuation->digest, continuation->cryptoPluginName);
+                break;
+            }
+            default: {
+                qCWarning(lcSailfishCryptoDaemon) << "Secrets completed storedKey() operation for request:" << requestId << "of invalid type:" << pr.requestType;
+                break;
+            }
+        }
+    } else {
+        qCWarning(lcSailfishCryptoDaemon) << "Secrets completed storedKey() operation for unknown request:" << requestId;
+    }
+}
+
+// asynchronous operation (store key) has completed.
+void Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoreKeyCompleted(
+        quint64 requestId,
+        const Sailfish::Secrets::Result &result)
+{
+    // look up the pending request in our list
+    if (m_pendingRequests.contains(requestId)) {
+        // transform the error code.
         Sailfish::Crypto::Result returnResult;
         if (result.code() == Sailfish::Secrets::Result::Succeeded) {
             returnResult.setCode(Sailfish::Crypto::Result::Succeeded);
@@ -952,10 +2196,16 @@ void Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoreKeyComplet
 
         // call the appropriate method to complete the request
         Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest pr = m_pendingRequests.take(requestId);
+        const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation *storedKeyContinuation
+                = dynamic_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation*>(pr.continuation.data());
+        if (storedKeyContinuation && returnResult.code() == Sailfish::Crypto::Result::Succeeded) {
+            cacheStoredKey(pr.callerPid, storedKeyContinuation->identifier, serialisedKey);
+        }
         switch (pr.requestType) {
             case GenerateStoredKeyRequest: {
-                Sailfish::Crypto::Key fullKey = pr.parameters.takeFirst().value<Sailfish::Crypto::Key>();
-                generateStoredKey2(requestId, returnResult, fullKey);
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyContinuation*>(pr.continuation.data());
+                generateStoredKey2(requestId, returnResult, continuation->key);
                 break;
             }
             default: {
@@ -988,12 +2238,16 @@ void Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsDeleteStoredKey
 
         // call the appropriate method to complete the request
         Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest pr = m_pendingRequests.take(requestId);
+        const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation *storedKeyContinuation
+                = dynamic_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation*>(pr.continuation.data());
+        if (storedKeyContinuation && returnResult.code() == Sailfish::Crypto::Result::Succeeded) {
+            cacheStoredKey(pr.callerPid, storedKeyContinuation->identifier, serialisedKey);
+        }
         switch (pr.requestType) {
             case DeleteStoredKeyRequest: {
-                Sailfish::Crypto::Key::Identifier identifier = pr.parameters.size()
-                        ? pr.parameters.first().value<Sailfish::Crypto::Key::Identifier>()
-                        : Sailfish::Crypto::Key::Identifier();
-                deleteStoredKey2(pr.callerPid, requestId, returnResult, identifier);
+                const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyIdentifierContinuation *continuation
+                        = static_cast<const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::KeyIdentifierContinuation*>(pr.continuation.data());
+                deleteStoredKey2(pr.callerPid, requestId, returnResult, continuation->identifier);
                 break;
             }
             default: {
@@ -1005,3 +2259,399 @@ void Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsDeleteStoredKey
         qCWarning(lcSailfishCryptoDaemon) << "Secrets completed deleteStoredKey() operation for unknown request:" << requestId;
     }
 }
+
+void Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::secretsStoredKeysInvalidated(
+        const QString &collectionName,
+        const QString &keyName)
+{
+    QMap<QPair<QString, Sailfish::Crypto::Key::Identifier>, Sailfish::Crypto::Key>::iterator it = m_storedKeyCache.begin();
+    while (it != m_storedKeyCache.end()) {
+        const Sailfish::Crypto::Key::Identifier &identifier(it.key().second);
+        if ((collectionName.isEmpty() || identifier.collectionName() == collectionName)
+                && (keyName.isEmpty() || identifier.name() == keyName)) {
+            accountCachedStoredKey(it.key().first, it.value(), -1);
+            it = m_storedKeyCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::cachedStoredKey(
+        pid_t callerPid,
+        const Sailfish::Crypto::Key::Identifier &identifier,
+        Sailfish::Crypto::Key *key) const
+{
+    if (m_storedKeyCache.isEmpty()) {
+        return false;
+    }
+
+    // the secrets daemon checked that the application may read the key when it was cached.
+    const QString applicationId = m_secrets->applicationId(callerPid);
+    QMap<QPair<QString, Sailfish::Crypto::Key::Identifier>, Sailfish::Crypto::Key>::const_iterator it
+            = m_storedKeyCache.constFind(qMakePair(applicationId, identifier));
+    if (applicationId.isEmpty() || it == m_storedKeyCache.constEnd()) {
+        return false;
+    }
+    *key = it.value();
+    return true;
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::cacheStoredKey(
+        pid_t callerPid,
+        const Sailfish::Crypto::Key::Identifier &identifier,
+        const QByteArray &serialisedKey)
+{
+    const QString applicationId = m_secrets->applicationId(callerPid);
+    if (applicationId.isEmpty() || identifier.name().isEmpty()) {
+        return;
+    }
+
+    const QPair<QString, Sailfish::Crypto::Key::Identifier> cacheKey = qMakePair(applicationId, identifier);
+    QMap<QPair<QString, Sailfish::Crypto::Key::Identifier>, Sailfish::Crypto::Key>::iterator it = m_storedKeyCache.find(cacheKey);
+    if (it != m_storedKeyCache.end()) {
+        accountCachedStoredKey(applicationId, it.value(), -1);
+        m_storedKeyCache.erase(it);
+    } else if (m_storedKeyCache.size() >= MaxCachedStoredKeys) {
+        accountCachedStoredKey(m_storedKeyCache.begin().key().first, m_storedKeyCache.begin().value(), -1);
+        m_storedKeyCache.erase(m_storedKeyCache.begin());
+    }
+
+    const Sailfish::Crypto::Key key = Sailfish::Crypto::Key::deserialise(serialisedKey);
+    if (!Sailfish::Secrets::Daemon::ApplicationAccounting::instance()->mayCache(applicationId, cachedStoredKeySize(key))) {
+        return;
+    }
+    m_storedKeyCache.insert(cacheKey, key);
+    accountCachedStoredKey(applicationId, key, 1);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::memoryUsage(QMap<QString, qint64> *usage) const
+{
+    qint64 storedKeyBytes = 0;
+    for (QMap<QPair<QString, Sailfish::Crypto::Key::Identifier>, Sailfish::Crypto::Key>::const_iterator it = m_storedKeyCache.constBegin();
+            it != m_storedKeyCache.constEnd(); ++it) {
+        storedKeyBytes += cachedStoredKeySize(it.value());
+    }
+    usage->insert(QStringLiteral("storedKeyCache"), storedKeyBytes);
+
+    m_certificateChainCacheMutex.lock();
+    qint64 certificateChainBytes = 0;
+    for (QMap<QByteArray, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CertificateChainValidation>::const_iterator it
+                = m_certificateChainCache.constBegin(); it != m_certificateChainCache.constEnd(); ++it) {
+        certificateChainBytes += it.key().size() + sizeof(Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CertificateChainValidation);
+    }
+    m_certificateChainCacheMutex.unlock();
+    usage->insert(QStringLiteral("certificateChainCache"), certificateChainBytes);
+
+    usage->insert(QStringLiteral("keyPool"), m_keyPool.pooledKeyBytes());
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::releaseMemory()
+{
+    for (QMap<QPair<QString, Sailfish::Crypto::Key::Identifier>, Sailfish::Crypto::Key>::const_iterator it = m_storedKeyCache.constBegin();
+            it != m_storedKeyCache.constEnd(); ++it) {
+        accountCachedStoredKey(it.key().first, it.value(), -1);
+    }
+    m_storedKeyCache.clear();
+    QMutexLocker locker(&m_certificateChainCacheMutex);
+    m_certificateChainCache.clear();
+}
+
+bool
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::cachedCertificateChainValidation(
+        const QByteArray &fingerprint,
+        bool *valid) const
+{
+    QMutexLocker locker(&m_certificateChainCacheMutex);
+    QMap<QByteArray, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CertificateChainValidation>::const_iterator it
+            = m_certificateChainCache.constFind(fingerprint);
+    if (it == m_certificateChainCache.constEnd() || it->expiry <= QDateTime::currentDateTimeUtc()) {
+        return false;
+    }
+    *valid = it->valid;
+    return true;
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::cacheCertificateChainValidation(
+        const QByteArray &fingerprint,
+        const QVector<Sailfish::Crypto::Certificate> &chain,
+        bool valid)
+{
+    // the outcome can change once any certificate in the chain becomes valid or expires.
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QDateTime expiry = now.addSecs(CertificateChainCacheLifetimeSecs);
+    Q_FOREACH (const Sailfish::Crypto::Certificate &certificate, chain) {
+        if (certificate.type() != Sailfish::Crypto::Certificate::X509) {
+            continue;
+        }
+        const Sailfish::Crypto::X509Certificate::TbsCertificate::Validity validity
+                = Sailfish::Crypto::X509Certificate::fromCertificate(certificate).tbsCertificate().validity;
+        if (validity.notBefore.isValid() && validity.notBefore > now && validity.notBefore < expiry) {
+            expiry = validity.notBefore;
+        }
+        if (validity.notAfter.isValid() && validity.notAfter < expiry) {
+            expiry = validity.notAfter;
+        }
+    }
+    if (expiry <= now) {
+        return;
+    }
+
+    QMutexLocker locker(&m_certificateChainCacheMutex);
+    if (!m_certificateChainCache.contains(fingerprint) && m_certificateChainCache.size() >= MaxCachedCertificateChains) {
+        // discard the expired outcomes, or failing that, an arbitrary one.
+        QMap<QByteArray, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CertificateChainValidation>::iterator it
+                = m_certificateChainCache.begin();
+        while (it != m_certificateChainCache.end()) {
+            it = it->expiry <= now ? m_certificateChainCache.erase(it) : it + 1;
+        }
+        if (m_certificateChainCache.size() >= MaxCachedCertificateChains) {
+            m_certificateChainCache.erase(m_certificateChainCache.begin());
+        }
+    }
+    m_certificateChainCache.insert(fingerprint,
+                                   Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CertificateChainValidation(valid, expiry));
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::signWithPlugin(
+        Sailfish::Crypto::CryptoPlugin *plugin,
+        quint64 requestId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *signature)
+{
+    Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob job(requestId, Sailfish::Crypto::Key::Sign, data, key);
+    job.signaturePadding = padding;
+    job.digest = digest;
+    return performPluginJob(plugin, job, signature, Q_NULLPTR);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::verifyWithPlugin(
+        Sailfish::Crypto::CryptoPlugin *plugin,
+        quint64 requestId,
+        const QByteArray &data,
+        const QByteArray &signature,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::SignaturePadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        bool *verified)
+{
+    Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob job(requestId, Sailfish::Crypto::Key::Verify, data, key);
+    job.signature = signature;
+    job.signaturePadding = padding;
+    job.digest = digest;
+    return performPluginJob(plugin, job, Q_NULLPTR, verified);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::encryptWithPlugin(
+        Sailfish::Crypto::CryptoPlugin *plugin,
+        quint64 requestId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *encrypted)
+{
+    Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob job(requestId, Sailfish::Crypto::Key::Encrypt, data, key);
+    job.blockMode = blockMode;
+    job.encryptionPadding = padding;
+    job.digest = digest;
+    return performPluginJob(plugin, job, encrypted, Q_NULLPTR);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::decryptWithPlugin(
+        Sailfish::Crypto::CryptoPlugin *plugin,
+        quint64 requestId,
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *decrypted)
+{
+    Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob job(requestId, Sailfish::Crypto::Key::Decrypt, data, key);
+    job.blockMode = blockMode;
+    job.encryptionPadding = padding;
+    job.digest = digest;
+    return performPluginJob(plugin, job, decrypted, Q_NULLPTR);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::performPluginJob(
+        Sailfish::Crypto::CryptoPlugin *plugin,
+        const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob &job,
+        QByteArray *output,
+        bool *verified)
+{
+    // the job queues are only accessed from the main thread.
+    if (plugin->supportsAsynchronousOperations() && QThread::currentThread() == thread()) {
+        // the data may refer to a client's memfd, which is unmapped once the request is handled.
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob queuedJob(job);
+        queuedJob.data = QByteArray(job.data.constData(), job.data.size());
+
+        Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJobQueue &queue(m_pluginJobQueues[plugin->name()]);
+        if (!queue.waiting.isEmpty() || queue.submitted >= pluginJobQueueDepth(plugin)) {
+            queue.waiting.append(queuedJob);
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+        }
+
+        const Sailfish::Crypto::Result result = beginPluginJob(plugin, queuedJob);
+        if (result.code() == Sailfish::Crypto::Result::Failed) {
+            return result;
+        }
+        queue.submitted++;
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Pending);
+    }
+
+    SAILFISH_SECRETS_TRACE_SPAN("plugin.crypto.operation");
+    switch (job.operation) {
+        case Sailfish::Crypto::Key::Sign:
+            return plugin->sign(job.data, job.key, job.signaturePadding, job.digest, output);
+        case Sailfish::Crypto::Key::Verify:
+            return plugin->verify(job.data, job.signature, job.key, job.signaturePadding, job.digest, verified);
+        case Sailfish::Crypto::Key::Encrypt:
+            return plugin->encrypt(job.data, job.key, job.blockMode, job.encryptionPadding, job.digest, output);
+        default:
+            return plugin->decrypt(job.data, job.key, job.blockMode, job.encryptionPadding, job.digest, output);
+    }
+}
+
+int
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginJobQueueDepth(
+        Sailfish::Crypto::CryptoPlugin *plugin) const
+{
+    const int depth = qMax(plugin->maximumPendingOperations(), 1);
+    return m_pluginJobQueueDepth > 0 ? qMin(depth, m_pluginJobQueueDepth) : depth;
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::beginPluginJob(
+        Sailfish::Crypto::CryptoPlugin *plugin,
+        const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob &job)
+{
+    Sailfish::Crypto::Result result;
+    m_submittedPluginJobs.insert(job.requestId, job.operation);
+    switch (job.operation) {
+        case Sailfish::Crypto::Key::Sign:
+            result = plugin->beginSign(job.requestId, job.data, job.key, job.signaturePadding, job.digest);
+            break;
+        case Sailfish::Crypto::Key::Verify:
+            result = plugin->beginVerify(job.requestId, job.data, job.signature, job.key, job.signaturePadding, job.digest);
+            break;
+        case Sailfish::Crypto::Key::Encrypt:
+            result = plugin->beginEncrypt(job.requestId, job.data, job.key, job.blockMode, job.encryptionPadding, job.digest);
+            break;
+        default:
+            result = plugin->beginDecrypt(job.requestId, job.data, job.key, job.blockMode, job.encryptionPadding, job.digest);
+            break;
+    }
+    if (result.code() == Sailfish::Crypto::Result::Failed) {
+        m_submittedPluginJobs.remove(job.requestId);
+    }
+    return result;
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::submitPluginJobs(
+        Sailfish::Crypto::CryptoPlugin *plugin)
+{
+    Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJobQueue &queue(m_pluginJobQueues[plugin->name()]);
+    while (!queue.waiting.isEmpty() && queue.submitted < pluginJobQueueDepth(plugin)) {
+        const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob job = queue.waiting.takeFirst();
+        const Sailfish::Crypto::Result result = beginPluginJob(plugin, job);
+        if (result.code() == Sailfish::Crypto::Result::Failed) {
+            // the request is already pending, so is finished with the error.
+            QList<QVariant> outParams;
+            outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
+            if (job.operation == Sailfish::Crypto::Key::Verify) {
+                outParams << QVariant::fromValue<bool>(false);
+            } else {
+                outParams << QVariant::fromValue<QByteArray>(QByteArray());
+            }
+            m_requestQueue->requestFinished(job.requestId, outParams);
+        } else {
+            queue.submitted++;
+        }
+    }
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::finishPluginJob(
+        QObject *plugin,
+        quint64 operationId,
+        const Sailfish::Crypto::Result &result,
+        const QByteArray &output,
+        bool verified)
+{
+    Sailfish::Crypto::CryptoPlugin *cryptoPlugin = qobject_cast<Sailfish::Crypto::CryptoPlugin*>(plugin);
+    if (!cryptoPlugin) {
+        return;
+    }
+
+    Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJobQueue &queue(m_pluginJobQueues[cryptoPlugin->name()]);
+    if (queue.submitted > 0) {
+        queue.submitted--;
+    }
+
+    // jobs of cancelled requests are no longer in the submitted jobs.
+    if (m_submittedPluginJobs.contains(operationId)) {
+        QList<QVariant> outParams;
+        outParams << QVariant::fromValue<Sailfish::Crypto::Result>(result);
+        if (m_submittedPluginJobs.take(operationId) == Sailfish::Crypto::Key::Verify) {
+            outParams << QVariant::fromValue<bool>(verified);
+        } else {
+            outParams << QVariant::fromValue<QByteArray>(output);
+        }
+        m_requestQueue->requestFinished(operationId, outParams);
+    }
+
+    submitPluginJobs(cryptoPlugin);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginSignCompleted(
+        quint64 operationId,
+        const Sailfish::Crypto::Result &result,
+        const QByteArray &signature)
+{
+    finishPluginJob(sender(), operationId, result, signature, false);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginVerifyCompleted(
+        quint64 operationId,
+        const Sailfish::Crypto::Result &result,
+        bool verified)
+{
+    finishPluginJob(sender(), operationId, result, QByteArray(), verified);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginEncryptCompleted(
+        quint64 operationId,
+        const Sailfish::Crypto::Result &result,
+        const QByteArray &encrypted)
+{
+    finishPluginJob(sender(), operationId, result, encrypted, false);
+}
+
+void
+Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::pluginDecryptCompleted(
+        quint64 operationId,
+        const Sailfish::Crypto::Result &result,
+        const QByteArray &decrypted)
+{
+    finishPluginJob(sender(), operationId, result, decrypted, false);
+}
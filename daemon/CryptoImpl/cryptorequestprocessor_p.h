@@ -11,11 +11,15 @@
 #include <QtCore/QObject>
 #include <QtCore/QVariantList>
 #include <QtCore/QList>
+#include <QtCore/QVector>
 #include <QtCore/QVariant>
 #include <QtCore/QByteArray>
 #include <QtCore/QString>
 #include <QtCore/QDateTime>
 #include <QtCore/QMap>
+#include <QtCore/QPair>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QMutex>
 
 #include <sys/types.h>
 
@@ -26,8 +30,10 @@
 #include "Crypto/extensionplugins.h"
 
 #include "CryptoImpl/crypto_p.h"
+#include "CryptoImpl/cryptokeypool_p.h"
 
 #include "requestqueue_p.h"
+#include "pluginregistry_p.h"
 
 namespace Sailfish {
 
@@ -60,12 +66,47 @@ public:
 
     bool loadPlugins(const QString &pluginDir, bool autotestMode);
 
+    // see KeyPool::configure().
+    void setKeyPool(const QString &specification) { m_keyPool.configure(specification); }
+
+    // Parses a comma-separated list of "<plugin name>[:<processes>]" entries.  The named
+    // plugins are loaded by that many host processes (one by default) instead of by the
+    // daemon.  See RemoteCryptoPlugin.  Must be called from the main thread, before the
+    // plugins are first used, as their hosts are started at once.
+    void setPluginHosts(const QString &specification);
+    // The statistics of the host processes of each hosted plugin, by plugin name.
+    QVariantMap pluginHostStatistics() const;
+
+    // discard the state of a cancelled asynchronous request, so that its completion is ignored.
+    void cancelPendingRequest(quint64 requestId);
+
+    // The number of jobs submitted to each plugin which supports asynchronous
+    // operations at once, at most the plugin's own maximum.  Zero means the plugin's maximum.
+    void setPluginJobQueueDepth(int depth) { m_pluginJobQueueDepth = depth; }
+
+    // Adds the bytes held by the stored key and certificate chain caches and the key pool to usage.
+    void memoryUsage(QMap<QString, qint64> *usage) const;
+    // Discards the cached stored keys and certificate chain outcomes.  The pooled
+    // keys are kept, as they are expensive to generate and bounded by the pool size.
+    void releaseMemory();
+
+    // Whether the operation is submitted to the plugin's job queue, so must be
+    // handled on the main thread.  May be called from any thread.
+    bool providerIsAsynchronous(
+            const QString &cryptosystemProviderName,
+            Sailfish::Crypto::Key::Algorithm algorithm,
+            Sailfish::Crypto::Key::Operation operation) const;
+
     Sailfish::Crypto::Result getPluginInfo(
             pid_t callerPid,
             quint64 requestId,
             QVector<Sailfish::Crypto::CryptoPluginInfo> *cryptoPlugins,
             QStringList *storagePlugins);
 
+    // changes whenever the result of getPluginInfo() would, i.e. when crypto
+    // or storage plugins are installed.
+    quint64 pluginInfoGeneration() const;
+
     Sailfish::Crypto::Result validateCertificateChain(
             pid_t callerPid,
             quint64 requestId,
@@ -73,6 +114,13 @@ public:
             const QString &cryptosystemProviderName,
             bool *valid);
 
+    Sailfish::Crypto::Result validateCertificateChains(
+            pid_t callerPid,
+            quint64 requestId,
+            const QVector<QVector<Sailfish::Crypto::Certificate> > &chains,
+            const QString &cryptosystemProviderName,
+            QVector<bool> *valid);
+
     Sailfish::Crypto::Result generateKey(
             pid_t callerPid,
             quint64 requestId,
@@ -104,6 +152,20 @@ public:
             quint64 requestId,
             QVector<Sailfish::Crypto::Key::Identifier> *identifiers);
 
+    Sailfish::Crypto::Result storedKeyIdentifiers(
+            pid_t callerPid,
+            quint64 requestId,
+            qint64 cursor,
+            int limit,
+            QVector<Sailfish::Crypto::Key::Identifier> *identifiers,
+            qint64 *nextCursor);
+
+    Sailfish::Crypto::Result findKeys(
+            pid_t callerPid,
+            quint64 requestId,
+            const Sailfish::Crypto::Key::FilterData &filter,
+            QVector<Sailfish::Crypto::Key::Identifier> *identifiers);
+
     Sailfish::Crypto::Result sign(
             pid_t callerPid,
             quint64 requestId,
@@ -118,6 +180,7 @@ public:
             pid_t callerPid,
             quint64 requestId,
             const QByteArray &data,
+            const QByteArray &signature,
             const Sailfish::Crypto::Key &key,
             Sailfish::Crypto::Key::SignaturePadding padding,
             Sailfish::Crypto::Key::Digest digest,
@@ -146,6 +209,95 @@ public:
             const QString &cryptosystemProviderName,
             QByteArray *decrypted);
 
+    // as above, but for many items of data with the same key, which is read
+    // from storage once.  The items are handled on the global thread pool.
+    Sailfish::Crypto::Result signBatch(
+            pid_t callerPid,
+            quint64 requestId,
+            const QVector<QByteArray> &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            QVector<QByteArray> *signatures);
+
+    Sailfish::Crypto::Result verifyBatch(
+            pid_t callerPid,
+            quint64 requestId,
+            const QVector<QByteArray> &data,
+            const QVector<QByteArray> &signatures,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            QVector<bool> *verified);
+
+    Sailfish::Crypto::Result encryptBatch(
+            pid_t callerPid,
+            quint64 requestId,
+            const QVector<QByteArray> &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            QVector<QByteArray> *encrypted);
+
+    Sailfish::Crypto::Result generateRandomData(
+            pid_t callerPid,
+            quint64 requestId,
+            quint64 numberBytes,
+            const QString &csprngEngineName,
+            const QString &cryptosystemProviderName,
+            QByteArray *randomData);
+
+    Sailfish::Crypto::Result generateDigest(
+            pid_t callerPid,
+            quint64 requestId,
+            const QByteArray &data,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            QByteArray *digestValue);
+
+    Sailfish::Crypto::Result calculateMac(
+            pid_t callerPid,
+            quint64 requestId,
+            const QByteArray &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            QByteArray *mac);
+
+    Sailfish::Crypto::Result initialiseCipherSession(
+            pid_t callerPid,
+            quint64 requestId,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::Operation operation,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptosystemProviderName,
+            quint32 *cipherSessionToken);
+
+    // may be called from a worker thread.
+    Sailfish::Crypto::Result updateCipherSession(
+            pid_t callerPid,
+            quint64 requestId,
+            const QByteArray &data,
+            quint32 cipherSessionToken,
+            const QString &cryptosystemProviderName,
+            QByteArray *generatedData);
+
+    // may be called from a worker thread.
+    Sailfish::Crypto::Result finaliseCipherSession(
+            pid_t callerPid,
+            quint64 requestId,
+            quint32 cipherSessionToken,
+            const QString &cryptosystemProviderName,
+            QByteArray *generatedData);
+
+    void closeCipherSessions(pid_t callerPid);
+
 public Q_SLOTS:
     void secretsStoreKeyCompleted(
             quint64 requestId,
@@ -160,20 +312,161 @@ public Q_SLOTS:
             quint64 requestId,
             const Sailfish::Secrets::Result &result);
 
+    // an empty key name means every key in the collection, and an empty collection name every key.
+    void secretsStoredKeysInvalidated(
+            const QString &collectionName,
+            const QString &keyName);
+
+private Q_SLOTS:
+    void pluginLoaded(const QString &interfaceId, const QString &name, QObject *plugin);
+    void pluginSignCompleted(quint64 operationId, const Sailfish::Crypto::Result &result, const QByteArray &signature);
+    void pluginVerifyCompleted(quint64 operationId, const Sailfish::Crypto::Result &result, bool verified);
+    void pluginEncryptCompleted(quint64 operationId, const Sailfish::Crypto::Result &result, const QByteArray &encrypted);
+    void pluginDecryptCompleted(quint64 operationId, const Sailfish::Crypto::Result &result, const QByteArray &decrypted);
+
 private:
+    // The state required to continue an asynchronous request once
+    // the secrets daemon completes the stored key operation for it.
+    struct Continuation {
+        virtual ~Continuation() {}
+    };
+    struct KeyContinuation : public Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::Continuation {
+        Sailfish::Crypto::Key key;
+    };
+    struct KeyIdentifierContinuation : public Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::Continuation {
+        Sailfish::Crypto::Key::Identifier identifier;
+    };
+    struct StoredKeyContinuation : public Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::Continuation {
+        Sailfish::Crypto::Key::Identifier identifier; // of the key being read from storage
+    };
+    struct SignatureContinuation : public Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation {
+        SignatureContinuation()
+            : padding(Sailfish::Crypto::Key::SignaturePaddingUnknown), digest(Sailfish::Crypto::Key::DigestUnknown) {}
+        QByteArray data;
+        QByteArray signature; // only used by verify; calculateMac uses neither this nor the padding
+        Sailfish::Crypto::Key::SignaturePadding padding;
+        Sailfish::Crypto::Key::Digest digest;
+        QString cryptoPluginName;
+    };
+    struct CipherContinuation : public Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation {
+        CipherContinuation()
+            : operation(Sailfish::Crypto::Key::OperationUnknown), blockMode(Sailfish::Crypto::Key::BlockModeUnknown)
+            , padding(Sailfish::Crypto::Key::EncryptionPaddingUnknown), digest(Sailfish::Crypto::Key::DigestUnknown) {}
+        QByteArray data;
+        Sailfish::Crypto::Key::Operation operation;
+        Sailfish::Crypto::Key::BlockMode blockMode;
+        Sailfish::Crypto::Key::EncryptionPadding padding;
+        Sailfish::Crypto::Key::Digest digest;
+        QString cryptoPluginName;
+    };
+
+    struct BatchContinuation : public Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::StoredKeyContinuation {
+        BatchContinuation()
+            : signaturePadding(Sailfish::Crypto::Key::SignaturePaddingUnknown), blockMode(Sailfish::Crypto::Key::BlockModeUnknown)
+            , encryptionPadding(Sailfish::Crypto::Key::EncryptionPaddingUnknown), digest(Sailfish::Crypto::Key::DigestUnknown) {}
+        QVector<QByteArray> data;
+        QVector<QByteArray> signatures; // only used by verifyBatch
+        Sailfish::Crypto::Key::SignaturePadding signaturePadding;
+        Sailfish::Crypto::Key::BlockMode blockMode;
+        Sailfish::Crypto::Key::EncryptionPadding encryptionPadding;
+        Sailfish::Crypto::Key::Digest digest;
+        QString cryptoPluginName;
+    };
+
     struct PendingRequest {
         PendingRequest()
             : callerPid(0), requestId(0), requestType(Sailfish::Crypto::Daemon::ApiImpl::InvalidRequest) {}
-        PendingRequest(uint pid, quint64 rid, Sailfish::Crypto::Daemon::ApiImpl::RequestType rtype, QVariantList params)
-            : callerPid(pid), requestId(rid), requestType(rtype), parameters(params) {}
-        PendingRequest(const PendingRequest &other)
-            : callerPid(other.callerPid), requestId(other.requestId), requestType(other.requestType), parameters(other.parameters) {}
+        PendingRequest(uint pid, quint64 rid, Sailfish::Crypto::Daemon::ApiImpl::RequestType rtype,
+                       Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::Continuation *cont)
+            : callerPid(pid), requestId(rid), requestType(rtype), continuation(cont) {}
         uint callerPid;
         quint64 requestId;
         Sailfish::Crypto::Daemon::ApiImpl::RequestType requestType;
-        QVariantList parameters;
+        QSharedPointer<Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::Continuation> continuation;
+    };
+
+    // What a crypto plugin supports, and how quickly, as measured when it was introspected.
+    struct ProviderProfile {
+        ProviderProfile() : asynchronous(false) {}
+        ProviderProfile(const Sailfish::Crypto::CryptoPluginInfo &i, const QMap<int, qint64> &t, bool a)
+            : info(i), throughput(t), asynchronous(a) {}
+        Sailfish::Crypto::CryptoPluginInfo info;
+        QMap<int, qint64> throughput; // bytes per second, by key algorithm
+        bool asynchronous; // supportsAsynchronousOperations()
+    };
+
+    // A sign, verify, encrypt or decrypt operation for a plugin which supports
+    // asynchronous operations.  Each such plugin has a queue of jobs, from which up
+    // to the queue depth are submitted to the plugin at once, on the main thread.
+    struct PluginJob {
+        PluginJob()
+            : requestId(0), operation(Sailfish::Crypto::Key::OperationUnknown)
+            , blockMode(Sailfish::Crypto::Key::BlockModeUnknown), encryptionPadding(Sailfish::Crypto::Key::EncryptionPaddingUnknown)
+            , signaturePadding(Sailfish::Crypto::Key::SignaturePaddingUnknown), digest(Sailfish::Crypto::Key::DigestUnknown) {}
+        PluginJob(quint64 rid, Sailfish::Crypto::Key::Operation op, const QByteArray &d, const Sailfish::Crypto::Key &k)
+            : requestId(rid), operation(op), data(d), key(k)
+            , blockMode(Sailfish::Crypto::Key::BlockModeUnknown), encryptionPadding(Sailfish::Crypto::Key::EncryptionPaddingUnknown)
+            , signaturePadding(Sailfish::Crypto::Key::SignaturePaddingUnknown), digest(Sailfish::Crypto::Key::DigestUnknown) {}
+        quint64 requestId; // also the operation id given to the plugin
+        Sailfish::Crypto::Key::Operation operation;
+        QByteArray data;
+        QByteArray signature; // only used by verify
+        Sailfish::Crypto::Key key;
+        Sailfish::Crypto::Key::BlockMode blockMode;
+        Sailfish::Crypto::Key::EncryptionPadding encryptionPadding;
+        Sailfish::Crypto::Key::SignaturePadding signaturePadding;
+        Sailfish::Crypto::Key::Digest digest;
+    };
+    struct PluginJobQueue {
+        PluginJobQueue() : submitted(0) {}
+        QList<Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob> waiting;
+        int submitted;
+    };
+
+    // The outcome of validating a certificate chain, which holds until the expiry time.
+    struct CertificateChainValidation {
+        CertificateChainValidation() : valid(false) {}
+        CertificateChainValidation(bool v, const QDateTime &e) : valid(v), expiry(e) {}
+        bool valid;
+        QDateTime expiry;
     };
 
+    // maps the provider policies of CryptoManager to a plugin which supports the operation, or returns the name unchanged.
+    QString resolveCryptosystemProvider(const QString &cryptosystemProviderName,
+                                        Sailfish::Crypto::Key::Algorithm algorithm,
+                                        Sailfish::Crypto::Key::Operation operation) const;
+
+    // Keys read from storage for the operations of an application are kept,
+    // so that its later operations with the same key reference needn't wait
+    // for the secrets request queue.  Only used from the main thread.
+    bool cachedStoredKey(pid_t callerPid, const Sailfish::Crypto::Key::Identifier &identifier, Sailfish::Crypto::Key *key) const;
+    void cacheStoredKey(pid_t callerPid, const Sailfish::Crypto::Key::Identifier &identifier, const QByteArray &serialisedKey);
+
+    // The outcomes of validating certificate chains are kept, keyed by the
+    // fingerprint of the chain and the provider which validated it, until
+    // any certificate in the chain becomes valid or expires.  Used from any thread.
+    bool cachedCertificateChainValidation(const QByteArray &fingerprint, bool *valid) const;
+    void cacheCertificateChainValidation(const QByteArray &fingerprint, const QVector<Sailfish::Crypto::Certificate> &chain, bool valid);
+
+    // Reads the referenced key for a batch request.  If the key must be read
+    // asynchronously, the continuation is kept until it has been, and Pending
+    // is returned.  Otherwise the continuation is deleted.
+    Sailfish::Crypto::Result batchStoredKey(
+            pid_t callerPid,
+            quint64 requestId,
+            Sailfish::Crypto::Daemon::ApiImpl::RequestType requestType,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation *continuation,
+            Sailfish::Crypto::Key *fullKey);
+
+    // completes a batch request once its key has been read from storage.
+    void batch2(
+            quint64 requestId,
+            Sailfish::Crypto::Daemon::ApiImpl::RequestType requestType,
+            const Sailfish::Crypto::Result &result,
+            const QByteArray &serialisedKey,
+            const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::BatchContinuation &continuation);
+
     void storedKey2(
             quint64 requestId,
             const Sailfish::Crypto::Result &result,
@@ -204,6 +497,7 @@ private:
             const Sailfish::Crypto::Result &result,
             const QByteArray &serialisedKey,
             const QByteArray &data,
+            const QByteArray &signature,
             Sailfish::Crypto::Key::SignaturePadding padding,
             Sailfish::Crypto::Key::Digest digest,
             const QString &cryptoPluginName);
@@ -228,11 +522,82 @@ private:
             Sailfish::Crypto::Key::Digest digest,
             const QString &cryptoPluginName);
 
+    void calculateMac2(
+            quint64 requestId,
+            const Sailfish::Crypto::Result &result,
+            const QByteArray &serialisedKey,
+            const QByteArray &data,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptoPluginName);
+
+    void initialiseCipherSession2(
+            pid_t callerPid,
+            quint64 requestId,
+            const Sailfish::Crypto::Result &result,
+            const QByteArray &serialisedKey,
+            Sailfish::Crypto::Key::Operation operation,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const QString &cryptoPluginName);
+
+    // Performs the job with the plugin before returning, unless the plugin supports
+    // asynchronous operations, in which case the job is queued and Pending is returned,
+    // and the request is finished once the plugin completes the job.
+    Sailfish::Crypto::Result performPluginJob(
+            Sailfish::Crypto::CryptoPlugin *plugin,
+            const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob &job,
+            QByteArray *output,
+            bool *verified);
+    Sailfish::Crypto::Result signWithPlugin(
+            Sailfish::Crypto::CryptoPlugin *plugin, quint64 requestId,
+            const QByteArray &data, const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding, Sailfish::Crypto::Key::Digest digest,
+            QByteArray *signature);
+    Sailfish::Crypto::Result verifyWithPlugin(
+            Sailfish::Crypto::CryptoPlugin *plugin, quint64 requestId,
+            const QByteArray &data, const QByteArray &signature, const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding, Sailfish::Crypto::Key::Digest digest,
+            bool *verified);
+    Sailfish::Crypto::Result encryptWithPlugin(
+            Sailfish::Crypto::CryptoPlugin *plugin, quint64 requestId,
+            const QByteArray &data, const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode, Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest, QByteArray *encrypted);
+    Sailfish::Crypto::Result decryptWithPlugin(
+            Sailfish::Crypto::CryptoPlugin *plugin, quint64 requestId,
+            const QByteArray &data, const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode, Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest, QByteArray *decrypted);
+    int pluginJobQueueDepth(Sailfish::Crypto::CryptoPlugin *plugin) const;
+    Sailfish::Crypto::Result beginPluginJob(
+            Sailfish::Crypto::CryptoPlugin *plugin,
+            const Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJob &job);
+    void submitPluginJobs(Sailfish::Crypto::CryptoPlugin *plugin);
+    void finishPluginJob(
+            QObject *plugin,
+            quint64 operationId,
+            const Sailfish::Crypto::Result &result,
+            const QByteArray &output,
+            bool verified);
+
 private:
     Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue *m_requestQueue;
     Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue *m_secrets;
-    QMap<QString, Sailfish::Crypto::CryptoPlugin*> m_cryptoPlugins;
+    // plugins are instantiated when first used.
+    Sailfish::Secrets::Daemon::PluginRegistry m_pluginRegistry;
+    Sailfish::Secrets::Daemon::PluginMap<Sailfish::Crypto::CryptoPlugin> m_cryptoPlugins;
+    // read by requests on worker threads, while plugin hosts may still be configured on the main thread.
+    mutable QMutex m_providerProfilesMutex;
+    QMap<QString, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::ProviderProfile> m_providerProfiles;
     QMap<quint64, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PendingRequest> m_pendingRequests;
+    QMap<QPair<QString, Sailfish::Crypto::Key::Identifier>, Sailfish::Crypto::Key> m_storedKeyCache; // (application id, identifier) to key
+    mutable QMutex m_certificateChainCacheMutex;
+    QMap<QByteArray, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::CertificateChainValidation> m_certificateChainCache; // fingerprint to outcome
+    QMap<QString, Sailfish::Crypto::Daemon::ApiImpl::RequestProcessor::PluginJobQueue> m_pluginJobQueues; // by plugin name
+    QMap<quint64, Sailfish::Crypto::Key::Operation> m_submittedPluginJobs; // request id to operation
+    int m_pluginJobQueueDepth;
+    Sailfish::Crypto::Daemon::ApiImpl::KeyPool m_keyPool; // stopped before the plugins are unloaded
 };
 
 } // namespace ApiImpl
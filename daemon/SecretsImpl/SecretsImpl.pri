@@ -6,13 +6,23 @@ HEADERS += \
     $$PWD/secrets_p.h \
     $$PWD/secretsrequestprocessor_p.h \
     $$PWD/secretsdatabase_p.h \
-    $$PWD/applicationpermissions_p.h
+    $$PWD/applicationpermissions_p.h \
+    $$PWD/relockscheduler_p.h \
+    $$PWD/secretcache_p.h \
+    $$PWD/collectionlocks_p.h \
+    $$PWD/secretsarchive_p.h \
+    $$PWD/preloadmanifest_p.h
 
 SOURCES += \
     $$PWD/secrets.cpp \
     $$PWD/secretsrequestprocessor.cpp \
     $$PWD/secretsdatabase.cpp \
-    $$PWD/applicationpermissions.cpp
+    $$PWD/applicationpermissions.cpp \
+    $$PWD/relockscheduler.cpp \
+    $$PWD/secretcache.cpp \
+    $$PWD/collectionlocks.cpp \
+    $$PWD/secretsarchive.cpp \
+    $$PWD/preloadmanifest.cpp
 
 SOURCES += \
     $$PWD/secretscryptohelpers.cpp
@@ -13,6 +13,84 @@
 #include <QtCore/QFileInfo>
 
 QString Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::applicationId(pid_t pid) const
+{
+    const QString retn = callerIdentity(pid).applicationId;
+    qCDebug(lcSailfishSecretsDaemon) << "caller with pid" << pid << "has applicationId:" << retn;
+    return retn;
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::applicationIsPlatformApplication(pid_t pid) const
+{
+    return callerIdentity(pid).isPlatformApplication;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::callerConnected(pid_t pid)
+{
+    const quint64 startTime = processStartTime(pid);
+    QMutexLocker locker(&m_callerIdentitiesMutex);
+    QHash<pid_t, CallerIdentity>::iterator it = m_callerIdentities.find(pid);
+    if (it != m_callerIdentities.end() && it->startTime == startTime) {
+        it->connectionCount++;
+        return;
+    }
+
+    // either a new caller, or the pid was reused after the previous
+    // caller exited but before we saw its connection being closed.
+    CallerIdentity identity;
+    identity.startTime = startTime;
+    identity.applicationId = readApplicationId(pid);
+    identity.isPlatformApplication = readIsPlatformApplication(pid);
+    identity.connectionCount = 1;
+    m_callerIdentities.insert(pid, identity);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::callerDisconnected(pid_t pid)
+{
+    QMutexLocker locker(&m_callerIdentitiesMutex);
+    QHash<pid_t, CallerIdentity>::iterator it = m_callerIdentities.find(pid);
+    if (it != m_callerIdentities.end() && --it->connectionCount <= 0) {
+        m_callerIdentities.erase(it);
+    }
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::CallerIdentity
+Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::callerIdentity(pid_t pid) const
+{
+    {
+        QMutexLocker locker(&m_callerIdentitiesMutex);
+        QHash<pid_t, CallerIdentity>::const_iterator it = m_callerIdentities.constFind(pid);
+        if (it != m_callerIdentities.constEnd()) {
+            return it.value();
+        }
+    }
+
+    // not connected (e.g. the pid 0), so resolve it without caching.
+    CallerIdentity identity;
+    identity.applicationId = readApplicationId(pid);
+    identity.isPlatformApplication = readIsPlatformApplication(pid);
+    return identity;
+}
+
+quint64 Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::processStartTime(pid_t pid)
+{
+    QFile file(QString::fromLatin1("/proc/%1/stat").arg(pid));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    // the command name may contain spaces or parentheses, so skip past the last ')'.
+    // The start time is then the 20th field after it (field 22 overall).
+    const QByteArray stat = file.readAll();
+    const int commandEnd = stat.lastIndexOf(')');
+    if (commandEnd < 0) {
+        return 0;
+    }
+
+    const QList<QByteArray> fields = stat.mid(commandEnd + 2).split(' ');
+    return fields.size() > 19 ? fields.at(19).toULongLong() : 0;
+}
+
+QString Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::readApplicationId(pid_t pid) const
 {
     // TODO: readlink /proc/pid/exe -- but requires root permissions?
 
@@ -28,32 +106,18 @@ QString Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::applicationI
     }
 
     const QString pidFile = QString::fromLatin1("/proc/%1/cmdline").arg(pid);
-    if (!QFile::exists(pidFile)) {
-        qCWarning(lcSailfishSecretsDaemon) << "no such pid:" << pid;
-        return QString();
-    }
-
     QFile file(pidFile);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (!file.open(QIODevice::ReadOnly)) {
         qCWarning(lcSailfishSecretsDaemon) << "unable to open pid file:" << pidFile;
         return QString();
     }
 
-    QByteArray contents;
-    char data;
-    while (file.read(&data, 1)) {
-        if (data == '\0') {
-            data = ' ';
-        }
-        contents.append(data);
-    }
-
-    const QString retn(QString::fromUtf8(contents).trimmed());
-    qCDebug(lcSailfishSecretsDaemon) << "caller with pid" << pid << "has applicationId:" << retn;
-    return retn;
+    QByteArray contents = file.readAll();
+    contents.replace('\0', ' ');
+    return QString::fromUtf8(contents).trimmed();
 }
 
-bool Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::applicationIsPlatformApplication(pid_t pid) const
+bool Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions::readIsPlatformApplication(pid_t pid)
 {
     // TODO: implement a real ACL?  This implementation just checks that the pid is privileged egid.
 
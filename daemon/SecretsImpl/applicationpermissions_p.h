@@ -14,6 +14,8 @@
 #include <QtCore/QMap>
 #include <QtCore/QList>
 #include <QtCore/QSet>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 
 #include <sys/types.h>
 
@@ -36,6 +38,29 @@ public:
     QString applicationId(pid_t pid) const;
     QString platformApplicationId() const { return QLatin1String("Sailfish"); }
     bool applicationIsPlatformApplication(pid_t pid) const;
+
+    // The identity of a caller is resolved when it connects, and cached until
+    // its last connection to the daemon is closed.  The process start time is
+    // recorded so that a reused pid is never mistaken for an earlier process.
+    void callerConnected(pid_t pid);
+    void callerDisconnected(pid_t pid);
+
+private:
+    struct CallerIdentity {
+        CallerIdentity() : startTime(0), isPlatformApplication(false), connectionCount(0) {}
+        quint64 startTime;
+        QString applicationId;
+        bool isPlatformApplication;
+        int connectionCount;
+    };
+
+    CallerIdentity callerIdentity(pid_t pid) const;
+    static quint64 processStartTime(pid_t pid);
+    QString readApplicationId(pid_t pid) const;
+    static bool readIsPlatformApplication(pid_t pid);
+
+    mutable QMutex m_callerIdentitiesMutex;
+    QHash<pid_t, CallerIdentity> m_callerIdentities;
 };
 
 } // namespace ApiImpl
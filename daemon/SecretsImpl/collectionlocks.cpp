@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "collectionlocks_p.h"
+
+#include <QtCore/QThread>
+#include <QtCore/QMutexLocker>
+
+bool
+Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::LockState::heldByOtherThread(Qt::HANDLE self) const
+{
+    if (writeDepth > 0 && writer != self) {
+        return true;
+    }
+    for (QHash<Qt::HANDLE, int>::const_iterator it = readers.constBegin(); it != readers.constEnd(); ++it) {
+        if (it.key() != self) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::canLock(
+        const QString &collectionName,
+        Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Mode mode,
+        Qt::HANDLE self) const
+{
+    if (m_global.writeDepth > 0) {
+        return m_global.writer == self;
+    }
+
+    if (collectionName.isEmpty()) {
+        // every collection which is locked must be locked only by this thread.
+        for (QHash<QString, LockState>::const_iterator it = m_collections.constBegin(); it != m_collections.constEnd(); ++it) {
+            if (it->heldByOtherThread(self)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    QHash<QString, LockState>::const_iterator it = m_collections.constFind(collectionName);
+    if (it == m_collections.constEnd()) {
+        return true;
+    }
+    if (mode == Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::ReadLock) {
+        return it->writeDepth == 0 || it->writer == self;
+    }
+    return !it->heldByOtherThread(self);
+}
+
+void
+Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::lock(
+        const QString &collectionName,
+        Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Mode mode)
+{
+    const Qt::HANDLE self = QThread::currentThreadId();
+    QMutexLocker locker(&m_mutex);
+    while (!canLock(collectionName, mode, self)) {
+        m_released.wait(&m_mutex);
+    }
+
+    LockState &state(collectionName.isEmpty() ? m_global : m_collections[collectionName]);
+    if (collectionName.isEmpty() || mode == Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock) {
+        state.writer = self;
+        state.writeDepth++;
+    } else {
+        state.readers[self]++;
+    }
+}
+
+void
+Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::unlock(
+        const QString &collectionName,
+        Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Mode mode)
+{
+    const Qt::HANDLE self = QThread::currentThreadId();
+    QMutexLocker locker(&m_mutex);
+
+    LockState &state(collectionName.isEmpty() ? m_global : m_collections[collectionName]);
+    if (collectionName.isEmpty() || mode == Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock) {
+        if (--state.writeDepth == 0) {
+            state.writer = Q_NULLPTR;
+        }
+    } else {
+        QHash<Qt::HANDLE, int>::iterator it = state.readers.find(self);
+        if (it != state.readers.end() && --it.value() == 0) {
+            state.readers.erase(it);
+        }
+    }
+
+    if (!collectionName.isEmpty() && state.isFree()) {
+        m_collections.remove(collectionName);
+    }
+    m_released.wakeAll();
+}
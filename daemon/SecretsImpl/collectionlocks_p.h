@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_APIIMPL_COLLECTIONLOCKS_P_H
+#define SAILFISHSECRETS_APIIMPL_COLLECTIONLOCKS_P_H
+
+#include <QtCore/QString>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace ApiImpl {
+
+// Reader/writer locks keyed by collection name, so that operations on
+// unrelated collections needn't exclude each other.  Locking the empty
+// collection name locks every collection for writing, as creating or
+// deleting a collection (or changing how collections are stored) requires.
+//
+// The locks are recursive: a thread which holds a lock may lock it again,
+// and a thread which holds the global lock may lock any collection.  A
+// thread which holds a read lock may upgrade it to a write lock only if
+// no other thread also holds it for reading, so callers must not rely on
+// upgrades.  Collection locks must be taken before the accessMutex() of
+// the database, as the database connection may be held across them.
+class CollectionLocks
+{
+public:
+    enum Mode {
+        ReadLock = 0,
+        WriteLock
+    };
+
+    CollectionLocks() {}
+
+    void lock(const QString &collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Mode mode);
+    void unlock(const QString &collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Mode mode);
+
+    class Locker
+    {
+    public:
+        Locker(Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks *locks,
+               const QString &collectionName,
+               Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Mode mode)
+            : m_locks(locks), m_collectionName(collectionName), m_mode(mode) {
+            m_locks->lock(m_collectionName, m_mode);
+        }
+        ~Locker() {
+            m_locks->unlock(m_collectionName, m_mode);
+        }
+
+    private:
+        Q_DISABLE_COPY(Locker)
+        Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks *m_locks;
+        QString m_collectionName;
+        Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Mode m_mode;
+    };
+
+private:
+    Q_DISABLE_COPY(CollectionLocks)
+
+    struct LockState {
+        LockState() : writer(Q_NULLPTR), writeDepth(0) {}
+        bool isFree() const { return writeDepth == 0 && readers.isEmpty(); }
+        bool heldByOtherThread(Qt::HANDLE self) const;
+        Qt::HANDLE writer;
+        int writeDepth;
+        QHash<Qt::HANDLE, int> readers; // thread to depth
+    };
+
+    bool canLock(const QString &collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Mode mode, Qt::HANDLE self) const;
+
+    QMutex m_mutex;
+    QWaitCondition m_released;
+    LockState m_global;
+    QHash<QString, LockState> m_collections; // only the currently locked collections
+};
+
+} // namespace ApiImpl
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_APIIMPL_COLLECTIONLOCKS_P_H
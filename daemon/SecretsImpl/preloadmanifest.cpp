@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "preloadmanifest_p.h"
+#include "logging_p.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QRegularExpression>
+
+bool Sailfish::Secrets::Daemon::ApiImpl::PreloadManifest::load(const QString &path)
+{
+    m_entries.clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    const QRegularExpression separator(QStringLiteral("\\s+"));
+    int lineNumber = 0;
+    while (!file.atEnd()) {
+        const QString line = QString::fromUtf8(file.readLine()).trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#'))) {
+            continue;
+        }
+
+        const QStringList fields = line.split(separator, QString::SkipEmptyParts);
+        if (fields.size() != 3) {
+            qCWarning(lcSailfishSecretsDaemon) << "Ignoring malformed preload manifest line" << lineNumber << "of" << path;
+            continue;
+        }
+
+        Entry entry;
+        entry.applicationId = fields.at(0);
+        entry.secretName = fields.at(2);
+        m_entries[fields.at(1)].append(entry);
+    }
+
+    return true;
+}
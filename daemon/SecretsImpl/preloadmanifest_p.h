@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_APIIMPL_PRELOADMANIFEST_P_H
+#define SAILFISHSECRETS_APIIMPL_PRELOADMANIFEST_P_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QMap>
+#include <QtCore/QVector>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace ApiImpl {
+
+// The secrets which platform applications read as soon as the device
+// is unlocked, and which are therefore read into the secret cache ahead
+// of their requests.  Each line of the manifest names one secret:
+//
+//     <applicationId> <collectionName> <secretName>
+//
+// Empty lines, and lines starting with '#', are ignored.
+class PreloadManifest
+{
+public:
+    struct Entry {
+        QString applicationId;
+        QString secretName;
+    };
+
+    PreloadManifest() {}
+
+    // Returns false if the manifest could not be read.  Malformed lines are skipped.
+    bool load(const QString &path);
+
+    bool isEmpty() const { return m_entries.isEmpty(); }
+    QStringList collectionNames() const { return m_entries.keys(); }
+    QVector<Entry> entries(const QString &collectionName) const { return m_entries.value(collectionName); }
+
+private:
+    QMap<QString, QVector<Entry> > m_entries; // collection name to the secrets to preload from it
+};
+
+} // namespace ApiImpl
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_APIIMPL_PRELOADMANIFEST_P_H
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "relockscheduler_p.h"
+
+#include <algorithm>
+#include <functional>
+#include <climits>
+
+Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::RelockScheduler(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout,
+            this, &Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::timeout);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::schedule(const QString &name, int timeoutMs)
+{
+    const qint64 deadline = m_clock.elapsed() + qMax(timeoutMs, 0);
+    m_deadlines.insert(name, deadline);
+    m_heap.append(Deadline(deadline, name));
+    std::push_heap(m_heap.begin(), m_heap.end(), std::greater<Deadline>());
+    if (m_heap.first().msecs == deadline) {
+        restartTimer();
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::cancel(const QString &name)
+{
+    if (m_deadlines.remove(name)) {
+        compact();
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::timeout()
+{
+    const qint64 now = m_clock.elapsed();
+    QStringList expiredNames;
+    while (!m_heap.isEmpty() && m_heap.first().msecs <= now) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<Deadline>());
+        const Deadline deadline = m_heap.takeLast();
+        QHash<QString, qint64>::iterator it = m_deadlines.find(deadline.name);
+        if (it != m_deadlines.end() && it.value() == deadline.msecs) {
+            m_deadlines.erase(it);
+            expiredNames.append(deadline.name);
+        }
+    }
+
+    restartTimer();
+    if (!expiredNames.isEmpty()) {
+        emit expired(expiredNames);
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::compact()
+{
+    // rebuild the heap once most of its entries are stale.
+    if (m_heap.size() > 2 * m_deadlines.size() + 16) {
+        QVector<Deadline> heap;
+        heap.reserve(m_deadlines.size());
+        for (QHash<QString, qint64>::const_iterator it = m_deadlines.constBegin(); it != m_deadlines.constEnd(); it++) {
+            heap.append(Deadline(it.value(), it.key()));
+        }
+        std::make_heap(heap.begin(), heap.end(), std::greater<Deadline>());
+        m_heap = heap;
+    }
+    restartTimer();
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::restartTimer()
+{
+    if (m_deadlines.isEmpty()) {
+        m_heap.clear();
+        m_timer.stop();
+        return;
+    }
+
+    // stale entries at the top would only cause spurious wakeups.
+    while (!m_heap.isEmpty() && m_deadlines.value(m_heap.first().name, -1) != m_heap.first().msecs) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<Deadline>());
+        m_heap.removeLast();
+    }
+
+    const qint64 remaining = m_heap.first().msecs - m_clock.elapsed();
+    m_timer.start(static_cast<int>(qBound<qint64>(0, remaining, INT_MAX)));
+}
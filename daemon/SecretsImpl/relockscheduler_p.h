@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_APIIMPL_RELOCKSCHEDULER_P_H
+#define SAILFISHSECRETS_APIIMPL_RELOCKSCHEDULER_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace ApiImpl {
+
+// Manages the relock deadlines of any number of collections or secrets
+// with a single timer.  The deadlines are kept in a min-heap, so scheduling
+// is O(log n), and every deadline which has passed when the timer fires
+// is reported in one batch.
+class RelockScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    RelockScheduler(QObject *parent = Q_NULLPTR);
+
+    bool isScheduled(const QString &name) const { return m_deadlines.contains(name); }
+    void schedule(const QString &name, int timeoutMs);
+    void cancel(const QString &name);
+
+Q_SIGNALS:
+    void expired(const QStringList &names);
+
+private Q_SLOTS:
+    void timeout();
+
+private:
+    struct Deadline {
+        Deadline() : msecs(0) {}
+        Deadline(qint64 m, const QString &n) : msecs(m), name(n) {}
+        bool operator>(const Deadline &other) const { return msecs > other.msecs; }
+        qint64 msecs;
+        QString name;
+    };
+
+    void compact();
+    void restartTimer();
+
+    // Cancelled or rescheduled entries are left in the heap, and skipped
+    // when they reach the top if they no longer match m_deadlines.
+    QVector<Deadline> m_heap;
+    QHash<QString, qint64> m_deadlines;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+};
+
+} // namespace ApiImpl
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_APIIMPL_RELOCKSCHEDULER_P_H
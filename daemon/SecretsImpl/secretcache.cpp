@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "secretcache_p.h"
+#include "applicationaccounting_p.h"
+#include "logging_p.h"
+
+Sailfish::Secrets::Daemon::ApiImpl::SecretCache::SecretCache()
+    : m_mostRecent(Q_NULLPTR)
+    , m_leastRecent(Q_NULLPTR)
+    , m_capacity(0)
+    , m_size(0)
+    , m_lockFailureReported(false)
+{
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::SecretCache::~SecretCache()
+{
+    clear();
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::setCapacity(qint64 bytes)
+{
+    m_capacity = qMax(bytes, qint64(0));
+    evict(0);
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::SecretCache::lookup(
+        const QString &collectionName,
+        const QString &hashedSecretName,
+        QByteArray *secret)
+{
+    Entry *entry = m_entries.value(Key(collectionName, hashedSecretName));
+    if (!entry) {
+        return false;
+    }
+
+    if (entry != m_mostRecent) {
+        unlink(entry);
+        pushFront(entry);
+    }
+    *secret = QByteArray(entry->secret.rawData().constData(), entry->secret.size());
+    return true;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::insert(
+        const QString &collectionName,
+        const QString &hashedSecretName,
+        const QByteArray &secret)
+{
+    remove(collectionName, hashedSecretName);
+
+    if (m_capacity == 0 || qint64(secret.size()) > m_capacity) {
+        return;
+    }
+
+    const Sailfish::Secrets::Daemon::SecureByteArray secureSecret(secret);
+    if (secureSecret.size() != secret.size() || qint64(secureSecret.allocatedSize()) > m_capacity) {
+        return;
+    }
+
+    // never cache plaintext which could be written to swap.
+    if (!secureSecret.isLocked()) {
+        if (!m_lockFailureReported) {
+            qCWarning(lcSailfishSecretsDaemon) << "Unable to lock secret cache memory, not caching";
+            m_lockFailureReported = true;
+        }
+        return;
+    }
+
+    // an application which holds its cache quota doesn't displace others' secrets.
+    const QString applicationId = Sailfish::Secrets::Daemon::ApplicationAccounting::currentApplicationId();
+    Sailfish::Secrets::Daemon::ApplicationAccounting *accounting = Sailfish::Secrets::Daemon::ApplicationAccounting::instance();
+    if (!accounting->mayCache(applicationId, qint64(secureSecret.allocatedSize()))) {
+        return;
+    }
+
+    evict(qint64(secureSecret.allocatedSize()));
+
+    Entry *entry = new Entry;
+    entry->key = Key(collectionName, hashedSecretName);
+    entry->secret = secureSecret;
+    entry->applicationId = applicationId;
+    accounting->recordCacheBytes(applicationId, qint64(secureSecret.allocatedSize()));
+
+    m_entries.insert(entry->key, entry);
+    m_collectionEntryCounts[collectionName] += 1;
+    m_size += qint64(secureSecret.allocatedSize());
+    pushFront(entry);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::remove(
+        const QString &collectionName,
+        const QString &hashedSecretName)
+{
+    Entry *entry = m_entries.take(Key(collectionName, hashedSecretName));
+    if (entry) {
+        release(entry);
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::removeCollection(const QString &collectionName)
+{
+    if (!m_collectionEntryCounts.contains(collectionName)) {
+        return;
+    }
+
+    QHash<Key, Entry*>::iterator it = m_entries.begin();
+    while (it != m_entries.end()) {
+        if (it.key().first == collectionName) {
+            Entry *entry = it.value();
+            it = m_entries.erase(it);
+            release(entry);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::clear()
+{
+    while (m_leastRecent) {
+        Entry *entry = m_leastRecent;
+        m_entries.remove(entry->key);
+        release(entry);
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::unlink(Entry *entry)
+{
+    if (entry->previous) {
+        entry->previous->next = entry->next;
+    } else {
+        m_mostRecent = entry->next;
+    }
+    if (entry->next) {
+        entry->next->previous = entry->previous;
+    } else {
+        m_leastRecent = entry->previous;
+    }
+    entry->previous = Q_NULLPTR;
+    entry->next = Q_NULLPTR;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::pushFront(Entry *entry)
+{
+    entry->next = m_mostRecent;
+    if (m_mostRecent) {
+        m_mostRecent->previous = entry;
+    }
+    m_mostRecent = entry;
+    if (!m_leastRecent) {
+        m_leastRecent = entry;
+    }
+}
+
+// the entry must already have been removed from m_entries.
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::release(Entry *entry)
+{
+    unlink(entry);
+
+    QHash<QString, int>::iterator count = m_collectionEntryCounts.find(entry->key.first);
+    if (count != m_collectionEntryCounts.end() && --count.value() <= 0) {
+        m_collectionEntryCounts.erase(count);
+    }
+
+    m_size -= qint64(entry->secret.allocatedSize());
+    Sailfish::Secrets::Daemon::ApplicationAccounting::instance()->recordCacheBytes(
+            entry->applicationId, -qint64(entry->secret.allocatedSize()));
+    delete entry; // releasing the secure memory wipes it
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretCache::evict(qint64 required)
+{
+    while (m_leastRecent && m_size + required > m_capacity) {
+        Entry *entry = m_leastRecent;
+        m_entries.remove(entry->key);
+        release(entry);
+    }
+}
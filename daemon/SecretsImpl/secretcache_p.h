@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_APIIMPL_SECRETCACHE_P_H
+#define SAILFISHSECRETS_APIIMPL_SECRETCACHE_P_H
+
+#include "securememory_p.h"
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace ApiImpl {
+
+// A size-bounded, least-recently-used cache of decrypted secret values
+// from unlocked collections.  Each value is held in secure memory
+// which is locked into RAM, excluded from core dumps, and wiped when released.
+// The cache is disabled until it is given a non-zero capacity.
+// Each value is accounted to the application whose request cached it.
+class SecretCache
+{
+public:
+    SecretCache();
+    ~SecretCache();
+
+    void setCapacity(qint64 bytes);
+    qint64 capacity() const { return m_capacity; }
+    qint64 size() const { return m_size; }
+
+    bool lookup(const QString &collectionName, const QString &hashedSecretName, QByteArray *secret);
+    void insert(const QString &collectionName, const QString &hashedSecretName, const QByteArray &secret);
+    void remove(const QString &collectionName, const QString &hashedSecretName);
+    void removeCollection(const QString &collectionName);
+    void clear();
+
+private:
+    typedef QPair<QString, QString> Key;
+    struct Entry {
+        Entry() : previous(Q_NULLPTR), next(Q_NULLPTR) {}
+        Key key;
+        Entry *previous; // more recently used
+        Entry *next;     // less recently used
+        Sailfish::Secrets::Daemon::SecureByteArray secret;
+        QString applicationId;
+    };
+
+    void unlink(Entry *entry);
+    void pushFront(Entry *entry);
+    void release(Entry *entry);
+    void evict(qint64 required);
+
+    QHash<Key, Entry*> m_entries;
+    QHash<QString, int> m_collectionEntryCounts;
+    Entry *m_mostRecent;
+    Entry *m_leastRecent;
+    qint64 m_capacity;
+    qint64 m_size;   // the allocated size of all entries
+    bool m_lockFailureReported;
+
+    Q_DISABLE_COPY(SecretCache)
+};
+
+} // namespace ApiImpl
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_APIIMPL_SECRETCACHE_P_H
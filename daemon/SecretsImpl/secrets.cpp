@@ -8,6 +8,7 @@
 #include "secrets_p.h"
 #include "secretsrequestprocessor_p.h"
 #include "logging_p.h"
+#include "sharedmemory_p.h"
 
 #include "Secrets/result.h"
 #include "Secrets/secretmanager.h"
@@ -41,6 +42,26 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::getPluginInfo(
                                   result);
 }
 
+// retrieve the generation of the plugin info, without queueing the request
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::getPluginInfoGeneration(
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result,
+        quint64 &generation)
+{
+    Q_UNUSED(message);
+    generation = m_requestQueue->pluginInfoGeneration();
+    result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::setNextRequestDeadline(
+        const QString &method,
+        qint64 timeoutMsecs,
+        const QDBusMessage &message)
+{
+    Q_UNUSED(message);  // no reply is sent
+    m_requestQueue->setNextRequestDeadline(connection(), method, timeoutMsecs);
+}
+
 // create a DeviceLock-protected collection
 void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::createCollection(
         const QString &collectionName,
@@ -48,6 +69,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::createCollection(
         const QString &encryptionPluginName,
         Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic unlockSemantic,
         Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+        Sailfish::Secrets::StoragePlugin::Durability durability,
         const QDBusMessage &message,
         Sailfish::Secrets::Result &result)
 {
@@ -56,7 +78,8 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::createCollection(
              << QVariant::fromValue<QString>(storagePluginName)
              << QVariant::fromValue<QString>(encryptionPluginName)
              << QVariant::fromValue<Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic>(unlockSemantic)
-             << QVariant::fromValue<Sailfish::Secrets::SecretManager::AccessControlMode>(accessControlMode);
+             << QVariant::fromValue<Sailfish::Secrets::SecretManager::AccessControlMode>(accessControlMode)
+             << QVariant::fromValue<Sailfish::Secrets::StoragePlugin::Durability>(durability);
     m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::CreateDeviceLockCollectionRequest,
                                   inParams,
                                   connection(),
@@ -75,6 +98,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::createCollection(
         Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
         Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
         const QString &uiServiceAddress,
+        Sailfish::Secrets::StoragePlugin::Durability durability,
         const QDBusMessage &message,
         Sailfish::Secrets::Result &result)
 {
@@ -87,7 +111,8 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::createCollection(
              << QVariant::fromValue<int>(customLockTimeoutMs)
              << QVariant::fromValue<Sailfish::Secrets::SecretManager::AccessControlMode>(accessControlMode)
              << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
-             << QVariant::fromValue<QString>(uiServiceAddress);
+             << QVariant::fromValue<QString>(uiServiceAddress)
+             << QVariant::fromValue<Sailfish::Secrets::StoragePlugin::Durability>(durability);
     m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::CreateCustomLockCollectionRequest,
                                   inParams,
                                   connection(),
@@ -135,6 +160,50 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::setSecret(
                                   result);
 }
 
+// set a secret in a collection, passed as a sealed memfd
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::setSecretFd(
+        const QString &collectionName,
+        const QString &secretName,
+        const QDBusUnixFileDescriptor &secret,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result)
+{
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QString>(collectionName)
+             << QVariant::fromValue<QString>(secretName)
+             << QVariant::fromValue<QDBusUnixFileDescriptor>(secret)
+             << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
+             << QVariant::fromValue<QString>(uiServiceAddress);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::SetCollectionSecretFdRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+// set multiple secrets in a collection
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::setSecrets(
+        const QString &collectionName,
+        const QMap<QString, QByteArray> &secrets,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result)
+{
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QString>(collectionName)
+             << QVariant::fromValue<QMap<QString, QByteArray> >(secrets)
+             << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
+             << QVariant::fromValue<QString>(uiServiceAddress);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::SetCollectionSecretsRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
 // set a standalone DeviceLock-protected secret
 void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::setSecret(
         const QString &storagePluginName,
@@ -218,6 +287,52 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::getSecret(
                                   result);
 }
 
+// get a secret in a collection, returned as a sealed memfd
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::getSecretFd(
+        const QString &collectionName,
+        const QString &secretName,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result,
+        QDBusUnixFileDescriptor &secret)
+{
+    Q_UNUSED(secret); // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QString>(collectionName)
+             << QVariant::fromValue<QString>(secretName)
+             << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
+             << QVariant::fromValue<QString>(uiServiceAddress);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::GetCollectionSecretFdRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+// get multiple secrets in a collection
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::getSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result,
+        QMap<QString, QByteArray> &secrets)
+{
+    Q_UNUSED(secrets); // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QString>(collectionName)
+             << QVariant::fromValue<QStringList>(secretNames)
+             << QVariant::fromValue<Sailfish::Secrets::SecretManager::UserInteractionMode>(userInteractionMode)
+             << QVariant::fromValue<QString>(uiServiceAddress);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::GetCollectionSecretsRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
 // get a standalone secret
 void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::getSecret(
         const QString &secretName,
@@ -277,6 +392,151 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::deleteSecret(
                                   result);
 }
 
+// cancel all of the caller's outstanding requests
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::cancelRequests(
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result)
+{
+    Q_UNUSED(message);
+    pid_t callerPid = 0;
+    if (!Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::connectionPid(connection(), &callerPid)) {
+        result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsDaemonRequestPidError,
+                                           QLatin1String("Could not determine PID of caller"));
+        return;
+    }
+
+    m_requestQueue->cancelRequests(callerPid);
+    result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// set whether the collection should be prefetched whenever it is unlocked
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::setCollectionPrefetchOnUnlock(
+        const QString &collectionName,
+        bool prefetchOnUnlock,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result)
+{
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QString>(collectionName)
+             << QVariant::fromValue<bool>(prefetchOnUnlock);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::SetCollectionPrefetchOnUnlockRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+// change the device lock key
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::modifyDeviceLockKey(
+        const QByteArray &oldDeviceLockKey,
+        const QByteArray &newDeviceLockKey,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result)
+{
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QByteArray>(oldDeviceLockKey)
+             << QVariant::fromValue<QByteArray>(newDeviceLockKey);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::ModifyDeviceLockKeyRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+// get the names of the collections owned by the caller
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::collectionNames(
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result,
+        QStringList &collectionNames)
+{
+    Q_UNUSED(collectionNames); // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::CollectionNamesRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+// get a page of the names of the secrets in a collection
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::secretNames(
+        const QString &collectionName,
+        qint64 cursor,
+        int limit,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result,
+        QStringList &secretNames,
+        qint64 &nextCursor)
+{
+    Q_UNUSED(secretNames); // outparam, set in handlePendingRequest / handleFinishedRequest
+    Q_UNUSED(nextCursor);  // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QString>(collectionName)
+             << QVariant::fromValue<qint64>(cursor)
+             << QVariant::fromValue<int>(limit);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::SecretNamesRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+// write the caller's collections and secrets to an encrypted archive
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::exportSecrets(
+        const QDBusUnixFileDescriptor &archive,
+        const QByteArray &archiveKey,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result,
+        int &exportedCount)
+{
+    Q_UNUSED(exportedCount); // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QDBusUnixFileDescriptor>(archive)
+             << QVariant::fromValue<QByteArray>(archiveKey);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::ExportSecretsRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+// restore the collections and secrets of an encrypted archive
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::importSecrets(
+        const QDBusUnixFileDescriptor &archive,
+        const QByteArray &archiveKey,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result,
+        int &importedCount)
+{
+    Q_UNUSED(importedCount); // outparam, set in handlePendingRequest / handleFinishedRequest
+    QList<QVariant> inParams;
+    inParams << QVariant::fromValue<QDBusUnixFileDescriptor>(archive)
+             << QVariant::fromValue<QByteArray>(archiveKey);
+    m_requestQueue->handleRequest(Sailfish::Secrets::Daemon::ApiImpl::ImportSecretsRequest,
+                                  inParams,
+                                  connection(),
+                                  message,
+                                  result);
+}
+
+// subscribe to lock state and secret change notifications
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsDBusObject::subscribeNotifications(
+        const QStringList &collectionNames,
+        const QDBusMessage &message,
+        Sailfish::Secrets::Result &result)
+{
+    Q_UNUSED(message);
+    pid_t callerPid = 0;
+    if (!Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::connectionPid(connection(), &callerPid)) {
+        result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsDaemonRequestPidError,
+                                           QLatin1String("Could not determine PID of caller"));
+        return;
+    }
+
+    m_requestQueue->setNotificationSubscription(callerPid, connection(), collectionNames);
+    result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
 //-----------------------------------
 
 Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::SecretsRequestQueue(
@@ -289,8 +549,13 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::SecretsRequestQueue(
           parent,
           pluginDir,
           autotestMode)
+    , m_groupCommitWindowMs(0)
+    , m_groupCommitMaxBatch(0)
 {
     Sailfish::Secrets::SecretsDaemonConnection::registerDBusTypes();
+    m_groupCommitTimer.setSingleShot(true);
+    connect(&m_groupCommitTimer, &QTimer::timeout,
+            this, &Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::flushGroupCommit);
     if (!m_db.open(QLatin1String("sailfishsecretsd"), autotestMode)) {
         qCWarning(lcSailfishSecretsDaemon) << "Secrets: failed to open database!";
         return;
@@ -309,6 +574,179 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::SecretsRequestQueue(
 
 Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::~SecretsRequestQueue()
 {
+    if (m_groupCommitWindowMs > 0) {
+        flushGroupCommit();
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleClientConnected(pid_t callerPid)
+{
+    m_appPermissions->callerConnected(callerPid);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleClientDisconnected(pid_t callerPid)
+{
+    m_appPermissions->callerDisconnected(callerPid);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::setSecretCacheCapacity(qint64 bytes)
+{
+    m_requestProcessor->setSecretCacheCapacity(bytes);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::setSecretChunkSize(int bytes)
+{
+    m_requestProcessor->setSecretChunkSize(bytes);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::preloadSecrets(const QString &manifestPath)
+{
+    Sailfish::Secrets::Daemon::ApiImpl::PreloadManifest manifest;
+    if (manifestPath.isEmpty() || !manifest.load(manifestPath) || manifest.isEmpty()) {
+        return;
+    }
+
+    const int preloadedCount = m_requestProcessor->preloadSecrets(manifest);
+    qCDebug(lcSailfishSecretsDaemon) << "Preloaded" << preloadedCount << "secrets from" << manifestPath;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::setSharedStorageTransactions(bool enabled)
+{
+    // plugins cannot be moved back onto their own connections.
+    if (enabled) {
+        m_requestProcessor->shareStorageDatabaseConnection();
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::setGroupCommit(int windowMs, int maxBatch)
+{
+    if (windowMs <= 0 && m_groupCommitWindowMs > 0) {
+        flushGroupCommit();
+    }
+
+    m_groupCommitWindowMs = qMax(windowMs, 0);
+    m_groupCommitMaxBatch = qMax(maxBatch, 1);
+    m_groupCommitTimer.setInterval(m_groupCommitWindowMs);
+
+    m_db.setGroupCommit(m_groupCommitWindowMs > 0);
+    m_requestProcessor->setStorageWriteBatching(m_groupCommitWindowMs > 0);
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::groupCommitPending() const
+{
+    return m_groupCommitWindowMs > 0
+            && (m_db.groupCommitPending() || m_requestProcessor->storageWritesPending());
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::scheduleGroupCommit(int pendingMessages)
+{
+    if (pendingMessages >= m_groupCommitMaxBatch) {
+        // flush once the current request has been handled, so that its transaction is closed.
+        QMetaObject::invokeMethod(this, "flushGroupCommit", Qt::QueuedConnection);
+    } else if (!m_groupCommitTimer.isActive()) {
+        m_groupCommitTimer.start();
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::flushGroupCommit()
+{
+    m_groupCommitTimer.stop();
+
+    // the master database is flushed last, as it refers to the plugins' data.
+    bool succeeded = m_requestProcessor->flushStorage().code() == Sailfish::Secrets::Result::Succeeded;
+    if (!m_db.flushGroupCommit()) {
+        qCWarning(lcSailfishSecretsDaemon) << "Secrets: failed to commit grouped transactions!";
+        succeeded = false;
+    }
+    if (!succeeded) {
+        m_requestProcessor->discardCachedState();
+        invalidateStoredKeys(QString());
+    }
+
+    sendDeferredMessages(succeeded);
+    emit groupCommitFinished(succeeded);
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::messagesDeferred() const
+{
+    // while any writes are not yet durable, nothing which may depend on them can be sent.
+    return deferredMessageCount() > 0 || groupCommitPending();
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::messageDeferred()
+{
+    scheduleGroupCommit(deferredMessageCount());
+}
+
+quint64 Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::pluginInfoGeneration() const
+{
+    return m_requestProcessor->pluginInfoGeneration();
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::setNotificationSubscription(
+        pid_t callerPid,
+        const QDBusConnection &connection,
+        const QStringList &collectionNames)
+{
+    if (collectionNames.isEmpty()) {
+        m_notificationSubscriptions.remove(connection.name());
+        return;
+    }
+
+    NotificationSubscription subscription;
+    subscription.callerPid = callerPid;
+    subscription.connection = connection;
+    subscription.collectionNames = collectionNames.toSet();
+    m_notificationSubscriptions.insert(connection.name(), subscription);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::notifyCollectionLockStateChanged(
+        const QString &collectionName,
+        bool locked)
+{
+    sendNotification(collectionName,
+                     locked ? QStringLiteral("collectionLocked") : QStringLiteral("collectionUnlocked"),
+                     QVariantList() << collectionName);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::notifySecretChanged(
+        const QString &collectionName,
+        const QString &secretName)
+{
+    invalidateStoredKeys(collectionName, secretName);
+    sendNotification(collectionName,
+                     QStringLiteral("secretChanged"),
+                     QVariantList() << collectionName << secretName);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::invalidateStoredKeys(
+        const QString &collectionName,
+        const QString &secretName)
+{
+    emit storedKeysInvalidated(collectionName, secretName);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::sendNotification(
+        const QString &collectionName,
+        const QString &signalName,
+        const QVariantList &arguments)
+{
+    // The p2p object is registered on every client connection, so rather than
+    // broadcasting a signal from it, send the signal only to the subscribers.
+    QHash<QString, NotificationSubscription>::iterator it = m_notificationSubscriptions.begin();
+    while (it != m_notificationSubscriptions.end()) {
+        if (!it->connection.isConnected()) {
+            it = m_notificationSubscriptions.erase(it);
+            continue;
+        }
+        if (it->collectionNames.contains(collectionName)
+                && m_requestProcessor->collectionNotificationPermitted(it->callerPid, collectionName)) {
+            QDBusMessage signal = QDBusMessage::createSignal(m_dbusObjectPath, m_dbusInterfaceName, signalName);
+            signal.setArguments(arguments);
+            sendMessage(it->connection, signal);
+        }
+        ++it;
+    }
 }
 
 QString Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::requestTypeToString(int type) const
@@ -326,11 +764,144 @@ QString Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::requestTypeToSt
         case GetStandaloneSecretRequest:            return QLatin1String("GetStandaloneSecretRequest");
         case DeleteCollectionSecretRequest:         return QLatin1String("DeleteCollectionSecretRequest");
         case DeleteStandaloneSecretRequest:         return QLatin1String("DeleteStandaloneSecretRequest");
+        case GetCollectionSecretsRequest:           return QLatin1String("GetCollectionSecretsRequest");
+        case SetCollectionSecretsRequest:           return QLatin1String("SetCollectionSecretsRequest");
+        case SetCollectionSecretFdRequest:          return QLatin1String("SetCollectionSecretFdRequest");
+        case GetCollectionSecretFdRequest:          return QLatin1String("GetCollectionSecretFdRequest");
+        case SetCollectionPrefetchOnUnlockRequest:  return QLatin1String("SetCollectionPrefetchOnUnlockRequest");
+        case ModifyDeviceLockKeyRequest:            return QLatin1String("ModifyDeviceLockKeyRequest");
+        case CollectionNamesRequest:                return QLatin1String("CollectionNamesRequest");
+        case SecretNamesRequest:                    return QLatin1String("SecretNamesRequest");
+        case ExportSecretsRequest:                  return QLatin1String("ExportSecretsRequest");
+        case ImportSecretsRequest:                  return QLatin1String("ImportSecretsRequest");
         default: break;
     }
     return QLatin1String("Unknown Secrets Request!");
 }
 
+bool Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::isPriorityRequest(
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const
+{
+    switch (request->type) {
+        case GetPluginInfoRequest:
+        case CollectionNamesRequest:
+            return true;
+        case GetCollectionSecretRequest:
+        case GetCollectionSecretFdRequest:
+        case GetCollectionSecretsRequest:
+        case SecretNamesRequest:
+            // reads from an already-unlocked collection don't require user interaction.
+            return request->inParams.size()
+                && m_requestProcessor->collectionIsUnlocked(request->inParams.first().value<QString>());
+        default:
+            return false;
+    }
+}
+
+QVariantMap Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::statistics() const
+{
+    QVariantMap stats = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::statistics();
+    stats.insert(QStringLiteral("databaseCommitLatency"), m_db.commitLatency().toVariantMap());
+    stats.insert(QStringLiteral("databaseIntegrityStatus"), static_cast<int>(m_db.integrityStatus()));
+    stats.insert(QStringLiteral("databaseIntegrityCheckDurationMs"), m_db.integrityCheckDurationMs());
+    stats.insert(QStringLiteral("databaseStatements"), Sailfish::Secrets::Daemon::ApiImpl::Database::statementStatistics());
+    return stats;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::memoryUsage(QMap<QString, qint64> *usage) const
+{
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::memoryUsage(usage);
+    m_requestProcessor->memoryUsage(usage);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::releaseMemory()
+{
+    m_requestProcessor->releaseMemory();
+    m_db.releaseMemory();
+}
+
+int Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::performMaintenance(int pageBudget)
+{
+    // plugins sharing the daemon's connection must not be maintained
+    // while the daemon's own transactions are open.
+    const int pages = m_db.performMaintenance(pageBudget);
+    if (pages < 0) {
+        return pages;
+    }
+    const int pluginPages = m_requestProcessor->performMaintenance(pageBudget - pages);
+    return pluginPages < 0 ? -1 : pages + pluginPages;
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::isIdle() const
+{
+    // the keys of custom lock collections would be lost, so clients would have to unlock them again.
+    return Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::isIdle()
+            && !groupCommitPending()
+            && !m_requestProcessor->customLockKeysHeld();
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::prepareWarmRestart()
+{
+    m_db.setWarmStartSnapshot(true);
+}
+
+qint64 Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::parameterSize(const QVariant &parameter) const
+{
+    if (parameter.userType() == qMetaTypeId<QMap<QString, QByteArray> >()) {
+        const QMap<QString, QByteArray> secrets = parameter.value<QMap<QString, QByteArray> >();
+        qint64 size = 0;
+        for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); it++) {
+            size += it.key().size() * sizeof(QChar) + it.value().size();
+        }
+        return size;
+    }
+    return Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::parameterSize(parameter);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleCancelledRequest(
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request)
+{
+    m_requestProcessor->cancelPendingRequest(request->requestId);
+}
+
+QString Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::coalescingKey(
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const
+{
+    // requests performed on behalf of the crypto daemon are completed via
+    // asynchronousCryptoRequestCompleted() rather than requestFinished().
+    if (request->isSecretsCryptoRequest) {
+        return QString();
+    }
+
+    switch (request->type) {
+        case GetCollectionSecretRequest: {
+            if (request->inParams.size() != 4) {
+                return QString();
+            }
+            return QStringLiteral("%1:%2:%3:%4:%5:%6")
+                    .arg(request->type)
+                    .arg(request->remotePid)
+                    .arg(static_cast<int>(request->inParams.at(2).value<Sailfish::Secrets::SecretManager::UserInteractionMode>()))
+                    .arg(request->inParams.at(3).value<QString>(),
+                         request->inParams.at(0).value<QString>(),
+                         request->inParams.at(1).value<QString>());
+        }
+        case GetStandaloneSecretRequest: {
+            if (request->inParams.size() != 3) {
+                return QString();
+            }
+            return QStringLiteral("%1:%2:%3:%4:%5")
+                    .arg(request->type)
+                    .arg(request->remotePid)
+                    .arg(static_cast<int>(request->inParams.at(1).value<Sailfish::Secrets::SecretManager::UserInteractionMode>()))
+                    .arg(request->inParams.at(2).value<QString>(),
+                         request->inParams.at(0).value<QString>());
+        }
+        default:
+            return QString();
+    }
+}
+
 void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingRequest(
         Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request,
         bool *completed)
@@ -357,11 +928,11 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
-                                                                            << QVariant::fromValue<QVector<Sailfish::Secrets::StoragePluginInfo> >(storagePlugins)
-                                                                            << QVariant::fromValue<QVector<Sailfish::Secrets::EncryptionPluginInfo> >(encryptionPlugins)
-                                                                            << QVariant::fromValue<QVector<Sailfish::Secrets::EncryptedStoragePluginInfo> >(encryptedStoragePlugins)
-                                                                            << QVariant::fromValue<QVector<Sailfish::Secrets::AuthenticationPluginInfo> >(authenticationPlugins));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                    << QVariant::fromValue<QVector<Sailfish::Secrets::StoragePluginInfo> >(storagePlugins)
+                                                                                    << QVariant::fromValue<QVector<Sailfish::Secrets::EncryptionPluginInfo> >(encryptionPlugins)
+                                                                                    << QVariant::fromValue<QVector<Sailfish::Secrets::EncryptedStoragePluginInfo> >(encryptedStoragePlugins)
+                                                                                    << QVariant::fromValue<QVector<Sailfish::Secrets::AuthenticationPluginInfo> >(authenticationPlugins), request->message);
                 }
                 *completed = true;
             }
@@ -378,6 +949,9 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
             Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode = request->inParams.size()
                     ? request->inParams.takeFirst().value<Sailfish::Secrets::SecretManager::AccessControlMode>()
                     : Sailfish::Secrets::SecretManager::OwnerOnlyMode;
+            Sailfish::Secrets::StoragePlugin::Durability durability = request->inParams.size()
+                    ? request->inParams.takeFirst().value<Sailfish::Secrets::StoragePlugin::Durability>()
+                    : Sailfish::Secrets::StoragePlugin::FullDurability;
             Sailfish::Secrets::Result result = m_requestProcessor->createDeviceLockCollection(
                         request->remotePid,
                         request->requestId,
@@ -385,7 +959,8 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                         storagePluginName,
                         encryptionPluginName,
                         unlockSemantic,
-                        accessControlMode);
+                        accessControlMode,
+                        durability);
             // send the reply to the calling peer.
             if (result.code() == Sailfish::Secrets::Result::Pending) {
                 // waiting for asynchronous flow to complete
@@ -394,7 +969,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -417,6 +992,9 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                     ? request->inParams.takeFirst().value<Sailfish::Secrets::SecretManager::UserInteractionMode>()
                     : Sailfish::Secrets::SecretManager::PreventUserInteractionMode;
             QString uiServiceAddress = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Secrets::StoragePlugin::Durability durability = request->inParams.size()
+                    ? request->inParams.takeFirst().value<Sailfish::Secrets::StoragePlugin::Durability>()
+                    : Sailfish::Secrets::StoragePlugin::FullDurability;
             Sailfish::Secrets::Result result = m_requestProcessor->createCustomLockCollection(
                         request->remotePid,
                         request->requestId,
@@ -428,7 +1006,8 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                         customLockTimeoutMs,
                         accessControlMode,
                         userInteractionMode,
-                        uiServiceAddress);
+                        uiServiceAddress,
+                        durability);
             // send the reply to the calling peer.
             if (result.code() == Sailfish::Secrets::Result::Pending) {
                 // waiting for asynchronous flow to complete
@@ -437,7 +1016,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -462,7 +1041,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -493,7 +1072,196 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
+                }
+                *completed = true;
+            }
+            break;
+        }
+        case SetCollectionSecretFdRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling SetCollectionSecretFdRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QString collectionName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            QString secretName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            QVariant secretPayload = request->inParams.size() ? request->inParams.takeFirst() : QVariant();
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode = request->inParams.size()
+                    ? request->inParams.takeFirst().value<Sailfish::Secrets::SecretManager::UserInteractionMode>()
+                    : Sailfish::Secrets::SecretManager::PreventUserInteractionMode;
+            QString uiServiceAddress = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            // the secret refers directly to the mapped memfd, which is unmapped when this scope exits.
+            Sailfish::Secrets::Daemon::MappedMemfd mapping;
+            QByteArray secret;
+            QString errorString;
+            Sailfish::Secrets::Result result = Sailfish::Secrets::Daemon::payloadData(secretPayload, &mapping, &secret, &errorString)
+                    ? m_requestProcessor->setCollectionSecret(
+                              request->remotePid,
+                              request->requestId,
+                              collectionName,
+                              secretName,
+                              secret,
+                              userInteractionMode,
+                              uiServiceAddress)
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError, errorString);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Secrets::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case GetCollectionSecretFdRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling GetCollectionSecretFdRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QString collectionName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            QString secretName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode = request->inParams.size()
+                    ? request->inParams.takeFirst().value<Sailfish::Secrets::SecretManager::UserInteractionMode>()
+                    : Sailfish::Secrets::SecretManager::PreventUserInteractionMode;
+            QString uiServiceAddress = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            QByteArray secret;
+            Sailfish::Secrets::Result result = m_requestProcessor->getCollectionSecret(
+                        request->remotePid,
+                        request->requestId,
+                        collectionName,
+                        secretName,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        &secret);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Secrets::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                QDBusUnixFileDescriptor secretFd;
+                QString errorString;
+                if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+                    secretFd = Sailfish::Secrets::Daemon::createSealedMemfd(secret, &errorString);
+                    if (!secretFd.isValid()) {
+                        result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError, errorString);
+                    }
+                }
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                << QVariant::fromValue<QDBusUnixFileDescriptor>(secretFd), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case SetCollectionPrefetchOnUnlockRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling SetCollectionPrefetchOnUnlockRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QString collectionName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            bool prefetchOnUnlock = request->inParams.size() ? request->inParams.takeFirst().value<bool>() : false;
+            Sailfish::Secrets::Result result = m_requestProcessor->setCollectionPrefetchOnUnlock(
+                        request->remotePid,
+                        request->requestId,
+                        collectionName,
+                        prefetchOnUnlock);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
+            *completed = true;
+            break;
+        }
+        case ModifyDeviceLockKeyRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling ModifyDeviceLockKeyRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QByteArray oldDeviceLockKey = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
+            QByteArray newDeviceLockKey = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
+            Sailfish::Secrets::Result result = m_requestProcessor->modifyDeviceLockKey(
+                        request->remotePid,
+                        request->requestId,
+                        oldDeviceLockKey,
+                        newDeviceLockKey);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
+            *completed = true;
+            break;
+        }
+        case CollectionNamesRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling CollectionNamesRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QStringList collectionNames;
+            Sailfish::Secrets::Result result = m_requestProcessor->collectionNames(
+                        request->remotePid,
+                        request->requestId,
+                        &collectionNames);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                            << QVariant::fromValue<QStringList>(collectionNames), request->message);
+            *completed = true;
+            break;
+        }
+        case SecretNamesRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling SecretNamesRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QString collectionName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            qint64 cursor = request->inParams.size() ? request->inParams.takeFirst().value<qint64>() : 0;
+            int limit = request->inParams.size() ? request->inParams.takeFirst().value<int>() : 0;
+            QStringList secretNames;
+            qint64 nextCursor = 0;
+            Sailfish::Secrets::Result result = m_requestProcessor->secretNames(
+                        request->remotePid,
+                        request->requestId,
+                        collectionName,
+                        cursor,
+                        limit,
+                        &secretNames,
+                        &nextCursor);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                            << QVariant::fromValue<QStringList>(secretNames)
+                                                                            << QVariant::fromValue<qint64>(nextCursor), request->message);
+            *completed = true;
+            break;
+        }
+        case ExportSecretsRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling ExportSecretsRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QDBusUnixFileDescriptor archive = request->inParams.size() ? request->inParams.takeFirst().value<QDBusUnixFileDescriptor>() : QDBusUnixFileDescriptor();
+            QByteArray archiveKey = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
+            int exportedCount = 0;
+            Sailfish::Secrets::Result result = m_requestProcessor->exportSecrets(
+                        request->remotePid,
+                        request->requestId,
+                        archive,
+                        archiveKey,
+                        &exportedCount);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                            << QVariant::fromValue<int>(exportedCount), request->message);
+            *completed = true;
+            break;
+        }
+        case ImportSecretsRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling ImportSecretsRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QDBusUnixFileDescriptor archive = request->inParams.size() ? request->inParams.takeFirst().value<QDBusUnixFileDescriptor>() : QDBusUnixFileDescriptor();
+            QByteArray archiveKey = request->inParams.size() ? request->inParams.takeFirst().value<QByteArray>() : QByteArray();
+            int importedCount = 0;
+            Sailfish::Secrets::Result result = m_requestProcessor->importSecrets(
+                        request->remotePid,
+                        request->requestId,
+                        archive,
+                        archiveKey,
+                        &importedCount);
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                            << QVariant::fromValue<int>(importedCount), request->message);
+            *completed = true;
+            break;
+        }
+        case SetCollectionSecretsRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling SetCollectionSecretsRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QString collectionName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            QMap<QString, QByteArray> secrets = request->inParams.size() ? request->inParams.takeFirst().value<QMap<QString, QByteArray> >() : QMap<QString, QByteArray>();
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode = request->inParams.size()
+                    ? request->inParams.takeFirst().value<Sailfish::Secrets::SecretManager::UserInteractionMode>()
+                    : Sailfish::Secrets::SecretManager::PreventUserInteractionMode;
+            QString uiServiceAddress = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            Sailfish::Secrets::Result result = m_requestProcessor->setCollectionSecrets(
+                        request->remotePid,
+                        request->requestId,
+                        collectionName,
+                        secrets,
+                        userInteractionMode,
+                        uiServiceAddress);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Secrets::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                if (request->isSecretsCryptoRequest) {
+                    asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
+                } else {
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -532,7 +1300,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -577,7 +1345,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -608,8 +1376,45 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList() << QVariant::fromValue<QByteArray>(secret));
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
-                                                                            << QVariant::fromValue<QByteArray>(secret));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                    << QVariant::fromValue<QByteArray>(secret), request->message);
+                    if (!request->coalescingKey.isEmpty()) {
+                        // share the result with any identical requests.
+                        request->outParams << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                           << QVariant::fromValue<QByteArray>(secret);
+                    }
+                }
+                *completed = true;
+            }
+            break;
+        }
+        case GetCollectionSecretsRequest: {
+            qCDebug(lcSailfishSecretsDaemon) << "Handling GetCollectionSecretsRequest from client:" << request->remotePid << ", request number:" << request->requestId;
+            QString collectionName = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            QStringList secretNames = request->inParams.size() ? request->inParams.takeFirst().value<QStringList>() : QStringList();
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode = request->inParams.size()
+                    ? request->inParams.takeFirst().value<Sailfish::Secrets::SecretManager::UserInteractionMode>()
+                    : Sailfish::Secrets::SecretManager::PreventUserInteractionMode;
+            QString uiServiceAddress = request->inParams.size() ? request->inParams.takeFirst().value<QString>() : QString();
+            QMap<QString, QByteArray> secrets;
+            Sailfish::Secrets::Result result = m_requestProcessor->getCollectionSecrets(
+                        request->remotePid,
+                        request->requestId,
+                        collectionName,
+                        secretNames,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        &secrets);
+            // send the reply to the calling peer.
+            if (result.code() == Sailfish::Secrets::Result::Pending) {
+                // waiting for asynchronous flow to complete
+                *completed = false;
+            } else {
+                if (request->isSecretsCryptoRequest) {
+                    asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList() << QVariant::fromValue<QMap<QString, QByteArray> >(secrets));
+                } else {
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                    << QVariant::fromValue<QMap<QString, QByteArray> >(secrets), request->message);
                 }
                 *completed = true;
             }
@@ -638,8 +1443,13 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList() << QVariant::fromValue<QByteArray>(secret));
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
-                                                                            << QVariant::fromValue<QByteArray>(secret));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                    << QVariant::fromValue<QByteArray>(secret), request->message);
+                    if (!request->coalescingKey.isEmpty()) {
+                        // share the result with any identical requests.
+                        request->outParams << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                           << QVariant::fromValue<QByteArray>(secret);
+                    }
                 }
                 *completed = true;
             }
@@ -668,7 +1478,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -693,7 +1503,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handlePendingReque
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -729,8 +1539,8 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList() << QVariant::fromValue<QByteArray>(secret));
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
-                                                                            << QVariant::fromValue<QByteArray>(secret));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                    << QVariant::fromValue<QByteArray>(secret), request->message);
                 }
                 *completed = true;
             }
@@ -749,7 +1559,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -768,7 +1578,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -787,7 +1597,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -806,7 +1616,142 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
+                }
+                *completed = true;
+            }
+            break;
+        }
+        case SetCollectionSecretFdRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of SetCollectionSecretFdRequest request"));
+            if (result.code() == Sailfish::Secrets::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishSecretsDaemon) << "SetCollectionSecretFdRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case GetCollectionSecretFdRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of GetCollectionSecretFdRequest request"));
+            if (result.code() == Sailfish::Secrets::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishSecretsDaemon) << "GetCollectionSecretFdRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QByteArray secret = request->outParams.size()
+                        ? request->outParams.takeFirst().toByteArray()
+                        : QByteArray();
+                QDBusUnixFileDescriptor secretFd;
+                QString errorString;
+                if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+                    secretFd = Sailfish::Secrets::Daemon::createSealedMemfd(secret, &errorString);
+                    if (!secretFd.isValid()) {
+                        result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError, errorString);
+                    }
+                }
+                sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                << QVariant::fromValue<QDBusUnixFileDescriptor>(secretFd), request->message);
+                *completed = true;
+            }
+            break;
+        }
+        case SetCollectionPrefetchOnUnlockRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of SetCollectionPrefetchOnUnlockRequest request"));
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
+            *completed = true;
+            break;
+        }
+        case ModifyDeviceLockKeyRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of ModifyDeviceLockKeyRequest request"));
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
+            *completed = true;
+            break;
+        }
+        case CollectionNamesRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of CollectionNamesRequest request"));
+            QStringList collectionNames = request->outParams.size()
+                    ? request->outParams.takeFirst().value<QStringList>()
+                    : QStringList();
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                            << QVariant::fromValue<QStringList>(collectionNames), request->message);
+            *completed = true;
+            break;
+        }
+        case SecretNamesRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of SecretNamesRequest request"));
+            QStringList secretNames = request->outParams.size()
+                    ? request->outParams.takeFirst().value<QStringList>()
+                    : QStringList();
+            qint64 nextCursor = request->outParams.size()
+                    ? request->outParams.takeFirst().value<qint64>()
+                    : 0;
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                            << QVariant::fromValue<QStringList>(secretNames)
+                                                                            << QVariant::fromValue<qint64>(nextCursor), request->message);
+            *completed = true;
+            break;
+        }
+        case ExportSecretsRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of ExportSecretsRequest request"));
+            int exportedCount = request->outParams.size()
+                    ? request->outParams.takeFirst().value<int>()
+                    : 0;
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                            << QVariant::fromValue<int>(exportedCount), request->message);
+            *completed = true;
+            break;
+        }
+        case ImportSecretsRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of ImportSecretsRequest request"));
+            int importedCount = request->outParams.size()
+                    ? request->outParams.takeFirst().value<int>()
+                    : 0;
+            sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                            << QVariant::fromValue<int>(importedCount), request->message);
+            *completed = true;
+            break;
+        }
+        case SetCollectionSecretsRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of SetCollectionSecretsRequest request"));
+            if (result.code() == Sailfish::Secrets::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishSecretsDaemon) << "SetCollectionSecretsRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                if (request->isSecretsCryptoRequest) {
+                    asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
+                } else {
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -825,7 +1770,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -844,7 +1789,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -866,8 +1811,31 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList() << QVariant::fromValue<QByteArray>(secret));
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
-                                                                            << QVariant::fromValue<QByteArray>(secret));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                    << QVariant::fromValue<QByteArray>(secret), request->message);
+                }
+                *completed = true;
+            }
+            break;
+        }
+        case GetCollectionSecretsRequest: {
+            Sailfish::Secrets::Result result = request->outParams.size()
+                    ? request->outParams.takeFirst().value<Sailfish::Secrets::Result>()
+                    : Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                QLatin1String("Unable to determine result of GetCollectionSecretsRequest request"));
+            if (result.code() == Sailfish::Secrets::Result::Pending) {
+                // shouldn't happen!
+                qCWarning(lcSailfishSecretsDaemon) << "GetCollectionSecretsRequest:" << request->requestId << "finished as pending!";
+                *completed = true;
+            } else {
+                QMap<QString, QByteArray> secrets = request->outParams.size()
+                        ? request->outParams.takeFirst().value<QMap<QString, QByteArray> >()
+                        : QMap<QString, QByteArray>();
+                if (request->isSecretsCryptoRequest) {
+                    asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList() << QVariant::fromValue<QMap<QString, QByteArray> >(secrets));
+                } else {
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                    << QVariant::fromValue<QMap<QString, QByteArray> >(secrets), request->message);
                 }
                 *completed = true;
             }
@@ -889,8 +1857,8 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList() << QVariant::fromValue<QByteArray>(secret));
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
-                                                                            << QVariant::fromValue<QByteArray>(secret));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result)
+                                                                                    << QVariant::fromValue<QByteArray>(secret), request->message);
                 }
                 *completed = true;
             }
@@ -909,7 +1877,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -928,7 +1896,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::handleFinishedRequ
                 if (request->isSecretsCryptoRequest) {
                     asynchronousCryptoRequestCompleted(request->cryptoRequestId, result, QVariantList());
                 } else {
-                    request->connection.send(request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result));
+                    sendMessage(request->connection, request->message.createReply() << QVariant::fromValue<Sailfish::Secrets::Result>(result), request->message);
                 }
                 *completed = true;
             }
@@ -20,6 +20,9 @@
 #include "Crypto/key.h"
 
 #include <QtDBus/QDBusContext>
+#include <QtDBus/QDBusUnixFileDescriptor>
+
+#include <QtCore/QTimer>
 
 namespace Sailfish {
 
@@ -48,15 +51,27 @@ class SecretsDBusObject : public QObject, protected QDBusContext
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out3\" value=\"QVector<Sailfish::Secrets::EncryptedStoragePluginInfo>\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out4\" value=\"QVector<Sailfish::Secrets::AuthenticationPluginInfo>\" />\n"
     "      </method>\n"
+    "      <method name=\"getPluginInfoGeneration\">\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <arg name=\"generation\" type=\"t\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"setNextRequestDeadline\">\n"
+    "          <arg name=\"method\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"timeoutMsecs\" type=\"x\" direction=\"in\" />\n"
+    "          <annotation name=\"org.freedesktop.DBus.Method.NoReply\" value=\"true\" />\n"
+    "      </method>\n"
     "      <method name=\"createCollection\">\n"
     "          <arg name=\"collectionName\" type=\"s\" direction=\"in\" />\n"
     "          <arg name=\"storagePluginName\" type=\"s\" direction=\"in\" />\n"
     "          <arg name=\"encryptionPluginName\" type=\"s\" direction=\"in\" />\n"
     "          <arg name=\"unlockSemantic\" type=\"i\" direction=\"in\" />\n"
     "          <arg name=\"accessControlMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"durability\" type=\"i\" direction=\"in\" />\n"
     "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Secrets::SecretManager::AccessControlMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In5\" value=\"Sailfish::Secrets::StoragePlugin::Durability\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
     "      </method>\n"
     "      <method name=\"createCollection\">\n"
@@ -69,10 +84,12 @@ class SecretsDBusObject : public QObject, protected QDBusContext
     "          <arg name=\"accessControlMode\" type=\"i\" direction=\"in\" />\n"
     "          <arg name=\"userInteractionMode\" type=\"i\" direction=\"in\" />\n"
     "          <arg name=\"uiServiceAddress\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"durability\" type=\"i\" direction=\"in\" />\n"
     "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In4\" value=\"Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In6\" value=\"Sailfish::Secrets::SecretManager::AccessControlMode\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In7\" value=\"Sailfish::Secrets::SecretManager::UserInteractionMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In9\" value=\"Sailfish::Secrets::StoragePlugin::Durability\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
     "      </method>\n"
     "      <method name=\"deleteCollection\">\n"
@@ -93,6 +110,26 @@ class SecretsDBusObject : public QObject, protected QDBusContext
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Secrets::SecretManager::UserInteractionMode\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
     "      </method>\n"
+    "      <method name=\"setSecretFd\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"secretName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"secret\" type=\"h\" direction=\"in\" />\n"
+    "          <arg name=\"userInteractionMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"uiServiceAddress\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In3\" value=\"Sailfish::Secrets::SecretManager::UserInteractionMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"setSecrets\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"secrets\" type=\"a{say}\" direction=\"in\" />\n"
+    "          <arg name=\"userInteractionMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"uiServiceAddress\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"QMap<QString,QByteArray>\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Secrets::SecretManager::UserInteractionMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
     "      <method name=\"setSecret\">\n"
     "          <arg name=\"storagePluginName\" type=\"s\" direction=\"in\" />\n"
     "          <arg name=\"encryptionPluginName\" type=\"s\" direction=\"in\" />\n"
@@ -143,6 +180,27 @@ class SecretsDBusObject : public QObject, protected QDBusContext
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Secrets::SecretManager::UserInteractionMode\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
     "      </method>\n"
+    "      <method name=\"getSecretFd\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"secretName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"userInteractionMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"uiServiceAddress\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <arg name=\"secret\" type=\"h\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Secrets::SecretManager::UserInteractionMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"getSecrets\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"secretNames\" type=\"as\" direction=\"in\" />\n"
+    "          <arg name=\"userInteractionMode\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"uiServiceAddress\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <arg name=\"secrets\" type=\"a{say}\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"Sailfish::Secrets::SecretManager::UserInteractionMode\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out1\" value=\"QMap<QString,QByteArray>\" />\n"
+    "      </method>\n"
     "      <method name=\"deleteSecret\">\n"
     "          <arg name=\"collectionName\" type=\"s\" direction=\"in\" />\n"
     "          <arg name=\"secretName\" type=\"s\" direction=\"in\" />\n"
@@ -159,6 +217,65 @@ class SecretsDBusObject : public QObject, protected QDBusContext
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"Sailfish::Secrets::SecretManager::UserInteractionMode\" />\n"
     "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
     "      </method>\n"
+    "      <method name=\"cancelRequests\">\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"setCollectionPrefetchOnUnlock\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"prefetchOnUnlock\" type=\"b\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"modifyDeviceLockKey\">\n"
+    "          <arg name=\"oldDeviceLockKey\" type=\"ay\" direction=\"in\" />\n"
+    "          <arg name=\"newDeviceLockKey\" type=\"ay\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"collectionNames\">\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <arg name=\"collectionNames\" type=\"as\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"secretNames\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" direction=\"in\" />\n"
+    "          <arg name=\"cursor\" type=\"x\" direction=\"in\" />\n"
+    "          <arg name=\"limit\" type=\"i\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <arg name=\"secretNames\" type=\"as\" direction=\"out\" />\n"
+    "          <arg name=\"nextCursor\" type=\"x\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"exportSecrets\">\n"
+    "          <arg name=\"archive\" type=\"h\" direction=\"in\" />\n"
+    "          <arg name=\"archiveKey\" type=\"ay\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <arg name=\"exportedCount\" type=\"i\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"importSecrets\">\n"
+    "          <arg name=\"archive\" type=\"h\" direction=\"in\" />\n"
+    "          <arg name=\"archiveKey\" type=\"ay\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <arg name=\"importedCount\" type=\"i\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <method name=\"subscribeNotifications\">\n"
+    "          <arg name=\"collectionNames\" type=\"as\" direction=\"in\" />\n"
+    "          <arg name=\"result\" type=\"(iis)\" direction=\"out\" />\n"
+    "          <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"Sailfish::Secrets::Result\" />\n"
+    "      </method>\n"
+    "      <signal name=\"collectionLocked\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" />\n"
+    "      </signal>\n"
+    "      <signal name=\"collectionUnlocked\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" />\n"
+    "      </signal>\n"
+    "      <signal name=\"secretChanged\">\n"
+    "          <arg name=\"collectionName\" type=\"s\" />\n"
+    "          <arg name=\"secretName\" type=\"s\" />\n"
+    "      </signal>\n"
     "  </interface>\n"
     "")
 
@@ -175,6 +292,19 @@ public Q_SLOTS:
             QVector<Sailfish::Secrets::EncryptedStoragePluginInfo> &encryptedStoragePlugins,
             QVector<Sailfish::Secrets::AuthenticationPluginInfo> &authenticationPlugins);
 
+    // changes only when plugins are installed, updated or removed, so that
+    // clients may validate their cached plugin info without fetching it.
+    void getPluginInfoGeneration(
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result,
+            quint64 &generation);
+
+    // the deadline of the next request sent via this connection, see RequestQueue::setNextRequestDeadline().
+    void setNextRequestDeadline(
+            const QString &method,
+            qint64 timeoutMsecs,
+            const QDBusMessage &message);
+
     // create a DeviceLock-protected collection
     void createCollection(
             const QString &collectionName,
@@ -182,6 +312,7 @@ public Q_SLOTS:
             const QString &encryptionPluginName,
             Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic unlockSemantic,
             Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+            Sailfish::Secrets::StoragePlugin::Durability durability,
             const QDBusMessage &message,
             Sailfish::Secrets::Result &result);
 
@@ -196,6 +327,7 @@ public Q_SLOTS:
             Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
             Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
             const QString &uiServiceAddress,
+            Sailfish::Secrets::StoragePlugin::Durability durability,
             const QDBusMessage &message,
             Sailfish::Secrets::Result &result);
 
@@ -216,6 +348,25 @@ public Q_SLOTS:
             const QDBusMessage &message,
             Sailfish::Secrets::Result &result);
 
+    // set a secret in a collection, passed as a sealed memfd
+    void setSecretFd(
+            const QString &collectionName,
+            const QString &secretName,
+            const QDBusUnixFileDescriptor &secret,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            const QString &uiServiceAddress,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result);
+
+    // set multiple secrets in a collection
+    void setSecrets(
+            const QString &collectionName,
+            const QMap<QString, QByteArray> &secrets,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            const QString &uiServiceAddress,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result);
+
     // set a standalone DeviceLock-protected secret
     void setSecret(
             const QString &storagePluginName,
@@ -262,6 +413,26 @@ public Q_SLOTS:
             Sailfish::Secrets::Result &result,
             QByteArray &secret);
 
+    // get a secret in a collection, returned as a sealed memfd
+    void getSecretFd(
+            const QString &collectionName,
+            const QString &secretName,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            const QString &uiServiceAddress,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result,
+            QDBusUnixFileDescriptor &secret);
+
+    // get multiple secrets in a collection
+    void getSecrets(
+            const QString &collectionName,
+            const QStringList &secretNames,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            const QString &uiServiceAddress,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result,
+            QMap<QString, QByteArray> &secrets);
+
     // delete a secret in a collection
     void deleteSecret(
             const QString &collectionName,
@@ -278,6 +449,64 @@ public Q_SLOTS:
             const QDBusMessage &message,
             Sailfish::Secrets::Result &result);
 
+    // cancel all of the caller's outstanding requests
+    void cancelRequests(
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result);
+
+    // read and decrypt all of the secrets in the collection whenever it is unlocked
+    void setCollectionPrefetchOnUnlock(
+            const QString &collectionName,
+            bool prefetchOnUnlock,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result);
+
+    // change the device lock key, rewrapping the data keys of the device lock collections
+    void modifyDeviceLockKey(
+            const QByteArray &oldDeviceLockKey,
+            const QByteArray &newDeviceLockKey,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result);
+
+    // get the names of the collections owned by the caller
+    void collectionNames(
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result,
+            QStringList &collectionNames);
+
+    // get a page of the names of the secrets in a collection
+    void secretNames(
+            const QString &collectionName,
+            qint64 cursor,
+            int limit,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result,
+            QStringList &secretNames,
+            qint64 &nextCursor);
+
+    // write the caller's collections and secrets to an encrypted archive
+    void exportSecrets(
+            const QDBusUnixFileDescriptor &archive,
+            const QByteArray &archiveKey,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result,
+            int &exportedCount);
+
+    // restore the collections and secrets of an encrypted archive
+    void importSecrets(
+            const QDBusUnixFileDescriptor &archive,
+            const QByteArray &archiveKey,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result,
+            int &importedCount);
+
+    // receive the collectionLocked, collectionUnlocked and secretChanged
+    // signals for the given collections.  Replaces any previous subscription.
+    void subscribeNotifications(
+            const QStringList &collectionNames,
+            const QDBusMessage &message,
+            Sailfish::Secrets::Result &result);
+
 private:
     Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue *m_requestQueue;
 };
@@ -294,23 +523,102 @@ public:
     void handlePendingRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, bool *completed) Q_DECL_OVERRIDE;
     void handleFinishedRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, bool *completed) Q_DECL_OVERRIDE;
     QString requestTypeToString(int type) const Q_DECL_OVERRIDE;
+    bool isPriorityRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const Q_DECL_OVERRIDE;
+    QString coalescingKey(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const Q_DECL_OVERRIDE;
+    QVariantMap statistics() const Q_DECL_OVERRIDE;
+    void memoryUsage(QMap<QString, qint64> *usage) const Q_DECL_OVERRIDE;
+    void releaseMemory() Q_DECL_OVERRIDE;
+    bool isIdle() const Q_DECL_OVERRIDE;
+    int performMaintenance(int pageBudget) Q_DECL_OVERRIDE;
+    qint64 parameterSize(const QVariant &parameter) const Q_DECL_OVERRIDE;
+    void handleCancelledRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) Q_DECL_OVERRIDE;
+
+    // Called before an idle exit, so that the next start can skip the integrity
+    // check of the database.  See Database::setWarmStartSnapshot().
+    void prepareWarmRestart();
+
+    // Caller identities are cached for as long as the caller has a connection to the daemon.
+    void handleClientConnected(pid_t callerPid);
+    void handleClientDisconnected(pid_t callerPid);
+
+    // see RequestProcessor::pluginInfoGeneration().
+    quint64 pluginInfoGeneration() const;
+
+    // Clients only receive notifications for the collections they have subscribed to,
+    // and which they are permitted to access.  An empty list of names unsubscribes.
+    void setNotificationSubscription(pid_t callerPid, const QDBusConnection &connection, const QStringList &collectionNames);
+    void notifyCollectionLockStateChanged(const QString &collectionName, bool locked);
+    void notifySecretChanged(const QString &collectionName, const QString &secretName);
+
+    // The crypto daemon keeps keys read from storage until the secrets
+    // which hold them change, or their collection is locked or deleted.
+    // An empty secret name means every secret in the collection, and an
+    // empty collection name every secret.
+    void invalidateStoredKeys(const QString &collectionName, const QString &secretName = QString());
+
+    // Opt-in cache of decrypted secrets for unlocked collections.  Zero (the default) disables it.
+    void setSecretCacheCapacity(qint64 bytes);
+
+    // Collection secrets larger than this are encrypted and stored in chunks of it.  Zero stores them whole.
+    void setSecretChunkSize(int bytes);
+
+    // Reads the secrets named in the given manifest into the secret cache,
+    // see PreloadManifest.  Does nothing if the manifest doesn't exist.
+    void preloadSecrets(const QString &manifestPath);
+
+    // Storage plugins which support it write via the master database connection,
+    // so that each secret is committed atomically with its metadata.
+    void setSharedStorageTransactions(bool enabled);
+
+    // Writes made within windowMs of each other (up to maxBatch replies) are
+    // committed together, and the replies to those requests are withheld
+    // until the commit succeeds.  A window of zero (the default) disables this.
+    void setGroupCommit(int windowMs, int maxBatch);
+    bool groupCommitPending() const;
+    void scheduleGroupCommit(int pendingMessages);
+
+Q_SIGNALS:
+    void groupCommitFinished(bool succeeded);
+
+public Q_SLOTS:
+    void flushGroupCommit();
+
+protected:
+    bool messagesDeferred() const Q_DECL_OVERRIDE;
+    void messageDeferred() Q_DECL_OVERRIDE;
 
 private:
+    struct NotificationSubscription {
+        NotificationSubscription() : callerPid(0), connection(QString::fromUtf8("org.sailfishos.secrets.daemon.invalidConnection")) {}
+        pid_t callerPid;
+        QDBusConnection connection;
+        QSet<QString> collectionNames;
+    };
+    void sendNotification(const QString &collectionName, const QString &signalName, const QVariantList &arguments);
+
     Sailfish::Secrets::Daemon::ApiImpl::Database m_db;
     Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions *m_appPermissions;
     Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor *m_requestProcessor;
+    QHash<QString, NotificationSubscription> m_notificationSubscriptions; // connection name to subscription
+    QTimer m_groupCommitTimer;
+    int m_groupCommitWindowMs;
+    int m_groupCommitMaxBatch;
 
 public: // Crypto API helper methods.
     // these methods are provided in order to implement Crypto functionality
     // while using just one single database (for atomicity etc).
     void asynchronousCryptoRequestCompleted(quint64 cryptoRequestId, const Sailfish::Secrets::Result &result, const QVariantList &parameters);
     // the first methods are synchronous:
+    QString applicationId(pid_t callerPid) const Q_DECL_OVERRIDE;
     Sailfish::Secrets::Result storagePluginNames(pid_t callerPid, quint64 cryptoRequestId, QStringList *names) const;
     Sailfish::Secrets::Result keyEntryIdentifiers(pid_t callerPid, quint64 cryptoRequestId, QVector<Sailfish::Crypto::Key::Identifier> *identifiers);
+    Sailfish::Secrets::Result keyEntryIdentifiers(pid_t callerPid, quint64 cryptoRequestId, qint64 cursor, int limit, QVector<Sailfish::Crypto::Key::Identifier> *identifiers, qint64 *nextCursor);
+    Sailfish::Secrets::Result findKeyEntries(pid_t callerPid, quint64 cryptoRequestId, const Sailfish::Crypto::Key::FilterData &filter, QVector<Sailfish::Crypto::Key::Identifier> *identifiers);
     Sailfish::Secrets::Result keyEntry(pid_t callerPid, quint64 cryptoRequestId, const Sailfish::Crypto::Key::Identifier &identifier, QString *cryptoPluginName, QString *storagePluginName);
-    Sailfish::Secrets::Result addKeyEntry(pid_t callerPid, quint64 cryptoRequestId, const Sailfish::Crypto::Key::Identifier &identifier, const QString &cryptoPluginName, const QString &storagePluginName);
+    Sailfish::Secrets::Result addKeyEntry(pid_t callerPid, quint64 cryptoRequestId, const Sailfish::Crypto::Key::Identifier &identifier, const QString &cryptoPluginName, const QString &storagePluginName, const Sailfish::Crypto::Key::FilterData &filterData);
     Sailfish::Secrets::Result removeKeyEntry(pid_t callerPid, quint64 cryptoRequestId, const Sailfish::Crypto::Key::Identifier &identifier);
-    // the others are possibly-asynchronous methods:
+    // the others are possibly-asynchronous methods.  storedKey() reads the key
+    // directly unless a plugin must complete the read asynchronously:
     Sailfish::Secrets::Result storedKey(pid_t callerPid, quint64 cryptoRequestId, const Sailfish::Crypto::Key::Identifier &identifier, QByteArray *serialisedKey);
     Sailfish::Secrets::Result storeKey(pid_t callerPid, quint64 cryptoRequestId, const Sailfish::Crypto::Key::Identifier &identifier, const QByteArray &serialisedKey, const QString &storagePluginName);
     Sailfish::Secrets::Result deleteStoredKey(pid_t callerPid, quint64 cryptoRequestId, const Sailfish::Crypto::Key::Identifier &identifier);
@@ -318,6 +626,7 @@ Q_SIGNALS:
     void storedKeyCompleted(quint64 cryptoRequestId, const Sailfish::Secrets::Result &result, const QByteArray &serialisedKey);
     void storeKeyCompleted(quint64 cryptoRequestId, const Sailfish::Secrets::Result &result);
     void deleteStoredKeyCompleted(quint64 cryptoRequestId, const Sailfish::Secrets::Result &result);
+    void storedKeysInvalidated(const QString &collectionName, const QString &secretName);
 private:
     enum CryptoApiHelperRequestType {
         InvalidCryptoApiHelperRequest = 0,
@@ -345,7 +654,17 @@ enum RequestType {
     GetCollectionSecretRequest,
     GetStandaloneSecretRequest,
     DeleteCollectionSecretRequest,
-    DeleteStandaloneSecretRequest
+    DeleteStandaloneSecretRequest,
+    GetCollectionSecretsRequest,
+    SetCollectionSecretsRequest,
+    SetCollectionSecretFdRequest,
+    GetCollectionSecretFdRequest,
+    SetCollectionPrefetchOnUnlockRequest,
+    ModifyDeviceLockKeyRequest,
+    CollectionNamesRequest,
+    SecretNamesRequest,
+    ExportSecretsRequest,
+    ImportSecretsRequest
 };
 
 } // ApiImpl
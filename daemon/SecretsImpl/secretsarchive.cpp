@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "secretsarchive_p.h"
+#include "securememory_p.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QtEndian>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+namespace {
+    const QByteArray ArchiveMagic = QByteArrayLiteral("SailfishSecretsArchive/1\n");
+
+    // frames are written once their records exceed this size, or individually
+    // if a single secret does.  Frames larger than the maximum are rejected
+    // rather than read, so that a corrupt length can't exhaust memory.
+    const int FrameSize = 256 * 1024;
+    const quint32 MaxFrameSize = 256 * 1024 * 1024;
+
+    enum RecordType {
+        CollectionRecord = 1,
+        SecretRecord
+    };
+
+    bool openDuplicate(QFile *file, const QDBusUnixFileDescriptor &fd, QIODevice::OpenMode mode, QString *errorString)
+    {
+        if (!fd.isValid()) {
+            *errorString = QLatin1String("Invalid file descriptor given");
+            return false;
+        }
+        const int duplicate = ::dup(fd.fileDescriptor());
+        if (duplicate < 0) {
+            *errorString = QString::fromLatin1("dup failed: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+            return false;
+        }
+        if (!file->open(duplicate, mode | QIODevice::Unbuffered, QFileDevice::AutoCloseHandle)) {
+            ::close(duplicate);
+            *errorString = file->errorString();
+            return false;
+        }
+        return true;
+    }
+
+    bool readFully(QFile *file, char *data, qint64 size)
+    {
+        // pipes return short reads.
+        while (size > 0) {
+            const qint64 bytesRead = file->read(data, size);
+            if (bytesRead <= 0) {
+                return false;
+            }
+            data += bytesRead;
+            size -= bytesRead;
+        }
+        return true;
+    }
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveWriter::SecretsArchiveWriter(
+        Sailfish::Secrets::EncryptionPlugin *plugin,
+        const QByteArray &key)
+    : m_plugin(plugin)
+    , m_key(key)
+    , m_recordCount(0)
+{
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveWriter::~SecretsArchiveWriter()
+{
+    Sailfish::Secrets::Daemon::wipe(&m_frame);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveWriter::open(const QDBusUnixFileDescriptor &fd)
+{
+    QString errorString;
+    if (!openDuplicate(&m_file, fd, QIODevice::WriteOnly, &errorString)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromLatin1("Unable to open export archive: %1").arg(errorString));
+    }
+    if (m_file.write(ArchiveMagic) != ArchiveMagic.size()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromLatin1("Unable to write export archive: %1").arg(m_file.errorString()));
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveWriter::writeCollection(
+        const Sailfish::Secrets::Daemon::ApiImpl::ArchivedCollection &collection)
+{
+    QDataStream out(&m_frame, QIODevice::WriteOnly | QIODevice::Append);
+    out << quint8(CollectionRecord)
+        << collection.collectionName
+        << collection.usesDeviceLockKey
+        << collection.storagePluginName
+        << collection.encryptionPluginName
+        << collection.authenticationPluginName
+        << qint32(collection.unlockSemantic)
+        << qint32(collection.customLockTimeoutMs)
+        << qint32(collection.accessControlMode);
+    ++m_recordCount;
+    return flush(false);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveWriter::writeSecret(
+        const Sailfish::Secrets::Daemon::ApiImpl::ArchivedSecret &secret)
+{
+    // the frame is wiped rather than shrunk, so it mustn't reallocate with the secret in it.
+    if (m_frame.capacity() < m_frame.size() + secret.secret.size() + 1024) {
+        QByteArray frame;
+        frame.reserve(qMax(FrameSize, m_frame.size() + secret.secret.size()) + 1024);
+        frame.append(m_frame);
+        Sailfish::Secrets::Daemon::wipe(&m_frame);
+        m_frame = frame;
+    }
+
+    QDataStream out(&m_frame, QIODevice::WriteOnly | QIODevice::Append);
+    out << quint8(SecretRecord)
+        << secret.collectionName
+        << secret.secretName
+        << secret.secret;
+    ++m_recordCount;
+    return flush(false);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveWriter::finish()
+{
+    Sailfish::Secrets::Result result = flush(true);
+    if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+        // the empty frame which ends the archive.
+        result = flush(true);
+    }
+    m_file.close();
+    return result;
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveWriter::flush(bool force)
+{
+    if (!force && m_frame.size() < FrameSize) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QByteArray plaintext;
+    QDataStream out(&plaintext, QIODevice::WriteOnly);
+    out << m_recordCount;
+    plaintext.append(m_frame);
+    Sailfish::Secrets::Daemon::wipe(&m_frame);
+    m_frame.clear();
+    m_recordCount = 0;
+
+    QByteArray encrypted;
+    Sailfish::Secrets::Result result = m_plugin->encryptSecret(plaintext, m_key, &encrypted);
+    Sailfish::Secrets::Daemon::wipe(&plaintext);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    }
+
+    const quint32 length = qToBigEndian<quint32>(quint32(encrypted.size()));
+    if (m_file.write(reinterpret_cast<const char *>(&length), sizeof(length)) != qint64(sizeof(length))
+            || m_file.write(encrypted) != encrypted.size()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromLatin1("Unable to write export archive: %1").arg(m_file.errorString()));
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveReader::SecretsArchiveReader(
+        Sailfish::Secrets::EncryptionPlugin *plugin,
+        const QByteArray &key)
+    : m_plugin(plugin)
+    , m_key(key)
+{
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveReader::~SecretsArchiveReader()
+{
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveReader::open(const QDBusUnixFileDescriptor &fd)
+{
+    QString errorString;
+    if (!openDuplicate(&m_file, fd, QIODevice::ReadOnly, &errorString)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromLatin1("Unable to open import archive: %1").arg(errorString));
+    }
+    QByteArray magic(ArchiveMagic.size(), '\0');
+    if (!readFully(&m_file, magic.data(), magic.size()) || magic != ArchiveMagic) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("The import archive is not a secrets archive"));
+    }
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveReader::readFrame(
+        QVector<Sailfish::Secrets::Daemon::ApiImpl::ArchivedCollection> *collections,
+        QVector<Sailfish::Secrets::Daemon::ApiImpl::ArchivedSecret> *secrets,
+        bool *finished)
+{
+    *finished = false;
+
+    quint32 length = 0;
+    if (!readFully(&m_file, reinterpret_cast<char *>(&length), sizeof(length))) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("The import archive is truncated"));
+    }
+    length = qFromBigEndian<quint32>(length);
+    if (length > MaxFrameSize) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("The import archive is corrupt"));
+    }
+
+    QByteArray encrypted(int(length), '\0');
+    if (!readFully(&m_file, encrypted.data(), encrypted.size())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("The import archive is truncated"));
+    }
+
+    QByteArray plaintext;
+    Sailfish::Secrets::Result result = m_plugin->decryptSecret(encrypted, m_key, &plaintext);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                         QLatin1String("Unable to decrypt the import archive with the given key"));
+    }
+
+    QDataStream in(plaintext);
+    quint32 recordCount = 0;
+    in >> recordCount;
+    for (quint32 i = 0; i < recordCount && in.status() == QDataStream::Ok; ++i) {
+        quint8 type = 0;
+        in >> type;
+        if (type == CollectionRecord) {
+            Sailfish::Secrets::Daemon::ApiImpl::ArchivedCollection collection;
+            qint32 unlockSemantic = 0, customLockTimeoutMs = 0, accessControlMode = 0;
+            in >> collection.collectionName
+               >> collection.usesDeviceLockKey
+               >> collection.storagePluginName
+               >> collection.encryptionPluginName
+               >> collection.authenticationPluginName
+               >> unlockSemantic
+               >> customLockTimeoutMs
+               >> accessControlMode;
+            collection.unlockSemantic = unlockSemantic;
+            collection.customLockTimeoutMs = customLockTimeoutMs;
+            collection.accessControlMode = accessControlMode;
+            collections->append(collection);
+        } else if (type == SecretRecord) {
+            Sailfish::Secrets::Daemon::ApiImpl::ArchivedSecret secret;
+            in >> secret.collectionName
+               >> secret.secretName
+               >> secret.secret;
+            secrets->append(secret);
+        } else {
+            in.setStatus(QDataStream::ReadCorruptData);
+        }
+    }
+    const bool corrupt = in.status() != QDataStream::Ok;
+    Sailfish::Secrets::Daemon::wipe(&plaintext);
+
+    if (corrupt) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("The import archive is corrupt"));
+    }
+    *finished = recordCount == 0;
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_APIIMPL_SECRETSARCHIVE_P_H
+#define SAILFISHSECRETS_APIIMPL_SECRETSARCHIVE_P_H
+
+#include "Secrets/extensionplugins.h"
+#include "Secrets/result.h"
+
+#include <QtDBus/QDBusUnixFileDescriptor>
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+#include <QtCore/QFile>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace ApiImpl {
+
+// The metadata needed to recreate an exported collection.
+struct ArchivedCollection {
+    ArchivedCollection()
+        : usesDeviceLockKey(false), unlockSemantic(0), customLockTimeoutMs(0), accessControlMode(0) {}
+    QString collectionName;
+    bool usesDeviceLockKey;
+    QString storagePluginName;
+    QString encryptionPluginName;
+    QString authenticationPluginName;
+    int unlockSemantic;
+    int customLockTimeoutMs;
+    int accessControlMode;
+};
+
+struct ArchivedSecret {
+    QString collectionName;
+    QString secretName;
+    QByteArray secret;
+};
+
+// An export archive is a plaintext header followed by a sequence of frames.
+// Each frame is a length-prefixed batch of records, encrypted as a whole with
+// the archive key, so that neither side holds more than one frame at once.
+// An empty frame ends the archive, so that a truncated archive is detected.
+class SecretsArchiveWriter
+{
+public:
+    SecretsArchiveWriter(Sailfish::Secrets::EncryptionPlugin *plugin, const QByteArray &key);
+    ~SecretsArchiveWriter();
+
+    Sailfish::Secrets::Result open(const QDBusUnixFileDescriptor &fd);
+    Sailfish::Secrets::Result writeCollection(const Sailfish::Secrets::Daemon::ApiImpl::ArchivedCollection &collection);
+    Sailfish::Secrets::Result writeSecret(const Sailfish::Secrets::Daemon::ApiImpl::ArchivedSecret &secret);
+    // writes any buffered records and the end of the archive.
+    Sailfish::Secrets::Result finish();
+
+private:
+    Sailfish::Secrets::Result flush(bool force);
+
+    Sailfish::Secrets::EncryptionPlugin *m_plugin;
+    QByteArray m_key;
+    QFile m_file;
+    QByteArray m_frame;
+    quint32 m_recordCount;
+
+    Q_DISABLE_COPY(SecretsArchiveWriter)
+};
+
+class SecretsArchiveReader
+{
+public:
+    SecretsArchiveReader(Sailfish::Secrets::EncryptionPlugin *plugin, const QByteArray &key);
+    ~SecretsArchiveReader();
+
+    Sailfish::Secrets::Result open(const QDBusUnixFileDescriptor &fd);
+    // Reads the records of the next frame.  The collections of a frame
+    // precede any of its secrets in the archive.  finished is set, and no
+    // records are returned, once the end of the archive has been read.
+    Sailfish::Secrets::Result readFrame(QVector<Sailfish::Secrets::Daemon::ApiImpl::ArchivedCollection> *collections,
+                                        QVector<Sailfish::Secrets::Daemon::ApiImpl::ArchivedSecret> *secrets,
+                                        bool *finished);
+
+private:
+    Sailfish::Secrets::EncryptionPlugin *m_plugin;
+    QByteArray m_key;
+    QFile m_file;
+
+    Q_DISABLE_COPY(SecretsArchiveReader)
+};
+
+} // namespace ApiImpl
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_APIIMPL_SECRETSARCHIVE_P_H
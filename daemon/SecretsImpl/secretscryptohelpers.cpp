@@ -30,6 +30,38 @@ QStringList Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::storagePluginN
     return m_storagePlugins.keys();
 }
 
+bool
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::collectionSecretReadableSynchronously(
+        const QString &collectionName,
+        const QString &secretName)
+{
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded || !found
+            || metadata.storagePluginName == metadata.encryptionPluginName
+            || !m_storagePlugins.contains(metadata.storagePluginName)
+            || !m_encryptionPlugins.contains(metadata.encryptionPluginName)
+            || !m_collectionAuthenticationKeys.contains(collectionName)) {
+        // either the read is performed synchronously, or it fails immediately.
+        return true;
+    }
+
+    QByteArray cached;
+    if (m_secretCache.lookup(collectionName, generateHashedSecretName(collectionName, secretName), &cached)) {
+        return true;
+    }
+
+    return !m_storagePlugins[metadata.storagePluginName]->supportsAsynchronousOperations()
+            && !m_encryptionPlugins[metadata.encryptionPluginName]->supportsAsynchronousOperations();
+}
+
+QString
+Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::applicationId(pid_t callerPid) const
+{
+    return m_appPermissions->applicationId(callerPid);
+}
+
 Sailfish::Secrets::Result
 Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::storagePluginNames(
         pid_t callerPid,
@@ -60,17 +92,16 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::keyEntryIdentifiers(
     Q_UNUSED(callerPid);
     Q_UNUSED(cryptoRequestId);
 
-    QMutexLocker(m_db.accessMutex());
-
+    // this only reads committed state, so needn't wait for any write in progress.
     const QString selectKeyIdentifiersQuery = QStringLiteral(
                 "SELECT"
                    " KeyName,"
-                   " CollectionName,"
+                   " CollectionName"
                 " FROM KeyEntries;"
              );
 
     QString errorText;
-    Database::Query sq = m_db.prepare(selectKeyIdentifiersQuery, &errorText);
+    Database::Query sq = m_db.prepareRead(selectKeyIdentifiersQuery, &errorText);
     if (!errorText.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
                                          QString::fromLatin1("Unable to prepare select key identifiers query: %1").arg(errorText));
@@ -89,6 +120,125 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::keyEntryIdentifiers(
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
+// returns up to limit identifiers of key entries added after the one identified by cursor.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::keyEntryIdentifiers(
+        pid_t callerPid,
+        quint64 cryptoRequestId,
+        qint64 cursor,
+        int limit,
+        QVector<Sailfish::Crypto::Key::Identifier> *identifiers,
+        qint64 *nextCursor)
+{
+    // TODO: access control
+    Q_UNUSED(callerPid);
+    Q_UNUSED(cryptoRequestId);
+
+    // keyset pagination over the primary key, so each page costs the same however deep it is.
+    const QString selectKeyIdentifiersQuery = QStringLiteral(
+                "SELECT"
+                   " KeyId,"
+                   " KeyName,"
+                   " CollectionName"
+                " FROM KeyEntries"
+                " WHERE KeyId > ?"
+                " ORDER BY KeyId"
+                " LIMIT ?;"
+             );
+
+    QString errorText;
+    Database::Query sq = m_db.prepareRead(selectKeyIdentifiersQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare select key identifiers query: %1").arg(errorText));
+    }
+
+    QVariantList values;
+    values << QVariant::fromValue<qint64>(cursor);
+    values << QVariant::fromValue<int>(limit);
+    sq.bindValues(values);
+
+    if (!m_db.execute(sq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute select key identifiers query: %1").arg(errorText));
+    }
+
+    qint64 lastKeyId = 0;
+    int count = 0;
+    while (sq.next()) {
+        lastKeyId = sq.value(0).value<qint64>();
+        identifiers->append(Sailfish::Crypto::Key::Identifier(sq.value(1).value<QString>(),
+                                                              sq.value(2).value<QString>()));
+        ++count;
+    }
+    *nextCursor = count == limit ? lastKeyId : 0;
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// returns the identifiers of the key entries whose filter data includes every field and value of filter.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::findKeyEntries(
+        pid_t callerPid,
+        quint64 cryptoRequestId,
+        const Sailfish::Crypto::Key::FilterData &filter,
+        QVector<Sailfish::Crypto::Key::Identifier> *identifiers)
+{
+    if (filter.isEmpty()) {
+        return keyEntryIdentifiers(callerPid, cryptoRequestId, identifiers);
+    }
+
+    // TODO: access control
+    Q_UNUSED(callerPid);
+    Q_UNUSED(cryptoRequestId);
+
+    // each term is looked up via the (Field, Value) index, and a key matches
+    // if it was found by every term.  The statement is cached per term count.
+    QStringList terms;
+    QVariantList values;
+    for (Sailfish::Crypto::Key::FilterData::const_iterator it = filter.constBegin(); it != filter.constEnd(); ++it) {
+        terms.append(QStringLiteral("(Field = ? AND Value = ?)"));
+        values << QVariant::fromValue<QString>(it.key())
+               << QVariant::fromValue<QString>(it.value());
+    }
+    values << QVariant::fromValue<int>(filter.size());
+
+    const QString selectKeyIdentifiersQuery = QStringLiteral(
+                "SELECT"
+                   " KeyName,"
+                   " CollectionName"
+                " FROM KeyEntries"
+                " WHERE KeyId IN ("
+                   " SELECT KeyId"
+                   " FROM KeyFilterData"
+                   " WHERE %1"
+                   " GROUP BY KeyId"
+                   " HAVING COUNT(*) = ? )"
+                " ORDER BY KeyId;"
+             ).arg(terms.join(QStringLiteral(" OR ")));
+
+    QString errorText;
+    Database::Query sq = m_db.prepareRead(selectKeyIdentifiersQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare find key identifiers query: %1").arg(errorText));
+    }
+
+    sq.bindValues(values);
+
+    if (!m_db.execute(sq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute find key identifiers query: %1").arg(errorText));
+    }
+
+    while (sq.next()) {
+        identifiers->append(Sailfish::Crypto::Key::Identifier(sq.value(0).value<QString>(),
+                                                              sq.value(1).value<QString>()));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
 Sailfish::Secrets::Result
 Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::keyEntry(
         pid_t callerPid,
@@ -101,19 +251,17 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::keyEntry(
     Q_UNUSED(callerPid);
     Q_UNUSED(cryptoRequestId);
 
-    QMutexLocker(m_db.accessMutex());
-
     const QString selectKeyPluginsQuery = QStringLiteral(
                 "SELECT"
                    " CryptoPluginName,"
-                   " StoragePluginName,"
+                   " StoragePluginName"
                 " FROM KeyEntries"
                 " WHERE KeyName = ?"
                 " AND CollectionName = ?;"
              );
 
     QString errorText;
-    Database::Query sq = m_db.prepare(selectKeyPluginsQuery, &errorText);
+    Database::Query sq = m_db.prepareRead(selectKeyPluginsQuery, &errorText);
     if (!errorText.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
                                          QString::fromLatin1("Unable to prepare select key plugins query: %1").arg(errorText));
@@ -143,13 +291,14 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::addKeyEntry(
         quint64 cryptoRequestId,
         const Sailfish::Crypto::Key::Identifier &identifier,
         const QString &cryptoPluginName,
-        const QString &storagePluginName)
+        const QString &storagePluginName,
+        const Sailfish::Crypto::Key::FilterData &filterData)
 {
     // TODO: access control
     Q_UNUSED(callerPid);
     Q_UNUSED(cryptoRequestId);
 
-    QMutexLocker(m_db.accessMutex());
+    QMutexLocker locker(m_db.accessMutex());
 
     const QString insertKeyEntryQuery = QStringLiteral(
                 "INSERT INTO KeyEntries ("
@@ -185,6 +334,38 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::addKeyEntry(
                                          QString::fromLatin1("Unable to execute insert key entry query: %1").arg(errorText));
     }
 
+    if (!filterData.isEmpty()) {
+        const QString insertKeyFilterDataQuery = QStringLiteral(
+                    "INSERT INTO KeyFilterData ("
+                    "   KeyId,"
+                    "   Field,"
+                    "   Value )"
+                    " VALUES ( ?,?,? );"
+                 );
+
+        Database::Query fq = m_db.prepare(insertKeyFilterDataQuery, &errorText);
+        if (!errorText.isEmpty()) {
+            m_db.rollbackTransaction();
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to prepare insert key filter data query: %1").arg(errorText));
+        }
+
+        const QVariant keyId = iq.lastInsertId();
+        QVariantList keyIds, fields, fieldValues;
+        for (Sailfish::Crypto::Key::FilterData::const_iterator it = filterData.constBegin(); it != filterData.constEnd(); ++it) {
+            keyIds.append(keyId);
+            fields.append(QVariant::fromValue<QString>(it.key()));
+            fieldValues.append(QVariant::fromValue<QString>(it.value()));
+        }
+        fq.bindValues(QVariantList() << QVariant(keyIds) << QVariant(fields) << QVariant(fieldValues));
+
+        if (!m_db.executeBatch(fq, &errorText)) {
+            m_db.rollbackTransaction();
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to execute insert key filter data query: %1").arg(errorText));
+        }
+    }
+
     if (!m_db.commitTransaction()) {
         m_db.rollbackTransaction();
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
@@ -204,7 +385,7 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::removeKeyEntry(
     Q_UNUSED(callerPid);
     Q_UNUSED(cryptoRequestId);
 
-    QMutexLocker(m_db.accessMutex());
+    QMutexLocker locker(m_db.accessMutex());
 
     const QString deleteKeyEntryQuery = QStringLiteral(
                 "DELETE FROM KeyEntries"
@@ -272,6 +453,7 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::storeKey(
     if (enqueueResult.code() == Sailfish::Secrets::Result::Failed) {
         return enqueueResult;
     }
+    m_cryptoApiHelperRequests.insert(cryptoRequestId, StoreKeyCryptoApiHelperRequest);
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
 }
 
@@ -297,6 +479,7 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::deleteStoredKey(
     if (enqueueResult.code() == Sailfish::Secrets::Result::Failed) {
         return enqueueResult;
     }
+    m_cryptoApiHelperRequests.insert(cryptoRequestId, DeleteStoredKeyCryptoApiHelperRequest);
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
 }
 
@@ -307,9 +490,20 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::storedKey(
         const Sailfish::Crypto::Key::Identifier &identifier,
         QByteArray *serialisedKey)
 {
-    Q_UNUSED(serialisedKey); // this request is always asynchronous
+    // both daemons run in this process, so read the key directly if that won't block.
+    // Crypto requests never allow user interaction, so a locked collection fails here too.
+    if (m_requestProcessor->collectionSecretReadableSynchronously(identifier.collectionName(), identifier.name())) {
+        return m_requestProcessor->getCollectionSecret(
+                    callerPid,
+                    cryptoRequestId,
+                    identifier.collectionName(),
+                    identifier.name(),
+                    Sailfish::Secrets::SecretManager::PreventUserInteractionMode,
+                    QString(),
+                    serialisedKey);
+    }
 
-    // perform the "get collection secret" request, as a secrets-for-crypto request.
+    // otherwise perform the "get collection secret" request, as a secrets-for-crypto request.
     QList<QVariant> inParams;
     inParams << QVariant::fromValue<QString>(identifier.collectionName())
              << QVariant::fromValue<QString>(identifier.name())
@@ -325,6 +519,7 @@ Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue::storedKey(
     if (enqueueResult.code() == Sailfish::Secrets::Result::Failed) {
         return enqueueResult;
     }
+    m_cryptoApiHelperRequests.insert(cryptoRequestId, StoredKeyCryptoApiHelperRequest);
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
 }
 
@@ -6,9 +6,13 @@
  */
 
 #include "secretsdatabase_p.h"
+#include "applicationaccounting_p.h"
 #include "logging_p.h"
+#include "tracing_p.h"
 
 #include <QtCore/QElapsedTimer>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QDateTime>
 #include <QtCore/QDate>
@@ -17,25 +21,63 @@
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QSaveFile>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
 
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
+#include <QtSql/QSqlRecord>
+#include <QtSql/QSqlDriver>
+
+#include <sqlite3.h>
+
+#include <stdio.h>
+
+// Statements which are built dynamically would otherwise grow the
+// prepared query cache without bound.
+static const int PreparedQueryCacheCapacity = 64;
+
+// Statements which take at least this long are logged, and counted in the
+// statistics.  May be overridden via SAILFISH_SECRETSD_SLOW_QUERY_MSEC
+// (where 0 disables the log).
+static const int DefaultSlowQueryThresholdMs = 100;
+
+// The statistics used by the query planner are refreshed by idle-time
+// maintenance once at least this many transactions have been committed.
+static const int AnalyzeAfterCommits = 1000;
 
 static const char *setupEnforceForeignKeys =
         "\n PRAGMA foreign_keys = ON;";
 
 static const char *setupEncoding =
-        "\n PRAGMA encoding = \"UTF-16\";";
+        "\n PRAGMA encoding = \"UTF-8\";";
 
 static const char *setupTempStore =
         "\n PRAGMA temp_store = MEMORY;";
 
+// the page size only takes effect when the database is created.
+static const char *setupPageSize =
+        "\n PRAGMA page_size = 4096;";
+
+// as does the auto vacuum mode, unless the database is rebuilt.  Free
+// pages are released by idle-time maintenance, see performMaintenance().
+static const char *setupAutoVacuum =
+        "\n PRAGMA auto_vacuum = INCREMENTAL;";
+
+static const char *setupCacheSize =
+        "\n PRAGMA cache_size = -2048;"; // KiB
+
 static const char *setupJournal =
         "\n PRAGMA journal_mode = WAL;";
 
 static const char *setupSynchronous =
         "\n PRAGMA synchronous = FULL;";
 
+static const char *setupQueryOnly =
+        "\n PRAGMA query_only = 1;";
+
 static const char *createCollectionsTable =
         "\n CREATE TABLE Collections ("
         "   CollectionId INTEGER PRIMARY KEY AUTOINCREMENT,"
@@ -48,6 +90,10 @@ static const char *createCollectionsTable =
         "   UnlockSemantic INTEGER NOT NULL,"
         "   CustomLockTimeoutMs INTEGER NOT NULL,"
         "   AccessControlMode INTEGER NOT NULL,"
+        "   PrefetchOnUnlock INTEGER NOT NULL DEFAULT 0,"
+        "   EncryptionAlgorithm INTEGER NOT NULL DEFAULT 1,"
+        "   Durability INTEGER NOT NULL DEFAULT 0,"
+        "   WrappedDataKey BLOB,"
         "   CONSTRAINT collectionNameUnique UNIQUE (CollectionName));";
 
 static const char *createSecretsTable =
@@ -75,11 +121,46 @@ static const char *createKeyEntriesTable =
         "   StoragePluginName TEXT NOT NULL,"
         "   CONSTRAINT collectionKeyNameUnique UNIQUE (CollectionName, KeyName));";
 
+// the filter data of each key, normalised so that keys are found by
+// field and value via the index, rather than by reading every key.
+static const char *createKeyFilterDataTable =
+        "\n CREATE TABLE KeyFilterData ("
+        "   KeyId INTEGER NOT NULL,"
+        "   Field TEXT NOT NULL,"
+        "   Value TEXT NOT NULL,"
+        "   FOREIGN KEY (KeyId) REFERENCES KeyEntries(KeyId) ON DELETE CASCADE,"
+        "   CONSTRAINT keyFieldUnique UNIQUE (KeyId, Field));";
+
+// cover the columns read by the per-secret and per-key lookups,
+// so that they are answered from the index alone.
+static const char *createSecretsLookupIndex =
+        "\n CREATE INDEX SecretsLookupIndex ON Secrets ("
+        "   CollectionName, SecretName, ApplicationId, UsesDeviceLockKey,"
+        "   StoragePluginName, EncryptionPluginName, AccessControlMode);";
+
+static const char *createKeyEntriesLookupIndex =
+        "\n CREATE INDEX KeyEntriesLookupIndex ON KeyEntries ("
+        "   CollectionName, KeyName, CryptoPluginName, StoragePluginName);";
+
+// secret names are enumerated a page at a time, in the order they were added.
+static const char *createSecretsEnumerationIndex =
+        "\n CREATE INDEX SecretsEnumerationIndex ON Secrets ("
+        "   CollectionName, SecretId);";
+
+static const char *createKeyFilterDataLookupIndex =
+        "\n CREATE INDEX KeyFilterDataLookupIndex ON KeyFilterData ("
+        "   Field, Value, KeyId);";
+
 static const char *createStatements[] =
 {
     createCollectionsTable,
     createSecretsTable,
     createKeyEntriesTable,
+    createKeyFilterDataTable,
+    createSecretsLookupIndex,
+    createKeyEntriesLookupIndex,
+    createSecretsEnumerationIndex,
+    createKeyFilterDataLookupIndex,
 };
 
 typedef bool (*UpgradeFunction)(QSqlDatabase &database);
@@ -89,11 +170,67 @@ struct UpgradeOperation {
     const char **statements;
 };
 
+static const char *upgradeVersion1[] = {
+    "ALTER TABLE Collections ADD COLUMN PrefetchOnUnlock INTEGER NOT NULL DEFAULT 0",
+    "PRAGMA user_version=2",
+    0 // NULL-terminated
+};
+
+// existing collections were all written with AES-256-CBC.
+static const char *upgradeVersion2[] = {
+    "ALTER TABLE Collections ADD COLUMN EncryptionAlgorithm INTEGER NOT NULL DEFAULT 1",
+    "PRAGMA user_version=3",
+    0 // NULL-terminated
+};
+
+// existing collections were all stored with full durability.
+static const char *upgradeVersion3[] = {
+    "ALTER TABLE Collections ADD COLUMN Durability INTEGER NOT NULL DEFAULT 0",
+    "PRAGMA user_version=4",
+    0 // NULL-terminated
+};
+
+static const char *upgradeVersion4[] = {
+    createSecretsLookupIndex,
+    createKeyEntriesLookupIndex,
+    "ANALYZE",
+    "PRAGMA user_version=5",
+    0 // NULL-terminated
+};
+
+static const char *upgradeVersion5[] = {
+    createSecretsEnumerationIndex,
+    "PRAGMA user_version=6",
+    0 // NULL-terminated
+};
+
+// existing collections have no data key until they are next unlocked.
+static const char *upgradeVersion6[] = {
+    "ALTER TABLE Collections ADD COLUMN WrappedDataKey BLOB",
+    "PRAGMA user_version=7",
+    0 // NULL-terminated
+};
+
+// existing keys have no filter data.
+static const char *upgradeVersion7[] = {
+    createKeyFilterDataTable,
+    createKeyFilterDataLookupIndex,
+    "PRAGMA user_version=8",
+    0 // NULL-terminated
+};
+
 static UpgradeOperation upgradeVersions[] = {
     { 0, 0 },
+    { 0, upgradeVersion1 },
+    { 0, upgradeVersion2 },
+    { 0, upgradeVersion3 },
+    { 0, upgradeVersion4 },
+    { 0, upgradeVersion5 },
+    { 0, upgradeVersion6 },
+    { 0, upgradeVersion7 },
 };
 
-static const int currentSchemaVersion = 1;
+static const int currentSchemaVersion = 8;
 
 static bool execute(QSqlDatabase &database, const QString &statement)
 {
@@ -108,6 +245,35 @@ static bool execute(QSqlDatabase &database, const QString &statement)
     }
 }
 
+static bool pragmaValue(QSqlDatabase &database, const QString &statement, int column, int *value)
+{
+    QSqlQuery query(database);
+    if (!query.exec(statement) || !query.next()) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << QString::fromLatin1("Query failed: %1\n%2")
+                .arg(query.lastError().text())
+                .arg(statement);
+        return false;
+    }
+    *value = query.value(column).toInt();
+    return true;
+}
+
+static bool incrementalVacuum(QSqlDatabase &database, int pages)
+{
+    // each step of the statement releases one page.
+    const QString statement = QString::fromLatin1("PRAGMA main.incremental_vacuum(%1)").arg(pages);
+    QSqlQuery query(database);
+    if (!query.exec(statement)) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << QString::fromLatin1("Query failed: %1\n%2")
+                .arg(query.lastError().text())
+                .arg(statement);
+        return false;
+    }
+    while (query.next()) {
+    }
+    return true;
+}
+
 static bool beginTransaction(QSqlDatabase &database)
 {
     // Use immediate lock acquisition; we should already have an IPC lock, so
@@ -214,6 +380,151 @@ static bool checkDatabase(QSqlDatabase &database)
     return false;
 }
 
+static bool copyTable(QSqlDatabase &source, QSqlDatabase &target, const QString &tableName)
+{
+    QSqlQuery selectQuery(source);
+    selectQuery.setForwardOnly(true);
+    if (!selectQuery.exec(QString::fromLatin1("SELECT * FROM \"%1\"").arg(tableName))) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "Unable to select rows to migrate from" << tableName << selectQuery.lastError().text();
+        return false;
+    }
+
+    const int columnCount = selectQuery.record().count();
+    QStringList placeholders;
+    for (int i = 0; i < columnCount; ++i) {
+        placeholders.append(QString::fromLatin1("?"));
+    }
+
+    QSqlQuery insertQuery(target);
+    if (!insertQuery.prepare(QString::fromLatin1("INSERT INTO \"%1\" VALUES (%2)")
+                                .arg(tableName, placeholders.join(QLatin1Char(','))))) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "Unable to prepare migrated rows for" << tableName << insertQuery.lastError().text();
+        return false;
+    }
+
+    while (selectQuery.next()) {
+        for (int i = 0; i < columnCount; ++i) {
+            insertQuery.bindValue(i, selectQuery.value(i));
+        }
+        if (!insertQuery.exec()) {
+            qCWarning(lcSailfishSecretsDaemonDatabase) << "Unable to insert migrated row into" << tableName << insertQuery.lastError().text();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Recreates the schema objects of the source database in the target
+// database, copying the rows of each table before its indexes are created.
+static bool copyDatabase(QSqlDatabase &source, QSqlDatabase &target)
+{
+    QSqlQuery schemaQuery(source);
+    if (!schemaQuery.exec(QLatin1String(
+                "SELECT type, name, sql FROM sqlite_master"
+                " WHERE sql IS NOT NULL"
+                " AND name NOT LIKE 'sqlite_%'"
+                " ORDER BY CASE type WHEN 'table' THEN 0 ELSE 1 END"))) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "Unable to select schema to migrate:" << schemaQuery.lastError().text();
+        return false;
+    }
+
+    QStringList types, names, statements;
+    while (schemaQuery.next()) {
+        types.append(schemaQuery.value(0).toString());
+        names.append(schemaQuery.value(1).toString());
+        statements.append(schemaQuery.value(2).toString());
+    }
+    schemaQuery.finish();
+
+    for (int i = 0; i < statements.size(); ++i) {
+        if (!execute(target, statements.at(i))) {
+            return false;
+        }
+        if (types.at(i) == QLatin1String("table") && !copyTable(source, target, names.at(i))) {
+            return false;
+        }
+    }
+
+    QSqlQuery versionQuery(source);
+    if (!versionQuery.exec(QLatin1String("PRAGMA user_version")) || !versionQuery.next()) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "User version query failed:" << versionQuery.lastError();
+        return false;
+    }
+
+    return execute(target, QString::fromLatin1("PRAGMA user_version=%1").arg(versionQuery.value(0).toInt()));
+}
+
+// The text encoding of a database cannot be changed once it has been created,
+// so a database which was created with another encoding is rebuilt as a new
+// UTF-8 database file, which then atomically replaces the original file.
+// Returns false if the database remains in its original encoding.
+static bool migrateEncoding(const QString &databaseFile, const QString &connectionName)
+{
+    const QString sourceConnectionName = connectionName + QLatin1String("-migrate-source");
+    const QString targetConnectionName = connectionName + QLatin1String("-migrate-target");
+    const QString migratedFile = databaseFile + QLatin1String(".utf8");
+
+    bool required = false;
+    bool migrated = false;
+    {
+        QSqlDatabase source = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), sourceConnectionName);
+        source.setDatabaseName(databaseFile);
+        if (!source.open()) {
+            qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to open secrets database for encoding migration:" << source.lastError().text();
+            required = true;
+        } else {
+            QSqlQuery encodingQuery(source);
+            if (!encodingQuery.exec(QLatin1String("PRAGMA encoding")) || !encodingQuery.next()) {
+                qCWarning(lcSailfishSecretsDaemonDatabase) << "Encoding query failed:" << encodingQuery.lastError();
+                required = true;
+            } else if (encodingQuery.value(0).toString() != QLatin1String("UTF-8")) {
+                qCWarning(lcSailfishSecretsDaemonDatabase) << "Migrating secrets database from encoding" << encodingQuery.value(0).toString();
+                required = true;
+
+                QFile::remove(migratedFile);
+                QSqlDatabase target = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), targetConnectionName);
+                target.setDatabaseName(migratedFile);
+                if (!target.open()) {
+                    qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to create migrated secrets database:" << target.lastError().text();
+                } else {
+                    // the encoding and page size must be set before anything is written.
+                    migrated = execute(target, QLatin1String(setupEncoding))
+                            && execute(target, QLatin1String(setupPageSize))
+                            && beginTransaction(target)
+                            && finalizeTransaction(target, copyDatabase(source, target))
+                            && execute(target, QLatin1String("ANALYZE"));
+                    target.close();
+                }
+            }
+            encodingQuery.finish();
+            // closing the only connection checkpoints and removes the write-ahead log.
+            source.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(targetConnectionName);
+    QSqlDatabase::removeDatabase(sourceConnectionName);
+
+    if (!required) {
+        return true;
+    } else if (!migrated) {
+        QFile::remove(migratedFile);
+        return false;
+    }
+
+    // a stale write-ahead log must never be applied to the migrated file.
+    if ((QFile::exists(databaseFile + QLatin1String("-wal")) && !QFile::remove(databaseFile + QLatin1String("-wal")))
+            || ::rename(QFile::encodeName(migratedFile).constData(), QFile::encodeName(databaseFile).constData()) != 0) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "Unable to replace secrets database with migrated database";
+        QFile::remove(migratedFile);
+        return false;
+    }
+    QFile::remove(databaseFile + QLatin1String("-shm"));
+
+    qCWarning(lcSailfishSecretsDaemonDatabase) << "Migrated secrets database to UTF-8 encoding";
+    return true;
+}
+
 static bool upgradeDatabase(QSqlDatabase &database)
 {
     if (!beginTransaction(database))
@@ -229,6 +540,9 @@ static bool configureDatabase(QSqlDatabase &database, QString &localeName)
     if (!execute(database,QLatin1String(setupEnforceForeignKeys))
         || !execute(database, QLatin1String(setupEncoding))
         || !execute(database, QLatin1String(setupTempStore))
+        || !execute(database, QLatin1String(setupPageSize))
+        || !execute(database, QLatin1String(setupAutoVacuum))
+        || !execute(database, QLatin1String(setupCacheSize))
         || !execute(database, QLatin1String(setupJournal))
         || !execute(database, QLatin1String(setupSynchronous))) {
         qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to configure secrets database:" << database.lastError().text();
@@ -282,6 +596,50 @@ static bool prepareDatabase(QSqlDatabase &database, QString &localeName)
     return finalizeTransaction(database, success);
 }
 
+// Runs the integrity check on its own connection, so that requests
+// can be served (and the database written, since it uses WAL journaling)
+// while the check is in progress.
+class Sailfish::Secrets::Daemon::ApiImpl::Database::IntegrityCheck : public QRunnable
+{
+public:
+    IntegrityCheck(Sailfish::Secrets::Daemon::ApiImpl::Database *db) : m_db(db) {}
+
+    void run() Q_DECL_OVERRIDE
+    {
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        const QString connectionName = m_db->m_connectionName + QLatin1String("-integrity");
+        bool intact = false;
+        {
+            QSqlDatabase database = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), connectionName);
+            database.setDatabaseName(m_db->m_databaseFile);
+            if (!database.open()) {
+                qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to open secrets database for integrity check:" << database.lastError().text();
+            } else {
+                ::execute(database, QLatin1String(setupQueryOnly));
+                intact = checkDatabase(database);
+                database.close();
+            }
+        }
+        QSqlDatabase::removeDatabase(connectionName);
+
+        m_db->m_integrityCheckDurationMs.storeRelease(static_cast<int>(timer.elapsed()));
+        if (intact) {
+            m_db->m_integrityStatus.storeRelease(Sailfish::Secrets::Daemon::ApiImpl::Database::IntegrityOk);
+            qCDebug(lcSailfishSecretsDaemonDatabase) << "Checked integrity of secrets database in" << timer.elapsed() << "ms";
+        } else {
+            m_db->m_integrityStatus.storeRelease(Sailfish::Secrets::Daemon::ApiImpl::Database::IntegrityCorrupt);
+            qCWarning(lcSailfishSecretsDaemonDatabase) << "Integrity check of secrets database failed - refusing further writes";
+        }
+    }
+
+private:
+    Sailfish::Secrets::Daemon::ApiImpl::Database *m_db;
+};
+
 Sailfish::Secrets::Daemon::ApiImpl::Database::Query::Query(const QSqlQuery &query)
     : m_query(query)
 {
@@ -298,15 +656,84 @@ void Sailfish::Secrets::Daemon::ApiImpl::Database::Query::reportError(const char
     reportError(QString::fromLatin1(text));
 }
 
+// The snapshot identifies the database file by its size and modification time,
+// as the plugin registry cache does for plugin files.
+static QString warmStartSnapshotPath(const QString &databaseFile)
+{
+    return databaseFile + QLatin1String(".warmstart");
+}
+
+static bool writeWarmStartSnapshot(const QString &databaseFile, const QString &localeName)
+{
+    const QFileInfo info(databaseFile);
+    QJsonObject snapshot;
+    snapshot.insert(QStringLiteral("schemaVersion"), currentSchemaVersion);
+    snapshot.insert(QStringLiteral("locale"), localeName);
+    snapshot.insert(QStringLiteral("size"), QJsonValue::fromVariant(QVariant::fromValue<qint64>(info.size())));
+    snapshot.insert(QStringLiteral("lastModified"), QJsonValue::fromVariant(QVariant::fromValue<qint64>(info.lastModified().toMSecsSinceEpoch())));
+
+    QSaveFile file(warmStartSnapshotPath(databaseFile));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(snapshot).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+// Returns true if the database file is unchanged since the snapshot was written.
+static bool takeWarmStartSnapshot(const QString &databaseFile, const QString &localeName)
+{
+    QFile file(warmStartSnapshotPath(databaseFile));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QJsonObject snapshot = QJsonDocument::fromJson(file.readAll()).object();
+    file.close();
+    file.remove();
+
+    const QFileInfo info(databaseFile);
+    return snapshot.value(QStringLiteral("schemaVersion")).toInt() == currentSchemaVersion
+            && snapshot.value(QStringLiteral("locale")).toString() == localeName
+            && snapshot.value(QStringLiteral("size")).toVariant().toLongLong() == info.size()
+            && snapshot.value(QStringLiteral("lastModified")).toVariant().toLongLong() == info.lastModified().toMSecsSinceEpoch()
+            && !QFile::exists(databaseFile + QLatin1String("-wal"));
+}
+
 Sailfish::Secrets::Daemon::ApiImpl::Database::Database()
     : m_mutex(QMutex::Recursive)
     , m_localeName(QLocale().name())
+    , m_preparedQueries(PreparedQueryCacheCapacity)
+    , m_groupCommit(false)
+    , m_groupTransactionOpen(false)
+    , m_groupedTransactions(0)
+    , m_integrityStatus(IntegrityUnknown)
+    , m_integrityCheckDurationMs(-1)
+    , m_writeWarmStartSnapshot(false)
+    , m_checkpointedFrames(0)
 {
+    m_integrityCheckPool.setMaxThreadCount(1);
 }
 
 Sailfish::Secrets::Daemon::ApiImpl::Database::~Database()
 {
+    m_integrityCheckPool.waitForDone();
+    Q_FOREACH (ReadConnection *connection, m_readConnections) {
+        const QString connectionName = connection->database.connectionName();
+        connection->preparedQueries.clear();
+        connection->database.close();
+        delete connection;
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+    m_preparedQueries.clear();
     m_database.close();
+
+    // closing the last connection checkpoints the write-ahead log into the database file.
+    if (m_writeWarmStartSnapshot && integrityStatus() == IntegrityOk && !m_databaseFile.isEmpty()
+            && !QFile::exists(m_databaseFile + QLatin1String("-wal"))) {
+        if (!writeWarmStartSnapshot(m_databaseFile, m_localeName)) {
+            qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to write warm start snapshot for database:" << m_databaseFile;
+        }
+    }
 }
 
 QMutex *Sailfish::Secrets::Daemon::ApiImpl::Database::accessMutex() const
@@ -348,10 +775,17 @@ bool Sailfish::Secrets::Daemon::ApiImpl::Database::open(const QString &connectio
 
     const QString databaseFile = databaseDir.absoluteFilePath(QLatin1String("secrets.db"));
     const bool databasePreexisting = QFile::exists(databaseFile);
+    const bool databaseVerified = databasePreexisting && takeWarmStartSnapshot(databaseFile, m_localeName);
+
+    if (databasePreexisting && !migrateEncoding(databaseFile, connectionName)) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to migrate secrets database encoding - continuing with the existing encoding";
+    }
 
     qCDebug(lcSailfishSecretsDaemonDatabase) << "Attempting to open secrets database:" << databaseFile;
     m_database = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), connectionName);
     m_database.setDatabaseName(databaseFile);
+    m_connectionName = connectionName;
+    m_databaseFile = databaseFile;
 
     if (!m_database.open()) {
         qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to open secrets database:" << m_database.lastError().text();
@@ -370,12 +804,6 @@ bool Sailfish::Secrets::Daemon::ApiImpl::Database::open(const QString &connectio
     }
 
     if (databasePreexisting) {
-        // Perform an integrity check
-        if (!checkDatabase(m_database)) {
-            qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to check integrity of secrets database:" << m_database.lastError().text();
-            m_database.close();
-            return false;
-        }
         // Try to upgrade, if necessary
         if (!upgradeDatabase(m_database)) {
             qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to upgrade secrets database:" << m_database.lastError().text();
@@ -384,6 +812,14 @@ bool Sailfish::Secrets::Daemon::ApiImpl::Database::open(const QString &connectio
         }
     }
 
+    // a newly created database doesn't need to be checked, nor one which is unchanged since it was last checked.
+    if (databasePreexisting && !databaseVerified) {
+        m_integrityStatus.storeRelease(IntegrityChecking);
+        m_integrityCheckPool.start(new IntegrityCheck(this));
+    } else {
+        m_integrityStatus.storeRelease(IntegrityOk);
+    }
+
     qCDebug(lcSailfishSecretsDaemonDatabase) << "Opened secrets database:" << databaseFile << "Locale:" << m_localeName;
     return true;
 }
@@ -417,10 +853,27 @@ bool Sailfish::Secrets::Daemon::ApiImpl::Database::localized() const
 // should ever access the secrets database.
 bool Sailfish::Secrets::Daemon::ApiImpl::Database::beginTransaction()
 {
+    if (m_transactionSemaphore.loadAcquire() == 0
+            && m_integrityStatus.loadAcquire() == IntegrityCorrupt) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "Integrity check failed - not beginning transaction on secrets database";
+        return false;
+    }
+
     int oldSemaphoreValue = m_transactionSemaphore.fetchAndAddAcquire(1);
     if (oldSemaphoreValue == 0) {
         // start a new "outer" transaction.
-        return ::beginTransaction(m_database);
+        m_transactionThread.storeRelease(QThread::currentThreadId());
+        if (!m_groupCommit) {
+            return ::beginTransaction(m_database);
+        }
+        // when grouping, each "outer" transaction is a savepoint within the group transaction.
+        if (!m_groupTransactionOpen) {
+            if (!::beginTransaction(m_database)) {
+                return false;
+            }
+            m_groupTransactionOpen = true;
+        }
+        return ::execute(m_database, QString::fromLatin1("SAVEPOINT grouped"));
     } else if (oldSemaphoreValue == 1) {
         // already in an "outer" transaction.  This is fine, and is
         // done within loadPlugins() code to minimise transactions on startup.
@@ -436,7 +889,24 @@ bool Sailfish::Secrets::Daemon::ApiImpl::Database::commitTransaction()
 {
     int oldSemaphoreValue = m_transactionSemaphore.fetchAndAddAcquire(-1);
     if (oldSemaphoreValue == 1) {
-        return ::commitTransaction(m_database);
+        m_commitsSinceAnalyze.ref();
+        if (m_groupTransactionOpen) {
+            // durable once the group is flushed.  Until then, this thread's
+            // reads must continue to use the writing connection.
+            ++m_groupedTransactions;
+            m_groupedApplications.insert(Sailfish::Secrets::Daemon::ApplicationAccounting::currentApplicationId());
+            return ::execute(m_database, QString::fromLatin1("RELEASE SAVEPOINT grouped"));
+        }
+        m_transactionThread.storeRelease(Q_NULLPTR);
+        QElapsedTimer commitTimer;
+        commitTimer.start();
+        const bool committed = ::commitTransaction(m_database);
+        m_commitLatency.record(commitTimer.nsecsElapsed() / 1000);
+        recordStatement(QStringLiteral("COMMIT"), commitTimer.nsecsElapsed() / 1000, Q_NULLPTR);
+        if (committed) {
+            Sailfish::Secrets::Daemon::ApplicationAccounting::instance()->recordSync();
+        }
+        return committed;
     } else if (oldSemaphoreValue == 0) {
         // this is always an error in sailfishsecretsd code.
         qCWarning(lcSailfishSecretsDaemonDatabase) << "Invalid semaphore value - commitTransaction called without beginTransaction!";
@@ -451,6 +921,12 @@ bool Sailfish::Secrets::Daemon::ApiImpl::Database::rollbackTransaction()
 {
     int oldSemaphoreValue = m_transactionSemaphore.fetchAndAddAcquire(-1);
     if (oldSemaphoreValue == 1) {
+        if (m_groupTransactionOpen) {
+            // only discard the changes made since the savepoint, not the whole group.
+            return ::execute(m_database, QString::fromLatin1("ROLLBACK TO SAVEPOINT grouped"))
+                && ::execute(m_database, QString::fromLatin1("RELEASE SAVEPOINT grouped"));
+        }
+        m_transactionThread.storeRelease(Q_NULLPTR);
         return ::rollbackTransaction(m_database);
     } else if (oldSemaphoreValue == 0) {
         // this is always an error in sailfishsecretsd code.
@@ -462,6 +938,124 @@ bool Sailfish::Secrets::Daemon::ApiImpl::Database::rollbackTransaction()
     }
 }
 
+void Sailfish::Secrets::Daemon::ApiImpl::Database::setGroupCommit(bool enabled)
+{
+    QMutexLocker locker(accessMutex());
+    if (!enabled) {
+        flushGroupCommit();
+    }
+    m_groupCommit = enabled;
+}
+
+// Commits every transaction committed since the last flush with a single sync.
+// If this fails, all of those transactions are lost.
+bool Sailfish::Secrets::Daemon::ApiImpl::Database::flushGroupCommit()
+{
+    QMutexLocker locker(accessMutex());
+    if (!m_groupTransactionOpen) {
+        return true;
+    }
+    if (withinTransaction()) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "Unable to flush grouped transactions from within a transaction";
+        return false;
+    }
+
+    m_groupTransactionOpen = false;
+    m_groupedTransactions = 0;
+    m_transactionThread.storeRelease(Q_NULLPTR);
+    QElapsedTimer commitTimer;
+    commitTimer.start();
+    const bool committed = ::commitTransaction(m_database);
+    m_commitLatency.record(commitTimer.nsecsElapsed() / 1000);
+    recordStatement(QStringLiteral("COMMIT"), commitTimer.nsecsElapsed() / 1000, Q_NULLPTR);
+    if (!committed) {
+        ::rollbackTransaction(m_database);
+    } else {
+        // the one sync made every application's transactions durable.
+        Sailfish::Secrets::Daemon::ApplicationAccounting::instance()->recordSync(m_groupedApplications);
+    }
+    m_groupedApplications.clear();
+    return committed;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::Database::releaseMemory()
+{
+    QMutexLocker locker(accessMutex());
+    m_preparedQueries.clear();
+
+    const QVariant handle = m_database.driver() ? m_database.driver()->handle() : QVariant();
+    if (handle.isValid() && qstrcmp(handle.typeName(), "sqlite3*") == 0) {
+        sqlite3 *connection = *static_cast<sqlite3 * const *>(handle.data());
+        if (connection) {
+            sqlite3_db_release_memory(connection);
+        }
+    }
+}
+
+int Sailfish::Secrets::Daemon::ApiImpl::Database::performMaintenance(int pageBudget)
+{
+    // maintenance is deferred rather than waiting for a writer.
+    if (!m_mutex.tryLock()) {
+        return -1;
+    }
+    int pages = -1;
+    if (!withinTransaction() && !m_groupTransactionOpen && m_integrityStatus.loadAcquire() != IntegrityCorrupt) {
+        pages = maintain(pageBudget);
+    }
+    m_mutex.unlock();
+    return pages;
+}
+
+int Sailfish::Secrets::Daemon::ApiImpl::Database::maintain(int pageBudget)
+{
+    int pages = 0;
+
+    // copy the write-ahead log into the database as far as readers allow,
+    // so that the automatic checkpoint rarely falls within a client's commit.
+    int checkpointedFrames = 0;
+    if (pragmaValue(m_database, QStringLiteral("PRAGMA main.wal_checkpoint(PASSIVE)"), 2, &checkpointedFrames)) {
+        // the count is of the frames checkpointed since the log was last reset.
+        pages += checkpointedFrames >= m_checkpointedFrames ? checkpointedFrames - m_checkpointedFrames : checkpointedFrames;
+        m_checkpointedFrames = qMax(checkpointedFrames, 0);
+    }
+
+    int autoVacuum = 0, freePages = 0, pageCount = 0;
+    if (!pragmaValue(m_database, QStringLiteral("PRAGMA main.auto_vacuum"), 0, &autoVacuum)
+            || !pragmaValue(m_database, QStringLiteral("PRAGMA main.freelist_count"), 0, &freePages)
+            || !pragmaValue(m_database, QStringLiteral("PRAGMA main.page_count"), 0, &pageCount)) {
+        return pages;
+    }
+
+    // release the pages of deleted secrets back to the file system.
+    if (freePages > 0 && pages < pageBudget) {
+        if (autoVacuum == 2) { // INCREMENTAL
+            const int vacuumPages = qMin(freePages, pageBudget - pages);
+            if (incrementalVacuum(m_database, vacuumPages)) {
+                pages += vacuumPages;
+            }
+        } else if (autoVacuum == 0 && pageCount <= pageBudget - pages) {
+            // databases created before incremental vacuuming was enabled are
+            // rebuilt with it, once, if they are small enough for the budget.
+            m_preparedQueries.clear();
+            if (::execute(m_database, QLatin1String(setupAutoVacuum))
+                    && ::execute(m_database, QStringLiteral("VACUUM"))) {
+                qCDebug(lcSailfishSecretsDaemonDatabase) << "Rebuilt secrets database with incremental vacuuming";
+            }
+            pages += pageCount;
+        }
+    }
+
+    // ANALYZE reads every page, so it is deferred until a step has the budget for it.
+    if (m_commitsSinceAnalyze.loadAcquire() >= AnalyzeAfterCommits && pageCount <= pageBudget - pages) {
+        if (::execute(m_database, QStringLiteral("ANALYZE main"))) {
+            m_commitsSinceAnalyze.storeRelease(0);
+        }
+        pages += pageCount;
+    }
+
+    return pages;
+}
+
 Sailfish::Secrets::Daemon::ApiImpl::Database::Query Sailfish::Secrets::Daemon::ApiImpl::Database::prepare(const char *statement, QString *errorText)
 {
     return prepare(QString::fromLatin1(statement), errorText);
@@ -471,31 +1065,188 @@ Sailfish::Secrets::Daemon::ApiImpl::Database::Query Sailfish::Secrets::Daemon::A
 {
     QMutexLocker locker(accessMutex());
 
-    QHash<QString, QSqlQuery>::const_iterator it = m_preparedQueries.constFind(statement);
-    if (it == m_preparedQueries.constEnd()) {
-        QSqlQuery query(m_database);
-        query.setForwardOnly(true);
-        if (!query.prepare(statement)) {
-            qCWarning(lcSailfishSecretsDaemonDatabase) << QString::fromLatin1("Failed to prepare query: %1\n%2")
-                    .arg(query.lastError().text())
-                    .arg(statement);
-            *errorText = query.lastError().text();
-            return Query(QSqlQuery());
+    QSqlQuery *cached = m_preparedQueries.object(statement);
+    if (cached) {
+        return Query(*cached);
+    }
+
+    QSqlQuery query(m_database);
+    query.setForwardOnly(true);
+    if (!query.prepare(statement)) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << QString::fromLatin1("Failed to prepare query: %1\n%2")
+                .arg(query.lastError().text())
+                .arg(statement);
+        *errorText = query.lastError().text();
+        return Query(QSqlQuery());
+    }
+    m_preparedQueries.insert(statement, new QSqlQuery(query));
+
+    return Query(query);
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::Database::ReadConnection *
+Sailfish::Secrets::Daemon::ApiImpl::Database::readConnection(QString *errorText)
+{
+    const Qt::HANDLE thread = QThread::currentThreadId();
+    QMutexLocker locker(&m_readConnectionsMutex);
+    ReadConnection *connection = m_readConnections.value(thread);
+    if (connection) {
+        return connection;
+    }
+
+    // one connection per thread, so the number is bounded by the worker pools.
+    const QString connectionName = QString::fromLatin1("%1-reader-%2").arg(m_connectionName).arg(m_readConnections.size());
+    connection = new ReadConnection;
+    connection->preparedQueries.setMaxCost(PreparedQueryCacheCapacity);
+    connection->database = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), connectionName);
+    connection->database.setDatabaseName(m_databaseFile);
+    if (!connection->database.open()
+            || !::execute(connection->database, QLatin1String(setupQueryOnly))
+            || !::execute(connection->database, QLatin1String(setupTempStore))
+            || !::execute(connection->database, QLatin1String(setupCacheSize))) {
+        *errorText = connection->database.lastError().text();
+        qCWarning(lcSailfishSecretsDaemonDatabase) << "Failed to open secrets database read connection:" << *errorText;
+        connection->database.close();
+        delete connection;
+        QSqlDatabase::removeDatabase(connectionName);
+        return Q_NULLPTR;
+    }
+
+    m_readConnections.insert(thread, connection);
+    return connection;
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::Database::Query Sailfish::Secrets::Daemon::ApiImpl::Database::prepareRead(const QString &statement, QString *errorText)
+{
+    // a thread must observe its own uncommitted writes.
+    if (m_transactionThread.loadAcquire() == QThread::currentThreadId()) {
+        return prepare(statement, errorText);
+    }
+
+    ReadConnection *connection = readConnection(errorText);
+    if (!connection) {
+        return Query(QSqlQuery());
+    }
+
+    QSqlQuery *cached = connection->preparedQueries.object(statement);
+    if (cached) {
+        return Query(*cached);
+    }
+
+    QSqlQuery query(connection->database);
+    query.setForwardOnly(true);
+    if (!query.prepare(statement)) {
+        qCWarning(lcSailfishSecretsDaemonDatabase) << QString::fromLatin1("Failed to prepare read query: %1\n%2")
+                .arg(query.lastError().text())
+                .arg(statement);
+        *errorText = query.lastError().text();
+        return Query(QSqlQuery());
+    }
+    connection->preparedQueries.insert(statement, new QSqlQuery(query));
+
+    return Query(query);
+}
+
+namespace {
+    struct StatementStatistics {
+        StatementStatistics() : slowCount(0) {}
+        Sailfish::Secrets::Daemon::LatencyHistogram latency;
+        quint64 slowCount;
+    };
+
+    // execute() is static, and statements are timed on whichever thread runs them.
+    QMutex statementStatisticsMutex;
+    QHash<QString, StatementStatistics> recordedStatements;
+
+    int configuredSlowQueryThresholdMs()
+    {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue("SAILFISH_SECRETSD_SLOW_QUERY_MSEC", &ok);
+        return ok && value >= 0 ? value : DefaultSlowQueryThresholdMs;
+    }
+
+    int slowQueryThresholdMs()
+    {
+        static const int threshold = configuredSlowQueryThresholdMs();
+        return threshold;
+    }
+
+    // The statement id, under which its timing is recorded.  Statements differ
+    // only in the number of values in their IN (...) lists share an id, so that
+    // the dynamically built selects are recorded together.
+    QString statementId(const QString &statement)
+    {
+        static const QRegularExpression valueList(QStringLiteral("\\?(\\s*,\\s*\\?)+"));
+        return QString(statement).replace(valueList, QStringLiteral("?, ...")).simplified();
+    }
+
+    // The query with its bound values, except that blobs (the encrypted
+    // secrets and keys) are replaced by their size.
+    QString redactedQuery(const QSqlQuery &query)
+    {
+        QMap<QString, QVariant> bindings(query.boundValues());
+        for (QMap<QString, QVariant>::iterator it = bindings.begin(); it != bindings.end(); ++it) {
+            if (it.value().type() == QVariant::ByteArray) {
+                it.value() = QString::fromLatin1("<%1 bytes>").arg(it.value().toByteArray().size());
+            } else if (it.value().type() == QVariant::List) {
+                it.value() = QString::fromLatin1("<%1 values>").arg(it.value().toList().size());
+            }
+        }
+        return Sailfish::Secrets::Daemon::ApiImpl::Database::expandQuery(query.lastQuery(), bindings);
+    }
+
+    void recordStatement(const QString &statement, qint64 usecs, const QSqlQuery *query)
+    {
+        const int threshold = slowQueryThresholdMs();
+        const bool slow = threshold > 0 && usecs >= qint64(threshold) * 1000;
+        {
+            QMutexLocker locker(&statementStatisticsMutex);
+            StatementStatistics &statistics(recordedStatements[statementId(statement)]);
+            statistics.latency.record(usecs);
+            if (slow) {
+                statistics.slowCount++;
+            }
+        }
+
+        if (slow) {
+            qCWarning(lcSailfishSecretsDaemonDatabase).nospace() << "Slow query in " << usecs / 1000 << "ms: "
+                    << qPrintable(query ? redactedQuery(*query) : statement);
+        }
+    }
+}
+
+QVariantMap Sailfish::Secrets::Daemon::ApiImpl::Database::statementStatistics()
+{
+    QVariantMap statements;
+    quint64 slowCount = 0;
+    {
+        QMutexLocker locker(&statementStatisticsMutex);
+        for (QHash<QString, StatementStatistics>::const_iterator it = recordedStatements.constBegin();
+                it != recordedStatements.constEnd(); ++it) {
+            QVariantMap statement = it.value().latency.toVariantMap();
+            statement.insert(QStringLiteral("slowCount"), QVariant::fromValue<quint64>(it.value().slowCount));
+            statements.insert(it.key(), statement);
+            slowCount += it.value().slowCount;
         }
-        it = m_preparedQueries.insert(statement, query);
     }
 
-    return Query(*it);
+    QVariantMap stats;
+    stats.insert(QStringLiteral("statements"), statements);
+    stats.insert(QStringLiteral("slowQueryCount"), QVariant::fromValue<quint64>(slowCount));
+    stats.insert(QStringLiteral("slowQueryThresholdMs"), slowQueryThresholdMs());
+    return stats;
 }
 
 bool Sailfish::Secrets::Daemon::ApiImpl::Database::execute(QSqlQuery &query, QString *errorText)
 {
     static const bool debugSql = !qgetenv("SFOSSECRETSD_DEBUG_SQL").isEmpty();
+    SAILFISH_SECRETS_TRACE_SPAN("database.execute");
 
     QElapsedTimer t;
     t.start();
 
     bool rv = query.exec();
+    recordStatement(query.lastQuery(), t.nsecsElapsed() / 1000, &query);
     if (rv) {
         if (debugSql) {
             const int n = query.isSelect() ? query.size() : query.numRowsAffected();
@@ -512,11 +1263,13 @@ bool Sailfish::Secrets::Daemon::ApiImpl::Database::execute(QSqlQuery &query, QSt
 bool Sailfish::Secrets::Daemon::ApiImpl::Database::executeBatch(QSqlQuery &query, QString *errorText, QSqlQuery::BatchExecutionMode mode)
 {
     static const bool debugSql = !qgetenv("SFOSSECRETSD_DEBUG_SQL").isEmpty();
+    SAILFISH_SECRETS_TRACE_SPAN("database.executeBatch");
 
     QElapsedTimer t;
     t.start();
 
     bool rv = query.execBatch(mode);
+    recordStatement(query.lastQuery(), t.nsecsElapsed() / 1000, &query);
     if (rv) {
         if (debugSql) {
             const int n = query.isSelect() ? query.size() : query.numRowsAffected();
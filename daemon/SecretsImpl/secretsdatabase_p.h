@@ -17,10 +17,16 @@
 #include <QtCore/QVariant>
 #include <QtCore/QString>
 #include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QCache>
 #include <QtCore/QMutex>
 #include <QtCore/QMutexLocker>
 #include <QtCore/QAtomicInt>
 #include <QtCore/QScopedPointer>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "requeststatistics_p.h"
 
 namespace Sailfish {
 
@@ -93,10 +99,56 @@ public:
     bool commitTransaction();
     bool rollbackTransaction();
     bool withinTransaction() const { return m_transactionSemaphore.loadAcquire(); }
+    QString connectionName() const { return m_connectionName; }
+
+    // When enabled, transactions committed via commitTransaction() are
+    // savepoints within one group transaction, which becomes durable
+    // (with a single sync) only when flushGroupCommit() is called.
+    void setGroupCommit(bool enabled);
+    bool groupCommitPending() const { return m_groupTransactionOpen && m_groupedTransactions > 0; }
+    bool flushGroupCommit();
+
+    // Finalizes the cached prepared statements and returns the page cache of
+    // the write connection to the heap.  Both are rebuilt on demand.
+    void releaseMemory();
+
+    // Performs one step of idle-time maintenance, using roughly at most
+    // pageBudget pages of I/O: a passive checkpoint of the write-ahead log,
+    // the release of free pages, and, once enough transactions have been
+    // committed, refreshing the statistics of the query planner.
+    // Returns the number of pages used, or -1 if the database is in use.
+    int performMaintenance(int pageBudget);
+
+    // When enabled, the database file is described in a snapshot next to it
+    // once it has been closed cleanly (on destruction) after passing its
+    // integrity check.  If the file is unchanged when it is next opened, the
+    // integrity check is skipped.  The snapshot is removed on every open, so
+    // it only ever survives one clean shutdown.
+    void setWarmStartSnapshot(bool enabled) { m_writeWarmStartSnapshot = enabled; }
+
+    // The integrity of a pre-existing database is checked in the background
+    // after open() returns.  If the check fails, no further transactions
+    // may be begun.
+    enum IntegrityStatus {
+        IntegrityUnknown = 0,
+        IntegrityChecking,
+        IntegrityOk,
+        IntegrityCorrupt
+    };
+    IntegrityStatus integrityStatus() const { return static_cast<IntegrityStatus>(m_integrityStatus.loadAcquire()); }
+    int integrityCheckDurationMs() const { return m_integrityCheckDurationMs.loadAcquire(); }
+    const Sailfish::Secrets::Daemon::LatencyHistogram &commitLatency() const { return m_commitLatency; }
 
     Query prepare(const char *statement, QString *errorText);
     Query prepare(const QString &statement, QString *errorText);
 
+    // Prepares a read-only statement on a connection owned by the calling thread,
+    // which does not require the accessMutex() and so may run in parallel with
+    // a write transaction (the database uses WAL journaling).  Readers see the
+    // last committed state, unless the calling thread is itself within a
+    // transaction, in which case the statement is prepared via prepare().
+    Query prepareRead(const QString &statement, QString *errorText);
+
     static bool execute(QSqlQuery &query, QString *errorText);
     static bool executeBatch(QSqlQuery &query, QString *errorText, QSqlQuery::BatchExecutionMode mode = QSqlQuery::ValuesAsRows);
 
@@ -104,12 +156,41 @@ public:
     static QString expandQuery(const QString &queryString, const QMap<QString, QVariant> &bindings);
     static QString expandQuery(const QSqlQuery &query);
 
+    // the timing of each statement executed so far, and the count of slow ones.
+    static QVariantMap statementStatistics();
+
 private:
+    class IntegrityCheck;
+    friend class IntegrityCheck;
+
+    struct ReadConnection {
+        QSqlDatabase database;
+        QCache<QString, QSqlQuery> preparedQueries; // only used by the owning thread
+    };
+    ReadConnection *readConnection(QString *errorText);
+    int maintain(int pageBudget);
+
     QSqlDatabase m_database;
     QMutex m_mutex;
     QString m_localeName;
-    QHash<QString, QSqlQuery> m_preparedQueries;
+    QString m_connectionName;
+    QString m_databaseFile;
+    QCache<QString, QSqlQuery> m_preparedQueries; // least-recently-used statements are finalized
+    QMutex m_readConnectionsMutex;
+    QHash<Qt::HANDLE, ReadConnection*> m_readConnections;
+    QAtomicPointer<void> m_transactionThread;
     QAtomicInt m_transactionSemaphore;
+    bool m_groupCommit;
+    bool m_groupTransactionOpen;
+    int m_groupedTransactions;
+    QSet<QString> m_groupedApplications;  // whose transactions are in the group, to charge the sync to
+    Sailfish::Secrets::Daemon::LatencyHistogram m_commitLatency;
+    QAtomicInt m_integrityStatus;
+    QAtomicInt m_integrityCheckDurationMs;
+    QThreadPool m_integrityCheckPool;
+    bool m_writeWarmStartSnapshot;
+    QAtomicInt m_commitsSinceAnalyze;
+    int m_checkpointedFrames;
 };
 
 } // namespace ApiImpl
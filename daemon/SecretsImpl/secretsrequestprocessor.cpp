@@ -6,15 +6,16 @@
  */
 
 #include "secretsrequestprocessor_p.h"
+#include "secretsarchive_p.h"
 #include "applicationpermissions_p.h"
 #include "logging_p.h"
+#include "tracing_p.h"
 
 #include "Secrets/result.h"
 #include "Secrets/secretmanager.h"
 #include "Secrets/secret.h"
 
 #include <QtCore/QCryptographicHash>
-#include <QtCore/QPluginLoader>
 #include <QtCore/QDataStream>
 #include <QtCore/QVariant>
 #include <QtCore/QString>
@@ -22,6 +23,11 @@
 #include <QtCore/QHash>
 #include <QtCore/QSet>
 #include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QVector>
+#include <QtCore/QStandardPaths>
+
+#include <QtConcurrent/QtConcurrentMap>
 
 // In real system, we would generate a secure key on first boot,
 // and store it via a hardware-supported secure storage mechanism.
@@ -31,8 +37,8 @@
 static const QByteArray SystemEncryptionKey = QByteArray("example_encryption_key");
 // In real system, we would store the device lock key (hash) somewhere
 // securely.  We use this device lock key to lock/unlock device-lock
-// protected collections.
-static const QByteArray DeviceLockKey = QByteArray("example_device_lock_key");
+// protected collections, until it is changed via modifyDeviceLockKey().
+static const QByteArray DefaultDeviceLockKey = QByteArray("example_device_lock_key");
 
 namespace {
     QByteArray rehashHash(const QByteArray &hash) {
@@ -54,6 +60,383 @@ namespace {
 
         return QString::fromLatin1(hashed.toBase64());
     }
+
+    struct PrefetchedSecret {
+        PrefetchedSecret() : decrypted(false) {}
+        QString hashedSecretName;
+        QByteArray encrypted;
+        QByteArray plaintext;
+        bool decrypted;
+    };
+
+    // Decrypts prefetched secrets on the global thread pool.
+    struct PrefetchDecryptor {
+        typedef void result_type;
+        PrefetchDecryptor(Sailfish::Secrets::EncryptionPlugin *plugin, const Sailfish::Secrets::Daemon::SecureByteArray &key)
+            : m_plugin(plugin), m_key(key) {}
+        void operator()(PrefetchedSecret &secret) const {
+            secret.decrypted = m_plugin->decryptSecret(secret.encrypted, m_key.rawData(), &secret.plaintext).code()
+                    == Sailfish::Secrets::Result::Succeeded;
+        }
+        Sailfish::Secrets::EncryptionPlugin *m_plugin;
+        Sailfish::Secrets::Daemon::SecureByteArray m_key;
+    };
+
+    struct PendingEncryption {
+        PendingEncryption() : encrypted(false) {}
+        QString storedName;
+        QByteArray plaintext;
+        QByteArray ciphertext;
+        bool encrypted;
+    };
+
+    // Encrypts the values of a batch write on the global thread pool.
+    struct BatchEncryptor {
+        typedef void result_type;
+        BatchEncryptor(Sailfish::Secrets::EncryptionPlugin *plugin, const Sailfish::Secrets::Daemon::SecureByteArray &key)
+            : m_plugin(plugin), m_key(key) {}
+        void operator()(PendingEncryption &secret) const {
+            secret.encrypted = m_plugin->encryptSecret(secret.plaintext, m_key.rawData(), &secret.ciphertext).code()
+                    == Sailfish::Secrets::Result::Succeeded;
+        }
+        Sailfish::Secrets::EncryptionPlugin *m_plugin;
+        Sailfish::Secrets::Daemon::SecureByteArray m_key;
+    };
+
+    // A secret larger than the chunk size is stored as independently encrypted
+    // chunks under derived names, and a (likewise encrypted) manifest under the
+    // secret's own name, so that no more than one chunk is encrypted or decrypted
+    // at once.  The chunks are only in the storage plugin, not the Secrets table.
+    const QByteArray ChunkManifestMagic = QByteArrayLiteral("SailfishSecretChunks/1");
+    const int ChunkManifestSize = ChunkManifestMagic.size() + int(sizeof(quint32) + sizeof(quint64));
+    // generous room for the iv, padding and authentication tag of any encryption plugin.
+    const int MaxEncryptionOverhead = 256;
+
+    QString secretChunkName(const QString &hashedSecretName, int index)
+    {
+        return hashedSecretName + QStringLiteral(":chunk%1").arg(index);
+    }
+
+    QByteArray secretChunkManifest(int chunkCount, qint64 totalSize)
+    {
+        QByteArray manifest(ChunkManifestMagic);
+        QDataStream out(&manifest, QIODevice::WriteOnly | QIODevice::Append);
+        out << quint32(chunkCount) << quint64(totalSize);
+        return manifest;
+    }
+
+    bool parseSecretChunkManifest(const QByteArray &data, int *chunkCount, qint64 *totalSize)
+    {
+        if (data.size() != ChunkManifestSize || !data.startsWith(ChunkManifestMagic)) {
+            return false;
+        }
+        QDataStream in(data.mid(ChunkManifestMagic.size()));
+        quint32 count = 0;
+        quint64 size = 0;
+        in >> count >> size;
+        *chunkCount = int(count);
+        *totalSize = qint64(size);
+        return in.status() == QDataStream::Ok;
+    }
+
+    // Writes the secret whole if it is no larger than chunkSize (or chunkSize is zero),
+    // otherwise as chunks followed by the manifest which refers to them.
+    Sailfish::Secrets::Result storeSecretChunks(
+            Sailfish::Secrets::StoragePlugin *storagePlugin,
+            Sailfish::Secrets::EncryptionPlugin *encryptionPlugin,
+            const QString &collectionName,
+            const QString &hashedSecretName,
+            const QByteArray &key,
+            const QByteArray &secret,
+            int chunkSize,
+            int *chunkCount)
+    {
+        *chunkCount = (chunkSize > 0 && secret.size() > chunkSize)
+                ? (secret.size() + chunkSize - 1) / chunkSize
+                : 0;
+
+        Sailfish::Secrets::Result result(Sailfish::Secrets::Result::Succeeded);
+        QByteArray encrypted;
+        for (int i = 0; result.code() == Sailfish::Secrets::Result::Succeeded && i < *chunkCount; ++i) {
+            // the chunk refers to the secret's data, so only its ciphertext is allocated.
+            const int offset = i * chunkSize;
+            const QByteArray chunk = QByteArray::fromRawData(secret.constData() + offset, qMin(chunkSize, secret.size() - offset));
+            result = encryptionPlugin->encryptSecret(chunk, key, &encrypted);
+            if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+                result = storagePlugin->setSecret(collectionName, secretChunkName(hashedSecretName, i), encrypted);
+            }
+        }
+
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            // the manifest is written last, so that it never refers to missing chunks.
+            result = encryptionPlugin->encryptSecret(*chunkCount ? secretChunkManifest(*chunkCount, secret.size()) : secret,
+                                                     key, &encrypted);
+        }
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = storagePlugin->setSecret(collectionName, hashedSecretName, encrypted);
+        }
+        return result;
+    }
+
+    // If the decrypted secret is a manifest, replaces it with the secret assembled from its chunks.
+    Sailfish::Secrets::Result loadSecretChunks(
+            Sailfish::Secrets::StoragePlugin *storagePlugin,
+            Sailfish::Secrets::EncryptionPlugin *encryptionPlugin,
+            const QString &collectionName,
+            const QString &hashedSecretName,
+            const QByteArray &key,
+            QByteArray *secret,
+            bool *chunked)
+    {
+        int chunkCount = 0;
+        qint64 totalSize = 0;
+        *chunked = parseSecretChunkManifest(*secret, &chunkCount, &totalSize);
+        if (!*chunked) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+        }
+
+        QByteArray assembled;
+        assembled.reserve(int(totalSize));
+        Sailfish::Secrets::Result result(Sailfish::Secrets::Result::Succeeded);
+        for (int i = 0; result.code() == Sailfish::Secrets::Result::Succeeded && i < chunkCount; ++i) {
+            QByteArray encrypted;
+            QByteArray chunk;
+            result = storagePlugin->getSecret(collectionName, secretChunkName(hashedSecretName, i), &encrypted);
+            if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+                result = encryptionPlugin->decryptSecret(encrypted, key, &chunk);
+            }
+            assembled.append(chunk);
+            Sailfish::Secrets::Daemon::wipe(&chunk);
+        }
+
+        if (result.code() == Sailfish::Secrets::Result::Succeeded && assembled.size() != totalSize) {
+            result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                               QLatin1String("The chunks of the secret do not match its manifest"));
+        }
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            Sailfish::Secrets::Daemon::wipe(&assembled);
+            return result;
+        }
+        *secret = assembled;
+        return result;
+    }
+
+    // The number of chunks the given stored value refers to, if it is a manifest.
+    // Values too large to be a manifest aren't decrypted.
+    int secretChunkCount(
+            Sailfish::Secrets::EncryptionPlugin *encryptionPlugin,
+            const QByteArray &encrypted,
+            const QByteArray &key)
+    {
+        if (encrypted.size() > ChunkManifestSize + MaxEncryptionOverhead) {
+            return 0;
+        }
+        QByteArray manifest;
+        int chunkCount = 0;
+        qint64 totalSize = 0;
+        if (encryptionPlugin->decryptSecret(encrypted, key, &manifest).code() != Sailfish::Secrets::Result::Succeeded
+                || !parseSecretChunkManifest(manifest, &chunkCount, &totalSize)) {
+            chunkCount = 0;
+        }
+        Sailfish::Secrets::Daemon::wipe(&manifest);
+        return chunkCount;
+    }
+
+    int storedSecretChunkCount(
+            Sailfish::Secrets::StoragePlugin *storagePlugin,
+            Sailfish::Secrets::EncryptionPlugin *encryptionPlugin,
+            const QString &collectionName,
+            const QString &hashedSecretName,
+            const QByteArray &key)
+    {
+        QByteArray encrypted;
+        return storagePlugin->getSecret(collectionName, hashedSecretName, &encrypted).code() == Sailfish::Secrets::Result::Succeeded
+                ? secretChunkCount(encryptionPlugin, encrypted, key)
+                : 0;
+    }
+
+    // Removes the chunks from firstIndex up to (but not including) endIndex.
+    void removeSecretChunks(
+            Sailfish::Secrets::StoragePlugin *storagePlugin,
+            const QString &collectionName,
+            const QString &hashedSecretName,
+            int firstIndex,
+            int endIndex)
+    {
+        for (int i = firstIndex; i < endIndex; ++i) {
+            Sailfish::Secrets::Result result = storagePlugin->removeSecret(collectionName, secretChunkName(hashedSecretName, i));
+            if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+                qCWarning(lcSailfishSecretsDaemon) << "Unable to remove chunk" << i << "of secret in collection:"
+                                                   << collectionName << result.errorMessage();
+            }
+        }
+    }
+
+    // The Secrets table only holds hashed secret names, so the name of each
+    // collection secret is also stored (encrypted) in the storage plugin under
+    // a derived name, from which secretNames() reports it.
+    QString secretNameEntryName(const QString &hashedSecretName)
+    {
+        return hashedSecretName + QStringLiteral(":name");
+    }
+
+    Sailfish::Secrets::Result storeSecretName(
+            Sailfish::Secrets::StoragePlugin *storagePlugin,
+            Sailfish::Secrets::EncryptionPlugin *encryptionPlugin,
+            const QString &collectionName,
+            const QString &hashedSecretName,
+            const QByteArray &key,
+            const QString &secretName)
+    {
+        QByteArray encrypted;
+        Sailfish::Secrets::Result result = encryptionPlugin->encryptSecret(secretName.toUtf8(), key, &encrypted);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = storagePlugin->setSecret(collectionName, secretNameEntryName(hashedSecretName), encrypted);
+        }
+        return result;
+    }
+
+    bool secretNameStored(
+            Sailfish::Secrets::StoragePlugin *storagePlugin,
+            const QString &collectionName,
+            const QString &hashedSecretName)
+    {
+        QByteArray encrypted;
+        return storagePlugin->getSecret(collectionName, secretNameEntryName(hashedSecretName), &encrypted).code()
+                == Sailfish::Secrets::Result::Succeeded;
+    }
+
+    // The secrets of a collection are encrypted with a random data key, which
+    // is stored in the Collections table wrapped (i.e. encrypted) with the
+    // collection's lock key.  Unwrapping it verifies the lock key, and changing
+    // the lock key only requires the data key to be rewrapped.  Collections
+    // created before data keys were introduced use their lock key directly.
+    const int DataKeySize = 32;
+
+    Sailfish::Secrets::Result wrapNewDataKey(
+            Sailfish::Secrets::EncryptionPlugin *encryptionPlugin,
+            const QByteArray &lockKey,
+            QByteArray *wrappedDataKey)
+    {
+        QFile random(QStringLiteral("/dev/urandom"));
+        QByteArray dataKey;
+        if (random.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            dataKey = random.read(DataKeySize);
+        }
+        if (dataKey.size() != DataKeySize) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                             QLatin1String("Unable to generate a collection data key"));
+        }
+        Sailfish::Secrets::Result result = encryptionPlugin->encryptSecret(dataKey, lockKey, wrappedDataKey);
+        Sailfish::Secrets::Daemon::wipe(&dataKey);
+        return result;
+    }
+
+    // The plugin info is cached by the plugin registry, so that plugins need not be loaded to report it.
+    bool introspectStoragePlugin(QObject *object, QString *name, bool *testPlugin, QByteArray *info)
+    {
+        Sailfish::Secrets::StoragePlugin *plugin = qobject_cast<Sailfish::Secrets::StoragePlugin*>(object);
+        if (!plugin) {
+            return false;
+        }
+        *name = plugin->name();
+        *testPlugin = plugin->isTestPlugin();
+        QDataStream out(info, QIODevice::WriteOnly);
+        out << static_cast<qint32>(plugin->storageType());
+        return true;
+    }
+
+    bool introspectEncryptionPlugin(QObject *object, QString *name, bool *testPlugin, QByteArray *info)
+    {
+        Sailfish::Secrets::EncryptionPlugin *plugin = qobject_cast<Sailfish::Secrets::EncryptionPlugin*>(object);
+        if (!plugin) {
+            return false;
+        }
+        *name = plugin->name();
+        *testPlugin = plugin->isTestPlugin();
+        QDataStream out(info, QIODevice::WriteOnly);
+        out << static_cast<qint32>(plugin->encryptionType())
+            << static_cast<qint32>(plugin->encryptionAlgorithm());
+        return true;
+    }
+
+    bool introspectEncryptedStoragePlugin(QObject *object, QString *name, bool *testPlugin, QByteArray *info)
+    {
+        Sailfish::Secrets::EncryptedStoragePlugin *plugin = qobject_cast<Sailfish::Secrets::EncryptedStoragePlugin*>(object);
+        if (!plugin) {
+            return false;
+        }
+        *name = plugin->name();
+        *testPlugin = plugin->isTestPlugin();
+        QDataStream out(info, QIODevice::WriteOnly);
+        out << static_cast<qint32>(plugin->storageType())
+            << static_cast<qint32>(plugin->encryptionType())
+            << static_cast<qint32>(plugin->encryptionAlgorithm());
+        return true;
+    }
+
+    bool introspectAuthenticationPlugin(QObject *object, QString *name, bool *testPlugin, QByteArray *info)
+    {
+        Sailfish::Secrets::AuthenticationPlugin *plugin = qobject_cast<Sailfish::Secrets::AuthenticationPlugin*>(object);
+        if (!plugin) {
+            return false;
+        }
+        *name = plugin->name();
+        *testPlugin = plugin->isTestPlugin();
+        QDataStream out(info, QIODevice::WriteOnly);
+        out << static_cast<qint32>(plugin->authenticationType());
+        return true;
+    }
+
+    Sailfish::Secrets::StoragePluginInfo storagePluginInfo(const QString &name, const QByteArray &info)
+    {
+        qint32 storageType = Sailfish::Secrets::StoragePlugin::NoStorage;
+        QDataStream in(info);
+        in >> storageType;
+        Sailfish::Secrets::StoragePluginInfo pluginInfo;
+        pluginInfo.setName(name);
+        pluginInfo.setStorageType(static_cast<Sailfish::Secrets::StoragePlugin::StorageType>(storageType));
+        return pluginInfo;
+    }
+
+    Sailfish::Secrets::EncryptionPluginInfo encryptionPluginInfo(const QString &name, const QByteArray &info)
+    {
+        qint32 encryptionType = Sailfish::Secrets::EncryptionPlugin::NoEncryption;
+        qint32 encryptionAlgorithm = Sailfish::Secrets::EncryptionPlugin::NoAlgorithm;
+        QDataStream in(info);
+        in >> encryptionType >> encryptionAlgorithm;
+        Sailfish::Secrets::EncryptionPluginInfo pluginInfo;
+        pluginInfo.setName(name);
+        pluginInfo.setEncryptionType(static_cast<Sailfish::Secrets::EncryptionPlugin::EncryptionType>(encryptionType));
+        pluginInfo.setEncryptionAlgorithm(static_cast<Sailfish::Secrets::EncryptionPlugin::EncryptionAlgorithm>(encryptionAlgorithm));
+        return pluginInfo;
+    }
+
+    Sailfish::Secrets::EncryptedStoragePluginInfo encryptedStoragePluginInfo(const QString &name, const QByteArray &info)
+    {
+        qint32 storageType = Sailfish::Secrets::StoragePlugin::NoStorage;
+        qint32 encryptionType = Sailfish::Secrets::EncryptionPlugin::NoEncryption;
+        qint32 encryptionAlgorithm = Sailfish::Secrets::EncryptionPlugin::NoAlgorithm;
+        QDataStream in(info);
+        in >> storageType >> encryptionType >> encryptionAlgorithm;
+        Sailfish::Secrets::EncryptedStoragePluginInfo pluginInfo;
+        pluginInfo.setName(name);
+        pluginInfo.setStorageType(static_cast<Sailfish::Secrets::StoragePlugin::StorageType>(storageType));
+        pluginInfo.setEncryptionType(static_cast<Sailfish::Secrets::EncryptionPlugin::EncryptionType>(encryptionType));
+        pluginInfo.setEncryptionAlgorithm(static_cast<Sailfish::Secrets::EncryptionPlugin::EncryptionAlgorithm>(encryptionAlgorithm));
+        return pluginInfo;
+    }
+
+    Sailfish::Secrets::AuthenticationPluginInfo authenticationPluginInfo(const QString &name, const QByteArray &info)
+    {
+        qint32 authenticationType = Sailfish::Secrets::AuthenticationPlugin::NoAuthentication;
+        QDataStream in(info);
+        in >> authenticationType;
+        Sailfish::Secrets::AuthenticationPluginInfo pluginInfo;
+        pluginInfo.setName(name);
+        pluginInfo.setAuthenticationType(static_cast<Sailfish::Secrets::AuthenticationPlugin::AuthenticationType>(authenticationType));
+        return pluginInfo;
+    }
 }
 
 Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::DatabaseLocker::~DatabaseLocker()
@@ -81,7 +464,27 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::RequestProcessor(Sailfish:
                  Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions *appPermissions,
                  Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue *parent)
     : QObject(parent), m_requestQueue(parent), m_db(db), m_appPermissions(appPermissions)
+    , m_storagePlugins(&m_pluginRegistry, QLatin1String(Sailfish_Secrets_StoragePlugin_IID))
+    , m_encryptionPlugins(&m_pluginRegistry, QLatin1String(Sailfish_Secrets_EncryptionPlugin_IID))
+    , m_encryptedStoragePlugins(&m_pluginRegistry, QLatin1String(Sailfish_Secrets_EncryptedStoragePlugin_IID))
+    , m_authenticationPlugins(&m_pluginRegistry, QLatin1String(Sailfish_Secrets_AuthenticationPlugin_IID))
+    , m_storageWriteBatching(false)
+    , m_secretChunkSize(0)
+    , m_deviceLockKey(DefaultDeviceLockKey)
+    , m_autotestMode(false)
 {
+    m_pluginRegistry.registerInterface(QLatin1String(Sailfish_Secrets_StoragePlugin_IID), introspectStoragePlugin);
+    m_pluginRegistry.registerInterface(QLatin1String(Sailfish_Secrets_EncryptionPlugin_IID), introspectEncryptionPlugin);
+    m_pluginRegistry.registerInterface(QLatin1String(Sailfish_Secrets_EncryptedStoragePlugin_IID), introspectEncryptedStoragePlugin);
+    m_pluginRegistry.registerInterface(QLatin1String(Sailfish_Secrets_AuthenticationPlugin_IID), introspectAuthenticationPlugin);
+    connect(&m_pluginRegistry, &Sailfish::Secrets::Daemon::PluginRegistry::pluginLoaded,
+            this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::pluginLoaded);
+
+    connect(&m_collectionRelocks, &Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::expired,
+            this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::timeoutRelockCollections);
+    connect(&m_standaloneSecretRelocks, &Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler::expired,
+            this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::timeoutRelockSecrets);
+
     // Add the "standalone" collection.
     // Note that it is a "notional" collection,
     // existing only to satisfy the database constraints.
@@ -129,79 +532,58 @@ bool
 Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::loadPlugins(const QString &pluginDir, bool autotestMode)
 {
     qCDebug(lcSailfishSecretsDaemon) << "Loading plugins from directory:" << pluginDir;
-    QDir dir(pluginDir);
-    Q_FOREACH (const QString &pluginFile, dir.entryList(QDir::Files | QDir::NoDot | QDir::NoDotDot, QDir::Name)) {
-        // load the plugin and query it for its data.
-        QPluginLoader loader(pluginFile);
-        QObject *plugin = loader.instance();
-        Sailfish::Secrets::StoragePlugin *storagePlugin = qobject_cast<Sailfish::Secrets::StoragePlugin*>(plugin);
-        Sailfish::Secrets::EncryptionPlugin *encryptionPlugin = qobject_cast<Sailfish::Secrets::EncryptionPlugin*>(plugin);
-        Sailfish::Secrets::EncryptedStoragePlugin *encryptedStoragePlugin = qobject_cast<Sailfish::Secrets::EncryptedStoragePlugin*>(plugin);
-        Sailfish::Secrets::AuthenticationPlugin *authenticationPlugin = qobject_cast<Sailfish::Secrets::AuthenticationPlugin*>(plugin);
-        if (storagePlugin) {
-            if (storagePlugin->isTestPlugin() != autotestMode) {
-                qCDebug(lcSailfishSecretsDaemon) << "ignoring storage plugin:" << pluginFile << "due to mode";
-                loader.unload();
-                continue;
-            } else if (storagePlugin->name().isEmpty() || m_storagePlugins.contains(storagePlugin->name())) {
-                qCDebug(lcSailfishSecretsDaemon) << "ignoring storage plugin:" << pluginFile << "with duplicate name:" << storagePlugin->name();
-                loader.unload();
-                continue;
-            } else {
-                qCDebug(lcSailfishSecretsDaemon) << "loading storage plugin:" << pluginFile << "with name:" << storagePlugin->name();
-                m_storagePlugins.insert(storagePlugin->name(), storagePlugin);
-            }
-        } else if (encryptionPlugin) {
-            if (encryptionPlugin->isTestPlugin() != autotestMode) {
-                qCDebug(lcSailfishSecretsDaemon) << "ignoring encryption plugin:" << pluginFile << "due to mode";
-                loader.unload();
-                continue;
-            } else if (encryptionPlugin->name().isEmpty() || m_storagePlugins.contains(encryptionPlugin->name())) {
-                qCDebug(lcSailfishSecretsDaemon) << "ignoring encryption plugin:" << pluginFile << "with duplicate name:" << encryptionPlugin->name();
-                loader.unload();
-                continue;
-            } else {
-                qCDebug(lcSailfishSecretsDaemon) << "loading encryption plugin:" << pluginFile << "with name:" << encryptionPlugin->name();
-                m_encryptionPlugins.insert(encryptionPlugin->name(), encryptionPlugin);
-            }
-        } else if (encryptedStoragePlugin) {
-            if (encryptedStoragePlugin->isTestPlugin() != autotestMode) {
-                qCDebug(lcSailfishSecretsDaemon) << "ignoring encrypted storage plugin:" << pluginFile << "due to mode";
-                loader.unload();
-                continue;
-            } else if (encryptedStoragePlugin->name().isEmpty() || m_encryptedStoragePlugins.contains(encryptedStoragePlugin->name())) {
-                qCDebug(lcSailfishSecretsDaemon) << "ignoring encrypted storage plugin:" << pluginFile << "with duplicate name:" << encryptedStoragePlugin->name();
-                loader.unload();
-                continue;
-            } else {
-                qCDebug(lcSailfishSecretsDaemon) << "loading encrypted storage plugin:" << pluginFile << "with name:" << encryptedStoragePlugin->name();
-                m_encryptedStoragePlugins.insert(encryptedStoragePlugin->name(), encryptedStoragePlugin);
-            }
-        } else if (authenticationPlugin) {
-            if (authenticationPlugin->isTestPlugin() != autotestMode) {
-                qCDebug(lcSailfishSecretsDaemon) << "ignoring authentication plugin:" << pluginFile << "due to mode";
-                loader.unload();
-                continue;
-            } else if (authenticationPlugin->name().isEmpty() || m_authenticationPlugins.contains(authenticationPlugin->name())) {
-                qCDebug(lcSailfishSecretsDaemon) << "ignoring authentication plugin:" << pluginFile << "with duplicate name:" << authenticationPlugin->name();
-                loader.unload();
-                continue;
-            } else {
-                qCDebug(lcSailfishSecretsDaemon) << "loading authentication plugin:" << pluginFile << "with name:" << authenticationPlugin->name();
-                m_authenticationPlugins.insert(authenticationPlugin->name(), authenticationPlugin);
-                connect(authenticationPlugin, &Sailfish::Secrets::AuthenticationPlugin::authenticationCompleted,
-                        this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::authenticationCompleted);
-            }
-        } else {
-            qCWarning(lcSailfishSecretsDaemon) << "ignoring plugin:" << pluginFile << "- not a secrets plugin or Qt version mismatch";
-            loader.unload();
-            continue;
-        }
+    m_autotestMode = autotestMode;
+
+    // the device lock key must be held in secure memory, or nothing can be encrypted with it.
+    if (m_deviceLockKey.isEmpty()) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to allocate secure memory for the device lock key";
+        return false;
+    }
+
+    // the plugins themselves are only loaded once a request requires them.
+    QString cacheFilePath = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+            + QLatin1String("/system/privileged/Secrets/sailfishsecretsd");
+    if (autotestMode) {
+        cacheFilePath.append(QLatin1String("-test"));
+    }
+    cacheFilePath.append(QLatin1String("/plugins.json"));
+    if (!m_pluginRegistry.scan(pluginDir, cacheFilePath, autotestMode)) {
+        return false;
     }
 
+    removeInMemoryCollections();
     return true;
 }
 
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::pluginLoaded(
+        const QString &interfaceId,
+        const QString &name,
+        QObject *plugin)
+{
+    Q_UNUSED(name);
+
+    if (interfaceId == QLatin1String(Sailfish_Secrets_StoragePlugin_IID)) {
+        Sailfish::Secrets::StoragePlugin *storagePlugin = qobject_cast<Sailfish::Secrets::StoragePlugin*>(plugin);
+        connect(storagePlugin, &Sailfish::Secrets::StoragePlugin::reencryptionProgress,
+                this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::reencryptionProgress);
+        // queued, as the plugin may complete the operation before beginGetSecret() returns.
+        connect(storagePlugin, &Sailfish::Secrets::StoragePlugin::getSecretCompleted,
+                this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::storageGetSecretCompleted,
+                Qt::QueuedConnection);
+        if (m_storageWriteBatching) {
+            storagePlugin->setWriteBatching(true);
+        }
+    } else if (interfaceId == QLatin1String(Sailfish_Secrets_EncryptionPlugin_IID)) {
+        connect(qobject_cast<Sailfish::Secrets::EncryptionPlugin*>(plugin), &Sailfish::Secrets::EncryptionPlugin::decryptSecretCompleted,
+                this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::encryptionDecryptSecretCompleted,
+                Qt::QueuedConnection);
+    } else if (interfaceId == QLatin1String(Sailfish_Secrets_AuthenticationPlugin_IID)) {
+        connect(qobject_cast<Sailfish::Secrets::AuthenticationPlugin*>(plugin), &Sailfish::Secrets::AuthenticationPlugin::authenticationCompleted,
+                this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::authenticationCompleted);
+    }
+}
+
 // retrieve information about available plugins
 Sailfish::Secrets::Result
 Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getPluginInfo(
@@ -215,22 +597,29 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getPluginInfo(
     Q_UNUSED(callerPid); // TODO: perform access control request to see if the application has permission to read secure storage metadata.
     Q_UNUSED(requestId); // The request is synchronous, so don't need the requestId.
 
-    for (const Sailfish::Secrets::StoragePlugin *plugin : m_storagePlugins.values()) {
-        storagePlugins->append(Sailfish::Secrets::StoragePluginInfo(plugin));
+    // answered from the plugin metadata cache, without loading the plugins.
+    for (const QString &name : m_storagePlugins.keys()) {
+        storagePlugins->append(storagePluginInfo(name, m_storagePlugins.info(name)));
     }
-    for (const Sailfish::Secrets::EncryptionPlugin *plugin : m_encryptionPlugins.values()) {
-        encryptionPlugins->append(Sailfish::Secrets::EncryptionPluginInfo(plugin));
+    for (const QString &name : m_encryptionPlugins.keys()) {
+        encryptionPlugins->append(encryptionPluginInfo(name, m_encryptionPlugins.info(name)));
     }
-    for (const Sailfish::Secrets::EncryptedStoragePlugin *plugin : m_encryptedStoragePlugins.values()) {
-        encryptedStoragePlugins->append(Sailfish::Secrets::EncryptedStoragePluginInfo(plugin));
+    for (const QString &name : m_encryptedStoragePlugins.keys()) {
+        encryptedStoragePlugins->append(encryptedStoragePluginInfo(name, m_encryptedStoragePlugins.info(name)));
     }
-    for (const Sailfish::Secrets::AuthenticationPlugin *plugin : m_authenticationPlugins.values()) {
-        authenticationPlugins->append(Sailfish::Secrets::AuthenticationPluginInfo(plugin));
+    for (const QString &name : m_authenticationPlugins.keys()) {
+        authenticationPlugins->append(authenticationPluginInfo(name, m_authenticationPlugins.info(name)));
     }
 
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
+quint64
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::pluginInfoGeneration() const
+{
+    return m_pluginRegistry.generation();
+}
+
 // create a DeviceLock-protected collection
 Sailfish::Secrets::Result
 Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createDeviceLockCollection(
@@ -240,7 +629,8 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createDeviceLockCollection
         const QString &storagePluginName,
         const QString &encryptionPluginName,
         Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic unlockSemantic,
-        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode)
+        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+        Sailfish::Secrets::StoragePlugin::Durability durability)
 {
     Q_UNUSED(requestId); // the request would only be asynchronous if we needed to perform the access control request, so until then it's always synchronous.
 
@@ -264,6 +654,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createDeviceLockCollection
                 ? m_appPermissions->platformApplicationId()
                 : m_appPermissions->applicationId(callerPid);
 
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, QString(), Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
     DatabaseLocker locker(m_db);
 
     // Whenever we modify the master database + perform a plugin operation,
@@ -307,6 +698,16 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createDeviceLockCollection
                                          QString::fromLatin1("Collection already exists: %1").arg(collectionName));
     }
 
+    // encrypted storage plugins encrypt the collection with the lock key themselves.
+    QByteArray wrappedDataKey;
+    if (storagePluginName != encryptionPluginName) {
+        Sailfish::Secrets::Result wrapResult = wrapNewDataKey(m_encryptionPlugins[encryptionPluginName], m_deviceLockKey.rawData(), &wrappedDataKey);
+        if (wrapResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return wrapResult;
+        }
+    }
+
+    m_collectionMetadata.remove(collectionName);
     const QString insertCollectionQuery = QStringLiteral(
                 "INSERT INTO Collections ("
                   "CollectionName,"
@@ -317,10 +718,13 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createDeviceLockCollection
                   "AuthenticationPluginName,"
                   "UnlockSemantic,"
                   "CustomLockTimeoutMs,"
-                  "AccessControlMode"
+                  "AccessControlMode,"
+                  "EncryptionAlgorithm,"
+                  "Durability,"
+                  "WrappedDataKey"
                 ")"
                 " VALUES ("
-                  "?,?,1,?,?,?,?,0,?"
+                  "?,?,1,?,?,?,?,0,?,?,?,?"
                 ");");
 
     Database::Query iq = m_db->prepare(insertCollectionQuery, &errorText);
@@ -336,7 +740,10 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createDeviceLockCollection
             << encryptionPluginName
             << Sailfish::Secrets::SecretManager::DefaultAuthenticationPluginName
             << static_cast<int>(unlockSemantic)
-            << static_cast<int>(accessControlMode);
+            << static_cast<int>(accessControlMode)
+            << encryptionAlgorithm(storagePluginName, encryptionPluginName)
+            << static_cast<int>(collectionDurability(storagePluginName, encryptionPluginName, durability))
+            << (wrappedDataKey.isEmpty() ? QVariant(QVariant::ByteArray) : QVariant::fromValue<QByteArray>(wrappedDataKey));
     iq.bindValues(ivalues);
 
     if (!m_db->beginTransaction()) {
@@ -358,10 +765,16 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createDeviceLockCollection
 
     Sailfish::Secrets::Result pluginResult;
     if (storagePluginName == encryptionPluginName) {
-        pluginResult = m_encryptedStoragePlugins[storagePluginName]->createCollection(collectionName, DeviceLockKey);
+        pluginResult = m_encryptedStoragePlugins[storagePluginName]->createCollection(collectionName, m_deviceLockKey.rawData());
     } else {
-        pluginResult = m_storagePlugins[storagePluginName]->createCollection(collectionName);
-        m_collectionAuthenticationKeys.insert(collectionName, DeviceLockKey);
+        pluginResult = m_storagePlugins[storagePluginName]->createCollectionWithDurability(collectionName, durability);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            const Sailfish::Secrets::Result unlockResult = setCollectionAuthenticationKey(collectionName, m_deviceLockKey.rawData());
+            if (unlockResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                m_storagePlugins[storagePluginName]->removeCollection(collectionName);
+                pluginResult = unlockResult;
+            }
+        }
     }
 
     if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
@@ -369,6 +782,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createDeviceLockCollection
         // It may be tempting to merely remove the commitTransaction() above, and just do a rollbackTransaction() here,
         // but DO NOT do so, as that could lead to the case where the plugin->createCollection() call succeeds,
         // but the master table commit fails.
+        m_collectionMetadata.remove(collectionName);
         const QString deleteCollectionQuery = QStringLiteral(
                     "DELETE FROM Collections"
                     " WHERE CollectionName = ?;");
@@ -433,7 +847,8 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
         int customLockTimeoutMs,
         Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
         Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-        const QString &uiServiceAddress)
+        const QString &uiServiceAddress,
+        Sailfish::Secrets::StoragePlugin::Durability durability)
 {
     Q_UNUSED(requestId); // the request would only be asynchronous if we needed to perform the access control request, so until then it's always synchronous.
 
@@ -467,6 +882,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
                 ? m_appPermissions->platformApplicationId()
                 : m_appPermissions->applicationId(callerPid);
 
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, QString(), Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
     DatabaseLocker locker(m_db);
 
     const QString selectCollectionsCountQuery = QStringLiteral(
@@ -515,20 +931,23 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
         return authenticationResult;
     }
 
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CreateCustomLockCollectionContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CreateCustomLockCollectionContinuation;
+    continuation->collectionName = collectionName;
+    continuation->storagePluginName = storagePluginName;
+    continuation->encryptionPluginName = encryptionPluginName;
+    continuation->authenticationPluginName = authenticationPluginName;
+    continuation->unlockSemantic = unlockSemantic;
+    continuation->customLockTimeoutMs = customLockTimeoutMs;
+    continuation->accessControlMode = accessControlMode;
+    continuation->userInteractionMode = userInteractionMode;
+    continuation->uiServiceAddress = uiServiceAddress;
+    continuation->durability = durability;
     m_pendingRequests.insert(requestId,
                              Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                  callerPid,
                                  requestId,
                                  Sailfish::Secrets::Daemon::ApiImpl::CreateCustomLockCollectionRequest,
-                                 QVariantList() << collectionName
-                                                << storagePluginName
-                                                << encryptionPluginName
-                                                << authenticationPluginName
-                                                << unlockSemantic
-                                                << customLockTimeoutMs
-                                                << accessControlMode
-                                                << userInteractionMode
-                                                << uiServiceAddress));
+                                 continuation));
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
 }
 
@@ -545,6 +964,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
         Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
         Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
         const QString &uiServiceAddress,
+        Sailfish::Secrets::StoragePlugin::Durability durability,
         const QByteArray &authenticationKey)
 {
     // may be required for access control requests in the future
@@ -572,6 +992,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
     // In the future, we should mark the row as "dirty" via in-memory flag, if (6) fails,
     // so that we can re-attempt to remove it, at a later point in time.
 
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, QString(), Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
     DatabaseLocker locker(m_db);
 
     const QString selectCollectionsCountQuery = QStringLiteral(
@@ -608,6 +1029,16 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
                                          QString::fromLatin1("Collection already exists: %1").arg(collectionName));
     }
 
+    // encrypted storage plugins encrypt the collection with the lock key themselves.
+    QByteArray wrappedDataKey;
+    if (storagePluginName != encryptionPluginName) {
+        Sailfish::Secrets::Result wrapResult = wrapNewDataKey(m_encryptionPlugins[encryptionPluginName], authenticationKey, &wrappedDataKey);
+        if (wrapResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return wrapResult;
+        }
+    }
+
+    m_collectionMetadata.remove(collectionName);
     const QString insertCollectionQuery = QStringLiteral(
                 "INSERT INTO Collections ("
                   "CollectionName,"
@@ -618,10 +1049,13 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
                   "AuthenticationPluginName,"
                   "UnlockSemantic,"
                   "CustomLockTimeoutMs,"
-                  "AccessControlMode"
+                  "AccessControlMode,"
+                  "EncryptionAlgorithm,"
+                  "Durability,"
+                  "WrappedDataKey"
                 ")"
                 " VALUES ("
-                  "?,?,0,?,?,?,?,?,?"
+                  "?,?,0,?,?,?,?,?,?,?,?,?"
                 ");");
 
     Database::Query iq = m_db->prepare(insertCollectionQuery, &errorText);
@@ -638,7 +1072,10 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
             << authenticationPluginName
             << static_cast<int>(unlockSemantic)
             << customLockTimeoutMs
-            << static_cast<int>(accessControlMode);
+            << static_cast<int>(accessControlMode)
+            << encryptionAlgorithm(storagePluginName, encryptionPluginName)
+            << static_cast<int>(collectionDurability(storagePluginName, encryptionPluginName, durability))
+            << (wrappedDataKey.isEmpty() ? QVariant(QVariant::ByteArray) : QVariant::fromValue<QByteArray>(wrappedDataKey));
     iq.bindValues(ivalues);
 
     if (!m_db->beginTransaction()) {
@@ -662,8 +1099,14 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
     if (storagePluginName == encryptionPluginName) {
         pluginResult = m_encryptedStoragePlugins[storagePluginName]->createCollection(collectionName, authenticationKey);
     } else {
-        pluginResult = m_storagePlugins[storagePluginName]->createCollection(collectionName);
-        m_collectionAuthenticationKeys.insert(collectionName, authenticationKey);
+        pluginResult = m_storagePlugins[storagePluginName]->createCollectionWithDurability(collectionName, durability);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            const Sailfish::Secrets::Result unlockResult = setCollectionAuthenticationKey(collectionName, authenticationKey);
+            if (unlockResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                m_storagePlugins[storagePluginName]->removeCollection(collectionName);
+                pluginResult = unlockResult;
+            }
+        }
         // TODO: also set CustomLockTimeoutMs, flag for "is custom key", etc.
     }
 
@@ -672,6 +1115,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::createCustomLockCollection
         // It may be tempting to merely remove the commitTransaction() above, and just do a rollbackTransaction() here,
         // but DO NOT do so, as that could lead to the case where the plugin->createCollection() call succeeds,
         // but the master table commit fails.
+        m_collectionMetadata.remove(collectionName);
         const QString deleteCollectionQuery = QStringLiteral(
                     "DELETE FROM Collections"
                     " WHERE CollectionName = ?;");
@@ -748,6 +1192,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollection(
                 ? m_appPermissions->platformApplicationId()
                 : m_appPermissions->applicationId(callerPid);
 
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, QString(), Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
     DatabaseLocker locker(m_db);
 
     // Whenever we modify the master database + perform a plugin operation,
@@ -762,44 +1207,19 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollection(
     // In the future, we should mark the row as "dirty" via in-memory flag, if (5) fails,
     // so that we can re-attempt to remove it, at a later point in time.
 
-    const QString selectCollectionsQuery = QStringLiteral(
-                 "SELECT"
-                    " ApplicationId,"
-                    " StoragePluginName,"
-                    " EncryptionPluginName,"
-                    " AccessControlMode"
-                  " FROM Collections"
-                  " WHERE CollectionName = ?;"
-             );
-
     QString errorText;
-    Database::Query sq = m_db->prepare(selectCollectionsQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare select collections query: %1").arg(errorText));
-    }
-
     QVariantList values;
-    values << QVariant::fromValue<QString>(collectionName);
-    sq.bindValues(values);
-
-    if (!m_db->execute(sq, &errorText)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute select collections query: %1").arg(errorText));
-    }
 
     bool found = false;
-    QString collectionApplicationId;
-    QString collectionStoragePluginName;
-    QString collectionEncryptionPluginName;
-    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
-    if (sq.next()) {
-        found = true;
-        collectionApplicationId = sq.value(0).value<QString>();
-        collectionStoragePluginName = sq.value(1).value<QString>();
-        collectionEncryptionPluginName = sq.value(2).value<QString>();
-        collectionAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(sq.value(0).value<int>());
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
     }
+    QString collectionApplicationId = metadata.applicationId;
+    QString collectionStoragePluginName = metadata.storagePluginName;
+    QString collectionEncryptionPluginName = metadata.encryptionPluginName;
+    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = metadata.accessControlMode;
 
     if (!found) {
         // return success immediately.  No such collection exists, so "deleting" succeeded.
@@ -825,8 +1245,9 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollection(
     }
 
     // successfully removed from plugin storage, now remove the entry from the master table.
-    m_collectionAuthenticationKeys.remove(collectionName);
-    m_collectionLockTimers.remove(collectionName);
+    removeCollectionAuthenticationKey(collectionName);
+    m_collectionRelocks.cancel(collectionName);
+    m_collectionMetadata.remove(collectionName);
     const QString deleteCollectionQuery = QStringLiteral(
                 "DELETE FROM Collections"
                 " WHERE CollectionName = ?;");
@@ -896,56 +1317,20 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecret(
                 ? m_appPermissions->platformApplicationId()
                 : m_appPermissions->applicationId(callerPid);
 
-    const QString selectCollectionsQuery = QStringLiteral(
-                 "SELECT"
-                    " ApplicationId,"
-                    " UsesDeviceLockKey,"
-                    " StoragePluginName,"
-                    " EncryptionPluginName,"
-                    " AuthenticationPluginName,"
-                    " UnlockSemantic,"
-                    " CustomLockTimeoutMs,"
-                    " AccessControlMode"
-                  " FROM Collections"
-                  " WHERE CollectionName = ?;"
-             );
-
-    QString errorText;
-    Database::Query sq = m_db->prepare(selectCollectionsQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare select collections query: %1").arg(errorText));
-    }
-
-    QVariantList values;
-    values << QVariant::fromValue<QString>(collectionName);
-    sq.bindValues(values);
-
-    if (!m_db->execute(sq, &errorText)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute select collections query: %1").arg(errorText));
-    }
-
     bool found = false;
-    QString collectionApplicationId;
-    bool collectionUsesDeviceLockKey = false;
-    QString collectionStoragePluginName;
-    QString collectionEncryptionPluginName;
-    QString collectionAuthenticationPluginName;
-    int collectionUnlockSemantic = 0;
-    int collectionCustomLockTimeoutMs = 0;
-    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
-    if (sq.next()) {
-        found = true;
-        collectionApplicationId = sq.value(0).value<QString>();
-        collectionUsesDeviceLockKey = sq.value(1).value<int>() > 0;
-        collectionStoragePluginName = sq.value(2).value<QString>();
-        collectionEncryptionPluginName = sq.value(3).value<QString>();
-        collectionAuthenticationPluginName = sq.value(4).value<QString>();
-        collectionUnlockSemantic = sq.value(5).value<int>();
-        collectionCustomLockTimeoutMs = sq.value(6).value<int>();
-        collectionAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(sq.value(7).value<int>());
-    }
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
+    }
+    QString collectionApplicationId = metadata.applicationId;
+    bool collectionUsesDeviceLockKey = metadata.usesDeviceLockKey;
+    QString collectionStoragePluginName = metadata.storagePluginName;
+    QString collectionEncryptionPluginName = metadata.encryptionPluginName;
+    QString collectionAuthenticationPluginName = metadata.authenticationPluginName;
+    int collectionUnlockSemantic = metadata.unlockSemantic;
+    int collectionCustomLockTimeoutMs = metadata.customLockTimeoutMs;
+    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = metadata.accessControlMode;
 
     if (!found) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
@@ -1024,24 +1409,26 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecret(
             return authenticationResult;
         }
 
+        Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretContinuation;
+        continuation->collectionName = collectionName;
+        continuation->secretName = secretName;
+        continuation->secret = QByteArray(secret.constData(), secret.size()); // deep copy, as it may refer to a mapped memfd
+        continuation->userInteractionMode = userInteractionMode;
+        continuation->uiServiceAddress = uiServiceAddress;
+        continuation->collectionUsesDeviceLockKey = collectionUsesDeviceLockKey;
+        continuation->collectionApplicationId = collectionApplicationId;
+        continuation->collectionStoragePluginName = collectionStoragePluginName;
+        continuation->collectionEncryptionPluginName = collectionEncryptionPluginName;
+        continuation->collectionAuthenticationPluginName = collectionAuthenticationPluginName;
+        continuation->collectionUnlockSemantic = collectionUnlockSemantic;
+        continuation->collectionCustomLockTimeoutMs = collectionCustomLockTimeoutMs;
+        continuation->collectionAccessControlMode = collectionAccessControlMode;
         m_pendingRequests.insert(requestId,
                                  Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                      callerPid,
                                      requestId,
                                      Sailfish::Secrets::Daemon::ApiImpl::SetCollectionSecretRequest,
-                                     QVariantList() << collectionName
-                                                    << secretName
-                                                    << secret
-                                                    << userInteractionMode
-                                                    << uiServiceAddress
-                                                    << collectionUsesDeviceLockKey
-                                                    << collectionApplicationId
-                                                    << collectionStoragePluginName
-                                                    << collectionEncryptionPluginName
-                                                    << collectionAuthenticationPluginName
-                                                    << collectionUnlockSemantic
-                                                    << collectionCustomLockTimeoutMs
-                                                    << collectionAccessControlMode));
+                                     continuation));
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
     }
 
@@ -1063,7 +1450,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecret(
                     collectionUnlockSemantic,
                     collectionCustomLockTimeoutMs,
                     collectionAccessControlMode,
-                    m_collectionAuthenticationKeys.value(collectionName));
+                    m_collectionAuthenticationKeys.value(collectionName).rawData());
     }
 
     if (collectionUsesDeviceLockKey) {
@@ -1088,24 +1475,26 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecret(
         return authenticationResult;
     }
 
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretContinuation;
+    continuation->collectionName = collectionName;
+    continuation->secretName = secretName;
+    continuation->secret = QByteArray(secret.constData(), secret.size()); // deep copy, as it may refer to a mapped memfd
+    continuation->userInteractionMode = userInteractionMode;
+    continuation->uiServiceAddress = uiServiceAddress;
+    continuation->collectionUsesDeviceLockKey = collectionUsesDeviceLockKey;
+    continuation->collectionApplicationId = collectionApplicationId;
+    continuation->collectionStoragePluginName = collectionStoragePluginName;
+    continuation->collectionEncryptionPluginName = collectionEncryptionPluginName;
+    continuation->collectionAuthenticationPluginName = collectionAuthenticationPluginName;
+    continuation->collectionUnlockSemantic = collectionUnlockSemantic;
+    continuation->collectionCustomLockTimeoutMs = collectionCustomLockTimeoutMs;
+    continuation->collectionAccessControlMode = collectionAccessControlMode;
     m_pendingRequests.insert(requestId,
                              Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
                                  callerPid,
                                  requestId,
                                  Sailfish::Secrets::Daemon::ApiImpl::SetCollectionSecretRequest,
-                                 QVariantList() << collectionName
-                                                << secretName
-                                                << secret
-                                                << userInteractionMode
-                                                << uiServiceAddress
-                                                << collectionUsesDeviceLockKey
-                                                << collectionApplicationId
-                                                << collectionStoragePluginName
-                                                << collectionEncryptionPluginName
-                                                << collectionAuthenticationPluginName
-                                                << collectionUnlockSemantic
-                                                << collectionCustomLockTimeoutMs
-                                                << collectionAccessControlMode));
+                                 continuation));
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
 }
 
@@ -1134,6 +1523,45 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecretWithAut
     Q_UNUSED(userInteractionMode);
     Q_UNUSED(uiServiceAddress);
 
+    if (collectionStoragePluginName != collectionEncryptionPluginName
+            && m_sharedConnectionStoragePlugins.contains(collectionStoragePluginName)
+            && !m_db->withinTransaction()) {
+        // the storage plugin writes via the master database connection, so the
+        // metadata and the secret are committed (or rolled back) together.
+        Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
+        DatabaseLocker locker(m_db);
+        if (!m_db->beginTransaction()) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QLatin1String("Unable to begin set secret transaction"));
+        }
+        Sailfish::Secrets::Result result = setCollectionSecretWithAuthenticationKey(
+                    callerPid, requestId, collectionName, secretName, secret,
+                    userInteractionMode, uiServiceAddress, collectionUsesDeviceLockKey,
+                    collectionApplicationId, collectionStoragePluginName,
+                    collectionEncryptionPluginName, collectionAuthenticationPluginName,
+                    collectionUnlockSemantic, collectionCustomLockTimeoutMs,
+                    collectionAccessControlMode, authenticationKey);
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            m_db->rollbackTransaction();
+        } else if (!m_db->commitTransaction()) {
+            m_db->rollbackTransaction();
+            m_secretCache.remove(collectionName, generateHashedSecretName(collectionName, secretName));
+            result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                               QLatin1String("Unable to commit set secret transaction"));
+        }
+        return result;
+    }
+
+    // the key is verified when the data key is unwrapped, if the collection has one,
+    // so that nothing is written unless the collection can be unlocked with it.
+    if (collectionStoragePluginName != collectionEncryptionPluginName
+            && !m_collectionAuthenticationKeys.contains(collectionName)) {
+        const Sailfish::Secrets::Result unlockResult = setCollectionAuthenticationKey(collectionName, authenticationKey);
+        if (unlockResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return unlockResult;
+        }
+    }
+
     const QString selectSecretsCountQuery = QStringLiteral(
                  "SELECT"
                     " Count(*)"
@@ -1150,6 +1578,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecretWithAut
     }
 
     const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+    m_secretCache.remove(collectionName, hashedSecretName);
     QVariantList values;
     values << QVariant::fromValue<QString>(collectionName);
     values << QVariant::fromValue<QString>(hashedSecretName);
@@ -1254,15 +1683,31 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecretWithAut
             }
         }
     } else {
-        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
-            // TODO: some way to "test" the authenticationKey!
-            m_collectionAuthenticationKeys.insert(collectionName, authenticationKey);
-        }
-
-        QByteArray encrypted;
-        pluginResult = m_encryptionPlugins[collectionEncryptionPluginName]->encryptSecret(secret, m_collectionAuthenticationKeys.value(collectionName), &encrypted);
+        Sailfish::Secrets::StoragePlugin *storagePlugin = m_storagePlugins[collectionStoragePluginName];
+        Sailfish::Secrets::EncryptionPlugin *encryptionPlugin = m_encryptionPlugins[collectionEncryptionPluginName];
+        const Sailfish::Secrets::Daemon::SecureByteArray key = m_collectionAuthenticationKeys.value(collectionName);
+        // the chunks of a previous value which aren't overwritten are removed once the new value is stored.
+        const int previousChunkCount = secretAlreadyExists
+                ? storedSecretChunkCount(storagePlugin, encryptionPlugin, collectionName, hashedSecretName, key.rawData())
+                : 0;
+        // reads from asynchronous plugins aren't assembled from chunks, so they store secrets whole.
+        const int chunkSize = storagePlugin->supportsAsynchronousOperations() || encryptionPlugin->supportsAsynchronousOperations()
+                ? 0 : m_secretChunkSize;
+        int chunkCount = 0;
+        pluginResult = storeSecretChunks(storagePlugin, encryptionPlugin, collectionName, hashedSecretName,
+                                         key.rawData(), secret, chunkSize, &chunkCount);
         if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-            pluginResult = m_storagePlugins[collectionStoragePluginName]->setSecret(collectionName, hashedSecretName, encrypted);
+            removeSecretChunks(storagePlugin, collectionName, hashedSecretName, chunkCount, previousChunkCount);
+        }
+        // secrets written before their names were recorded are named when next written.
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded
+                && (!secretAlreadyExists || !secretNameStored(storagePlugin, collectionName, hashedSecretName))) {
+            Sailfish::Secrets::Result nameResult = storeSecretName(storagePlugin, encryptionPlugin, collectionName,
+                                                                   hashedSecretName, key, secretName);
+            if (nameResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                qCWarning(lcSailfishSecretsDaemon) << "Unable to store name of secret in collection:"
+                                                   << collectionName << nameResult.errorMessage();
+            }
         }
     }
 
@@ -1318,38 +1763,32 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecretWithAut
         }
     }
 
+    if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+        m_requestQueue->notifySecretChanged(collectionName, secretName);
+    }
+
     return pluginResult;
 }
 
-// set a standalone DeviceLock-protected secret
+// set multiple secrets in a collection
 Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneDeviceLockSecret(
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecrets(
         pid_t callerPid,
         quint64 requestId,
-        const QString &storagePluginName,
-        const QString &encryptionPluginName,
-        const QString &secretName,
-        const QByteArray &secret,
-        Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic unlockSemantic,
-        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
+        const QString &collectionName,
+        const QMap<QString, QByteArray> &secrets,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress)
 {
-    // TODO: Access Control requests to see if the application is permitted to set the secret.
-    Q_UNUSED(requestId); // until we implement access control queries, this method is synchronous, so requestId is unused.
-    Q_UNUSED(userInteractionMode);
-
-    if (secretName.isEmpty()) {
+    if (secrets.isEmpty() || secrets.contains(QString())) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
                                          QLatin1String("Empty secret name given"));
-    } else if (storagePluginName == encryptionPluginName && !m_encryptedStoragePlugins.contains(storagePluginName)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(storagePluginName));
-    } else if (storagePluginName != encryptionPluginName && !m_storagePlugins.contains(storagePluginName)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such storage plugin exists: %1").arg(storagePluginName));
-    } else if (storagePluginName != encryptionPluginName && !m_encryptionPlugins.contains(encryptionPluginName)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(encryptionPluginName));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Reserved collection name given"));
     }
 
     // TODO: perform access control request to see if the application has permission to write secure storage data.
@@ -1358,243 +1797,2257 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneDeviceLockSec
                 ? m_appPermissions->platformApplicationId()
                 : m_appPermissions->applicationId(callerPid);
 
-    const QString selectSecretsQuery = QStringLiteral(
-                "SELECT"
-                   " ApplicationId,"
-                   " UsesDeviceLockKey,"
-                   " StoragePluginName,"
-                   " AccessControlMode"
-                 " FROM Secrets"
-                 " WHERE CollectionName = ?"
-                 " AND SecretName = ?;"
-             );
-
-    QString errorText;
-    Database::Query ssq = m_db->prepare(selectSecretsQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
-    }
-
-    const QString collectionName = QStringLiteral("standalone");
-    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
-    QVariantList values;
-    values << QVariant::fromValue<QString>(collectionName);
-    values << QVariant::fromValue<QString>(hashedSecretName);
-    ssq.bindValues(values);
-
-    if (!m_db->execute(ssq, &errorText)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
-    }
-
     bool found = false;
-    QString secretApplicationId;
-    bool secretUsesDeviceLockKey = false;
-    QString secretStoragePluginName;
-    Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
-    if (ssq.next()) {
-        found = true;
-        secretApplicationId = ssq.value(0).value<QString>();
-        secretUsesDeviceLockKey = ssq.value(1).value<int>() > 0;
-        secretStoragePluginName = ssq.value(2).value<QString>();
-        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(ssq.value(3).value<int>());
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
+    }
+    QString collectionApplicationId = metadata.applicationId;
+    bool collectionUsesDeviceLockKey = metadata.usesDeviceLockKey;
+    QString collectionStoragePluginName = metadata.storagePluginName;
+    QString collectionEncryptionPluginName = metadata.encryptionPluginName;
+    QString collectionAuthenticationPluginName = metadata.authenticationPluginName;
+    int collectionUnlockSemantic = metadata.unlockSemantic;
+    int collectionCustomLockTimeoutMs = metadata.customLockTimeoutMs;
+    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = metadata.accessControlMode;
+
+    if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Nonexistent collection name given"));
     }
 
-    if (found && secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+    if (collectionAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
         // TODO: perform access control request, to ask for permission to set the secret in the collection.
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
                                          QLatin1String("Access control requests are not currently supported. TODO!"));
-    } else if (found && secretApplicationId != callerApplicationId) {
+    } else if (collectionApplicationId != callerApplicationId) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
-                                         QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
-    } else if (found && secretUsesDeviceLockKey == 0) {
-        // don't update the secret if it would involve changing from a custom-lock to device-lock protected secret.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QString::fromLatin1("Secret %1 already exists and is not a devicelock protected secret")
-                                         .arg(secretName));
-    } else if (found && secretStoragePluginName.compare(storagePluginName, Qt::CaseInsensitive) != 0) {
-        // don't update the secret if it would involve changing which plugin it's stored in.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QString::fromLatin1("Secret %1 already exists and is not stored via plugin %2")
-                                         .arg(secretName, storagePluginName));
+                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
+    } else if (collectionStoragePluginName == collectionEncryptionPluginName
+            && !m_encryptedStoragePlugins.contains(collectionStoragePluginName)) {
+        // TODO: this means we have "stale" data in the database; what should we do in this case?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(collectionStoragePluginName));
+    } else if (collectionStoragePluginName != collectionEncryptionPluginName
+            && (collectionStoragePluginName.isEmpty() || !m_storagePlugins.contains(collectionStoragePluginName))) {
+        // TODO: this means we have "stale" data in the database; what should we do in this case?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(collectionStoragePluginName));
+    } else if (collectionStoragePluginName != collectionEncryptionPluginName
+            && (collectionEncryptionPluginName.isEmpty() || !m_encryptionPlugins.contains(collectionEncryptionPluginName))) {
+        // TODO: this means we have "stale" data in the database; what should we do in this case?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(collectionEncryptionPluginName));
     }
 
-    // Write to the master database prior to the storage plugin.
+    if (collectionStoragePluginName == collectionEncryptionPluginName) {
+        bool locked = false;
+        Sailfish::Secrets::Result pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return pluginResult;
+        }
+        if (!locked) {
+            return setCollectionSecretsWithAuthenticationKey(
+                        callerPid,
+                        requestId,
+                        collectionName,
+                        secrets,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        collectionUsesDeviceLockKey,
+                        collectionApplicationId,
+                        collectionStoragePluginName,
+                        collectionEncryptionPluginName,
+                        collectionAuthenticationPluginName,
+                        collectionUnlockSemantic,
+                        collectionCustomLockTimeoutMs,
+                        collectionAccessControlMode,
+                        QByteArray());
+        }
 
-    const QString updateSecretQuery = QStringLiteral(
-                 "UPDATE Secrets"
-                 " SET ApplicationId = ?,"
-                     " UsesDeviceLockKey = ?,"
-                     " StoragePluginName = ?,"
-                     " EncryptionPluginName = ?,"
-                     " AuthenticationPluginName = ?,"
-                     " UnlockSemantic = ?,"
-                     " CustomLockTimeoutMs = ?,"
-                     " AccessControlMode = ?"
-                 " WHERE CollectionName = ?"
-                 " AND SecretName = ?;"
-             );
+        if (collectionUsesDeviceLockKey) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                             QString::fromLatin1("Collection %1 is locked and requires device lock authentication").arg(collectionName));
+        }
 
-    const QString insertSecretQuery = QStringLiteral(
-                "INSERT INTO Secrets ("
-                  "CollectionName,"
-                  "SecretName,"
-                  "ApplicationId,"
-                  "UsesDeviceLockKey,"
-                  "StoragePluginName,"
-                  "EncryptionPluginName,"
-                  "AuthenticationPluginName,"
-                  "UnlockSemantic,"
-                  "CustomLockTimeoutMs,"
-                  "AccessControlMode"
-                ")"
-                " VALUES ("
-                  "?,?,?,?,?,?,?,?,?,?"
-                ");");
+        if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                             QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
+        }
 
-    Database::Query iq = m_db->prepare(found ? updateSecretQuery : insertSecretQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        m_db->rollbackTransaction();
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare insert secret query: %1").arg(errorText));
+        // perform UI request to get the authentication key for the collection
+        Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
+                    callerPid,
+                    requestId,
+                    callerApplicationId,
+                    collectionName,
+                    QString(), // the whole collection is being unlocked, not any one secret.
+                    uiServiceAddress);
+        if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+            return authenticationResult;
+        }
+
+        Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretsContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretsContinuation;
+        continuation->collectionName = collectionName;
+        continuation->secrets = secrets;
+        continuation->userInteractionMode = userInteractionMode;
+        continuation->uiServiceAddress = uiServiceAddress;
+        continuation->collectionUsesDeviceLockKey = collectionUsesDeviceLockKey;
+        continuation->collectionApplicationId = collectionApplicationId;
+        continuation->collectionStoragePluginName = collectionStoragePluginName;
+        continuation->collectionEncryptionPluginName = collectionEncryptionPluginName;
+        continuation->collectionAuthenticationPluginName = collectionAuthenticationPluginName;
+        continuation->collectionUnlockSemantic = collectionUnlockSemantic;
+        continuation->collectionCustomLockTimeoutMs = collectionCustomLockTimeoutMs;
+        continuation->collectionAccessControlMode = collectionAccessControlMode;
+        m_pendingRequests.insert(requestId,
+                                 Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                     callerPid,
+                                     requestId,
+                                     Sailfish::Secrets::Daemon::ApiImpl::SetCollectionSecretsRequest,
+                                     continuation));
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
     }
 
-    QVariantList ivalues;
-    if (!found) {
-        ivalues << QVariant::fromValue<QString>(collectionName);
-        ivalues << QVariant::fromValue<QString>(hashedSecretName);
+
+    if (m_collectionAuthenticationKeys.contains(collectionName)) {
+        return setCollectionSecretsWithAuthenticationKey(
+                    callerPid,
+                    requestId,
+                    collectionName,
+                    secrets,
+                    userInteractionMode,
+                    uiServiceAddress,
+                    collectionUsesDeviceLockKey,
+                    collectionApplicationId,
+                    collectionStoragePluginName,
+                    collectionEncryptionPluginName,
+                    collectionAuthenticationPluginName,
+                    collectionUnlockSemantic,
+                    collectionCustomLockTimeoutMs,
+                    collectionAccessControlMode,
+                    m_collectionAuthenticationKeys.value(collectionName).rawData());
     }
-    ivalues << QVariant::fromValue<QString>(callerApplicationId);
-    ivalues << QVariant::fromValue<int>(1);
-    ivalues << QVariant::fromValue<QString>(storagePluginName);
-    ivalues << QVariant::fromValue<QString>(encryptionPluginName);
-    ivalues << QVariant::fromValue<QString>(Sailfish::Secrets::SecretManager::DefaultAuthenticationPluginName);
-    ivalues << QVariant::fromValue<int>(static_cast<int>(unlockSemantic));
-    ivalues << QVariant::fromValue<int>(0);
-    ivalues << QVariant::fromValue<int>(static_cast<int>(accessControlMode));
-    if (found) {
-        ivalues << QVariant::fromValue<QString>(collectionName);
-        ivalues << QVariant::fromValue<QString>(hashedSecretName);
+
+    if (collectionUsesDeviceLockKey) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromLatin1("Collection %1 is locked and requires device lock authentication").arg(collectionName));
     }
-    iq.bindValues(ivalues);
 
-    if (!m_db->beginTransaction()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                         QLatin1String("Unable to begin insert secret transaction"));
+    if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                         QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
     }
 
-    if (!m_db->execute(iq, &errorText)) {
-        m_db->rollbackTransaction();
+    // perform UI request to get the authentication key for the collection
+    Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
+                callerPid,
+                requestId,
+                callerApplicationId,
+                collectionName,
+                QString(), // the whole collection is being unlocked, not any one secret.
+                uiServiceAddress);
+    if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+        return authenticationResult;
+    }
+
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretsContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretsContinuation;
+    continuation->collectionName = collectionName;
+    continuation->secrets = secrets;
+    continuation->userInteractionMode = userInteractionMode;
+    continuation->uiServiceAddress = uiServiceAddress;
+    continuation->collectionUsesDeviceLockKey = collectionUsesDeviceLockKey;
+    continuation->collectionApplicationId = collectionApplicationId;
+    continuation->collectionStoragePluginName = collectionStoragePluginName;
+    continuation->collectionEncryptionPluginName = collectionEncryptionPluginName;
+    continuation->collectionAuthenticationPluginName = collectionAuthenticationPluginName;
+    continuation->collectionUnlockSemantic = collectionUnlockSemantic;
+    continuation->collectionCustomLockTimeoutMs = collectionCustomLockTimeoutMs;
+    continuation->collectionAccessControlMode = collectionAccessControlMode;
+    m_pendingRequests.insert(requestId,
+                             Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                 callerPid,
+                                 requestId,
+                                 Sailfish::Secrets::Daemon::ApiImpl::SetCollectionSecretsRequest,
+                                 continuation));
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionSecretsWithAuthenticationKey(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &collectionName,
+        const QMap<QString, QByteArray> &secrets,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        bool collectionUsesDeviceLockKey,
+        const QString &collectionApplicationId,
+        const QString &collectionStoragePluginName,
+        const QString &collectionEncryptionPluginName,
+        const QString &collectionAuthenticationPluginName,
+        int collectionUnlockSemantic,
+        int collectionCustomLockTimeoutMs,
+        Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode,
+        const QByteArray &authenticationKey)
+{
+    // In the future, we may need these for access control UI flows.
+    Q_UNUSED(callerPid);
+    Q_UNUSED(requestId);
+    Q_UNUSED(userInteractionMode);
+    Q_UNUSED(uiServiceAddress);
+
+    // the key is verified when the data key is unwrapped, if the collection has one,
+    // so that nothing is written unless the collection can be unlocked with it.
+    if (collectionStoragePluginName != collectionEncryptionPluginName
+            && !m_collectionAuthenticationKeys.contains(collectionName)) {
+        const Sailfish::Secrets::Result unlockResult = setCollectionAuthenticationKey(collectionName, authenticationKey);
+        if (unlockResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return unlockResult;
+        }
+    }
+
+    const QString selectSecretNamesQuery = QStringLiteral(
+                 "SELECT"
+                    " SecretName"
+                  " FROM Secrets"
+                  " WHERE CollectionName = ?;"
+             );
+
+    QString errorText;
+    Database::Query ssq = m_db->prepare(selectSecretNamesQuery, &errorText);
+    if (!errorText.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute insert secret query: %1").arg(errorText));
+                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
     }
 
-    if (!m_db->commitTransaction()) {
-        m_db->rollbackTransaction();
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                         QLatin1String("Unable to commit insert secret transaction"));
+    QVariantList values;
+    values << QVariant::fromValue<QString>(collectionName);
+    ssq.bindValues(values);
+
+    if (!m_db->execute(ssq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
     }
 
-    Sailfish::Secrets::Result pluginResult;
-    if (storagePluginName == encryptionPluginName) {
-        // TODO: does the following work?  We'd need to add methods to the encrypted storage plugin: re-encryptStandaloneSecrets or something...
-        pluginResult = m_encryptedStoragePlugins[storagePluginName]->setSecret(collectionName, hashedSecretName, secret, DeviceLockKey);
-    } else {
-        QByteArray encrypted;
-        pluginResult = m_encryptionPlugins[encryptionPluginName]->encryptSecret(secret, DeviceLockKey, &encrypted);
-        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-            pluginResult = m_storagePlugins[storagePluginName]->setSecret(collectionName, hashedSecretName, encrypted);
-            if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-                m_standaloneSecretAuthenticationKeys.insert(hashedSecretName, DeviceLockKey);
-            }
+    QSet<QString> existingSecretNames;
+    while (ssq.next()) {
+        existingSecretNames.insert(ssq.value(0).value<QString>());
+    }
+
+    QMap<QString, QByteArray> hashedSecrets;
+    QMap<QString, QString> secretNamesByHash;
+    QVariantList newSecretNames;
+    for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); it++) {
+        const QString hashedSecretName = generateHashedSecretName(collectionName, it.key());
+        m_secretCache.remove(collectionName, hashedSecretName);
+        hashedSecrets.insert(hashedSecretName, it.value());
+        secretNamesByHash.insert(hashedSecretName, it.key());
+        if (!existingSecretNames.contains(hashedSecretName)) {
+            newSecretNames.append(QVariant::fromValue<QString>(hashedSecretName));
         }
     }
 
-    if (pluginResult.code() == Sailfish::Secrets::Result::Failed && !found) {
-        // The plugin was unable to set the secret in its storage.
-        // Let's delete it from our master table if it was a new one.
-        // It may be tempting to merely remove the commitTransaction() above, and just do a rollbackTransaction() here,
-        // but DO NOT do so, as that could lead to the case where the plugin->setSecret() call succeeds,
-        // but the master table commit fails.
-        const QString deleteSecretQuery = QStringLiteral(
-                    "DELETE FROM Secrets"
-                    " WHERE CollectionName = ?"
-                    " AND SecretName = ?;");
+    // The column values are the same for every new secret, apart from the name.
+    QVariantList collectionNames;
+    for (int i = 0; i < newSecretNames.size(); ++i) {
+        collectionNames.append(QVariant::fromValue<QString>(collectionName));
+    }
 
-        Database::Query dq = m_db->prepare(deleteSecretQuery, &errorText);
+    if (newSecretNames.size()) {
+        // Write to the master database prior to the storage plugin.
+        // All of the new secrets are inserted as one batch within a single transaction.
+        const QString insertSecretQuery = QStringLiteral(
+                    "INSERT INTO Secrets ("
+                      "CollectionName,"
+                      "SecretName,"
+                      "ApplicationId,"
+                      "UsesDeviceLockKey,"
+                      "StoragePluginName,"
+                      "EncryptionPluginName,"
+                      "AuthenticationPluginName,"
+                      "UnlockSemantic,"
+                      "CustomLockTimeoutMs,"
+                      "AccessControlMode"
+                    ")"
+                    " VALUES ("
+                      "?,?,?,?,?,?,?,?,?,?"
+                    ");");
+
+        Database::Query iq = m_db->prepare(insertSecretQuery, &errorText);
         if (!errorText.isEmpty()) {
-            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to prepare insert secret query: %1").arg(errorText));
+        }
+
+        QVariantList applicationIds, usesDeviceLockKeys, storagePluginNames, encryptionPluginNames,
+                authenticationPluginNames, unlockSemantics, customLockTimeouts, accessControlModes;
+        for (int i = 0; i < newSecretNames.size(); ++i) {
+            applicationIds << QVariant::fromValue<QString>(collectionApplicationId);
+            usesDeviceLockKeys << QVariant::fromValue<int>(collectionUsesDeviceLockKey ? 1 : 0);
+            storagePluginNames << QVariant::fromValue<QString>(collectionStoragePluginName);
+            encryptionPluginNames << QVariant::fromValue<QString>(collectionEncryptionPluginName);
+            authenticationPluginNames << QVariant::fromValue<QString>(collectionAuthenticationPluginName);
+            unlockSemantics << QVariant::fromValue<int>(collectionUnlockSemantic);
+            customLockTimeouts << QVariant::fromValue<int>(collectionCustomLockTimeoutMs);
+            accessControlModes << QVariant::fromValue<int>(static_cast<int>(collectionAccessControlMode));
+        }
+
+        QVariantList ivalues;
+        ivalues << QVariant(collectionNames);
+        ivalues << QVariant(newSecretNames);
+        ivalues << QVariant(applicationIds);
+        ivalues << QVariant(usesDeviceLockKeys);
+        ivalues << QVariant(storagePluginNames);
+        ivalues << QVariant(encryptionPluginNames);
+        ivalues << QVariant(authenticationPluginNames);
+        ivalues << QVariant(unlockSemantics);
+        ivalues << QVariant(customLockTimeouts);
+        ivalues << QVariant(accessControlModes);
+        iq.bindValues(ivalues);
+
+        if (!m_db->beginTransaction()) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QLatin1String("Unable to begin insert secrets transaction"));
+        }
+
+        if (!m_db->executeBatch(iq, &errorText)) {
+            m_db->rollbackTransaction();
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to execute insert secrets query: %1").arg(errorText));
+        }
+
+        if (!m_db->commitTransaction()) {
+            m_db->rollbackTransaction();
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QLatin1String("Unable to commit insert secrets transaction"));
+        }
+    }
+
+    Sailfish::Secrets::Result pluginResult;
+    if (collectionStoragePluginName == collectionEncryptionPluginName) {
+        bool locked = false;
+        pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            if (locked) {
+                pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, authenticationKey);
+                if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                    // unable to apply the new authenticationKey.
+                    m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
+                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                                     QString::fromLatin1("Unable to decrypt collection %1 with the entered authentication key").arg(collectionName));
+
+                }
+                pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
+                if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                    m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
+                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                                     QString::fromLatin1("Unable to check lock state of collection %1 after setting the entered authentication key").arg(collectionName));
+
+                }
+            }
+            if (locked) {
+                // still locked, even after applying the new authenticationKey?  The authenticationKey was wrong.
+                m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                                 QString::fromLatin1("The authentication key entered for collection %1 was incorrect").arg(collectionName));
+            } else {
+                // successfully unlocked the encrypted storage collection.  write the secrets.
+                pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->setSecrets(collectionName, hashedSecrets);
+            }
+        }
+    } else {
+        // encrypt every value up front, so that the storage plugin can write them all at once.
+        // The values are stored whole, so any chunks of the values they replace are removed.
+        // The names of new secrets (and of any written before names were recorded) are stored in the same batch.
+        QMap<QString, QByteArray> encryptedSecrets;
+        QMap<QString, QByteArray> previousSecrets;
+        QMap<QString, QByteArray> storedNameEntries;
+        QStringList replacedSecretNames;
+        QStringList replacedNameEntries;
+        for (QMap<QString, QByteArray>::const_iterator it = hashedSecrets.constBegin(); it != hashedSecrets.constEnd(); it++) {
+            if (existingSecretNames.contains(it.key())) {
+                replacedSecretNames.append(it.key());
+                replacedNameEntries.append(secretNameEntryName(it.key()));
+            }
+        }
+        if (!replacedSecretNames.isEmpty()
+                && m_storagePlugins[collectionStoragePluginName]->getSecrets(collectionName, replacedSecretNames, &previousSecrets).code()
+                        != Sailfish::Secrets::Result::Succeeded) {
+            previousSecrets.clear();
+        }
+        if (!replacedNameEntries.isEmpty()
+                && m_storagePlugins[collectionStoragePluginName]->getSecrets(collectionName, replacedNameEntries, &storedNameEntries).code()
+                        != Sailfish::Secrets::Result::Succeeded) {
+            storedNameEntries.clear();
+        }
+        // large batches (such as imports) are encrypted in parallel.
+        QVector<PendingEncryption> pendingEncryptions;
+        pendingEncryptions.reserve(2 * hashedSecrets.size());
+        for (QMap<QString, QByteArray>::const_iterator it = hashedSecrets.constBegin(); it != hashedSecrets.constEnd(); it++) {
+            PendingEncryption value;
+            value.storedName = it.key();
+            value.plaintext = it.value();
+            pendingEncryptions.append(value);
+            const QString nameEntryName = secretNameEntryName(it.key());
+            if (!storedNameEntries.contains(nameEntryName)) {
+                PendingEncryption name;
+                name.storedName = nameEntryName;
+                name.plaintext = secretNamesByHash.value(it.key()).toUtf8();
+                pendingEncryptions.append(name);
+            }
+        }
+        QtConcurrent::blockingMap(pendingEncryptions, BatchEncryptor(m_encryptionPlugins[collectionEncryptionPluginName],
+                                                                     m_collectionAuthenticationKeys.value(collectionName)));
+        for (QVector<PendingEncryption>::const_iterator it = pendingEncryptions.constBegin(); it != pendingEncryptions.constEnd(); it++) {
+            if (!it->encrypted) {
+                pluginResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginEncryptionError,
+                                                         QString::fromLatin1("Unable to encrypt secrets in collection %1").arg(collectionName));
+                break;
+            }
+            encryptedSecrets.insert(it->storedName, it->ciphertext);
+        }
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            pluginResult = m_storagePlugins[collectionStoragePluginName]->setSecrets(collectionName, encryptedSecrets);
+        }
+        for (QMap<QString, QByteArray>::const_iterator it = previousSecrets.constBegin();
+                pluginResult.code() == Sailfish::Secrets::Result::Succeeded && it != previousSecrets.constEnd(); it++) {
+            removeSecretChunks(m_storagePlugins[collectionStoragePluginName], collectionName, it.key(), 0,
+                               secretChunkCount(m_encryptionPlugins[collectionEncryptionPluginName], it.value(),
+                                                m_collectionAuthenticationKeys.value(collectionName).rawData()));
+        }
+    }
+
+    if (pluginResult.code() == Sailfish::Secrets::Result::Failed && newSecretNames.size()) {
+        // The plugin was unable to set the secrets in its storage.
+        // Let's delete the new ones from our master table.
+        // See setCollectionSecretWithAuthenticationKey() for why this isn't done via rollbackTransaction().
+        const QString deleteSecretQuery = QStringLiteral(
+                    "DELETE FROM Secrets"
+                    " WHERE CollectionName = ?"
+                    " AND SecretName = ?;");
+
+        Database::Query dq = m_db->prepare(deleteSecretQuery, &errorText);
+        if (!errorText.isEmpty()) {
+            // TODO: add a "dirty" flag for these secrets somewhere in memory, so we can try again later.
             return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
                                              QString::fromLatin1("Unable to prepare delete secret query: %1"
                                                                  " while removing artifacts due to plugin operation failure: %2: %3")
                                              .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
         }
 
-        QVariantList values;
-        values << QVariant::fromValue<QString>(collectionName);
-        values << QVariant::fromValue<QString>(hashedSecretName);
-        dq.bindValues(values);
+        QVariantList dvalues;
+        dvalues << QVariant(collectionNames);
+        dvalues << QVariant(newSecretNames);
+        dq.bindValues(dvalues);
+
+        if (!m_db->beginTransaction()) {
+            // TODO: add a "dirty" flag for these secrets somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QString::fromLatin1("Unable to begin delete secrets transaction"
+                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
+                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+
+        if (!m_db->executeBatch(dq, &errorText)) {
+            m_db->rollbackTransaction();
+            // TODO: add a "dirty" flag for these secrets somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to execute delete secrets query: %1"
+                                                                 " while removing artifacts due to plugin operation failure: %2: %3")
+                                             .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+
+        if (!m_db->commitTransaction()) {
+            m_db->rollbackTransaction();
+            // TODO: add a "dirty" flag for these secrets somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QString::fromLatin1("Unable to commit delete secrets transaction"
+                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
+                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+    }
+
+    if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+        for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); it++) {
+            m_requestQueue->notifySecretChanged(collectionName, it.key());
+        }
+    }
+
+    return pluginResult;
+}
+
+// set a standalone DeviceLock-protected secret
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneDeviceLockSecret(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &storagePluginName,
+        const QString &encryptionPluginName,
+        const QString &secretName,
+        const QByteArray &secret,
+        Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic unlockSemantic,
+        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
+{
+    // TODO: Access Control requests to see if the application is permitted to set the secret.
+    Q_UNUSED(requestId); // until we implement access control queries, this method is synchronous, so requestId is unused.
+    Q_UNUSED(userInteractionMode);
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (storagePluginName == encryptionPluginName && !m_encryptedStoragePlugins.contains(storagePluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(storagePluginName));
+    } else if (storagePluginName != encryptionPluginName && !m_storagePlugins.contains(storagePluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(storagePluginName));
+    } else if (storagePluginName != encryptionPluginName && !m_encryptionPlugins.contains(encryptionPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(encryptionPluginName));
+    }
+
+    // TODO: perform access control request to see if the application has permission to write secure storage data.
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+
+    const QString selectSecretsQuery = QStringLiteral(
+                "SELECT"
+                   " ApplicationId,"
+                   " UsesDeviceLockKey,"
+                   " StoragePluginName,"
+                   " AccessControlMode"
+                 " FROM Secrets"
+                 " WHERE CollectionName = ?"
+                 " AND SecretName = ?;"
+             );
+
+    QString errorText;
+    Database::Query ssq = m_db->prepare(selectSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
+    }
+
+    const QString collectionName = QStringLiteral("standalone");
+    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+    QVariantList values;
+    values << QVariant::fromValue<QString>(collectionName);
+    values << QVariant::fromValue<QString>(hashedSecretName);
+    ssq.bindValues(values);
+
+    if (!m_db->execute(ssq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
+    }
+
+    bool found = false;
+    QString secretApplicationId;
+    bool secretUsesDeviceLockKey = false;
+    QString secretStoragePluginName;
+    Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
+    if (ssq.next()) {
+        found = true;
+        secretApplicationId = ssq.value(0).value<QString>();
+        secretUsesDeviceLockKey = ssq.value(1).value<int>() > 0;
+        secretStoragePluginName = ssq.value(2).value<QString>();
+        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(ssq.value(3).value<int>());
+    }
+
+    if (found && secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to set the secret in the collection.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Access control requests are not currently supported. TODO!"));
+    } else if (found && secretApplicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
+    } else if (found && secretUsesDeviceLockKey == 0) {
+        // don't update the secret if it would involve changing from a custom-lock to device-lock protected secret.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QString::fromLatin1("Secret %1 already exists and is not a devicelock protected secret")
+                                         .arg(secretName));
+    } else if (found && secretStoragePluginName.compare(storagePluginName, Qt::CaseInsensitive) != 0) {
+        // don't update the secret if it would involve changing which plugin it's stored in.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QString::fromLatin1("Secret %1 already exists and is not stored via plugin %2")
+                                         .arg(secretName, storagePluginName));
+    }
+
+    // Write to the master database prior to the storage plugin.
+
+    const QString updateSecretQuery = QStringLiteral(
+                 "UPDATE Secrets"
+                 " SET ApplicationId = ?,"
+                     " UsesDeviceLockKey = ?,"
+                     " StoragePluginName = ?,"
+                     " EncryptionPluginName = ?,"
+                     " AuthenticationPluginName = ?,"
+                     " UnlockSemantic = ?,"
+                     " CustomLockTimeoutMs = ?,"
+                     " AccessControlMode = ?"
+                 " WHERE CollectionName = ?"
+                 " AND SecretName = ?;"
+             );
+
+    const QString insertSecretQuery = QStringLiteral(
+                "INSERT INTO Secrets ("
+                  "CollectionName,"
+                  "SecretName,"
+                  "ApplicationId,"
+                  "UsesDeviceLockKey,"
+                  "StoragePluginName,"
+                  "EncryptionPluginName,"
+                  "AuthenticationPluginName,"
+                  "UnlockSemantic,"
+                  "CustomLockTimeoutMs,"
+                  "AccessControlMode"
+                ")"
+                " VALUES ("
+                  "?,?,?,?,?,?,?,?,?,?"
+                ");");
+
+    Database::Query iq = m_db->prepare(found ? updateSecretQuery : insertSecretQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare insert secret query: %1").arg(errorText));
+    }
+
+    QVariantList ivalues;
+    if (!found) {
+        ivalues << QVariant::fromValue<QString>(collectionName);
+        ivalues << QVariant::fromValue<QString>(hashedSecretName);
+    }
+    ivalues << QVariant::fromValue<QString>(callerApplicationId);
+    ivalues << QVariant::fromValue<int>(1);
+    ivalues << QVariant::fromValue<QString>(storagePluginName);
+    ivalues << QVariant::fromValue<QString>(encryptionPluginName);
+    ivalues << QVariant::fromValue<QString>(Sailfish::Secrets::SecretManager::DefaultAuthenticationPluginName);
+    ivalues << QVariant::fromValue<int>(static_cast<int>(unlockSemantic));
+    ivalues << QVariant::fromValue<int>(0);
+    ivalues << QVariant::fromValue<int>(static_cast<int>(accessControlMode));
+    if (found) {
+        ivalues << QVariant::fromValue<QString>(collectionName);
+        ivalues << QVariant::fromValue<QString>(hashedSecretName);
+    }
+    iq.bindValues(ivalues);
+
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Unable to begin insert secret transaction"));
+    }
+
+    if (!m_db->execute(iq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute insert secret query: %1").arg(errorText));
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Unable to commit insert secret transaction"));
+    }
+
+    Sailfish::Secrets::Result pluginResult;
+    if (storagePluginName == encryptionPluginName) {
+        // TODO: does the following work?  We'd need to add methods to the encrypted storage plugin: re-encryptStandaloneSecrets or something...
+        pluginResult = m_encryptedStoragePlugins[storagePluginName]->setSecret(collectionName, hashedSecretName, secret, m_deviceLockKey.rawData());
+    } else {
+        QByteArray encrypted;
+        pluginResult = m_encryptionPlugins[encryptionPluginName]->encryptSecret(secret, m_deviceLockKey.rawData(), &encrypted);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            pluginResult = m_storagePlugins[storagePluginName]->setSecret(collectionName, hashedSecretName, encrypted);
+            if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+                m_standaloneSecretAuthenticationKeys.insert(hashedSecretName, m_deviceLockKey);
+            }
+        }
+    }
+
+    if (pluginResult.code() == Sailfish::Secrets::Result::Failed && !found) {
+        // The plugin was unable to set the secret in its storage.
+        // Let's delete it from our master table if it was a new one.
+        // It may be tempting to merely remove the commitTransaction() above, and just do a rollbackTransaction() here,
+        // but DO NOT do so, as that could lead to the case where the plugin->setSecret() call succeeds,
+        // but the master table commit fails.
+        const QString deleteSecretQuery = QStringLiteral(
+                    "DELETE FROM Secrets"
+                    " WHERE CollectionName = ?"
+                    " AND SecretName = ?;");
+
+        Database::Query dq = m_db->prepare(deleteSecretQuery, &errorText);
+        if (!errorText.isEmpty()) {
+            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to prepare delete secret query: %1"
+                                                                 " while removing artifacts due to plugin operation failure: %2: %3")
+                                             .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+
+        QVariantList values;
+        values << QVariant::fromValue<QString>(collectionName);
+        values << QVariant::fromValue<QString>(hashedSecretName);
+        dq.bindValues(values);
+
+        if (!m_db->beginTransaction()) {
+            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QString::fromLatin1("Unable to begin delete secret transaction"
+                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
+                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+
+        if (!m_db->execute(dq, &errorText)) {
+            m_db->rollbackTransaction();
+            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to execute delete secret query: %1"
+                                                                 " while removing artifacts due to plugin operation failure: %2: %3")
+                                             .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+
+        if (!m_db->commitTransaction()) {
+            m_db->rollbackTransaction();
+            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QString::fromLatin1("Unable to commit delete secret transaction"
+                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
+                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+    }
+
+    return pluginResult;
+}
+
+// set a standalone CustomLock-protected secret
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSecret(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &storagePluginName,
+        const QString &encryptionPluginName,
+        const QString &authenticationPluginName,
+        const QString &secretName,
+        const QByteArray &secret,
+        Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic unlockSemantic,
+        int customLockTimeoutMs,
+        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress)
+{
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (storagePluginName == encryptionPluginName && !m_encryptedStoragePlugins.contains(storagePluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(storagePluginName));
+    } else if (storagePluginName != encryptionPluginName && !m_storagePlugins.contains(storagePluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(storagePluginName));
+    } else if (storagePluginName != encryptionPluginName && !m_encryptionPlugins.contains(encryptionPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(encryptionPluginName));
+    }
+
+    // TODO: perform access control request to see if the application has permission to write secure storage data.
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+
+    const QString selectSecretsQuery = QStringLiteral(
+                "SELECT"
+                   " ApplicationId,"
+                   " UsesDeviceLockKey,"
+                   " StoragePluginName,"
+                   " AccessControlMode"
+                 " FROM Secrets"
+                 " WHERE CollectionName = ?"
+                 " AND SecretName = ?;"
+             );
+
+    QString errorText;
+    Database::Query ssq = m_db->prepare(selectSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
+    }
+
+    const QString collectionName = QStringLiteral("standalone");
+    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+    QVariantList values;
+    values << QVariant::fromValue<QString>(collectionName);
+    values << QVariant::fromValue<QString>(hashedSecretName);
+    ssq.bindValues(values);
+
+    if (!m_db->execute(ssq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
+    }
+
+    bool found = false;
+    QString secretApplicationId;
+    bool secretUsesDeviceLockKey = false;
+    QString secretStoragePluginName;
+    Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
+    if (ssq.next()) {
+        found = true;
+        secretApplicationId = ssq.value(0).value<QString>();
+        secretUsesDeviceLockKey = ssq.value(1).value<int>() > 0;
+        secretStoragePluginName = ssq.value(2).value<QString>();
+        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(ssq.value(3).value<int>());
+    }
+
+    if (found && secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to set the secret in the collection.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Access control requests are not currently supported. TODO!"));
+    } else if (found && secretApplicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
+    } else if (found && secretUsesDeviceLockKey == 1) {
+        // don't update the secret if it would involve changing from a device-lock to custom-lock protected secret.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QString::fromLatin1("Secret %1 already exists and is not a devicelock protected secret")
+                                         .arg(secretName));
+    } else if (found && secretStoragePluginName.compare(storagePluginName, Qt::CaseInsensitive) != 0) {
+        // don't update the secret if it would involve changing which plugin it's stored in.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QString::fromLatin1("Secret %1 already exists and is not stored via plugin %2")
+                                         .arg(secretName, storagePluginName));
+    } else if (m_authenticationPlugins[authenticationPluginName]->authenticationType() == Sailfish::Secrets::AuthenticationPlugin::ApplicationSpecificAuthentication
+               && (userInteractionMode != Sailfish::Secrets::SecretManager::InProcessUserInteractionMode || uiServiceAddress.isEmpty())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresInProcessUserInteraction,
+                                         QString::fromLatin1("Authentication plugin %1 requires in-process user interaction").arg(authenticationPluginName));
+    } else if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                         QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(authenticationPluginName));
+    }
+
+    // perform the authentication required to get the authentication key which will be used
+    // to encrypt the secret.
+    Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[authenticationPluginName]->beginAuthentication(
+                callerPid,
+                requestId,
+                callerApplicationId,
+                QString(),
+                secretName,
+                uiServiceAddress);
+    if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+        return authenticationResult;
+    }
+
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetStandaloneCustomLockSecretContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetStandaloneCustomLockSecretContinuation;
+    continuation->storagePluginName = storagePluginName;
+    continuation->encryptionPluginName = encryptionPluginName;
+    continuation->authenticationPluginName = authenticationPluginName;
+    continuation->secretName = secretName;
+    continuation->secret = secret;
+    continuation->unlockSemantic = unlockSemantic;
+    continuation->customLockTimeoutMs = customLockTimeoutMs;
+    continuation->accessControlMode = accessControlMode;
+    continuation->userInteractionMode = userInteractionMode;
+    continuation->uiServiceAddress = uiServiceAddress;
+    m_pendingRequests.insert(requestId,
+                             Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                 callerPid,
+                                 requestId,
+                                 Sailfish::Secrets::Daemon::ApiImpl::SetStandaloneCustomLockSecretRequest,
+                                 continuation));
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSecretWithAuthenticationKey(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &storagePluginName,
+        const QString &encryptionPluginName,
+        const QString &authenticationPluginName,
+        const QString &secretName,
+        const QByteArray &secret,
+        Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic unlockSemantic,
+        int customLockTimeoutMs,
+        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QByteArray &authenticationKey)
+{
+    Q_UNUSED(requestId);
+    Q_UNUSED(userInteractionMode);
+    Q_UNUSED(uiServiceAddress);
+
+    // TODO: perform access control request to see if the application has permission to write secure storage data.
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+
+    // check again in case some other application added the secret while
+    // the asynchronous authentication plugin request was active.
+    const QString selectSecretsQuery = QStringLiteral(
+                "SELECT"
+                   " ApplicationId,"
+                   " UsesDeviceLockKey,"
+                   " StoragePluginName,"
+                   " AccessControlMode"
+                 " FROM Secrets"
+                 " WHERE CollectionName = ?"
+                 " AND SecretName = ?;"
+             );
+
+    QString errorText;
+    Database::Query ssq = m_db->prepare(selectSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
+    }
+
+    const QString collectionName = QStringLiteral("standalone");
+    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+    QVariantList values;
+    values << QVariant::fromValue<QString>(collectionName);
+    values << QVariant::fromValue<QString>(hashedSecretName);
+    ssq.bindValues(values);
+
+    if (!m_db->execute(ssq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
+    }
+
+    bool found = false;
+    QString secretApplicationId;
+    bool secretUsesDeviceLockKey = false;
+    QString secretStoragePluginName;
+    Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
+    if (ssq.next()) {
+        found = true;
+        secretApplicationId = ssq.value(0).value<QString>();
+        secretUsesDeviceLockKey = ssq.value(1).value<int>() > 0;
+        secretStoragePluginName = ssq.value(2).value<QString>();
+        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(ssq.value(3).value<int>());
+    }
+
+    if (found && secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to set the secret in the collection.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Access control requests are not currently supported. TODO!"));
+    } else if (found && secretApplicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
+    } else if (found && secretUsesDeviceLockKey == 1) {
+        // don't update the secret if it would involve changing from a device-lock to custom-lock protected secret.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QString::fromLatin1("Secret %1 already exists and is not a devicelock protected secret")
+                                         .arg(secretName));
+    } else if (found && secretStoragePluginName.compare(storagePluginName, Qt::CaseInsensitive) != 0) {
+        // don't update the secret if it would involve changing which plugin it's stored in.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QString::fromLatin1("Secret %1 already exists and is not stored via plugin %2")
+                                         .arg(secretName, storagePluginName));
+    }
+
+    // Write to the master database prior to the storage plugin.
+    const QString updateSecretQuery = QStringLiteral(
+                 "UPDATE Secrets"
+                 " SET ApplicationId = ?,"
+                     " UsesDeviceLockKey = ?,"
+                     " StoragePluginName = ?,"
+                     " EncryptionPluginName = ?,"
+                     " AuthenticationPluginName = ?,"
+                     " UnlockSemantic = ?,"
+                     " CustomLockTimeoutMs = ?,"
+                     " AccessControlMode = ?"
+                 " WHERE CollectionName = ?"
+                 " AND SecretName = ?;"
+             );
+
+    const QString insertSecretQuery = QStringLiteral(
+                "INSERT INTO Secrets ("
+                  "CollectionName,"
+                  "SecretName,"
+                  "ApplicationId,"
+                  "UsesDeviceLockKey,"
+                  "StoragePluginName,"
+                  "EncryptionPluginName,"
+                  "AuthenticationPluginName,"
+                  "UnlockSemantic,"
+                  "CustomLockTimeoutMs,"
+                  "AccessControlMode"
+                ")"
+                " VALUES ("
+                  "?,?,?,?,?,?,?,?,?,?"
+                ");");
+
+    Database::Query iq = m_db->prepare(found ? updateSecretQuery : insertSecretQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare insert secret query: %1").arg(errorText));
+    }
+
+    QVariantList ivalues;
+    if (!found) {
+        ivalues << QVariant::fromValue<QString>(collectionName);
+        ivalues << QVariant::fromValue<QString>(hashedSecretName);
+    }
+    ivalues << QVariant::fromValue<QString>(callerApplicationId);
+    ivalues << QVariant::fromValue<int>(1);
+    ivalues << QVariant::fromValue<QString>(storagePluginName);
+    ivalues << QVariant::fromValue<QString>(encryptionPluginName);
+    ivalues << QVariant::fromValue<QString>(authenticationPluginName);
+    ivalues << QVariant::fromValue<int>(static_cast<int>(unlockSemantic));
+    ivalues << QVariant::fromValue<int>(customLockTimeoutMs);
+    ivalues << QVariant::fromValue<int>(static_cast<int>(accessControlMode));
+    if (found) {
+        ivalues << QVariant::fromValue<QString>(collectionName);
+        ivalues << QVariant::fromValue<QString>(hashedSecretName);
+    }
+    iq.bindValues(ivalues);
+
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Unable to begin insert secret transaction"));
+    }
+
+    if (!m_db->execute(iq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute insert secret query: %1").arg(errorText));
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Unable to commit insert secret transaction"));
+    }
+
+    Sailfish::Secrets::Result pluginResult;
+    if (storagePluginName == encryptionPluginName) {
+        // TODO: does the following work?  We'd need to add methods to the encrypted storage plugin: re-encryptStandaloneSecrets or something...
+        pluginResult = m_encryptedStoragePlugins[storagePluginName]->setSecret(collectionName, hashedSecretName, secret, authenticationKey);
+    } else {
+        QByteArray encrypted;
+        pluginResult = m_encryptionPlugins[encryptionPluginName]->encryptSecret(secret, authenticationKey, &encrypted);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            pluginResult = m_storagePlugins[storagePluginName]->setSecret(collectionName, hashedSecretName, encrypted);
+            if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+                // if the key can't be held in secure memory the secret remains locked.
+                const Sailfish::Secrets::Daemon::SecureByteArray secureKey(authenticationKey);
+                if (secureKey.size() == authenticationKey.size()) {
+                    m_standaloneSecretAuthenticationKeys.insert(hashedSecretName, secureKey);
+                }
+            }
+        }
+    }
+
+    if (pluginResult.code() == Sailfish::Secrets::Result::Failed && !found) {
+        // The plugin was unable to set the secret in its storage.
+        // Let's delete it from our master table if it was a new one.
+        // It may be tempting to merely remove the commitTransaction() above, and just do a rollbackTransaction() here,
+        // but DO NOT do so, as that could lead to the case where the plugin->setSecret() call succeeds,
+        // but the master table commit fails.
+        const QString deleteSecretQuery = QStringLiteral(
+                    "DELETE FROM Secrets"
+                    " WHERE CollectionName = ?"
+                    " AND SecretName = ?;");
+
+        Database::Query dq = m_db->prepare(deleteSecretQuery, &errorText);
+        if (!errorText.isEmpty()) {
+            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to prepare delete secret query: %1"
+                                                                 " while removing artifacts due to plugin operation failure: %2: %3")
+                                             .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+
+        QVariantList values;
+        values << QVariant::fromValue<QString>(collectionName);
+        values << QVariant::fromValue<QString>(hashedSecretName);
+        dq.bindValues(values);
+
+        if (!m_db->beginTransaction()) {
+            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QString::fromLatin1("Unable to begin delete secret transaction"
+                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
+                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+
+        if (!m_db->execute(dq, &errorText)) {
+            m_db->rollbackTransaction();
+            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to execute delete secret query: %1"
+                                                                 " while removing artifacts due to plugin operation failure: %2: %3")
+                                             .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+
+        if (!m_db->commitTransaction()) {
+            m_db->rollbackTransaction();
+            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QString::fromLatin1("Unable to commit delete secret transaction"
+                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
+                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+        }
+    }
+
+    return pluginResult;
+}
+
+// get a secret in a collection
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getCollectionSecret(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &collectionName,
+        const QString &secretName,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        QByteArray *secret)
+{
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Reserved collection name given"));
+    }
+
+    // TODO: perform access control request to see if the application has permission to write secure storage data.
+    SAILFISH_SECRETS_TRACE_BEGIN("secrets.applicationPermissions");
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+    SAILFISH_SECRETS_TRACE_END("secrets.applicationPermissions");
+
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    SAILFISH_SECRETS_TRACE_BEGIN("secrets.collectionMetadata");
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    SAILFISH_SECRETS_TRACE_END("secrets.collectionMetadata");
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
+    }
+    QString collectionApplicationId = metadata.applicationId;
+    bool collectionUsesDeviceLockKey = metadata.usesDeviceLockKey;
+    QString collectionStoragePluginName = metadata.storagePluginName;
+    QString collectionEncryptionPluginName = metadata.encryptionPluginName;
+    QString collectionAuthenticationPluginName = metadata.authenticationPluginName;
+    int collectionUnlockSemantic = metadata.unlockSemantic;
+    int collectionCustomLockTimeoutMs = metadata.customLockTimeoutMs;
+    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = metadata.accessControlMode;
+
+    if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Nonexistent collection name given"));
+    }
+
+    if (collectionStoragePluginName == collectionEncryptionPluginName && !m_encryptedStoragePlugins.contains(collectionStoragePluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(collectionStoragePluginName));
+    } else if (collectionStoragePluginName != collectionEncryptionPluginName && !m_storagePlugins.contains(collectionStoragePluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(collectionStoragePluginName));
+    } else if (collectionStoragePluginName != collectionEncryptionPluginName && !m_encryptionPlugins.contains(collectionEncryptionPluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(collectionEncryptionPluginName));
+    } else if (collectionAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to set the secret in the collection.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Access control requests are not currently supported. TODO!"));
+    } else if (collectionApplicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
+    } else if (!m_authenticationPlugins.contains(collectionAuthenticationPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                        QString::fromLatin1("No such authentication plugin available: %1").arg(collectionAuthenticationPluginName));
+    } else if (m_authenticationPlugins[collectionAuthenticationPluginName]->authenticationType() == Sailfish::Secrets::AuthenticationPlugin::ApplicationSpecificAuthentication
+                   && (userInteractionMode != Sailfish::Secrets::SecretManager::InProcessUserInteractionMode || uiServiceAddress.isEmpty())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresInProcessUserInteraction,
+                                     QString::fromLatin1("Authentication plugin %1 requires in-process user interaction").arg(collectionAuthenticationPluginName));
+    }
+
+    if (collectionStoragePluginName == collectionEncryptionPluginName) {
+        bool locked = false;
+        Sailfish::Secrets::Result pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return pluginResult;
+        }
+
+        if (locked) {
+            if (collectionUsesDeviceLockKey) {
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                                 QString::fromLatin1("Collection %1 is locked and requires device lock authentication").arg(collectionName));
+            } else {
+                if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                                     QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
+                }
+
+                // perform UI request to get the authentication key for the collection
+                Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
+                            callerPid,
+                            requestId,
+                            callerApplicationId,
+                            collectionName,
+                            secretName,
+                            uiServiceAddress);
+                if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+                    return authenticationResult;
+                }
+
+                Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretContinuation;
+                continuation->collectionName = collectionName;
+                continuation->secretName = secretName;
+                continuation->userInteractionMode = userInteractionMode;
+                continuation->uiServiceAddress = uiServiceAddress;
+                continuation->storagePluginName = collectionStoragePluginName;
+                continuation->encryptionPluginName = collectionEncryptionPluginName;
+                continuation->collectionUnlockSemantic = collectionUnlockSemantic;
+                continuation->collectionCustomLockTimeoutMs = collectionCustomLockTimeoutMs;
+                m_pendingRequests.insert(requestId,
+                                         Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                             callerPid,
+                                             requestId,
+                                             Sailfish::Secrets::Daemon::ApiImpl::GetCollectionSecretRequest,
+                                             continuation));
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+            }
+        } else {
+            return getCollectionSecretWithAuthenticationKey(
+                        callerPid,
+                        requestId,
+                        collectionName,
+                        secretName,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        collectionStoragePluginName,
+                        collectionEncryptionPluginName,
+                        collectionUnlockSemantic,
+                        collectionCustomLockTimeoutMs,
+                        QByteArray(), // no key required, it's unlocked already.
+                        secret);
+        }
+    } else {
+        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
+            if (collectionUsesDeviceLockKey) {
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                                 QString::fromLatin1("Collection %1 is locked and requires device lock authentication").arg(collectionName));
+            } else {
+                if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                                     QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
+                }
+
+                // perform UI request to get the authentication key for the collection
+                Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
+                            callerPid,
+                            requestId,
+                            callerApplicationId,
+                            collectionName,
+                            secretName,
+                            uiServiceAddress);
+                if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+                    return authenticationResult;
+                }
+
+                Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretContinuation;
+                continuation->collectionName = collectionName;
+                continuation->secretName = secretName;
+                continuation->userInteractionMode = userInteractionMode;
+                continuation->uiServiceAddress = uiServiceAddress;
+                continuation->storagePluginName = collectionStoragePluginName;
+                continuation->encryptionPluginName = collectionEncryptionPluginName;
+                continuation->collectionUnlockSemantic = collectionUnlockSemantic;
+                continuation->collectionCustomLockTimeoutMs = collectionCustomLockTimeoutMs;
+                m_pendingRequests.insert(requestId,
+                                         Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                             callerPid,
+                                             requestId,
+                                             Sailfish::Secrets::Daemon::ApiImpl::GetCollectionSecretRequest,
+                                             continuation));
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+            }
+        } else {
+            return getCollectionSecretWithAuthenticationKey(
+                        callerPid,
+                        requestId,
+                        collectionName,
+                        secretName,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        collectionStoragePluginName,
+                        collectionEncryptionPluginName,
+                        collectionUnlockSemantic,
+                        collectionCustomLockTimeoutMs,
+                        m_collectionAuthenticationKeys.value(collectionName).rawData(),
+                        secret);
+        }
+    }
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getCollectionSecretWithAuthenticationKey(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &collectionName,
+        const QString &secretName,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QString &storagePluginName,
+        const QString &encryptionPluginName,
+        int collectionUnlockSemantic,
+        int collectionCustomLockTimeoutMs,
+        const QByteArray &authenticationKey,
+        QByteArray *secret)
+{
+    // might be required in future for access control requests.
+    Q_UNUSED(callerPid);
+    Q_UNUSED(requestId);
+    Q_UNUSED(userInteractionMode);
+    Q_UNUSED(uiServiceAddress);
+
+    if (collectionUnlockSemantic == Sailfish::Secrets::SecretManager::CustomLockTimoutRelock) {
+        if (!m_collectionRelocks.isScheduled(collectionName)) {
+            m_collectionRelocks.schedule(collectionName, collectionCustomLockTimeoutMs);
+        }
+    }
+
+    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+    Sailfish::Secrets::Result pluginResult;
+    if (storagePluginName == encryptionPluginName) {
+        bool locked = false;
+        pluginResult = m_encryptedStoragePlugins[storagePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return pluginResult;
+        }
+        // if it's locked, attempt to unlock it
+        if (locked) {
+            pluginResult = m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, authenticationKey);
+            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                // unable to apply the new authenticationKey.
+                m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                                 QString::fromLatin1("Unable to decrypt collection %1 with the entered authentication key").arg(collectionName));
+
+            }
+            pluginResult = m_encryptedStoragePlugins[storagePluginName]->isLocked(collectionName, &locked);
+            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                                 QString::fromLatin1("Unable to check lock state of collection %1 after setting the entered authentication key").arg(collectionName));
+
+            }
+        }
+        if (locked) {
+            // still locked, even after applying the new authenticationKey?  The authenticationKey was wrong.
+            m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                             QString::fromLatin1("The authentication key entered for collection %1 was incorrect").arg(collectionName));
+        }
+        // successfully unlocked the encrypted storage collection.  write the secret.
+        SAILFISH_SECRETS_TRACE_BEGIN("plugin.encryptedStorage.getSecret");
+        pluginResult = m_encryptedStoragePlugins[storagePluginName]->getSecret(collectionName, hashedSecretName, secret);
+        SAILFISH_SECRETS_TRACE_END("plugin.encryptedStorage.getSecret");
+    } else {
+        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
+            // the key is verified when the data key is unwrapped, if the collection has one.
+            // TODO: if it's a custom lock, set the timeout, etc.
+            const Sailfish::Secrets::Result unlockResult = setCollectionAuthenticationKey(collectionName, authenticationKey);
+            if (unlockResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                return unlockResult;
+            }
+        }
+
+        if (m_secretCache.lookup(collectionName, hashedSecretName, secret)) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+        }
+
+        if (m_storagePlugins[storagePluginName]->supportsAsynchronousOperations()
+                || m_encryptionPlugins[encryptionPluginName]->supportsAsynchronousOperations()) {
+            // don't block other clients while slow hardware completes the read.
+            Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation operation;
+            operation.collectionName = collectionName;
+            operation.hashedSecretName = hashedSecretName;
+            operation.storagePluginName = storagePluginName;
+            operation.encryptionPluginName = encryptionPluginName;
+            operation.cacheSecret = collectionUnlockSemantic != Sailfish::Secrets::SecretManager::CustomLockAccessRelock;
+            return beginGetCollectionSecret(requestId, operation, secret);
+        }
+
+        QByteArray encrypted;
+        SAILFISH_SECRETS_TRACE_BEGIN("plugin.storage.getSecret");
+        pluginResult = m_storagePlugins[storagePluginName]->getSecret(collectionName, hashedSecretName, &encrypted);
+        SAILFISH_SECRETS_TRACE_END("plugin.storage.getSecret");
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            SAILFISH_SECRETS_TRACE_BEGIN("plugin.encryption.decryptSecret");
+            pluginResult = m_encryptionPlugins[encryptionPluginName]->decryptSecret(encrypted, m_collectionAuthenticationKeys.value(collectionName).rawData(), secret);
+            SAILFISH_SECRETS_TRACE_END("plugin.encryption.decryptSecret");
+        }
+        bool chunked = false;
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            pluginResult = loadSecretChunks(m_storagePlugins[storagePluginName], m_encryptionPlugins[encryptionPluginName],
+                                            collectionName, hashedSecretName,
+                                            m_collectionAuthenticationKeys.value(collectionName).rawData(), secret, &chunked);
+        }
+        // chunked secrets are too large to be worth caching.
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded && !chunked
+                && collectionUnlockSemantic != Sailfish::Secrets::SecretManager::CustomLockAccessRelock) {
+            m_secretCache.insert(collectionName, hashedSecretName, *secret);
+        }
+    }
+
+    return pluginResult;
+}
+
+// Returns Pending if the secret will be returned via requestFinished(),
+// or otherwise the result of the read, with the secret if it succeeded.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::beginGetCollectionSecret(
+        quint64 requestId,
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation &operation,
+        QByteArray *secret)
+{
+    Sailfish::Secrets::StoragePlugin *storagePlugin = m_storagePlugins.value(operation.storagePluginName);
+    if (storagePlugin->supportsAsynchronousOperations()) {
+        Sailfish::Secrets::Result result = storagePlugin->beginGetSecret(requestId, operation.collectionName, operation.hashedSecretName);
+        if (result.code() == Sailfish::Secrets::Result::Failed) {
+            return result;
+        }
+        // completed via storageGetSecretCompleted().
+        m_pendingPluginOperations.insert(requestId, operation);
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+    }
+
+    QByteArray encrypted;
+    SAILFISH_SECRETS_TRACE_BEGIN("plugin.storage.getSecret");
+    Sailfish::Secrets::Result result = storagePlugin->getSecret(operation.collectionName, operation.hashedSecretName, &encrypted);
+    SAILFISH_SECRETS_TRACE_END("plugin.storage.getSecret");
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    }
+
+    return beginDecryptCollectionSecret(requestId, operation, encrypted, secret);
+}
+
+// Returns Pending if the decrypted secret will be returned via requestFinished(),
+// or otherwise the result of decrypting it synchronously.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::beginDecryptCollectionSecret(
+        quint64 requestId,
+        Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation operation,
+        const QByteArray &encrypted,
+        QByteArray *secret)
+{
+    // the collection may have been relocked while the storage plugin was busy.
+    if (!m_collectionAuthenticationKeys.contains(operation.collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromLatin1("Collection %1 was locked during the read").arg(operation.collectionName));
+    }
+
+    Sailfish::Secrets::EncryptionPlugin *encryptionPlugin = m_encryptionPlugins.value(operation.encryptionPluginName);
+    const Sailfish::Secrets::Daemon::SecureByteArray key = m_collectionAuthenticationKeys.value(operation.collectionName);
+    if (!encryptionPlugin->supportsAsynchronousOperations()) {
+        SAILFISH_SECRETS_TRACE_BEGIN("plugin.encryption.decryptSecret");
+        Sailfish::Secrets::Result result = encryptionPlugin->decryptSecret(encrypted, key.rawData(), secret);
+        SAILFISH_SECRETS_TRACE_END("plugin.encryption.decryptSecret");
+        if (result.code() == Sailfish::Secrets::Result::Succeeded && operation.cacheSecret) {
+            m_secretCache.insert(operation.collectionName, operation.hashedSecretName, *secret);
+        }
+        return result;
+    }
+
+    // the plugin may use the key after this returns, by when the collection may
+    // have been relocked and the secure memory released, so it is given a copy.
+    const QByteArray asynchronousKey(key.rawData().constData(), key.size());
+    Sailfish::Secrets::Result result = encryptionPlugin->beginDecryptSecret(requestId, encrypted, asynchronousKey);
+    if (result.code() == Sailfish::Secrets::Result::Failed) {
+        return result;
+    }
+    // completed via encryptionDecryptSecretCompleted().
+    operation.decrypting = true;
+    m_pendingPluginOperations.insert(requestId, operation);
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+}
+
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::finishGetCollectionSecret(
+        quint64 requestId,
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation &operation,
+        const Sailfish::Secrets::Result &result,
+        const QByteArray &secret)
+{
+    if (result.code() == Sailfish::Secrets::Result::Succeeded
+            && operation.cacheSecret
+            && m_collectionAuthenticationKeys.contains(operation.collectionName)) {
+        m_secretCache.insert(operation.collectionName, operation.hashedSecretName, secret);
+    }
+
+    QList<QVariant> outParams;
+    outParams << QVariant::fromValue<Sailfish::Secrets::Result>(result);
+    outParams << QVariant::fromValue<QByteArray>(result.code() == Sailfish::Secrets::Result::Succeeded ? secret : QByteArray());
+    m_requestQueue->requestFinished(requestId, outParams);
+}
+
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::storageGetSecretCompleted(
+        quint64 operationId,
+        const Sailfish::Secrets::Result &result,
+        const QByteArray &secret)
+{
+    QHash<quint64, Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation>::iterator it
+            = m_pendingPluginOperations.find(operationId);
+    if (it == m_pendingPluginOperations.end() || it->decrypting) {
+        // the request was cancelled, or this isn't the step it is waiting for.
+        return;
+    }
+
+    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation operation = *it;
+    m_pendingPluginOperations.erase(it);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        finishGetCollectionSecret(operationId, operation, result, QByteArray());
+        return;
+    }
+
+    QByteArray plaintext;
+    Sailfish::Secrets::Result decryptResult = beginDecryptCollectionSecret(operationId, operation, secret, &plaintext);
+    if (decryptResult.code() != Sailfish::Secrets::Result::Pending) {
+        finishGetCollectionSecret(operationId, operation, decryptResult, plaintext);
+    }
+}
+
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::encryptionDecryptSecretCompleted(
+        quint64 operationId,
+        const Sailfish::Secrets::Result &result,
+        const QByteArray &plaintext)
+{
+    QHash<quint64, Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation>::iterator it
+            = m_pendingPluginOperations.find(operationId);
+    if (it == m_pendingPluginOperations.end() || !it->decrypting) {
+        return;
+    }
+
+    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation operation = *it;
+    m_pendingPluginOperations.erase(it);
+    finishGetCollectionSecret(operationId, operation, result, plaintext);
+}
+
+// get multiple secrets from a collection
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getCollectionSecrets(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &collectionName,
+        const QStringList &secretNames,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        QMap<QString, QByteArray> *secrets)
+{
+    if (secretNames.isEmpty() || secretNames.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Reserved collection name given"));
+    }
+
+    // TODO: perform access control request to see if the application has permission to write secure storage data.
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
+    }
+    QString collectionApplicationId = metadata.applicationId;
+    bool collectionUsesDeviceLockKey = metadata.usesDeviceLockKey;
+    QString collectionStoragePluginName = metadata.storagePluginName;
+    QString collectionEncryptionPluginName = metadata.encryptionPluginName;
+    QString collectionAuthenticationPluginName = metadata.authenticationPluginName;
+    int collectionUnlockSemantic = metadata.unlockSemantic;
+    int collectionCustomLockTimeoutMs = metadata.customLockTimeoutMs;
+    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = metadata.accessControlMode;
+
+    if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Nonexistent collection name given"));
+    }
+
+    if (collectionStoragePluginName == collectionEncryptionPluginName && !m_encryptedStoragePlugins.contains(collectionStoragePluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(collectionStoragePluginName));
+    } else if (collectionStoragePluginName != collectionEncryptionPluginName && !m_storagePlugins.contains(collectionStoragePluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(collectionStoragePluginName));
+    } else if (collectionStoragePluginName != collectionEncryptionPluginName && !m_encryptionPlugins.contains(collectionEncryptionPluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(collectionEncryptionPluginName));
+    } else if (collectionAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to set the secret in the collection.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Access control requests are not currently supported. TODO!"));
+    } else if (collectionApplicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
+    } else if (!m_authenticationPlugins.contains(collectionAuthenticationPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                        QString::fromLatin1("No such authentication plugin available: %1").arg(collectionAuthenticationPluginName));
+    } else if (m_authenticationPlugins[collectionAuthenticationPluginName]->authenticationType() == Sailfish::Secrets::AuthenticationPlugin::ApplicationSpecificAuthentication
+                   && (userInteractionMode != Sailfish::Secrets::SecretManager::InProcessUserInteractionMode || uiServiceAddress.isEmpty())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresInProcessUserInteraction,
+                                     QString::fromLatin1("Authentication plugin %1 requires in-process user interaction").arg(collectionAuthenticationPluginName));
+    }
+
+    if (collectionStoragePluginName == collectionEncryptionPluginName) {
+        bool locked = false;
+        Sailfish::Secrets::Result pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return pluginResult;
+        }
+
+        if (locked) {
+            if (collectionUsesDeviceLockKey) {
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                                 QString::fromLatin1("Collection %1 is locked and requires device lock authentication").arg(collectionName));
+            } else {
+                if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                                     QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
+                }
+
+                // perform UI request to get the authentication key for the collection
+                Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
+                            callerPid,
+                            requestId,
+                            callerApplicationId,
+                            collectionName,
+                            QString(), // the whole collection is being unlocked, not any one secret.
+                            uiServiceAddress);
+                if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+                    return authenticationResult;
+                }
+
+                Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretsContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretsContinuation;
+                continuation->collectionName = collectionName;
+                continuation->secretNames = secretNames;
+                continuation->userInteractionMode = userInteractionMode;
+                continuation->uiServiceAddress = uiServiceAddress;
+                continuation->storagePluginName = collectionStoragePluginName;
+                continuation->encryptionPluginName = collectionEncryptionPluginName;
+                continuation->collectionUnlockSemantic = collectionUnlockSemantic;
+                continuation->collectionCustomLockTimeoutMs = collectionCustomLockTimeoutMs;
+                m_pendingRequests.insert(requestId,
+                                         Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                             callerPid,
+                                             requestId,
+                                             Sailfish::Secrets::Daemon::ApiImpl::GetCollectionSecretsRequest,
+                                             continuation));
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+            }
+        } else {
+            return getCollectionSecretsWithAuthenticationKey(
+                        callerPid,
+                        requestId,
+                        collectionName,
+                        secretNames,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        collectionStoragePluginName,
+                        collectionEncryptionPluginName,
+                        collectionUnlockSemantic,
+                        collectionCustomLockTimeoutMs,
+                        QByteArray(), // no key required, it's unlocked already.
+                        secrets);
+        }
+    } else {
+        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
+            if (collectionUsesDeviceLockKey) {
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                                 QString::fromLatin1("Collection %1 is locked and requires device lock authentication").arg(collectionName));
+            } else {
+                if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                                     QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
+                }
+
+                // perform UI request to get the authentication key for the collection
+                Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
+                            callerPid,
+                            requestId,
+                            callerApplicationId,
+                            collectionName,
+                            QString(), // the whole collection is being unlocked, not any one secret.
+                            uiServiceAddress);
+                if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+                    return authenticationResult;
+                }
+
+                Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretsContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretsContinuation;
+                continuation->collectionName = collectionName;
+                continuation->secretNames = secretNames;
+                continuation->userInteractionMode = userInteractionMode;
+                continuation->uiServiceAddress = uiServiceAddress;
+                continuation->storagePluginName = collectionStoragePluginName;
+                continuation->encryptionPluginName = collectionEncryptionPluginName;
+                continuation->collectionUnlockSemantic = collectionUnlockSemantic;
+                continuation->collectionCustomLockTimeoutMs = collectionCustomLockTimeoutMs;
+                m_pendingRequests.insert(requestId,
+                                         Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                             callerPid,
+                                             requestId,
+                                             Sailfish::Secrets::Daemon::ApiImpl::GetCollectionSecretsRequest,
+                                             continuation));
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+            }
+        } else {
+            return getCollectionSecretsWithAuthenticationKey(
+                        callerPid,
+                        requestId,
+                        collectionName,
+                        secretNames,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        collectionStoragePluginName,
+                        collectionEncryptionPluginName,
+                        collectionUnlockSemantic,
+                        collectionCustomLockTimeoutMs,
+                        m_collectionAuthenticationKeys.value(collectionName).rawData(),
+                        secrets);
+        }
+    }
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getCollectionSecretsWithAuthenticationKey(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &collectionName,
+        const QStringList &secretNames,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QString &storagePluginName,
+        const QString &encryptionPluginName,
+        int collectionUnlockSemantic,
+        int collectionCustomLockTimeoutMs,
+        const QByteArray &authenticationKey,
+        QMap<QString, QByteArray> *secrets)
+{
+    // might be required in future for access control requests.
+    Q_UNUSED(callerPid);
+    Q_UNUSED(requestId);
+    Q_UNUSED(userInteractionMode);
+    Q_UNUSED(uiServiceAddress);
+
+    if (collectionUnlockSemantic == Sailfish::Secrets::SecretManager::CustomLockTimoutRelock) {
+        if (!m_collectionRelocks.isScheduled(collectionName)) {
+            m_collectionRelocks.schedule(collectionName, collectionCustomLockTimeoutMs);
+        }
+    }
+
+    QStringList hashedSecretNames;
+    QHash<QString, QString> secretNamesByHash;
+    Q_FOREACH (const QString &secretName, secretNames) {
+        const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+        hashedSecretNames.append(hashedSecretName);
+        secretNamesByHash.insert(hashedSecretName, secretName);
+    }
+
+    QMap<QString, QByteArray> storedSecrets;
+    Sailfish::Secrets::Result pluginResult;
+    if (storagePluginName == encryptionPluginName) {
+        bool locked = false;
+        pluginResult = m_encryptedStoragePlugins[storagePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return pluginResult;
+        }
+        // if it's locked, attempt to unlock it
+        if (locked) {
+            pluginResult = m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, authenticationKey);
+            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                // unable to apply the new authenticationKey.
+                m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                                 QString::fromLatin1("Unable to decrypt collection %1 with the entered authentication key").arg(collectionName));
+
+            }
+            pluginResult = m_encryptedStoragePlugins[storagePluginName]->isLocked(collectionName, &locked);
+            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                                 QString::fromLatin1("Unable to check lock state of collection %1 after setting the entered authentication key").arg(collectionName));
+
+            }
+        }
+        if (locked) {
+            // still locked, even after applying the new authenticationKey?  The authenticationKey was wrong.
+            m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                             QString::fromLatin1("The authentication key entered for collection %1 was incorrect").arg(collectionName));
+        }
+        // successfully unlocked the encrypted storage collection.  read the secrets.
+        pluginResult = m_encryptedStoragePlugins[storagePluginName]->getSecrets(collectionName, hashedSecretNames, &storedSecrets);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            for (QMap<QString, QByteArray>::const_iterator it = storedSecrets.constBegin(); it != storedSecrets.constEnd(); it++) {
+                secrets->insert(secretNamesByHash.value(it.key()), it.value());
+            }
+        }
+    } else {
+        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
+            // the key is verified when the data key is unwrapped, if the collection has one.
+            // TODO: if it's a custom lock, set the timeout, etc.
+            const Sailfish::Secrets::Result unlockResult = setCollectionAuthenticationKey(collectionName, authenticationKey);
+            if (unlockResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                return unlockResult;
+            }
+        }
+
+        // only those secrets which aren't cached need to be read and decrypted.
+        const bool cacheable = collectionUnlockSemantic != Sailfish::Secrets::SecretManager::CustomLockAccessRelock;
+        QStringList uncachedSecretNames;
+        Q_FOREACH (const QString &hashedSecretName, hashedSecretNames) {
+            QByteArray secret;
+            if (m_secretCache.lookup(collectionName, hashedSecretName, &secret)) {
+                secrets->insert(secretNamesByHash.value(hashedSecretName), secret);
+            } else {
+                uncachedSecretNames.append(hashedSecretName);
+            }
+        }
+
+        pluginResult = uncachedSecretNames.isEmpty()
+                ? Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded)
+                : m_storagePlugins[storagePluginName]->getSecrets(collectionName, uncachedSecretNames, &storedSecrets);
+        for (QMap<QString, QByteArray>::const_iterator it = storedSecrets.constBegin();
+                pluginResult.code() == Sailfish::Secrets::Result::Succeeded && it != storedSecrets.constEnd(); it++) {
+            QByteArray secret;
+            bool chunked = false;
+            pluginResult = m_encryptionPlugins[encryptionPluginName]->decryptSecret(it.value(), m_collectionAuthenticationKeys.value(collectionName).rawData(), &secret);
+            if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+                pluginResult = loadSecretChunks(m_storagePlugins[storagePluginName], m_encryptionPlugins[encryptionPluginName],
+                                                collectionName, it.key(),
+                                                m_collectionAuthenticationKeys.value(collectionName).rawData(), &secret, &chunked);
+            }
+            secrets->insert(secretNamesByHash.value(it.key()), secret);
+            if (cacheable && !chunked && pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+                m_secretCache.insert(collectionName, it.key(), secret);
+            }
+        }
+        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            secrets->clear();
+        }
+    }
+
+    return pluginResult;
+}
+
+// get a standalone secret
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getStandaloneSecret(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &secretName,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        QByteArray *secret)
+{
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    }
+
+    // TODO: perform access control request to see if the application has permission to write secure storage data.
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+
+    const QString selectSecretsQuery = QStringLiteral(
+                 "SELECT"
+                    " ApplicationId,"
+                    " UsesDeviceLockKey,"
+                    " StoragePluginName,"
+                    " EncryptionPluginName,"
+                    " AuthenticationPluginName,"
+                    " UnlockSemantic,"
+                    " CustomLockTimeoutMs,"
+                    " AccessControlMode"
+                  " FROM Secrets"
+                  " WHERE CollectionName = ?"
+                  " AND SecretName = ?;"
+             );
+
+    QString errorText;
+    Database::Query sq = m_db->prepare(selectSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
+    }
+
+    const QString collectionName = QStringLiteral("standalone");
+    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+    QVariantList values;
+    values << QVariant::fromValue<QString>(collectionName);
+    values << QVariant::fromValue<QString>(hashedSecretName);
+    sq.bindValues(values);
+
+    if (!m_db->execute(sq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
+    }
+
+    bool found = false;
+    QString secretApplicationId;
+    bool secretUsesDeviceLockKey = false;
+    QString secretStoragePluginName;
+    QString secretEncryptionPluginName;
+    QString secretAuthenticationPluginName;
+    int secretUnlockSemantic = 0;
+    int secretCustomLockTimeoutMs = 0;
+    Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
+    if (sq.next()) {
+        found = true;
+        secretApplicationId = sq.value(0).value<QString>();
+        secretUsesDeviceLockKey = sq.value(1).value<int>() > 0;
+        secretStoragePluginName = sq.value(2).value<QString>();
+        secretEncryptionPluginName = sq.value(3).value<QString>();
+        secretAuthenticationPluginName = sq.value(4).value<QString>();
+        secretUnlockSemantic = sq.value(5).value<int>();
+        secretCustomLockTimeoutMs = sq.value(6).value<int>();
+        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(sq.value(7).value<int>());
+    }
+
+    if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Nonexistent secret name given"));
+    }
+
+    if (secretStoragePluginName == secretEncryptionPluginName && !m_encryptedStoragePlugins.contains(secretStoragePluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(secretStoragePluginName));
+    } else if (secretStoragePluginName != secretEncryptionPluginName && !m_storagePlugins.contains(secretStoragePluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(secretStoragePluginName));
+    } else if (secretStoragePluginName != secretEncryptionPluginName && !m_encryptionPlugins.contains(secretEncryptionPluginName)) {
+        // TODO: stale data, plugin was removed but data still exists...?
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(secretEncryptionPluginName));
+    } else if (secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to set the secret.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Access control requests are not currently supported. TODO!"));
+    } else if (secretApplicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
+    } else if (m_authenticationPlugins[secretAuthenticationPluginName]->authenticationType() == Sailfish::Secrets::AuthenticationPlugin::ApplicationSpecificAuthentication
+               && (userInteractionMode != Sailfish::Secrets::SecretManager::InProcessUserInteractionMode || uiServiceAddress.isEmpty())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresInProcessUserInteraction,
+                                         QString::fromLatin1("Authentication plugin %1 requires in-process user interaction").arg(secretAuthenticationPluginName));
+    }
+
+    if (m_standaloneSecretAuthenticationKeys.contains(hashedSecretName)) {
+        return getStandaloneSecretWithAuthenticationKey(
+                    callerPid,
+                    requestId,
+                    secretName,
+                    userInteractionMode,
+                    uiServiceAddress,
+                    secretStoragePluginName,
+                    secretEncryptionPluginName,
+                    secretUnlockSemantic,
+                    secretCustomLockTimeoutMs,
+                    m_standaloneSecretAuthenticationKeys.value(hashedSecretName).rawData(),
+                    secret);
+    }
+
+    if (secretUsesDeviceLockKey) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromLatin1("Secret %1 is locked and requires device lock authentication").arg(secretName));
+    }
+
+    if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                         QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(secretAuthenticationPluginName));
+    }
+
+    // perform UI request to get the authentication key for the collection
+    Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[secretAuthenticationPluginName]->beginAuthentication(
+                callerPid,
+                requestId,
+                callerApplicationId,
+                QString(),
+                secretName,
+                uiServiceAddress);
+    if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+        return authenticationResult;
+    }
+
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetStandaloneSecretContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetStandaloneSecretContinuation;
+    continuation->secretName = secretName;
+    continuation->userInteractionMode = userInteractionMode;
+    continuation->uiServiceAddress = uiServiceAddress;
+    continuation->storagePluginName = secretStoragePluginName;
+    continuation->encryptionPluginName = secretEncryptionPluginName;
+    continuation->lockSemantic = secretUnlockSemantic;
+    continuation->customLockTimeoutMs = secretCustomLockTimeoutMs;
+    m_pendingRequests.insert(requestId,
+                             Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                 callerPid,
+                                 requestId,
+                                 Sailfish::Secrets::Daemon::ApiImpl::GetStandaloneSecretRequest,
+                                 continuation));
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getStandaloneSecretWithAuthenticationKey(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &secretName,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QString &storagePluginName,
+        const QString &encryptionPluginName,
+        int secretUnlockSemantic,
+        int secretCustomLockTimeoutMs,
+        const QByteArray &authenticationKey,
+        QByteArray *secret)
+{
+    // may be needed for access control requests in the future.
+    Q_UNUSED(callerPid);
+    Q_UNUSED(requestId);
+    Q_UNUSED(userInteractionMode);
+    Q_UNUSED(uiServiceAddress);
 
-        if (!m_db->beginTransaction()) {
-            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                             QString::fromLatin1("Unable to begin delete secret transaction"
-                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
-                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
-        }
+    const QString collectionName = QStringLiteral("standalone");
+    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
 
-        if (!m_db->execute(dq, &errorText)) {
-            m_db->rollbackTransaction();
-            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                             QString::fromLatin1("Unable to execute delete secret query: %1"
-                                                                 " while removing artifacts due to plugin operation failure: %2: %3")
-                                             .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+    if (secretUnlockSemantic == Sailfish::Secrets::SecretManager::CustomLockTimoutRelock) {
+        if (!m_standaloneSecretRelocks.isScheduled(hashedSecretName)) {
+            m_standaloneSecretRelocks.schedule(hashedSecretName, secretCustomLockTimeoutMs);
         }
+    }
 
-        if (!m_db->commitTransaction()) {
-            m_db->rollbackTransaction();
-            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                             QString::fromLatin1("Unable to commit delete secret transaction"
-                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
-                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+    Sailfish::Secrets::Result pluginResult;
+    if (storagePluginName == encryptionPluginName) {
+        pluginResult = m_encryptedStoragePlugins[storagePluginName]->accessSecret(collectionName, hashedSecretName, authenticationKey, secret);
+    } else {
+        QByteArray encrypted;
+        pluginResult = m_storagePlugins[storagePluginName]->getSecret(collectionName, hashedSecretName, &encrypted);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            pluginResult = m_encryptionPlugins[encryptionPluginName]->decryptSecret(encrypted, authenticationKey, secret);
         }
     }
 
     return pluginResult;
 }
 
-// set a standalone CustomLock-protected secret
+// delete a secret in a collection
 Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSecret(
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollectionSecret(
         pid_t callerPid,
         quint64 requestId,
-        const QString &storagePluginName,
-        const QString &encryptionPluginName,
-        const QString &authenticationPluginName,
+        const QString &collectionName,
         const QString &secretName,
-        const QByteArray &secret,
-        Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic unlockSemantic,
-        int customLockTimeoutMs,
-        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
         Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
         const QString &uiServiceAddress)
 {
     if (secretName.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
                                          QLatin1String("Empty secret name given"));
-    } else if (storagePluginName == encryptionPluginName && !m_encryptedStoragePlugins.contains(storagePluginName)) {
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Reserved collection name given"));
+    }
+
+    // TODO: perform access control request to see if the application has permission to write secure storage data.
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
+    }
+    QString collectionApplicationId = metadata.applicationId;
+    bool collectionUsesDeviceLockKey = metadata.usesDeviceLockKey;
+    QString collectionStoragePluginName = metadata.storagePluginName;
+    QString collectionEncryptionPluginName = metadata.encryptionPluginName;
+    QString collectionAuthenticationPluginName = metadata.authenticationPluginName;
+    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = metadata.accessControlMode;
+
+    if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Nonexistent collection name given"));
+    }
+
+    if (collectionAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to set the secret in the collection.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Access control requests are not currently supported. TODO!"));
+    } else if (collectionApplicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
+    } else if (collectionStoragePluginName == collectionEncryptionPluginName
+            && !m_encryptedStoragePlugins.contains(collectionStoragePluginName)) {
+        // TODO: this means we have "stale" data in the database; what should we do in this case?
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(storagePluginName));
-    } else if (storagePluginName != encryptionPluginName && !m_storagePlugins.contains(storagePluginName)) {
+                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(collectionStoragePluginName));
+    } else if (collectionStoragePluginName != collectionEncryptionPluginName
+            && (collectionStoragePluginName.isEmpty() || !m_storagePlugins.contains(collectionStoragePluginName))) {
+        // TODO: this means we have "stale" data in the database; what should we do in this case?
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such storage plugin exists: %1").arg(storagePluginName));
-    } else if (storagePluginName != encryptionPluginName && !m_encryptionPlugins.contains(encryptionPluginName)) {
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(collectionStoragePluginName));
+    } else if (collectionStoragePluginName != collectionEncryptionPluginName
+            && (collectionEncryptionPluginName.isEmpty() || !m_encryptionPlugins.contains(collectionEncryptionPluginName))) {
+        // TODO: this means we have "stale" data in the database; what should we do in this case?
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(encryptionPluginName));
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(collectionEncryptionPluginName));
+    }
+
+    if (collectionStoragePluginName == collectionEncryptionPluginName) {
+        bool locked = false;
+        Sailfish::Secrets::Result pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return pluginResult;
+        }
+        if (locked) {
+            if (collectionUsesDeviceLockKey) {
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                                 QString::fromLatin1("Collection %1 is locked and requires device lock authentication"));
+            }
+
+            if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                                 QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
+            }
+
+            // perform UI request to get the authentication key for the collection
+            Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
+                        callerPid,
+                        requestId,
+                        callerApplicationId,
+                        collectionName,
+                        secretName,
+                        uiServiceAddress);
+            if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+                return authenticationResult;
+            }
+
+            Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::DeleteCollectionSecretContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::DeleteCollectionSecretContinuation;
+            continuation->collectionName = collectionName;
+            continuation->secretName = secretName;
+            continuation->userInteractionMode = userInteractionMode;
+            continuation->uiServiceAddress = uiServiceAddress;
+            m_pendingRequests.insert(requestId,
+                                     Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                         callerPid,
+                                         requestId,
+                                         Sailfish::Secrets::Daemon::ApiImpl::DeleteCollectionSecretRequest,
+                                         continuation));
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+        } else {
+            return deleteCollectionSecretWithAuthenticationKey(
+                        callerPid,
+                        requestId,
+                        collectionName,
+                        secretName,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        QByteArray());
+        }
+    } else {
+        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
+            if (collectionUsesDeviceLockKey) {
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                                 QStringLiteral("Collection %1 is locked and requires device lock authentication"));
+            } else {
+                if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
+                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
+                                                     QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
+                }
+
+                // perform UI request to get the authentication key for the collection
+                Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
+                            callerPid,
+                            requestId,
+                            callerApplicationId,
+                            collectionName,
+                            secretName,
+                            uiServiceAddress);
+                if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
+                    return authenticationResult;
+                }
+
+                Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::DeleteCollectionSecretContinuation *continuation = new Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::DeleteCollectionSecretContinuation;
+                continuation->collectionName = collectionName;
+                continuation->secretName = secretName;
+                continuation->userInteractionMode = userInteractionMode;
+                continuation->uiServiceAddress = uiServiceAddress;
+                m_pendingRequests.insert(requestId,
+                                         Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
+                                             callerPid,
+                                             requestId,
+                                             Sailfish::Secrets::Daemon::ApiImpl::DeleteCollectionSecretRequest,
+                                             continuation));
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+            }
+        } else {
+            return deleteCollectionSecretWithAuthenticationKey(
+                        callerPid,
+                        requestId,
+                        collectionName,
+                        secretName,
+                        userInteractionMode,
+                        uiServiceAddress,
+                        m_collectionAuthenticationKeys.value(collectionName).rawData());
+        }
     }
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollectionSecretWithAuthenticationKey(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &collectionName,
+        const QString &secretName,
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+        const QString &uiServiceAddress,
+        const QByteArray &authenticationKey)
+{
+    // may be needed for access control requests in the future.
+    Q_UNUSED(requestId);
+    Q_UNUSED(userInteractionMode);
+    Q_UNUSED(uiServiceAddress);
 
     // TODO: perform access control request to see if the application has permission to write secure storage data.
     const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
@@ -1602,125 +4055,163 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSec
                 ? m_appPermissions->platformApplicationId()
                 : m_appPermissions->applicationId(callerPid);
 
-    const QString selectSecretsQuery = QStringLiteral(
-                "SELECT"
-                   " ApplicationId,"
-                   " UsesDeviceLockKey,"
-                   " StoragePluginName,"
-                   " AccessControlMode"
-                 " FROM Secrets"
-                 " WHERE CollectionName = ?"
-                 " AND SecretName = ?;"
-             );
+    // check again in case it was deleted or modified while the
+    // asynchronous authentication key request was in progress.
+    QString errorText;
+
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
+    }
+    QString collectionApplicationId = metadata.applicationId;
+    bool collectionUsesDeviceLockKey = metadata.usesDeviceLockKey;
+    QString collectionStoragePluginName = metadata.storagePluginName;
+    QString collectionEncryptionPluginName = metadata.encryptionPluginName;
+    QString collectionAuthenticationPluginName = metadata.authenticationPluginName;
+    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = metadata.accessControlMode;
+
+    if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Nonexistent collection name given"));
+    }
+
+    if (collectionUsesDeviceLockKey && authenticationKey != m_deviceLockKey.rawData()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                         QLatin1String("Incorrect device lock key provided"));
+    }
+
+    if (collectionAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to set the secret in the collection.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Access control requests are not currently supported. TODO!"));
+    } else if (collectionApplicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
+    }
+
+    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+    m_secretCache.remove(collectionName, hashedSecretName);
+    Sailfish::Secrets::Result pluginResult;
+    if (collectionStoragePluginName == collectionEncryptionPluginName) {
+        bool locked = false;
+        pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            return pluginResult;
+        }
+        // if it's locked, attempt to unlock it
+        if (locked) {
+            pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, authenticationKey);
+            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                // unable to apply the new authenticationKey.
+                m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                                 QString::fromLatin1("Unable to decrypt collection %1 with the entered authentication key").arg(collectionName));
+
+            }
+            pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
+            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
+                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                                 QString::fromLatin1("Unable to check lock state of collection %1 after setting the entered authentication key").arg(collectionName));
+
+            }
+        }
+        if (locked) {
+            // still locked, even after applying the new authenticationKey?  The authenticationKey was wrong.
+            m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                             QString::fromLatin1("The authentication key entered for collection %1 was incorrect").arg(collectionName));
+        }
+        // successfully unlocked the encrypted storage collection.  remove the secret.
+        pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->removeSecret(collectionName, hashedSecretName);
+    } else {
+        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
+            // the key is verified when the data key is unwrapped, if the collection has one.
+            // TODO: if it's a custom lock, set the timeout, etc.
+            const Sailfish::Secrets::Result unlockResult = setCollectionAuthenticationKey(collectionName, authenticationKey);
+            if (unlockResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                return unlockResult;
+            }
+        }
 
-    QString errorText;
-    Database::Query ssq = m_db->prepare(selectSecretsQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
+        Sailfish::Secrets::StoragePlugin *storagePlugin = m_storagePlugins[collectionStoragePluginName];
+        const int chunkCount = storedSecretChunkCount(storagePlugin, m_encryptionPlugins[collectionEncryptionPluginName],
+                                                      collectionName, hashedSecretName,
+                                                      m_collectionAuthenticationKeys.value(collectionName).rawData());
+        pluginResult = storagePlugin->removeSecret(collectionName, hashedSecretName);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+            removeSecretChunks(storagePlugin, collectionName, hashedSecretName, 0, chunkCount);
+            // secrets written before their names were recorded have no name to remove.
+            storagePlugin->removeSecret(collectionName, secretNameEntryName(hashedSecretName));
+        }
     }
 
-    const QString collectionName = QStringLiteral("standalone");
-    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
-    QVariantList values;
-    values << QVariant::fromValue<QString>(collectionName);
-    values << QVariant::fromValue<QString>(hashedSecretName);
-    ssq.bindValues(values);
+    // now remove from the master database.
+    if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+        const QString deleteSecretQuery = QStringLiteral(
+                    "DELETE FROM Secrets"
+                    " WHERE CollectionName = ?"
+                    " AND SecretName = ?;");
 
-    if (!m_db->execute(ssq, &errorText)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
-    }
+        Database::Query dq = m_db->prepare(deleteSecretQuery, &errorText);
+        if (!errorText.isEmpty()) {
+            // TODO: add a "dirty" flag for this collection somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to prepare delete secret query: %1")
+                                             .arg(errorText));
+        }
 
-    bool found = false;
-    QString secretApplicationId;
-    bool secretUsesDeviceLockKey = false;
-    QString secretStoragePluginName;
-    Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
-    if (ssq.next()) {
-        found = true;
-        secretApplicationId = ssq.value(0).value<QString>();
-        secretUsesDeviceLockKey = ssq.value(1).value<int>() > 0;
-        secretStoragePluginName = ssq.value(2).value<QString>();
-        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(ssq.value(3).value<int>());
+        QVariantList values;
+        values << QVariant::fromValue<QString>(collectionName);
+        values << QVariant::fromValue<QString>(hashedSecretName);
+        dq.bindValues(values);
+
+        if (!m_db->beginTransaction()) {
+            // TODO: add a "dirty" flag for this collection somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QLatin1String("Unable to begin delete secret transaction"));
+        }
+
+        if (!m_db->execute(dq, &errorText)) {
+            m_db->rollbackTransaction();
+            // TODO: add a "dirty" flag for this collection somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to execute delete secret query: %1")
+                                             .arg(errorText));
+        }
+
+        if (!m_db->commitTransaction()) {
+            m_db->rollbackTransaction();
+            // TODO: add a "dirty" flag for this collection somewhere in memory, so we can try again later.
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QLatin1String("Unable to commit delete secret transaction"));
+        }
     }
 
-    if (found && secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
-        // TODO: perform access control request, to ask for permission to set the secret in the collection.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("Access control requests are not currently supported. TODO!"));
-    } else if (found && secretApplicationId != callerApplicationId) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
-                                         QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
-    } else if (found && secretUsesDeviceLockKey == 1) {
-        // don't update the secret if it would involve changing from a device-lock to custom-lock protected secret.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QString::fromLatin1("Secret %1 already exists and is not a devicelock protected secret")
-                                         .arg(secretName));
-    } else if (found && secretStoragePluginName.compare(storagePluginName, Qt::CaseInsensitive) != 0) {
-        // don't update the secret if it would involve changing which plugin it's stored in.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QString::fromLatin1("Secret %1 already exists and is not stored via plugin %2")
-                                         .arg(secretName, storagePluginName));
-    } else if (m_authenticationPlugins[authenticationPluginName]->authenticationType() == Sailfish::Secrets::AuthenticationPlugin::ApplicationSpecificAuthentication
-               && (userInteractionMode != Sailfish::Secrets::SecretManager::InProcessUserInteractionMode || uiServiceAddress.isEmpty())) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresInProcessUserInteraction,
-                                         QString::fromLatin1("Authentication plugin %1 requires in-process user interaction").arg(authenticationPluginName));
-    } else if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
-                                         QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(authenticationPluginName));
+    if (collectionAccessControlMode == Sailfish::Secrets::SecretManager::SystemAccessControlMode) {
+        // TODO: tell AccessControl daemon to remove this datum from its database.
     }
 
-    // perform the authentication required to get the authentication key which will be used
-    // to encrypt the secret.
-    Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[authenticationPluginName]->beginAuthentication(
-                callerPid,
-                requestId,
-                callerApplicationId,
-                QString(),
-                secretName,
-                uiServiceAddress);
-    if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
-        return authenticationResult;
+    if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
+        m_requestQueue->notifySecretChanged(collectionName, secretName);
     }
 
-    m_pendingRequests.insert(requestId,
-                             Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
-                                 callerPid,
-                                 requestId,
-                                 Sailfish::Secrets::Daemon::ApiImpl::SetStandaloneCustomLockSecretRequest,
-                                 QVariantList() << storagePluginName
-                                                << encryptionPluginName
-                                                << authenticationPluginName
-                                                << secretName
-                                                << secret
-                                                << unlockSemantic
-                                                << customLockTimeoutMs
-                                                << accessControlMode
-                                                << userInteractionMode
-                                                << uiServiceAddress));
-    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+    return pluginResult;
 }
 
+// delete a standalone secret
 Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSecretWithAuthenticationKey(
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteStandaloneSecret(
         pid_t callerPid,
         quint64 requestId,
-        const QString &storagePluginName,
-        const QString &encryptionPluginName,
-        const QString &authenticationPluginName,
         const QString &secretName,
-        const QByteArray &secret,
-        Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic unlockSemantic,
-        int customLockTimeoutMs,
-        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-        const QString &uiServiceAddress,
-        const QByteArray &authenticationKey)
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
 {
+    // these may be required in the future for access control requests.
     Q_UNUSED(requestId);
     Q_UNUSED(userInteractionMode);
-    Q_UNUSED(uiServiceAddress);
 
     // TODO: perform access control request to see if the application has permission to write secure storage data.
     const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
@@ -1735,6 +4226,7 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSec
                    " ApplicationId,"
                    " UsesDeviceLockKey,"
                    " StoragePluginName,"
+                   " EncryptionPluginName,"
                    " AccessControlMode"
                  " FROM Secrets"
                  " WHERE CollectionName = ?"
@@ -1764,129 +4256,68 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSec
     QString secretApplicationId;
     bool secretUsesDeviceLockKey = false;
     QString secretStoragePluginName;
+    QString secretEncryptionPluginName;
     Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
     if (ssq.next()) {
         found = true;
         secretApplicationId = ssq.value(0).value<QString>();
         secretUsesDeviceLockKey = ssq.value(1).value<int>() > 0;
         secretStoragePluginName = ssq.value(2).value<QString>();
-        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(ssq.value(3).value<int>());
+        secretEncryptionPluginName = ssq.value(3).value<QString>();
+        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(ssq.value(4).value<int>());
     }
 
-    if (found && secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+    if (!found) {
+        // the secret doesn't exist, return success.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    if (secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
         // TODO: perform access control request, to ask for permission to set the secret in the collection.
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
                                          QLatin1String("Access control requests are not currently supported. TODO!"));
-    } else if (found && secretApplicationId != callerApplicationId) {
+    } else if (secretApplicationId != callerApplicationId) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
                                          QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
-    } else if (found && secretUsesDeviceLockKey == 1) {
-        // don't update the secret if it would involve changing from a device-lock to custom-lock protected secret.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QString::fromLatin1("Secret %1 already exists and is not a devicelock protected secret")
-                                         .arg(secretName));
-    } else if (found && secretStoragePluginName.compare(storagePluginName, Qt::CaseInsensitive) != 0) {
-        // don't update the secret if it would involve changing which plugin it's stored in.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QString::fromLatin1("Secret %1 already exists and is not stored via plugin %2")
-                                         .arg(secretName, storagePluginName));
-    }
-
-    // Write to the master database prior to the storage plugin.
-    const QString updateSecretQuery = QStringLiteral(
-                 "UPDATE Secrets"
-                 " SET ApplicationId = ?,"
-                     " UsesDeviceLockKey = ?,"
-                     " StoragePluginName = ?,"
-                     " EncryptionPluginName = ?,"
-                     " AuthenticationPluginName = ?,"
-                     " UnlockSemantic = ?,"
-                     " CustomLockTimeoutMs = ?,"
-                     " AccessControlMode = ?"
-                 " WHERE CollectionName = ?"
-                 " AND SecretName = ?;"
-             );
-
-    const QString insertSecretQuery = QStringLiteral(
-                "INSERT INTO Secrets ("
-                  "CollectionName,"
-                  "SecretName,"
-                  "ApplicationId,"
-                  "UsesDeviceLockKey,"
-                  "StoragePluginName,"
-                  "EncryptionPluginName,"
-                  "AuthenticationPluginName,"
-                  "UnlockSemantic,"
-                  "CustomLockTimeoutMs,"
-                  "AccessControlMode"
-                ")"
-                " VALUES ("
-                  "?,?,?,?,?,?,?,?,?,?"
-                ");");
-
-    Database::Query iq = m_db->prepare(found ? updateSecretQuery : insertSecretQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare insert secret query: %1").arg(errorText));
-    }
-
-    QVariantList ivalues;
-    if (!found) {
-        ivalues << QVariant::fromValue<QString>(collectionName);
-        ivalues << QVariant::fromValue<QString>(hashedSecretName);
-    }
-    ivalues << QVariant::fromValue<QString>(callerApplicationId);
-    ivalues << QVariant::fromValue<int>(1);
-    ivalues << QVariant::fromValue<QString>(storagePluginName);
-    ivalues << QVariant::fromValue<QString>(encryptionPluginName);
-    ivalues << QVariant::fromValue<QString>(authenticationPluginName);
-    ivalues << QVariant::fromValue<int>(static_cast<int>(unlockSemantic));
-    ivalues << QVariant::fromValue<int>(customLockTimeoutMs);
-    ivalues << QVariant::fromValue<int>(static_cast<int>(accessControlMode));
-    if (found) {
-        ivalues << QVariant::fromValue<QString>(collectionName);
-        ivalues << QVariant::fromValue<QString>(hashedSecretName);
-    }
-    iq.bindValues(ivalues);
-
-    if (!m_db->beginTransaction()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                         QLatin1String("Unable to begin insert secret transaction"));
-    }
-
-    if (!m_db->execute(iq, &errorText)) {
-        m_db->rollbackTransaction();
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute insert secret query: %1").arg(errorText));
-    }
-
-    if (!m_db->commitTransaction()) {
-        m_db->rollbackTransaction();
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                         QLatin1String("Unable to commit insert secret transaction"));
+    } else if (secretStoragePluginName == secretEncryptionPluginName && !m_encryptedStoragePlugins.contains(secretStoragePluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(secretStoragePluginName));
+    } else if (secretStoragePluginName != secretEncryptionPluginName && !m_storagePlugins.contains(secretStoragePluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(secretStoragePluginName));
+    } else if (secretStoragePluginName != secretEncryptionPluginName && !m_encryptionPlugins.contains(secretEncryptionPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(secretEncryptionPluginName));
     }
 
     Sailfish::Secrets::Result pluginResult;
-    if (storagePluginName == encryptionPluginName) {
-        // TODO: does the following work?  We'd need to add methods to the encrypted storage plugin: re-encryptStandaloneSecrets or something...
-        pluginResult = m_encryptedStoragePlugins[storagePluginName]->setSecret(collectionName, hashedSecretName, secret, authenticationKey);
+    if (secretStoragePluginName == secretEncryptionPluginName) {
+        bool locked = false;
+        pluginResult = m_encryptedStoragePlugins[secretStoragePluginName]->isLocked(collectionName, &locked);
+        if (pluginResult.code() == Sailfish::Secrets::Result::Failed) {
+            return pluginResult;
+        }
+        if (locked && secretUsesDeviceLockKey) {
+            pluginResult = m_encryptedStoragePlugins[secretStoragePluginName]->setEncryptionKey(collectionName, m_deviceLockKey.rawData());
+            if (pluginResult.code() == Sailfish::Secrets::Result::Failed) {
+                return pluginResult;
+            }
+        }
+        pluginResult = m_encryptedStoragePlugins[secretStoragePluginName]->removeSecret(collectionName, hashedSecretName);
+        if (locked) {
+            // relock after delete-access.
+            m_encryptedStoragePlugins[secretStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
+        }
     } else {
-        QByteArray encrypted;
-        pluginResult = m_encryptionPlugins[encryptionPluginName]->encryptSecret(secret, authenticationKey, &encrypted);
+        pluginResult = m_storagePlugins[secretStoragePluginName]->removeSecret(collectionName, hashedSecretName);
         if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-            pluginResult = m_storagePlugins[storagePluginName]->setSecret(collectionName, hashedSecretName, encrypted);
-            if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-                m_standaloneSecretAuthenticationKeys.insert(hashedSecretName, authenticationKey);
-            }
+            releaseAuthenticationKey(m_standaloneSecretAuthenticationKeys.take(hashedSecretName));
+            m_standaloneSecretRelocks.cancel(hashedSecretName);
         }
     }
 
-    if (pluginResult.code() == Sailfish::Secrets::Result::Failed && !found) {
-        // The plugin was unable to set the secret in its storage.
-        // Let's delete it from our master table if it was a new one.
-        // It may be tempting to merely remove the commitTransaction() above, and just do a rollbackTransaction() here,
-        // but DO NOT do so, as that could lead to the case where the plugin->setSecret() call succeeds,
-        // but the master table commit fails.
+    // remove from master database also.
+    if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
         const QString deleteSecretQuery = QStringLiteral(
                     "DELETE FROM Secrets"
                     " WHERE CollectionName = ?"
@@ -1896,9 +4327,8 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSec
         if (!errorText.isEmpty()) {
             // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
             return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                             QString::fromLatin1("Unable to prepare delete secret query: %1"
-                                                                 " while removing artifacts due to plugin operation failure: %2: %3")
-                                             .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+                                             QString::fromLatin1("Unable to prepare delete secret query: %1")
+                                             .arg(errorText));
         }
 
         QVariantList values;
@@ -1909,48 +4339,40 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStandaloneCustomLockSec
         if (!m_db->beginTransaction()) {
             // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
             return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                             QString::fromLatin1("Unable to begin delete secret transaction"
-                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
-                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+                                             QString::fromLatin1("Unable to begin delete secret transaction"));
         }
 
         if (!m_db->execute(dq, &errorText)) {
             m_db->rollbackTransaction();
             // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
             return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                             QString::fromLatin1("Unable to execute delete secret query: %1"
-                                                                 " while removing artifacts due to plugin operation failure: %2: %3")
-                                             .arg(errorText).arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+                                             QString::fromLatin1("Unable to execute delete secret query: %1")
+                                             .arg(errorText));
         }
 
         if (!m_db->commitTransaction()) {
             m_db->rollbackTransaction();
             // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
             return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                             QString::fromLatin1("Unable to commit delete secret transaction"
-                                                                 " while removing artifacts due to plugin operation failure: %1: %2")
-                                             .arg(pluginResult.errorCode()).arg(pluginResult.errorMessage()));
+                                             QString::fromLatin1("Unable to commit delete secret transaction"));
         }
     }
 
-    return pluginResult;
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
-// get a secret in a collection
+// set whether the secrets in a collection are prefetched when it is unlocked
 Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getCollectionSecret(
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionPrefetchOnUnlock(
         pid_t callerPid,
         quint64 requestId,
         const QString &collectionName,
-        const QString &secretName,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-        const QString &uiServiceAddress,
-        QByteArray *secret)
+        bool prefetchOnUnlock)
 {
-    if (secretName.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
-                                         QLatin1String("Empty secret name given"));
-    } else if (collectionName.isEmpty()) {
+    // may be required in the future for access control requests.
+    Q_UNUSED(requestId);
+
+    if (collectionName.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
                                          QLatin1String("Empty collection name given"));
     } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
@@ -1958,722 +4380,839 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getCollectionSecret(
                                          QLatin1String("Reserved collection name given"));
     }
 
-    // TODO: perform access control request to see if the application has permission to write secure storage data.
     const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
     const QString callerApplicationId = applicationIsPlatformApplication
                 ? m_appPermissions->platformApplicationId()
                 : m_appPermissions->applicationId(callerPid);
 
-    const QString selectCollectionsQuery = QStringLiteral(
-                 "SELECT"
-                    " ApplicationId,"
-                    " UsesDeviceLockKey,"
-                    " StoragePluginName,"
-                    " EncryptionPluginName,"
-                    " AuthenticationPluginName,"
-                    " UnlockSemantic,"
-                    " CustomLockTimeoutMs,"
-                    " AccessControlMode"
-                  " FROM Collections"
-                  " WHERE CollectionName = ?;"
-             );
-
-    QString errorText;
-    Database::Query sq = m_db->prepare(selectCollectionsQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare select collections query: %1").arg(errorText));
-    }
-
-    QVariantList values;
-    values << QVariant::fromValue<QString>(collectionName);
-    sq.bindValues(values);
-
-    if (!m_db->execute(sq, &errorText)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute select collections query: %1").arg(errorText));
-    }
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
+    DatabaseLocker locker(m_db);
 
     bool found = false;
-    QString collectionApplicationId;
-    bool collectionUsesDeviceLockKey = false;
-    QString collectionStoragePluginName;
-    QString collectionEncryptionPluginName;
-    QString collectionAuthenticationPluginName;
-    int collectionUnlockSemantic = 0;
-    int collectionCustomLockTimeoutMs = 0;
-    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
-    if (sq.next()) {
-        found = true;
-        collectionApplicationId = sq.value(0).value<QString>();
-        collectionUsesDeviceLockKey = sq.value(1).value<int>() > 0;
-        collectionStoragePluginName = sq.value(2).value<QString>();
-        collectionEncryptionPluginName = sq.value(3).value<QString>();
-        collectionAuthenticationPluginName = sq.value(4).value<QString>();
-        collectionUnlockSemantic = sq.value(5).value<int>();
-        collectionCustomLockTimeoutMs = sq.value(6).value<int>();
-        collectionAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(sq.value(7).value<int>());
-    }
-
-    if (!found) {
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
+    } else if (!found) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
                                          QLatin1String("Nonexistent collection name given"));
-    }
-
-    if (collectionStoragePluginName == collectionEncryptionPluginName && !m_encryptedStoragePlugins.contains(collectionStoragePluginName)) {
-        // TODO: stale data, plugin was removed but data still exists...?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(collectionStoragePluginName));
-    } else if (collectionStoragePluginName != collectionEncryptionPluginName && !m_storagePlugins.contains(collectionStoragePluginName)) {
-        // TODO: stale data, plugin was removed but data still exists...?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such storage plugin exists: %1").arg(collectionStoragePluginName));
-    } else if (collectionStoragePluginName != collectionEncryptionPluginName && !m_encryptionPlugins.contains(collectionEncryptionPluginName)) {
-        // TODO: stale data, plugin was removed but data still exists...?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(collectionEncryptionPluginName));
-    } else if (collectionAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
-        // TODO: perform access control request, to ask for permission to set the secret in the collection.
+    } else if (metadata.accessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to modify the collection.
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
                                          QLatin1String("Access control requests are not currently supported. TODO!"));
-    } else if (collectionApplicationId != callerApplicationId) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
-                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
-    } else if (!m_authenticationPlugins.contains(collectionAuthenticationPluginName)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                        QString::fromLatin1("No such authentication plugin available: %1").arg(collectionAuthenticationPluginName));
-    } else if (m_authenticationPlugins[collectionAuthenticationPluginName]->authenticationType() == Sailfish::Secrets::AuthenticationPlugin::ApplicationSpecificAuthentication
-                   && (userInteractionMode != Sailfish::Secrets::SecretManager::InProcessUserInteractionMode || uiServiceAddress.isEmpty())) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresInProcessUserInteraction,
-                                     QString::fromLatin1("Authentication plugin %1 requires in-process user interaction").arg(collectionAuthenticationPluginName));
-    }
-
-    if (collectionStoragePluginName == collectionEncryptionPluginName) {
-        bool locked = false;
-        Sailfish::Secrets::Result pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
-        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
-            return pluginResult;
-        }
-
-        if (locked) {
-            if (collectionUsesDeviceLockKey) {
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
-                                                 QString::fromLatin1("Collection %1 is locked and requires device lock authentication").arg(collectionName));
-            } else {
-                if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
-                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
-                                                     QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
-                }
-
-                // perform UI request to get the authentication key for the collection
-                Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
-                            callerPid,
-                            requestId,
-                            callerApplicationId,
-                            collectionName,
-                            secretName,
-                            uiServiceAddress);
-                if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
-                    return authenticationResult;
-                }
-
-                m_pendingRequests.insert(requestId,
-                                         Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
-                                             callerPid,
-                                             requestId,
-                                             Sailfish::Secrets::Daemon::ApiImpl::GetCollectionSecretRequest,
-                                             QVariantList() << collectionName
-                                                            << secretName
-                                                            << userInteractionMode
-                                                            << uiServiceAddress
-                                                            << collectionStoragePluginName
-                                                            << collectionEncryptionPluginName
-                                                            << collectionUnlockSemantic
-                                                            << collectionCustomLockTimeoutMs));
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
-            }
-        } else {
-            return getCollectionSecretWithAuthenticationKey(
-                        callerPid,
-                        requestId,
-                        collectionName,
-                        secretName,
-                        userInteractionMode,
-                        uiServiceAddress,
-                        collectionStoragePluginName,
-                        collectionEncryptionPluginName,
-                        collectionUnlockSemantic,
-                        collectionCustomLockTimeoutMs,
-                        QByteArray(), // no key required, it's unlocked already.
-                        secret);
-        }
-    } else {
-        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
-            if (collectionUsesDeviceLockKey) {
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
-                                                 QString::fromLatin1("Collection %1 is locked and requires device lock authentication").arg(collectionName));
-            } else {
-                if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
-                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
-                                                     QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
-                }
-
-                // perform UI request to get the authentication key for the collection
-                Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
-                            callerPid,
-                            requestId,
-                            callerApplicationId,
-                            collectionName,
-                            secretName,
-                            uiServiceAddress);
-                if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
-                    return authenticationResult;
-                }
-
-                m_pendingRequests.insert(requestId,
-                                         Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
-                                             callerPid,
-                                             requestId,
-                                             Sailfish::Secrets::Daemon::ApiImpl::GetCollectionSecretRequest,
-                                             QVariantList() << collectionName
-                                                            << secretName
-                                                            << userInteractionMode
-                                                            << uiServiceAddress
-                                                            << collectionStoragePluginName
-                                                            << collectionEncryptionPluginName
-                                                            << collectionUnlockSemantic
-                                                            << collectionCustomLockTimeoutMs));
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
-            }
-        } else {
-            return getCollectionSecretWithAuthenticationKey(
-                        callerPid,
-                        requestId,
-                        collectionName,
-                        secretName,
-                        userInteractionMode,
-                        uiServiceAddress,
-                        collectionStoragePluginName,
-                        collectionEncryptionPluginName,
-                        collectionUnlockSemantic,
-                        collectionCustomLockTimeoutMs,
-                        m_collectionAuthenticationKeys.value(collectionName),
-                        secret);
-        }
-    }
-}
-
-Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getCollectionSecretWithAuthenticationKey(
-        pid_t callerPid,
-        quint64 requestId,
-        const QString &collectionName,
-        const QString &secretName,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-        const QString &uiServiceAddress,
-        const QString &storagePluginName,
-        const QString &encryptionPluginName,
-        int collectionUnlockSemantic,
-        int collectionCustomLockTimeoutMs,
-        const QByteArray &authenticationKey,
-        QByteArray *secret)
-{
-    // might be required in future for access control requests.
-    Q_UNUSED(callerPid);
-    Q_UNUSED(requestId);
-    Q_UNUSED(userInteractionMode);
-    Q_UNUSED(uiServiceAddress);
-
-    if (collectionUnlockSemantic == Sailfish::Secrets::SecretManager::CustomLockTimoutRelock) {
-        if (!m_collectionLockTimers.contains(collectionName)) {
-            QTimer *timer = new QTimer(this);
-            connect(timer, &QTimer::timeout,
-                    this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::timeoutRelockCollection);
-            timer->setInterval(collectionCustomLockTimeoutMs);
-            timer->setSingleShot(true);
-            timer->start();
-            m_collectionLockTimers.insert(collectionName, timer);
-        }
-    }
-
-    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
-    Sailfish::Secrets::Result pluginResult;
-    if (storagePluginName == encryptionPluginName) {
-        bool locked = false;
-        pluginResult = m_encryptedStoragePlugins[storagePluginName]->isLocked(collectionName, &locked);
-        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
-            return pluginResult;
-        }
-        // if it's locked, attempt to unlock it
-        if (locked) {
-            pluginResult = m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, authenticationKey);
-            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
-                // unable to apply the new authenticationKey.
-                m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
-                                                 QString::fromLatin1("Unable to decrypt collection %1 with the entered authentication key").arg(collectionName));
+    } else if (metadata.applicationId != callerApplicationId) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
+                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
+    } else if (metadata.prefetchOnUnlock == prefetchOnUnlock) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
 
-            }
-            pluginResult = m_encryptedStoragePlugins[storagePluginName]->isLocked(collectionName, &locked);
-            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
-                m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
-                                                 QString::fromLatin1("Unable to check lock state of collection %1 after setting the entered authentication key").arg(collectionName));
+    const QString updateCollectionQuery = QStringLiteral(
+                "UPDATE Collections"
+                " SET PrefetchOnUnlock = ?"
+                " WHERE CollectionName = ?;");
 
-            }
-        }
-        if (locked) {
-            // still locked, even after applying the new authenticationKey?  The authenticationKey was wrong.
-            m_encryptedStoragePlugins[storagePluginName]->setEncryptionKey(collectionName, QByteArray());
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
-                                             QString::fromLatin1("The authentication key entered for collection %1 was incorrect").arg(collectionName));
-        }
-        // successfully unlocked the encrypted storage collection.  write the secret.
-        pluginResult = m_encryptedStoragePlugins[storagePluginName]->getSecret(collectionName, hashedSecretName, secret);
-    } else {
-        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
-            // TODO: some way to "test" the authenticationKey!  also, if it's a custom lock, set the timeout, etc.
-            m_collectionAuthenticationKeys.insert(collectionName, authenticationKey);
-        }
+    QString errorText;
+    Database::Query uq = m_db->prepare(updateCollectionQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare update collection query: %1").arg(errorText));
+    }
 
-        QByteArray encrypted;
-        pluginResult = m_storagePlugins[storagePluginName]->getSecret(collectionName, hashedSecretName, &encrypted);
-        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-            pluginResult = m_encryptionPlugins[encryptionPluginName]->decryptSecret(encrypted, m_collectionAuthenticationKeys.value(collectionName), secret);
-        }
+    QVariantList values;
+    values << QVariant::fromValue<int>(prefetchOnUnlock ? 1 : 0);
+    values << QVariant::fromValue<QString>(collectionName);
+    uq.bindValues(values);
+
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Unable to begin update collection transaction"));
     }
 
-    return pluginResult;
+    if (!m_db->execute(uq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute update collection query: %1").arg(errorText));
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Unable to commit update collection transaction"));
+    }
+
+    m_collectionMetadata.remove(collectionName);
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
-// get a standalone secret
+// get the names of the collections owned by the caller
 Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getStandaloneSecret(
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::collectionNames(
         pid_t callerPid,
         quint64 requestId,
-        const QString &secretName,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-        const QString &uiServiceAddress,
-        QByteArray *secret)
+        QStringList *collectionNames)
 {
-    if (secretName.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
-                                         QLatin1String("Empty secret name given"));
-    }
+    // may be required in the future for access control requests.
+    Q_UNUSED(requestId);
 
-    // TODO: perform access control request to see if the application has permission to write secure storage data.
     const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
     const QString callerApplicationId = applicationIsPlatformApplication
                 ? m_appPermissions->platformApplicationId()
                 : m_appPermissions->applicationId(callerPid);
 
-    const QString selectSecretsQuery = QStringLiteral(
+    // this only reads committed state, so needn't wait for any write in progress.
+    const QString selectCollectionNamesQuery = QStringLiteral(
                  "SELECT"
-                    " ApplicationId,"
-                    " UsesDeviceLockKey,"
-                    " StoragePluginName,"
-                    " EncryptionPluginName,"
-                    " AuthenticationPluginName,"
-                    " UnlockSemantic,"
-                    " CustomLockTimeoutMs,"
-                    " AccessControlMode"
-                  " FROM Secrets"
-                  " WHERE CollectionName = ?"
-                  " AND SecretName = ?;"
+                    " CollectionName"
+                  " FROM Collections"
+                  " WHERE ApplicationId = ?"
+                  " AND CollectionName != 'standalone'"
+                  " ORDER BY CollectionName;"
              );
 
     QString errorText;
-    Database::Query sq = m_db->prepare(selectSecretsQuery, &errorText);
+    Database::Query sq = m_db->prepareRead(selectCollectionNamesQuery, &errorText);
     if (!errorText.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
+                                         QString::fromLatin1("Unable to prepare select collection names query: %1").arg(errorText));
     }
 
-    const QString collectionName = QStringLiteral("standalone");
-    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
     QVariantList values;
-    values << QVariant::fromValue<QString>(collectionName);
-    values << QVariant::fromValue<QString>(hashedSecretName);
+    values << QVariant::fromValue<QString>(callerApplicationId);
     sq.bindValues(values);
 
     if (!m_db->execute(sq, &errorText)) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
+                                         QString::fromLatin1("Unable to execute select collection names query: %1").arg(errorText));
     }
 
-    bool found = false;
-    QString secretApplicationId;
-    bool secretUsesDeviceLockKey = false;
-    QString secretStoragePluginName;
-    QString secretEncryptionPluginName;
-    QString secretAuthenticationPluginName;
-    int secretUnlockSemantic = 0;
-    int secretCustomLockTimeoutMs = 0;
-    Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
-    if (sq.next()) {
-        found = true;
-        secretApplicationId = sq.value(0).value<QString>();
-        secretUsesDeviceLockKey = sq.value(1).value<int>() > 0;
-        secretStoragePluginName = sq.value(2).value<QString>();
-        secretEncryptionPluginName = sq.value(3).value<QString>();
-        secretAuthenticationPluginName = sq.value(4).value<QString>();
-        secretUnlockSemantic = sq.value(5).value<int>();
-        secretCustomLockTimeoutMs = sq.value(6).value<int>();
-        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(sq.value(7).value<int>());
+    while (sq.next()) {
+        collectionNames->append(sq.value(0).value<QString>());
     }
 
-    if (!found) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
-                                         QLatin1String("Nonexistent secret name given"));
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// get a page of the names of the secrets in an unlocked collection
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::secretNames(
+        pid_t callerPid,
+        quint64 requestId,
+        const QString &collectionName,
+        qint64 cursor,
+        int limit,
+        QStringList *secretNames,
+        qint64 *nextCursor)
+{
+    // may be required in the future for access control requests.
+    Q_UNUSED(requestId);
+
+    // bounds the size of the reply, whatever the caller asks for.
+    const int MaxSecretNamesPerPage = 1000;
+
+    *nextCursor = 0;
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Reserved collection name given"));
+    } else if (cursor < 0 || limit <= 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QLatin1String("Invalid cursor or limit given"));
     }
 
-    if (secretStoragePluginName == secretEncryptionPluginName && !m_encryptedStoragePlugins.contains(secretStoragePluginName)) {
-        // TODO: stale data, plugin was removed but data still exists...?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(secretStoragePluginName));
-    } else if (secretStoragePluginName != secretEncryptionPluginName && !m_storagePlugins.contains(secretStoragePluginName)) {
-        // TODO: stale data, plugin was removed but data still exists...?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such storage plugin exists: %1").arg(secretStoragePluginName));
-    } else if (secretStoragePluginName != secretEncryptionPluginName && !m_encryptionPlugins.contains(secretEncryptionPluginName)) {
-        // TODO: stale data, plugin was removed but data still exists...?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(secretEncryptionPluginName));
-    } else if (secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
-        // TODO: perform access control request, to ask for permission to set the secret.
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::ReadLock);
+
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        return metadataResult;
+    } else if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Nonexistent collection name given"));
+    } else if (metadata.accessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
+        // TODO: perform access control request, to ask for permission to enumerate the collection.
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
                                          QLatin1String("Access control requests are not currently supported. TODO!"));
-    } else if (secretApplicationId != callerApplicationId) {
+    } else if (metadata.applicationId != callerApplicationId) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
-                                         QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
-    } else if (m_authenticationPlugins[secretAuthenticationPluginName]->authenticationType() == Sailfish::Secrets::AuthenticationPlugin::ApplicationSpecificAuthentication
-               && (userInteractionMode != Sailfish::Secrets::SecretManager::InProcessUserInteractionMode || uiServiceAddress.isEmpty())) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresInProcessUserInteraction,
-                                         QString::fromLatin1("Authentication plugin %1 requires in-process user interaction").arg(secretAuthenticationPluginName));
+                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
+    } else if (metadata.storagePluginName == metadata.encryptionPluginName) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Secret names are not recorded in encrypted storage plugins"));
+    } else if (!m_storagePlugins.contains(metadata.storagePluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such storage plugin exists: %1").arg(metadata.storagePluginName));
+    } else if (!m_encryptionPlugins.contains(metadata.encryptionPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(metadata.encryptionPluginName));
+    } else if (!m_collectionAuthenticationKeys.contains(collectionName)) {
+        // the names are encrypted with the collection key, which reading any secret will supply.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromLatin1("Collection %1 is locked").arg(collectionName));
     }
 
-    if (m_standaloneSecretAuthenticationKeys.contains(hashedSecretName)) {
-        return getStandaloneSecretWithAuthenticationKey(
-                    callerPid,
-                    requestId,
-                    secretName,
-                    userInteractionMode,
-                    uiServiceAddress,
-                    secretStoragePluginName,
-                    secretEncryptionPluginName,
-                    secretUnlockSemantic,
-                    secretCustomLockTimeoutMs,
-                    m_standaloneSecretAuthenticationKeys.value(hashedSecretName),
-                    secret);
+    // keyset pagination over SecretsEnumerationIndex, so each page costs the same however deep it is.
+    const QString selectSecretNamesQuery = QStringLiteral(
+                 "SELECT"
+                    " SecretId,"
+                    " SecretName"
+                  " FROM Secrets"
+                  " WHERE CollectionName = ?"
+                  " AND SecretId > ?"
+                  " ORDER BY SecretId"
+                  " LIMIT ?;"
+             );
+
+    QString errorText;
+    Database::Query sq = m_db->prepareRead(selectSecretNamesQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare select secret names query: %1").arg(errorText));
     }
 
-    if (secretUsesDeviceLockKey) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
-                                         QString::fromLatin1("Secret %1 is locked and requires device lock authentication").arg(secretName));
+    const int pageSize = qMin(limit, MaxSecretNamesPerPage);
+    QVariantList values;
+    values << QVariant::fromValue<QString>(collectionName);
+    values << QVariant::fromValue<qint64>(cursor);
+    values << QVariant::fromValue<int>(pageSize);
+    sq.bindValues(values);
+
+    if (!m_db->execute(sq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute select secret names query: %1").arg(errorText));
     }
 
-    if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
-                                         QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(secretAuthenticationPluginName));
+    QStringList nameEntryNames;
+    qint64 lastSecretId = 0;
+    while (sq.next()) {
+        lastSecretId = sq.value(0).value<qint64>();
+        nameEntryNames.append(secretNameEntryName(sq.value(1).value<QString>()));
+    }
+    if (nameEntryNames.size() == pageSize) {
+        *nextCursor = lastSecretId;
+    }
+    if (nameEntryNames.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
     }
 
-    // perform UI request to get the authentication key for the collection
-    Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[secretAuthenticationPluginName]->beginAuthentication(
-                callerPid,
-                requestId,
-                callerApplicationId,
-                QString(),
-                secretName,
-                uiServiceAddress);
-    if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
-        return authenticationResult;
+    // secrets written before their names were recorded have no name entry, and are skipped.
+    QMap<QString, QByteArray> nameEntries;
+    Sailfish::Secrets::Result pluginResult = m_storagePlugins[metadata.storagePluginName]->getSecrets(
+                collectionName, nameEntryNames, &nameEntries);
+    const Sailfish::Secrets::Daemon::SecureByteArray key = m_collectionAuthenticationKeys.value(collectionName);
+    for (int i = 0; pluginResult.code() == Sailfish::Secrets::Result::Succeeded && i < nameEntryNames.size(); ++i) {
+        if (!nameEntries.contains(nameEntryNames.at(i))) {
+            continue;
+        }
+        QByteArray name;
+        pluginResult = m_encryptionPlugins[metadata.encryptionPluginName]->decryptSecret(nameEntries.value(nameEntryNames.at(i)), key.rawData(), &name);
+        secretNames->append(QString::fromUtf8(name));
     }
 
-    m_pendingRequests.insert(requestId,
-                             Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
-                                 callerPid,
-                                 requestId,
-                                 Sailfish::Secrets::Daemon::ApiImpl::GetStandaloneSecretRequest,
-                                 QVariantList() << collectionName
-                                                << secretName
-                                                << userInteractionMode
-                                                << uiServiceAddress
-                                                << secretStoragePluginName
-                                                << secretEncryptionPluginName
-                                                << secretUnlockSemantic
-                                                << secretCustomLockTimeoutMs));
-    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+    if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        secretNames->clear();
+        *nextCursor = 0;
+    }
+    return pluginResult;
 }
 
+// write every unlocked collection owned by the caller, and its secrets, to an archive
 Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::getStandaloneSecretWithAuthenticationKey(
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::exportSecrets(
         pid_t callerPid,
         quint64 requestId,
-        const QString &secretName,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-        const QString &uiServiceAddress,
-        const QString &storagePluginName,
-        const QString &encryptionPluginName,
-        int secretUnlockSemantic,
-        int secretCustomLockTimeoutMs,
-        const QByteArray &authenticationKey,
-        QByteArray *secret)
+        const QDBusUnixFileDescriptor &archive,
+        const QByteArray &archiveKey,
+        int *exportedCount)
 {
-    // may be needed for access control requests in the future.
-    Q_UNUSED(callerPid);
-    Q_UNUSED(requestId);
-    Q_UNUSED(userInteractionMode);
-    Q_UNUSED(uiServiceAddress);
+    // the Secrets table is paged through, so that no more than a page of secrets is held at once.
+    const int ExportPageSize = 256;
 
-    if (secretUnlockSemantic == Sailfish::Secrets::SecretManager::CustomLockTimoutRelock) {
-        if (!m_standaloneSecretLockTimers.contains(secretName)) {
-            QTimer *timer = new QTimer(this);
-            connect(timer, &QTimer::timeout,
-                    this, &Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::timeoutRelockSecret);
-            timer->setInterval(secretCustomLockTimeoutMs);
-            timer->setSingleShot(true);
-            timer->start();
-            m_standaloneSecretLockTimers.insert(secretName, timer);
-        }
+    *exportedCount = 0;
+    if (archiveKey.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty archive key given"));
+    } else if (!m_encryptionPlugins.contains(Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1")
+                                         .arg(Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName));
     }
 
-    const QString collectionName = QStringLiteral("standalone");
-    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
+    QStringList ownedCollectionNames;
+    Sailfish::Secrets::Result result = collectionNames(callerPid, requestId, &ownedCollectionNames);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    }
 
-    Sailfish::Secrets::Result pluginResult;
-    if (storagePluginName == encryptionPluginName) {
-        pluginResult = m_encryptedStoragePlugins[storagePluginName]->accessSecret(collectionName, hashedSecretName, authenticationKey, secret);
-    } else {
-        QByteArray encrypted;
-        pluginResult = m_storagePlugins[storagePluginName]->getSecret(collectionName, hashedSecretName, &encrypted);
-        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-            pluginResult = m_encryptionPlugins[encryptionPluginName]->decryptSecret(encrypted, authenticationKey, secret);
+    Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveWriter writer(
+                m_encryptionPlugins[Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName], archiveKey);
+    result = writer.open(archive);
+
+    const QString selectSecretNamesQuery = QStringLiteral(
+                 "SELECT"
+                    " SecretId,"
+                    " SecretName"
+                  " FROM Secrets"
+                  " WHERE CollectionName = ?"
+                  " AND SecretId > ?"
+                  " ORDER BY SecretId"
+                  " LIMIT ?;"
+             );
+
+    for (int c = 0; result.code() == Sailfish::Secrets::Result::Succeeded && c < ownedCollectionNames.size(); ++c) {
+        const QString &collectionName(ownedCollectionNames.at(c));
+        Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::ReadLock);
+
+        bool found = false;
+        Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+        result = collectionMetadata(collectionName, &metadata, &found);
+        if (result.code() != Sailfish::Secrets::Result::Succeeded || !found) {
+            continue;
+        } else if (metadata.storagePluginName == metadata.encryptionPluginName) {
+            // the secret names are only recorded for collections stored by separate plugins.
+            qCWarning(lcSailfishSecretsDaemon) << "Not exporting encrypted storage collection:" << collectionName;
+            continue;
+        } else if (!m_storagePlugins.contains(metadata.storagePluginName)
+                || !m_encryptionPlugins.contains(metadata.encryptionPluginName)) {
+            qCWarning(lcSailfishSecretsDaemon) << "Not exporting collection with missing plugins:" << collectionName;
+            continue;
+        } else if (!m_collectionAuthenticationKeys.contains(collectionName)) {
+            // the export never prompts, so the caller must unlock each collection it wants exported.
+            qCWarning(lcSailfishSecretsDaemon) << "Not exporting locked collection:" << collectionName;
+            continue;
+        }
+
+        Sailfish::Secrets::Daemon::ApiImpl::ArchivedCollection archivedCollection;
+        archivedCollection.collectionName = collectionName;
+        archivedCollection.usesDeviceLockKey = metadata.usesDeviceLockKey;
+        archivedCollection.storagePluginName = metadata.storagePluginName;
+        archivedCollection.encryptionPluginName = metadata.encryptionPluginName;
+        archivedCollection.authenticationPluginName = metadata.authenticationPluginName;
+        archivedCollection.unlockSemantic = metadata.unlockSemantic;
+        archivedCollection.customLockTimeoutMs = metadata.customLockTimeoutMs;
+        archivedCollection.accessControlMode = static_cast<int>(metadata.accessControlMode);
+        result = writer.writeCollection(archivedCollection);
+
+        Sailfish::Secrets::StoragePlugin *storagePlugin = m_storagePlugins[metadata.storagePluginName];
+        Sailfish::Secrets::EncryptionPlugin *encryptionPlugin = m_encryptionPlugins[metadata.encryptionPluginName];
+        const Sailfish::Secrets::Daemon::SecureByteArray key = m_collectionAuthenticationKeys.value(collectionName);
+        qint64 cursor = 0;
+        bool morePages = true;
+        while (result.code() == Sailfish::Secrets::Result::Succeeded && morePages) {
+            QString errorText;
+            Database::Query sq = m_db->prepareRead(selectSecretNamesQuery, &errorText);
+            if (!errorText.isEmpty()) {
+                result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                                   QString::fromLatin1("Unable to prepare select secret names query: %1").arg(errorText));
+                break;
+            }
+
+            QVariantList values;
+            values << QVariant::fromValue<QString>(collectionName);
+            values << QVariant::fromValue<qint64>(cursor);
+            values << QVariant::fromValue<int>(ExportPageSize);
+            sq.bindValues(values);
+
+            if (!m_db->execute(sq, &errorText)) {
+                result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                                   QString::fromLatin1("Unable to execute select secret names query: %1").arg(errorText));
+                break;
+            }
+
+            QStringList hashedSecretNames;
+            QStringList storedNames;
+            while (sq.next()) {
+                cursor = sq.value(0).value<qint64>();
+                hashedSecretNames.append(sq.value(1).value<QString>());
+                storedNames.append(hashedSecretNames.last());
+                storedNames.append(secretNameEntryName(hashedSecretNames.last()));
+            }
+            morePages = hashedSecretNames.size() == ExportPageSize;
+            if (hashedSecretNames.isEmpty()) {
+                break;
+            }
+
+            QMap<QString, QByteArray> storedSecrets;
+            result = storagePlugin->getSecrets(collectionName, storedNames, &storedSecrets);
+            for (int i = 0; result.code() == Sailfish::Secrets::Result::Succeeded && i < hashedSecretNames.size(); ++i) {
+                // secrets written before their names were recorded can't be restored by name, and are skipped.
+                const QString &hashedSecretName(hashedSecretNames.at(i));
+                const QString nameEntryName = secretNameEntryName(hashedSecretName);
+                if (!storedSecrets.contains(hashedSecretName) || !storedSecrets.contains(nameEntryName)) {
+                    continue;
+                }
+
+                QByteArray name;
+                Sailfish::Secrets::Daemon::ApiImpl::ArchivedSecret archivedSecret;
+                archivedSecret.collectionName = collectionName;
+                result = encryptionPlugin->decryptSecret(storedSecrets.value(nameEntryName), key.rawData(), &name);
+                archivedSecret.secretName = QString::fromUtf8(name);
+                if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+                    result = encryptionPlugin->decryptSecret(storedSecrets.value(hashedSecretName), key.rawData(), &archivedSecret.secret);
+                }
+                bool chunked = false;
+                if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+                    result = loadSecretChunks(storagePlugin, encryptionPlugin, collectionName, hashedSecretName,
+                                              key.rawData(), &archivedSecret.secret, &chunked);
+                }
+                if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+                    result = writer.writeSecret(archivedSecret);
+                    *exportedCount += 1;
+                }
+                Sailfish::Secrets::Daemon::wipe(&archivedSecret.secret);
+            }
         }
     }
 
-    return pluginResult;
+    if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+        result = writer.finish();
+    }
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        *exportedCount = 0;
+    }
+    return result;
 }
 
-// delete a secret in a collection
+// recreate the collections in an archive written by exportSecrets(), and write their secrets
 Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollectionSecret(
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::importSecrets(
         pid_t callerPid,
         quint64 requestId,
-        const QString &collectionName,
-        const QString &secretName,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-        const QString &uiServiceAddress)
+        const QDBusUnixFileDescriptor &archive,
+        const QByteArray &archiveKey,
+        int *importedCount)
 {
-    if (secretName.isEmpty()) {
+    *importedCount = 0;
+    if (archiveKey.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
-                                         QLatin1String("Empty secret name given"));
-    } else if (collectionName.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
-                                         QLatin1String("Empty collection name given"));
-    } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
-                                         QLatin1String("Reserved collection name given"));
-    }
-
-    // TODO: perform access control request to see if the application has permission to write secure storage data.
-    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
-    const QString callerApplicationId = applicationIsPlatformApplication
-                ? m_appPermissions->platformApplicationId()
-                : m_appPermissions->applicationId(callerPid);
+                                         QLatin1String("Empty archive key given"));
+    } else if (!m_encryptionPlugins.contains(Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1")
+                                         .arg(Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName));
+    }
+
+    Sailfish::Secrets::Daemon::ApiImpl::SecretsArchiveReader reader(
+                m_encryptionPlugins[Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName], archiveKey);
+    Sailfish::Secrets::Result result = reader.open(archive);
+
+    bool finished = false;
+    while (result.code() == Sailfish::Secrets::Result::Succeeded && !finished) {
+        QVector<Sailfish::Secrets::Daemon::ApiImpl::ArchivedCollection> collections;
+        QVector<Sailfish::Secrets::Daemon::ApiImpl::ArchivedSecret> secrets;
+        result = reader.readFrame(&collections, &secrets, &finished);
+
+        for (int i = 0; result.code() == Sailfish::Secrets::Result::Succeeded && i < collections.size(); ++i) {
+            const Sailfish::Secrets::Daemon::ApiImpl::ArchivedCollection &collection(collections.at(i));
+            bool found = false;
+            Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+            result = collectionMetadata(collection.collectionName, &metadata, &found);
+            if (result.code() != Sailfish::Secrets::Result::Succeeded || found) {
+                // existing collections are written to (if the caller owns them) by setCollectionSecrets().
+                continue;
+            } else if (!collection.usesDeviceLockKey) {
+                // a custom lock collection needs a new authentication key, which only the user can supply.
+                result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                                   QString::fromLatin1("Collection %1 must be created before it can be imported")
+                                                   .arg(collection.collectionName));
+            } else {
+                result = createDeviceLockCollection(
+                            callerPid,
+                            requestId,
+                            collection.collectionName,
+                            collection.storagePluginName,
+                            collection.encryptionPluginName,
+                            static_cast<Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic>(collection.unlockSemantic),
+                            static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(collection.accessControlMode),
+                            Sailfish::Secrets::StoragePlugin::FullDurability);
+            }
+        }
 
-    const QString selectCollectionsQuery = QStringLiteral(
-                 "SELECT"
-                    " ApplicationId,"
-                    " UsesDeviceLockKey,"
-                    " StoragePluginName,"
-                    " EncryptionPluginName,"
-                    " AuthenticationPluginName,"
-                    " AccessControlMode"
-                  " FROM Collections"
-                  " WHERE CollectionName = ?;"
-             );
+        // the secrets of each collection in the frame are written in one batch.
+        QMap<QString, QMap<QString, QByteArray> > collectionSecrets;
+        for (int i = 0; i < secrets.size(); ++i) {
+            collectionSecrets[secrets.at(i).collectionName].insert(secrets.at(i).secretName, secrets.at(i).secret);
+        }
+        for (QMap<QString, QMap<QString, QByteArray> >::const_iterator it = collectionSecrets.constBegin();
+                result.code() == Sailfish::Secrets::Result::Succeeded && it != collectionSecrets.constEnd(); it++) {
+            result = setCollectionSecrets(callerPid, requestId, it.key(), it.value(),
+                                          Sailfish::Secrets::SecretManager::PreventUserInteractionMode, QString());
+            if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+                *importedCount += it.value().size();
+            }
+        }
 
-    QString errorText;
-    Database::Query sq = m_db->prepare(selectCollectionsQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare select collections query: %1").arg(errorText));
+        collectionSecrets.clear();
+        for (int i = 0; i < secrets.size(); ++i) {
+            Sailfish::Secrets::Daemon::wipe(&secrets[i].secret);
+        }
     }
 
-    QVariantList values;
-    values << QVariant::fromValue<QString>(collectionName);
-    sq.bindValues(values);
+    return result;
+}
 
-    if (!m_db->execute(sq, &errorText)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute select collections query: %1").arg(errorText));
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setStorageWriteBatching(bool enabled)
+{
+    // plugins which are loaded later are configured by pluginLoaded().
+    m_storageWriteBatching = enabled;
+    Q_FOREACH (Sailfish::Secrets::StoragePlugin *plugin, m_storagePlugins.loaded()) {
+        plugin->setWriteBatching(enabled);
     }
+}
 
-    bool found = false;
-    QString collectionApplicationId;
-    bool collectionUsesDeviceLockKey = false;
-    QString collectionStoragePluginName;
-    QString collectionEncryptionPluginName;
-    QString collectionAuthenticationPluginName;
-    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
-    if (sq.next()) {
-        found = true;
-        collectionApplicationId = sq.value(0).value<QString>();
-        collectionUsesDeviceLockKey = sq.value(1).value<int>() > 0;
-        collectionStoragePluginName = sq.value(2).value<QString>();
-        collectionEncryptionPluginName = sq.value(3).value<QString>();
-        collectionAuthenticationPluginName = sq.value(4).value<QString>();
-        collectionAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(sq.value(5).value<int>());
+bool
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::storageWritesPending() const
+{
+    Q_FOREACH (Sailfish::Secrets::StoragePlugin *plugin, m_storagePlugins.loaded()) {
+        if (plugin->hasPendingWrites()) {
+            return true;
+        }
     }
+    return false;
+}
 
-    if (!found) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
-                                         QLatin1String("Nonexistent collection name given"));
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::shareStorageDatabaseConnection()
+{
+    // every storage plugin is loaded now, as a connection can't be shared within a transaction.
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, QString(), Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
+    DatabaseLocker locker(m_db);
+    Q_FOREACH (const QString &pluginName, m_storagePlugins.keys()) {
+        Sailfish::Secrets::StoragePlugin *plugin = m_storagePlugins.value(pluginName);
+        if (!plugin || m_sharedConnectionStoragePlugins.contains(plugin->name())) {
+            continue;
+        }
+        const QString schemaName = QStringLiteral("storage%1").arg(m_sharedConnectionStoragePlugins.size());
+        if (plugin->shareDatabaseConnection(m_db->connectionName(), schemaName, m_db->accessMutex())) {
+            qCDebug(lcSailfishSecretsDaemon) << "storage plugin" << plugin->name() << "shares the master database connection";
+            m_sharedConnectionStoragePlugins.insert(plugin->name());
+        }
     }
+}
 
-    if (collectionAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
-        // TODO: perform access control request, to ask for permission to set the secret in the collection.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("Access control requests are not currently supported. TODO!"));
-    } else if (collectionApplicationId != callerApplicationId) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
-                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
-    } else if (collectionStoragePluginName == collectionEncryptionPluginName
-            && !m_encryptedStoragePlugins.contains(collectionStoragePluginName)) {
-        // TODO: this means we have "stale" data in the database; what should we do in this case?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(collectionStoragePluginName));
-    } else if (collectionStoragePluginName != collectionEncryptionPluginName
-            && (collectionStoragePluginName.isEmpty() || !m_storagePlugins.contains(collectionStoragePluginName))) {
-        // TODO: this means we have "stale" data in the database; what should we do in this case?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such storage plugin exists: %1").arg(collectionStoragePluginName));
-    } else if (collectionStoragePluginName != collectionEncryptionPluginName
-            && (collectionEncryptionPluginName.isEmpty() || !m_encryptionPlugins.contains(collectionEncryptionPluginName))) {
-        // TODO: this means we have "stale" data in the database; what should we do in this case?
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(collectionEncryptionPluginName));
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::flushStorage()
+{
+    Sailfish::Secrets::Result result(Sailfish::Secrets::Result::Succeeded);
+    Q_FOREACH (Sailfish::Secrets::StoragePlugin *plugin, m_storagePlugins.loaded()) {
+        if (!plugin->hasPendingWrites()) {
+            continue;
+        }
+        const Sailfish::Secrets::Result flushResult = plugin->flush();
+        if (flushResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            qCWarning(lcSailfishSecretsDaemon) << "Failed to flush grouped writes to storage plugin:" << plugin->name()
+                                               << flushResult.errorMessage();
+            result = flushResult;
+        }
     }
+    return result;
+}
 
-    if (collectionStoragePluginName == collectionEncryptionPluginName) {
-        bool locked = false;
-        Sailfish::Secrets::Result pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
-        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
-            return pluginResult;
-        }
-        if (locked) {
-            if (collectionUsesDeviceLockKey) {
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
-                                                 QString::fromLatin1("Collection %1 is locked and requires device lock authentication"));
-            }
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::discardCachedState()
+{
+    m_secretCache.clear();
+    m_collectionMetadata.clear();
+}
 
-            if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
-                                                 QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
-            }
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::memoryUsage(QMap<QString, qint64> *usage) const
+{
+    qint64 keyBytes = 0;
+    for (QMap<QString, Sailfish::Secrets::Daemon::SecureByteArray>::const_iterator it = m_collectionAuthenticationKeys.constBegin();
+            it != m_collectionAuthenticationKeys.constEnd(); ++it) {
+        keyBytes += it.value().allocatedSize();
+    }
+    for (QMap<QString, Sailfish::Secrets::Daemon::SecureByteArray>::const_iterator it = m_standaloneSecretAuthenticationKeys.constBegin();
+            it != m_standaloneSecretAuthenticationKeys.constEnd(); ++it) {
+        keyBytes += it.value().allocatedSize();
+    }
+    usage->insert(QStringLiteral("authenticationKeys"), keyBytes);
+    usage->insert(QStringLiteral("secretCache"), m_secretCache.size());
+}
 
-            // perform UI request to get the authentication key for the collection
-            Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
-                        callerPid,
-                        requestId,
-                        callerApplicationId,
-                        collectionName,
-                        secretName,
-                        uiServiceAddress);
-            if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
-                return authenticationResult;
-            }
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::releaseMemory()
+{
+    m_secretCache.clear();
+}
 
-            m_pendingRequests.insert(requestId,
-                                     Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
-                                         callerPid,
-                                         requestId,
-                                         Sailfish::Secrets::Daemon::ApiImpl::DeleteCollectionSecretRequest,
-                                         QVariantList() << collectionName
-                                                        << secretName
-                                                        << userInteractionMode
-                                                        << uiServiceAddress));
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+int
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::performMaintenance(int pageBudget)
+{
+    int pages = 0;
+    bool busy = false;
+    // plugins which haven't been loaded yet have nothing to maintain.
+    Q_FOREACH (Sailfish::Secrets::StoragePlugin *plugin, m_storagePlugins.loaded()) {
+        if (pages >= pageBudget) {
+            break;
+        }
+        const int pluginPages = plugin->performMaintenance(pageBudget - pages);
+        if (pluginPages < 0) {
+            busy = true;
         } else {
-            return deleteCollectionSecretWithAuthenticationKey(
-                        callerPid,
-                        requestId,
-                        collectionName,
-                        secretName,
-                        userInteractionMode,
-                        uiServiceAddress,
-                        QByteArray());
+            pages += pluginPages;
         }
-    } else {
-        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
-            if (collectionUsesDeviceLockKey) {
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
-                                                 QStringLiteral("Collection %1 is locked and requires device lock authentication"));
-            } else {
-                if (userInteractionMode == Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {
-                    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationRequiresUserInteraction,
-                                                     QString::fromLatin1("Authentication plugin %1 requires user interaction").arg(collectionAuthenticationPluginName));
-                }
+    }
+    return busy ? -1 : pages;
+}
 
-                // perform UI request to get the authentication key for the collection
-                Sailfish::Secrets::Result authenticationResult = m_authenticationPlugins[collectionAuthenticationPluginName]->beginAuthentication(
-                            callerPid,
-                            requestId,
-                            callerApplicationId,
-                            collectionName,
-                            secretName,
-                            uiServiceAddress);
-                if (authenticationResult.code() == Sailfish::Secrets::Result::Failed) {
-                    return authenticationResult;
-                }
+bool
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::customLockKeysHeld() const
+{
+    // device lock collections hold their data key, rather than the device lock key.
+    for (QMap<QString, Sailfish::Secrets::Daemon::SecureByteArray>::const_iterator it = m_collectionAuthenticationKeys.constBegin();
+            it != m_collectionAuthenticationKeys.constEnd(); it++) {
+        QHash<QString, CollectionMetadata>::const_iterator metadata = m_collectionMetadata.constFind(it.key());
+        if (it.value().rawData() != m_deviceLockKey.rawData()
+                && (metadata == m_collectionMetadata.constEnd() || !metadata->usesDeviceLockKey)) {
+            return true;
+        }
+    }
+    Q_FOREACH (const Sailfish::Secrets::Daemon::SecureByteArray &key, m_standaloneSecretAuthenticationKeys) {
+        if (key.rawData() != m_deviceLockKey.rawData()) {
+            return true;
+        }
+    }
+    return false;
+}
 
-                m_pendingRequests.insert(requestId,
-                                         Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest(
-                                             callerPid,
-                                             requestId,
-                                             Sailfish::Secrets::Daemon::ApiImpl::DeleteCollectionSecretRequest,
-                                             QVariantList() << collectionName
-                                                            << secretName
-                                                            << userInteractionMode
-                                                            << uiServiceAddress));
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Pending);
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::authenticationCompleted(
+        uint callerPid,
+        qint64 requestId,
+        const QString &callerApplicationId,
+        const QString &collectionName,
+        const QString &secretName,
+        const QString &uiServiceAddress,
+        const Sailfish::Secrets::Result &result,
+        const QByteArray &authenticationKey)
+{
+    // may be needed in the future for "multiple-step" flows.
+    Q_UNUSED(callerPid);
+    Q_UNUSED(callerApplicationId);
+    Q_UNUSED(secretName);
+    Q_UNUSED(uiServiceAddress);
+
+    QByteArray secret;
+    QMap<QString, QByteArray> secrets;
+    const Sailfish::Secrets::Daemon::ApiImpl::RequestType requestType = m_pendingRequests.value(requestId).requestType;
+    Sailfish::Secrets::Result returnResult = result;
+    if (result.code() == Sailfish::Secrets::Result::Succeeded
+            && requestType != CreateCustomLockCollectionRequest
+            && !collectionName.isEmpty()
+            && !m_collectionAuthenticationKeys.contains(collectionName)) {
+        // unwrapping the collection's data key verifies the entered key, before the request writes anything.
+        QByteArray dataKey;
+        returnResult = collectionDataKey(collectionName, authenticationKey, &dataKey);
+        Sailfish::Secrets::Daemon::wipe(&dataKey);
+        if (returnResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            m_pendingRequests.remove(requestId);
+        }
+    }
+    if (returnResult.code() == Sailfish::Secrets::Result::Succeeded) {
+        // look up the pending request in our list
+        if (m_pendingRequests.contains(requestId)) {
+            // call the appropriate method to complete the request
+            Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest pr = m_pendingRequests.take(requestId);
+            switch (pr.requestType) {
+                case CreateCustomLockCollectionRequest: {
+                    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CreateCustomLockCollectionContinuation *continuation
+                            = static_cast<const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CreateCustomLockCollectionContinuation*>(pr.continuation.data());
+                    returnResult = createCustomLockCollectionWithAuthenticationKey(
+                                pr.callerPid,
+                                pr.requestId,
+                                continuation->collectionName,
+                                continuation->storagePluginName,
+                                continuation->encryptionPluginName,
+                                continuation->authenticationPluginName,
+                                continuation->unlockSemantic,
+                                continuation->customLockTimeoutMs,
+                                continuation->accessControlMode,
+                                continuation->userInteractionMode,
+                                continuation->uiServiceAddress,
+                                continuation->durability,
+                                authenticationKey);
+                    break;
+                }
+                case SetCollectionSecretRequest: {
+                    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretContinuation *continuation
+                            = static_cast<const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretContinuation*>(pr.continuation.data());
+                    returnResult = setCollectionSecretWithAuthenticationKey(
+                                pr.callerPid,
+                                pr.requestId,
+                                continuation->collectionName,
+                                continuation->secretName,
+                                continuation->secret,
+                                continuation->userInteractionMode,
+                                continuation->uiServiceAddress,
+                                continuation->collectionUsesDeviceLockKey,
+                                continuation->collectionApplicationId,
+                                continuation->collectionStoragePluginName,
+                                continuation->collectionEncryptionPluginName,
+                                continuation->collectionAuthenticationPluginName,
+                                continuation->collectionUnlockSemantic,
+                                continuation->collectionCustomLockTimeoutMs,
+                                continuation->collectionAccessControlMode,
+                                authenticationKey);
+                    break;
+                }
+                case SetCollectionSecretsRequest: {
+                    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretsContinuation *continuation
+                            = static_cast<const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetCollectionSecretsContinuation*>(pr.continuation.data());
+                    returnResult = setCollectionSecretsWithAuthenticationKey(
+                                pr.callerPid,
+                                pr.requestId,
+                                continuation->collectionName,
+                                continuation->secrets,
+                                continuation->userInteractionMode,
+                                continuation->uiServiceAddress,
+                                continuation->collectionUsesDeviceLockKey,
+                                continuation->collectionApplicationId,
+                                continuation->collectionStoragePluginName,
+                                continuation->collectionEncryptionPluginName,
+                                continuation->collectionAuthenticationPluginName,
+                                continuation->collectionUnlockSemantic,
+                                continuation->collectionCustomLockTimeoutMs,
+                                continuation->collectionAccessControlMode,
+                                authenticationKey);
+                    break;
+                }
+                case SetStandaloneCustomLockSecretRequest: {
+                    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetStandaloneCustomLockSecretContinuation *continuation
+                            = static_cast<const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::SetStandaloneCustomLockSecretContinuation*>(pr.continuation.data());
+                    returnResult = setStandaloneCustomLockSecretWithAuthenticationKey(
+                                pr.callerPid,
+                                pr.requestId,
+                                continuation->storagePluginName,
+                                continuation->encryptionPluginName,
+                                continuation->authenticationPluginName,
+                                continuation->secretName,
+                                continuation->secret,
+                                continuation->unlockSemantic,
+                                continuation->customLockTimeoutMs,
+                                continuation->accessControlMode,
+                                continuation->userInteractionMode,
+                                continuation->uiServiceAddress,
+                                authenticationKey);
+                    break;
+                }
+                case GetCollectionSecretRequest: {
+                    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretContinuation *continuation
+                            = static_cast<const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretContinuation*>(pr.continuation.data());
+                    returnResult = getCollectionSecretWithAuthenticationKey(
+                                pr.callerPid,
+                                pr.requestId,
+                                continuation->collectionName,
+                                continuation->secretName,
+                                continuation->userInteractionMode,
+                                continuation->uiServiceAddress,
+                                continuation->storagePluginName,
+                                continuation->encryptionPluginName,
+                                continuation->collectionUnlockSemantic,
+                                continuation->collectionCustomLockTimeoutMs,
+                                authenticationKey,
+                                &secret);
+                    break;
+                }
+                case GetCollectionSecretsRequest: {
+                    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretsContinuation *continuation
+                            = static_cast<const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetCollectionSecretsContinuation*>(pr.continuation.data());
+                    returnResult = getCollectionSecretsWithAuthenticationKey(
+                                pr.callerPid,
+                                pr.requestId,
+                                continuation->collectionName,
+                                continuation->secretNames,
+                                continuation->userInteractionMode,
+                                continuation->uiServiceAddress,
+                                continuation->storagePluginName,
+                                continuation->encryptionPluginName,
+                                continuation->collectionUnlockSemantic,
+                                continuation->collectionCustomLockTimeoutMs,
+                                authenticationKey,
+                                &secrets);
+                    break;
+                }
+                case GetStandaloneSecretRequest: {
+                    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetStandaloneSecretContinuation *continuation
+                            = static_cast<const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::GetStandaloneSecretContinuation*>(pr.continuation.data());
+                    returnResult = getStandaloneSecretWithAuthenticationKey(
+                                pr.callerPid,
+                                pr.requestId,
+                                continuation->secretName,
+                                continuation->userInteractionMode,
+                                continuation->uiServiceAddress,
+                                continuation->storagePluginName,
+                                continuation->encryptionPluginName,
+                                continuation->lockSemantic,
+                                continuation->customLockTimeoutMs,
+                                authenticationKey,
+                                &secret);
+                    break;
+                }
+                case DeleteCollectionSecretRequest: {
+                    const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::DeleteCollectionSecretContinuation *continuation
+                            = static_cast<const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::DeleteCollectionSecretContinuation*>(pr.continuation.data());
+                    returnResult = deleteCollectionSecretWithAuthenticationKey(
+                                pr.callerPid,
+                                pr.requestId,
+                                continuation->collectionName,
+                                continuation->secretName,
+                                continuation->userInteractionMode,
+                                continuation->uiServiceAddress,
+                                authenticationKey);
+                    break;
+                }
+                default: {
+                    returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                             QLatin1String("Internal error: unknown continuation for asynchronous request!"));
+                    break;
+                }
             }
         } else {
-            return deleteCollectionSecretWithAuthenticationKey(
-                        callerPid,
-                        requestId,
-                        collectionName,
-                        secretName,
-                        userInteractionMode,
-                        uiServiceAddress,
-                        m_collectionAuthenticationKeys.value(collectionName));
+            returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                                     QLatin1String("Internal error: failed to finish unknown pending request!"));
         }
     }
+
+    if (returnResult.code() == Sailfish::Secrets::Result::Pending) {
+        // the request is finished once its plugin operation completes.
+        return;
+    }
+
+    // finish the request.
+    QList<QVariant> outParams;
+    outParams << QVariant::fromValue<Sailfish::Secrets::Result>(returnResult);
+    if (requestType == GetCollectionSecretsRequest) {
+        outParams << QVariant::fromValue<QMap<QString, QByteArray> >(secrets);
+    } else {
+        outParams << QVariant::fromValue<QByteArray>(secret);
+    }
+    m_requestQueue->requestFinished(requestId, outParams);
 }
 
 Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollectionSecretWithAuthenticationKey(
-        pid_t callerPid,
-        quint64 requestId,
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::collectionMetadata(
         const QString &collectionName,
-        const QString &secretName,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-        const QString &uiServiceAddress,
-        const QByteArray &authenticationKey)
+        Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata *metadata,
+        bool *found)
 {
-    // may be needed for access control requests in the future.
-    Q_UNUSED(requestId);
-    Q_UNUSED(userInteractionMode);
-    Q_UNUSED(uiServiceAddress);
-
-    // TODO: perform access control request to see if the application has permission to write secure storage data.
-    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
-    const QString callerApplicationId = applicationIsPlatformApplication
-                ? m_appPermissions->platformApplicationId()
-                : m_appPermissions->applicationId(callerPid);
+    QHash<QString, CollectionMetadata>::const_iterator it = m_collectionMetadata.constFind(collectionName);
+    if (it != m_collectionMetadata.constEnd()) {
+        *metadata = it.value();
+        *found = true;
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
 
-    // check again in case it was deleted or modified while the
-    // asynchronous authentication key request was in progress.
     const QString selectCollectionsQuery = QStringLiteral(
                  "SELECT"
                     " ApplicationId,"
@@ -2681,7 +5220,12 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollectionSecretWith
                     " StoragePluginName,"
                     " EncryptionPluginName,"
                     " AuthenticationPluginName,"
-                    " AccessControlMode"
+                    " UnlockSemantic,"
+                    " CustomLockTimeoutMs,"
+                    " AccessControlMode,"
+                    " PrefetchOnUnlock,"
+                    " EncryptionAlgorithm,"
+                    " WrappedDataKey"
                   " FROM Collections"
                   " WHERE CollectionName = ?;"
              );
@@ -2702,489 +5246,730 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteCollectionSecretWith
                                          QString::fromLatin1("Unable to execute select collections query: %1").arg(errorText));
     }
 
-    bool found = false;
-    QString collectionApplicationId;
-    bool collectionUsesDeviceLockKey = false;
-    QString collectionStoragePluginName;
-    QString collectionEncryptionPluginName;
-    QString collectionAuthenticationPluginName;
-    Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
+    *found = false;
     if (sq.next()) {
-        found = true;
-        collectionApplicationId = sq.value(0).value<QString>();
-        collectionUsesDeviceLockKey = sq.value(1).value<int>() > 0;
-        collectionStoragePluginName = sq.value(2).value<QString>();
-        collectionEncryptionPluginName = sq.value(3).value<QString>();
-        collectionAuthenticationPluginName = sq.value(4).value<QString>();
-        collectionAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(sq.value(5).value<int>());
+        *found = true;
+        metadata->applicationId = sq.value(0).value<QString>();
+        metadata->usesDeviceLockKey = sq.value(1).value<int>() > 0;
+        metadata->storagePluginName = sq.value(2).value<QString>();
+        metadata->encryptionPluginName = sq.value(3).value<QString>();
+        metadata->authenticationPluginName = sq.value(4).value<QString>();
+        metadata->unlockSemantic = sq.value(5).value<int>();
+        metadata->customLockTimeoutMs = sq.value(6).value<int>();
+        metadata->accessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(sq.value(7).value<int>());
+        metadata->prefetchOnUnlock = sq.value(8).value<int>() > 0;
+        metadata->encryptionAlgorithm = sq.value(9).value<int>();
+        metadata->wrappedDataKey = sq.value(10).value<QByteArray>();
+        m_collectionMetadata.insert(collectionName, *metadata);
     }
 
-    if (!found) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
-                                         QLatin1String("Nonexistent collection name given"));
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// Unlocks the collection with the given lock key.  If its data key can't be
+// unwrapped the collection stays locked, and the result says why.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::setCollectionAuthenticationKey(
+        const QString &collectionName,
+        const QByteArray &authenticationKey)
+{
+    if (m_collectionAuthenticationKeys.contains(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
     }
 
-    if (collectionUsesDeviceLockKey && authenticationKey != DeviceLockKey) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
-                                         QLatin1String("Incorrect device lock key provided"));
+    // the collection's secrets are encrypted with its data key, if it has one.
+    QByteArray dataKey;
+    Sailfish::Secrets::Result result = collectionDataKey(collectionName, authenticationKey, &dataKey);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to unlock collection:" << collectionName << result.errorMessage();
+        return result;
+    }
+    const QByteArray &key(dataKey.isEmpty() ? authenticationKey : dataKey);
+    const Sailfish::Secrets::Daemon::SecureByteArray secureKey(key);
+    const bool allocated = secureKey.size() == key.size();
+    Sailfish::Secrets::Daemon::wipe(&dataKey);
+    if (!allocated) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QStringLiteral("Unable to allocate secure memory to unlock collection %1").arg(collectionName));
     }
+    m_collectionAuthenticationKeys.insert(collectionName, secureKey);
 
-    if (collectionAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
-        // TODO: perform access control request, to ask for permission to set the secret in the collection.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("Access control requests are not currently supported. TODO!"));
-    } else if (collectionApplicationId != callerApplicationId) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
-                                         QString::fromLatin1("Collection %1 is owned by a different application").arg(collectionName));
+    m_requestQueue->notifyCollectionLockStateChanged(collectionName, false);
+    reencryptCollectionIfRequired(collectionName);
+    prefetchCollection(collectionName);
+    return result;
+}
+
+// Unwraps the data key of the collection with the given lock key.  The data key
+// is empty if the collection has none, i.e. its secrets are encrypted with the
+// lock key itself, or it is stored by an encrypted storage plugin.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::collectionDataKey(
+        const QString &collectionName,
+        const QByteArray &lockKey,
+        QByteArray *dataKey)
+{
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result result = collectionMetadata(collectionName, &metadata, &found);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded || !found || metadata.wrappedDataKey.isEmpty()) {
+        return result;
+    } else if (!m_encryptionPlugins.contains(metadata.encryptionPluginName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(metadata.encryptionPluginName));
     }
 
-    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
-    Sailfish::Secrets::Result pluginResult;
-    if (collectionStoragePluginName == collectionEncryptionPluginName) {
-        bool locked = false;
-        pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
-        if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
-            return pluginResult;
-        }
-        // if it's locked, attempt to unlock it
-        if (locked) {
-            pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, authenticationKey);
-            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
-                // unable to apply the new authenticationKey.
-                m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
-                                                 QString::fromLatin1("Unable to decrypt collection %1 with the entered authentication key").arg(collectionName));
+    result = m_encryptionPlugins[metadata.encryptionPluginName]->decryptSecret(metadata.wrappedDataKey, lockKey, dataKey);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded || dataKey->size() != DataKeySize) {
+        Sailfish::Secrets::Daemon::wipe(dataKey);
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                         QString::fromLatin1("The authentication key entered for collection %1 was incorrect").arg(collectionName));
+    }
+    return result;
+}
 
-            }
-            pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->isLocked(collectionName, &locked);
-            if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
-                m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
-                return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
-                                                 QString::fromLatin1("Unable to check lock state of collection %1 after setting the entered authentication key").arg(collectionName));
+// Rewraps the data keys of the device lock collections with a new device lock
+// key, in a single transaction.  Their secrets needn't be re-encrypted, so this
+// costs the same however many secrets they hold.  Device lock collections which
+// predate data keys, and those stored by encrypted storage plugins, aren't
+// affected, and must be re-encrypted by their plugins.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::rewrapDeviceLockDataKeys(
+        const QByteArray &oldKey,
+        const QByteArray &newKey,
+        QStringList *rewrappedCollectionNames)
+{
+    rewrappedCollectionNames->clear();
 
-            }
-        }
-        if (locked) {
-            // still locked, even after applying the new authenticationKey?  The authenticationKey was wrong.
-            m_encryptedStoragePlugins[collectionStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
-                                             QString::fromLatin1("The authentication key entered for collection %1 was incorrect").arg(collectionName));
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, QString(), Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
+    DatabaseLocker locker(m_db);
+
+    const QString selectDataKeysQuery = QStringLiteral(
+                 "SELECT"
+                    " CollectionName,"
+                    " EncryptionPluginName,"
+                    " WrappedDataKey"
+                  " FROM Collections"
+                  " WHERE UsesDeviceLockKey = 1"
+                  " AND WrappedDataKey IS NOT NULL;"
+             );
+    const QString updateDataKeyQuery = QStringLiteral(
+                "UPDATE Collections"
+                " SET WrappedDataKey = ?"
+                " WHERE CollectionName = ?;");
+
+    QString errorText;
+    Database::Query sq = m_db->prepare(selectDataKeysQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare select data keys query: %1").arg(errorText));
+    }
+    if (!m_db->execute(sq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute select data keys query: %1").arg(errorText));
+    }
+
+    QVariantList wrappedDataKeys;
+    QVariantList collectionNames;
+    Sailfish::Secrets::Result result(Sailfish::Secrets::Result::Succeeded);
+    while (result.code() == Sailfish::Secrets::Result::Succeeded && sq.next()) {
+        const QString collectionName = sq.value(0).value<QString>();
+        const QString encryptionPluginName = sq.value(1).value<QString>();
+        if (!m_encryptionPlugins.contains(encryptionPluginName)) {
+            result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
+                                               QString::fromLatin1("No such encryption plugin exists: %1").arg(encryptionPluginName));
+            break;
         }
-        // successfully unlocked the encrypted storage collection.  remove the secret.
-        pluginResult = m_encryptedStoragePlugins[collectionStoragePluginName]->removeSecret(collectionName, hashedSecretName);
-    } else {
-        if (!m_collectionAuthenticationKeys.contains(collectionName)) {
-            // TODO: some way to "test" the authenticationKey!  also, if it's a custom lock, set the timeout, etc.
-            m_collectionAuthenticationKeys.insert(collectionName, authenticationKey);
+        Sailfish::Secrets::EncryptionPlugin *encryptionPlugin = m_encryptionPlugins[encryptionPluginName];
+        QByteArray dataKey;
+        QByteArray wrappedDataKey;
+        result = encryptionPlugin->decryptSecret(sq.value(2).value<QByteArray>(), oldKey, &dataKey);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = encryptionPlugin->encryptSecret(dataKey, newKey, &wrappedDataKey);
         }
+        Sailfish::Secrets::Daemon::wipe(&dataKey);
+        wrappedDataKeys.append(QVariant::fromValue<QByteArray>(wrappedDataKey));
+        collectionNames.append(QVariant::fromValue<QString>(collectionName));
+    }
+    if (result.code() != Sailfish::Secrets::Result::Succeeded || collectionNames.isEmpty()) {
+        return result;
+    }
 
-        pluginResult = m_storagePlugins[collectionStoragePluginName]->removeSecret(collectionName, hashedSecretName);
+    Database::Query uq = m_db->prepare(updateDataKeyQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to prepare update data key query: %1").arg(errorText));
     }
 
-    // now remove from the master database.
-    if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-        const QString deleteSecretQuery = QStringLiteral(
-                    "DELETE FROM Secrets"
-                    " WHERE CollectionName = ?"
-                    " AND SecretName = ?;");
+    QVariantList values;
+    values << QVariant(wrappedDataKeys);
+    values << QVariant(collectionNames);
+    uq.bindValues(values);
 
-        Database::Query dq = m_db->prepare(deleteSecretQuery, &errorText);
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Unable to begin update data keys transaction"));
+    }
+
+    if (!m_db->executeBatch(uq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromLatin1("Unable to execute update data keys query: %1").arg(errorText));
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Unable to commit update data keys transaction"));
+    }
+
+    Q_FOREACH (const QVariant &collectionName, collectionNames) {
+        m_collectionMetadata.remove(collectionName.toString());
+        rewrappedCollectionNames->append(collectionName.toString());
+    }
+    return result;
+}
+
+// Changes the device lock key, rewrapping the data keys of the device lock
+// collections with the new key.  Until the daemon is integrated with the
+// device lock the key is only held in memory, so it may only be changed in
+// autotest mode.  Device lock data which is encrypted with the key itself
+// (standalone secrets, and collections which have no data key) would have to
+// be re-encrypted, which isn't supported, so the key isn't changed if any exists.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::modifyDeviceLockKey(
+        pid_t callerPid,
+        quint64 requestId,
+        const QByteArray &oldDeviceLockKey,
+        const QByteArray &newDeviceLockKey)
+{
+    // may be required in the future for access control requests.
+    Q_UNUSED(callerPid);
+    Q_UNUSED(requestId);
+
+    if (!m_autotestMode) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("The device lock key can only be modified in autotest mode"));
+    } else if (oldDeviceLockKey != m_deviceLockKey.rawData()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                         QLatin1String("The device lock key entered was incorrect"));
+    } else if (newDeviceLockKey.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                         QLatin1String("Empty device lock key given"));
+    }
+
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, QString(), Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
+
+    {
+        DatabaseLocker locker(m_db);
+
+        const QString selectUnwrappedQuery = QStringLiteral(
+                     "SELECT"
+                        " (SELECT COUNT(*) FROM Collections"
+                          " WHERE UsesDeviceLockKey = 1"
+                          " AND WrappedDataKey IS NULL)"
+                        " + (SELECT COUNT(*) FROM Secrets"
+                          " WHERE CollectionName = ?"
+                          " AND UsesDeviceLockKey = 1);"
+                 );
+
+        QString errorText;
+        Database::Query sq = m_db->prepare(selectUnwrappedQuery, &errorText);
         if (!errorText.isEmpty()) {
-            // TODO: add a "dirty" flag for this collection somewhere in memory, so we can try again later.
             return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                             QString::fromLatin1("Unable to prepare delete secret query: %1")
-                                             .arg(errorText));
+                                             QString::fromLatin1("Unable to prepare select device lock data query: %1").arg(errorText));
         }
 
         QVariantList values;
-        values << QVariant::fromValue<QString>(collectionName);
-        values << QVariant::fromValue<QString>(hashedSecretName);
-        dq.bindValues(values);
+        values << QVariant::fromValue<QString>(QStringLiteral("standalone"));
+        sq.bindValues(values);
 
-        if (!m_db->beginTransaction()) {
-            // TODO: add a "dirty" flag for this collection somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                             QLatin1String("Unable to begin delete secret transaction"));
+        if (!m_db->execute(sq, &errorText)) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromLatin1("Unable to execute select device lock data query: %1").arg(errorText));
+        }
+
+        if (sq.next() && sq.value(0).value<int>() > 0) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                             QLatin1String("Device lock data without a data key cannot be re-encrypted"));
+        }
+    }
+
+    const Sailfish::Secrets::Daemon::SecureByteArray secureDeviceLockKey(newDeviceLockKey);
+    if (secureDeviceLockKey.size() != newDeviceLockKey.size()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QLatin1String("Unable to allocate secure memory for the device lock key"));
+    }
+
+    QStringList rewrappedCollectionNames;
+    Sailfish::Secrets::Result result = rewrapDeviceLockDataKeys(oldDeviceLockKey, newDeviceLockKey, &rewrappedCollectionNames);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    }
+    m_deviceLockKey = secureDeviceLockKey;
+
+    // unlocked collections are unlocked again with the new key, so that
+    // their data keys are known to be unwrapped by it.  Any which can't be
+    // are left locked, and the failure is reported to the caller.
+    DatabaseLocker locker(m_db);
+    Q_FOREACH (const QString &collectionName, rewrappedCollectionNames) {
+        if (m_collectionAuthenticationKeys.contains(collectionName)) {
+            removeCollectionAuthenticationKey(collectionName);
+            const Sailfish::Secrets::Result unlockResult = setCollectionAuthenticationKey(collectionName, m_deviceLockKey.rawData());
+            if (unlockResult.code() != Sailfish::Secrets::Result::Succeeded) {
+                result = unlockResult;
+            }
+        }
+    }
+
+    return result;
+}
+
+// the algorithm used by whichever plugin will encrypt the secrets in a new collection.
+int Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::encryptionAlgorithm(
+        const QString &storagePluginName,
+        const QString &encryptionPluginName) const
+{
+    if (storagePluginName == encryptionPluginName) {
+        Sailfish::Secrets::EncryptedStoragePlugin *plugin = m_encryptedStoragePlugins.value(storagePluginName);
+        return plugin ? static_cast<int>(plugin->encryptionAlgorithm()) : 0;
+    }
+    Sailfish::Secrets::EncryptionPlugin *plugin = m_encryptionPlugins.value(encryptionPluginName);
+    return plugin ? static_cast<int>(plugin->encryptionAlgorithm()) : 0;
+}
+
+// encrypted storage plugins always store collections with full durability,
+// and in-memory storage plugins never store them durably at all.
+Sailfish::Secrets::StoragePlugin::Durability
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::collectionDurability(
+        const QString &storagePluginName,
+        const QString &encryptionPluginName,
+        Sailfish::Secrets::StoragePlugin::Durability requestedDurability) const
+{
+    if (storagePluginName == encryptionPluginName) {
+        return Sailfish::Secrets::StoragePlugin::FullDurability;
+    }
+    const Sailfish::Secrets::StoragePlugin *plugin = m_storagePlugins.value(storagePluginName);
+    return plugin && plugin->storageType() == Sailfish::Secrets::StoragePlugin::InMemoryStorage
+            ? Sailfish::Secrets::StoragePlugin::InMemoryDurability
+            : requestedDurability;
+}
+
+// The storage plugins do not retain in-memory collections across restarts,
+// so remove the master table entries for any which were left behind.
+void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::removeInMemoryCollections()
+{
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, QString(), Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
+    DatabaseLocker locker(m_db);
+
+    const QString deleteSecretsQuery = QStringLiteral(
+                "DELETE FROM Secrets"
+                " WHERE CollectionName IN ("
+                  "SELECT CollectionName FROM Collections WHERE Durability = ?"
+                ");");
+    const QString deleteCollectionsQuery = QStringLiteral(
+                "DELETE FROM Collections"
+                " WHERE Durability = ?;");
+
+    QString errorText;
+    Database::Query dsq = m_db->prepare(deleteSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to prepare delete in-memory secrets query:" << errorText;
+        return;
+    }
+    Database::Query dcq = m_db->prepare(deleteCollectionsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to prepare delete in-memory collections query:" << errorText;
+        return;
+    }
+
+    // standalone secrets stored by in-memory storage plugins are lost too.
+    const QString deleteStandaloneSecretsQuery = QStringLiteral(
+                "DELETE FROM Secrets"
+                " WHERE CollectionName = 'standalone'"
+                " AND StoragePluginName = ?;");
+    Database::Query dssq = m_db->prepare(deleteStandaloneSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to prepare delete in-memory standalone secrets query:" << errorText;
+        return;
+    }
+
+    QVariantList values;
+    values << static_cast<int>(Sailfish::Secrets::StoragePlugin::InMemoryDurability);
+    dsq.bindValues(values);
+    dcq.bindValues(values);
+
+    QVariantList inMemoryPluginNames;
+    Q_FOREACH (const QString &pluginName, m_storagePlugins.keys()) {
+        if (storagePluginInfo(pluginName, m_storagePlugins.info(pluginName)).storageType() == Sailfish::Secrets::StoragePlugin::InMemoryStorage) {
+            inMemoryPluginNames.append(QVariant::fromValue<QString>(pluginName));
         }
+    }
+    dssq.addBindValue(inMemoryPluginNames);
+
+    if (!m_db->beginTransaction()) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to begin delete in-memory collections transaction";
+        return;
+    }
+
+    if (!m_db->execute(dsq, &errorText) || !m_db->execute(dcq, &errorText)
+            || (!inMemoryPluginNames.isEmpty() && !m_db->executeBatch(dssq, &errorText))) {
+        m_db->rollbackTransaction();
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to delete in-memory collections:" << errorText;
+        return;
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to commit delete in-memory collections transaction";
+        return;
+    }
+
+    m_collectionMetadata.clear();
+}
+
+void
+Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::reencryptionProgress(
+        const QString &collectionName,
+        int reencryptedCount,
+        int totalCount)
+{
+    qCDebug(lcSailfishSecretsDaemon) << "Re-encrypted" << reencryptedCount << "of" << totalCount
+                                     << "secrets in collection:" << collectionName;
+}
+
+// A collection whose secrets were written using an older algorithm of its
+// encryption plugin (e.g. AES-256-CBC rather than AES-256-GCM) is
+// re-encrypted in place the first time it is unlocked with the newer plugin.
+void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::reencryptCollectionIfRequired(
+        const QString &collectionName)
+{
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::WriteLock);
+    DatabaseLocker locker(m_db);
+
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded || !found
+            || metadata.storagePluginName == metadata.encryptionPluginName
+            || !m_storagePlugins.contains(metadata.storagePluginName)
+            || !m_encryptionPlugins.contains(metadata.encryptionPluginName)) {
+        return;
+    }
+
+    Sailfish::Secrets::EncryptionPlugin *encryptionPlugin = m_encryptionPlugins.value(metadata.encryptionPluginName);
+    const int currentAlgorithm = static_cast<int>(encryptionPlugin->encryptionAlgorithm());
+    if (metadata.encryptionAlgorithm == currentAlgorithm) {
+        return;
+    }
+
+    qCDebug(lcSailfishSecretsDaemon) << "Re-encrypting collection:" << collectionName
+                                     << "from algorithm" << metadata.encryptionAlgorithm << "to" << currentAlgorithm;
+    const Sailfish::Secrets::Daemon::SecureByteArray key = m_collectionAuthenticationKeys.value(collectionName);
+    // the plugin locks the database for each chunk of secrets it re-encrypts,
+    // so other requests may interleave with the re-encryption of a large collection.
+    locker.unlock();
+    Sailfish::Secrets::Result pluginResult = m_storagePlugins.value(metadata.storagePluginName)->reencryptSecrets(
+                collectionName, QVector<QString>(), key.rawData(), key.rawData(), encryptionPlugin);
+    locker.relock();
+    if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        // the secrets remain readable, so try again when the collection is next unlocked.
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to re-encrypt collection:" << collectionName << pluginResult.errorMessage();
+        return;
+    }
+
+    const QString updateCollectionQuery = QStringLiteral(
+                "UPDATE Collections"
+                " SET EncryptionAlgorithm = ?"
+                " WHERE CollectionName = ?;");
+
+    QString errorText;
+    Database::Query uq = m_db->prepare(updateCollectionQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to prepare update collection query:" << errorText;
+        return;
+    }
 
-        if (!m_db->execute(dq, &errorText)) {
-            m_db->rollbackTransaction();
-            // TODO: add a "dirty" flag for this collection somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                             QString::fromLatin1("Unable to execute delete secret query: %1")
-                                             .arg(errorText));
-        }
+    QVariantList values;
+    values << currentAlgorithm
+           << QVariant::fromValue<QString>(collectionName);
+    uq.bindValues(values);
 
-        if (!m_db->commitTransaction()) {
-            m_db->rollbackTransaction();
-            // TODO: add a "dirty" flag for this collection somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                             QLatin1String("Unable to commit delete secret transaction"));
-        }
+    if (!m_db->beginTransaction()) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to begin update collection transaction";
+        return;
     }
 
-    if (collectionAccessControlMode == Sailfish::Secrets::SecretManager::SystemAccessControlMode) {
-        // TODO: tell AccessControl daemon to remove this datum from its database.
+    if (!m_db->execute(uq, &errorText)) {
+        m_db->rollbackTransaction();
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to execute update collection query:" << errorText;
+        return;
     }
 
-    return pluginResult;
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to commit update collection transaction";
+        return;
+    }
+
+    m_collectionMetadata.remove(collectionName);
 }
 
-// delete a standalone secret
-Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::deleteStandaloneSecret(
-        pid_t callerPid,
-        quint64 requestId,
-        const QString &secretName,
-        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode)
+void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::prefetchCollection(
+        const QString &collectionName)
 {
-    // these may be required in the future for access control requests.
-    Q_UNUSED(requestId);
-    Q_UNUSED(userInteractionMode);
+    if (m_secretCache.capacity() == 0) {
+        return;
+    }
 
-    // TODO: perform access control request to see if the application has permission to write secure storage data.
-    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
-    const QString callerApplicationId = applicationIsPlatformApplication
-                ? m_appPermissions->platformApplicationId()
-                : m_appPermissions->applicationId(callerPid);
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::ReadLock);
+    DatabaseLocker locker(m_db);
 
-    // check again in case some other application added the secret while
-    // the asynchronous authentication plugin request was active.
-    const QString selectSecretsQuery = QStringLiteral(
-                "SELECT"
-                   " ApplicationId,"
-                   " UsesDeviceLockKey,"
-                   " StoragePluginName,"
-                   " EncryptionPluginName,"
-                   " AccessControlMode"
-                 " FROM Secrets"
-                 " WHERE CollectionName = ?"
-                 " AND SecretName = ?;"
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to read collection metadata:" << metadataResult.errorMessage();
+        return;
+    } else if (!found
+            || !metadata.prefetchOnUnlock
+            || metadata.unlockSemantic == Sailfish::Secrets::SecretManager::CustomLockAccessRelock
+            || metadata.storagePluginName == metadata.encryptionPluginName
+            || !m_storagePlugins.contains(metadata.storagePluginName)
+            || !m_encryptionPlugins.contains(metadata.encryptionPluginName)) {
+        return;
+    }
+
+    const QString selectSecretNamesQuery = QStringLiteral(
+                 "SELECT"
+                    " SecretName"
+                  " FROM Secrets"
+                  " WHERE CollectionName = ?;"
              );
 
     QString errorText;
-    Database::Query ssq = m_db->prepare(selectSecretsQuery, &errorText);
+    Database::Query sq = m_db->prepare(selectSecretNamesQuery, &errorText);
     if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to prepare select secrets query: %1").arg(errorText));
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to prepare select secret names query:" << errorText;
+        return;
     }
 
-    const QString collectionName = QStringLiteral("standalone");
-    const QString hashedSecretName = generateHashedSecretName(collectionName, secretName);
     QVariantList values;
     values << QVariant::fromValue<QString>(collectionName);
-    values << QVariant::fromValue<QString>(hashedSecretName);
-    ssq.bindValues(values);
+    sq.bindValues(values);
 
-    if (!m_db->execute(ssq, &errorText)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromLatin1("Unable to execute select secrets query: %1").arg(errorText));
+    if (!m_db->execute(sq, &errorText)) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to execute select secret names query:" << errorText;
+        return;
     }
 
-    bool found = false;
-    QString secretApplicationId;
-    bool secretUsesDeviceLockKey = false;
-    QString secretStoragePluginName;
-    QString secretEncryptionPluginName;
-    Sailfish::Secrets::SecretManager::AccessControlMode secretAccessControlMode = Sailfish::Secrets::SecretManager::OwnerOnlyMode;
-    if (ssq.next()) {
-        found = true;
-        secretApplicationId = ssq.value(0).value<QString>();
-        secretUsesDeviceLockKey = ssq.value(1).value<int>() > 0;
-        secretStoragePluginName = ssq.value(2).value<QString>();
-        secretEncryptionPluginName = ssq.value(3).value<QString>();
-        secretAccessControlMode = static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(ssq.value(4).value<int>());
+    QStringList hashedSecretNames;
+    while (sq.next()) {
+        hashedSecretNames.append(sq.value(0).value<QString>());
+    }
+    if (hashedSecretNames.isEmpty()) {
+        return;
     }
 
-    if (!found) {
-        // the secret doesn't exist, return success.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    // read the whole collection from storage at once, and decrypt it in parallel.
+    cacheStoredSecrets(collectionName, metadata, hashedSecretNames, &locker);
+}
+
+// Reads the given secrets of an unlocked collection from storage in one batch,
+// decrypts them in parallel and caches them.  The caller must hold the collection
+// lock, and the database via the given locker, which is released before decrypting.
+int Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::cacheStoredSecrets(
+        const QString &collectionName,
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata &metadata,
+        const QStringList &hashedSecretNames,
+        DatabaseLocker *locker)
+{
+    QMap<QString, QByteArray> storedSecrets;
+    Sailfish::Secrets::Result pluginResult = m_storagePlugins[metadata.storagePluginName]->getSecrets(
+                collectionName, hashedSecretNames, &storedSecrets);
+    if (pluginResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to prefetch collection:" << collectionName << pluginResult.errorMessage();
+        return 0;
     }
 
-    if (secretAccessControlMode != Sailfish::Secrets::SecretManager::OwnerOnlyMode) {
-        // TODO: perform access control request, to ask for permission to set the secret in the collection.
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("Access control requests are not currently supported. TODO!"));
-    } else if (secretApplicationId != callerApplicationId) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::PermissionsError,
-                                         QString::fromLatin1("Secret %1 is owned by a different application").arg(secretName));
-    } else if (secretStoragePluginName == secretEncryptionPluginName && !m_encryptedStoragePlugins.contains(secretStoragePluginName)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encrypted storage plugin exists: %1").arg(secretStoragePluginName));
-    } else if (secretStoragePluginName != secretEncryptionPluginName && !m_storagePlugins.contains(secretStoragePluginName)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such storage plugin exists: %1").arg(secretStoragePluginName));
-    } else if (secretStoragePluginName != secretEncryptionPluginName && !m_encryptionPlugins.contains(secretEncryptionPluginName)) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidExtensionPluginError,
-                                         QString::fromLatin1("No such encryption plugin exists: %1").arg(secretEncryptionPluginName));
+    // the collection stays read-locked, so the database needn't be held while decrypting.
+    locker->unlock();
+
+    QVector<PrefetchedSecret> prefetched;
+    prefetched.reserve(storedSecrets.size());
+    for (QMap<QString, QByteArray>::const_iterator it = storedSecrets.constBegin(); it != storedSecrets.constEnd(); it++) {
+        PrefetchedSecret secret;
+        secret.hashedSecretName = it.key();
+        secret.encrypted = it.value();
+        prefetched.append(secret);
     }
 
-    Sailfish::Secrets::Result pluginResult;
-    if (secretStoragePluginName == secretEncryptionPluginName) {
-        bool locked = false;
-        pluginResult = m_encryptedStoragePlugins[secretStoragePluginName]->isLocked(collectionName, &locked);
-        if (pluginResult.code() == Sailfish::Secrets::Result::Failed) {
-            return pluginResult;
-        }
-        if (locked && secretUsesDeviceLockKey) {
-            pluginResult = m_encryptedStoragePlugins[secretStoragePluginName]->setEncryptionKey(collectionName, DeviceLockKey);
-            if (pluginResult.code() == Sailfish::Secrets::Result::Failed) {
-                return pluginResult;
-            }
-        }
-        pluginResult = m_encryptedStoragePlugins[secretStoragePluginName]->removeSecret(collectionName, hashedSecretName);
-        if (locked) {
-            // relock after delete-access.
-            m_encryptedStoragePlugins[secretStoragePluginName]->setEncryptionKey(collectionName, QByteArray());
-        }
-    } else {
-        pluginResult = m_storagePlugins[secretStoragePluginName]->removeSecret(collectionName, hashedSecretName);
-        if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-            m_standaloneSecretAuthenticationKeys.remove(hashedSecretName);
-            m_standaloneSecretLockTimers.remove(hashedSecretName);
+    QtConcurrent::blockingMap(prefetched, PrefetchDecryptor(m_encryptionPlugins[metadata.encryptionPluginName],
+                                                            m_collectionAuthenticationKeys.value(collectionName)));
+
+    int cachedCount = 0;
+    int chunkCount = 0;
+    qint64 totalSize = 0;
+    for (QVector<PrefetchedSecret>::iterator it = prefetched.begin(); it != prefetched.end(); it++) {
+        // chunked secrets are read when requested, rather than cached.
+        if (it->decrypted && !parseSecretChunkManifest(it->plaintext, &chunkCount, &totalSize)) {
+            m_secretCache.insert(collectionName, it->hashedSecretName, it->plaintext);
+            ++cachedCount;
         }
+        Sailfish::Secrets::Daemon::wipe(&it->plaintext);
     }
+    return cachedCount;
+}
 
-    // remove from master database also.
-    if (pluginResult.code() == Sailfish::Secrets::Result::Succeeded) {
-        const QString deleteSecretQuery = QStringLiteral(
-                    "DELETE FROM Secrets"
-                    " WHERE CollectionName = ?"
-                    " AND SecretName = ?;");
+int Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::preloadSecrets(
+        const Sailfish::Secrets::Daemon::ApiImpl::PreloadManifest &manifest)
+{
+    if (m_secretCache.capacity() == 0) {
+        return 0;
+    }
 
-        Database::Query dq = m_db->prepare(deleteSecretQuery, &errorText);
-        if (!errorText.isEmpty()) {
-            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                             QString::fromLatin1("Unable to prepare delete secret query: %1")
-                                             .arg(errorText));
+    int preloadedCount = 0;
+    Q_FOREACH (const QString &collectionName, manifest.collectionNames()) {
+        Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::ReadLock);
+        DatabaseLocker locker(m_db);
+
+        bool found = false;
+        Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+        Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+        if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+            qCWarning(lcSailfishSecretsDaemon) << "Unable to read collection metadata:" << metadataResult.errorMessage();
+            continue;
+        } else if (!found
+                || !metadata.usesDeviceLockKey
+                || metadata.storagePluginName == metadata.encryptionPluginName
+                || !m_storagePlugins.contains(metadata.storagePluginName)
+                || !m_encryptionPlugins.contains(metadata.encryptionPluginName)) {
+            // only device lock collections can be unlocked without the user.
+            qCDebug(lcSailfishSecretsDaemon) << "Not preloading secrets from collection:" << collectionName;
+            continue;
         }
 
-        QVariantList values;
-        values << QVariant::fromValue<QString>(collectionName);
-        values << QVariant::fromValue<QString>(hashedSecretName);
-        dq.bindValues(values);
+        // an application can only be given the secrets of collections it may read.
+        QStringList hashedSecretNames;
+        Q_FOREACH (const Sailfish::Secrets::Daemon::ApiImpl::PreloadManifest::Entry &entry, manifest.entries(collectionName)) {
+            if (metadata.accessControlMode == Sailfish::Secrets::SecretManager::OwnerOnlyMode
+                    && metadata.applicationId != entry.applicationId) {
+                qCWarning(lcSailfishSecretsDaemon) << "Not preloading secret" << entry.secretName
+                                                   << "for" << entry.applicationId
+                                                   << "from collection owned by another application:" << collectionName;
+                continue;
+            }
+            const QString hashedSecretName = generateHashedSecretName(collectionName, entry.secretName);
+            if (!hashedSecretNames.contains(hashedSecretName)) {
+                hashedSecretNames.append(hashedSecretName);
+            }
+        }
+        if (hashedSecretNames.isEmpty()) {
+            continue;
+        }
 
-        if (!m_db->beginTransaction()) {
-            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                             QString::fromLatin1("Unable to begin delete secret transaction"));
+        // unlocking the collection may already prefetch all of it.
+        if (!m_collectionAuthenticationKeys.contains(collectionName)
+                && setCollectionAuthenticationKey(collectionName, m_deviceLockKey.rawData()).code() != Sailfish::Secrets::Result::Succeeded) {
+            continue;
         }
 
-        if (!m_db->execute(dq, &errorText)) {
-            m_db->rollbackTransaction();
-            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                             QString::fromLatin1("Unable to execute delete secret query: %1")
-                                             .arg(errorText));
+        QByteArray cached;
+        QStringList uncachedSecretNames;
+        Q_FOREACH (const QString &hashedSecretName, hashedSecretNames) {
+            if (m_secretCache.lookup(collectionName, hashedSecretName, &cached)) {
+                Sailfish::Secrets::Daemon::wipe(&cached);
+                ++preloadedCount;
+            } else {
+                uncachedSecretNames.append(hashedSecretName);
+            }
         }
 
-        if (!m_db->commitTransaction()) {
-            m_db->rollbackTransaction();
-            // TODO: add a "dirty" flag for this secret somewhere in memory, so we can try again later.
-            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                             QString::fromLatin1("Unable to commit delete secret transaction"));
+        // secrets which don't exist (yet) are simply not returned by the plugin.
+        if (!uncachedSecretNames.isEmpty()) {
+            preloadedCount += cacheStoredSecrets(collectionName, metadata, uncachedSecretNames, &locker);
         }
     }
+    return preloadedCount;
+}
 
-    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::removeCollectionAuthenticationKey(
+        const QString &collectionName)
+{
+    m_secretCache.removeCollection(collectionName);
+    m_requestQueue->invalidateStoredKeys(collectionName);
+    if (m_collectionAuthenticationKeys.contains(collectionName)) {
+        releaseAuthenticationKey(m_collectionAuthenticationKeys.take(collectionName));
+        m_requestQueue->notifyCollectionLockStateChanged(collectionName, true);
+    }
 }
 
-void
-Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::authenticationCompleted(
-        uint callerPid,
-        qint64 requestId,
-        const QString &callerApplicationId,
-        const QString &collectionName,
-        const QString &secretName,
-        const QString &uiServiceAddress,
-        const Sailfish::Secrets::Result &result,
-        const QByteArray &authenticationKey)
+// let the encryption plugins discard anything derived from a key which is no longer in use.
+void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::releaseAuthenticationKey(
+        const Sailfish::Secrets::Daemon::SecureByteArray &authenticationKey)
 {
-    // may be needed in the future for "multiple-step" flows.
-    Q_UNUSED(callerPid);
-    Q_UNUSED(callerApplicationId);
-    Q_UNUSED(collectionName);
-    Q_UNUSED(secretName);
-    Q_UNUSED(uiServiceAddress);
+    if (authenticationKey.isEmpty()) {
+        return;
+    }
 
-    QByteArray secret;
-    Sailfish::Secrets::Result returnResult = result;
-    if (result.code() == Sailfish::Secrets::Result::Succeeded) {
-        // look up the pending request in our list
-        if (m_pendingRequests.contains(requestId)) {
-            // call the appropriate method to complete the request
-            Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest pr = m_pendingRequests.take(requestId);
-            switch (pr.requestType) {
-                case CreateCustomLockCollectionRequest: {
-                    if (pr.parameters.size() != 9) {
-                        returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
-                                                                 QLatin1String("Internal error: incorrect parameter count!"));
-                    } else {
-                        returnResult = createCustomLockCollectionWithAuthenticationKey(
-                                    pr.callerPid,
-                                    pr.requestId,
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic>(pr.parameters.takeFirst().value<int>()),
-                                    pr.parameters.takeFirst().value<int>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(pr.parameters.takeFirst().value<int>()),
-                                    static_cast<Sailfish::Secrets::SecretManager::UserInteractionMode>(pr.parameters.takeFirst().value<int>()),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    authenticationKey);
-                    }
-                    break;
-                }
-                case SetCollectionSecretRequest: {
-                    if (pr.parameters.size() != 13) {
-                        returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
-                                                                 QLatin1String("Internal error: incorrect parameter count!"));
-                    } else {
-                        returnResult = setCollectionSecretWithAuthenticationKey(
-                                    pr.callerPid,
-                                    pr.requestId,
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QByteArray>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::UserInteractionMode>(pr.parameters.takeFirst().value<int>()),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<bool>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<int>(),
-                                    pr.parameters.takeFirst().value<int>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(pr.parameters.takeFirst().value<int>()),
-                                    authenticationKey);
-                    }
-                    break;
-                }
-                case SetStandaloneCustomLockSecretRequest: {
-                    if (pr.parameters.size() != 10) {
-                        returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
-                                                                 QLatin1String("Internal error: incorrect parameter count!"));
-                    } else {
-                        returnResult = setStandaloneCustomLockSecretWithAuthenticationKey(
-                                    pr.callerPid,
-                                    pr.requestId,
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QByteArray>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic>(pr.parameters.takeFirst().value<int>()),
-                                    pr.parameters.takeFirst().value<int>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::AccessControlMode>(pr.parameters.takeFirst().value<int>()),
-                                    static_cast<Sailfish::Secrets::SecretManager::UserInteractionMode>(pr.parameters.takeFirst().value<int>()),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    authenticationKey);
-                    }
-                    break;
-                }
-                case GetCollectionSecretRequest: {
-                    if (pr.parameters.size() != 8) {
-                        returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
-                                                                 QLatin1String("Internal error: incorrect parameter count!"));
-                    } else {
-                        returnResult = getCollectionSecretWithAuthenticationKey(
-                                    pr.callerPid,
-                                    pr.requestId,
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::UserInteractionMode>(pr.parameters.takeFirst().value<int>()),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<int>(),
-                                    pr.parameters.takeFirst().value<int>(),
-                                    authenticationKey,
-                                    &secret);
-                    }
-                    break;
-                }
-                case GetStandaloneSecretRequest: {
-                    if (pr.parameters.size() != 7) {
-                        returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
-                                                                 QLatin1String("Internal error: incorrect parameter count!"));
-                    } else {
-                        returnResult = getStandaloneSecretWithAuthenticationKey(
-                                    pr.callerPid,
-                                    pr.requestId,
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::UserInteractionMode>(pr.parameters.takeFirst().value<int>()),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<int>(),
-                                    pr.parameters.takeFirst().value<int>(),
-                                    authenticationKey,
-                                    &secret);
-                    }
-                    break;
-                }
-                case DeleteCollectionSecretRequest: {
-                    if (pr.parameters.size() != 4) {
-                        returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
-                                                                 QLatin1String("Internal error: incorrect parameter count!"));
-                    } else {
-                        returnResult = deleteCollectionSecretWithAuthenticationKey(
-                                    pr.callerPid,
-                                    pr.requestId,
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    static_cast<Sailfish::Secrets::SecretManager::UserInteractionMode>(pr.parameters.takeFirst().value<int>()),
-                                    pr.parameters.takeFirst().value<QString>(),
-                                    authenticationKey);
-                    }
-                    break;
-                }
-                default: {
-                    returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
-                                                             QLatin1String("Internal error: unknown continuation for asynchronous request!"));
-                    break;
-                }
-            }
-        } else {
-            returnResult = Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
-                                                     QLatin1String("Internal error: failed to finish unknown pending request!"));
+    // the device lock key (for example) is shared by many collections.
+    const QByteArray key = authenticationKey.rawData();
+    Q_FOREACH (const Sailfish::Secrets::Daemon::SecureByteArray &other, m_collectionAuthenticationKeys) {
+        if (other.rawData() == key) {
+            return;
+        }
+    }
+    Q_FOREACH (const Sailfish::Secrets::Daemon::SecureByteArray &other, m_standaloneSecretAuthenticationKeys) {
+        if (other.rawData() == key) {
+            return;
         }
     }
 
-    // finish the request.
-    QList<QVariant> outParams;
-    outParams << QVariant::fromValue<Sailfish::Secrets::Result>(returnResult);
-    outParams << QVariant::fromValue<QByteArray>(secret);
-    m_requestQueue->requestFinished(requestId, outParams);
+    Q_FOREACH (Sailfish::Secrets::EncryptionPlugin *plugin, m_encryptionPlugins.loaded()) {
+        plugin->releaseKey(key);
+    }
 }
 
-void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::timeoutRelockCollection()
+bool Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::collectionNotificationPermitted(
+        pid_t callerPid,
+        const QString &collectionName)
 {
-    QTimer *timer = qobject_cast<QTimer*>(sender());
-    for (QMap<QString, QTimer*>::iterator it = m_collectionLockTimers.begin(); it != m_collectionLockTimers.end(); it++) {
-        if (it.value() == timer) {
-            qCDebug(lcSailfishSecretsDaemon) << "Relocking collection:" << it.key() << "due to unlock timeout!";
-            m_collectionAuthenticationKeys.remove(it.key());
-            m_collectionLockTimers.erase(it);
-            break;
-        }
+    const bool applicationIsPlatformApplication = m_appPermissions->applicationIsPlatformApplication(callerPid);
+    const QString callerApplicationId = applicationIsPlatformApplication
+                ? m_appPermissions->platformApplicationId()
+                : m_appPermissions->applicationId(callerPid);
+
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::Locker collectionLocker(&m_collectionLocks, collectionName, Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks::ReadLock);
+    DatabaseLocker locker(m_db);
+
+    bool found = false;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata metadata;
+    Sailfish::Secrets::Result metadataResult = collectionMetadata(collectionName, &metadata, &found);
+    if (metadataResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to read collection metadata:" << metadataResult.errorMessage();
+        return false;
+    } else if (!found) {
+        return false;
+    }
+
+    // As for reading secrets, only the owner of a collection may observe it.
+    return metadata.accessControlMode == Sailfish::Secrets::SecretManager::OwnerOnlyMode
+            && metadata.applicationId == callerApplicationId;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::timeoutRelockCollections(const QStringList &collectionNames)
+{
+    Q_FOREACH (const QString &collectionName, collectionNames) {
+        qCDebug(lcSailfishSecretsDaemon) << "Relocking collection:" << collectionName << "due to unlock timeout!";
+        removeCollectionAuthenticationKey(collectionName);
     }
-    timer->deleteLater();
 }
 
-void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::timeoutRelockSecret()
+void Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::timeoutRelockSecrets(const QStringList &secretNames)
 {
-    QTimer *timer = qobject_cast<QTimer*>(sender());
-    for (QMap<QString, QTimer*>::iterator it = m_standaloneSecretLockTimers.begin(); it != m_standaloneSecretLockTimers.end(); it++) {
-        if (it.value() == timer) {
-            qCDebug(lcSailfishSecretsDaemon) << "Relocking standalone secret:" << it.key() << "due to unlock timeout!";
-            m_standaloneSecretAuthenticationKeys.remove(it.key());
-            m_standaloneSecretLockTimers.erase(it);
-            break;
-        }
+    Q_FOREACH (const QString &hashedSecretName, secretNames) {
+        qCDebug(lcSailfishSecretsDaemon) << "Relocking standalone secret:" << hashedSecretName << "due to unlock timeout!";
+        releaseAuthenticationKey(m_standaloneSecretAuthenticationKeys.take(hashedSecretName));
     }
-    timer->deleteLater();
 }
 
@@ -13,10 +13,12 @@
 #include <QtCore/QVariant>
 #include <QtCore/QString>
 #include <QtCore/QHash>
+#include <QtCore/QSet>
 #include <QtCore/QPair>
 #include <QtCore/QDateTime>
 #include <QtCore/QMultiMap>
 #include <QtCore/QTimer>
+#include <QtCore/QSharedPointer>
 
 #include <sys/types.h>
 
@@ -29,8 +31,14 @@
 #include "SecretsImpl/secrets_p.h"
 #include "SecretsImpl/secretsdatabase_p.h"
 #include "SecretsImpl/applicationpermissions_p.h"
+#include "SecretsImpl/relockscheduler_p.h"
+#include "SecretsImpl/secretcache_p.h"
+#include "SecretsImpl/collectionlocks_p.h"
+#include "SecretsImpl/preloadmanifest_p.h"
 
 #include "requestqueue_p.h"
+#include "securememory_p.h"
+#include "pluginregistry_p.h"
 
 namespace Sailfish {
 
@@ -65,6 +73,9 @@ public:
             QVector<Sailfish::Secrets::EncryptedStoragePluginInfo> *encryptedStoragePlugins,
             QVector<Sailfish::Secrets::AuthenticationPluginInfo> *authenticationPlugins);
 
+    // changes whenever the result of getPluginInfo() would, i.e. when plugins are installed.
+    quint64 pluginInfoGeneration() const;
+
     // create a DeviceLock-protected collection
     Sailfish::Secrets::Result createDeviceLockCollection(
             pid_t callerPid,
@@ -73,7 +84,8 @@ public:
             const QString &storagePluginName,
             const QString &encryptionPluginName,
             Sailfish::Secrets::SecretManager::DeviceLockUnlockSemantic unlockSemantic,
-            Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode);
+            Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
+            Sailfish::Secrets::StoragePlugin::Durability durability);
 
     // create a CustomLock-protected collection
     Sailfish::Secrets::Result createCustomLockCollection(
@@ -87,7 +99,8 @@ public:
             int customLockTimeoutMs,
             Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
             Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
-            const QString &uiServiceAddress);
+            const QString &uiServiceAddress,
+            Sailfish::Secrets::StoragePlugin::Durability durability);
 
     // delete a collection
     Sailfish::Secrets::Result deleteCollection(
@@ -106,6 +119,15 @@ public:
             Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
             const QString &uiServiceAddress);
 
+    // set multiple secrets in a collection
+    Sailfish::Secrets::Result setCollectionSecrets(
+            pid_t callerPid,
+            quint64 requestId,
+            const QString &collectionName,
+            const QMap<QString, QByteArray> &secrets,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            const QString &uiServiceAddress);
+
     // set a standalone DeviceLock-protected secret
     Sailfish::Secrets::Result setStandaloneDeviceLockSecret(
             pid_t callerPid,
@@ -143,6 +165,16 @@ public:
             const QString &uiServiceAddress,
             QByteArray *secret);
 
+    // get multiple secrets from a collection
+    Sailfish::Secrets::Result getCollectionSecrets(
+            pid_t callerPid,
+            quint64 requestId,
+            const QString &collectionName,
+            const QStringList &secretNames,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            const QString &uiServiceAddress,
+            QMap<QString, QByteArray> *secrets);
+
     // get a standalone secret
     Sailfish::Secrets::Result getStandaloneSecret(
             pid_t callerPid,
@@ -168,10 +200,112 @@ public:
             const QString &secretName,
             Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode);
 
+    // set whether the secrets in a collection are prefetched when it is unlocked
+    Sailfish::Secrets::Result setCollectionPrefetchOnUnlock(
+            pid_t callerPid,
+            quint64 requestId,
+            const QString &collectionName,
+            bool prefetchOnUnlock);
+
+    // change the device lock key which unlocks the device lock collections
+    Sailfish::Secrets::Result modifyDeviceLockKey(
+            pid_t callerPid,
+            quint64 requestId,
+            const QByteArray &oldDeviceLockKey,
+            const QByteArray &newDeviceLockKey);
+
+    // get the names of the collections owned by the caller
+    Sailfish::Secrets::Result collectionNames(
+            pid_t callerPid,
+            quint64 requestId,
+            QStringList *collectionNames);
+
+    // get up to limit names of secrets in an unlocked collection, following the given cursor.
+    // The nextCursor continues the enumeration, and is zero once every name has been returned.
+    Sailfish::Secrets::Result secretNames(
+            pid_t callerPid,
+            quint64 requestId,
+            const QString &collectionName,
+            qint64 cursor,
+            int limit,
+            QStringList *secretNames,
+            qint64 *nextCursor);
+
+    // write every unlocked collection owned by the caller (other than those in encrypted storage),
+    // and its secrets, to an archive encrypted with the given key.
+    Sailfish::Secrets::Result exportSecrets(
+            pid_t callerPid,
+            quint64 requestId,
+            const QDBusUnixFileDescriptor &archive,
+            const QByteArray &archiveKey,
+            int *exportedCount);
+
+    // restore the collections and secrets of an archive written by exportSecrets().
+    Sailfish::Secrets::Result importSecrets(
+            pid_t callerPid,
+            quint64 requestId,
+            const QDBusUnixFileDescriptor &archive,
+            const QByteArray &archiveKey,
+            int *importedCount);
+
     // To allow implementation of storagePluginNames() for Crypto API:
     QStringList storagePluginNames() const;
+    // true if getCollectionSecret() would return without waiting for an asynchronous
+    // plugin operation, so the crypto daemon may read a stored key without queueing.
+    bool collectionSecretReadableSynchronously(const QString &collectionName, const QString &secretName);
+
+    // true if the authentication key for the collection is currently cached.
+    bool collectionIsUnlocked(const QString &collectionName) const { return m_collectionAuthenticationKeys.contains(collectionName); }
+
+    // Whether the given client may be notified about changes to the given collection.
+    bool collectionNotificationPermitted(pid_t callerPid, const QString &collectionName);
+
+    // discard the state of a cancelled asynchronous request, so that its completion is ignored.
+    void cancelPendingRequest(quint64 requestId) { m_pendingRequests.remove(requestId); m_pendingPluginOperations.remove(requestId); }
+
+    // Decrypted secrets from unlocked collections are cached up to this many bytes.  Zero disables the cache.
+    void setSecretCacheCapacity(qint64 bytes) { m_secretCache.setCapacity(bytes); }
+
+    // Collection secrets larger than this many bytes are stored as separately encrypted chunks of it.
+    // Zero stores every secret whole.
+    void setSecretChunkSize(int bytes) { m_secretChunkSize = bytes; }
+
+    // Adds the bytes held by the cached authentication keys and decrypted secrets to usage.
+    void memoryUsage(QMap<QString, qint64> *usage) const;
+    // Discards the decrypted secrets, which are read again when next requested.
+    // The authentication keys are kept, as discarding them would relock collections.
+    void releaseMemory();
+
+    // Maintains the storage of each storage plugin in turn within the budget.
+    // Returns the number of pages used, or -1 if any plugin was busy.
+    int performMaintenance(int pageBudget);
+
+    // Unlocks the device lock collections named in the manifest, and reads the
+    // secrets it names from each into the secret cache in one batch, so that the
+    // applications which read them once the device is unlocked needn't all wait
+    // for the storage.  Returns the number of secrets which are cached.
+    int preloadSecrets(const Sailfish::Secrets::Daemon::ApiImpl::PreloadManifest &manifest);
+
+    // Rewraps the data keys of the device lock collections when the device lock key changes.
+    Sailfish::Secrets::Result rewrapDeviceLockDataKeys(const QByteArray &oldKey, const QByteArray &newKey, QStringList *rewrappedCollectionNames);
+
+    // Whether any collection or standalone secret is unlocked with a key
+    // other than the device lock key, i.e. one which only the user can supply.
+    bool customLockKeysHeld() const;
+
+    // Group commit for storage plugins which support batching their writes.
+    void setStorageWriteBatching(bool enabled);
+    bool storageWritesPending() const;
+    Sailfish::Secrets::Result flushStorage();
+    // called if grouped writes are lost, as cached values may reflect them.
+    void discardCachedState();
+
+    // Storage plugins which support it are moved onto the master database connection,
+    // so that secret values are committed in the same transaction as their metadata.
+    void shareStorageDatabaseConnection();
 
 private Q_SLOTS:
+    void pluginLoaded(const QString &interfaceId, const QString &name, QObject *plugin);
     void authenticationCompleted(
             uint callerPid,
             qint64 requestId,
@@ -182,8 +316,12 @@ private Q_SLOTS:
             const Sailfish::Secrets::Result &result,
             const QByteArray &authenticationKey);
 
-    void timeoutRelockCollection();
-    void timeoutRelockSecret();
+    void storageGetSecretCompleted(quint64 operationId, const Sailfish::Secrets::Result &result, const QByteArray &secret);
+    void encryptionDecryptSecretCompleted(quint64 operationId, const Sailfish::Secrets::Result &result, const QByteArray &plaintext);
+
+    void reencryptionProgress(const QString &collectionName, int reencryptedCount, int totalCount);
+    void timeoutRelockCollections(const QStringList &collectionNames);
+    void timeoutRelockSecrets(const QStringList &secretNames);
 
 private:
     class DatabaseLocker : public QMutexLocker
@@ -197,6 +335,51 @@ private:
         Sailfish::Secrets::Daemon::ApiImpl::Database *m_db;
     };
 
+    // The metadata of a collection rarely changes after it is created,
+    // so it is cached to avoid querying the Collections table on every request.
+    struct CollectionMetadata {
+        CollectionMetadata()
+            : usesDeviceLockKey(false), unlockSemantic(0), customLockTimeoutMs(0)
+            , accessControlMode(Sailfish::Secrets::SecretManager::OwnerOnlyMode)
+            , prefetchOnUnlock(false), encryptionAlgorithm(0) {}
+        QString applicationId;
+        bool usesDeviceLockKey;
+        QString storagePluginName;
+        QString encryptionPluginName;
+        QString authenticationPluginName;
+        int unlockSemantic;
+        int customLockTimeoutMs;
+        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode;
+        bool prefetchOnUnlock;
+        int encryptionAlgorithm; // the EncryptionPlugin::EncryptionAlgorithm the secrets were written with
+        QByteArray wrappedDataKey; // empty if the secrets are encrypted with the lock key itself
+    };
+    Sailfish::Secrets::Result collectionMetadata(
+            const QString &collectionName,
+            Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata *metadata,
+            bool *found);
+
+    // Update the unlocked collections, notifying subscribed clients of any lock state change.
+    Sailfish::Secrets::Result setCollectionAuthenticationKey(const QString &collectionName, const QByteArray &authenticationKey);
+    Sailfish::Secrets::Result collectionDataKey(const QString &collectionName, const QByteArray &lockKey, QByteArray *dataKey);
+    void removeCollectionAuthenticationKey(const QString &collectionName);
+    void releaseAuthenticationKey(const Sailfish::Secrets::Daemon::SecureByteArray &authenticationKey);
+
+    int encryptionAlgorithm(const QString &storagePluginName, const QString &encryptionPluginName) const;
+    Sailfish::Secrets::StoragePlugin::Durability collectionDurability(
+            const QString &storagePluginName,
+            const QString &encryptionPluginName,
+            Sailfish::Secrets::StoragePlugin::Durability requestedDurability) const;
+    void removeInMemoryCollections();
+    void reencryptCollectionIfRequired(const QString &collectionName);
+
+    // Fill the secret cache with every secret in a newly unlocked collection.
+    void prefetchCollection(const QString &collectionName);
+    int cacheStoredSecrets(const QString &collectionName,
+                           const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata &metadata,
+                           const QStringList &hashedSecretNames,
+                           DatabaseLocker *locker);
+
     Sailfish::Secrets::Result createCustomLockCollectionWithAuthenticationKey(
             pid_t callerPid,
             quint64 requestId,
@@ -209,6 +392,7 @@ private:
             Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode,
             Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
             const QString &uiServiceAddress,
+            Sailfish::Secrets::StoragePlugin::Durability durability,
             const QByteArray &authenticationKey);
 
     Sailfish::Secrets::Result setCollectionSecretWithAuthenticationKey(
@@ -229,6 +413,23 @@ private:
             Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode,
             const QByteArray &authenticationKey);
 
+    Sailfish::Secrets::Result setCollectionSecretsWithAuthenticationKey(
+            pid_t callerPid,
+            quint64 requestId,
+            const QString &collectionName,
+            const QMap<QString, QByteArray> &secrets,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            const QString &uiServiceAddress,
+            bool collectionUsesDeviceLockKey,
+            const QString &collectionApplicationId,
+            const QString &collectionStoragePluginName,
+            const QString &collectionEncryptionPluginName,
+            const QString &collectionAuthenticationPluginName,
+            int collectionUnlockSemantic,
+            int collectionCustomLockTimeoutMs,
+            Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode,
+            const QByteArray &authenticationKey);
+
     Sailfish::Secrets::Result setStandaloneCustomLockSecretWithAuthenticationKey(
             pid_t callerPid,
             quint64 requestId,
@@ -258,6 +459,46 @@ private:
             const QByteArray &authenticationKey,
             QByteArray *secret);
 
+    // A read of a collection secret via storage and encryption plugins at least
+    // one of which completes asynchronously.  The operationId is the requestId.
+    struct PendingPluginOperation {
+        PendingPluginOperation() : decrypting(false), cacheSecret(false) {}
+        QString collectionName;
+        QString hashedSecretName;
+        QString storagePluginName;
+        QString encryptionPluginName;
+        bool decrypting;
+        bool cacheSecret;
+    };
+    Sailfish::Secrets::Result beginGetCollectionSecret(
+            quint64 requestId,
+            const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation &operation,
+            QByteArray *secret);
+    Sailfish::Secrets::Result beginDecryptCollectionSecret(
+            quint64 requestId,
+            Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation operation,
+            const QByteArray &encrypted,
+            QByteArray *secret);
+    void finishGetCollectionSecret(
+            quint64 requestId,
+            const Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation &operation,
+            const Sailfish::Secrets::Result &result,
+            const QByteArray &secret);
+
+    Sailfish::Secrets::Result getCollectionSecretsWithAuthenticationKey(
+            pid_t callerPid,
+            quint64 requestId,
+            const QString &collectionName,
+            const QStringList &secretNames,
+            Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode,
+            const QString &uiServiceAddress,
+            const QString &storagePluginName,
+            const QString &encryptionPluginName,
+            int collectionUnlockSemantic,
+            int collectionCustomLockTimeoutMs,
+            const QByteArray &authenticationKey,
+            QMap<QString, QByteArray> *secrets);
+
     Sailfish::Secrets::Result getStandaloneSecretWithAuthenticationKey(
             pid_t callerPid,
             quint64 requestId,
@@ -281,33 +522,155 @@ private:
             const QByteArray &authenticationKey);
 
 private:
+    // The state required to continue an asynchronous request once the
+    // authentication plugin returns the authentication key for it.
+    // Each request type has its own continuation, so that the arguments
+    // are type-checked rather than unpacked from a QVariantList by position.
+    struct Continuation {
+        virtual ~Continuation() {}
+    };
+    struct CreateCustomLockCollectionContinuation : public Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation {
+        CreateCustomLockCollectionContinuation()
+            : unlockSemantic(Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked), customLockTimeoutMs(0), accessControlMode(Sailfish::Secrets::SecretManager::OwnerOnlyMode), userInteractionMode(Sailfish::Secrets::SecretManager::PreventUserInteractionMode), durability(Sailfish::Secrets::StoragePlugin::FullDurability) {}
+        QString collectionName;
+        QString storagePluginName;
+        QString encryptionPluginName;
+        QString authenticationPluginName;
+        Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic unlockSemantic;
+        int customLockTimeoutMs;
+        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode;
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode;
+        QString uiServiceAddress;
+        Sailfish::Secrets::StoragePlugin::Durability durability;
+    };
+    struct SetCollectionSecretContinuation : public Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation {
+        SetCollectionSecretContinuation()
+            : userInteractionMode(Sailfish::Secrets::SecretManager::PreventUserInteractionMode), collectionUsesDeviceLockKey(false), collectionUnlockSemantic(0), collectionCustomLockTimeoutMs(0), collectionAccessControlMode(Sailfish::Secrets::SecretManager::OwnerOnlyMode) {}
+        QString collectionName;
+        QString secretName;
+        QByteArray secret;
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode;
+        QString uiServiceAddress;
+        bool collectionUsesDeviceLockKey;
+        QString collectionApplicationId;
+        QString collectionStoragePluginName;
+        QString collectionEncryptionPluginName;
+        QString collectionAuthenticationPluginName;
+        int collectionUnlockSemantic;
+        int collectionCustomLockTimeoutMs;
+        Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode;
+    };
+    struct SetCollectionSecretsContinuation : public Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation {
+        SetCollectionSecretsContinuation()
+            : userInteractionMode(Sailfish::Secrets::SecretManager::PreventUserInteractionMode), collectionUsesDeviceLockKey(false), collectionUnlockSemantic(0), collectionCustomLockTimeoutMs(0), collectionAccessControlMode(Sailfish::Secrets::SecretManager::OwnerOnlyMode) {}
+        QString collectionName;
+        QMap<QString, QByteArray> secrets;
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode;
+        QString uiServiceAddress;
+        bool collectionUsesDeviceLockKey;
+        QString collectionApplicationId;
+        QString collectionStoragePluginName;
+        QString collectionEncryptionPluginName;
+        QString collectionAuthenticationPluginName;
+        int collectionUnlockSemantic;
+        int collectionCustomLockTimeoutMs;
+        Sailfish::Secrets::SecretManager::AccessControlMode collectionAccessControlMode;
+    };
+    struct SetStandaloneCustomLockSecretContinuation : public Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation {
+        SetStandaloneCustomLockSecretContinuation()
+            : unlockSemantic(Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked), customLockTimeoutMs(0), accessControlMode(Sailfish::Secrets::SecretManager::OwnerOnlyMode), userInteractionMode(Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {}
+        QString storagePluginName;
+        QString encryptionPluginName;
+        QString authenticationPluginName;
+        QString secretName;
+        QByteArray secret;
+        Sailfish::Secrets::SecretManager::CustomLockUnlockSemantic unlockSemantic;
+        int customLockTimeoutMs;
+        Sailfish::Secrets::SecretManager::AccessControlMode accessControlMode;
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode;
+        QString uiServiceAddress;
+    };
+    struct GetCollectionSecretContinuation : public Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation {
+        GetCollectionSecretContinuation()
+            : userInteractionMode(Sailfish::Secrets::SecretManager::PreventUserInteractionMode), collectionUnlockSemantic(0), collectionCustomLockTimeoutMs(0) {}
+        QString collectionName;
+        QString secretName;
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode;
+        QString uiServiceAddress;
+        QString storagePluginName;
+        QString encryptionPluginName;
+        int collectionUnlockSemantic;
+        int collectionCustomLockTimeoutMs;
+    };
+    struct GetCollectionSecretsContinuation : public Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation {
+        GetCollectionSecretsContinuation()
+            : userInteractionMode(Sailfish::Secrets::SecretManager::PreventUserInteractionMode), collectionUnlockSemantic(0), collectionCustomLockTimeoutMs(0) {}
+        QString collectionName;
+        QStringList secretNames;
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode;
+        QString uiServiceAddress;
+        QString storagePluginName;
+        QString encryptionPluginName;
+        int collectionUnlockSemantic;
+        int collectionCustomLockTimeoutMs;
+    };
+    struct GetStandaloneSecretContinuation : public Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation {
+        GetStandaloneSecretContinuation()
+            : userInteractionMode(Sailfish::Secrets::SecretManager::PreventUserInteractionMode), lockSemantic(0), customLockTimeoutMs(0) {}
+        QString secretName;
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode;
+        QString uiServiceAddress;
+        QString storagePluginName;
+        QString encryptionPluginName;
+        int lockSemantic;
+        int customLockTimeoutMs;
+    };
+    struct DeleteCollectionSecretContinuation : public Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation {
+        DeleteCollectionSecretContinuation()
+            : userInteractionMode(Sailfish::Secrets::SecretManager::PreventUserInteractionMode) {}
+        QString collectionName;
+        QString secretName;
+        Sailfish::Secrets::SecretManager::UserInteractionMode userInteractionMode;
+        QString uiServiceAddress;
+    };
+
     struct PendingRequest {
         PendingRequest()
             : callerPid(0), requestId(0), requestType(Sailfish::Secrets::Daemon::ApiImpl::InvalidRequest) {}
-        PendingRequest(uint pid, quint64 rid, Sailfish::Secrets::Daemon::ApiImpl::RequestType rtype, QVariantList params)
-            : callerPid(pid), requestId(rid), requestType(rtype), parameters(params) {}
-        PendingRequest(const PendingRequest &other)
-            : callerPid(other.callerPid), requestId(other.requestId), requestType(other.requestType), parameters(other.parameters) {}
+        PendingRequest(uint pid, quint64 rid, Sailfish::Secrets::Daemon::ApiImpl::RequestType rtype,
+                       Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation *cont)
+            : callerPid(pid), requestId(rid), requestType(rtype), continuation(cont) {}
         uint callerPid;
         quint64 requestId;
         Sailfish::Secrets::Daemon::ApiImpl::RequestType requestType;
-        QVariantList parameters;
+        QSharedPointer<Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::Continuation> continuation;
     };
 
     Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue *m_requestQueue;
     Sailfish::Secrets::Daemon::ApiImpl::Database *m_db;
     Sailfish::Secrets::Daemon::ApiImpl::ApplicationPermissions *m_appPermissions;
 
-    QMap<QString, Sailfish::Secrets::StoragePlugin*> m_storagePlugins;
-    QMap<QString, Sailfish::Secrets::EncryptionPlugin*> m_encryptionPlugins;
-    QMap<QString, Sailfish::Secrets::EncryptedStoragePlugin*> m_encryptedStoragePlugins;
-    QMap<QString, Sailfish::Secrets::AuthenticationPlugin*> m_authenticationPlugins;
-
-    QMap<QString, QTimer*> m_collectionLockTimers;
-    QMap<QString, QByteArray> m_collectionAuthenticationKeys;
-    QMap<QString, QTimer*> m_standaloneSecretLockTimers;
-    QMap<QString, QByteArray> m_standaloneSecretAuthenticationKeys;
+    // plugins are instantiated when first used.
+    Sailfish::Secrets::Daemon::PluginRegistry m_pluginRegistry;
+    Sailfish::Secrets::Daemon::PluginMap<Sailfish::Secrets::StoragePlugin> m_storagePlugins;
+    Sailfish::Secrets::Daemon::PluginMap<Sailfish::Secrets::EncryptionPlugin> m_encryptionPlugins;
+    Sailfish::Secrets::Daemon::PluginMap<Sailfish::Secrets::EncryptedStoragePlugin> m_encryptedStoragePlugins;
+    Sailfish::Secrets::Daemon::PluginMap<Sailfish::Secrets::AuthenticationPlugin> m_authenticationPlugins;
+    QSet<QString> m_sharedConnectionStoragePlugins;
+    bool m_storageWriteBatching;
+    int m_secretChunkSize;
+    Sailfish::Secrets::Daemon::SecureByteArray m_deviceLockKey;
+    bool m_autotestMode;
+
+    QHash<QString, Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::CollectionMetadata> m_collectionMetadata;
+    Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler m_collectionRelocks;
+    QMap<QString, Sailfish::Secrets::Daemon::SecureByteArray> m_collectionAuthenticationKeys;
+    Sailfish::Secrets::Daemon::ApiImpl::SecretCache m_secretCache; // wiped whenever a collection is relocked
+    Sailfish::Secrets::Daemon::ApiImpl::CollectionLocks m_collectionLocks; // taken before the database's accessMutex()
+    Sailfish::Secrets::Daemon::ApiImpl::RelockScheduler m_standaloneSecretRelocks;
+    QMap<QString, Sailfish::Secrets::Daemon::SecureByteArray> m_standaloneSecretAuthenticationKeys;
     QMap<quint64, Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingRequest> m_pendingRequests;
+    QHash<quint64, Sailfish::Secrets::Daemon::ApiImpl::RequestProcessor::PendingPluginOperation> m_pendingPluginOperations;
 };
 
 } // namespace ApiImpl
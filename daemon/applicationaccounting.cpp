@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "applicationaccounting_p.h"
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+namespace {
+    thread_local Sailfish::Secrets::Daemon::ApplicationAccounting::Scope *currentScope = Q_NULLPTR;
+
+    // getrusage() reports the blocks written to storage in units of 512 bytes.
+    const qint64 BlockSize = 512;
+}
+
+Sailfish::Secrets::Daemon::ApplicationAccounting::Scope::Scope(const QString &applicationId)
+    : m_outer(currentScope)
+    , m_applicationId(applicationId)
+    , m_startCpuUsecs(0)
+    , m_startBytesWritten(0)
+    , m_innerCpuUsecs(0)
+    , m_innerBytesWritten(0)
+{
+    Sailfish::Secrets::Daemon::ApplicationAccounting::threadUsage(&m_startCpuUsecs, &m_startBytesWritten);
+    currentScope = this;
+}
+
+Sailfish::Secrets::Daemon::ApplicationAccounting::Scope::~Scope()
+{
+    qint64 cpuUsecs = 0, bytesWritten = 0;
+    Sailfish::Secrets::Daemon::ApplicationAccounting::threadUsage(&cpuUsecs, &bytesWritten);
+    cpuUsecs -= m_startCpuUsecs;
+    bytesWritten -= m_startBytesWritten;
+
+    // the usage of nested scopes was charged to their own applications.
+    Sailfish::Secrets::Daemon::ApplicationAccounting::instance()->record(
+            m_applicationId, cpuUsecs - m_innerCpuUsecs, bytesWritten - m_innerBytesWritten, 0);
+    if (m_outer) {
+        m_outer->m_innerCpuUsecs += cpuUsecs;
+        m_outer->m_innerBytesWritten += bytesWritten;
+    }
+    currentScope = m_outer;
+}
+
+Sailfish::Secrets::Daemon::ApplicationAccounting::ApplicationAccounting()
+    : m_windowMsecs(0)
+{
+    m_clock.start();
+}
+
+Sailfish::Secrets::Daemon::ApplicationAccounting *Sailfish::Secrets::Daemon::ApplicationAccounting::instance()
+{
+    static Sailfish::Secrets::Daemon::ApplicationAccounting accounting;
+    return &accounting;
+}
+
+void Sailfish::Secrets::Daemon::ApplicationAccounting::setQuotas(const Quotas &quotas, int windowSecs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_quotas = quotas;
+    m_windowMsecs = qint64(qMax(windowSecs, 1)) * 1000;
+}
+
+QString Sailfish::Secrets::Daemon::ApplicationAccounting::currentApplicationId()
+{
+    return currentScope ? currentScope->m_applicationId : QString();
+}
+
+void Sailfish::Secrets::Daemon::ApplicationAccounting::threadUsage(qint64 *cpuUsecs, qint64 *bytesWritten)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+        return;
+    }
+    *cpuUsecs = (qint64(usage.ru_utime.tv_sec) + qint64(usage.ru_stime.tv_sec)) * 1000000
+              + qint64(usage.ru_utime.tv_usec) + qint64(usage.ru_stime.tv_usec);
+    *bytesWritten = qint64(usage.ru_oublock) * BlockSize;
+}
+
+Sailfish::Secrets::Daemon::ApplicationAccounting::Usage &
+Sailfish::Secrets::Daemon::ApplicationAccounting::usage(const QString &applicationId) const
+{
+    Usage &u(m_usage[applicationId]);
+    const qint64 now = m_clock.elapsed();
+    if (m_windowMsecs > 0 && now - u.windowStart >= m_windowMsecs) {
+        u.windowStart = now;
+        u.windowCpuUsecs = 0;
+        u.windowBytesWritten = 0;
+        u.windowSyncs = 0;
+    }
+    return u;
+}
+
+void Sailfish::Secrets::Daemon::ApplicationAccounting::record(const QString &applicationId, qint64 cpuUsecs, qint64 bytesWritten, qint64 syncs)
+{
+    // work done for no particular application (e.g. at startup) isn't accounted.
+    if (applicationId.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    Usage &u(usage(applicationId));
+    u.cpuUsecs += cpuUsecs;
+    u.bytesWritten += bytesWritten;
+    u.syncs += syncs;
+    u.windowCpuUsecs += cpuUsecs;
+    u.windowBytesWritten += bytesWritten;
+    u.windowSyncs += syncs;
+}
+
+void Sailfish::Secrets::Daemon::ApplicationAccounting::recordSync()
+{
+    record(currentApplicationId(), 0, 0, 1);
+}
+
+void Sailfish::Secrets::Daemon::ApplicationAccounting::recordSync(const QSet<QString> &applicationIds)
+{
+    Q_FOREACH (const QString &applicationId, applicationIds) {
+        record(applicationId, 0, 0, 1);
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApplicationAccounting::recordCacheBytes(const QString &applicationId, qint64 bytes)
+{
+    if (applicationId.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    Usage &u(usage(applicationId));
+    u.cacheBytes = qMax(Q_INT64_C(0), u.cacheBytes + bytes);
+}
+
+bool Sailfish::Secrets::Daemon::ApplicationAccounting::mayCache(const QString &applicationId, qint64 bytes) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_quotas.cacheBytes <= 0 || applicationId.isEmpty()) {
+        return true;
+    }
+    return m_usage.value(applicationId).cacheBytes + bytes <= m_quotas.cacheBytes;
+}
+
+bool Sailfish::Secrets::Daemon::ApplicationAccounting::isThrottled(const QString &applicationId) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (applicationId.isEmpty()
+            || (m_quotas.cpuUsecs <= 0 && m_quotas.bytesWritten <= 0 && m_quotas.syncs <= 0)) {
+        return false;
+    }
+    const Usage &u(usage(applicationId));
+    return (m_quotas.cpuUsecs > 0 && u.windowCpuUsecs > m_quotas.cpuUsecs)
+            || (m_quotas.bytesWritten > 0 && u.windowBytesWritten > m_quotas.bytesWritten)
+            || (m_quotas.syncs > 0 && u.windowSyncs > m_quotas.syncs);
+}
+
+void Sailfish::Secrets::Daemon::ApplicationAccounting::recordThrottledRequest(const QString &applicationId)
+{
+    QMutexLocker locker(&m_mutex);
+    usage(applicationId).throttledRequests++;
+}
+
+QVariantMap Sailfish::Secrets::Daemon::ApplicationAccounting::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap quotas;
+    quotas.insert(QStringLiteral("windowMsecs"), QVariant::fromValue<qint64>(m_windowMsecs));
+    quotas.insert(QStringLiteral("cpuUsecs"), QVariant::fromValue<qint64>(m_quotas.cpuUsecs));
+    quotas.insert(QStringLiteral("bytesWritten"), QVariant::fromValue<qint64>(m_quotas.bytesWritten));
+    quotas.insert(QStringLiteral("syncs"), QVariant::fromValue<qint64>(m_quotas.syncs));
+    quotas.insert(QStringLiteral("cacheBytes"), QVariant::fromValue<qint64>(m_quotas.cacheBytes));
+
+    QVariantMap applications;
+    for (QHash<QString, Usage>::const_iterator it = m_usage.constBegin(); it != m_usage.constEnd(); ++it) {
+        QVariantMap application;
+        application.insert(QStringLiteral("cpuUsecs"), QVariant::fromValue<qint64>(it->cpuUsecs));
+        application.insert(QStringLiteral("bytesWritten"), QVariant::fromValue<qint64>(it->bytesWritten));
+        application.insert(QStringLiteral("syncs"), QVariant::fromValue<qint64>(it->syncs));
+        application.insert(QStringLiteral("cacheBytes"), QVariant::fromValue<qint64>(it->cacheBytes));
+        application.insert(QStringLiteral("throttledRequests"), QVariant::fromValue<quint64>(it->throttledRequests));
+        applications.insert(it.key(), application);
+    }
+
+    QVariantMap stats;
+    stats.insert(QStringLiteral("quotas"), quotas);
+    stats.insert(QStringLiteral("applications"), applications);
+    return stats;
+}
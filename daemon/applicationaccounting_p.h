@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_APPLICATIONACCOUNTING_P_H
+#define SAILFISHSECRETS_DAEMON_APPLICATIONACCOUNTING_P_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QVariantMap>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+// Accounts the daemon's resources to the applications (as identified by
+// ApplicationPermissions::applicationId()) on whose behalf they are used:
+// the CPU time spent handling their requests, the bytes written to storage
+// and the database syncs while doing so, and the cache memory holding their
+// data.  Usage is reported via the statistics DBus interface.
+//
+// Optionally, an application may be given quotas per accounting window.
+// Once it exceeds any of them, it is throttled until the window ends: only
+// one of its requests is handled per pass over a request queue, after those
+// of other applications.  No more of its data is cached once it holds its
+// cache quota.
+//
+// While a Scope is alive, the thread's CPU time and storage writes are
+// charged to its application, as are any syncs recorded by the database.
+class ApplicationAccounting
+{
+public:
+    struct Quotas {
+        Quotas() : cpuUsecs(0), bytesWritten(0), syncs(0), cacheBytes(0) {}
+        // zero means unlimited.
+        qint64 cpuUsecs;      // per window
+        qint64 bytesWritten;  // per window
+        qint64 syncs;         // per window
+        qint64 cacheBytes;    // at any time
+    };
+
+    class Scope
+    {
+    public:
+        explicit Scope(const QString &applicationId);
+        ~Scope();
+
+    private:
+        friend class ApplicationAccounting;
+        Q_DISABLE_COPY(Scope)
+        Scope *m_outer;
+        QString m_applicationId;
+        qint64 m_startCpuUsecs;
+        qint64 m_startBytesWritten;
+        qint64 m_innerCpuUsecs;      // used by scopes nested within this one
+        qint64 m_innerBytesWritten;
+    };
+
+    static ApplicationAccounting *instance();
+
+    void setQuotas(const Quotas &quotas, int windowSecs);
+
+    // The application of the current thread's innermost scope, if any.
+    static QString currentApplicationId();
+
+    // Charges a sync of the database to the current scope's application.
+    void recordSync();
+    // Charges one sync to each of the given applications, e.g. those whose
+    // transactions were made durable together by a group commit.
+    void recordSync(const QSet<QString> &applicationIds);
+
+    // Adjusts the cache memory held for the application by the given (signed) amount.
+    void recordCacheBytes(const QString &applicationId, qint64 bytes);
+    // Whether the application may have the given number of bytes more cached for it.
+    bool mayCache(const QString &applicationId, qint64 bytes) const;
+
+    // Whether the application has exceeded a quota in the current window.
+    // Each throttled request is counted, to be reported with its usage.
+    bool isThrottled(const QString &applicationId) const;
+    void recordThrottledRequest(const QString &applicationId);
+
+    QVariantMap statistics() const;
+
+private:
+    ApplicationAccounting();
+
+    struct Usage {
+        Usage() : cpuUsecs(0), bytesWritten(0), syncs(0), cacheBytes(0), throttledRequests(0)
+                , windowStart(0), windowCpuUsecs(0), windowBytesWritten(0), windowSyncs(0) {}
+        qint64 cpuUsecs;
+        qint64 bytesWritten;
+        qint64 syncs;
+        qint64 cacheBytes;
+        quint64 throttledRequests;
+        qint64 windowStart;     // msecs on m_clock
+        qint64 windowCpuUsecs;
+        qint64 windowBytesWritten;
+        qint64 windowSyncs;
+    };
+
+    // must be called with m_mutex locked.
+    Usage &usage(const QString &applicationId) const;
+    void record(const QString &applicationId, qint64 cpuUsecs, qint64 bytesWritten, qint64 syncs);
+    static void threadUsage(qint64 *cpuUsecs, qint64 *bytesWritten);
+
+    mutable QMutex m_mutex;
+    mutable QHash<QString, Usage> m_usage;
+    QElapsedTimer m_clock;
+    Quotas m_quotas;
+    qint64 m_windowMsecs;
+};
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_APPLICATIONACCOUNTING_P_H
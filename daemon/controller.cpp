@@ -7,17 +7,30 @@
 
 #include "controller_p.h"
 #include "discoveryobject_p.h"
+#include "statisticsobject_p.h"
+#include "memoryaccounting_p.h"
+#include "applicationaccounting_p.h"
+#include "databasemaintenance_p.h"
 #include "logging_p.h"
+#include "securememory_p.h"
+#include "yieldpolicy_p.h"
 
 #include "SecretsImpl/secrets_p.h"
 #include "CryptoImpl/crypto_p.h"
 
+#include <QtCore/QCoreApplication>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QDir>
+#include <QtCore/QFile>
 #include <QtCore/QStandardPaths>
 
+#include <unistd.h>
+
 namespace {
-    QString p2pSocketAddress()
+    // Clients first try to connect to this socket file directly, and only
+    // fall back to asking the discovery objects for the address if that fails.
+    QString p2pSocketFile()
     {
         const QString path = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
         if (path.isEmpty()) {
@@ -31,33 +44,95 @@ namespace {
             return QString();
         }
 
-        const QString socketFile = QString::fromUtf8("%1/%2").arg(dir.absolutePath(), QLatin1String("sailfishsecretsd-p2pSocket"));
-        const QString address = QString::fromUtf8("unix:path=%1").arg(socketFile);
+        return QString::fromUtf8("%1/%2").arg(dir.absolutePath(), QLatin1String("sailfishsecretsd-p2pSocket"));
+    }
+
+    int configuredLimit(const char *environmentVariable, int defaultValue)
+    {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue(environmentVariable, &ok);
+        return ok ? value : defaultValue;
+    }
 
-        return address;
+    // Whether systemd passed us the listening p2p socket, see sd_listen_fds(3).
+    bool socketActivated()
+    {
+        return qEnvironmentVariableIntValue("LISTEN_PID") == int(getpid())
+                && qEnvironmentVariableIntValue("LISTEN_FDS") >= 1;
     }
 }
 
+Sailfish::Secrets::Daemon::ClientConnectionWatcher::ClientConnectionWatcher(
+        pid_t pid,
+        const QDBusConnection &connection,
+        QObject *parent)
+    : QObject(parent)
+    , m_pid(pid)
+{
+    QDBusConnection clientConnection(connection);
+    clientConnection.connect(QString(), // any service
+                             QLatin1String("/org/freedesktop/DBus/Local"),
+                             QLatin1String("org.freedesktop.DBus.Local"),
+                             QLatin1String("Disconnected"),
+                             this, SLOT(disconnected()));
+}
+
+void Sailfish::Secrets::Daemon::ClientConnectionWatcher::disconnected()
+{
+    emit clientDisconnected(m_pid);
+    deleteLater();
+}
+
 Sailfish::Secrets::Daemon::Controller::Controller(const QString &secretsPluginDir,
                                                   const QString &cryptoPluginDir,
                                                   bool autotestMode, QObject *parent)
     : QObject(parent)
+    , m_dbusServer(Q_NULLPTR)
+    , m_secretsDiscoveryObject(Q_NULLPTR)
+    , m_cryptoDiscoveryObject(Q_NULLPTR)
+    , m_statisticsObject(Q_NULLPTR)
+    , m_memoryAccounting(Q_NULLPTR)
+    , m_databaseMaintenance(Q_NULLPTR)
+    , m_secrets(Q_NULLPTR)
+    , m_crypto(Q_NULLPTR)
     , m_secretsPluginDir(secretsPluginDir)
     , m_cryptoPluginDir(cryptoPluginDir)
     , m_autotestMode(autotestMode)
+    , m_socketActivated(socketActivated())
     , m_isValid(false)
+    , m_connectedClients(0)
 {
-    // Initialise the various API implementation objects.
-    // These objects provide Peer-To-Peer DBus API.
-    m_secrets = new Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue(this, secretsPluginDir, autotestMode);
-    m_crypto = new Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue(this, m_secrets, cryptoPluginDir, autotestMode);
+    // Preallocate locked memory for authentication keys and cached plaintext.
+    // Caching decrypted secrets is opt-in, as it keeps plaintext in (locked) memory.
+    const int secretCacheKBytes = configuredLimit("SAILFISH_SECRETSD_SECRET_CACHE_KBYTES", 0);
+    const int secureMemoryKBytes = configuredLimit("SAILFISH_SECRETSD_SECURE_MEMORY_KBYTES", 64);
+    Sailfish::Secrets::Daemon::SecureArena::instance()->initialise(
+            (qint64(secureMemoryKBytes) + qint64(secretCacheKBytes)) * 1024);
+
+    // When socket activated, the daemon exits once it has had no clients for this long,
+    // and is started again by the next connection.  Zero (the default) means it stays resident.
+    const int idleExitSecs = m_socketActivated ? configuredLimit("SAILFISH_SECRETSD_IDLE_EXIT_SECS", 0) : 0;
+    if (idleExitSecs > 0) {
+        m_idleTimer.setSingleShot(true);
+        m_idleTimer.setInterval(idleExitSecs * 1000);
+        connect(&m_idleTimer, &QTimer::timeout,
+                this, &Sailfish::Secrets::Daemon::Controller::exitIfIdle);
+        m_idleTimer.start();
+    }
+
+    // When started by systemd, the plugins and databases are only loaded once
+    // the first client connects, so that an unused daemon stays small.
+    if (!m_socketActivated) {
+        startSubsystems();
+    }
 
     // Determine the p2p socket address.
-    const QString p2pDBusSocketAddress = p2pSocketAddress();
-    if (p2pDBusSocketAddress.isEmpty()) {
+    const QString p2pDBusSocketFile = p2pSocketFile();
+    if (p2pDBusSocketFile.isEmpty()) {
         qCWarning(lcSailfishSecretsDaemon) << "Failed to determine p2p socket file location!";
         return;
     }
+    const QString p2pDBusSocketAddress = QString::fromUtf8("unix:path=%1").arg(p2pDBusSocketFile);
 
     // Initialise the discovery objects and register them on the session bus.
     // This allows clients who don't know the P2P socket file path to discover it via DBus.
@@ -80,14 +155,125 @@ Sailfish::Secrets::Daemon::Controller::Controller(const QString &secretsPluginDi
     m_secretsDiscoveryObject->setPeerToPeerAddress(p2pDBusSocketAddress);
     m_cryptoDiscoveryObject->setPeerToPeerAddress(p2pDBusSocketAddress);
 
-    // Initialise the Peer-To-Peer DBus server.
-    m_dbusServer = new QDBusServer(p2pDBusSocketAddress, this);
+    // Initialise the Peer-To-Peer DBus server.  When socket activated, the
+    // server accepts connections on the socket which systemd created and
+    // listened on at the same path (with the same permissions) for us.
+    m_dbusServer = new QDBusServer(m_socketActivated ? QString::fromUtf8("systemd:") : p2pDBusSocketAddress, this);
     connect(m_dbusServer, &QDBusServer::newConnection,
             this, &Sailfish::Secrets::Daemon::Controller::handleClientConnection);
 
+    // The runtime directory is already private to the user, but restrict
+    // the well-known socket file itself too, since clients connect to it directly.
+    if (!m_socketActivated
+            && !QFile::setPermissions(p2pDBusSocketFile, QFileDevice::ReadOwner | QFileDevice::WriteOwner)) {
+        qCWarning(lcSailfishSecretsDaemon) << "Failed to restrict permissions of p2p socket file:" << p2pDBusSocketFile;
+    }
+
     m_isValid = true;
 }
 
+void Sailfish::Secrets::Daemon::Controller::startSubsystems()
+{
+    if (m_secrets) {
+        return;
+    }
+
+    // Initialise the various API implementation objects.
+    // These objects provide Peer-To-Peer DBus API.
+    m_secrets = new Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue(this, m_secretsPluginDir, m_autotestMode);
+    m_crypto = new Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue(this, m_secrets, m_cryptoPluginDir, m_autotestMode);
+
+    // Bound the work which clients can queue up.  Zero means unlimited.
+    const int maxRequestsPerCaller = configuredLimit("SAILFISH_SECRETSD_MAX_REQUESTS_PER_CLIENT", 64);
+    const int maxQueueDepth = configuredLimit("SAILFISH_SECRETSD_MAX_QUEUE_DEPTH", 1024);
+    const qint64 maxQueuedBytes = qint64(configuredLimit("SAILFISH_SECRETSD_MAX_QUEUED_KBYTES", 64 * 1024)) * 1024;
+    m_secrets->setAdmissionLimits(maxRequestsPerCaller, maxQueueDepth, maxQueuedBytes);
+    m_crypto->setAdmissionLimits(maxRequestsPerCaller, maxQueueDepth, maxQueuedBytes);
+
+    // Each pass over a request queue returns to the event loop after between the minimum and
+    // maximum budget, the shorter the more often client requests are arriving.  Setting the
+    // minimum to the maximum gives a fixed budget.
+    const qint64 maxYieldBudgetUsecs = qint64(configuredLimit("SAILFISH_SECRETSD_MAX_YIELD_BUDGET_MS", 100)) * 1000;
+    const qint64 minYieldBudgetUsecs = qint64(configuredLimit("SAILFISH_SECRETSD_MIN_YIELD_BUDGET_MS", 5)) * 1000;
+    if (minYieldBudgetUsecs >= maxYieldBudgetUsecs) {
+        m_secrets->setYieldPolicy(new Sailfish::Secrets::Daemon::FixedYieldPolicy(maxYieldBudgetUsecs));
+        m_crypto->setYieldPolicy(new Sailfish::Secrets::Daemon::FixedYieldPolicy(maxYieldBudgetUsecs));
+    } else {
+        m_secrets->setYieldPolicy(new Sailfish::Secrets::Daemon::AdaptiveYieldPolicy(minYieldBudgetUsecs, maxYieldBudgetUsecs));
+        m_crypto->setYieldPolicy(new Sailfish::Secrets::Daemon::AdaptiveYieldPolicy(minYieldBudgetUsecs, maxYieldBudgetUsecs));
+    }
+
+    // Applications which use more than their quota of the daemon's CPU time, storage writes or
+    // database syncs in a window have their requests handled after others' until the window
+    // ends, and no more of their data is cached once they hold their cache quota.  Zero means
+    // unlimited, and each is unlimited by default.
+    Sailfish::Secrets::Daemon::ApplicationAccounting::Quotas quotas;
+    quotas.cpuUsecs = qint64(configuredLimit("SAILFISH_SECRETSD_APP_CPU_QUOTA_MS", 0)) * 1000;
+    quotas.bytesWritten = qint64(configuredLimit("SAILFISH_SECRETSD_APP_WRITE_QUOTA_KBYTES", 0)) * 1024;
+    quotas.syncs = configuredLimit("SAILFISH_SECRETSD_APP_SYNC_QUOTA", 0);
+    quotas.cacheBytes = qint64(configuredLimit("SAILFISH_SECRETSD_APP_CACHE_QUOTA_KBYTES", 0)) * 1024;
+    Sailfish::Secrets::Daemon::ApplicationAccounting::instance()->setQuotas(
+            quotas, configuredLimit("SAILFISH_SECRETSD_APP_QUOTA_WINDOW_SECS", 60));
+
+    m_secrets->setSecretCacheCapacity(qint64(configuredLimit("SAILFISH_SECRETSD_SECRET_CACHE_KBYTES", 0)) * 1024);
+
+    // The secrets which system services read as soon as the device is unlocked are
+    // read into the secret cache together, rather than by each service in turn.
+    const QByteArray preloadManifest = qgetenv("SAILFISH_SECRETSD_PRELOAD_MANIFEST");
+    m_secrets->preloadSecrets(preloadManifest.isNull()
+            ? QStringLiteral("/etc/sailfish-secrets/preload.conf")
+            : QString::fromLocal8Bit(preloadManifest));
+
+    // Large secrets are encrypted and decrypted a chunk at a time.  Zero stores every secret whole.
+    m_secrets->setSecretChunkSize(configuredLimit("SAILFISH_SECRETSD_SECRET_CHUNK_KBYTES", 1024) * 1024);
+
+    // Commit secret values and their metadata in one transaction.  Off by default.
+    m_secrets->setSharedStorageTransactions(configuredLimit("SAILFISH_SECRETSD_SHARED_STORAGE_TRANSACTIONS", 0) > 0);
+
+    // Group commit trades reply latency for fewer syncs of the databases.  Off by default.
+    m_secrets->setGroupCommit(configuredLimit("SAILFISH_SECRETSD_GROUP_COMMIT_MS", 0),
+                              configuredLimit("SAILFISH_SECRETSD_GROUP_COMMIT_BATCH", 32));
+
+    // Operations submitted at once to each hardware-backed crypto plugin.  Zero means as many as the plugin accepts.
+    m_crypto->setPluginJobQueueDepth(configuredLimit("SAILFISH_SECRETSD_PLUGIN_JOB_QUEUE_DEPTH", 0));
+
+    // Vendor crypto plugins may be loaded by separate, restartable host processes instead of
+    // by the daemon, e.g. "org.example.crypto.tee:2" for two processes.  None by default.
+    m_crypto->setPluginHosts(QString::fromLocal8Bit(qgetenv("SAILFISH_SECRETSD_CRYPTO_PLUGIN_HOSTS")));
+
+    // Slow asymmetric keys may be generated ahead of time, on an idle-priority thread,
+    // e.g. "org.sailfishos.crypto.plugin.crypto.openssl:rsa:4096:2".  Off by default.
+    m_crypto->setKeyPool(QString::fromLocal8Bit(qgetenv("SAILFISH_SECRETSD_KEY_POOL")));
+
+    // The caches are released whenever the sampled memory use exceeds the budget.  Zero means unlimited.
+    m_memoryAccounting = new Sailfish::Secrets::Daemon::MemoryAccounting(
+            m_secrets, m_crypto,
+            QStringList() << m_secretsPluginDir << m_cryptoPluginDir,
+            qint64(configuredLimit("SAILFISH_SECRETSD_MEMORY_BUDGET_KBYTES", 0)) * 1024,
+            this);
+
+    // The databases are checkpointed, vacuumed and analyzed in steps of at most the given
+    // number of pages, once the daemon has been idle for long enough.  Zero disables it.
+    const int maintenanceIntervalSecs = configuredLimit("SAILFISH_SECRETSD_MAINTENANCE_INTERVAL_SECS", 60);
+    if (maintenanceIntervalSecs > 0) {
+        m_databaseMaintenance = new Sailfish::Secrets::Daemon::DatabaseMaintenance(
+                m_secrets, m_crypto,
+                maintenanceIntervalSecs * 1000,
+                configuredLimit("SAILFISH_SECRETSD_MAINTENANCE_IDLE_SECS", 10) * 1000,
+                configuredLimit("SAILFISH_SECRETSD_MAINTENANCE_PAGES", 1024),
+                this);
+    }
+
+    // The statistics object is purely informational, so failing to register it is not fatal.
+    // When socket activated, it is only registered once the first client has connected.
+    m_statisticsObject = new Sailfish::Secrets::Daemon::StatisticsObject(
+            m_secrets, m_crypto, m_memoryAccounting, m_databaseMaintenance, this);
+    if (!m_statisticsObject->registerObject(QString::fromUtf8("org.sailfishos.secrets.daemon.statistics"),
+                                            QString::fromUtf8("/Sailfish/Secrets/Statistics"))) {
+        qCWarning(lcSailfishSecretsDaemon) << "Failed to register statistics object on session bus!";
+    }
+}
+
 Sailfish::Secrets::Daemon::Controller::~Controller()
 {
 }
@@ -96,7 +282,49 @@ void Sailfish::Secrets::Daemon::Controller::handleClientConnection(const QDBusCo
 {
     qCDebug(lcSailfishSecretsDaemon) << "New client p2p connection received!" << connection.name();
 
+    startSubsystems();
+
     // Each API implementation needs to register its DBus API object with the connection.
     m_secrets->handleClientConnection(connection);
     m_crypto->handleClientConnection(connection);
+
+    pid_t pid = 0;
+    if (Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::connectionPid(connection, &pid)) {
+        m_connectedClients++;
+        m_idleTimer.stop();
+        m_secrets->handleClientConnected(pid);
+        Sailfish::Secrets::Daemon::ClientConnectionWatcher *watcher
+                = new Sailfish::Secrets::Daemon::ClientConnectionWatcher(pid, connection, this);
+        connect(watcher, &Sailfish::Secrets::Daemon::ClientConnectionWatcher::clientDisconnected,
+                this, &Sailfish::Secrets::Daemon::Controller::handleClientDisconnection);
+    }
+}
+
+void Sailfish::Secrets::Daemon::Controller::handleClientDisconnection(pid_t pid)
+{
+    qCDebug(lcSailfishSecretsDaemon) << "Client p2p connection closed for pid:" << pid;
+    m_secrets->handleClientDisconnected(pid);
+    if (--m_connectedClients == 0 && m_idleTimer.interval() > 0) {
+        m_idleTimer.start();
+    }
+}
+
+void Sailfish::Secrets::Daemon::Controller::exitIfIdle()
+{
+    if (m_connectedClients > 0) {
+        return;
+    }
+
+    // unlocked custom lock collections would have to be unlocked again by the user,
+    // so the daemon stays resident until they are locked (or time out).
+    if (m_secrets && (!m_secrets->isIdle() || !m_crypto->isIdle())) {
+        m_idleTimer.start();
+        return;
+    }
+
+    qCDebug(lcSailfishSecretsDaemon) << "No clients for" << m_idleTimer.interval() << "ms, exiting";
+    if (m_secrets) {
+        m_secrets->prepareWarmRestart();
+    }
+    QCoreApplication::quit();
 }
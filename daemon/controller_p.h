@@ -16,6 +16,9 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtCore/QTimer>
+
+#include <sys/types.h>
 
 namespace Sailfish {
 
@@ -33,10 +36,31 @@ namespace Secrets {
 namespace Daemon {
 
 class DiscoveryObject;
+class StatisticsObject;
+class MemoryAccounting;
+class DatabaseMaintenance;
 namespace ApiImpl {
     class SecretsRequestQueue;
 }
 
+// Notifies the controller when a client's p2p connection is closed.
+class ClientConnectionWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    ClientConnectionWatcher(pid_t pid, const QDBusConnection &connection, QObject *parent = Q_NULLPTR);
+
+Q_SIGNALS:
+    void clientDisconnected(pid_t pid);
+
+private Q_SLOTS:
+    void disconnected();
+
+private:
+    pid_t m_pid;
+};
+
 class Controller : public QObject
 {
     Q_OBJECT
@@ -49,17 +73,30 @@ public:
 
 public Q_SLOTS:
     void handleClientConnection(const QDBusConnection &connection);
+    void handleClientDisconnection(pid_t pid);
+
+private Q_SLOTS:
+    void exitIfIdle();
 
 private:
+    // Creates the request queues, which load the plugins and open the databases.
+    void startSubsystems();
+
     QDBusServer *m_dbusServer;
     Sailfish::Secrets::Daemon::DiscoveryObject *m_secretsDiscoveryObject;
     Sailfish::Crypto::Daemon::DiscoveryObject *m_cryptoDiscoveryObject;
+    Sailfish::Secrets::Daemon::StatisticsObject *m_statisticsObject;
+    Sailfish::Secrets::Daemon::MemoryAccounting *m_memoryAccounting;
+    Sailfish::Secrets::Daemon::DatabaseMaintenance *m_databaseMaintenance;
     Sailfish::Secrets::Daemon::ApiImpl::SecretsRequestQueue *m_secrets;
     Sailfish::Crypto::Daemon::ApiImpl::CryptoRequestQueue *m_crypto;
     QString m_secretsPluginDir;
     QString m_cryptoPluginDir;
     bool m_autotestMode;
+    bool m_socketActivated;
     bool m_isValid;
+    int m_connectedClients;
+    QTimer m_idleTimer;
 };
 
 } // namespace Daemon
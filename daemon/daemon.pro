@@ -5,20 +5,46 @@ include($$PWD/../common.pri)
 include($$PWD/../api/libsailfishsecrets/libsailfishsecrets.pri)
 include($$PWD/../api/libsailfishcrypto/libsailfishcrypto.pri)
 
-QT += sql dbus
+QT += sql dbus concurrent
 
 CONFIG += link_pkgconfig
-PKGCONFIG += dbus-1
+PKGCONFIG += dbus-1 sqlite3
+
+# per-request trace spans are compiled in with "qmake CONFIG+=tracing", see tracing_p.h
+tracing {
+    DEFINES += SAILFISH_SECRETS_TRACING
+}
 
 HEADERS += \
     $$PWD/controller_p.h \
     $$PWD/discoveryobject_p.h \
+    $$PWD/statisticsobject_p.h \
+    $$PWD/memoryaccounting_p.h \
+    $$PWD/applicationaccounting_p.h \
+    $$PWD/databasemaintenance_p.h \
     $$PWD/logging_p.h \
-    $$PWD/requestqueue_p.h
+    $$PWD/requestqueue_p.h \
+    $$PWD/pluginregistry_p.h \
+    $$PWD/pluginhostchannel_p.h \
+    $$PWD/requeststatistics_p.h \
+    $$PWD/sharedmemory_p.h \
+    $$PWD/securememory_p.h \
+    $$PWD/tracing_p.h \
+    $$PWD/yieldpolicy_p.h
 
 SOURCES += \
     $$PWD/controller.cpp \
     $$PWD/requestqueue.cpp \
+    $$PWD/memoryaccounting.cpp \
+    $$PWD/applicationaccounting.cpp \
+    $$PWD/databasemaintenance.cpp \
+    $$PWD/pluginregistry.cpp \
+    $$PWD/pluginhostchannel.cpp \
+    $$PWD/requeststatistics.cpp \
+    $$PWD/sharedmemory.cpp \
+    $$PWD/securememory.cpp \
+    $$PWD/tracing.cpp \
+    $$PWD/yieldpolicy.cpp \
     $$PWD/main.cpp
 
 include($$PWD/SecretsImpl/SecretsImpl.pri)
@@ -26,3 +52,13 @@ include($$PWD/CryptoImpl/CryptoImpl.pri)
 
 target.path = /usr/bin/
 INSTALLS += target
+
+# the daemon is started on demand, by a client connecting to the p2p socket or the discovery service.
+systemd.files = $$PWD/systemd/sailfish-secretsd.service $$PWD/systemd/sailfish-secretsd.socket
+systemd.path = /usr/lib/systemd/user/
+dbusservices.files = \
+    $$PWD/dbus/org.sailfishos.secrets.daemon.discovery.service \
+    $$PWD/dbus/org.sailfishos.crypto.daemon.discovery.service
+dbusservices.path = /usr/share/dbus-1/services/
+INSTALLS += systemd dbusservices
+OTHER_FILES += $$systemd.files $$dbusservices.files
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "databasemaintenance_p.h"
+#include "requestqueue_p.h"
+#include "logging_p.h"
+
+#include <QtCore/QElapsedTimer>
+
+Sailfish::Secrets::Daemon::DatabaseMaintenance::DatabaseMaintenance(
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *secrets,
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *crypto,
+        int intervalMs,
+        int idleMs,
+        int pageBudget,
+        QObject *parent)
+    : QObject(parent)
+    , m_secrets(secrets)
+    , m_crypto(crypto)
+    , m_idleMs(idleMs)
+    , m_pageBudget(pageBudget)
+    , m_stepCount(0)
+    , m_deferredCount(0)
+    , m_busyCount(0)
+    , m_pagesUsed(0)
+{
+    m_timer.setInterval(intervalMs);
+    connect(&m_timer, &QTimer::timeout,
+            this, &Sailfish::Secrets::Daemon::DatabaseMaintenance::step);
+    m_timer.start();
+}
+
+void Sailfish::Secrets::Daemon::DatabaseMaintenance::step()
+{
+    // crypto requests read and write keys via the secrets database too.
+    if (m_secrets->idleMsecs() < m_idleMs || m_crypto->idleMsecs() < m_idleMs) {
+        m_deferredCount++;
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const int pages = m_secrets->performMaintenance(m_pageBudget);
+    m_stepLatency.record(timer.nsecsElapsed() / 1000);
+    m_stepCount++;
+
+    if (pages < 0) {
+        // a transaction was open, e.g. a grouped commit; try again next interval.
+        m_busyCount++;
+    } else {
+        m_pagesUsed += pages;
+        qCDebug(lcSailfishSecretsDaemon) << "Database maintenance used" << pages << "of" << m_pageBudget
+                                         << "pages in" << timer.elapsed() << "ms";
+    }
+}
+
+QVariantMap Sailfish::Secrets::Daemon::DatabaseMaintenance::statistics() const
+{
+    QVariantMap stats;
+    stats.insert(QStringLiteral("intervalMs"), m_timer.interval());
+    stats.insert(QStringLiteral("idleMs"), m_idleMs);
+    stats.insert(QStringLiteral("pageBudget"), m_pageBudget);
+    stats.insert(QStringLiteral("stepCount"), m_stepCount);
+    stats.insert(QStringLiteral("deferredCount"), m_deferredCount);
+    stats.insert(QStringLiteral("busyCount"), m_busyCount);
+    stats.insert(QStringLiteral("pagesUsed"), m_pagesUsed);
+    stats.insert(QStringLiteral("stepLatency"), m_stepLatency.toVariantMap());
+    return stats;
+}
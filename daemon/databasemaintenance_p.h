@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_DATABASEMAINTENANCE_P_H
+#define SAILFISHSECRETS_DAEMON_DATABASEMAINTENANCE_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtCore/QVariantMap>
+
+#include "requeststatistics_p.h"
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace ApiImpl {
+    class RequestQueue;
+}
+
+// Periodically maintains the databases of the daemon and its storage plugins
+// (checkpointing, releasing free pages and refreshing the query planner's
+// statistics), but only once neither request queue has had any activity for
+// the idle period, and with at most roughly the page budget of I/O per step,
+// so that maintenance doesn't compete with clients for the disk.
+class DatabaseMaintenance : public QObject
+{
+    Q_OBJECT
+
+public:
+    DatabaseMaintenance(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *secrets,
+                        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *crypto,
+                        int intervalMs,
+                        int idleMs,
+                        int pageBudget,
+                        QObject *parent = Q_NULLPTR);
+
+    QVariantMap statistics() const;
+
+public Q_SLOTS:
+    void step();
+
+private:
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *m_secrets;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *m_crypto;
+    int m_idleMs;
+    int m_pageBudget;
+    quint64 m_stepCount;
+    quint64 m_deferredCount;
+    quint64 m_busyCount;
+    quint64 m_pagesUsed;
+    Sailfish::Secrets::Daemon::LatencyHistogram m_stepLatency;
+    QTimer m_timer;
+};
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_DATABASEMAINTENANCE_P_H
@@ -10,6 +10,7 @@
 #include <QtCore/QDir>
 
 #include "controller_p.h"
+#include "CryptoImpl/cryptopluginhost_p.h"
 #include "logging_p.h"
 
 Q_LOGGING_CATEGORY(lcSailfishSecretsDaemon, "org.sailfishos.secrets.daemon")
@@ -28,8 +29,13 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
     QCoreApplication::addLibraryPath(cryptoPluginDir);
     QCoreApplication app(argc, argv);
 
-    bool autotestMode = false;
+    // the daemon runs itself to host crypto plugins out of process.
     QStringList args = app.arguments();
+    if (args.size() > 1 && args[1] == QLatin1String("--crypto-plugin-host")) {
+        return Sailfish::Crypto::Daemon::ApiImpl::runCryptoPluginHost(args);
+    }
+
+    bool autotestMode = false;
     if (args.size() > 1 &&
             (args[1] == QLatin1String("test") ||
              args[1] == QLatin1String("-test") ||
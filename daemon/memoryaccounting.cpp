@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "memoryaccounting_p.h"
+#include "requestqueue_p.h"
+#include "securememory_p.h"
+#include "logging_p.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QDir>
+
+#include <sqlite3.h>
+
+#include <limits.h>
+
+namespace {
+    // the gauges are sampled rather than updated on every allocation, so
+    // short-lived peaks between samples are not reflected in the high-water marks.
+    const int SampleIntervalMs = 5000;
+
+    void insertUsage(QMap<QString, Sailfish::Secrets::Daemon::MemoryGauge> *subsystems,
+                     const QString &prefix,
+                     const QMap<QString, qint64> &usage,
+                     qint64 *total)
+    {
+        for (QMap<QString, qint64>::const_iterator it = usage.constBegin(); it != usage.constEnd(); ++it) {
+            (*subsystems)[prefix + it.key()].set(it.value());
+            *total += it.value();
+        }
+    }
+}
+
+Sailfish::Secrets::Daemon::MemoryAccounting::MemoryAccounting(
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *secrets,
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *crypto,
+        const QStringList &pluginDirs,
+        qint64 budgetBytes,
+        QObject *parent)
+    : QObject(parent)
+    , m_secrets(secrets)
+    , m_crypto(crypto)
+    , m_budgetBytes(budgetBytes)
+    , m_pressureCount(0)
+{
+    Q_FOREACH (const QString &pluginDir, pluginDirs) {
+        m_pluginDirs.append(QDir(pluginDir).canonicalPath() + QLatin1Char('/'));
+    }
+
+    m_timer.setInterval(SampleIntervalMs);
+    connect(&m_timer, &QTimer::timeout,
+            this, &Sailfish::Secrets::Daemon::MemoryAccounting::sample);
+    m_timer.start();
+}
+
+// The resident size of the plugin libraries, from the mappings of their files.
+qint64 Sailfish::Secrets::Daemon::MemoryAccounting::pluginBytes() const
+{
+    QFile smaps(QStringLiteral("/proc/self/smaps"));
+    if (!smaps.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    qint64 bytes = 0;
+    bool pluginMapping = false;
+    const QList<QByteArray> lines = smaps.readAll().split('\n');
+    Q_FOREACH (const QByteArray &line, lines) {
+        if (line.isEmpty()) {
+            continue;
+        }
+        if (line.startsWith("Rss:")) {
+            if (pluginMapping) {
+                bytes += line.mid(4).trimmed().split(' ').first().toLongLong() * 1024;
+            }
+        } else if (!line.left(line.indexOf(' ')).endsWith(':')) {
+            // a mapping header, "start-end perms offset dev inode path", rather than a field.
+            const int pathIndex = line.indexOf('/');
+            pluginMapping = false;
+            if (pathIndex >= 0) {
+                const QString path = QString::fromLocal8Bit(line.mid(pathIndex));
+                Q_FOREACH (const QString &pluginDir, m_pluginDirs) {
+                    if (path.startsWith(pluginDir)) {
+                        pluginMapping = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return bytes;
+}
+
+void Sailfish::Secrets::Daemon::MemoryAccounting::sample()
+{
+    qint64 total = 0;
+
+    QMap<QString, qint64> secretsUsage;
+    m_secrets->memoryUsage(&secretsUsage);
+    insertUsage(&m_subsystems, QStringLiteral("secrets."), secretsUsage, &total);
+
+    QMap<QString, qint64> cryptoUsage;
+    m_crypto->memoryUsage(&cryptoUsage);
+    insertUsage(&m_subsystems, QStringLiteral("crypto."), cryptoUsage, &total);
+
+    // SQLite reports the heap of every connection in the process,
+    // including those opened by the storage plugins.
+    int sqliteCurrent = 0;
+    int sqliteHighWater = 0;
+    if (sqlite3_status(SQLITE_STATUS_MEMORY_USED, &sqliteCurrent, &sqliteHighWater, 0) == SQLITE_OK) {
+        // SQLite tracks its own high-water mark, which also covers the peaks between samples.
+        Sailfish::Secrets::Daemon::MemoryGauge &sqlite(m_subsystems[QStringLiteral("sqlite")]);
+        sqlite.set(sqliteHighWater);
+        sqlite.set(sqliteCurrent);
+        total += sqliteCurrent;
+    }
+
+    // the authentication keys and cached secrets are allocated from the secure
+    // arena (or its overflow mappings), so it is reported alongside them but not added to the total.
+    Sailfish::Secrets::Daemon::SecureArena *secureArena = Sailfish::Secrets::Daemon::SecureArena::instance();
+    m_subsystems[QStringLiteral("secureArena")].set(secureArena->used() + secureArena->overflowUsed());
+
+    const qint64 plugins = pluginBytes();
+    m_subsystems[QStringLiteral("plugins")].set(plugins);
+    total += plugins;
+
+    m_total.set(total);
+
+    if (m_budgetBytes > 0 && total > m_budgetBytes) {
+        // the caches are rebuilt on demand, so releasing them costs only latency.
+        qCWarning(lcSailfishSecretsDaemon) << "Memory use of" << total << "bytes exceeds the budget of"
+                                           << m_budgetBytes << "bytes, releasing caches";
+        m_pressureCount++;
+        m_secrets->releaseMemory();
+        m_crypto->releaseMemory();
+        sqlite3_release_memory(int(qMin<qint64>(total - m_budgetBytes, INT_MAX)));
+    }
+}
+
+QVariantMap Sailfish::Secrets::Daemon::MemoryAccounting::statistics() const
+{
+    QVariantMap subsystems;
+    for (QMap<QString, Sailfish::Secrets::Daemon::MemoryGauge>::const_iterator it = m_subsystems.constBegin();
+            it != m_subsystems.constEnd(); ++it) {
+        subsystems.insert(it.key(), it.value().toVariantMap());
+    }
+
+    QVariantMap stats;
+    stats.insert(QStringLiteral("subsystems"), subsystems);
+    stats.insert(QStringLiteral("total"), m_total.toVariantMap());
+    stats.insert(QStringLiteral("budgetBytes"), m_budgetBytes);
+    stats.insert(QStringLiteral("pressureCount"), m_pressureCount);
+    return stats;
+}
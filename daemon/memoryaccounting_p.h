@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_MEMORYACCOUNTING_P_H
+#define SAILFISHSECRETS_DAEMON_MEMORYACCOUNTING_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QMap>
+#include <QtCore/QTimer>
+#include <QtCore/QVariantMap>
+
+#include "requeststatistics_p.h"
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace ApiImpl {
+    class RequestQueue;
+}
+
+// Periodically samples the memory held by each subsystem of the daemon:
+// the request queues and the caches of their processors, SQLite, the
+// secure arena and the loaded plugins.  If a budget is given and the total
+// exceeds it, the caches of the request queues are released.
+class MemoryAccounting : public QObject
+{
+    Q_OBJECT
+
+public:
+    MemoryAccounting(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *secrets,
+                     Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *crypto,
+                     const QStringList &pluginDirs,
+                     qint64 budgetBytes,
+                     QObject *parent = Q_NULLPTR);
+
+    QVariantMap statistics() const;
+
+public Q_SLOTS:
+    void sample();
+
+private:
+    qint64 pluginBytes() const;
+
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *m_secrets;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *m_crypto;
+    QStringList m_pluginDirs;
+    qint64 m_budgetBytes;
+    QMap<QString, Sailfish::Secrets::Daemon::MemoryGauge> m_subsystems;
+    Sailfish::Secrets::Daemon::MemoryGauge m_total;
+    quint64 m_pressureCount;
+    QTimer m_timer;
+};
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_MEMORYACCOUNTING_P_H
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "pluginhostchannel_p.h"
+
+#include <QtCore/QAtomicInteger>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+namespace {
+    const quint32 ChannelMagic = 0x53504843; // "SPHC"
+    const qint64 DataOffset = 4096;
+    const quint32 MaximumRingSize = 64 * 1024 * 1024;
+
+    enum Ring {
+        RequestRing = 0,
+        ResponseRing
+    };
+
+    // the positions are byte counts modulo 2^32, so the ring size is a power of two.
+    // The producer only writes the head, and the consumer only the tail, each in its own cache line.
+    struct RingPositions {
+        QAtomicInteger<quint32> head;
+        char headPadding[64 - sizeof(QAtomicInteger<quint32>)];
+        QAtomicInteger<quint32> tail;
+        char tailPadding[64 - sizeof(QAtomicInteger<quint32>)];
+    };
+
+    struct ChannelHeader {
+        quint32 magic;
+        quint32 ringSize;
+        char padding[56];
+        RingPositions rings[2];
+    };
+    Q_STATIC_ASSERT(sizeof(ChannelHeader) <= DataOffset);
+
+    QString errnoString(const char *operation)
+    {
+        return QString::fromLatin1("%1 failed: %2").arg(QLatin1String(operation), QString::fromLocal8Bit(strerror(errno)));
+    }
+
+    void closeDescriptor(int *fd)
+    {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+
+    void copyIn(char *ring, quint32 ringSize, quint32 position, const char *data, quint32 size)
+    {
+        const quint32 offset = position & (ringSize - 1);
+        const quint32 first = qMin(size, ringSize - offset);
+        memcpy(ring + offset, data, first);
+        memcpy(ring, data + first, size - first);
+    }
+
+    void copyOut(char *ring, quint32 ringSize, quint32 position, char *data, quint32 size)
+    {
+        const quint32 offset = position & (ringSize - 1);
+        const quint32 first = qMin(size, ringSize - offset);
+        memcpy(data, ring + offset, first);
+        memcpy(data + first, ring, size - first);
+        memset(ring + offset, 0, first);
+        memset(ring, 0, size - first);
+    }
+}
+
+Sailfish::Secrets::Daemon::PluginHostChannel::PluginHostChannel()
+    : m_memory(Q_NULLPTR)
+    , m_memorySize(0)
+    , m_ringSize(0)
+    , m_memoryFd(-1)
+    , m_requestFd(-1)
+    , m_responseFd(-1)
+    , m_livenessReadFd(-1)
+    , m_livenessWriteFd(-1)
+{
+}
+
+Sailfish::Secrets::Daemon::PluginHostChannel::~PluginHostChannel()
+{
+    close();
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::create(int ringSize, QString *errorString)
+{
+    close();
+
+    m_ringSize = 4096;
+    while (m_ringSize < quint32(qMax(ringSize, 0)) && m_ringSize < MaximumRingSize) {
+        m_ringSize *= 2;
+    }
+    m_memorySize = DataOffset + 2 * qint64(m_ringSize);
+
+    // not close-on-exec, until releaseHostDescriptors(), so that the host inherits them.
+    int livenessPipe[2];
+    m_memoryFd = static_cast<int>(syscall(SYS_memfd_create, "sailfishsecretsd-pluginhost", 0));
+    if (m_memoryFd < 0) {
+        *errorString = errnoString("memfd_create");
+    } else if (ftruncate(m_memoryFd, m_memorySize) != 0) {
+        *errorString = errnoString("ftruncate");
+    } else if ((m_requestFd = eventfd(0, EFD_NONBLOCK)) < 0
+            || (m_responseFd = eventfd(0, EFD_NONBLOCK)) < 0) {
+        *errorString = errnoString("eventfd");
+    } else if (pipe(livenessPipe) != 0) {
+        *errorString = errnoString("pipe");
+    } else {
+        m_livenessReadFd = livenessPipe[0];
+        m_livenessWriteFd = livenessPipe[1];
+        fcntl(m_livenessReadFd, F_SETFD, FD_CLOEXEC);
+        if (map(errorString)) {
+            ChannelHeader *header = reinterpret_cast<ChannelHeader *>(m_memory);
+            header->ringSize = m_ringSize;
+            header->magic = ChannelMagic;
+            return true;
+        }
+    }
+
+    close();
+    return false;
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::attach(int memoryFd, int requestFd, int responseFd, QString *errorString)
+{
+    close();
+    m_memoryFd = memoryFd;
+    m_requestFd = requestFd;
+    m_responseFd = responseFd;
+
+    struct stat st;
+    if (fstat(m_memoryFd, &st) != 0) {
+        *errorString = errnoString("fstat");
+        close();
+        return false;
+    }
+    m_memorySize = st.st_size;
+    if (m_memorySize <= DataOffset || !map(errorString)) {
+        close();
+        return false;
+    }
+
+    const ChannelHeader *header = reinterpret_cast<const ChannelHeader *>(m_memory);
+    m_ringSize = header->ringSize;
+    if (header->magic != ChannelMagic
+            || m_ringSize == 0 || (m_ringSize & (m_ringSize - 1)) != 0
+            || DataOffset + 2 * qint64(m_ringSize) != m_memorySize) {
+        *errorString = QLatin1String("Invalid plugin host channel");
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::map(QString *errorString)
+{
+    void *address = mmap(Q_NULLPTR, m_memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, m_memoryFd, 0);
+    if (address == MAP_FAILED) {
+        *errorString = errnoString("mmap");
+        return false;
+    }
+    m_memory = static_cast<char *>(address);
+    return true;
+}
+
+void Sailfish::Secrets::Daemon::PluginHostChannel::close()
+{
+    if (m_memory) {
+        munmap(m_memory, m_memorySize);
+        m_memory = Q_NULLPTR;
+    }
+    m_memorySize = 0;
+    m_ringSize = 0;
+    closeDescriptor(&m_memoryFd);
+    closeDescriptor(&m_requestFd);
+    closeDescriptor(&m_responseFd);
+    closeDescriptor(&m_livenessReadFd);
+    closeDescriptor(&m_livenessWriteFd);
+}
+
+void Sailfish::Secrets::Daemon::PluginHostChannel::releaseHostDescriptors()
+{
+    closeDescriptor(&m_livenessWriteFd);
+    fcntl(m_memoryFd, F_SETFD, FD_CLOEXEC);
+    fcntl(m_requestFd, F_SETFD, FD_CLOEXEC);
+    fcntl(m_responseFd, F_SETFD, FD_CLOEXEC);
+}
+
+int Sailfish::Secrets::Daemon::PluginHostChannel::maximumMessageSize() const
+{
+    return int(qMin<quint32>(m_ringSize - sizeof(quint32), INT_MAX));
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::writeRequest(const QByteArray &message)
+{
+    return write(RequestRing, m_requestFd, message);
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::writeResponse(const QByteArray &message)
+{
+    return write(ResponseRing, m_responseFd, message);
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::readRequest(QByteArray *message)
+{
+    return read(RequestRing, message);
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::readResponse(QByteArray *message)
+{
+    return read(ResponseRing, message);
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::write(int ring, int eventFd, const QByteArray &message)
+{
+    if (!m_memory) {
+        return false;
+    }
+
+    RingPositions &positions(reinterpret_cast<ChannelHeader *>(m_memory)->rings[ring]);
+    char *data = m_memory + DataOffset + ring * qint64(m_ringSize);
+    const quint32 head = positions.head.load();
+    const quint32 tail = positions.tail.loadAcquire();
+    const quint32 used = head - tail;
+    const quint32 length = quint32(message.size());
+    if (used > m_ringSize || qint64(sizeof(length)) + length > qint64(m_ringSize - used)) {
+        return false;
+    }
+
+    copyIn(data, m_ringSize, head, reinterpret_cast<const char *>(&length), sizeof(length));
+    copyIn(data, m_ringSize, head + sizeof(length), message.constData(), length);
+    positions.head.storeRelease(head + sizeof(length) + length);
+    signal(eventFd);
+    return true;
+}
+
+bool Sailfish::Secrets::Daemon::PluginHostChannel::read(int ring, QByteArray *message)
+{
+    if (!m_memory) {
+        return false;
+    }
+
+    RingPositions &positions(reinterpret_cast<ChannelHeader *>(m_memory)->rings[ring]);
+    char *data = m_memory + DataOffset + ring * qint64(m_ringSize);
+    const quint32 tail = positions.tail.load();
+    const quint32 head = positions.head.loadAcquire();
+    const quint32 available = head - tail;
+    if (available == 0) {
+        return false;
+    }
+
+    // the other process may have written anything, so nothing is read past what it claims to have written.
+    quint32 length = 0;
+    if (available > m_ringSize || available < sizeof(length)) {
+        return false;
+    }
+    copyOut(data, m_ringSize, tail, reinterpret_cast<char *>(&length), sizeof(length));
+    if (length > available - sizeof(length)) {
+        return false;
+    }
+
+    message->resize(int(length));
+    copyOut(data, m_ringSize, tail + sizeof(length), message->data(), length);
+    positions.tail.storeRelease(tail + sizeof(length) + length);
+    return true;
+}
+
+void Sailfish::Secrets::Daemon::PluginHostChannel::clearSignal(int eventFd)
+{
+    eventfd_t value = 0;
+    eventfd_read(eventFd, &value);
+}
+
+void Sailfish::Secrets::Daemon::PluginHostChannel::signal(int eventFd)
+{
+    eventfd_write(eventFd, 1);
+}
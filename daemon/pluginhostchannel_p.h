@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_PLUGINHOSTCHANNEL_P_H
+#define SAILFISHSECRETS_DAEMON_PLUGINHOSTCHANNEL_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+// The memory through which the daemon exchanges requests and responses with
+// a plugin host process.  Each direction is a single-producer, single-consumer
+// ring of length-prefixed messages in a memfd which both processes map, and
+// is signalled with an eventfd, so that the consumer is woken once for however
+// many messages were written since it last drained the ring.
+//
+// The daemon does not trust the host: the positions the host writes are
+// checked before any message is read from the response ring.  The host is
+// given the write end of a pipe which it never writes, so that the daemon
+// sees the read end hang up when the host exits, however it exits.
+class PluginHostChannel
+{
+public:
+    PluginHostChannel();
+    ~PluginHostChannel();
+
+    // Creates the memory, eventfds and pipe for a new host, with rings of at least
+    // the given size.  The descriptors are inherited by the next child process.
+    bool create(int ringSize, QString *errorString);
+    // Maps the channel in the host, from the descriptors given to it.
+    bool attach(int memoryFd, int requestFd, int responseFd, QString *errorString);
+    void close();
+
+    bool isValid() const { return m_memory != Q_NULLPTR; }
+
+    // The descriptors to pass to the host process.
+    int memoryFd() const { return m_memoryFd; }
+    int requestFd() const { return m_requestFd; }
+    int responseFd() const { return m_responseFd; }
+    int hostLivenessFd() const { return m_livenessWriteFd; }
+
+    // Called by the daemon once the host has started, so that no other child inherits them.
+    void releaseHostDescriptors();
+
+    // Readable (or hung up) once the host has exited.
+    int hostExitedFd() const { return m_livenessReadFd; }
+
+    // The largest message which fits in a ring.
+    int maximumMessageSize() const;
+
+    // Returns false if the ring hasn't room for the message.  The consumer is signalled.
+    bool writeRequest(const QByteArray &message);
+    bool writeResponse(const QByteArray &message);
+
+    // Returns false once the ring is empty, or if it is corrupt.  The bytes read
+    // are wiped from the ring, as messages may contain key material.
+    bool readRequest(QByteArray *message);
+    bool readResponse(QByteArray *message);
+
+    // Resets the eventfd before the consumer drains the ring.
+    static void clearSignal(int eventFd);
+    static void signal(int eventFd);
+
+private:
+    Q_DISABLE_COPY(PluginHostChannel)
+    bool write(int ring, int eventFd, const QByteArray &message);
+    bool read(int ring, QByteArray *message);
+    bool map(QString *errorString);
+
+    char *m_memory;
+    qint64 m_memorySize;
+    quint32 m_ringSize;
+    int m_memoryFd;
+    int m_requestFd;
+    int m_responseFd;
+    int m_livenessReadFd;
+    int m_livenessWriteFd;
+};
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_PLUGINHOSTCHANNEL_P_H
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "pluginregistry_p.h"
+#include "logging_p.h"
+
+#include <QtCore/QPluginLoader>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDateTime>
+#include <QtCore/QSaveFile>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonValue>
+#include <QtCore/QVariant>
+#include <QtCore/QDataStream>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QtEndian>
+
+namespace {
+    // bump whenever the format of the cache, or of the info which the introspectors store in it, changes.
+    const int CacheVersion = 2;
+}
+
+Sailfish::Secrets::Daemon::PluginRegistry::PluginRegistry(QObject *parent)
+    : QObject(parent)
+    , m_mutex(QMutex::Recursive)
+    , m_generation(0)
+{
+}
+
+Sailfish::Secrets::Daemon::PluginRegistry::~PluginRegistry()
+{
+    // as before plugins were loaded lazily, the plugin instances outlive their loaders.
+    typedef QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Entry> Entries;
+    Q_FOREACH (const Entries &entries, m_plugins) {
+        Q_FOREACH (const Sailfish::Secrets::Daemon::PluginRegistry::Entry &entry, entries) {
+            delete entry.remote;
+            delete entry.loader;
+        }
+    }
+}
+
+void
+Sailfish::Secrets::Daemon::PluginRegistry::registerInterface(
+        const QString &interfaceId,
+        Sailfish::Secrets::Daemon::PluginRegistry::Introspector introspector)
+{
+    QMutexLocker locker(&m_mutex);
+    m_introspectors.insert(interfaceId, introspector);
+}
+
+void
+Sailfish::Secrets::Daemon::PluginRegistry::setOutOfProcess(
+        const QString &interfaceId,
+        const QMap<QString, int> &processCounts,
+        Sailfish::Secrets::Daemon::PluginRegistry::RemoteFactory factory)
+{
+    QMutexLocker locker(&m_mutex);
+    Sailfish::Secrets::Daemon::PluginRegistry::OutOfProcess &outOfProcess(m_outOfProcess[interfaceId]);
+    outOfProcess.processCounts = processCounts;
+    outOfProcess.factory = factory;
+}
+
+bool
+Sailfish::Secrets::Daemon::PluginRegistry::scan(const QString &pluginDir, const QString &cacheFilePath, bool autotestMode)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pluginDir = pluginDir;
+
+    const QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Entry> cached = readCache(cacheFilePath);
+    QList<Sailfish::Secrets::Daemon::PluginRegistry::Entry> entries;
+    bool cacheChanged = false;
+
+    QByteArray fingerprint;
+    QDataStream fingerprintStream(&fingerprint, QIODevice::WriteOnly);
+    fingerprintStream << CacheVersion << autotestMode;
+
+    QDir dir(pluginDir);
+    Q_FOREACH (const QString &pluginFile, dir.entryList(QDir::Files | QDir::NoDot | QDir::NoDotDot, QDir::Name)) {
+        const QFileInfo fileInfo(dir.absoluteFilePath(pluginFile));
+        Sailfish::Secrets::Daemon::PluginRegistry::Entry entry = cached.value(pluginFile);
+        if (entry.fileName.isEmpty()
+                || entry.size != fileInfo.size()
+                || entry.lastModified != fileInfo.lastModified().toMSecsSinceEpoch()) {
+            // new or updated since the cache was written: load the plugin to find out what it provides.
+            entry = Sailfish::Secrets::Daemon::PluginRegistry::Entry();
+            entry.fileName = pluginFile;
+            entry.size = fileInfo.size();
+            entry.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+            introspect(fileInfo.absoluteFilePath(), &entry);
+            cacheChanged = true;
+        }
+        entries.append(entry);
+
+        if (entry.interfaceId.isEmpty() || !m_introspectors.contains(entry.interfaceId)) {
+            qCWarning(lcSailfishSecretsDaemon) << "ignoring plugin:" << pluginFile << "- unknown plugin interface or Qt version mismatch";
+        } else if (entry.testPlugin != autotestMode) {
+            qCDebug(lcSailfishSecretsDaemon) << "ignoring plugin:" << pluginFile << "due to mode";
+        } else if (entry.name.isEmpty() || m_plugins.value(entry.interfaceId).contains(entry.name)) {
+            qCDebug(lcSailfishSecretsDaemon) << "ignoring plugin:" << pluginFile << "with duplicate name:" << entry.name;
+        } else {
+            qCDebug(lcSailfishSecretsDaemon) << "found plugin:" << pluginFile << "with name:" << entry.name;
+            m_plugins[entry.interfaceId].insert(entry.name, entry);
+            fingerprintStream << entry.fileName << entry.size << entry.lastModified;
+        }
+    }
+
+    // the plugin files are identified as for the cache, so this is stable across restarts.
+    const QByteArray digest = QCryptographicHash::hash(fingerprint, QCryptographicHash::Sha1);
+    m_generation = qFromBigEndian<quint64>(reinterpret_cast<const uchar *>(digest.constData()));
+
+    if ((cacheChanged || entries.size() != cached.size()) && !writeCache(cacheFilePath, entries)) {
+        // not fatal, the plugins will be introspected again next time.
+        qCWarning(lcSailfishSecretsDaemon) << "unable to write plugin metadata cache:" << cacheFilePath;
+    }
+
+    return true;
+}
+
+QStringList
+Sailfish::Secrets::Daemon::PluginRegistry::pluginNames(const QString &interfaceId) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_plugins.value(interfaceId).keys();
+}
+
+bool
+Sailfish::Secrets::Daemon::PluginRegistry::contains(const QString &interfaceId, const QString &name) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_plugins.value(interfaceId).contains(name);
+}
+
+QByteArray
+Sailfish::Secrets::Daemon::PluginRegistry::pluginInfo(const QString &interfaceId, const QString &name) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_plugins.value(interfaceId).value(name).info;
+}
+
+quint64
+Sailfish::Secrets::Daemon::PluginRegistry::generation() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_generation;
+}
+
+QObject *
+Sailfish::Secrets::Daemon::PluginRegistry::instance(const QString &interfaceId, const QString &name)
+{
+    QMutexLocker locker(&m_mutex);
+    QMap<QString, QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Entry> >::iterator plugins = m_plugins.find(interfaceId);
+    if (plugins == m_plugins.end()) {
+        return Q_NULLPTR;
+    }
+    QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Entry>::iterator it = plugins->find(name);
+    if (it == plugins->end()) {
+        return Q_NULLPTR;
+    }
+    if (it->loader) {
+        return it->loader->instance();
+    } else if (it->remote) {
+        return it->remote;
+    }
+
+    const Sailfish::Secrets::Daemon::PluginRegistry::OutOfProcess outOfProcess = m_outOfProcess.value(interfaceId);
+    if (outOfProcess.factory && outOfProcess.processCounts.contains(name)) {
+        QObject *remote = outOfProcess.factory(QDir(m_pluginDir).absoluteFilePath(it->fileName), name,
+                                               it->testPlugin, it->info, outOfProcess.processCounts.value(name));
+        if (!remote) {
+            qCWarning(lcSailfishSecretsDaemon) << "unable to start plugin host for:" << it->fileName;
+            return Q_NULLPTR;
+        }
+        if (remote->thread() != thread()) {
+            remote->moveToThread(thread());
+        }
+        qCDebug(lcSailfishSecretsDaemon) << "hosting plugin:" << it->fileName << "with name:" << name
+                                         << "in" << outOfProcess.processCounts.value(name) << "processes";
+        it->remote = remote;
+        emit pluginLoaded(interfaceId, name, remote);
+        return remote;
+    }
+
+    QPluginLoader *loader = new QPluginLoader(QDir(m_pluginDir).absoluteFilePath(it->fileName));
+    QObject *plugin = loader->instance();
+    if (!plugin) {
+        qCWarning(lcSailfishSecretsDaemon) << "unable to load plugin:" << it->fileName << loader->errorString();
+        delete loader;
+        return Q_NULLPTR;
+    }
+
+    // requests may be processed in worker threads, which don't outlive the plugin.
+    if (plugin->thread() != thread()) {
+        plugin->moveToThread(thread());
+        loader->moveToThread(thread());
+    }
+
+    qCDebug(lcSailfishSecretsDaemon) << "loaded plugin:" << it->fileName << "with name:" << name;
+    it->loader = loader;
+    emit pluginLoaded(interfaceId, name, plugin);
+    return plugin;
+}
+
+QList<QObject*>
+Sailfish::Secrets::Daemon::PluginRegistry::loadedInstances(const QString &interfaceId) const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<QObject*> instances;
+    Q_FOREACH (const Sailfish::Secrets::Daemon::PluginRegistry::Entry &entry, m_plugins.value(interfaceId)) {
+        if (entry.loader) {
+            instances.append(entry.loader->instance());
+        } else if (entry.remote) {
+            instances.append(entry.remote);
+        }
+    }
+    return instances;
+}
+
+bool
+Sailfish::Secrets::Daemon::PluginRegistry::introspect(
+        const QString &filePath,
+        Sailfish::Secrets::Daemon::PluginRegistry::Entry *entry) const
+{
+    // the interface is available from the metadata without loading the plugin.
+    QPluginLoader loader(filePath);
+    const QString interfaceId = loader.metaData().value(QStringLiteral("IID")).toString();
+    Sailfish::Secrets::Daemon::PluginRegistry::Introspector introspector = m_introspectors.value(interfaceId);
+    if (!introspector) {
+        return false;
+    }
+
+    qCDebug(lcSailfishSecretsDaemon) << "introspecting plugin:" << filePath;
+    const bool introspected = introspector(loader.instance(), &entry->name, &entry->testPlugin, &entry->info);
+    loader.unload();
+    if (introspected) {
+        entry->interfaceId = interfaceId;
+    }
+    return introspected;
+}
+
+QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Entry>
+Sailfish::Secrets::Daemon::PluginRegistry::readCache(const QString &cacheFilePath)
+{
+    QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Entry> entries;
+    QFile file(cacheFilePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return entries;
+    }
+
+    const QJsonObject cache = QJsonDocument::fromJson(file.readAll()).object();
+    if (cache.value(QStringLiteral("version")).toInt() != CacheVersion) {
+        return entries;
+    }
+
+    Q_FOREACH (const QJsonValue &value, cache.value(QStringLiteral("plugins")).toArray()) {
+        const QJsonObject object = value.toObject();
+        Sailfish::Secrets::Daemon::PluginRegistry::Entry entry;
+        entry.fileName = object.value(QStringLiteral("file")).toString();
+        entry.size = object.value(QStringLiteral("size")).toVariant().toLongLong();
+        entry.lastModified = object.value(QStringLiteral("lastModified")).toVariant().toLongLong();
+        entry.interfaceId = object.value(QStringLiteral("interface")).toString();
+        entry.name = object.value(QStringLiteral("name")).toString();
+        entry.testPlugin = object.value(QStringLiteral("testPlugin")).toBool();
+        entry.info = QByteArray::fromBase64(object.value(QStringLiteral("info")).toString().toLatin1());
+        if (!entry.fileName.isEmpty()) {
+            entries.insert(entry.fileName, entry);
+        }
+    }
+
+    return entries;
+}
+
+bool
+Sailfish::Secrets::Daemon::PluginRegistry::writeCache(
+        const QString &cacheFilePath,
+        const QList<Sailfish::Secrets::Daemon::PluginRegistry::Entry> &entries)
+{
+    QJsonArray plugins;
+    Q_FOREACH (const Sailfish::Secrets::Daemon::PluginRegistry::Entry &entry, entries) {
+        QJsonObject object;
+        object.insert(QStringLiteral("file"), entry.fileName);
+        object.insert(QStringLiteral("size"), QJsonValue::fromVariant(QVariant::fromValue<qint64>(entry.size)));
+        object.insert(QStringLiteral("lastModified"), QJsonValue::fromVariant(QVariant::fromValue<qint64>(entry.lastModified)));
+        object.insert(QStringLiteral("interface"), entry.interfaceId);
+        object.insert(QStringLiteral("name"), entry.name);
+        object.insert(QStringLiteral("testPlugin"), entry.testPlugin);
+        object.insert(QStringLiteral("info"), QString::fromLatin1(entry.info.toBase64()));
+        plugins.append(object);
+    }
+
+    QJsonObject cache;
+    cache.insert(QStringLiteral("version"), CacheVersion);
+    cache.insert(QStringLiteral("plugins"), plugins);
+
+    if (!QDir().mkpath(QFileInfo(cacheFilePath).absolutePath())) {
+        return false;
+    }
+    QSaveFile file(cacheFilePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
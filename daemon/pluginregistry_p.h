@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_PLUGINREGISTRY_P_H
+#define SAILFISHSECRETS_DAEMON_PLUGINREGISTRY_P_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QByteArray>
+#include <QtCore/QMap>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+
+QT_BEGIN_NAMESPACE
+class QPluginLoader;
+QT_END_NAMESPACE
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+// The plugins in a plugin directory, each of which is only instantiated
+// when it is first requested.  The interface of a plugin is read from its
+// metadata, and its name and info are cached across daemon restarts (keyed
+// by the size and modification time of the plugin file), so at startup only
+// new or updated plugins are instantiated, to be introspected and unloaded.
+class PluginRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Describes the plugin instance for the cache.  Returns false if the
+    // instance does not implement the interface it was registered for.
+    typedef bool (*Introspector)(QObject *plugin, QString *name, bool *testPlugin, QByteArray *info);
+    // Creates the stand-in for a plugin which is loaded by the given number of
+    // host processes rather than by the daemon, from the introspected info.
+    typedef QObject *(*RemoteFactory)(const QString &filePath, const QString &name, bool testPlugin, const QByteArray &info, int processCount);
+
+    PluginRegistry(QObject *parent = Q_NULLPTR);
+    ~PluginRegistry();
+
+    void registerInterface(const QString &interfaceId, Sailfish::Secrets::Daemon::PluginRegistry::Introspector introspector);
+    bool scan(const QString &pluginDir, const QString &cacheFilePath, bool autotestMode);
+
+    // The named plugins are instantiated via the factory instead of being loaded.
+    // Must be called before any of them is first requested.
+    void setOutOfProcess(const QString &interfaceId,
+                         const QMap<QString, int> &processCounts,
+                         Sailfish::Secrets::Daemon::PluginRegistry::RemoteFactory factory);
+
+    QStringList pluginNames(const QString &interfaceId) const;
+    bool contains(const QString &interfaceId, const QString &name) const;
+    QByteArray pluginInfo(const QString &interfaceId, const QString &name) const;
+
+    // changes whenever a plugin is installed, updated or removed, but not
+    // when the daemon is restarted, so that clients may cache plugin info.
+    quint64 generation() const;
+
+    // loads the plugin on first use.  May be called from any thread.
+    QObject *instance(const QString &interfaceId, const QString &name);
+    QList<QObject*> loadedInstances(const QString &interfaceId) const;
+
+Q_SIGNALS:
+    // emitted from the thread which first requested the plugin, before it is returned.
+    void pluginLoaded(const QString &interfaceId, const QString &name, QObject *plugin);
+
+private:
+    struct Entry {
+        Entry() : size(0), lastModified(0), testPlugin(false), loader(Q_NULLPTR), remote(Q_NULLPTR) {}
+        QString fileName;
+        qint64 size;
+        qint64 lastModified;
+        QString interfaceId;
+        QString name;
+        bool testPlugin;
+        QByteArray info;
+        QPluginLoader *loader;
+        QObject *remote;
+    };
+    struct OutOfProcess {
+        OutOfProcess() : factory(Q_NULLPTR) {}
+        QMap<QString, int> processCounts; // plugin name to host processes
+        Sailfish::Secrets::Daemon::PluginRegistry::RemoteFactory factory;
+    };
+
+    bool introspect(const QString &filePath, Sailfish::Secrets::Daemon::PluginRegistry::Entry *entry) const;
+    static QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Entry> readCache(const QString &cacheFilePath);
+    static bool writeCache(const QString &cacheFilePath, const QList<Sailfish::Secrets::Daemon::PluginRegistry::Entry> &entries);
+
+    mutable QMutex m_mutex;
+    QString m_pluginDir;
+    quint64 m_generation;
+    QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Introspector> m_introspectors;
+    QMap<QString, QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::Entry> > m_plugins; // interface -> name -> entry
+    QMap<QString, Sailfish::Secrets::Daemon::PluginRegistry::OutOfProcess> m_outOfProcess; // by interface
+};
+
+// The plugins of one interface in a PluginRegistry, looked up as if they
+// were held in a QMap of plugin name to (already instantiated) plugin.
+template <typename T>
+class PluginMap
+{
+public:
+    PluginMap(Sailfish::Secrets::Daemon::PluginRegistry *registry, const QString &interfaceId)
+        : m_registry(registry), m_interfaceId(interfaceId) {}
+
+    bool contains(const QString &name) const { return m_registry->contains(m_interfaceId, name); }
+    T *value(const QString &name) const { return qobject_cast<T*>(m_registry->instance(m_interfaceId, name)); }
+    T *operator[](const QString &name) const { return value(name); }
+    QStringList keys() const { return m_registry->pluginNames(m_interfaceId); }
+    QByteArray info(const QString &name) const { return m_registry->pluginInfo(m_interfaceId, name); }
+
+    QList<T*> loaded() const {
+        QList<T*> plugins;
+        Q_FOREACH (QObject *plugin, m_registry->loadedInstances(m_interfaceId)) {
+            plugins.append(qobject_cast<T*>(plugin));
+        }
+        return plugins;
+    }
+
+private:
+    Sailfish::Secrets::Daemon::PluginRegistry *m_registry;
+    QString m_interfaceId;
+};
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_PLUGINREGISTRY_P_H
@@ -6,14 +6,67 @@
  */
 
 #include "requestqueue_p.h"
+#include "applicationaccounting_p.h"
 #include "logging_p.h"
+#include "sharedmemory_p.h"
+#include "tracing_p.h"
 
 #include "Secrets/secretsdaemonconnection.h"
 
 #include <QtCore/QElapsedTimer>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+
+#include <algorithm>
 
 #include <dbus/dbus.h>
 
+namespace {
+    class WorkerRequest : public QRunnable
+    {
+    public:
+        WorkerRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *queue,
+                      pid_t callerPid,
+                      const QString &applicationId,
+                      quint64 requestId,
+                      int type,
+                      const QList<QVariant> &inParams)
+            : m_queue(queue), m_callerPid(callerPid), m_applicationId(applicationId)
+            , m_requestId(requestId), m_type(type), m_inParams(inParams) {}
+
+        void run() Q_DECL_OVERRIDE
+        {
+            SAILFISH_SECRETS_TRACE_REQUEST(m_queue->traceCategory(), m_requestId);
+            SAILFISH_SECRETS_TRACE_SPAN("queue.worker");
+            QList<QVariant> outParams;
+            {
+                Sailfish::Secrets::Daemon::ApplicationAccounting::Scope accountingScope(m_applicationId);
+                outParams = m_queue->handleWorkerRequest(m_callerPid, m_requestId, m_type, m_inParams);
+            }
+            // marshal the result back to the main thread, which owns the request and the connection.
+            QMetaObject::invokeMethod(m_queue, "workerRequestFinished", Qt::QueuedConnection,
+                                      Q_ARG(quint64, m_requestId),
+                                      Q_ARG(QVariantList, outParams));
+        }
+
+    private:
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *m_queue;
+        pid_t m_callerPid;
+        QString m_applicationId;
+        quint64 m_requestId;
+        int m_type;
+        QList<QVariant> m_inParams;
+    };
+
+    // Requests without a deadline are scheduled after those with one.
+    bool earlierDeadline(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *lhs,
+                         const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *rhs)
+    {
+        return lhs->deadline != 0 && (rhs->deadline == 0 || lhs->deadline < rhs->deadline);
+    }
+}
+
 Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestQueue(
         const QString &dbusObjectPath,
         const QString &dbusInterfaceName,
@@ -24,14 +77,355 @@ Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestQueue(
     , m_controller(parent)
     , m_dbusObjectPath(dbusObjectPath)
     , m_dbusInterfaceName(dbusInterfaceName)
+    , m_traceCategory(dbusInterfaceName.toLatin1())
+    , m_nextRequestId(1)
+    , m_maxWorkerThreads(0)
+    , m_lastScheduledPid(0)
+    , m_invalidConnection(QString::fromUtf8("org.sailfishos.secrets.daemon.invalidConnection"))
+    , m_queuedBytes(0)
+    , m_maxRequestsPerCaller(0)
+    , m_maxQueueDepth(0)
+    , m_maxQueuedBytes(0)
+    , m_lastActivityTime(0)
+    , m_yieldPolicy(new Sailfish::Secrets::Daemon::FixedYieldPolicy(100000))
     , m_pluginDir(pluginDir)
     , m_autotestMode(autotestMode)
 {
+    m_statisticsClock.start();
     qCDebug(lcSailfishSecretsDaemon) << "New API implementation request queue constructed:" << m_dbusObjectPath << "," << m_dbusInterfaceName;
 }
 
 Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::~RequestQueue()
 {
+    // worker requests reference this queue, so wait for them to finish.
+    m_workerPool.waitForDone();
+    qDeleteAll(m_requestDataPool);
+}
+
+Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::acquireRequestData()
+{
+    if (!m_requestDataPool.isEmpty()) {
+        return m_requestDataPool.takeLast();
+    }
+    return new Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::releaseRequestData(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request)
+{
+    // bound the pool so that a burst of requests doesn't pin memory forever.
+    static const int MaxPooledRequestData = 64;
+    if (m_requestDataPool.size() >= MaxPooledRequestData) {
+        delete request;
+        return;
+    }
+
+    // reset to the default state without reconstructing the connection.
+    request->requestId = 0;
+    request->remotePid = 0;
+    request->type = 0; // InvalidRequest
+    request->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestPending;
+    request->inParams.clear();
+    request->outParams.clear();
+    request->message = QDBusMessage();
+    request->connection = m_invalidConnection;
+    request->cryptoRequestId = 0;
+    request->isSecretsCryptoRequest = false;
+    request->coalescingKey.clear();
+    request->enqueueTime = 0;
+    request->startTime = 0;
+    request->deadline = 0;
+    request->inParamsSize = 0;
+    request->applicationId.clear();
+    m_requestDataPool.append(request);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::setMaxWorkerThreads(int count)
+{
+    m_maxWorkerThreads = qMax(0, count);
+    if (m_maxWorkerThreads > 0) {
+        m_workerPool.setMaxThreadCount(m_maxWorkerThreads);
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::setAdmissionLimits(int maxRequestsPerCaller, int maxQueueDepth, qint64 maxQueuedBytes)
+{
+    m_maxRequestsPerCaller = qMax(0, maxRequestsPerCaller);
+    m_maxQueueDepth = qMax(0, maxQueueDepth);
+    m_maxQueuedBytes = qMax(Q_INT64_C(0), maxQueuedBytes);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::setYieldPolicy(Sailfish::Secrets::Daemon::YieldPolicy *policy)
+{
+    if (policy) {
+        m_yieldPolicy.reset(policy);
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleCancelledRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request)
+{
+    Q_UNUSED(request);
+}
+
+qint64 Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::parameterSize(const QVariant &parameter) const
+{
+    if (parameter.userType() == qMetaTypeId<QDBusUnixFileDescriptor>()) {
+        // the payload is mapped from the memfd while the request is handled.
+        return Sailfish::Secrets::Daemon::memfdSize(parameter.value<QDBusUnixFileDescriptor>());
+    }
+
+    switch (parameter.userType()) {
+        case QMetaType::QByteArray: return parameter.toByteArray().size();
+        case QMetaType::QString:    return parameter.toString().size() * sizeof(QChar);
+        case QMetaType::QStringList: {
+            qint64 size = 0;
+            Q_FOREACH (const QString &string, parameter.toStringList()) {
+                size += string.size() * sizeof(QChar);
+            }
+            return size;
+        }
+        default: return sizeof(QVariant);
+    }
+}
+
+int Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::retryAfterHint() const
+{
+    // roughly the time it would take to drain the current queue, in msecs.
+    const qint64 drainMsecs = m_statistics.processingTime().meanUsecs() * m_requests.size() / 1000;
+    return static_cast<int>(qBound(Q_INT64_C(10), drainMsecs, Q_INT64_C(5000)));
+}
+
+Sailfish::Secrets::Result Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::admitRequest(
+        const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request)
+{
+    if (request->isSecretsCryptoRequest) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QString reason;
+    if (m_maxRequestsPerCaller > 0 && m_callerRequestCounts.value(request->remotePid) >= m_maxRequestsPerCaller) {
+        reason = QStringLiteral("Too many requests in flight from this client");
+    } else if (m_maxQueueDepth > 0 && m_requests.size() >= m_maxQueueDepth) {
+        reason = QStringLiteral("Request queue is full");
+    } else if (m_maxQueuedBytes > 0 && m_queuedBytes + request->inParamsSize > m_maxQueuedBytes) {
+        reason = QStringLiteral("Request queue memory limit reached");
+    } else {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    m_statistics.recordRejected();
+    const int retryAfter = retryAfterHint();
+    qCWarning(lcSailfishSecretsDaemon) << "Rejecting" << requestTypeToString(request->type) << "request from client:" << request->remotePid
+                                       << ":" << reason << ", retry after:" << retryAfter << "msec";
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsDaemonRequestQueueFullError,
+                                     QString::fromUtf8("%1, retry after %2 msec").arg(reason).arg(retryAfter));
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::isWorkerRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const
+{
+    Q_UNUSED(request);
+    return false;
+}
+
+QList<QVariant> Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleWorkerRequest(pid_t callerPid, quint64 requestId, int type, const QList<QVariant> &inParams)
+{
+    Q_UNUSED(callerPid);
+    Q_UNUSED(inParams);
+    qCWarning(lcSailfishSecretsDaemon) << "Cannot handle request:" << requestId << "of type:" << requestTypeToString(type) << "on worker thread";
+    return QList<QVariant>();
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::isPriorityRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const
+{
+    Q_UNUSED(request);
+    return false;
+}
+
+QString Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::applicationId(pid_t callerPid) const
+{
+    Q_UNUSED(callerPid);
+    return QString();
+}
+
+QString Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::coalescingKey(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const
+{
+    Q_UNUSED(request);
+    return QString();
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::setNextRequestDeadline(
+        const QDBusConnection &connection,
+        const QString &method,
+        qint64 timeoutMsecs)
+{
+    const qint64 now = m_statisticsClock.nsecsElapsed() / 1000;
+
+    // a client which disconnected between the two messages leaves its deadline behind.
+    QHash<QString, QPair<QString, qint64> >::iterator it = m_nextRequestDeadlines.begin();
+    while (it != m_nextRequestDeadlines.end()) {
+        if (it.value().second < now) {
+            it = m_nextRequestDeadlines.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (timeoutMsecs >= 0) {
+        m_nextRequestDeadlines.insert(connection.name(), qMakePair(method, now + timeoutMsecs * 1000));
+    }
+}
+
+qint64 Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::takeNextRequestDeadline(
+        const QDBusConnection &connection,
+        const QDBusMessage &message)
+{
+    // methods which are answered without being queued don't consume the deadline,
+    // so it must not be applied to a later request of a different method.
+    const QPair<QString, qint64> deadline = m_nextRequestDeadlines.take(connection.name());
+    return deadline.first == message.member() ? deadline.second : 0;
+}
+
+QVariantMap Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::statistics() const
+{
+    QVariantMap requestTypes;
+    Q_FOREACH (int requestType, m_statistics.requestTypes()) {
+        requestTypes.insert(requestTypeToString(requestType), m_statistics.toVariantMap(requestType));
+    }
+
+    QVariantMap admissionLimits;
+    admissionLimits.insert(QStringLiteral("maxRequestsPerCaller"), m_maxRequestsPerCaller);
+    admissionLimits.insert(QStringLiteral("maxQueueDepth"), m_maxQueueDepth);
+    admissionLimits.insert(QStringLiteral("maxQueuedBytes"), QVariant::fromValue<qint64>(m_maxQueuedBytes));
+
+    QVariantMap stats;
+    stats.insert(QStringLiteral("admissionLimits"), admissionLimits);
+    stats.insert(QStringLiteral("queueDepth"), m_requests.size());
+    stats.insert(QStringLiteral("queuedBytes"), QVariant::fromValue<qint64>(m_queuedBytes));
+    stats.insert(QStringLiteral("yieldCount"), QVariant::fromValue<quint64>(m_statistics.yieldCount()));
+    stats.insert(QStringLiteral("rejectedCount"), QVariant::fromValue<quint64>(m_statistics.rejectedCount()));
+    stats.insert(QStringLiteral("expiredCount"), QVariant::fromValue<quint64>(m_statistics.expiredCount()));
+    stats.insert(QStringLiteral("coalescedCount"), QVariant::fromValue<quint64>(m_statistics.coalescedCount()));
+    stats.insert(QStringLiteral("cancelledCount"), QVariant::fromValue<quint64>(m_statistics.cancelledCount()));
+    stats.insert(QStringLiteral("eventLoopLag"), m_statistics.eventLoopLag().toVariantMap());
+    stats.insert(QStringLiteral("yieldPolicy"), m_yieldPolicy->statistics());
+    stats.insert(QStringLiteral("histogramBucketUpperBoundsUsecs"), Sailfish::Secrets::Daemon::LatencyHistogram::bucketUpperBounds());
+    stats.insert(QStringLiteral("requestTypes"), requestTypes);
+    return stats;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::memoryUsage(QMap<QString, qint64> *usage) const
+{
+    // the parameters of a request in progress are held by its continuation until it finishes.
+    qint64 queuedBytes = 0;
+    qint64 inProgressBytes = 0;
+    Q_FOREACH (const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, m_requests) {
+        if (request->status == Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestPending) {
+            queuedBytes += request->inParamsSize;
+        } else if (request->status == Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestInProgress) {
+            inProgressBytes += request->inParamsSize;
+        }
+    }
+    usage->insert(QStringLiteral("queuedRequestParameters"), queuedBytes);
+    usage->insert(QStringLiteral("pendingRequestContinuations"), inProgressBytes);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::releaseMemory()
+{
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::isIdle() const
+{
+    return m_requests.isEmpty();
+}
+
+qint64 Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::idleMsecs() const
+{
+    if (!m_requests.isEmpty()) {
+        return 0;
+    }
+    return (m_statisticsClock.nsecsElapsed() / 1000 - m_lastActivityTime) / 1000;
+}
+
+int Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::performMaintenance(int)
+{
+    return 0;
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::messagesDeferred() const
+{
+    return false;
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::messageDeferred()
+{
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::sendMessage(
+        const QDBusConnection &connection,
+        const QDBusMessage &message,
+        const QDBusMessage &request)
+{
+    if (!messagesDeferred()) {
+        // the reply is marshalled as it is sent.
+        SAILFISH_SECRETS_TRACE_SPAN("queue.sendReply");
+        connection.send(message);
+        return;
+    }
+
+    m_deferredMessages.append(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::DeferredMessage(connection, message, request));
+    messageDeferred();
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::sendDeferredMessages(bool succeeded)
+{
+    const QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::DeferredMessage> deferred = m_deferredMessages;
+    m_deferredMessages.clear();
+    Q_FOREACH (const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::DeferredMessage &message, deferred) {
+        if (succeeded) {
+            message.connection.send(message.message);
+        } else if (message.request.type() == QDBusMessage::MethodCallMessage) {
+            // the writes made by the request were lost, so it must not be reported as succeeded.
+            message.connection.send(message.request.createErrorReply(
+                                        QDBusError::Other,
+                                        QString::fromUtf8("Unable to commit the changes made by the request")));
+        }
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::finishCoalescedRequests(
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request,
+        const QList<QVariant> &outParams)
+{
+    if (request->coalescingKey.isEmpty()) {
+        return;
+    }
+
+    m_coalescingRequests.remove(request->coalescingKey);
+    request->coalescingKey.clear();
+    const QList<quint64> coalescedRequestIds = m_coalescedRequests.take(request->requestId);
+    Q_FOREACH (quint64 coalescedRequestId, coalescedRequestIds) {
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *coalesced = m_requestsById.value(coalescedRequestId);
+        if (!coalesced) {
+            continue;
+        }
+        if (outParams.isEmpty()) {
+            // no result to share, so the request has to be handled itself.
+            coalesced->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestPending;
+        } else {
+            qCDebug(lcSailfishSecretsDaemon) << "Finishing request:" << coalescedRequestId << "with result of identical request:" << request->requestId;
+            coalesced->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestFinished;
+            coalesced->outParams = outParams;
+            m_statistics.recordCoalesced();
+        }
+    }
+
+    if (!coalescedRequestIds.isEmpty()) {
+        QMetaObject::invokeMethod(this, "handleRequests", Qt::QueuedConnection);
+    }
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::workerRequestFinished(quint64 requestId, const QVariantList &outParams)
+{
+    requestFinished(requestId, outParams);
 }
 
 void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleClientConnection(const QDBusConnection &connection)
@@ -65,13 +459,14 @@ void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleRequest(
                             QDBusError::Other,
                             QString::fromUtf8("Could not determine PID of caller to enforce access controls")));
     } else {
-        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *data = new Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData;
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *data = acquireRequestData();
         data->connection = connection;
         data->remotePid = (pid_t)dbusRemotePid;
         data->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestPending;
         data->type = requestType;
         data->inParams = inParams;
         data->requestId = 0;
+        data->deadline = takeNextRequestDeadline(connection, message);
         Sailfish::Secrets::Result result = enqueueRequest(data);
         if (result.code() == Sailfish::Secrets::Result::Succeeded) {
             data->message = message;
@@ -81,7 +476,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleRequest(
             transformedResult.setErrorCode(Sailfish::Crypto::Result::DaemonError);
             transformedResult.setErrorMessage(result.errorMessage());
             returnResult = transformedResult;
-            delete data;
+            releaseRequestData(data);
         }
     }
 }
@@ -102,20 +497,21 @@ void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleRequest(
                             QDBusError::Other,
                             QString::fromUtf8("Could not determine PID of caller to enforce access controls")));
     } else {
-        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *data = new Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData;
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *data = acquireRequestData();
         data->connection = connection;
         data->remotePid = (pid_t)dbusRemotePid;
         data->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestPending;
         data->type = requestType;
         data->inParams = inParams;
         data->requestId = 0;
+        data->deadline = takeNextRequestDeadline(connection, message);
         Sailfish::Secrets::Result result = enqueueRequest(data);
         if (result.code() == Sailfish::Secrets::Result::Succeeded) {
             data->message = message;
             message.setDelayedReply(true);
         } else {
             returnResult = result;
-            delete data;
+            releaseRequestData(data);
         }
     }
 }
@@ -128,7 +524,7 @@ void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleRequest(
         Sailfish::Secrets::Result &result)
 {
     // queue up a Secrets request as part of a Crypto request.
-    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *data = new Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *data = acquireRequestData();
     data->remotePid = callerPid;
     data->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestPending;
     data->type = requestType;
@@ -138,34 +534,35 @@ void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleRequest(
     data->cryptoRequestId = cryptoRequestId;
     result = enqueueRequest(data);
     if (result.code() == Sailfish::Secrets::Result::Failed) {
-        delete data;
+        releaseRequestData(data);
     }
 }
 
 Sailfish::Secrets::Result Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::enqueueRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request)
 {
-    static quint64 requestId = 0;
-
-    // If no free request ids (i.e. queue is full) then return an error to the client.
-    quint64 prevId = requestId;
-    quint64 nextFreeId = ++requestId;
-    bool found = false;
-    for ( ; nextFreeId != prevId; ++nextFreeId) {
-        found = false;
-        QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*>::const_iterator it = m_requests.constBegin();
-        while (it != m_requests.constEnd()) {
-            if ((*it)->requestId == nextFreeId) {
-                // another current request is using this id.
-                found = true;
-                break;
-            }
-            it++;
-        }
-        if (!found) {
-            // no requests in the queue are using this id.  it is free to use.
-            break;
-        }
+    // Reject the request early if the client or the queue is over its limits.
+    request->inParamsSize = 0;
+    Q_FOREACH (const QVariant &parameter, request->inParams) {
+        request->inParamsSize += parameterSize(parameter);
     }
+    const Sailfish::Secrets::Result admitted = admitRequest(request);
+    if (admitted.code() == Sailfish::Secrets::Result::Failed) {
+        return admitted;
+    }
+
+    // Request ids are allocated monotonically.  After wraparound an id may
+    // still be in use by a long-running request, so skip over any such ids
+    // (and zero, which means "no request id").  If no free request ids
+    // (i.e. queue is full) then return an error to the client.
+    const quint64 prevId = m_nextRequestId;
+    bool found = true;
+    do {
+        const quint64 candidateId = m_nextRequestId++;
+        if (candidateId != 0 && !m_requestsById.contains(candidateId)) {
+            request->requestId = candidateId;
+            found = false;
+        }
+    } while (found && m_nextRequestId != prevId);
 
     if (found) {
         // all request ids are taken.  we cannot enqueue this request.
@@ -174,27 +571,125 @@ Sailfish::Secrets::Result Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::enqu
                                          QString::fromUtf8("Request queue is full, try again later"));
     }
 
-    qCDebug(lcSailfishSecretsDaemon) << "Enqueuing" << requestTypeToString(request->type) << "request with id:" << nextFreeId;
-    request->requestId = nextFreeId;
+    qCDebug(lcSailfishSecretsDaemon) << "Enqueuing" << requestTypeToString(request->type) << "request with id:" << request->requestId;
+    SAILFISH_SECRETS_TRACE_EVENT(traceCategory(), request->requestId, "queue.enqueued");
+    request->enqueueTime = m_statisticsClock.nsecsElapsed() / 1000;
+    request->startTime = request->enqueueTime;
+    m_lastActivityTime = request->enqueueTime;
+    request->applicationId = applicationId(request->remotePid);
+    if (!request->isSecretsCryptoRequest) {
+        m_yieldPolicy->requestArrived(request->enqueueTime);
+    }
+    const QString key = coalescingKey(request);
+    if (!key.isEmpty()) {
+        const quint64 inFlightRequestId = m_coalescingRequests.value(key);
+        if (inFlightRequestId != 0) {
+            // an identical request is already in flight.  wait for its result.
+            qCDebug(lcSailfishSecretsDaemon) << "Coalescing request:" << request->requestId << "with identical request:" << inFlightRequestId;
+            request->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestInProgress;
+            m_coalescedRequests[inFlightRequestId].append(request->requestId);
+        } else {
+            request->coalescingKey = key;
+            m_coalescingRequests.insert(key, request->requestId);
+        }
+    }
     m_requests.append(request);
+    m_requestsById.insert(request->requestId, request);
+    m_callerRequestCounts[request->remotePid]++;
+    m_queuedBytes += request->inParamsSize;
     QMetaObject::invokeMethod(this, "handleRequests", Qt::QueuedConnection);
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
 void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::requestFinished(quint64 requestId, const QList<QVariant> &outParams)
 {
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request = m_requestsById.value(requestId);
+    if (request) {
+        SAILFISH_SECRETS_TRACE_EVENT(traceCategory(), requestId, "queue.finished");
+        request->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestFinished;
+        request->outParams = outParams;
+        finishCoalescedRequests(request, outParams);
+        QMetaObject::invokeMethod(this, "handleRequests", Qt::QueuedConnection);
+        return;
+    }
+
+    qCWarning(lcSailfishSecretsDaemon) << "Unable to finish unknown request:" << requestId;
+}
+
+bool Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::connectionPid(const QDBusConnection &connection, pid_t *pid)
+{
+    DBusConnection *internalConnection = static_cast<DBusConnection*>(connection.internalPointer());
+    unsigned long dbusRemotePid = 0;
+    if (!internalConnection || !dbus_connection_get_unix_process_id(internalConnection, &dbusRemotePid)) {
+        return false;
+    }
+    *pid = (pid_t)dbusRemotePid;
+    return true;
+}
+
+int Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::cancelRequests(pid_t callerPid)
+{
+    // finished requests are left alone, as their result is about to be sent anyway.
+    // requests performed on behalf of the crypto daemon are cancelled via their crypto request.
+    QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> cancelled;
+    Q_FOREACH (Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, m_requests) {
+        if (request->remotePid == callerPid
+                && !request->isSecretsCryptoRequest
+                && request->status != Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestFinished) {
+            cancelled.append(request);
+        }
+    }
+
+    qCDebug(lcSailfishSecretsDaemon) << "Cancelling" << cancelled.size() << "requests from client:" << callerPid;
+    m_statistics.recordCancelled(cancelled.size());
+    dropRequests(cancelled, true);
+    return cancelled.size();
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::dropRequests(
+        const QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> &requests,
+        bool sendReply)
+{
+    if (requests.isEmpty()) {
+        return;
+    }
+
+    QSet<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> dropped;
+    Q_FOREACH (Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, requests) {
+        if (request->status == Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestInProgress) {
+            handleCancelledRequest(request);
+        }
+        // any identical requests which were waiting on this one must now be handled themselves.
+        finishCoalescedRequests(request, QList<QVariant>());
+        if (sendReply) {
+            request->connection.send(request->message.createErrorReply(
+                                         QDBusError::Other,
+                                         QString::fromUtf8("Request was cancelled")));
+        }
+        dropped.insert(request);
+    }
+    removeRequests(dropped);
+}
+
+void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::removeRequests(
+        const QSet<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> &requests)
+{
+    // remove the requests from the queue, in a single pass.
     QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*>::iterator it = m_requests.begin();
     while (it != m_requests.end()) {
-        if ((*it)->requestId == requestId) {
-            (*it)->status = Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestFinished;
-            (*it)->outParams = outParams;
-            QMetaObject::invokeMethod(this, "handleRequests", Qt::QueuedConnection);
-            return;
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request = *it;
+        if (requests.contains(request)) {
+            it = m_requests.erase(it);
+            m_requestsById.remove(request->requestId);
+            if (--m_callerRequestCounts[request->remotePid] <= 0) {
+                m_callerRequestCounts.remove(request->remotePid);
+            }
+            m_queuedBytes -= request->inParamsSize;
+            releaseRequestData(request);
+        } else {
+            it++;
         }
-        it++;
     }
-
-    qCWarning(lcSailfishSecretsDaemon) << "Unable to finish unknown request:" << requestId;
 }
 
 void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleRequests()
@@ -202,47 +697,182 @@ void Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::handleRequests()
     qCDebug(lcSailfishSecretsDaemon) << "have:" << m_requests.size() << "in queue.";
     QElapsedTimer yieldTimer;
     yieldTimer.start();
-    bool completed = false;
-    QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*>::iterator it = m_requests.begin();
-    while (it != m_requests.end()) {
-        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request = *it;
-        completed = false;
+
+    // Drop any requests whose client has disconnected, as nobody is waiting for their result.
+    QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> abandonedRequests;
+    Q_FOREACH (Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, m_requests) {
+        if (!request->isSecretsCryptoRequest && !request->connection.isConnected()) {
+            qCDebug(lcSailfishSecretsDaemon) << "Dropping request:" << request->requestId << "from disconnected client:" << request->remotePid;
+            abandonedRequests.append(request);
+        }
+    }
+    dropRequests(abandonedRequests, false);
+
+    // Fail any requests which can no longer start before their client gives up
+    // waiting, rather than doing work whose result nobody will receive.
+    const qint64 now = m_statisticsClock.nsecsElapsed() / 1000;
+    QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> expiredRequests;
+    Q_FOREACH (Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, m_requests) {
+        if (request->deadline != 0 && request->deadline <= now
+                && request->status == Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestPending) {
+            qCDebug(lcSailfishSecretsDaemon) << "Failing request:" << request->requestId << "from client:" << request->remotePid
+                                             << "after its deadline";
+            m_statistics.recordExpired();
+            request->connection.send(request->message.createErrorReply(
+                                         QDBusError::Timeout,
+                                         QString::fromUtf8("Request deadline expired before it was started")));
+            expiredRequests.append(request);
+        }
+    }
+    dropRequests(expiredRequests, false);
+
+    // Build the schedule for this pass.  Finished requests only need their
+    // reply to be sent, so they go first, followed by the priority lane.
+    // The remaining pending requests are interleaved round-robin across
+    // callers (in FIFO order per caller) so that one client which floods
+    // the queue cannot starve other clients.  Within the priority lane and
+    // each round, requests are ordered by earliest deadline.  Applications
+    // which are over their quotas only get one request handled per pass,
+    // after everything else.
+    QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> schedule;
+    QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> priorityRequests;
+    QList<pid_t> callers;
+    QHash<pid_t, QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> > callerRequests;
+    Sailfish::Secrets::Daemon::ApplicationAccounting *accounting = Sailfish::Secrets::Daemon::ApplicationAccounting::instance();
+    QStringList throttledApplications;
+    QHash<QString, bool> throttled; // whether each application is throttled, for the whole pass
+    QHash<QString, QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> > throttledRequests;
+    Q_FOREACH (Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, m_requests) {
+        if (request->status == RequestFinished) {
+            schedule.append(request);
+        } else if (request->status == RequestPending) {
+            if (!request->isSecretsCryptoRequest && !throttled.contains(request->applicationId)) {
+                throttled.insert(request->applicationId, accounting->isThrottled(request->applicationId));
+            }
+            if (isPriorityRequest(request)) {
+                priorityRequests.append(request);
+            } else if (!request->isSecretsCryptoRequest && throttled.value(request->applicationId)) {
+                if (!throttledRequests.contains(request->applicationId)) {
+                    throttledApplications.append(request->applicationId);
+                }
+                throttledRequests[request->applicationId].append(request);
+            } else {
+                if (!callerRequests.contains(request->remotePid)) {
+                    callers.append(request->remotePid);
+                }
+                callerRequests[request->remotePid].append(request);
+            }
+        }
+        // else: this request is already in progress.
+    }
+    std::stable_sort(priorityRequests.begin(), priorityRequests.end(), earlierDeadline);
+    schedule.append(priorityRequests);
+
+    // start with the caller after the one we served last, so that
+    // yielding part-way through a pass doesn't favour the first caller.
+    const int lastIndex = callers.indexOf(m_lastScheduledPid);
+    for (int i = 0; i <= lastIndex; ++i) {
+        callers.append(callers.takeFirst());
+    }
+    for (bool scheduled = true; scheduled; ) {
+        scheduled = false;
+        QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> round;
+        Q_FOREACH (pid_t caller, callers) {
+            QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> &requests(callerRequests[caller]);
+            if (!requests.isEmpty()) {
+                round.append(requests.takeFirst());
+                scheduled = true;
+            }
+        }
+        // a caller's own requests stay in order, as it may rely on a write preceding a read.
+        std::stable_sort(round.begin(), round.end(), earlierDeadline);
+        schedule.append(round);
+    }
+
+    const int firstThrottledRequest = schedule.size();
+    bool throttledRequestsDeferred = false;
+    Q_FOREACH (const QString &application, throttledApplications) {
+        const QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> &requests(throttledRequests[application]);
+        schedule.append(requests.first());
+        throttledRequestsDeferred = throttledRequestsDeferred || requests.size() > 1;
+    }
+
+    // Always handle at least one request per pass, so that a request which is
+    // expected to take longer than the whole budget is still handled.
+    const qint64 yieldBudget = m_yieldPolicy->passBudget(m_statisticsClock.nsecsElapsed() / 1000);
+    QSet<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> completedRequests;
+    for (int i = 0; i < schedule.size(); ++i) {
+        Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request = schedule.at(i);
+        const bool finishing = request->status == RequestFinished;
+        if (i > 0 && m_yieldPolicy->shouldYield(yieldTimer.nsecsElapsed() / 1000, yieldBudget, request->type, finishing)) {
+            // Yield to the event loop after queuing up another handleRequests event.
+            // This ensures that we stay responsive to DBus requests even if we have
+            // a large number of incoming client requests to handle.
+            m_statistics.recordYield();
+            QMetaObject::invokeMethod(this, "handleRequests", Qt::QueuedConnection);
+            throttledRequestsDeferred = false;
+            break;
+        }
+
+        const qint64 handlingStarted = yieldTimer.nsecsElapsed() / 1000;
+        if (i >= firstThrottledRequest) {
+            accounting->recordThrottledRequest(request->applicationId);
+        }
+        Sailfish::Secrets::Daemon::ApplicationAccounting::Scope accountingScope(request->applicationId);
+        bool completed = false;
         if (request->status == RequestPending) {
             // This is a new request we haven't seen before.
             // Track the peer connection (if we haven't already), and then handle the request.
             //trackPeerConnection(request); // TODO: is this needed?
             request->status = RequestInProgress;
-            handlePendingRequest(request, &completed);
-            if (completed) {
-                it = m_requests.erase(it);
-                delete request;
+            request->startTime = m_statisticsClock.nsecsElapsed() / 1000;
+            m_statistics.recordWaitTime(request->type, request->startTime - request->enqueueTime);
+            if (!isPriorityRequest(request)) {
+                m_lastScheduledPid = request->remotePid;
+            }
+            if (m_maxWorkerThreads > 0 && isWorkerRequest(request)) {
+                // CPU-bound request which can run in parallel with others.
+                // It will be finished via workerRequestFinished().
+                qCDebug(lcSailfishSecretsDaemon) << "Dispatching" << requestTypeToString(request->type) << "request:" << request->requestId << "to worker thread";
+                SAILFISH_SECRETS_TRACE_EVENT(traceCategory(), request->requestId, "queue.dispatched");
+                m_workerPool.start(new WorkerRequest(this, request->remotePid, request->applicationId, request->requestId, request->type, request->inParams));
             } else {
-                it++;
+                SAILFISH_SECRETS_TRACE_REQUEST(traceCategory(), request->requestId);
+                SAILFISH_SECRETS_TRACE_SPAN("queue.handlePendingRequest");
+                handlePendingRequest(request, &completed);
+                if (completed) {
+                    finishCoalescedRequests(request, request->outParams);
+                }
             }
         } else if (request->status == RequestFinished) {
             // This (asynchronous) request is in Finished state.  We need to send the response.
+            SAILFISH_SECRETS_TRACE_REQUEST(traceCategory(), request->requestId);
+            SAILFISH_SECRETS_TRACE_SPAN("queue.handleFinishedRequest");
             handleFinishedRequest(request, &completed);
-            if (completed) {
-                it = m_requests.erase(it);
-                delete request;
-            } else {
-                it++;
-            }
-        } else if (request->status == RequestInProgress) {
-            // this request is already in progress.
-            it++;
         }
 
-        if (m_requests.size() && yieldTimer.elapsed() > 100) {
-            // If we've taken more than 100 msec to handle requests, then we should
-            // yield to the event loop after queuing up another handleRequests event.
-            // This ensures that we stay responsive to DBus requests even if we have
-            // a large number of incoming client requests to handle.
-            QMetaObject::invokeMethod(this, "handleRequests", Qt::QueuedConnection);
-            break;
+        if (completed) {
+            m_lastActivityTime = m_statisticsClock.nsecsElapsed() / 1000;
+            m_statistics.recordProcessingTime(request->type, m_lastActivityTime - request->startTime);
+            completedRequests.insert(request);
         }
+
+        m_yieldPolicy->requestHandled(request->type, finishing, yieldTimer.nsecsElapsed() / 1000 - handlingStarted);
+    }
+
+    // remove the completed requests from the queue.
+    if (!completedRequests.isEmpty()) {
+        removeRequests(completedRequests);
     }
 
+    // the remaining requests of throttled applications are handled in later passes.
+    if (throttledRequestsDeferred) {
+        QMetaObject::invokeMethod(this, "handleRequests", Qt::QueuedConnection);
+    }
+
+    // any message which arrived during the pass waited at most this long to be dispatched.
+    m_statistics.recordEventLoopLag(yieldTimer.nsecsElapsed() / 1000);
+
     // no more pending requests to handle, or yielding to event loop.
     qint64 nsecs = yieldTimer.nsecsElapsed(), msecs = 0, secs = 0;
     while (nsecs > 1000000) {
@@ -13,8 +13,17 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QThreadPool>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QVariantMap>
 
 #include "controller_p.h"
+#include "requeststatistics_p.h"
+#include "yieldpolicy_p.h"
 
 #include "Secrets/result.h"
 #include "Crypto/result.h"
@@ -52,7 +61,11 @@ public:
             , status(RequestPending)
             , connection(QString::fromUtf8("org.sailfishos.secrets.daemon.invalidConnection"))
             , cryptoRequestId(0)
-            , isSecretsCryptoRequest(false) {}
+            , isSecretsCryptoRequest(false)
+            , enqueueTime(0)
+            , startTime(0)
+            , deadline(0)
+            , inParamsSize(0) {}
         quint64 requestId;
         pid_t remotePid;
         int type;
@@ -66,6 +79,23 @@ public:
         // which is being performed as part of a Sailfish::Crypto request.
         quint64 cryptoRequestId;
         bool isSecretsCryptoRequest;
+
+        // Only set if other identical requests are waiting on this one.
+        QString coalescingKey;
+
+        // Timestamps (in usecs of the queue's statistics clock) used for statistics.
+        qint64 enqueueTime;
+        qint64 startTime;
+
+        // If non-zero, the time (on the same clock) after which the client will
+        // no longer wait for the reply, so the request is failed if not yet started.
+        qint64 deadline;
+
+        // The estimated size of inParams, counted against the queued bytes limit.
+        qint64 inParamsSize;
+
+        // The application of the caller, to which the resources used are accounted.
+        QString applicationId;
     };
 
 public:
@@ -79,6 +109,33 @@ public:
 
     void setDBusObject(QObject *dbusObject) { m_dbusObject = dbusObject; }
 
+    // The category of this queue's trace events, see tracing_p.h.
+    const char *traceCategory() const { return m_traceCategory.constData(); }
+
+    // If zero (the default) all requests are handled on the main thread.
+    // Otherwise, requests for which isWorkerRequest() returns true are
+    // handled by handleWorkerRequest() on a pool of at most this many threads.
+    void setMaxWorkerThreads(int count);
+    int maxWorkerThreads() const { return m_maxWorkerThreads; }
+
+    // Client requests which would exceed any of these limits are rejected
+    // with a SecretsDaemonRequestQueueFullError before being queued.
+    // A limit of zero means unlimited.  Requests performed on behalf of
+    // the crypto daemon are never rejected, as their client request was
+    // already admitted by the crypto request queue.
+    void setAdmissionLimits(int maxRequestsPerCaller, int maxQueueDepth, qint64 maxQueuedBytes);
+
+    // Decides when handleRequests() returns to the event loop part-way
+    // through the queue.  The queue takes ownership of the policy.
+    // By default it yields after 100 msec.
+    void setYieldPolicy(Sailfish::Secrets::Daemon::YieldPolicy *policy);
+
+    // Gives the next client request received via the connection a deadline
+    // of timeoutMsecs from now, if it is a call of the given method.  Clients
+    // send this immediately before the request itself, as DBus has no
+    // per-message header for it.
+    void setNextRequestDeadline(const QDBusConnection &connection, const QString &method, qint64 timeoutMsecs);
+
     void handleRequest(int requestType,
                        const QVariantList &inParams,
                        const QDBusConnection &connection,
@@ -98,20 +155,138 @@ public:
     Sailfish::Secrets::Result enqueueRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request);
     void requestFinished(quint64 requestId, const QList<QVariant> &outParams);
 
+    // Cancels all requests from the given client which have not yet finished,
+    // replying to each with an error.  Returns the number of cancelled requests.
+    int cancelRequests(pid_t callerPid);
+    static bool connectionPid(const QDBusConnection &connection, pid_t *pid);
+
     virtual void handlePendingRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, bool *completed) = 0;
     virtual void handleFinishedRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, bool *completed) = 0;
     virtual QString requestTypeToString(int type) const = 0;
 
+    // Worker requests must not touch any state owned by the main thread
+    // (e.g. the database, or pending asynchronous request maps).
+    // The returned outParams are passed to handleFinishedRequest() on the main thread.
+    virtual bool isWorkerRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const;
+    virtual QList<QVariant> handleWorkerRequest(pid_t callerPid, quint64 requestId, int type, const QList<QVariant> &inParams);
+
+    // Priority requests are cheap, read-only requests which are handled
+    // before any other pending requests, regardless of which client sent them.
+    virtual bool isPriorityRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const;
+
+    // Requests with the same non-empty coalescing key as an in-flight request
+    // are not handled themselves, but instead receive a copy of the outParams
+    // of the in-flight request once it finishes.  Subclasses must fill in
+    // request->outParams when a coalescable request completes synchronously.
+    virtual QString coalescingKey(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request) const;
+
+    // Called when an in-progress request is cancelled, or its client disconnects,
+    // so that any pending asynchronous state for the request can be discarded.
+    // Any later completion of the request is ignored.
+    virtual void handleCancelledRequest(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request);
+
+    // Returns the application id of the given caller, see ApplicationPermissions.
+    virtual QString applicationId(pid_t callerPid) const;
+
+    // Returns a cheap estimate of the memory used by the given request parameter.
+    // Subclasses should override this to account for their API-specific types.
+    virtual qint64 parameterSize(const QVariant &parameter) const;
+
+    // Returns request counts, latency histograms and queue state,
+    // keyed by name, for reporting via the statistics DBus interface.
+    virtual QVariantMap statistics() const;
+
+    // Adds the live size in bytes of each part of the queue's memory (its
+    // requests, and any caches of its subclass) to usage, keyed by name.
+    virtual void memoryUsage(QMap<QString, qint64> *usage) const;
+
+    // Called when the daemon is over its memory budget.  Subclasses should
+    // discard whatever they can rebuild, e.g. their caches.
+    virtual void releaseMemory();
+
+    // Whether the daemon could exit without losing anything which clients
+    // rely on, i.e. no request is queued or in progress.  Subclasses should
+    // also account for any state which can't be rebuilt on restart.
+    virtual bool isIdle() const;
+
+    // The time since a request was last enqueued or completed, or zero
+    // while any request is queued or in progress.
+    qint64 idleMsecs() const;
+
+    // Called periodically while the daemon is idle.  Subclasses should
+    // maintain their storage using roughly at most pageBudget pages of I/O,
+    // and return the number of pages used, or -1 if the storage was busy.
+    virtual int performMaintenance(int pageBudget);
+
 public Q_SLOTS:
     void handleRequests();
     void handleClientConnection(const QDBusConnection &connection);
 
+protected Q_SLOTS:
+    // Sends (or, if the grouped writes could not be committed, fails) every deferred message.
+    void sendDeferredMessages(bool succeeded);
+
+private Q_SLOTS:
+    void workerRequestFinished(quint64 requestId, const QVariantList &outParams);
+
+private:
+    Sailfish::Secrets::Result admitRequest(const Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request);
+    int retryAfterHint() const;
+    qint64 takeNextRequestDeadline(const QDBusConnection &connection, const QDBusMessage &message);
+    void dropRequests(const QList<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> &requests, bool sendReply);
+    void removeRequests(const QSet<Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData*> &requests);
+
+    // RequestData instances are recycled rather than reallocated for every request.
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *acquireRequestData();
+    void releaseRequestData(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request);
+    void finishCoalescedRequests(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue::RequestData *request, const QList<QVariant> &outParams);
+
 protected:
+    // Replies and signals must be sent via sendMessage(), so that they can be
+    // withheld until any writes they depend upon have been made durable.
+    // request is the method call being replied to, or an empty message for signals.
+    void sendMessage(const QDBusConnection &connection, const QDBusMessage &message, const QDBusMessage &request = QDBusMessage());
+    int deferredMessageCount() const { return m_deferredMessages.size(); }
+
+    // If this returns true, sendMessage() defers the message and calls messageDeferred().
+    // The subclass must later call sendDeferredMessages().
+    virtual bool messagesDeferred() const;
+    virtual void messageDeferred();
+
+    struct DeferredMessage {
+        DeferredMessage(const QDBusConnection &c, const QDBusMessage &m, const QDBusMessage &r)
+            : connection(c), message(m), request(r) {}
+        QDBusConnection connection;
+        QDBusMessage message;
+        QDBusMessage request;
+    };
+
     Controller *m_controller;
     QObject *m_dbusObject;
     QString m_dbusObjectPath;
     QString m_dbusInterfaceName;
-    QList<RequestData*> m_requests;
+    QByteArray m_traceCategory;
+    QList<RequestData*> m_requests;             // FIFO order of in-flight requests
+    QHash<quint64, RequestData*> m_requestsById; // index into m_requests by request id
+    quint64 m_nextRequestId;
+    QThreadPool m_workerPool;
+    int m_maxWorkerThreads;
+    pid_t m_lastScheduledPid; // the caller most recently served by the round-robin scheduler
+    QHash<QString, quint64> m_coalescingRequests;        // coalescing key to in-flight request id
+    QHash<quint64, QList<quint64> > m_coalescedRequests; // in-flight request id to ids of identical requests
+    QList<RequestData*> m_requestDataPool;      // released RequestData instances available for reuse
+    QDBusConnection m_invalidConnection;        // assigned to released RequestData instances
+    QHash<pid_t, int> m_callerRequestCounts;    // number of in-flight requests per caller
+    QHash<QString, QPair<QString, qint64> > m_nextRequestDeadlines; // connection name to method and deadline of its next request
+    qint64 m_queuedBytes;                       // sum of inParamsSize of all in-flight requests
+    int m_maxRequestsPerCaller;
+    int m_maxQueueDepth;
+    qint64 m_maxQueuedBytes;
+    QElapsedTimer m_statisticsClock;
+    qint64 m_lastActivityTime;                  // usecs on m_statisticsClock
+    Sailfish::Secrets::Daemon::RequestStatistics m_statistics;
+    QScopedPointer<Sailfish::Secrets::Daemon::YieldPolicy> m_yieldPolicy;
+    QList<DeferredMessage> m_deferredMessages;  // in the order they were sent
 
     QString m_pluginDir;
     bool m_autotestMode;
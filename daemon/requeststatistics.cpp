@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "requeststatistics_p.h"
+
+namespace {
+    // bucket upper bounds, in microseconds.  the final bucket is unbounded.
+    const qint64 BucketUpperBounds[] = {
+        100, 250, 500,
+        1000, 2500, 5000,
+        10000, 25000, 50000,
+        100000, 250000, 1000000
+    };
+}
+
+Sailfish::Secrets::Daemon::LatencyHistogram::LatencyHistogram()
+    : m_count(0)
+    , m_totalUsecs(0)
+    , m_maxUsecs(0)
+{
+    Q_STATIC_ASSERT(sizeof(BucketUpperBounds) / sizeof(BucketUpperBounds[0]) == BucketCount - 1);
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] = 0;
+    }
+}
+
+void Sailfish::Secrets::Daemon::LatencyHistogram::record(qint64 usecs)
+{
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && usecs > BucketUpperBounds[bucket]) {
+        bucket++;
+    }
+    m_buckets[bucket]++;
+    m_count++;
+    m_totalUsecs += usecs;
+    m_maxUsecs = qMax(m_maxUsecs, usecs);
+}
+
+QVariantMap Sailfish::Secrets::Daemon::LatencyHistogram::toVariantMap() const
+{
+    QVariantList buckets;
+    for (int i = 0; i < BucketCount; ++i) {
+        buckets.append(QVariant::fromValue<quint64>(m_buckets[i]));
+    }
+
+    QVariantMap map;
+    map.insert(QStringLiteral("count"), QVariant::fromValue<quint64>(m_count));
+    map.insert(QStringLiteral("totalUsecs"), QVariant::fromValue<qint64>(m_totalUsecs));
+    map.insert(QStringLiteral("maxUsecs"), QVariant::fromValue<qint64>(m_maxUsecs));
+    map.insert(QStringLiteral("buckets"), buckets);
+    return map;
+}
+
+QVariantMap Sailfish::Secrets::Daemon::MemoryGauge::toVariantMap() const
+{
+    QVariantMap map;
+    map.insert(QStringLiteral("bytes"), QVariant::fromValue<qint64>(m_bytes));
+    map.insert(QStringLiteral("highWaterMark"), QVariant::fromValue<qint64>(m_highWaterMark));
+    return map;
+}
+
+QVariantList Sailfish::Secrets::Daemon::LatencyHistogram::bucketUpperBounds()
+{
+    QVariantList bounds;
+    for (int i = 0; i < BucketCount - 1; ++i) {
+        bounds.append(QVariant::fromValue<qint64>(BucketUpperBounds[i]));
+    }
+    return bounds;
+}
+
+QVariantMap Sailfish::Secrets::Daemon::RequestStatistics::toVariantMap(int requestType) const
+{
+    const Sailfish::Secrets::Daemon::RequestStatistics::RequestTypeStatistics stats = m_requestTypes.value(requestType);
+    QVariantMap map;
+    map.insert(QStringLiteral("count"), QVariant::fromValue<quint64>(stats.processingTime.count()));
+    map.insert(QStringLiteral("waitTime"), stats.waitTime.toVariantMap());
+    map.insert(QStringLiteral("processingTime"), stats.processingTime.toVariantMap());
+    return map;
+}
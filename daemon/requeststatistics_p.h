@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_REQUESTSTATISTICS_P_H
+#define SAILFISHSECRETS_DAEMON_REQUESTSTATISTICS_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QVariant>
+#include <QtCore/QVariantList>
+#include <QtCore/QVariantMap>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+// A fixed-bucket histogram of latencies, in microseconds.
+// Recording a value is cheap, so histograms are always enabled.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 usecs);
+    quint64 count() const { return m_count; }
+    qint64 meanUsecs() const { return m_count ? m_totalUsecs / static_cast<qint64>(m_count) : 0; }
+    QVariantMap toVariantMap() const;
+
+    // the (inclusive) upper bound of each bucket but the last, which is unbounded.
+    static QVariantList bucketUpperBounds();
+
+private:
+    enum { BucketCount = 13 };
+    quint64 m_buckets[BucketCount];
+    quint64 m_count;
+    qint64 m_totalUsecs;
+    qint64 m_maxUsecs;
+};
+
+// The live size of some part of the daemon's memory, and the largest it has been.
+class MemoryGauge
+{
+public:
+    MemoryGauge() : m_bytes(0), m_highWaterMark(0) {}
+
+    void set(qint64 bytes) { m_bytes = bytes; m_highWaterMark = qMax(m_highWaterMark, bytes); }
+    void add(qint64 bytes) { set(m_bytes + bytes); }
+    qint64 bytes() const { return m_bytes; }
+    qint64 highWaterMark() const { return m_highWaterMark; }
+    QVariantMap toVariantMap() const;
+
+private:
+    qint64 m_bytes;
+    qint64 m_highWaterMark;
+};
+
+// Counters and latency histograms for the requests handled by a RequestQueue.
+class RequestStatistics
+{
+public:
+    RequestStatistics() : m_yieldCount(0), m_rejectedCount(0), m_expiredCount(0), m_coalescedCount(0), m_cancelledCount(0) {}
+
+    void recordWaitTime(int requestType, qint64 usecs) { m_requestTypes[requestType].waitTime.record(usecs); }
+    void recordProcessingTime(int requestType, qint64 usecs) { m_requestTypes[requestType].processingTime.record(usecs); m_processingTime.record(usecs); }
+    void recordYield() { m_yieldCount++; }
+    void recordRejected() { m_rejectedCount++; }
+    void recordExpired() { m_expiredCount++; }
+    void recordCoalesced() { m_coalescedCount++; }
+    void recordCancelled(int count) { m_cancelledCount += count; }
+    void recordEventLoopLag(qint64 usecs) { m_eventLoopLag.record(usecs); }
+
+    quint64 yieldCount() const { return m_yieldCount; }
+    quint64 rejectedCount() const { return m_rejectedCount; }
+    quint64 expiredCount() const { return m_expiredCount; }
+    quint64 coalescedCount() const { return m_coalescedCount; }
+    quint64 cancelledCount() const { return m_cancelledCount; }
+    const LatencyHistogram &processingTime() const { return m_processingTime; }
+    const LatencyHistogram &eventLoopLag() const { return m_eventLoopLag; }
+    QList<int> requestTypes() const { return m_requestTypes.keys(); }
+    QVariantMap toVariantMap(int requestType) const;
+
+private:
+    struct RequestTypeStatistics {
+        LatencyHistogram waitTime;       // from enqueue until handling starts
+        LatencyHistogram processingTime; // from handling start until the reply is sent
+    };
+    QHash<int, RequestTypeStatistics> m_requestTypes;
+    LatencyHistogram m_processingTime; // across all request types
+    LatencyHistogram m_eventLoopLag;   // how long each pass over the queue kept the event loop from dispatching messages
+    quint64 m_yieldCount;
+    quint64 m_rejectedCount;
+    quint64 m_expiredCount;
+    quint64 m_coalescedCount; // requests which were given the result of an identical request
+    quint64 m_cancelledCount; // requests which were cancelled by their client
+};
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_REQUESTSTATISTICS_P_H
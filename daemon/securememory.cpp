@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "securememory_p.h"
+#include "logging_p.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+namespace {
+    // allocations within the arena are rounded up to this many bytes.
+    const size_t Granularity = 16;
+
+    // the total size of the mappings given to allocations which don't fit into the
+    // arena is bounded by the arena's capacity, and at least this many bytes.
+    const size_t MinimumOverflowCapacity = 64 * 1024;
+
+    void wipeMemory(char *data, size_t length)
+    {
+        // prevent the compiler from optimising away the wipe of memory which is about to be released.
+        volatile char *p = data;
+        while (length--) {
+            *p++ = 0;
+        }
+    }
+
+    size_t roundUp(size_t length, size_t multiple)
+    {
+        return qMax((length + multiple - 1) / multiple, size_t(1)) * multiple;
+    }
+}
+
+Sailfish::Secrets::Daemon::SecureArena *Sailfish::Secrets::Daemon::SecureArena::instance()
+{
+    static Sailfish::Secrets::Daemon::SecureArena arena;
+    return &arena;
+}
+
+Sailfish::Secrets::Daemon::SecureArena::SecureArena()
+    : m_mapping(Q_NULLPTR)
+    , m_base(Q_NULLPTR)
+    , m_mappedLength(0)
+    , m_capacity(0)
+    , m_used(0)
+    , m_overflowCapacity(MinimumOverflowCapacity)
+    , m_overflowUsed(0)
+    , m_pageSize(static_cast<size_t>(sysconf(_SC_PAGESIZE)))
+    , m_locked(false)
+    , m_lockFailureReported(false)
+{
+}
+
+Sailfish::Secrets::Daemon::SecureArena::~SecureArena()
+{
+    if (m_mapping) {
+        wipeMemory(m_base, m_capacity);
+        if (m_locked) {
+            munlock(m_base, m_capacity);
+        }
+        munmap(m_mapping, m_mappedLength);
+    }
+}
+
+bool Sailfish::Secrets::Daemon::SecureArena::initialise(qint64 capacity)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_mapping) {
+        qCWarning(lcSailfishSecretsDaemon) << "Secure memory arena is already initialised";
+        return false;
+    }
+    if (capacity <= 0) {
+        return true;
+    }
+
+    // one inaccessible guard page either side of the arena.
+    const size_t arenaLength = roundUp(static_cast<size_t>(capacity), m_pageSize);
+    const size_t mappedLength = arenaLength + 2 * m_pageSize;
+    void *mapping = mmap(Q_NULLPTR, mappedLength, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to map secure memory arena:" << strerror(errno);
+        return false;
+    }
+
+    char *base = static_cast<char*>(mapping) + m_pageSize;
+    if (mprotect(base, arenaLength, PROT_READ | PROT_WRITE) != 0) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to protect secure memory arena:" << strerror(errno);
+        munmap(mapping, mappedLength);
+        return false;
+    }
+#ifdef MADV_DONTDUMP
+    madvise(base, arenaLength, MADV_DONTDUMP);
+#endif
+    // memory which could be written to swap is no use for key material.
+    if (mlock(base, arenaLength) != 0) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to lock secure memory arena:" << strerror(errno);
+        m_lockFailureReported = true;
+        munmap(mapping, mappedLength);
+        return false;
+    }
+
+    m_mapping = static_cast<char*>(mapping);
+    m_base = base;
+    m_mappedLength = mappedLength;
+    m_capacity = arenaLength;
+    m_overflowCapacity = qMax(arenaLength, MinimumOverflowCapacity);
+    m_locked = true;
+    m_freeExtents.insert(0, arenaLength);
+    return true;
+}
+
+qint64 Sailfish::Secrets::Daemon::SecureArena::capacity() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_capacity);
+}
+
+qint64 Sailfish::Secrets::Daemon::SecureArena::used() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_used);
+}
+
+qint64 Sailfish::Secrets::Daemon::SecureArena::overflowUsed() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_overflowUsed);
+}
+
+Sailfish::Secrets::Daemon::SecureArena::Allocation
+Sailfish::Secrets::Daemon::SecureArena::allocate(int length)
+{
+    const size_t required = roundUp(static_cast<size_t>(qMax(length, 0)), Granularity);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        for (QMap<size_t, size_t>::iterator it = m_freeExtents.begin(); it != m_freeExtents.end(); ++it) {
+            if (it.value() < required) {
+                continue;
+            }
+            const size_t offset = it.key();
+            const size_t remaining = it.value() - required;
+            m_freeExtents.erase(it);
+            if (remaining) {
+                m_freeExtents.insert(offset + required, remaining);
+            }
+            m_used += required;
+
+            Allocation allocation;
+            allocation.data = m_base + offset;
+            allocation.length = required;
+            allocation.inArena = true;
+            allocation.locked = m_locked;
+            return allocation;
+        }
+    }
+
+    return allocateMapping(length);
+}
+
+Sailfish::Secrets::Daemon::SecureArena::Allocation
+Sailfish::Secrets::Daemon::SecureArena::allocateMapping(int length)
+{
+    Allocation allocation;
+    const size_t mappedLength = roundUp(static_cast<size_t>(qMax(length, 0)), m_pageSize);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_overflowUsed + mappedLength > m_overflowCapacity) {
+            qCWarning(lcSailfishSecretsDaemon) << "Secure memory exhausted, unable to allocate" << length << "bytes";
+            return allocation;
+        }
+        m_overflowUsed += mappedLength;
+    }
+
+    void *data = mmap(Q_NULLPTR, mappedLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to map secure memory:" << strerror(errno);
+        QMutexLocker locker(&m_mutex);
+        m_overflowUsed -= mappedLength;
+        return allocation;
+    }
+#ifdef MADV_DONTDUMP
+    madvise(data, mappedLength, MADV_DONTDUMP);
+#endif
+
+    // memory which could be written to swap is no use for key material.
+    if (mlock(data, mappedLength) != 0) {
+        const int lockError = errno;
+        munmap(data, mappedLength);
+        QMutexLocker locker(&m_mutex);
+        m_overflowUsed -= mappedLength;
+        if (!m_lockFailureReported) {
+            qCWarning(lcSailfishSecretsDaemon) << "Unable to lock secure memory:" << strerror(lockError);
+            m_lockFailureReported = true;
+        }
+        return allocation;
+    }
+
+    allocation.data = static_cast<char*>(data);
+    allocation.length = mappedLength;
+    allocation.locked = true;
+    return allocation;
+}
+
+void Sailfish::Secrets::Daemon::SecureArena::release(
+        const Sailfish::Secrets::Daemon::SecureArena::Allocation &allocation)
+{
+    if (!allocation.data) {
+        return;
+    }
+
+    wipeMemory(allocation.data, allocation.length);
+
+    if (!allocation.inArena) {
+        munlock(allocation.data, allocation.length);
+        munmap(allocation.data, allocation.length);
+        QMutexLocker locker(&m_mutex);
+        m_overflowUsed -= allocation.length;
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    size_t offset = static_cast<size_t>(allocation.data - m_base);
+    size_t length = allocation.length;
+    m_used -= length;
+
+    // coalesce with the following and preceding free extents.
+    QMap<size_t, size_t>::iterator next = m_freeExtents.lowerBound(offset);
+    if (next != m_freeExtents.end() && next.key() == offset + length) {
+        length += next.value();
+        next = m_freeExtents.erase(next);
+    }
+    if (next != m_freeExtents.begin()) {
+        QMap<size_t, size_t>::iterator previous = next;
+        --previous;
+        if (previous.key() + previous.value() == offset) {
+            offset = previous.key();
+            length += previous.value();
+            m_freeExtents.erase(previous);
+        }
+    }
+    m_freeExtents.insert(offset, length);
+}
+
+Sailfish::Secrets::Daemon::SecureByteArray::Data::~Data()
+{
+    Sailfish::Secrets::Daemon::SecureArena::instance()->release(allocation);
+}
+
+Sailfish::Secrets::Daemon::SecureByteArray::SecureByteArray()
+{
+}
+
+Sailfish::Secrets::Daemon::SecureByteArray::SecureByteArray(const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return;
+    }
+
+    Data *secureData = new Data;
+    secureData->allocation = Sailfish::Secrets::Daemon::SecureArena::instance()->allocate(data.size());
+    if (secureData->allocation.data) {
+        memcpy(secureData->allocation.data, data.constData(), data.size());
+        secureData->length = data.size();
+    }
+    d = secureData;
+}
+
+Sailfish::Secrets::Daemon::SecureByteArray::SecureByteArray(
+        const Sailfish::Secrets::Daemon::SecureByteArray &other)
+    : d(other.d)
+{
+}
+
+Sailfish::Secrets::Daemon::SecureByteArray::~SecureByteArray()
+{
+}
+
+Sailfish::Secrets::Daemon::SecureByteArray &
+Sailfish::Secrets::Daemon::SecureByteArray::operator=(
+        const Sailfish::Secrets::Daemon::SecureByteArray &other)
+{
+    d = other.d;
+    return *this;
+}
+
+int Sailfish::Secrets::Daemon::SecureByteArray::size() const
+{
+    return d ? d->length : 0;
+}
+
+size_t Sailfish::Secrets::Daemon::SecureByteArray::allocatedSize() const
+{
+    return d ? d->allocation.length : 0;
+}
+
+bool Sailfish::Secrets::Daemon::SecureByteArray::isLocked() const
+{
+    return d && d->allocation.locked;
+}
+
+QByteArray Sailfish::Secrets::Daemon::SecureByteArray::rawData() const
+{
+    return d ? QByteArray::fromRawData(d->allocation.data, d->length) : QByteArray();
+}
+
+void Sailfish::Secrets::Daemon::wipe(QByteArray *data)
+{
+    // writing to a shared array would detach it and leave the contents in its
+    // other copies, so those are only cleared.
+    if (!data->isEmpty() && data->isDetached()) {
+        wipeMemory(data->data(), data->size());
+    }
+    data->clear();
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_SECUREMEMORY_P_H
+#define SAILFISHSECRETS_DAEMON_SECUREMEMORY_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedData>
+
+#include <sys/types.h>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+// A preallocated region of memory for key material and plaintext which is
+// locked into RAM, excluded from core dumps, and bounded by inaccessible
+// guard pages.  Every allocation is wiped when it is released.
+// Requests which do not fit into the arena are given their own locked
+// mapping instead, up to a bounded total, so callers never fall back to the
+// ordinary heap.  Memory which can't be locked is never handed out: the
+// allocation fails instead, and its data is null.
+class SecureArena
+{
+public:
+    struct Allocation {
+        Allocation() : data(Q_NULLPTR), length(0), inArena(false), locked(false) {}
+        char *data;
+        size_t length;  // the allocated (rounded-up) length
+        bool inArena;
+        bool locked;
+    };
+
+    static SecureArena *instance();
+
+    // Must be called before the first allocation, otherwise every
+    // allocation is given its own mapping.
+    bool initialise(qint64 capacity);
+
+    qint64 capacity() const;
+    qint64 used() const;
+    qint64 overflowUsed() const;
+
+    Allocation allocate(int length);
+    void release(const Allocation &allocation);
+
+private:
+    SecureArena();
+    ~SecureArena();
+
+    Allocation allocateMapping(int length);
+
+    mutable QMutex m_mutex;
+    QMap<size_t, size_t> m_freeExtents; // offset -> length, coalesced on release
+    char *m_mapping;
+    char *m_base;
+    size_t m_mappedLength;
+    size_t m_capacity;
+    size_t m_used;
+    size_t m_overflowCapacity;
+    size_t m_overflowUsed;
+    size_t m_pageSize;
+    bool m_locked;
+    bool m_lockFailureReported;
+
+    Q_DISABLE_COPY(SecureArena)
+};
+
+// An immutable, implicitly shared byte array whose contents live in the SecureArena.
+class SecureByteArray
+{
+public:
+    SecureByteArray();
+    explicit SecureByteArray(const QByteArray &data);
+    SecureByteArray(const SecureByteArray &other);
+    ~SecureByteArray();
+    SecureByteArray &operator=(const SecureByteArray &other);
+
+    // An array constructed from non-empty data is empty if no secure memory
+    // could be allocated for it, so callers should compare sizes.
+    bool isEmpty() const { return size() == 0; }
+    int size() const;
+    size_t allocatedSize() const;
+    bool isLocked() const;
+
+    // Refers directly to the secure memory, so is only valid
+    // for as long as this array (or a copy of it) exists.
+    QByteArray rawData() const;
+
+private:
+    class Data : public QSharedData
+    {
+    public:
+        Data() : length(0) {}
+        ~Data();
+        SecureArena::Allocation allocation;
+        int length;
+    };
+    QExplicitlySharedDataPointer<Data> d;
+};
+
+// Overwrites the contents of the given byte array before clearing it.
+// The array must not share its contents with any other (e.g. a copy, or one
+// from QByteArray::fromRawData()), otherwise they are cleared but not wiped.
+void wipe(QByteArray *data);
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_SECUREMEMORY_P_H
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "sharedmemory_p.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+namespace {
+    const int RequiredSeals = F_SEAL_SHRINK | F_SEAL_WRITE;
+    const int AllSeals = F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+    QString errnoString(const char *operation)
+    {
+        return QString::fromLatin1("%1 failed: %2").arg(QLatin1String(operation), QString::fromLocal8Bit(strerror(errno)));
+    }
+}
+
+Sailfish::Secrets::Daemon::MappedMemfd::MappedMemfd()
+    : m_address(MAP_FAILED)
+    , m_size(0)
+{
+}
+
+Sailfish::Secrets::Daemon::MappedMemfd::~MappedMemfd()
+{
+    unmap();
+}
+
+bool Sailfish::Secrets::Daemon::MappedMemfd::map(const QDBusUnixFileDescriptor &fd, QString *errorString)
+{
+    unmap();
+
+    if (!fd.isValid()) {
+        *errorString = QLatin1String("Invalid file descriptor given");
+        return false;
+    }
+
+    const int seals = fcntl(fd.fileDescriptor(), F_GET_SEALS);
+    if (seals < 0 || (seals & RequiredSeals) != RequiredSeals) {
+        *errorString = QLatin1String("File descriptor is not a memfd sealed against writing and shrinking");
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd.fileDescriptor(), &st) != 0) {
+        *errorString = errnoString("fstat");
+        return false;
+    }
+
+    // the contents are accessed as a QByteArray, whose size is an int.
+    if (st.st_size > INT_MAX) {
+        *errorString = QString::fromLatin1("Memfd payload of %1 bytes is too large").arg(qint64(st.st_size));
+        return false;
+    }
+
+    m_size = st.st_size;
+    if (m_size == 0) {
+        // mmap() doesn't allow empty mappings.
+        return true;
+    }
+
+    m_address = mmap(Q_NULLPTR, m_size, PROT_READ, MAP_PRIVATE, fd.fileDescriptor(), 0);
+    if (m_address == MAP_FAILED) {
+        *errorString = errnoString("mmap");
+        m_size = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void Sailfish::Secrets::Daemon::MappedMemfd::unmap()
+{
+    if (m_address != MAP_FAILED) {
+        munmap(m_address, m_size);
+        m_address = MAP_FAILED;
+    }
+    m_size = 0;
+}
+
+QByteArray Sailfish::Secrets::Daemon::MappedMemfd::data() const
+{
+    return m_address == MAP_FAILED
+            ? QByteArray()
+            : QByteArray::fromRawData(static_cast<const char *>(m_address), m_size);
+}
+
+qint64 Sailfish::Secrets::Daemon::memfdSize(const QDBusUnixFileDescriptor &fd)
+{
+    struct stat st;
+    if (!fd.isValid() || fstat(fd.fileDescriptor(), &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+QDBusUnixFileDescriptor Sailfish::Secrets::Daemon::createSealedMemfd(const QByteArray &data, QString *errorString)
+{
+    const int fd = static_cast<int>(syscall(SYS_memfd_create, "sailfishsecretsd", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (fd < 0) {
+        *errorString = errnoString("memfd_create");
+        return QDBusUnixFileDescriptor();
+    }
+
+    const char *buf = data.constData();
+    qint64 remaining = data.size();
+    while (remaining > 0) {
+        const ssize_t written = write(fd, buf, remaining);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            *errorString = errnoString("write");
+            close(fd);
+            return QDBusUnixFileDescriptor();
+        }
+        buf += written;
+        remaining -= written;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, AllSeals) != 0) {
+        *errorString = errnoString("fcntl(F_ADD_SEALS)");
+        close(fd);
+        return QDBusUnixFileDescriptor();
+    }
+
+    // QDBusUnixFileDescriptor takes a duplicate of the descriptor.
+    QDBusUnixFileDescriptor retn(fd);
+    close(fd);
+    return retn;
+}
+
+bool Sailfish::Secrets::Daemon::payloadData(const QVariant &payload, MappedMemfd *mapping, QByteArray *data, QString *errorString)
+{
+    if (payload.userType() != qMetaTypeId<QDBusUnixFileDescriptor>()) {
+        *data = payload.toByteArray();
+        return true;
+    }
+
+    if (!mapping->map(payload.value<QDBusUnixFileDescriptor>(), errorString)) {
+        return false;
+    }
+
+    *data = mapping->data();
+    return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_SHAREDMEMORY_P_H
+#define SAILFISHSECRETS_DAEMON_SHAREDMEMORY_P_H
+
+#include <QtDBus/QDBusUnixFileDescriptor>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+// A read-only mapping of a sealed memfd passed by a client.
+// The memfd must be sealed against writing and shrinking, so that the
+// client cannot modify (or truncate) the memory while we operate on it.
+class MappedMemfd
+{
+public:
+    MappedMemfd();
+    ~MappedMemfd();
+
+    bool map(const QDBusUnixFileDescriptor &fd, QString *errorString);
+    void unmap();
+
+    // Refers directly to the mapped memory, so is only valid until unmap().
+    QByteArray data() const;
+
+private:
+    Q_DISABLE_COPY(MappedMemfd)
+    void *m_address;
+    qint64 m_size;
+};
+
+// Returns the size of the given memfd's contents, or zero if it is invalid.
+qint64 memfdSize(const QDBusUnixFileDescriptor &fd);
+
+// Returns a new memfd containing the given data, sealed against any modification.
+QDBusUnixFileDescriptor createSealedMemfd(const QByteArray &data, QString *errorString);
+
+// Request payloads are either passed inline as a QByteArray or as a sealed memfd.
+// A memfd payload is mapped via the given mapping, and so the returned data is
+// only valid for the lifetime of the mapping.
+bool payloadData(const QVariant &payload, MappedMemfd *mapping, QByteArray *data, QString *errorString);
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_SHAREDMEMORY_P_H
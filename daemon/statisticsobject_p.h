@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_STATISTICSOBJECT_P_H
+#define SAILFISHSECRETS_DAEMON_STATISTICSOBJECT_P_H
+
+#include <QtDBus/QDBusConnection>
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QVariantMap>
+
+#include "controller_p.h"
+#include "requestqueue_p.h"
+#include "memoryaccounting_p.h"
+#include "applicationaccounting_p.h"
+#include "databasemaintenance_p.h"
+#include "logging_p.h"
+#include "tracing_p.h"
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+// The StatisticsObject exposes request queue statistics via the DBus session bus,
+// so that monitoring agents can scrape them without enabling debug logging.
+class StatisticsObject : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.sailfishos.secrets.daemon.statistics")
+    Q_CLASSINFO("D-Bus Introspection", ""
+    "  <interface name=\"org.sailfishos.secrets.daemon.statistics\">\n"
+    "      <method name=\"statistics\" />\n"
+    "          <arg name=\"statistics\" type=\"a{sv}\" direction=\"out\" />\n"
+    "      </method>\n"
+    "      <method name=\"writeTrace\" />\n"
+    "          <arg name=\"written\" type=\"b\" direction=\"out\" />\n"
+    "      </method>\n"
+    "  </interface>\n"
+    "")
+
+public:
+    StatisticsObject(Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *secrets,
+                     Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *crypto,
+                     Sailfish::Secrets::Daemon::MemoryAccounting *memory,
+                     Sailfish::Secrets::Daemon::DatabaseMaintenance *maintenance,
+                     Sailfish::Secrets::Daemon::Controller *parent)
+        : QObject(parent)
+        , m_secrets(secrets)
+        , m_crypto(crypto)
+        , m_memory(memory)
+        , m_maintenance(maintenance)
+        , m_registered(false) {}
+
+    bool registerObject(const QString &serviceName, const QString &objectPath) {
+        if (m_registered) {
+            return true;
+        }
+
+        if (!QDBusConnection::sessionBus().registerObject(objectPath, this, QDBusConnection::ExportAllSlots)) {
+            qCWarning(lcSailfishSecretsDaemonDBus) << "Unable to register session bus service:" << serviceName << "at path:" << objectPath;
+            return false;
+        }
+
+        if (!QDBusConnection::sessionBus().registerService(serviceName)) {
+            qCWarning(lcSailfishSecretsDaemonDBus) << "Unable to register session bus service:" << serviceName;
+            return false;
+        }
+
+        m_registered = true;
+        return true;
+    }
+
+public Q_SLOTS:
+    QVariantMap statistics() const {
+        QVariantMap stats;
+        stats.insert(QStringLiteral("secrets"), m_secrets->statistics());
+        stats.insert(QStringLiteral("crypto"), m_crypto->statistics());
+        stats.insert(QStringLiteral("memory"), m_memory->statistics());
+        stats.insert(QStringLiteral("applications"), Sailfish::Secrets::Daemon::ApplicationAccounting::instance()->statistics());
+        if (m_maintenance) {
+            stats.insert(QStringLiteral("maintenance"), m_maintenance->statistics());
+        }
+        return stats;
+    }
+
+    // the trace is written to SAILFISH_SECRETSD_TRACE_FILE rather than a path
+    // given by the caller, so that clients can't have the daemon overwrite files.
+    bool writeTrace() const {
+#ifdef SAILFISH_SECRETS_TRACING
+        return Sailfish::Secrets::Daemon::Tracing::writeTrace();
+#else
+        return false;
+#endif
+    }
+
+private:
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *m_secrets;
+    Sailfish::Secrets::Daemon::ApiImpl::RequestQueue *m_crypto;
+    Sailfish::Secrets::Daemon::MemoryAccounting *m_memory;
+    Sailfish::Secrets::Daemon::DatabaseMaintenance *m_maintenance;
+    bool m_registered;
+};
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_STATISTICSOBJECT_P_H
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "tracing_p.h"
+
+#ifdef SAILFISH_SECRETS_TRACING
+
+#include "logging_p.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QHash>
+#include <QtCore/QSaveFile>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonArray>
+
+#include <time.h>
+
+namespace {
+    // the most recent events are kept, enough for a few thousand requests.
+    const quint32 TraceBufferSize = 1 << 16;
+
+    struct TraceEvent {
+        // written last, so that an event which is being overwritten isn't written out.
+        QAtomicInteger<quint32> sequence;
+        qint64 timestamp;
+        const char *category;
+        quint64 requestId;
+        const char *stage;
+        Qt::HANDLE thread;
+        char phase;
+    };
+
+    TraceEvent traceEvents[TraceBufferSize];
+    QAtomicInteger<quint32> nextTraceEvent;
+
+    thread_local const char *currentCategory = Q_NULLPTR;
+    thread_local quint64 currentRequestId = 0;
+
+    qint64 timestampNsecs()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+}
+
+void
+Sailfish::Secrets::Daemon::Tracing::record(const char *category, quint64 requestId, const char *stage, char phase)
+{
+    const quint32 index = nextTraceEvent.fetchAndAddRelaxed(1);
+    TraceEvent &event(traceEvents[index % TraceBufferSize]);
+    event.timestamp = timestampNsecs();
+    event.category = category;
+    event.requestId = requestId;
+    event.stage = stage;
+    event.thread = QThread::currentThreadId();
+    event.phase = phase;
+    event.sequence.storeRelease(index + 1);
+}
+
+void
+Sailfish::Secrets::Daemon::Tracing::begin(const char *stage)
+{
+    record(currentCategory, currentRequestId, stage, 'B');
+}
+
+void
+Sailfish::Secrets::Daemon::Tracing::end(const char *stage)
+{
+    record(currentCategory, currentRequestId, stage, 'E');
+}
+
+bool
+Sailfish::Secrets::Daemon::Tracing::writeTrace()
+{
+    const QString filePath = QString::fromLocal8Bit(qgetenv("SAILFISH_SECRETSD_TRACE_FILE"));
+    if (filePath.isEmpty()) {
+        return false;
+    }
+
+    const quint32 next = nextTraceEvent.loadAcquire();
+    const quint32 count = qMin(next, TraceBufferSize);
+    const int pid = int(QCoreApplication::applicationPid());
+    QHash<Qt::HANDLE, int> threads;
+    QJsonArray events;
+    for (quint32 index = next - count; index != next; ++index) {
+        const TraceEvent &event(traceEvents[index % TraceBufferSize]);
+        if (event.sequence.loadAcquire() != index + 1) {
+            continue;
+        }
+
+        QHash<Qt::HANDLE, int>::const_iterator thread = threads.constFind(event.thread);
+        if (thread == threads.constEnd()) {
+            thread = threads.insert(event.thread, threads.size() + 1);
+        }
+
+        QJsonObject args;
+        args.insert(QStringLiteral("requestId"), double(event.requestId));
+        QJsonObject object;
+        object.insert(QStringLiteral("name"), QLatin1String(event.stage));
+        object.insert(QStringLiteral("cat"), QLatin1String(event.category ? event.category : "none"));
+        object.insert(QStringLiteral("ph"), QString(QLatin1Char(event.phase)));
+        object.insert(QStringLiteral("ts"), double(event.timestamp) / 1000.0);
+        object.insert(QStringLiteral("pid"), pid);
+        object.insert(QStringLiteral("tid"), *thread);
+        object.insert(QStringLiteral("args"), args);
+        if (event.phase == 'i') {
+            object.insert(QStringLiteral("s"), QStringLiteral("t"));
+        }
+        events.append(object);
+    }
+
+    QJsonObject trace;
+    trace.insert(QStringLiteral("traceEvents"), events);
+    trace.insert(QStringLiteral("displayTimeUnit"), QStringLiteral("ns"));
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lcSailfishSecretsDaemon) << "Unable to open trace file:" << filePath;
+        return false;
+    }
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+Sailfish::Secrets::Daemon::Tracing::RequestScope::RequestScope(const char *category, quint64 requestId)
+    : m_previousCategory(currentCategory)
+    , m_previousRequestId(currentRequestId)
+{
+    currentCategory = category;
+    currentRequestId = requestId;
+}
+
+Sailfish::Secrets::Daemon::Tracing::RequestScope::~RequestScope()
+{
+    currentCategory = m_previousCategory;
+    currentRequestId = m_previousRequestId;
+}
+
+Sailfish::Secrets::Daemon::Tracing::SpanScope::SpanScope(const char *stage)
+    : m_category(currentCategory)
+    , m_requestId(currentRequestId)
+    , m_stage(stage)
+{
+    record(m_category, m_requestId, m_stage, 'B');
+}
+
+Sailfish::Secrets::Daemon::Tracing::SpanScope::~SpanScope()
+{
+    record(m_category, m_requestId, m_stage, 'E');
+}
+
+#endif // SAILFISH_SECRETS_TRACING
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_TRACING_P_H
+#define SAILFISHSECRETS_DAEMON_TRACING_P_H
+
+#include <QtCore/QString>
+
+// Per-request trace spans, which are only compiled in when the daemon is
+// built with "qmake CONFIG+=tracing".  Each stage of a request records a
+// begin and an end event, keyed by the request id of the queue which is
+// handling it, into a fixed-size ring buffer (so recording never allocates
+// or locks).  The buffer is written on request as trace event JSON, which
+// the Perfetto UI and chrome://tracing can open.
+//
+// SAILFISH_SECRETS_TRACE_REQUEST(category, requestId) marks the rest of the
+// scope as belonging to the request, so that the spans of the stages it
+// calls into (the processor, plugins and database) needn't be passed the id.
+// SAILFISH_SECRETS_TRACE_SPAN(stage) records the rest of the scope as a stage
+// of the current request, or SAILFISH_SECRETS_TRACE_BEGIN(stage) and
+// SAILFISH_SECRETS_TRACE_END(stage) the code between them (which mustn't
+// return early), and SAILFISH_SECRETS_TRACE_EVENT(category, requestId, stage)
+// records a point in time.  The category and stage must be static, or
+// must outlive the trace.
+
+#ifdef SAILFISH_SECRETS_TRACING
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace Tracing {
+
+void record(const char *category, quint64 requestId, const char *stage, char phase);
+void begin(const char *stage);
+void end(const char *stage);
+
+// Writes the events recorded so far to the file given by SAILFISH_SECRETSD_TRACE_FILE.
+bool writeTrace();
+
+class RequestScope
+{
+public:
+    RequestScope(const char *category, quint64 requestId);
+    ~RequestScope();
+
+private:
+    const char *m_previousCategory;
+    quint64 m_previousRequestId;
+};
+
+class SpanScope
+{
+public:
+    SpanScope(const char *stage);
+    ~SpanScope();
+
+private:
+    const char *m_category;
+    quint64 m_requestId;
+    const char *m_stage;
+};
+
+} // namespace Tracing
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#define SAILFISH_SECRETS_TRACE_CONCAT_(a, b) a##b
+#define SAILFISH_SECRETS_TRACE_CONCAT(a, b) SAILFISH_SECRETS_TRACE_CONCAT_(a, b)
+
+#define SAILFISH_SECRETS_TRACE_REQUEST(category, requestId) \
+    Sailfish::Secrets::Daemon::Tracing::RequestScope SAILFISH_SECRETS_TRACE_CONCAT(traceRequest, __LINE__)(category, requestId)
+#define SAILFISH_SECRETS_TRACE_SPAN(stage) \
+    Sailfish::Secrets::Daemon::Tracing::SpanScope SAILFISH_SECRETS_TRACE_CONCAT(traceSpan, __LINE__)(stage)
+#define SAILFISH_SECRETS_TRACE_BEGIN(stage) \
+    Sailfish::Secrets::Daemon::Tracing::begin(stage)
+#define SAILFISH_SECRETS_TRACE_END(stage) \
+    Sailfish::Secrets::Daemon::Tracing::end(stage)
+#define SAILFISH_SECRETS_TRACE_EVENT(category, requestId, stage) \
+    Sailfish::Secrets::Daemon::Tracing::record(category, requestId, stage, 'i')
+
+#else
+
+#define SAILFISH_SECRETS_TRACE_REQUEST(category, requestId) do {} while (0)
+#define SAILFISH_SECRETS_TRACE_SPAN(stage) do {} while (0)
+#define SAILFISH_SECRETS_TRACE_BEGIN(stage) do {} while (0)
+#define SAILFISH_SECRETS_TRACE_END(stage) do {} while (0)
+#define SAILFISH_SECRETS_TRACE_EVENT(category, requestId, stage) do {} while (0)
+
+#endif // SAILFISH_SECRETS_TRACING
+
+#endif // SAILFISHSECRETS_DAEMON_TRACING_P_H
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "yieldpolicy_p.h"
+
+namespace {
+    // moving averages weight each new sample by 1/AverageWeight.
+    const qint64 AverageWeight = 8;
+
+    qint64 movingAverage(qint64 average, qint64 sample)
+    {
+        return average + (sample - average) / AverageWeight;
+    }
+}
+
+QVariantMap Sailfish::Secrets::Daemon::YieldPolicy::statistics() const
+{
+    QVariantMap stats;
+    stats.insert(QStringLiteral("name"), name());
+    return stats;
+}
+
+QString Sailfish::Secrets::Daemon::FixedYieldPolicy::name() const
+{
+    return QStringLiteral("fixed");
+}
+
+qint64 Sailfish::Secrets::Daemon::FixedYieldPolicy::passBudget(qint64)
+{
+    return m_budgetUsecs;
+}
+
+bool Sailfish::Secrets::Daemon::FixedYieldPolicy::shouldYield(qint64 elapsedUsecs, qint64 budgetUsecs, int, bool) const
+{
+    return elapsedUsecs > budgetUsecs;
+}
+
+QVariantMap Sailfish::Secrets::Daemon::FixedYieldPolicy::statistics() const
+{
+    QVariantMap stats = YieldPolicy::statistics();
+    stats.insert(QStringLiteral("budgetUsecs"), QVariant::fromValue<qint64>(m_budgetUsecs));
+    return stats;
+}
+
+Sailfish::Secrets::Daemon::AdaptiveYieldPolicy::AdaptiveYieldPolicy(qint64 minimumBudgetUsecs, qint64 maximumBudgetUsecs)
+    : m_minimumBudgetUsecs(qMax(Q_INT64_C(0), minimumBudgetUsecs))
+    , m_maximumBudgetUsecs(qMax(m_minimumBudgetUsecs, maximumBudgetUsecs))
+    , m_lastArrival(-1)
+    , m_meanArrivalGap(-1)
+    , m_lastBudget(m_maximumBudgetUsecs)
+{
+}
+
+QString Sailfish::Secrets::Daemon::AdaptiveYieldPolicy::name() const
+{
+    return QStringLiteral("adaptive");
+}
+
+void Sailfish::Secrets::Daemon::AdaptiveYieldPolicy::requestArrived(qint64 nowUsecs)
+{
+    if (m_lastArrival >= 0) {
+        const qint64 gap = qMax(Q_INT64_C(0), nowUsecs - m_lastArrival);
+        m_meanArrivalGap = m_meanArrivalGap < 0 ? gap : movingAverage(m_meanArrivalGap, gap);
+    }
+    m_lastArrival = nowUsecs;
+}
+
+void Sailfish::Secrets::Daemon::AdaptiveYieldPolicy::requestHandled(int requestType, bool finished, qint64 usecs)
+{
+    const int key = costKey(requestType, finished);
+    QHash<int, qint64>::iterator it = m_costs.find(key);
+    if (it == m_costs.end()) {
+        m_costs.insert(key, usecs);
+    } else {
+        *it = movingAverage(*it, usecs);
+    }
+}
+
+qint64 Sailfish::Secrets::Daemon::AdaptiveYieldPolicy::passBudget(qint64 nowUsecs)
+{
+    if (m_meanArrivalGap < 0) {
+        m_lastBudget = m_maximumBudgetUsecs;
+    } else {
+        // the average lags behind once a burst stops, so the time since the
+        // last arrival is used instead if it is longer.
+        const qint64 gap = qMax(m_meanArrivalGap, nowUsecs - m_lastArrival);
+        m_lastBudget = qBound(m_minimumBudgetUsecs, gap, m_maximumBudgetUsecs);
+    }
+    return m_lastBudget;
+}
+
+bool Sailfish::Secrets::Daemon::AdaptiveYieldPolicy::shouldYield(qint64 elapsedUsecs, qint64 budgetUsecs, int nextRequestType, bool nextFinished) const
+{
+    return elapsedUsecs + m_costs.value(costKey(nextRequestType, nextFinished)) > budgetUsecs;
+}
+
+QVariantMap Sailfish::Secrets::Daemon::AdaptiveYieldPolicy::statistics() const
+{
+    QVariantMap stats = YieldPolicy::statistics();
+    stats.insert(QStringLiteral("minimumBudgetUsecs"), QVariant::fromValue<qint64>(m_minimumBudgetUsecs));
+    stats.insert(QStringLiteral("maximumBudgetUsecs"), QVariant::fromValue<qint64>(m_maximumBudgetUsecs));
+    stats.insert(QStringLiteral("budgetUsecs"), QVariant::fromValue<qint64>(m_lastBudget));
+    stats.insert(QStringLiteral("meanArrivalGapUsecs"), QVariant::fromValue<qint64>(m_meanArrivalGap));
+    return stats;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_DAEMON_YIELDPOLICY_P_H
+#define SAILFISHSECRETS_DAEMON_YIELDPOLICY_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QVariantMap>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+// Decides when a RequestQueue should stop handling requests and return to
+// the event loop, so that incoming DBus messages are dispatched.  Each pass
+// over the queue is given a budget, and before each request after the first
+// the policy is asked whether to yield instead.  All times are in usecs.
+class YieldPolicy
+{
+public:
+    virtual ~YieldPolicy() {}
+
+    virtual QString name() const = 0;
+
+    // Called as each client request is enqueued.
+    virtual void requestArrived(qint64 nowUsecs) { Q_UNUSED(nowUsecs); }
+    // Called once a request has been handled on the main thread, with the time it took.
+    virtual void requestHandled(int requestType, bool finished, qint64 usecs) { Q_UNUSED(requestType); Q_UNUSED(finished); Q_UNUSED(usecs); }
+
+    // Called at the start of each pass, returns its budget.
+    virtual qint64 passBudget(qint64 nowUsecs) = 0;
+    // Whether to yield before handling the next request, which is of the given
+    // type and is either pending or finished (i.e. only its reply is to be sent).
+    virtual bool shouldYield(qint64 elapsedUsecs, qint64 budgetUsecs, int nextRequestType, bool nextFinished) const = 0;
+
+    // The policy's current state, for the statistics DBus interface.
+    virtual QVariantMap statistics() const;
+};
+
+// Yields once the pass has run for longer than a fixed budget, whatever the load.
+class FixedYieldPolicy : public YieldPolicy
+{
+public:
+    explicit FixedYieldPolicy(qint64 budgetUsecs) : m_budgetUsecs(budgetUsecs) {}
+
+    QString name() const Q_DECL_OVERRIDE;
+    qint64 passBudget(qint64 nowUsecs) Q_DECL_OVERRIDE;
+    bool shouldYield(qint64 elapsedUsecs, qint64 budgetUsecs, int nextRequestType, bool nextFinished) const Q_DECL_OVERRIDE;
+    QVariantMap statistics() const Q_DECL_OVERRIDE;
+
+private:
+    qint64 m_budgetUsecs;
+};
+
+// Sizes each pass's budget to the gap between incoming client requests,
+// within [minimum, maximum]: while clients are sending requests the queue
+// yields about as often as they arrive, so none waits long to be dispatched,
+// and while they are not it amortises yields over the maximum budget.
+// The pass also yields early rather than start a request which is expected
+// to overrun the budget, from a moving average of the cost of requests of
+// its type, so that one expensive request doesn't delay dispatch on its own.
+class AdaptiveYieldPolicy : public YieldPolicy
+{
+public:
+    AdaptiveYieldPolicy(qint64 minimumBudgetUsecs, qint64 maximumBudgetUsecs);
+
+    QString name() const Q_DECL_OVERRIDE;
+    void requestArrived(qint64 nowUsecs) Q_DECL_OVERRIDE;
+    void requestHandled(int requestType, bool finished, qint64 usecs) Q_DECL_OVERRIDE;
+    qint64 passBudget(qint64 nowUsecs) Q_DECL_OVERRIDE;
+    bool shouldYield(qint64 elapsedUsecs, qint64 budgetUsecs, int nextRequestType, bool nextFinished) const Q_DECL_OVERRIDE;
+    QVariantMap statistics() const Q_DECL_OVERRIDE;
+
+private:
+    static int costKey(int requestType, bool finished) { return (requestType << 1) | (finished ? 1 : 0); }
+
+    qint64 m_minimumBudgetUsecs;
+    qint64 m_maximumBudgetUsecs;
+    qint64 m_lastArrival;         // -1 until the first request arrives
+    qint64 m_meanArrivalGap;      // moving average, or -1 until two requests have arrived
+    qint64 m_lastBudget;
+    QHash<int, qint64> m_costs;   // moving average cost, keyed by costKey()
+};
+
+} // Daemon
+
+} // Secrets
+
+} // Sailfish
+
+#endif // SAILFISHSECRETS_DAEMON_YIELDPOLICY_P_H
@@ -0,0 +1,13 @@
+TEMPLATE=lib
+CONFIG+=plugin
+TARGET=sailfishsecrets-inmemory
+TARGET = $$qtLibraryTarget($$TARGET)
+
+include($$PWD/../../common.pri)
+include($$PWD/../../api/libsailfishsecrets/libsailfishsecrets.pri)
+
+HEADERS+=lockedmemory_p.h plugin.h
+SOURCES+=lockedmemory.cpp plugin.cpp
+
+target.path=/usr/lib/sailfishsecrets/
+INSTALLS += target
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "lockedmemory_p.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+namespace {
+    // allocations within the arena are rounded up to this many bytes.
+    const size_t Granularity = 16;
+
+    void wipeMemory(char *data, size_t length)
+    {
+        // prevent the compiler from optimising away the wipe of memory which is about to be released.
+        volatile char *p = data;
+        while (length--) {
+            *p++ = 0;
+        }
+    }
+
+    size_t roundUp(size_t length, size_t multiple)
+    {
+        return qMax((length + multiple - 1) / multiple, size_t(1)) * multiple;
+    }
+}
+
+Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::LockedArena()
+    : m_mapping(Q_NULLPTR)
+    , m_base(Q_NULLPTR)
+    , m_mappedLength(0)
+    , m_capacity(0)
+    , m_used(0)
+{
+}
+
+Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::~LockedArena()
+{
+    if (m_mapping) {
+        wipeMemory(m_base, m_capacity);
+        munlock(m_base, m_capacity);
+        munmap(m_mapping, m_mappedLength);
+    }
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::initialise(qint64 capacity)
+{
+    if (m_mapping || capacity <= 0) {
+        return false;
+    }
+
+    // one inaccessible guard page either side of the arena.
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t arenaLength = roundUp(static_cast<size_t>(capacity), pageSize);
+    const size_t mappedLength = arenaLength + 2 * pageSize;
+    void *mapping = mmap(Q_NULLPTR, mappedLength, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        qCWarning(lcSailfishSecretsPluginInMemory) << "Unable to map locked memory arena:" << strerror(errno);
+        return false;
+    }
+
+    char *base = static_cast<char*>(mapping) + pageSize;
+    if (mprotect(base, arenaLength, PROT_READ | PROT_WRITE) != 0) {
+        qCWarning(lcSailfishSecretsPluginInMemory) << "Unable to protect locked memory arena:" << strerror(errno);
+        munmap(mapping, mappedLength);
+        return false;
+    }
+#ifdef MADV_DONTDUMP
+    madvise(base, arenaLength, MADV_DONTDUMP);
+#endif
+    if (mlock(base, arenaLength) != 0) {
+        // secrets must never be swapped out, so refuse to store any.
+        qCWarning(lcSailfishSecretsPluginInMemory) << "Unable to lock memory arena:" << strerror(errno);
+        munmap(mapping, mappedLength);
+        return false;
+    }
+
+    m_mapping = static_cast<char*>(mapping);
+    m_base = base;
+    m_mappedLength = mappedLength;
+    m_capacity = arenaLength;
+    m_freeExtents.insert(0, arenaLength);
+    return true;
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::allocate(
+        const QByteArray &value,
+        Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::Allocation *allocation)
+{
+    const size_t required = roundUp(static_cast<size_t>(value.size()), Granularity);
+    for (QMap<size_t, size_t>::iterator it = m_freeExtents.begin(); it != m_freeExtents.end(); ++it) {
+        if (it.value() < required) {
+            continue;
+        }
+        const size_t offset = it.key();
+        const size_t remaining = it.value() - required;
+        m_freeExtents.erase(it);
+        if (remaining) {
+            m_freeExtents.insert(offset + required, remaining);
+        }
+        m_used += required;
+
+        allocation->data = m_base + offset;
+        allocation->length = required;
+        allocation->size = value.size();
+        memcpy(allocation->data, value.constData(), value.size());
+        return true;
+    }
+
+    return false;
+}
+
+void Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::release(
+        Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::Allocation *allocation)
+{
+    if (!allocation->data) {
+        return;
+    }
+
+    wipeMemory(allocation->data, allocation->length);
+
+    size_t offset = static_cast<size_t>(allocation->data - m_base);
+    size_t length = allocation->length;
+    m_used -= length;
+    *allocation = Allocation();
+
+    // coalesce with the following and preceding free extents.
+    QMap<size_t, size_t>::iterator next = m_freeExtents.lowerBound(offset);
+    if (next != m_freeExtents.end() && next.key() == offset + length) {
+        length += next.value();
+        next = m_freeExtents.erase(next);
+    }
+    if (next != m_freeExtents.begin()) {
+        QMap<size_t, size_t>::iterator previous = next;
+        --previous;
+        if (previous.key() + previous.value() == offset) {
+            offset = previous.key();
+            length += previous.value();
+            m_freeExtents.erase(previous);
+        }
+    }
+    m_freeExtents.insert(offset, length);
+}
+
+QByteArray Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::rawData(
+        const Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::Allocation &allocation)
+{
+    return allocation.data ? QByteArray::fromRawData(allocation.data, allocation.size) : QByteArray();
+}
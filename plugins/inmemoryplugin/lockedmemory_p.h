@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_PLUGIN_STORAGE_INMEMORY_LOCKEDMEMORY_P_H
+#define SAILFISHSECRETS_PLUGIN_STORAGE_INMEMORY_LOCKEDMEMORY_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMap>
+#include <QtCore/QLoggingCategory>
+
+#include <sys/types.h>
+
+Q_DECLARE_LOGGING_CATEGORY(lcSailfishSecretsPluginInMemory)
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace Plugins {
+
+namespace InMemory {
+
+// A fixed-size region of memory which is locked into RAM and excluded from
+// core dumps, from which the stored secrets are allocated.  Every allocation
+// is wiped when it is released.  Unlike the daemon's secure memory, requests
+// which do not fit are refused rather than given their own mapping, so that
+// the capacity bounds the memory used by the plugin.
+class LockedArena
+{
+public:
+    struct Allocation {
+        Allocation() : data(Q_NULLPTR), length(0), size(0) {}
+        char *data;
+        size_t length;  // the allocated (rounded-up) length
+        int size;       // the length of the stored value
+    };
+
+    LockedArena();
+    ~LockedArena();
+
+    bool initialise(qint64 capacity);
+
+    qint64 capacity() const { return qint64(m_capacity); }
+    qint64 used() const { return qint64(m_used); }
+
+    bool allocate(const QByteArray &value, Allocation *allocation);
+    void release(Allocation *allocation);
+
+    // Refers directly to the locked memory, so is only valid until the allocation is released.
+    static QByteArray rawData(const Allocation &allocation);
+
+private:
+    QMap<size_t, size_t> m_freeExtents; // offset -> length, coalesced on release
+    char *m_mapping;
+    char *m_base;
+    size_t m_mappedLength;
+    size_t m_capacity;
+    size_t m_used;
+
+    Q_DISABLE_COPY(LockedArena)
+};
+
+} // namespace InMemory
+
+} // namespace Plugins
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_PLUGIN_STORAGE_INMEMORY_LOCKEDMEMORY_P_H
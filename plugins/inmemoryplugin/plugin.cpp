@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "plugin.h"
+
+#include <QtCore/QDateTime>
+
+#include <algorithm>
+
+Q_PLUGIN_METADATA(IID Sailfish_Secrets_StoragePlugin_IID)
+
+Q_LOGGING_CATEGORY(lcSailfishSecretsPluginInMemory, "org.sailfishos.secrets.plugin.storage.inmemory")
+
+namespace {
+    // the defaults may be overridden via the environment.
+    const int DefaultCapacityKBytes = 256;
+    const int DefaultSecretLifetimeSeconds = 0; // secrets don't expire
+
+    int configuredValue(const char *environmentVariable, int defaultValue)
+    {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue(environmentVariable, &ok);
+        return ok && value >= 0 ? value : defaultValue;
+    }
+}
+
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::InMemoryPlugin(QObject *parent)
+    : Sailfish::Secrets::StoragePlugin(parent)
+    , m_secretLifetimeMs(qint64(configuredValue("SAILFISH_SECRETSD_INMEMORY_SECRET_LIFETIME_SECONDS", DefaultSecretLifetimeSeconds)) * 1000)
+{
+    const qint64 capacity = qint64(configuredValue("SAILFISH_SECRETSD_INMEMORY_STORAGE_KBYTES", DefaultCapacityKBytes)) * 1024;
+    if (!m_arena.initialise(capacity)) {
+        qCWarning(lcSailfishSecretsPluginInMemory) << "Secrets in-memory plugin: unable to allocate" << capacity << "bytes of locked memory";
+    }
+
+    // Add the "standalone" collection.
+    // Note that it is a "notional" collection,
+    // existing only so that standalone secrets can be stored.
+    m_collections.insert(QStringLiteral("standalone"), Collection());
+}
+
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::~InMemoryPlugin()
+{
+    for (QHash<QString, Collection>::iterator cit = m_collections.begin(); cit != m_collections.end(); ++cit) {
+        for (Collection::iterator sit = cit->begin(); sit != cit->end(); ++sit) {
+            m_arena.release(&sit->allocation);
+        }
+    }
+}
+
+// Secrets are expired lazily, whenever the plugin is next used.
+void
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::removeExpiredSecrets()
+{
+    if (m_expiries.isEmpty()) {
+        return;
+    }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while (!m_expiries.isEmpty() && m_expiries.firstKey() <= now) {
+        const SecretKey key = m_expiries.first();
+        m_expiries.erase(m_expiries.begin());
+
+        QHash<QString, Collection>::iterator cit = m_collections.find(key.first);
+        if (cit != m_collections.end()) {
+            Collection::iterator sit = cit->find(key.second);
+            if (sit != cit->end()) {
+                m_arena.release(&sit->allocation);
+                cit->erase(sit);
+            }
+        }
+    }
+}
+
+void
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::releaseEntry(
+        const SecretKey &key,
+        Entry *entry)
+{
+    if (entry->expiry) {
+        m_expiries.remove(entry->expiry, key);
+        entry->expiry = 0;
+    }
+    m_arena.release(&entry->allocation);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::storeSecret(
+        Collection *collection,
+        const QString &collectionName,
+        const QString &secretName,
+        const QByteArray &secret)
+{
+    const SecretKey key(collectionName, secretName);
+    Collection::iterator it = collection->find(secretName);
+    if (it != collection->end()) {
+        releaseEntry(key, &(*it));
+    } else {
+        it = collection->insert(secretName, Entry());
+    }
+
+    if (!m_arena.allocate(secret, &it->allocation)) {
+        collection->erase(it);
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromUtf8("In-memory plugin has insufficient locked memory to store secret: %1 used of %2 bytes")
+                                                .arg(m_arena.used()).arg(m_arena.capacity()));
+    }
+
+    if (m_secretLifetimeMs > 0) {
+        it->expiry = QDateTime::currentMSecsSinceEpoch() + m_secretLifetimeMs;
+        m_expiries.insert(it->expiry, key);
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+bool
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::lookupSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        QByteArray *secret)
+{
+    QHash<QString, Collection>::const_iterator cit = m_collections.constFind(collectionName);
+    if (cit == m_collections.constEnd()) {
+        return false;
+    }
+
+    Collection::const_iterator sit = cit->constFind(secretName);
+    if (sit == cit->constEnd()) {
+        return false;
+    }
+
+    // copy the value out of locked memory, since the entry may be released at any time.
+    const QByteArray raw = Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::rawData(sit->allocation);
+    *secret = QByteArray(raw.constData(), raw.size());
+    return true;
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::createCollection(
+        const QString &collectionName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Reserved collection name given"));
+    } else if (m_collections.contains(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionAlreadyExistsError,
+                                         QString::fromUtf8("Collection already exists: %1").arg(collectionName));
+    }
+
+    m_collections.insert(collectionName, Collection());
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::removeCollection(
+        const QString &collectionName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Reserved collection name given"));
+    }
+
+    QHash<QString, Collection>::iterator cit = m_collections.find(collectionName);
+    if (cit != m_collections.end()) {
+        for (Collection::iterator sit = cit->begin(); sit != cit->end(); ++sit) {
+            releaseEntry(SecretKey(collectionName, sit.key()), &(*sit));
+        }
+        m_collections.erase(cit);
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::setSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        const QByteArray &secret)
+{
+    QMutexLocker locker(&m_mutex);
+    removeExpiredSecrets();
+
+    // Note: don't disallow collectionName=standalone, since that's how we store standalone secrets.
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    }
+
+    QHash<QString, Collection>::iterator cit = m_collections.find(collectionName);
+    if (cit == m_collections.end()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    }
+
+    return storeSecret(&(*cit), collectionName, secretName, secret);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::getSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        QByteArray *secret)
+{
+    QMutexLocker locker(&m_mutex);
+    removeExpiredSecrets();
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    }
+
+    if (!lookupSecret(collectionName, secretName, secret)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("No such secret in collection"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::removeSecret(
+        const QString &collectionName,
+        const QString &secretName)
+{
+    QMutexLocker locker(&m_mutex);
+    removeExpiredSecrets();
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    }
+
+    QHash<QString, Collection>::iterator cit = m_collections.find(collectionName);
+    if (cit != m_collections.end()) {
+        Collection::iterator sit = cit->find(secretName);
+        if (sit != cit->end()) {
+            releaseEntry(SecretKey(collectionName, secretName), &(*sit));
+            cit->erase(sit);
+        }
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::getSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames,
+        QMap<QString, QByteArray> *secrets)
+{
+    QMutexLocker locker(&m_mutex);
+    removeExpiredSecrets();
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    }
+
+    for (const QString &secretName : secretNames) {
+        QByteArray secret;
+        if (lookupSecret(collectionName, secretName, &secret)) {
+            secrets->insert(secretName, secret);
+        }
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::setSecrets(
+        const QString &collectionName,
+        const QMap<QString, QByteArray> &secrets)
+{
+    QMutexLocker locker(&m_mutex);
+    removeExpiredSecrets();
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (secrets.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    }
+
+    QHash<QString, Collection>::iterator cit = m_collections.find(collectionName);
+    if (cit == m_collections.end()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    }
+
+    for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); ++it) {
+        Sailfish::Secrets::Result result = storeSecret(&(*cit), collectionName, it.key(), it.value());
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::removeSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames)
+{
+    QMutexLocker locker(&m_mutex);
+    removeExpiredSecrets();
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (secretNames.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    }
+
+    QHash<QString, Collection>::iterator cit = m_collections.find(collectionName);
+    if (cit != m_collections.end()) {
+        for (const QString &secretName : secretNames) {
+            Collection::iterator sit = cit->find(secretName);
+            if (sit != cit->end()) {
+                releaseEntry(SecretKey(collectionName, secretName), &(*sit));
+                cit->erase(sit);
+            }
+        }
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::enumerateSecrets(
+        const QString &collectionName,
+        const QString &cursor,
+        int maxCount,
+        QMap<QString, QByteArray> *secrets,
+        QString *nextCursor)
+{
+    QMutexLocker locker(&m_mutex);
+    removeExpiredSecrets();
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (maxCount <= 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromUtf8("Invalid maximum count given: %1").arg(maxCount));
+    }
+
+    QHash<QString, Collection>::const_iterator cit = m_collections.constFind(collectionName);
+    if (cit == m_collections.constEnd()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    }
+
+    QStringList names = cit->keys();
+    std::sort(names.begin(), names.end());
+    QStringList::const_iterator it = std::upper_bound(names.constBegin(), names.constEnd(), cursor);
+
+    QMap<QString, QByteArray> retn;
+    for (; it != names.constEnd() && retn.size() < maxCount; ++it) {
+        QByteArray secret;
+        lookupSecret(collectionName, *it, &secret);
+        retn.insert(*it, secret);
+    }
+
+    *secrets = retn;
+    *nextCursor = it != names.constEnd() ? retn.lastKey() : QString();
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::InMemoryPlugin::reencryptSecrets(
+        const QString &collectionName,
+        const QVector<QString> &secretNames,
+        const QByteArray &oldkey,
+        const QByteArray &newkey,
+        Sailfish::Secrets::EncryptionPlugin *plugin)
+{
+    QMutexLocker locker(&m_mutex);
+    removeExpiredSecrets();
+
+    if (collectionName.isEmpty() && secretNames.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret names given and empty collection name given"));
+    }
+
+    const QString name = collectionName.isEmpty() ? QStringLiteral("standalone") : collectionName;
+    QHash<QString, Collection>::iterator cit = m_collections.find(name);
+    if (cit == m_collections.end()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(name));
+    }
+
+    const QStringList names = collectionName.isEmpty() ? secretNames.toList() : cit->keys();
+    for (const QString &secretName : names) {
+        QByteArray encrypted;
+        if (!lookupSecret(name, secretName, &encrypted)) {
+            continue;
+        }
+
+        QByteArray decrypted, reencrypted;
+        Sailfish::Secrets::Result result = plugin->decryptSecret(encrypted, oldkey, &decrypted);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = plugin->encryptSecret(decrypted, newkey, &reencrypted);
+        }
+        decrypted.fill('\0');
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+
+        // keep the existing expiry of the secret.
+        Entry &entry((*cit)[secretName]);
+        Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::Allocation allocation;
+        if (!m_arena.allocate(reencrypted, &allocation)) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                             QString::fromUtf8("In-memory plugin has insufficient locked memory to re-encrypt secret"));
+        }
+        m_arena.release(&entry.allocation);
+        entry.allocation = allocation;
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_PLUGIN_STORAGE_INMEMORY_H
+#define SAILFISHSECRETS_PLUGIN_STORAGE_INMEMORY_H
+
+#include "Secrets/extensionplugins.h"
+#include "Secrets/result.h"
+
+#include "lockedmemory_p.h"
+
+#include <QObject>
+#include <QVector>
+#include <QString>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QByteArray>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace Plugins {
+
+// Stores secrets in locked memory only, so they never touch the disk
+// and do not survive a restart of the daemon.  Each secret optionally
+// expires a configured time after it was last written.
+class Q_DECL_EXPORT InMemoryPlugin : public Sailfish::Secrets::StoragePlugin
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID Sailfish_Secrets_StoragePlugin_IID)
+    Q_INTERFACES(Sailfish::Secrets::StoragePlugin)
+
+public:
+    InMemoryPlugin(QObject *parent = Q_NULLPTR);
+    ~InMemoryPlugin();
+
+    bool isTestPlugin() const Q_DECL_OVERRIDE {
+#ifdef SAILFISH_SECRETS_BUILD_TEST_PLUGIN
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    QString name() const Q_DECL_OVERRIDE { return QLatin1String("org.sailfishos.secrets.plugin.storage.inmemory"); }
+    Sailfish::Secrets::StoragePlugin::StorageType storageType() const Q_DECL_OVERRIDE { return Sailfish::Secrets::StoragePlugin::InMemoryStorage; }
+
+    Sailfish::Secrets::Result createCollection(const QString &collectionName) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeCollection(const QString &collectionName) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result setSecret(const QString &collectionName, const QString &secretName, const QByteArray &secret) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result getSecret(const QString &collectionName, const QString &secretName, QByteArray *secret) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeSecret(const QString &collectionName, const QString &secretName) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result getSecrets(const QString &collectionName, const QStringList &secretNames, QMap<QString, QByteArray> *secrets) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result setSecrets(const QString &collectionName, const QMap<QString, QByteArray> &secrets) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeSecrets(const QString &collectionName, const QStringList &secretNames) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result enumerateSecrets(const QString &collectionName, const QString &cursor, int maxCount,
+                                               QMap<QString, QByteArray> *secrets, QString *nextCursor) Q_DECL_OVERRIDE;
+
+    Sailfish::Secrets::Result reencryptSecrets(
+            const QString &collectionName,          // non-empty, all secrets in this collection will be re-encrypted
+            const QVector<QString> &secretNames,    // if collectionName is empty, these standalone secrets will be re-encrypted.
+            const QByteArray &oldkey,
+            const QByteArray &newkey,
+            Sailfish::Secrets::EncryptionPlugin *plugin) Q_DECL_OVERRIDE;
+
+private:
+    typedef QPair<QString, QString> SecretKey; // collection name, secret name
+    struct Entry {
+        Entry() : expiry(0) {}
+        Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena::Allocation allocation;
+        qint64 expiry; // msecs since epoch, or zero if the secret doesn't expire
+    };
+    typedef QHash<QString, Entry> Collection;
+
+    void removeExpiredSecrets();
+    void releaseEntry(const SecretKey &key, Entry *entry);
+    Sailfish::Secrets::Result storeSecret(Collection *collection, const QString &collectionName, const QString &secretName, const QByteArray &secret);
+    bool lookupSecret(const QString &collectionName, const QString &secretName, QByteArray *secret);
+
+    QMutex m_mutex;
+    Sailfish::Secrets::Daemon::Plugins::InMemory::LockedArena m_arena;
+    QHash<QString, Collection> m_collections;
+    QMultiMap<qint64, SecretKey> m_expiries;
+    qint64 m_secretLifetimeMs;
+};
+
+} // namespace Plugins
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_PLUGIN_STORAGE_INMEMORY_H
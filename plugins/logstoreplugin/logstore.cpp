@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "logstore_p.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+namespace {
+    // Record layout (native byte order, the segment never leaves the device):
+    //   magic(4) checksum(2) type(1) reserved(1)
+    //   collectionLength(4) nameLength(4) valueLength(4)
+    //   collectionName secretName value
+    // The checksum covers every byte of the record following it.
+    const quint32 RecordMagic = 0x53534c47; // "SSLG"
+    const quint64 HeaderLength = 20;
+    const quint64 ChecksummedOffset = 6;
+
+    // set on every record of a batch except the last.
+    const quint8 ContinuedFlag = 0x01;
+
+    // the mapping grows in large steps, so that appends rarely require a remap.
+    const quint64 MinimumMappingLength = 1024 * 1024;
+
+    // segments smaller than this are never compacted.
+    const quint64 MinimumCompactionSize = 1024 * 1024;
+
+    // live records are written to the compacted segment in batches of about this size.
+    const int CompactionWriteLength = 64 * 1024;
+
+    quint32 readUInt32(const char *data)
+    {
+        quint32 value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    quint16 readUInt16(const char *data)
+    {
+        quint16 value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void writeChecksum(char *record, quint64 recordLength)
+    {
+        const quint16 checksum = qChecksum(record + ChecksummedOffset, recordLength - ChecksummedOffset);
+        memcpy(record + 4, &checksum, 2);
+    }
+
+    // appends a copy of the given record, as a batch of its own.
+    void appendRecord(QByteArray *buffer, const char *record, quint32 recordLength)
+    {
+        const int offset = buffer->size();
+        buffer->append(record, recordLength);
+        char *copy = buffer->data() + offset;
+        if (copy[7] & ContinuedFlag) {
+            copy[7] = static_cast<char>(copy[7] & ~ContinuedFlag);
+            writeChecksum(copy, recordLength);
+        }
+    }
+
+    quint64 roundUp(quint64 length, quint64 multiple)
+    {
+        return ((length + multiple - 1) / multiple) * multiple;
+    }
+
+    bool syncDirectory(const QString &filePath)
+    {
+        const QByteArray directory = QFile::encodeName(QFileInfo(filePath).absolutePath());
+        const int fd = ::open(directory.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        const bool synced = fsync(fd) == 0;
+        ::close(fd);
+        return synced;
+    }
+}
+
+Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Segment()
+    : m_fd(-1)
+    , m_mapping(Q_NULLPTR)
+    , m_mappedLength(0)
+    , m_end(0)
+    , m_unsyncedWrites(false)
+    , m_compacting(false)
+{
+}
+
+Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::~Segment()
+{
+    close();
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::open(const QString &filePath)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_fd >= 0) {
+        return false;
+    }
+
+    const QByteArray path = QFile::encodeName(filePath);
+    m_fd = ::open(path.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd < 0) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to open segment:" << filePath << strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to stat segment:" << filePath << strerror(errno);
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_filePath = filePath;
+    m_index = Index();
+    m_end = 0;
+
+    const quint64 fileLength = static_cast<quint64>(st.st_size);
+    if (fileLength && !ensureMapped(fileLength)) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_end = fileLength ? replay(m_mapping, 0, fileLength, 0, &m_index) : 0;
+    if (m_end < fileLength) {
+        // a crash during an append leaves a torn record at the end of the segment.
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Discarding" << (fileLength - m_end)
+                                                   << "bytes of incomplete records from the end of segment:" << filePath;
+        if (ftruncate(m_fd, static_cast<off_t>(m_end)) != 0 || fdatasync(m_fd) != 0) {
+            qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to truncate segment:" << filePath << strerror(errno);
+        }
+    }
+
+    return true;
+}
+
+void Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::close()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_fd < 0) {
+        return;
+    }
+
+    if (m_unsyncedWrites) {
+        fdatasync(m_fd);
+        m_unsyncedWrites = false;
+    }
+    if (m_mapping) {
+        munmap(m_mapping, m_mappedLength);
+        m_mapping = Q_NULLPTR;
+        m_mappedLength = 0;
+    }
+    ::close(m_fd);
+    m_fd = -1;
+    m_end = 0;
+    m_index = Index();
+}
+
+QByteArray Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::encode(
+        const Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record &record,
+        bool continued)
+{
+    const QByteArray collectionName = record.collectionName.toUtf8();
+    const QByteArray secretName = record.secretName.toUtf8();
+    const quint32 collectionLength = collectionName.size();
+    const quint32 nameLength = secretName.size();
+    const quint32 valueLength = record.value.size();
+    const quint8 type = record.type;
+    const quint8 flags = continued ? ContinuedFlag : 0;
+
+    QByteArray encoded(HeaderLength + collectionLength + nameLength + valueLength, Qt::Uninitialized);
+    char *data = encoded.data();
+    memcpy(data, &RecordMagic, 4);
+    memcpy(data + 6, &type, 1);
+    memcpy(data + 7, &flags, 1);
+    memcpy(data + 8, &collectionLength, 4);
+    memcpy(data + 12, &nameLength, 4);
+    memcpy(data + 16, &valueLength, 4);
+    memcpy(data + HeaderLength, collectionName.constData(), collectionLength);
+    memcpy(data + HeaderLength + collectionLength, secretName.constData(), nameLength);
+    memcpy(data + HeaderLength + collectionLength + nameLength, record.value.constData(), valueLength);
+    writeChecksum(data, encoded.size());
+    return encoded;
+}
+
+void Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::apply(
+        const ParsedRecord &record,
+        Index *index)
+{
+    const quint32 recordLength = record.location.recordLength;
+    if (record.type == CreateCollectionRecord) {
+        if (index->collections.contains(record.collectionName)) {
+            index->deadBytes += recordLength;
+        } else {
+            index->collections.insert(record.collectionName, record.location);
+            index->secrets.insert(record.collectionName, Collection());
+        }
+    } else if (record.type == RemoveCollectionRecord) {
+        QHash<QString, Location>::iterator cit = index->collections.find(record.collectionName);
+        if (cit != index->collections.end()) {
+            index->deadBytes += cit->recordLength;
+            index->collections.erase(cit);
+            const Collection secrets = index->secrets.take(record.collectionName);
+            for (Collection::const_iterator sit = secrets.constBegin(); sit != secrets.constEnd(); ++sit) {
+                index->deadBytes += sit->recordLength;
+            }
+        }
+        // nothing remains for the removal to supersede once the segment is compacted.
+        index->deadBytes += recordLength;
+    } else if (record.type == SetSecretRecord) {
+        QHash<QString, Collection>::iterator cit = index->secrets.find(record.collectionName);
+        if (cit == index->secrets.end()) {
+            index->deadBytes += recordLength;
+        } else {
+            Collection::iterator sit = cit->find(record.secretName);
+            if (sit != cit->end()) {
+                index->deadBytes += sit->recordLength;
+                *sit = record.location;
+            } else {
+                cit->insert(record.secretName, record.location);
+            }
+        }
+    } else if (record.type == RemoveSecretRecord) {
+        QHash<QString, Collection>::iterator cit = index->secrets.find(record.collectionName);
+        if (cit != index->secrets.end()) {
+            Collection::iterator sit = cit->find(record.secretName);
+            if (sit != cit->end()) {
+                index->deadBytes += sit->recordLength;
+                cit->erase(sit);
+            }
+        }
+        index->deadBytes += recordLength;
+    }
+}
+
+// Applies the batches of records in data[begin, end) to the index, whose
+// locations are offset by the given adjustment.  Returns the end of the last
+// complete batch.
+quint64 Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::replay(
+        const char *data,
+        quint64 begin,
+        quint64 end,
+        qint64 offsetAdjustment,
+        Index *index)
+{
+    QVector<ParsedRecord> batch;
+    quint64 batchEnd = begin;
+    quint64 offset = begin;
+    while (end - offset >= HeaderLength) {
+        const char *header = data + offset;
+        if (readUInt32(header) != RecordMagic) {
+            break;
+        }
+
+        const quint32 collectionLength = readUInt32(header + 8);
+        const quint32 nameLength = readUInt32(header + 12);
+        const quint32 valueLength = readUInt32(header + 16);
+        const quint64 recordLength = HeaderLength + quint64(collectionLength) + nameLength + valueLength;
+        if (recordLength > end - offset || recordLength > 0xffffffffu
+                || qChecksum(header + ChecksummedOffset, recordLength - ChecksummedOffset) != readUInt16(header + 4)) {
+            break;
+        }
+
+        const quint8 type = static_cast<quint8>(header[6]);
+        if (type < CreateCollectionRecord || type > RemoveSecretRecord) {
+            break;
+        }
+
+        ParsedRecord record;
+        record.type = type;
+        record.collectionName = QString::fromUtf8(header + HeaderLength, collectionLength);
+        record.secretName = QString::fromUtf8(header + HeaderLength + collectionLength, nameLength);
+        record.location.offset = offset + offsetAdjustment;
+        record.location.recordLength = recordLength;
+        record.location.valueLength = valueLength;
+        batch.append(record);
+        offset += recordLength;
+
+        if (!(static_cast<quint8>(header[7]) & ContinuedFlag)) {
+            for (const ParsedRecord &parsed : batch) {
+                apply(parsed, index);
+            }
+            batch.clear();
+            batchEnd = offset;
+        }
+    }
+
+    return batchEnd;
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::ensureMapped(quint64 end)
+{
+    if (end <= m_mappedLength) {
+        return true;
+    }
+
+    // map well beyond the end of the file, so that the mapping covers subsequent appends.
+    const quint64 pageSize = static_cast<quint64>(sysconf(_SC_PAGESIZE));
+    const quint64 mappedLength = roundUp(qMax(end * 2, MinimumMappingLength), pageSize);
+    void *mapping = mmap(Q_NULLPTR, mappedLength, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (mapping == MAP_FAILED) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to map segment:" << m_filePath << strerror(errno);
+        return false;
+    }
+
+    if (m_mapping) {
+        munmap(m_mapping, m_mappedLength);
+    }
+    m_mapping = static_cast<char*>(mapping);
+    m_mappedLength = mappedLength;
+    return true;
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::writeAll(
+        int fd,
+        const char *data,
+        quint64 length,
+        quint64 offset)
+{
+    while (length) {
+        const ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to write segment:" << m_filePath << strerror(errno);
+            return false;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::append(
+        const QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> &records)
+{
+    QByteArray encoded;
+    for (int i = 0; i < records.size(); ++i) {
+        encoded.append(encode(records[i], i < records.size() - 1));
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_fd < 0) {
+        return false;
+    }
+
+    if (!writeAll(m_fd, encoded.constData(), encoded.size(), m_end)) {
+        // don't leave a partial record for the next append to follow.
+        if (ftruncate(m_fd, static_cast<off_t>(m_end)) != 0) {
+            qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to truncate segment:" << m_filePath << strerror(errno);
+        }
+        return false;
+    }
+
+    replay(encoded.constData(), 0, encoded.size(), m_end, &m_index);
+    m_end += encoded.size();
+    m_unsyncedWrites = true;
+    return true;
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::sync()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_unsyncedWrites) {
+        return true;
+    }
+
+    if (fdatasync(m_fd) != 0) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to sync segment:" << m_filePath << strerror(errno);
+        return false;
+    }
+
+    m_unsyncedWrites = false;
+    return true;
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::hasUnsyncedWrites() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_unsyncedWrites;
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::collectionExists(
+        const QString &collectionName) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.collections.contains(collectionName);
+}
+
+QStringList Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::secretNames(
+        const QString &collectionName) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.secrets.value(collectionName).keys();
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::secretExists(
+        const QString &collectionName,
+        const QString &secretName) const
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, Collection>::const_iterator cit = m_index.secrets.constFind(collectionName);
+    return cit != m_index.secrets.constEnd() && cit->contains(secretName);
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::readSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        QByteArray *value)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, Collection>::const_iterator cit = m_index.secrets.constFind(collectionName);
+    if (cit == m_index.secrets.constEnd()) {
+        return false;
+    }
+
+    Collection::const_iterator sit = cit->constFind(secretName);
+    if (sit == cit->constEnd()) {
+        return false;
+    }
+
+    const quint64 end = sit->offset + sit->recordLength;
+    if (!ensureMapped(end)) {
+        return false;
+    }
+
+    // the value is the last field of the record.
+    *value = QByteArray(m_mapping + end - sit->valueLength, sit->valueLength);
+    return true;
+}
+
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::compactionRequired() const
+{
+    QMutexLocker locker(&m_mutex);
+    return !m_compacting
+            && m_end >= MinimumCompactionSize
+            && m_index.deadBytes * 2 > m_end;
+}
+
+// The live records are copied from a snapshot of the index without holding
+// the lock.  The lock is only taken at the end, to copy across any records
+// appended since the snapshot and to swap in the compacted segment.
+bool Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::compact()
+{
+    Index snapshot;
+    quint64 snapshotEnd = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_fd < 0 || m_compacting) {
+            return false;
+        }
+        m_compacting = true;
+        snapshot = m_index;
+        snapshotEnd = m_end;
+    }
+
+    const QString compactedFilePath = m_filePath + QLatin1String(".compact");
+    const QByteArray sourcePath = QFile::encodeName(m_filePath);
+    const QByteArray targetPath = QFile::encodeName(compactedFilePath);
+    int sourceFd = -1;
+    int targetFd = -1;
+    void *source = MAP_FAILED;
+    Index compacted;
+    quint64 compactedEnd = 0;
+    bool succeeded = false;
+
+    sourceFd = ::open(sourcePath.constData(), O_RDONLY | O_CLOEXEC);
+    if (sourceFd >= 0 && snapshotEnd) {
+        source = mmap(Q_NULLPTR, snapshotEnd, PROT_READ, MAP_SHARED, sourceFd, 0);
+    }
+    targetFd = ::open(targetPath.constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (sourceFd < 0 || targetFd < 0 || (snapshotEnd && source == MAP_FAILED)) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to begin compaction of segment:" << m_filePath << strerror(errno);
+    } else {
+        // copy each live record, a collection's creation before its secrets.
+        const char *data = static_cast<const char*>(source);
+        QByteArray batch;
+        bool written = true;
+        for (QHash<QString, Location>::const_iterator cit = snapshot.collections.constBegin();
+                written && cit != snapshot.collections.constEnd(); ++cit) {
+            appendRecord(&batch, data + cit->offset, cit->recordLength);
+            const Collection secrets = snapshot.secrets.value(cit.key());
+            for (Collection::const_iterator sit = secrets.constBegin(); written && sit != secrets.constEnd(); ++sit) {
+                appendRecord(&batch, data + sit->offset, sit->recordLength);
+                if (batch.size() >= CompactionWriteLength) {
+                    written = writeAll(targetFd, batch.constData(), batch.size(), compactedEnd);
+                    replay(batch.constData(), 0, batch.size(), compactedEnd, &compacted);
+                    compactedEnd += batch.size();
+                    batch.clear();
+                }
+            }
+        }
+        if (written && !batch.isEmpty()) {
+            written = writeAll(targetFd, batch.constData(), batch.size(), compactedEnd);
+            replay(batch.constData(), 0, batch.size(), compactedEnd, &compacted);
+            compactedEnd += batch.size();
+        }
+        succeeded = written;
+    }
+
+    if (source != MAP_FAILED) {
+        munmap(source, snapshotEnd);
+    }
+    if (sourceFd >= 0) {
+        ::close(sourceFd);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_compacting = false;
+
+    if (succeeded && m_end > snapshotEnd) {
+        // the records appended during compaction follow the live records.
+        const quint64 tailLength = m_end - snapshotEnd;
+        succeeded = ensureMapped(m_end)
+                && writeAll(targetFd, m_mapping + snapshotEnd, tailLength, compactedEnd);
+        if (succeeded) {
+            replay(m_mapping, snapshotEnd, m_end, qint64(compactedEnd) - qint64(snapshotEnd), &compacted);
+            compactedEnd += tailLength;
+        }
+    }
+
+    if (succeeded && (fdatasync(targetFd) != 0 || ::rename(targetPath.constData(), sourcePath.constData()) != 0)) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to replace segment:" << m_filePath << strerror(errno);
+        succeeded = false;
+    }
+
+    if (!succeeded) {
+        if (targetFd >= 0) {
+            ::close(targetFd);
+        }
+        ::unlink(targetPath.constData());
+        return false;
+    }
+
+    if (!syncDirectory(m_filePath)) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to sync directory of segment:" << m_filePath << strerror(errno);
+    }
+
+    const quint64 reclaimed = m_end - compactedEnd;
+    if (m_mapping) {
+        munmap(m_mapping, m_mappedLength);
+        m_mapping = Q_NULLPTR;
+        m_mappedLength = 0;
+    }
+    ::close(m_fd);
+    m_fd = targetFd;
+    m_end = compactedEnd;
+    m_index = compacted;
+    m_unsyncedWrites = false;
+    if (m_end && !ensureMapped(m_end)) {
+        // subsequent reads will retry the mapping.
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Unable to map compacted segment:" << m_filePath;
+    }
+
+    qCDebug(lcSailfishSecretsPluginLogStore) << "Compacted segment:" << m_filePath << "reclaimed" << reclaimed << "bytes";
+    return true;
+}
+
+quint64 Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_end;
+}
+
+quint64 Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::reclaimableSize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.deadBytes;
+}
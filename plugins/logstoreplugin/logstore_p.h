@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_PLUGIN_STORAGE_LOGSTORE_LOGSTORE_P_H
+#define SAILFISHSECRETS_PLUGIN_STORAGE_LOGSTORE_LOGSTORE_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(lcSailfishSecretsPluginLogStore)
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace Plugins {
+
+namespace LogStore {
+
+// An append-only log of records in a single segment file, which is
+// memory-mapped for reading.  Every collection and secret is indexed in
+// memory by the offset of its latest value in the segment, so a read is a
+// hash lookup plus a copy out of the mapping, and a write is one append.
+//
+// Each record is checksummed, and the records of one append form a batch
+// which is applied as a whole: a torn batch at the end of the segment (from
+// a crash during an append) is discarded when the segment is opened.
+// Superseded records are reclaimed by compaction, which rewrites the live
+// records into a new segment without blocking reads and writes, except
+// briefly at the end to copy any records appended in the meantime.
+class Segment
+{
+public:
+    enum RecordType {
+        CreateCollectionRecord = 1,
+        RemoveCollectionRecord,
+        SetSecretRecord,
+        RemoveSecretRecord
+    };
+
+    struct Record {
+        Record() : type(0) {}
+        Record(int t, const QString &c, const QString &n = QString(), const QByteArray &v = QByteArray())
+            : type(t), collectionName(c), secretName(n), value(v) {}
+        int type;
+        QString collectionName;
+        QString secretName;
+        QByteArray value;
+    };
+
+    Segment();
+    ~Segment();
+
+    bool open(const QString &filePath);
+    void close();
+
+    // the records are appended with a single write, and replayed all or none.
+    bool append(const QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> &records);
+    bool sync();
+    bool hasUnsyncedWrites() const;
+
+    bool collectionExists(const QString &collectionName) const;
+    QStringList secretNames(const QString &collectionName) const;
+    bool secretExists(const QString &collectionName, const QString &secretName) const;
+    bool readSecret(const QString &collectionName, const QString &secretName, QByteArray *value);
+
+    bool compactionRequired() const;
+    bool compact();
+
+    quint64 size() const;
+    quint64 reclaimableSize() const;
+
+private:
+    struct Location {
+        Location() : offset(0), recordLength(0), valueLength(0) {}
+        quint64 offset;       // of the record
+        quint32 recordLength;
+        quint32 valueLength;
+    };
+    typedef QHash<QString, Location> Collection; // secret name -> latest value
+    struct ParsedRecord {
+        ParsedRecord() : type(0) {}
+        int type;
+        QString collectionName;
+        QString secretName;
+        Location location;
+    };
+    struct Index {
+        Index() : deadBytes(0) {}
+        QHash<QString, Location> collections;   // collection name -> creation record
+        QHash<QString, Collection> secrets;     // collection name -> secrets
+        quint64 deadBytes;
+    };
+
+    static QByteArray encode(const Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record &record, bool continued);
+    static void apply(const ParsedRecord &record, Index *index);
+    static quint64 replay(const char *data, quint64 begin, quint64 end, qint64 offsetAdjustment, Index *index);
+
+    bool ensureMapped(quint64 end);
+    bool writeAll(int fd, const char *data, quint64 length, quint64 offset);
+
+    mutable QMutex m_mutex;
+    QString m_filePath;
+    int m_fd;
+    char *m_mapping;
+    quint64 m_mappedLength;
+    quint64 m_end;
+    Index m_index;
+    bool m_unsyncedWrites;
+    bool m_compacting;
+
+    Q_DISABLE_COPY(Segment)
+};
+
+} // namespace LogStore
+
+} // namespace Plugins
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_PLUGIN_STORAGE_LOGSTORE_LOGSTORE_P_H
@@ -0,0 +1,13 @@
+TEMPLATE=lib
+CONFIG+=plugin
+TARGET=sailfishsecrets-logstore
+TARGET = $$qtLibraryTarget($$TARGET)
+
+include($$PWD/../../common.pri)
+include($$PWD/../../api/libsailfishsecrets/libsailfishsecrets.pri)
+
+HEADERS+=logstore_p.h plugin.h
+SOURCES+=logstore.cpp plugin.cpp
+
+target.path=/usr/lib/sailfishsecrets/
+INSTALLS += target
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "plugin.h"
+
+#include <QtCore/QStandardPaths>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QRunnable>
+
+#include <algorithm>
+
+Q_PLUGIN_METADATA(IID Sailfish_Secrets_StoragePlugin_IID)
+
+Q_LOGGING_CATEGORY(lcSailfishSecretsPluginLogStore, "org.sailfishos.secrets.plugin.storage.logstore")
+
+namespace {
+    class CompactionTask : public QRunnable
+    {
+    public:
+        CompactionTask(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment *segment)
+            : m_segment(segment) {}
+        void run() Q_DECL_OVERRIDE {
+            // another compaction may have been scheduled in the meantime.
+            if (m_segment->compactionRequired() && !m_segment->compact()) {
+                qCWarning(lcSailfishSecretsPluginLogStore) << "Secrets logstore plugin: compaction failed";
+            }
+        }
+    private:
+        Sailfish::Secrets::Daemon::Plugins::LogStore::Segment *m_segment;
+    };
+
+    bool isStandalone(const QString &collectionName)
+    {
+        return collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0;
+    }
+}
+
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::LogStorePlugin(QObject *parent)
+    : Sailfish::Secrets::StoragePlugin(parent)
+    , m_writeBatching(false)
+{
+    m_compactionPool.setMaxThreadCount(1);
+
+    const QString systemDataDirPath(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/system/");
+    const QString privilegedDataDirPath(systemDataDirPath + QLatin1String("privileged") + "/");
+
+    QString segmentSubdir(QLatin1String("Secrets/logstoreplugin"));
+    if (isTestPlugin()) {
+        segmentSubdir.append(QLatin1String("-test"));
+    }
+
+    const QString segmentDirPath = privilegedDataDirPath + segmentSubdir;
+    QDir segmentDir(segmentDirPath);
+    if (!segmentDir.mkpath(segmentDirPath)) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Permissions error: unable to create segment directory:" << segmentDirPath;
+        return;
+    }
+
+    // a compaction interrupted by a crash leaves its partial output behind.
+    const QString segmentFile = segmentDir.absoluteFilePath(QLatin1String("secrets.log"));
+    QFile::remove(segmentFile + QLatin1String(".compact"));
+
+    if (!m_segment.open(segmentFile)) {
+        qCWarning(lcSailfishSecretsPluginLogStore) << "Secrets logstore plugin: failed to open segment!";
+        return;
+    }
+
+    // Add the "standalone" collection.
+    // Note that it is a "notional" collection,
+    // existing only so that standalone secrets can be stored.
+    if (!m_segment.collectionExists(QStringLiteral("standalone"))) {
+        QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> records;
+        records.append(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record(
+                           Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::CreateCollectionRecord,
+                           QStringLiteral("standalone")));
+        if (!m_segment.append(records) || !m_segment.sync()) {
+            qCWarning(lcSailfishSecretsPluginLogStore) << "Secrets logstore plugin: failed to add standalone collection";
+        }
+    }
+}
+
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::~LogStorePlugin()
+{
+    m_compactionPool.waitForDone();
+    m_segment.close();
+}
+
+// Appends the records as one batch, and syncs them unless writes are being
+// batched by the daemon, in which case they are synced by the next flush().
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::appendRecords(
+        const QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> &records)
+{
+    if (!m_segment.append(records)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Logstore plugin unable to append to segment"));
+    }
+
+    if (!m_writeBatching && !m_segment.sync()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Logstore plugin unable to sync segment"));
+    }
+
+    if (m_segment.compactionRequired()) {
+        m_compactionPool.start(new CompactionTask(&m_segment));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::createCollection(
+        const QString &collectionName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Reserved collection name given"));
+    } else if (m_segment.collectionExists(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionAlreadyExistsError,
+                                         QString::fromUtf8("Collection already exists: %1").arg(collectionName));
+    }
+
+    QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> records;
+    records.append(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record(
+                       Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::CreateCollectionRecord,
+                       collectionName));
+    return appendRecords(records);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::removeCollection(
+        const QString &collectionName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Reserved collection name given"));
+    } else if (!m_segment.collectionExists(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> records;
+    records.append(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record(
+                       Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::RemoveCollectionRecord,
+                       collectionName));
+    return appendRecords(records);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::setSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        const QByteArray &secret)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Note: don't disallow collectionName=standalone, since that's how we store standalone secrets.
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (!m_segment.collectionExists(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    }
+
+    QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> records;
+    records.append(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record(
+                       Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::SetSecretRecord,
+                       collectionName, secretName, secret));
+    return appendRecords(records);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::getSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        QByteArray *secret)
+{
+    // reads don't take the plugin lock, as the segment serialises access to its index.
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    }
+
+    if (!m_segment.readSecret(collectionName, secretName, secret)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("No such secret in collection"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::removeSecret(
+        const QString &collectionName,
+        const QString &secretName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (!m_segment.secretExists(collectionName, secretName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> records;
+    records.append(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record(
+                       Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::RemoveSecretRecord,
+                       collectionName, secretName));
+    return appendRecords(records);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::getSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames,
+        QMap<QString, QByteArray> *secrets)
+{
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    }
+
+    for (const QString &secretName : secretNames) {
+        QByteArray secret;
+        if (m_segment.readSecret(collectionName, secretName, &secret)) {
+            secrets->insert(secretName, secret);
+        }
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::setSecrets(
+        const QString &collectionName,
+        const QMap<QString, QByteArray> &secrets)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (secrets.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (!m_segment.collectionExists(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    } else if (secrets.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> records;
+    records.reserve(secrets.size());
+    for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); ++it) {
+        records.append(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record(
+                           Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::SetSecretRecord,
+                           collectionName, it.key(), it.value()));
+    }
+    return appendRecords(records);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::removeSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (secretNames.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    }
+
+    QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> records;
+    for (const QString &secretName : secretNames) {
+        if (m_segment.secretExists(collectionName, secretName)) {
+            records.append(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record(
+                               Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::RemoveSecretRecord,
+                               collectionName, secretName));
+        }
+    }
+
+    if (records.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    return appendRecords(records);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::enumerateSecrets(
+        const QString &collectionName,
+        const QString &cursor,
+        int maxCount,
+        QMap<QString, QByteArray> *secrets,
+        QString *nextCursor)
+{
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (maxCount <= 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromUtf8("Invalid maximum count given: %1").arg(maxCount));
+    } else if (!m_segment.collectionExists(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    }
+
+    QStringList names = m_segment.secretNames(collectionName);
+    std::sort(names.begin(), names.end());
+    QStringList::const_iterator it = std::upper_bound(names.constBegin(), names.constEnd(), cursor);
+
+    // secrets removed since their names were listed are skipped.
+    QMap<QString, QByteArray> retn;
+    for (; it != names.constEnd() && retn.size() < maxCount; ++it) {
+        QByteArray secret;
+        if (m_segment.readSecret(collectionName, *it, &secret)) {
+            retn.insert(*it, secret);
+        }
+    }
+
+    *secrets = retn;
+    *nextCursor = it != names.constEnd() ? retn.lastKey() : QString();
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::reencryptSecrets(
+        const QString &collectionName,
+        const QVector<QString> &secretNames,
+        const QByteArray &oldkey,
+        const QByteArray &newkey,
+        Sailfish::Secrets::EncryptionPlugin *plugin)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty() && secretNames.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret names given and empty collection name given"));
+    }
+
+    const QString name = collectionName.isEmpty() ? QStringLiteral("standalone") : collectionName;
+    if (!m_segment.collectionExists(name)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(name));
+    }
+
+    // the re-encrypted secrets are appended as one batch, so that the
+    // collection is never left partly encrypted with each key.
+    QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> records;
+    const QStringList names = collectionName.isEmpty() ? secretNames.toList() : m_segment.secretNames(name);
+    for (const QString &secretName : names) {
+        QByteArray encrypted;
+        if (!m_segment.readSecret(name, secretName, &encrypted)) {
+            continue;
+        }
+
+        QByteArray decrypted, reencrypted;
+        Sailfish::Secrets::Result result = plugin->decryptSecret(encrypted, oldkey, &decrypted);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = plugin->encryptSecret(decrypted, newkey, &reencrypted);
+        }
+        decrypted.fill('\0');
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+
+        records.append(Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record(
+                           Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::SetSecretRecord,
+                           name, secretName, reencrypted));
+    }
+
+    if (records.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    return appendRecords(records);
+}
+
+void
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::setWriteBatching(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+    m_writeBatching = enabled;
+}
+
+bool
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::hasPendingWrites() const
+{
+    return m_segment.hasUnsyncedWrites();
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::LogStorePlugin::flush()
+{
+    if (!m_segment.sync()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Logstore plugin unable to sync segment"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
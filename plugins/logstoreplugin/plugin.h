@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_PLUGIN_STORAGE_LOGSTORE_H
+#define SAILFISHSECRETS_PLUGIN_STORAGE_LOGSTORE_H
+
+#include "Secrets/extensionplugins.h"
+#include "Secrets/result.h"
+
+#include "logstore_p.h"
+
+#include <QObject>
+#include <QVector>
+#include <QString>
+#include <QMap>
+#include <QByteArray>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThreadPool>
+
+namespace Sailfish {
+
+namespace Secrets {
+
+namespace Daemon {
+
+namespace Plugins {
+
+// Stores secrets in an append-only, memory-mapped log, which suits large
+// stores which are mostly read.  Superseded records are compacted away in
+// the background once they make up most of the log.
+class Q_DECL_EXPORT LogStorePlugin : public Sailfish::Secrets::StoragePlugin
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID Sailfish_Secrets_StoragePlugin_IID)
+    Q_INTERFACES(Sailfish::Secrets::StoragePlugin)
+
+public:
+    LogStorePlugin(QObject *parent = Q_NULLPTR);
+    ~LogStorePlugin();
+
+    bool isTestPlugin() const Q_DECL_OVERRIDE {
+#ifdef SAILFISH_SECRETS_BUILD_TEST_PLUGIN
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    QString name() const Q_DECL_OVERRIDE { return QLatin1String("org.sailfishos.secrets.plugin.storage.logstore"); }
+    Sailfish::Secrets::StoragePlugin::StorageType storageType() const Q_DECL_OVERRIDE { return Sailfish::Secrets::StoragePlugin::FileSystemStorage; }
+
+    Sailfish::Secrets::Result createCollection(const QString &collectionName) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeCollection(const QString &collectionName) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result setSecret(const QString &collectionName, const QString &secretName, const QByteArray &secret) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result getSecret(const QString &collectionName, const QString &secretName, QByteArray *secret) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeSecret(const QString &collectionName, const QString &secretName) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result getSecrets(const QString &collectionName, const QStringList &secretNames, QMap<QString, QByteArray> *secrets) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result setSecrets(const QString &collectionName, const QMap<QString, QByteArray> &secrets) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeSecrets(const QString &collectionName, const QStringList &secretNames) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result enumerateSecrets(const QString &collectionName, const QString &cursor, int maxCount,
+                                               QMap<QString, QByteArray> *secrets, QString *nextCursor) Q_DECL_OVERRIDE;
+
+    Sailfish::Secrets::Result reencryptSecrets(
+            const QString &collectionName,          // non-empty, all secrets in this collection will be re-encrypted
+            const QVector<QString> &secretNames,    // if collectionName is empty, these standalone secrets will be re-encrypted.
+            const QByteArray &oldkey,
+            const QByteArray &newkey,
+            Sailfish::Secrets::EncryptionPlugin *plugin) Q_DECL_OVERRIDE;
+
+    void setWriteBatching(bool enabled) Q_DECL_OVERRIDE;
+    bool hasPendingWrites() const Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result flush() Q_DECL_OVERRIDE;
+
+private:
+    Sailfish::Secrets::Result appendRecords(const QVector<Sailfish::Secrets::Daemon::Plugins::LogStore::Segment::Record> &records);
+
+    QMutex m_mutex;
+    Sailfish::Secrets::Daemon::Plugins::LogStore::Segment m_segment;
+    QThreadPool m_compactionPool;
+    bool m_writeBatching;
+};
+
+} // namespace Plugins
+
+} // namespace Daemon
+
+} // namespace Secrets
+
+} // namespace Sailfish
+
+#endif // SAILFISHSECRETS_PLUGIN_STORAGE_LOGSTORE_H
@@ -14,8 +14,13 @@
 
 #include <openssl/conf.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/aes.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/ec.h>
+#include <openssl/x509.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,137 +45,277 @@ int osslevp_init()
 }
 
 /*
-    int osslevp_aes_encrypt_plaintext(const unsigned char *init_vector,
+    int osslevp_random_bytes(unsigned char *buffer, int length)
+
+    Fills the \a buffer with \a length cryptographically secure random bytes,
+    for example to use as an initialisation vector.
+
+    Returns 1 on success, 0 on failure.
+*/
+int osslevp_random_bytes(unsigned char *buffer, int length)
+{
+    if (buffer == NULL || length <= 0) {
+        return 0;
+    }
+    return RAND_bytes(buffer, length) == 1 ? 1 : 0;
+}
+
+/*
+    int osslevp_random_reseed()
+
+    Mixes fresh entropy from the operating system into the state of the
+    random number generator used by osslevp_random_bytes().
+
+    Returns 1 on success, 0 on failure.
+*/
+int osslevp_random_reseed()
+{
+    return RAND_poll() == 1 ? 1 : 0;
+}
+
+/*
+    struct osslevp_cipher_context
+
+    A reusable cipher context for the one-shot encryption and decryption
+    functions below.  The context remembers the cipher, direction and key
+    it was last initialised with, so that consecutive operations with the
+    same key only need to set a new initialisation vector, and reuse the
+    expanded key schedule.  A context must only be used by one thread at
+    a time; callers are expected to keep one per worker thread.
+*/
+typedef struct osslevp_cipher_context {
+    EVP_CIPHER_CTX *context;
+    const EVP_CIPHER *cipher;
+    int encrypt;
+    int key_set;
+    unsigned char padded_key[32];
+} osslevp_cipher_context;
+
+/*
+    osslevp_cipher_context *osslevp_cipher_context_new()
+
+    Creates a cipher context for use with osslevp_aes_encrypt_plaintext()
+    and the other one-shot functions.  The caller owns the returned context
+    and must release it with osslevp_cipher_context_free().
+
+    Returns the context on success, or NULL on failure.
+*/
+osslevp_cipher_context *osslevp_cipher_context_new()
+{
+    osslevp_cipher_context *cipher_context = (osslevp_cipher_context *)malloc(sizeof(osslevp_cipher_context));
+    if (cipher_context == NULL) {
+        return NULL;
+    }
+
+    memset(cipher_context, 0, sizeof(osslevp_cipher_context));
+    cipher_context->context = EVP_CIPHER_CTX_new();
+    if (cipher_context->context == NULL) {
+        free(cipher_context);
+        return NULL;
+    }
+
+    return cipher_context;
+}
+
+/*
+    void osslevp_cipher_context_free(osslevp_cipher_context *cipher_context)
+
+    Releases the \a cipher_context and clears the key material within it.
+*/
+void osslevp_cipher_context_free(osslevp_cipher_context *cipher_context)
+{
+    if (cipher_context != NULL) {
+        EVP_CIPHER_CTX_free(cipher_context->context);
+        OPENSSL_cleanse(cipher_context->padded_key, sizeof(cipher_context->padded_key));
+        free(cipher_context);
+    }
+}
+
+/*
+    int osslevp_cipher_context_prepare(osslevp_cipher_context *cipher_context,
+                                       const EVP_CIPHER *cipher,
+                                       int encrypt,
+                                       const unsigned char *init_vector,
+                                       int init_vector_length,
+                                       const unsigned char *key,
+                                       int key_length)
+
+    Prepares the \a cipher_context to encrypt (if \a encrypt is non-zero) or
+    decrypt with the given \a cipher, \a key and \a init_vector.  If the
+    context was last prepared with the same cipher, direction and key, only
+    the initialisation vector is set.  The \a init_vector_length is only
+    used for GCM ciphers; other ciphers take a 16 byte \a init_vector.
+
+    Only the first 32 bytes of \a key will be used.  If \a key_length is less
+    than 32, a 32 byte key will be created from the first \a key_length bytes
+    of \a key padded out to 32 bytes with null bytes.  A 128 bit \a cipher
+    uses only the first 16 bytes of that key.
+
+    Returns 1 on success, 0 on failure.
+*/
+int osslevp_cipher_context_prepare(osslevp_cipher_context *cipher_context,
+                                   const EVP_CIPHER *cipher,
+                                   int encrypt,
+                                   const unsigned char *init_vector,
+                                   int init_vector_length,
+                                   const unsigned char *key,
+                                   int key_length)
+{
+    unsigned char padded_key[32] = { 0 };
+    int gcm = 0;
+    int i = 0;
+
+    if (cipher_context == NULL || cipher == NULL || init_vector == NULL
+            || key_length <= 0 || key == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting cipher context preparation");
+        return 0;
+    }
+
+    /* Create a 32-byte padded-key from the key */
+    for (i = 0; i < 32; ++i) {
+        padded_key[i] = i < key_length ? key[i] : '\0';
+    }
+
+    gcm = EVP_CIPHER_mode(cipher) == EVP_CIPH_GCM_MODE;
+    encrypt = encrypt ? 1 : 0;
+
+    if (cipher_context->key_set
+            && cipher_context->cipher == cipher
+            && cipher_context->encrypt == encrypt
+            && CRYPTO_memcmp(cipher_context->padded_key, padded_key, sizeof(padded_key)) == 0) {
+        /* Keep the key schedule, and only start over with the new initialisation vector */
+        OPENSSL_cleanse(padded_key, sizeof(padded_key));
+        if ((gcm && !EVP_CIPHER_CTX_ctrl(cipher_context->context, EVP_CTRL_GCM_SET_IVLEN, init_vector_length, NULL))
+                || !EVP_CipherInit_ex(cipher_context->context, NULL, NULL, NULL, init_vector, encrypt)) {
+            ERR_print_errors_fp(stderr);
+            cipher_context->key_set = 0;
+            fprintf(stderr, "%s\n", "failed to reinitialize cipher context");
+            return 0;
+        }
+        return 1;
+    }
+
+    /* The GCM initialisation vector length must be set before the vector itself */
+    cipher_context->key_set = 0;
+    if (!EVP_CipherInit_ex(cipher_context->context, cipher, NULL, NULL, NULL, encrypt)
+            || (gcm && !EVP_CIPHER_CTX_ctrl(cipher_context->context, EVP_CTRL_GCM_SET_IVLEN, init_vector_length, NULL))
+            || !EVP_CipherInit_ex(cipher_context->context, NULL, NULL, padded_key, init_vector, encrypt)) {
+        ERR_print_errors_fp(stderr);
+        OPENSSL_cleanse(padded_key, sizeof(padded_key));
+        fprintf(stderr, "%s\n", "failed to initialize cipher context");
+        return 0;
+    }
+
+    memcpy(cipher_context->padded_key, padded_key, sizeof(padded_key));
+    OPENSSL_cleanse(padded_key, sizeof(padded_key));
+    cipher_context->cipher = cipher;
+    cipher_context->encrypt = encrypt;
+    cipher_context->key_set = 1;
+    return 1;
+}
+
+/*
+    int osslevp_aes_encrypt_plaintext(osslevp_cipher_context *cipher_context,
+                                      const EVP_CIPHER *cipher,
+                                      const unsigned char *init_vector,
                                       const unsigned char *key,
                                       int key_length,
                                       const unsigned char *plaintext,
                                       int plaintext_length,
-                                      unsigned char **encrypted)
+                                      unsigned char *encrypted)
 
     Encrypts the \a plaintext of the specified \a plaintext_length with the
-    given symmetric encryption \a key.  The result is stored in \a encrypted.
-    The caller owns the content of the \a encrypted buffer and must free().
+    given AES \a cipher (for example EVP_aes_256_cbc() or EVP_aes_128_ctr())
+    and symmetric encryption \a key, using the \a cipher_context.  The result
+    is written to the \a encrypted buffer, which must be at least
+    \a plaintext_length + AES_BLOCK_SIZE bytes long.  The plaintext may be
+    empty, in which case \a plaintext may be NULL.
 
     The given \a init_vector must be a 16 byte buffer containing the
-    initialisation vector for the AES encryption context.
-
-    Only the first 32 bytes of \a key will be used.  If \a key_length is less
-    than 32, a 32 byte key will be created from the first \a key_length bytes
-    of \a key padded out to 32 bytes with null bytes.
+    initialisation vector (or initial counter block, for CTR mode) for the
+    AES encryption context.  The \a key is interpreted as for
+    osslevp_cipher_context_prepare().
 
     Returns the length of the \a encrypted output on success, or -1 if the
     arguments are invalid or encryption otherwise fails.
 */
-int osslevp_aes_encrypt_plaintext(const unsigned char *init_vector,
+int osslevp_aes_encrypt_plaintext(osslevp_cipher_context *cipher_context,
+                                  const EVP_CIPHER *cipher,
+                                  const unsigned char *init_vector,
                                   const unsigned char *key,
                                   int key_length,
                                   const unsigned char *plaintext,
                                   int plaintext_length,
-                                  unsigned char **encrypted)
+                                  unsigned char *encrypted)
 {
-    unsigned char padded_key[32] = { 0 };
-    int ciphertext_length = plaintext_length + AES_BLOCK_SIZE;
     int update_length = 0;
     int final_length = 0;
-    int i = 0;
-    unsigned char *ciphertext = NULL;
-    EVP_CIPHER_CTX encryption_context;
 
-    if (plaintext_length <= 0 || plaintext == NULL
-            || key_length <= 0 || key == NULL || encrypted == NULL) {
+    if (plaintext_length < 0 || (plaintext_length > 0 && plaintext == NULL) || encrypted == NULL) {
         /* Invalid arguments */
         fprintf(stderr, "%s\n", "invalid arguments, aborting encryption");
         return -1;
     }
 
-    /* Create a 32-byte padded-key from the key */
-    for (i = 0; i < 32; ++i) {
-        if (i < key_length) {
-            padded_key[i] = key[i];
-        } else {
-            padded_key[i] = '\0';
-        }
-    }
-
-    /* Allocate the buffer for the encrypted output */
-    ciphertext = (unsigned char *)malloc(ciphertext_length);
-    memset(ciphertext, 0, ciphertext_length);
-
-    /* Create the encryption context */
-    EVP_CIPHER_CTX_init(&encryption_context);
-    if (!EVP_EncryptInit_ex(&encryption_context, EVP_aes_256_cbc(), NULL, padded_key, init_vector)) {
-        ERR_print_errors_fp(stderr);
-        EVP_CIPHER_CTX_cleanup(&encryption_context);
-        free(ciphertext);
+    if (!osslevp_cipher_context_prepare(cipher_context, cipher, 1, init_vector, AES_BLOCK_SIZE, key, key_length)) {
         fprintf(stderr, "%s\n", "failed to initialize encryption context");
         return -1;
     }
 
     /* Encrypt the plaintext into the encrypted output buffer */
-    if (!EVP_EncryptUpdate(&encryption_context, ciphertext, &update_length, plaintext, plaintext_length)) {
+    if (plaintext_length > 0
+            && !EVP_EncryptUpdate(cipher_context->context, encrypted, &update_length, plaintext, plaintext_length)) {
         ERR_print_errors_fp(stderr);
-        EVP_CIPHER_CTX_cleanup(&encryption_context);
-        free(ciphertext);
+        cipher_context->key_set = 0;
         fprintf(stderr, "%s\n", "failed to update ciphertext buffer with encrypted content");
         return -1;
     }
 
-    if (!EVP_EncryptFinal_ex(&encryption_context, ciphertext+update_length, &final_length)) {
+    if (!EVP_EncryptFinal_ex(cipher_context->context, encrypted + update_length, &final_length)) {
         ERR_print_errors_fp(stderr);
-        EVP_CIPHER_CTX_cleanup(&encryption_context);
-        free(ciphertext);
+        cipher_context->key_set = 0;
         fprintf(stderr, "%s\n", "failed to encrypt final block");
         return -1;
     }
 
-    /* Update the out parameter */
-    *encrypted = ciphertext;
-
-    /* Clean up the encryption context */
-    EVP_CIPHER_CTX_cleanup(&encryption_context);
-    ciphertext_length = update_length + final_length;
-    return ciphertext_length;
+    return update_length + final_length;
 }
 
 /*
-    int osslevp_aes_decrypt_ciphertext(const unsigned char *init_vector,
+    int osslevp_aes_decrypt_ciphertext(osslevp_cipher_context *cipher_context,
+                                       const EVP_CIPHER *cipher,
+                                       const unsigned char *init_vector,
                                        const unsigned char *key,
                                        int key_length,
                                        const unsigned char *ciphertext,
                                        int ciphertext_length,
-                                       unsigned char **decrypted)
+                                       unsigned char *decrypted)
 
     Decrypts the \a ciphertext of the specified \a ciphertext_length with the
-    given symmetric decryption \a key.  The result is stored in \a decrypted.
-    The caller owns the content of the \a decrypted buffer and must free().
+    given AES \a cipher and symmetric decryption \a key, using the
+    \a cipher_context.  The result is written to the \a decrypted buffer,
+    which must be at least \a ciphertext_length + AES_BLOCK_SIZE bytes long.
 
-    The given \a init_vector must be a 16 byte buffer containing the
-    initialisation vector for the AES decryption context.
-
-    Only the first 32 bytes of \a key will be used.  If \a key_length is less
-    than 32, a 32 byte key will be created from the first \a key_length bytes
-    of \a key padded out to 32 bytes with null bytes.
+    The \a init_vector and \a key are interpreted as for
+    osslevp_aes_encrypt_plaintext().
 
     Returns the length of the \a decrypted output on success, or -1 if the
     arguments are invalid or decryption otherwise fails.
 */
-int osslevp_aes_decrypt_ciphertext(const unsigned char *init_vector,
+int osslevp_aes_decrypt_ciphertext(osslevp_cipher_context *cipher_context,
+                                   const EVP_CIPHER *cipher,
+                                   const unsigned char *init_vector,
                                    const unsigned char *key,
                                    int key_length,
                                    const unsigned char *ciphertext,
                                    int ciphertext_length,
-                                   unsigned char **decrypted)
+                                   unsigned char *decrypted)
 {
-    unsigned char padded_key[32] = { 0 };
-    int plaintext_length = 0;
     int update_length = 0;
     int final_length = 0;
-    int i = 0;
-    unsigned char *plaintext = NULL;
-    EVP_CIPHER_CTX decryption_context;
 
-    if (ciphertext_length <= 0 || ciphertext == NULL
-            || key_length <= 0 || key == NULL || decrypted == NULL) {
+    if (ciphertext_length < 0 || (ciphertext_length > 0 && ciphertext == NULL) || decrypted == NULL) {
         /* Invalid arguments */
         fprintf(stderr,
                 "%s: %s\n",
@@ -179,25 +324,7 @@ int osslevp_aes_decrypt_ciphertext(const unsigned char *init_vector,
         return -1;
     }
 
-    /* Create a 32-byte padded-key from the key */
-    for (i = 0; i < 32; ++i) {
-        if (i < key_length) {
-            padded_key[i] = key[i];
-        } else {
-            padded_key[i] = '\0';
-        }
-    }
-
-    /* Allocate the buffer for the decrypted output */
-    plaintext = (unsigned char *)malloc(ciphertext_length + AES_BLOCK_SIZE);
-    memset(plaintext, 0, ciphertext_length + AES_BLOCK_SIZE);
-
-    /* Create the decryption context */
-    EVP_CIPHER_CTX_init(&decryption_context);
-    if (!EVP_DecryptInit_ex(&decryption_context, EVP_aes_256_cbc(), NULL, padded_key, init_vector)) {
-        ERR_print_errors_fp(stderr);
-        EVP_CIPHER_CTX_cleanup(&decryption_context);
-        free(plaintext);
+    if (!osslevp_cipher_context_prepare(cipher_context, cipher, 0, init_vector, AES_BLOCK_SIZE, key, key_length)) {
         fprintf(stderr,
                 "%s: %s\n",
                 "osslevp_aes_decrypt_ciphertext()",
@@ -206,10 +333,10 @@ int osslevp_aes_decrypt_ciphertext(const unsigned char *init_vector,
     }
 
     /* Decrypt the ciphertext into the decrypted output buffer */
-    if (!EVP_DecryptUpdate(&decryption_context, plaintext, &update_length, ciphertext, ciphertext_length)) {
+    if (ciphertext_length > 0
+            && !EVP_DecryptUpdate(cipher_context->context, decrypted, &update_length, ciphertext, ciphertext_length)) {
         ERR_print_errors_fp(stderr);
-        EVP_CIPHER_CTX_cleanup(&decryption_context);
-        free(plaintext);
+        cipher_context->key_set = 0;
         fprintf(stderr,
                 "%s: %s\n",
                 "osslevp_aes_decrypt_ciphertext()",
@@ -217,10 +344,9 @@ int osslevp_aes_decrypt_ciphertext(const unsigned char *init_vector,
         return -1;
     }
 
-    if (!EVP_DecryptFinal_ex(&decryption_context, plaintext+update_length, &final_length)) {
+    if (!EVP_DecryptFinal_ex(cipher_context->context, decrypted + update_length, &final_length)) {
         ERR_print_errors_fp(stderr);
-        EVP_CIPHER_CTX_cleanup(&decryption_context);
-        free(plaintext);
+        cipher_context->key_set = 0;
         fprintf(stderr,
                 "%s: %s\n",
                 "osslevp_aes_decrypt_ciphertext()",
@@ -228,13 +354,810 @@ int osslevp_aes_decrypt_ciphertext(const unsigned char *init_vector,
         return -1;
     }
 
-    /* Update the out parameter */
-    *decrypted = plaintext;
+    return update_length + final_length;
+}
+
+/*
+    int osslevp_aes_gcm_encrypt_plaintext(osslevp_cipher_context *cipher_context,
+                                          const EVP_CIPHER *cipher,
+                                          const unsigned char *init_vector,
+                                          int init_vector_length,
+                                          const unsigned char *key,
+                                          int key_length,
+                                          const unsigned char *aad,
+                                          int aad_length,
+                                          const unsigned char *plaintext,
+                                          int plaintext_length,
+                                          unsigned char *encrypted,
+                                          unsigned char *tag)
+
+    Encrypts and authenticates the \a plaintext of the specified
+    \a plaintext_length with the given AES-GCM \a cipher (for example
+    EVP_aes_256_gcm()) and symmetric encryption \a key, using the
+    \a cipher_context.  The \a aad of the given \a aad_length (which may be
+    zero) is authenticated but not encrypted.  The result is written to the
+    \a encrypted buffer, which must be at least \a plaintext_length bytes
+    long, and the 16 byte authentication tag is written to \a tag.  The
+    plaintext may be empty, in which case only the tag is produced.
+
+    The \a init_vector of the given \a init_vector_length (normally 12 bytes)
+    must never be reused with the same key.  The \a key is interpreted as for
+    osslevp_cipher_context_prepare().
+
+    Returns the length of the \a encrypted output on success, or -1 if the
+    arguments are invalid or encryption otherwise fails.
+*/
+int osslevp_aes_gcm_encrypt_plaintext(osslevp_cipher_context *cipher_context,
+                                      const EVP_CIPHER *cipher,
+                                      const unsigned char *init_vector,
+                                      int init_vector_length,
+                                      const unsigned char *key,
+                                      int key_length,
+                                      const unsigned char *aad,
+                                      int aad_length,
+                                      const unsigned char *plaintext,
+                                      int plaintext_length,
+                                      unsigned char *encrypted,
+                                      unsigned char *tag)
+{
+    int aad_update_length = 0;
+    int update_length = 0;
+    int final_length = 0;
+
+    if (init_vector_length <= 0 || plaintext_length < 0 || (plaintext_length > 0 && plaintext == NULL)
+            || aad_length < 0 || (aad_length > 0 && aad == NULL)
+            || encrypted == NULL || tag == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting authenticated encryption");
+        return -1;
+    }
+
+    if (!osslevp_cipher_context_prepare(cipher_context, cipher, 1, init_vector, init_vector_length, key, key_length)) {
+        fprintf(stderr, "%s\n", "failed to initialize authenticated encryption context");
+        return -1;
+    }
+
+    /* The additional authenticated data is passed with a null output buffer */
+    if ((aad_length > 0 && !EVP_EncryptUpdate(cipher_context->context, NULL, &aad_update_length, aad, aad_length))
+            || (plaintext_length > 0 && !EVP_EncryptUpdate(cipher_context->context, encrypted, &update_length, plaintext, plaintext_length))
+            || !EVP_EncryptFinal_ex(cipher_context->context, encrypted + update_length, &final_length)
+            || !EVP_CIPHER_CTX_ctrl(cipher_context->context, EVP_CTRL_GCM_GET_TAG, 16, tag)) {
+        ERR_print_errors_fp(stderr);
+        cipher_context->key_set = 0;
+        fprintf(stderr, "%s\n", "failed to encrypt and authenticate plaintext");
+        return -1;
+    }
+
+    return update_length + final_length;
+}
+
+/*
+    int osslevp_aes_gcm_decrypt_ciphertext(osslevp_cipher_context *cipher_context,
+                                           const EVP_CIPHER *cipher,
+                                           const unsigned char *init_vector,
+                                           int init_vector_length,
+                                           const unsigned char *key,
+                                           int key_length,
+                                           const unsigned char *aad,
+                                           int aad_length,
+                                           const unsigned char *ciphertext,
+                                           int ciphertext_length,
+                                           const unsigned char *tag,
+                                           unsigned char *decrypted)
+
+    Decrypts the \a ciphertext of the specified \a ciphertext_length with the
+    given AES-GCM \a cipher and symmetric decryption \a key, using the
+    \a cipher_context, and verifies it and the \a aad against the 16 byte
+    authentication \a tag.  The result is written to the \a decrypted buffer,
+    which must be at least \a ciphertext_length bytes long.
+
+    Returns the length of the \a decrypted output on success, or -1 if the
+    arguments are invalid, the data is not authentic, or decryption otherwise
+    fails.  The \a decrypted buffer is cleared unless the data is authentic.
+*/
+int osslevp_aes_gcm_decrypt_ciphertext(osslevp_cipher_context *cipher_context,
+                                       const EVP_CIPHER *cipher,
+                                       const unsigned char *init_vector,
+                                       int init_vector_length,
+                                       const unsigned char *key,
+                                       int key_length,
+                                       const unsigned char *aad,
+                                       int aad_length,
+                                       const unsigned char *ciphertext,
+                                       int ciphertext_length,
+                                       const unsigned char *tag,
+                                       unsigned char *decrypted)
+{
+    unsigned char expected_tag[16] = { 0 };
+    int aad_update_length = 0;
+    int update_length = 0;
+    int final_length = 0;
+
+    if (init_vector_length <= 0 || ciphertext_length < 0 || (ciphertext_length > 0 && ciphertext == NULL)
+            || aad_length < 0 || (aad_length > 0 && aad == NULL)
+            || tag == NULL || decrypted == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting authenticated decryption");
+        return -1;
+    }
+
+    if (!osslevp_cipher_context_prepare(cipher_context, cipher, 0, init_vector, init_vector_length, key, key_length)) {
+        fprintf(stderr, "%s\n", "failed to initialize authenticated decryption context");
+        return -1;
+    }
+
+    /* OpenSSL 1.0 takes a non-const tag buffer */
+    memcpy(expected_tag, tag, sizeof(expected_tag));
+
+    if ((aad_length > 0 && !EVP_DecryptUpdate(cipher_context->context, NULL, &aad_update_length, aad, aad_length))
+            || (ciphertext_length > 0 && !EVP_DecryptUpdate(cipher_context->context, decrypted, &update_length, ciphertext, ciphertext_length))
+            || !EVP_CIPHER_CTX_ctrl(cipher_context->context, EVP_CTRL_GCM_SET_TAG, 16, expected_tag)
+            || EVP_DecryptFinal_ex(cipher_context->context, decrypted + update_length, &final_length) <= 0) {
+        /* Don't release unauthenticated plaintext */
+        cipher_context->key_set = 0;
+        OPENSSL_cleanse(decrypted, ciphertext_length);
+        fprintf(stderr, "%s\n", "failed to decrypt and authenticate ciphertext");
+        return -1;
+    }
+
+    return update_length + final_length;
+}
+
+/*
+    EVP_CIPHER_CTX *osslevp_aes_cipher_session_init(const EVP_CIPHER *cipher,
+                                                    int encrypt,
+                                                    const unsigned char *init_vector,
+                                                    const unsigned char *key,
+                                                    int key_length)
+
+    Creates a cipher context for the given AES \a cipher which encrypts (if
+    \a encrypt is non-zero) or decrypts data passed to
+    osslevp_aes_cipher_session_update().  The caller owns the returned context
+    and must release it with osslevp_aes_cipher_session_free().
+
+    The \a init_vector and \a key are interpreted as for
+    osslevp_cipher_context_prepare().  The \a init_vector may be NULL if it
+    is not yet known, in which case it must be set with
+    osslevp_aes_cipher_session_set_iv() before any data is processed.
+
+    Returns the cipher context on success, or NULL on failure.
+*/
+EVP_CIPHER_CTX *osslevp_aes_cipher_session_init(const EVP_CIPHER *cipher,
+                                                int encrypt,
+                                                const unsigned char *init_vector,
+                                                const unsigned char *key,
+                                                int key_length)
+{
+    unsigned char padded_key[32] = { 0 };
+    int i = 0;
+    EVP_CIPHER_CTX *cipher_context = NULL;
+
+    if (cipher == NULL || key_length <= 0 || key == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting cipher session");
+        return NULL;
+    }
+
+    /* Create a 32-byte padded-key from the key */
+    for (i = 0; i < 32; ++i) {
+        if (i < key_length) {
+            padded_key[i] = key[i];
+        } else {
+            padded_key[i] = '\0';
+        }
+    }
+
+    cipher_context = EVP_CIPHER_CTX_new();
+    if (cipher_context == NULL) {
+        fprintf(stderr, "%s\n", "failed to allocate cipher context");
+        return NULL;
+    }
+
+    if (!EVP_CipherInit_ex(cipher_context, cipher, NULL, padded_key, init_vector, encrypt ? 1 : 0)) {
+        ERR_print_errors_fp(stderr);
+        EVP_CIPHER_CTX_free(cipher_context);
+        fprintf(stderr, "%s\n", "failed to initialize cipher context");
+        return NULL;
+    }
+
+    /* The context holds its own copy of the key schedule */
+    memset(padded_key, 0, sizeof(padded_key));
+    return cipher_context;
+}
+
+/*
+    int osslevp_aes_cipher_session_set_iv(EVP_CIPHER_CTX *cipher_context,
+                                          const unsigned char *init_vector)
+
+    Sets the \a init_vector of a \a cipher_context which was created without
+    one, for example once it has been read from the start of the ciphertext.
+
+    Returns 1 on success, 0 on failure.
+*/
+int osslevp_aes_cipher_session_set_iv(EVP_CIPHER_CTX *cipher_context,
+                                      const unsigned char *init_vector)
+{
+    if (cipher_context == NULL || init_vector == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting cipher session initialisation");
+        return 0;
+    }
+
+    /* An encrypt argument of -1 leaves the direction unchanged */
+    if (!EVP_CipherInit_ex(cipher_context, NULL, NULL, NULL, init_vector, -1)) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to set cipher session initialisation vector");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+    int osslevp_aes_cipher_session_update(EVP_CIPHER_CTX *cipher_context,
+                                          const unsigned char *input,
+                                          int input_length,
+                                          unsigned char *output)
+
+    Encrypts or decrypts the \a input of the specified \a input_length
+    with the given \a cipher_context.  The \a output buffer must be at least
+    \a input_length + AES_BLOCK_SIZE bytes long.
+
+    Returns the number of bytes written to \a output (which may be zero, as
+    incomplete blocks are buffered by the context), or -1 on failure.
+*/
+int osslevp_aes_cipher_session_update(EVP_CIPHER_CTX *cipher_context,
+                                      const unsigned char *input,
+                                      int input_length,
+                                      unsigned char *output)
+{
+    int update_length = 0;
+
+    if (cipher_context == NULL || input_length < 0 || (input_length > 0 && input == NULL) || output == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting cipher session update");
+        return -1;
+    }
+
+    if (input_length == 0) {
+        return 0;
+    }
+
+    if (!EVP_CipherUpdate(cipher_context, output, &update_length, input, input_length)) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to update cipher session");
+        return -1;
+    }
+
+    return update_length;
+}
+
+/*
+    int osslevp_aes_cipher_session_final(EVP_CIPHER_CTX *cipher_context,
+                                         unsigned char *output)
+
+    Writes the final block of the cipher session into the \a output buffer,
+    which must be at least AES_BLOCK_SIZE bytes long.
+
+    Returns the number of bytes written to \a output, or -1 on failure.
+*/
+int osslevp_aes_cipher_session_final(EVP_CIPHER_CTX *cipher_context,
+                                     unsigned char *output)
+{
+    int final_length = 0;
+
+    if (cipher_context == NULL || output == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting cipher session finalisation");
+        return -1;
+    }
+
+    if (!EVP_CipherFinal_ex(cipher_context, output, &final_length)) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to finalise cipher session");
+        return -1;
+    }
+
+    return final_length;
+}
+
+/*
+    void osslevp_aes_cipher_session_free(EVP_CIPHER_CTX *cipher_context)
+
+    Clears and releases the given \a cipher_context.
+*/
+void osslevp_aes_cipher_session_free(EVP_CIPHER_CTX *cipher_context)
+{
+    if (cipher_context != NULL) {
+        EVP_CIPHER_CTX_free(cipher_context);
+    }
+}
+
+/*
+    EVP_PKEY *osslevp_pkey_generate_rsa(int bits)
+
+    Generates an RSA key pair with a modulus of the given number of \a bits
+    and the public exponent 65537.  The caller owns the returned key and
+    must release it with EVP_PKEY_free().
+
+    Returns the key on success, or NULL on failure.
+*/
+EVP_PKEY *osslevp_pkey_generate_rsa(int bits)
+{
+    EVP_PKEY *pkey = NULL;
+    EVP_PKEY_CTX *keygen_context = NULL;
+
+    if (bits < 1024) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting RSA key generation");
+        return NULL;
+    }
+
+    keygen_context = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+    if (keygen_context == NULL
+            || EVP_PKEY_keygen_init(keygen_context) <= 0
+            || EVP_PKEY_CTX_set_rsa_keygen_bits(keygen_context, bits) <= 0
+            || EVP_PKEY_keygen(keygen_context, &pkey) <= 0) {
+        ERR_print_errors_fp(stderr);
+        EVP_PKEY_CTX_free(keygen_context);
+        fprintf(stderr, "%s\n", "failed to generate RSA key");
+        return NULL;
+    }
+
+    EVP_PKEY_CTX_free(keygen_context);
+    return pkey;
+}
+
+/*
+    EVP_PKEY *osslevp_pkey_generate_ec(int curve_nid)
+
+    Generates an elliptic curve key pair on the named curve identified by
+    \a curve_nid (for example NID_X9_62_prime256v1).  The curve is encoded
+    by name rather than by its parameters when the key is serialised.  The
+    caller owns the returned key and must release it with EVP_PKEY_free().
+
+    Returns the key on success, or NULL on failure.
+*/
+EVP_PKEY *osslevp_pkey_generate_ec(int curve_nid)
+{
+    EVP_PKEY *params = NULL;
+    EVP_PKEY *pkey = NULL;
+    EVP_PKEY_CTX *paramgen_context = NULL;
+    EVP_PKEY_CTX *keygen_context = NULL;
+
+    /* The curve is chosen by generating parameters, which OpenSSL 1.0 requires */
+    paramgen_context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (paramgen_context == NULL
+            || EVP_PKEY_paramgen_init(paramgen_context) <= 0
+            || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(paramgen_context, curve_nid) <= 0
+            || EVP_PKEY_CTX_set_ec_param_enc(paramgen_context, OPENSSL_EC_NAMED_CURVE) <= 0
+            || EVP_PKEY_paramgen(paramgen_context, &params) <= 0) {
+        ERR_print_errors_fp(stderr);
+        EVP_PKEY_CTX_free(paramgen_context);
+        fprintf(stderr, "%s\n", "failed to generate EC key parameters");
+        return NULL;
+    }
+    EVP_PKEY_CTX_free(paramgen_context);
+
+    keygen_context = EVP_PKEY_CTX_new(params, NULL);
+    if (keygen_context == NULL
+            || EVP_PKEY_keygen_init(keygen_context) <= 0
+            || EVP_PKEY_keygen(keygen_context, &pkey) <= 0) {
+        ERR_print_errors_fp(stderr);
+        EVP_PKEY_CTX_free(keygen_context);
+        EVP_PKEY_free(params);
+        fprintf(stderr, "%s\n", "failed to generate EC key");
+        return NULL;
+    }
+
+    EVP_PKEY_CTX_free(keygen_context);
+    EVP_PKEY_free(params);
+    return pkey;
+}
+
+/*
+    int osslevp_pkey_encode(EVP_PKEY *pkey,
+                            int private_key,
+                            unsigned char **encoded)
+
+    Serialises the private (if \a private_key is non-zero) or public part of
+    the \a pkey as DER.  Private keys are encoded in the traditional format
+    for their algorithm, and public keys as a SubjectPublicKeyInfo.  The
+    result is stored in \a encoded, which the caller owns and must
+    OPENSSL_free().
+
+    Returns the length of the \a encoded output on success, or -1 on failure.
+*/
+int osslevp_pkey_encode(EVP_PKEY *pkey,
+                        int private_key,
+                        unsigned char **encoded)
+{
+    int encoded_length = 0;
+
+    if (pkey == NULL || encoded == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting key encoding");
+        return -1;
+    }
+
+    *encoded = NULL;
+    encoded_length = private_key ? i2d_PrivateKey(pkey, encoded) : i2d_PUBKEY(pkey, encoded);
+    if (encoded_length <= 0) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to encode key");
+        return -1;
+    }
+
+    return encoded_length;
+}
+
+/*
+    EVP_PKEY *osslevp_pkey_decode(const unsigned char *encoded,
+                                  int encoded_length,
+                                  int private_key)
+
+    Parses the DER \a encoded private (if \a private_key is non-zero) or
+    public key of the given \a encoded_length, in the formats written by
+    osslevp_pkey_encode().  The caller owns the returned key and must
+    release it with EVP_PKEY_free().
+
+    Returns the key on success, or NULL on failure.
+*/
+EVP_PKEY *osslevp_pkey_decode(const unsigned char *encoded,
+                              int encoded_length,
+                              int private_key)
+{
+    EVP_PKEY *pkey = NULL;
+    const unsigned char *cursor = encoded;
+
+    if (encoded == NULL || encoded_length <= 0) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting key decoding");
+        return NULL;
+    }
+
+    pkey = private_key
+            ? d2i_AutoPrivateKey(NULL, &cursor, encoded_length)
+            : d2i_PUBKEY(NULL, &cursor, encoded_length);
+    if (pkey == NULL) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to decode key");
+        return NULL;
+    }
+
+    return pkey;
+}
+
+/*
+    int osslevp_pkey_sign(EVP_PKEY *pkey,
+                          const EVP_MD *digest,
+                          int rsa_padding,
+                          const unsigned char *data,
+                          int data_length,
+                          unsigned char *signature)
+
+    Signs the digest of the \a data of the specified \a data_length with the
+    private \a pkey.  The \a rsa_padding (RSA_PKCS1_PADDING or
+    RSA_PKCS1_PSS_PADDING) is only used for RSA keys; PSS signatures use a
+    salt as long as the digest.  The result is written to the \a signature
+    buffer, which must be at least EVP_PKEY_size(pkey) bytes long.
+
+    Returns the length of the \a signature on success, or -1 if the
+    arguments are invalid or signing otherwise fails.
+*/
+int osslevp_pkey_sign(EVP_PKEY *pkey,
+                      const EVP_MD *digest,
+                      int rsa_padding,
+                      const unsigned char *data,
+                      int data_length,
+                      unsigned char *signature)
+{
+    size_t signature_length = 0;
+    EVP_MD_CTX *digest_context = NULL;
+    EVP_PKEY_CTX *pkey_context = NULL;
+
+    if (pkey == NULL || digest == NULL || data_length < 0
+            || (data_length > 0 && data == NULL) || signature == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting signing");
+        return -1;
+    }
+
+    signature_length = EVP_PKEY_size(pkey);
+    digest_context = EVP_MD_CTX_create();
+    if (digest_context == NULL
+            || EVP_DigestSignInit(digest_context, &pkey_context, digest, NULL, pkey) <= 0
+            || (EVP_PKEY_base_id(pkey) == EVP_PKEY_RSA
+                && EVP_PKEY_CTX_set_rsa_padding(pkey_context, rsa_padding) <= 0)
+            || (EVP_PKEY_base_id(pkey) == EVP_PKEY_RSA && rsa_padding == RSA_PKCS1_PSS_PADDING
+                && EVP_PKEY_CTX_set_rsa_pss_saltlen(pkey_context, -1) <= 0)
+            || EVP_DigestSignUpdate(digest_context, data, data_length) <= 0
+            || EVP_DigestSignFinal(digest_context, signature, &signature_length) <= 0) {
+        ERR_print_errors_fp(stderr);
+        EVP_MD_CTX_destroy(digest_context);
+        fprintf(stderr, "%s\n", "failed to sign data");
+        return -1;
+    }
+
+    EVP_MD_CTX_destroy(digest_context);
+    return (int)signature_length;
+}
+
+/*
+    int osslevp_pkey_verify(EVP_PKEY *pkey,
+                            const EVP_MD *digest,
+                            int rsa_padding,
+                            const unsigned char *data,
+                            int data_length,
+                            const unsigned char *signature,
+                            int signature_length)
 
-    /* Clean up the decryption context */
-    EVP_CIPHER_CTX_cleanup(&decryption_context);
-    plaintext_length = update_length + final_length;
-    return plaintext_length;
+    Verifies the \a signature of the specified \a signature_length over the
+    digest of the \a data with the public part of the \a pkey.  The
+    \a rsa_padding is interpreted as for osslevp_pkey_sign().
+
+    Returns 1 if the signature is valid, 0 if it is not, or -1 if the
+    arguments are invalid or verification otherwise fails.
+*/
+int osslevp_pkey_verify(EVP_PKEY *pkey,
+                        const EVP_MD *digest,
+                        int rsa_padding,
+                        const unsigned char *data,
+                        int data_length,
+                        const unsigned char *signature,
+                        int signature_length)
+{
+    int verified = 0;
+    EVP_MD_CTX *digest_context = NULL;
+    EVP_PKEY_CTX *pkey_context = NULL;
+
+    if (pkey == NULL || digest == NULL || data_length < 0
+            || (data_length > 0 && data == NULL)
+            || signature == NULL || signature_length <= 0) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting verification");
+        return -1;
+    }
+
+    digest_context = EVP_MD_CTX_create();
+    if (digest_context == NULL
+            || EVP_DigestVerifyInit(digest_context, &pkey_context, digest, NULL, pkey) <= 0
+            || (EVP_PKEY_base_id(pkey) == EVP_PKEY_RSA
+                && EVP_PKEY_CTX_set_rsa_padding(pkey_context, rsa_padding) <= 0)
+            || (EVP_PKEY_base_id(pkey) == EVP_PKEY_RSA && rsa_padding == RSA_PKCS1_PSS_PADDING
+                && EVP_PKEY_CTX_set_rsa_pss_saltlen(pkey_context, -1) <= 0)
+            || EVP_DigestVerifyUpdate(digest_context, data, data_length) <= 0) {
+        ERR_print_errors_fp(stderr);
+        EVP_MD_CTX_destroy(digest_context);
+        fprintf(stderr, "%s\n", "failed to initialise verification");
+        return -1;
+    }
+
+    /* A mismatching signature is a result, not an error */
+    verified = EVP_DigestVerifyFinal(digest_context, (unsigned char *)signature, signature_length);
+    EVP_MD_CTX_destroy(digest_context);
+    if (verified < 0) {
+        ERR_clear_error();
+        return 0;
+    }
+
+    return verified == 1 ? 1 : 0;
+}
+
+/*
+    int osslevp_digest(const EVP_MD *digest,
+                       const unsigned char *data,
+                       int data_length,
+                       unsigned char *digest_value)
+
+    Writes the \a digest of the \a data of the specified \a data_length
+    into the \a digest_value buffer, which must be at least EVP_MAX_MD_SIZE
+    bytes long.
+
+    Returns the length of the \a digest_value on success, or -1 on failure.
+*/
+int osslevp_digest(const EVP_MD *digest,
+                   const unsigned char *data,
+                   int data_length,
+                   unsigned char *digest_value)
+{
+    unsigned int digest_length = 0;
+
+    if (digest == NULL || data_length < 0 || (data_length > 0 && data == NULL) || digest_value == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting digest");
+        return -1;
+    }
+
+    if (!EVP_Digest(data, data_length, digest_value, &digest_length, digest, NULL)) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to generate digest");
+        return -1;
+    }
+
+    return (int)digest_length;
+}
+
+/*
+    int osslevp_hmac(const EVP_MD *digest,
+                     const unsigned char *key,
+                     int key_length,
+                     const unsigned char *data,
+                     int data_length,
+                     unsigned char *mac)
+
+    Writes the HMAC of the \a data of the specified \a data_length, keyed
+    with the \a key of the specified \a key_length and using the given
+    \a digest, into the \a mac buffer, which must be at least
+    EVP_MAX_MD_SIZE bytes long.
+
+    Returns the length of the \a mac on success, or -1 on failure.
+*/
+int osslevp_hmac(const EVP_MD *digest,
+                 const unsigned char *key,
+                 int key_length,
+                 const unsigned char *data,
+                 int data_length,
+                 unsigned char *mac)
+{
+    unsigned int mac_length = 0;
+
+    if (digest == NULL || key == NULL || key_length <= 0 || data_length < 0
+            || (data_length > 0 && data == NULL) || mac == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting hmac");
+        return -1;
+    }
+
+    if (HMAC(digest, key, key_length, data, data_length, mac, &mac_length) == NULL) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to calculate hmac");
+        return -1;
+    }
+
+    return (int)mac_length;
+}
+
+/*
+    EVP_MD_CTX *osslevp_digest_session_init(const EVP_MD *digest,
+                                            const unsigned char *key,
+                                            int key_length)
+
+    Creates a context which generates the \a digest of the data passed to
+    osslevp_digest_session_update(), or its HMAC if a \a key of the
+    specified \a key_length is given.  The context holds its own copy of
+    the key.
+
+    Returns the context, which must be released with
+    osslevp_digest_session_free(), or NULL on failure.
+*/
+EVP_MD_CTX *osslevp_digest_session_init(const EVP_MD *digest,
+                                        const unsigned char *key,
+                                        int key_length)
+{
+    EVP_MD_CTX *digest_context = NULL;
+    EVP_PKEY *mac_key = NULL;
+
+    if (digest == NULL || (key != NULL && key_length <= 0)) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting digest session initialisation");
+        return NULL;
+    }
+
+    digest_context = EVP_MD_CTX_create();
+    if (digest_context == NULL) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to allocate digest session context");
+        return NULL;
+    }
+
+    if (key == NULL) {
+        if (!EVP_DigestInit_ex(digest_context, digest, NULL)) {
+            ERR_print_errors_fp(stderr);
+            EVP_MD_CTX_destroy(digest_context);
+            fprintf(stderr, "%s\n", "failed to initialise digest session");
+            return NULL;
+        }
+        return digest_context;
+    }
+
+    /* The signing context keeps a reference to the key */
+    mac_key = EVP_PKEY_new_mac_key(EVP_PKEY_HMAC, NULL, key, key_length);
+    if (mac_key == NULL
+            || EVP_DigestSignInit(digest_context, NULL, digest, NULL, mac_key) <= 0) {
+        ERR_print_errors_fp(stderr);
+        EVP_PKEY_free(mac_key);
+        EVP_MD_CTX_destroy(digest_context);
+        fprintf(stderr, "%s\n", "failed to initialise hmac session");
+        return NULL;
+    }
+
+    EVP_PKEY_free(mac_key);
+    return digest_context;
+}
+
+/*
+    int osslevp_digest_session_update(EVP_MD_CTX *digest_context,
+                                      const unsigned char *input,
+                                      int input_length)
+
+    Adds the \a input of the specified \a input_length to the digest or
+    HMAC being calculated by the \a digest_context.
+
+    Returns 1 on success, 0 on failure.
+*/
+int osslevp_digest_session_update(EVP_MD_CTX *digest_context,
+                                  const unsigned char *input,
+                                  int input_length)
+{
+    if (digest_context == NULL || input_length < 0 || (input_length > 0 && input == NULL)) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting digest session update");
+        return 0;
+    }
+
+    /* EVP_DigestSignUpdate() is EVP_DigestUpdate() */
+    if (input_length > 0 && !EVP_DigestUpdate(digest_context, input, input_length)) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to update digest session");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+    int osslevp_digest_session_final(EVP_MD_CTX *digest_context,
+                                     int mac,
+                                     unsigned char *output)
+
+    Writes the digest, or if \a mac is nonzero the HMAC, calculated by
+    the \a digest_context into the \a output buffer, which must be at
+    least EVP_MAX_MD_SIZE bytes long.
+
+    Returns the number of bytes written to \a output, or -1 on failure.
+*/
+int osslevp_digest_session_final(EVP_MD_CTX *digest_context,
+                                 int mac,
+                                 unsigned char *output)
+{
+    unsigned int digest_length = 0;
+    size_t mac_length = EVP_MAX_MD_SIZE;
+
+    if (digest_context == NULL || output == NULL) {
+        /* Invalid arguments */
+        fprintf(stderr, "%s\n", "invalid arguments, aborting digest session finalisation");
+        return -1;
+    }
+
+    if (mac) {
+        if (EVP_DigestSignFinal(digest_context, output, &mac_length) <= 0) {
+            ERR_print_errors_fp(stderr);
+            fprintf(stderr, "%s\n", "failed to finalise hmac session");
+            return -1;
+        }
+        return (int)mac_length;
+    }
+
+    if (!EVP_DigestFinal_ex(digest_context, output, &digest_length)) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to finalise digest session");
+        return -1;
+    }
+
+    return (int)digest_length;
+}
+
+/*
+    void osslevp_digest_session_free(EVP_MD_CTX *digest_context)
+
+    Clears and releases the given \a digest_context.
+*/
+void osslevp_digest_session_free(EVP_MD_CTX *digest_context)
+{
+    if (digest_context != NULL) {
+        EVP_MD_CTX_destroy(digest_context);
+    }
 }
 
 #ifdef __cplusplus
@@ -10,18 +10,245 @@
 
 #include "Crypto/key.h"
 #include "Crypto/certificate.h"
+#include "Crypto/cryptomanager.h"
 
 #include <QtCore/QByteArray>
 #include <QtCore/QMap>
 #include <QtCore/QVector>
 #include <QtCore/QString>
-#include <QtCore/QUuid>
 #include <QtCore/QCryptographicHash>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+#include <climits>
 
 Q_PLUGIN_METADATA(IID Sailfish_Crypto_CryptoPlugin_IID)
 
+namespace {
+    // bounds the cipher contexts which a single client can keep resident.
+    const int MaxCipherSessionsPerClient = 16;
+
+    // bounds the parsed keys cached for each of signing and verification.
+    const int MaxParsedKeys = 32;
+
+    // random data is generated into each thread's buffer in blocks of this
+    // size, which larger requests bypass, and the generator is reseeded
+    // after this much has been generated for a thread.
+    const int RandomBufferSize = 4096;
+    const qint64 RandomReseedInterval = 1024 * 1024;
+
+    // GCM ciphertext is laid out as initialisation vector || ciphertext || tag.
+    const int GcmInitVectorSize = 12;
+    const int GcmTagSize = 16;
+
+    const EVP_CIPHER *aesCipher(Sailfish::Crypto::Key::Algorithm algorithm, Sailfish::Crypto::Key::BlockMode blockMode)
+    {
+        if (algorithm == Sailfish::Crypto::Key::Aes128) {
+            switch (blockMode) {
+                case Sailfish::Crypto::Key::BlockModeCBC: return EVP_aes_128_cbc();
+                case Sailfish::Crypto::Key::BlockModeCTR: return EVP_aes_128_ctr();
+                case Sailfish::Crypto::Key::BlockModeGCM: return EVP_aes_128_gcm();
+                default: break;
+            }
+        } else if (algorithm == Sailfish::Crypto::Key::Aes256) {
+            switch (blockMode) {
+                case Sailfish::Crypto::Key::BlockModeCBC: return EVP_aes_256_cbc();
+                case Sailfish::Crypto::Key::BlockModeCTR: return EVP_aes_256_ctr();
+                case Sailfish::Crypto::Key::BlockModeGCM: return EVP_aes_256_gcm();
+                default: break;
+            }
+        }
+        return Q_NULLPTR;
+    }
+
+    Sailfish::Crypto::Result checkCipherParameters(
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const EVP_CIPHER **cipher)
+    {
+        if (key.algorithm() != Sailfish::Crypto::Key::Aes128 && key.algorithm() != Sailfish::Crypto::Key::Aes256) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                            QLatin1String("The OpenSslCryptoPlugin doesn't support algorithms other than Aes128 and Aes256 - TODO!!"));
+        }
+
+        *cipher = aesCipher(key.algorithm(), blockMode);
+        if (!*cipher) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                            QLatin1String("The OpenSslCryptoPlugin doesn't support block modes other than CBC, CTR and GCM - TODO!!"));
+        }
+
+        if (padding != Sailfish::Crypto::Key::EncryptionPaddingNone) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                            QLatin1String("The OpenSslCryptoPlugin doesn't support encryption padding other than None - TODO!!"));
+        }
+
+        if (digest != Sailfish::Crypto::Key::DigestSha256) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                            QLatin1String("The OpenSslCryptoPlugin doesn't support digests other than Sha256 - TODO!!"));
+        }
+
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
+    // the modulus size of the RSA algorithms which the plugin supports, or 0.
+    int rsaKeyBits(Sailfish::Crypto::Key::Algorithm algorithm)
+    {
+        switch (algorithm) {
+            case Sailfish::Crypto::Key::Rsa2048: return 2048;
+            case Sailfish::Crypto::Key::Rsa3072: return 3072;
+            case Sailfish::Crypto::Key::Rsa4096: return 4096;
+            default: return 0;
+        }
+    }
+
+    // the curve of the elliptic curve algorithms which the plugin supports, or NID_undef.
+    int eccCurveNid(Sailfish::Crypto::Key::Algorithm algorithm)
+    {
+        switch (algorithm) {
+            case Sailfish::Crypto::Key::NistEcc256: return NID_X9_62_prime256v1;
+            case Sailfish::Crypto::Key::NistEcc384: return NID_secp384r1;
+            case Sailfish::Crypto::Key::NistEcc521: return NID_secp521r1;
+            default: return NID_undef;
+        }
+    }
+
+    QVector<Sailfish::Crypto::Key::Algorithm> asymmetricAlgorithms()
+    {
+        QVector<Sailfish::Crypto::Key::Algorithm> algorithms;
+        algorithms << Sailfish::Crypto::Key::Rsa2048 << Sailfish::Crypto::Key::Rsa3072 << Sailfish::Crypto::Key::Rsa4096
+                   << Sailfish::Crypto::Key::NistEcc256 << Sailfish::Crypto::Key::NistEcc384 << Sailfish::Crypto::Key::NistEcc521;
+        return algorithms;
+    }
+
+    const EVP_MD *evpDigest(Sailfish::Crypto::Key::Digest digest)
+    {
+        switch (digest) {
+            case Sailfish::Crypto::Key::DigestSha1:   return EVP_sha1();
+            case Sailfish::Crypto::Key::DigestSha256: return EVP_sha256();
+            case Sailfish::Crypto::Key::DigestSha384: return EVP_sha384();
+            case Sailfish::Crypto::Key::DigestSha512: return EVP_sha512();
+            default: return Q_NULLPTR;
+        }
+    }
+
+    Sailfish::Crypto::Result checkSignatureParameters(
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::SignaturePadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            const EVP_MD **md,
+            int *rsaPadding)
+    {
+        if (!rsaKeyBits(key.algorithm()) && eccCurveNid(key.algorithm()) == NID_undef) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
+                                            QLatin1String("The OpenSslCryptoPlugin doesn't support signatures with algorithms other than RSA and NIST ECC - TODO!!"));
+        }
+
+        *md = evpDigest(digest);
+        if (!*md) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                            QLatin1String("The OpenSslCryptoPlugin doesn't support that digest for signatures"));
+        }
+
+        *rsaPadding = 0;
+        if (rsaKeyBits(key.algorithm())) {
+            if (padding == Sailfish::Crypto::Key::SignaturePaddingRsaPss) {
+                *rsaPadding = RSA_PKCS1_PSS_PADDING;
+            } else if (padding == Sailfish::Crypto::Key::SignaturePaddingRsaPkcs1) {
+                *rsaPadding = RSA_PKCS1_PADDING;
+            }
+        }
+        if (*rsaPadding == 0 && !(eccCurveNid(key.algorithm()) != NID_undef && padding == Sailfish::Crypto::Key::SignaturePaddingNone)) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedSignaturePadding,
+                                            QLatin1String("The OpenSslCryptoPlugin doesn't support that signature padding for that algorithm"));
+        }
+
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
+    QByteArray encodedKey(EVP_PKEY *pkey, bool privateKey)
+    {
+        unsigned char *encoded = NULL;
+        const int size = osslevp_pkey_encode(pkey, privateKey ? 1 : 0, &encoded);
+        if (size <= 0) {
+            return QByteArray();
+        }
+        const QByteArray retn((const char *)encoded, size);
+        if (privateKey) {
+            OPENSSL_cleanse(encoded, size);
+        }
+        OPENSSL_free(encoded);
+        return retn;
+    }
+
+    // CBC uses an initialisation vector derived from the secret key, for
+    // compatibility with data encrypted before other modes were supported.
+    QByteArray derivedInitVector(const QByteArray &secretKey)
+    {
+        QCryptographicHash ivHash(QCryptographicHash::Sha256);
+        ivHash.addData(secretKey);
+        QByteArray initVector = ivHash.result();
+        if (initVector.size() > 16) {
+            initVector.chop(initVector.size() - 16);
+        } else while (initVector.size() < 16) {
+            initVector.append('\0');
+        }
+        return initVector;
+    }
+}
+
+struct Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::CipherSessionData
+{
+    CipherSessionData(EVP_CIPHER_CTX *context, Sailfish::Crypto::Key::Operation op)
+        : evpCipherContext(context), evpDigestContext(Q_NULLPTR), operation(op), closed(false), initVectorPending(false) {}
+    CipherSessionData(EVP_MD_CTX *context, Sailfish::Crypto::Key::Operation op)
+        : evpCipherContext(Q_NULLPTR), evpDigestContext(context), operation(op), closed(false), initVectorPending(false) {}
+    ~CipherSessionData() {
+        osslevp_aes_cipher_session_free(evpCipherContext);
+        osslevp_digest_session_free(evpDigestContext);
+    }
+
+    QMutex mutex; // serialises use of the context, and guards closed.
+    EVP_CIPHER_CTX *evpCipherContext; // for Encrypt and Decrypt sessions
+    EVP_MD_CTX *evpDigestContext;     // for GenerateDigest and CalculateMac sessions
+    Sailfish::Crypto::Key::Operation operation;
+    bool closed;
+
+    // the random initialisation vector of a CTR session precedes its ciphertext:
+    // encrypt sessions emit it before their first output, and decrypt sessions
+    // collect it from their first input before decrypting anything.
+    QByteArray initVector;
+    bool initVectorPending;
+};
+
+struct Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::ThreadRandomBuffer
+{
+    ThreadRandomBuffer() : offset(RandomBufferSize), generated(0) {}
+    ~ThreadRandomBuffer() { OPENSSL_cleanse(buffer, sizeof(buffer)); }
+
+    unsigned char buffer[RandomBufferSize];
+    int offset;        // the bytes before this have been handed out, and cleared
+    qint64 generated;  // since the generator was last reseeded
+};
+
+struct Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::ThreadCipherContexts
+{
+    ThreadCipherContexts()
+        : encryption(osslevp_cipher_context_new()), decryption(osslevp_cipher_context_new()) {}
+    ~ThreadCipherContexts() {
+        osslevp_cipher_context_free(encryption);
+        osslevp_cipher_context_free(decryption);
+    }
+
+    // separate contexts, so that alternating operations keep their key schedules.
+    osslevp_cipher_context *encryption;
+    osslevp_cipher_context *decryption;
+};
+
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::OpenSslCryptoPlugin(QObject *parent)
     : Sailfish::Crypto::CryptoPlugin(parent)
+    , m_nextCipherSessionToken(1)
 {
     osslevp_init();
 }
@@ -34,7 +261,9 @@ QVector<Sailfish::Crypto::Key::Algorithm>
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::supportedAlgorithms() const
 {
     QVector<Sailfish::Crypto::Key::Algorithm> retn;
+    retn.append(Sailfish::Crypto::Key::Aes128);
     retn.append(Sailfish::Crypto::Key::Aes256);
+    retn += asymmetricAlgorithms();
     return retn;
 }
 
@@ -42,7 +271,8 @@ QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::BlockModes>
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::supportedBlockModes() const
 {
     QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::BlockModes> retn;
-    retn.insert(Sailfish::Crypto::Key::Aes256, Sailfish::Crypto::Key::BlockModeCBC);
+    retn.insert(Sailfish::Crypto::Key::Aes128, Sailfish::Crypto::Key::BlockModeCBC | Sailfish::Crypto::Key::BlockModeCTR | Sailfish::Crypto::Key::BlockModeGCM);
+    retn.insert(Sailfish::Crypto::Key::Aes256, Sailfish::Crypto::Key::BlockModeCBC | Sailfish::Crypto::Key::BlockModeCTR | Sailfish::Crypto::Key::BlockModeGCM);
     return retn;
 }
 
@@ -50,6 +280,7 @@ QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::EncryptionPaddings
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::supportedEncryptionPaddings() const
 {
     QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::EncryptionPaddings> retn;
+    retn.insert(Sailfish::Crypto::Key::Aes128, Sailfish::Crypto::Key::EncryptionPaddingNone);
     retn.insert(Sailfish::Crypto::Key::Aes256, Sailfish::Crypto::Key::EncryptionPaddingNone);
     return retn;
 }
@@ -58,7 +289,13 @@ QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::SignaturePaddings>
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::supportedSignaturePaddings() const
 {
     QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::SignaturePaddings> retn;
+    retn.insert(Sailfish::Crypto::Key::Aes128, Sailfish::Crypto::Key::SignaturePaddingNone);
     retn.insert(Sailfish::Crypto::Key::Aes256, Sailfish::Crypto::Key::SignaturePaddingNone);
+    Q_FOREACH (Sailfish::Crypto::Key::Algorithm algorithm, asymmetricAlgorithms()) {
+        retn.insert(algorithm, rsaKeyBits(algorithm)
+                ? Sailfish::Crypto::Key::SignaturePaddingRsaPss | Sailfish::Crypto::Key::SignaturePaddingRsaPkcs1
+                : Sailfish::Crypto::Key::SignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone));
+    }
     return retn;
 }
 
@@ -66,7 +303,15 @@ QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::Digests>
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::supportedDigests() const
 {
     QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::Digests> retn;
+    retn.insert(Sailfish::Crypto::Key::Aes128, Sailfish::Crypto::Key::DigestSha256);
     retn.insert(Sailfish::Crypto::Key::Aes256, Sailfish::Crypto::Key::DigestSha256);
+    Q_FOREACH (Sailfish::Crypto::Key::Algorithm algorithm, asymmetricAlgorithms()) {
+        retn.insert(algorithm, Sailfish::Crypto::Key::DigestSha1 | Sailfish::Crypto::Key::DigestSha256
+                             | Sailfish::Crypto::Key::DigestSha384 | Sailfish::Crypto::Key::DigestSha512);
+    }
+    // the digests (and HMACs) which need no key, or any secret key.
+    retn.insert(Sailfish::Crypto::Key::AlgorithmUnknown, Sailfish::Crypto::Key::DigestSha1 | Sailfish::Crypto::Key::DigestSha256
+                                                       | Sailfish::Crypto::Key::DigestSha384 | Sailfish::Crypto::Key::DigestSha512);
     return retn;
 }
 
@@ -75,7 +320,12 @@ Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::supportedOperations() co
 {
     // TODO: should this be algorithm specific?  not sure?
     QMap<Sailfish::Crypto::Key::Algorithm, Sailfish::Crypto::Key::Operations> retn;
-    retn.insert(Sailfish::Crypto::Key::Aes256, Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+    retn.insert(Sailfish::Crypto::Key::Aes128, Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt | Sailfish::Crypto::Key::CalculateMac);
+    retn.insert(Sailfish::Crypto::Key::Aes256, Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt | Sailfish::Crypto::Key::CalculateMac);
+    Q_FOREACH (Sailfish::Crypto::Key::Algorithm algorithm, asymmetricAlgorithms()) {
+        retn.insert(algorithm, Sailfish::Crypto::Key::Sign | Sailfish::Crypto::Key::Verify);
+    }
+    retn.insert(Sailfish::Crypto::Key::AlgorithmUnknown, Sailfish::Crypto::Key::GenerateDigest);
     return retn;
 }
 
@@ -95,15 +345,41 @@ Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::generateKey(
         const Sailfish::Crypto::Key &keyTemplate,
         Sailfish::Crypto::Key *key)
 {
-    if (keyTemplate.algorithm() != Sailfish::Crypto::Key::Aes256) {
+    const int rsaBits = rsaKeyBits(keyTemplate.algorithm());
+    const int curveNid = eccCurveNid(keyTemplate.algorithm());
+    if (rsaBits || curveNid != NID_undef) {
+        EVP_PKEY *pkey = rsaBits ? osslevp_pkey_generate_rsa(rsaBits) : osslevp_pkey_generate_ec(curveNid);
+        if (!pkey) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginKeyGenerationError,
+                                            QLatin1String("OpenSSL crypto plugin failed to generate the key pair"));
+        }
+        const QByteArray privateKey = encodedKey(pkey, true);
+        const QByteArray publicKey = encodedKey(pkey, false);
+        EVP_PKEY_free(pkey);
+        if (privateKey.isEmpty() || publicKey.isEmpty()) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginKeyGenerationError,
+                                            QLatin1String("OpenSSL crypto plugin failed to encode the key pair"));
+        }
+
+        *key = keyTemplate;
+        key->setPrivateKey(privateKey);
+        key->setPublicKey(publicKey);
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
+    if (keyTemplate.algorithm() != Sailfish::Crypto::Key::Aes128
+            && keyTemplate.algorithm() != Sailfish::Crypto::Key::Aes256) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support algorithms other than Aes256 - TODO!!"));
+                                        QLatin1String("The OpenSslCryptoPlugin doesn't support algorithms other than Aes128, Aes256, RSA and NIST ECC - TODO!!"));
     }
 
-    const QUuid seed = QUuid::createUuid();
-    const QByteArray hashed = QCryptographicHash::hash(seed.toByteArray(), QCryptographicHash::Sha256);
+    QByteArray secretKey(keyTemplate.algorithm() == Sailfish::Crypto::Key::Aes128 ? 16 : 32, '\0');
+    if (!randomBytes(secretKey.data(), secretKey.size())) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginKeyGenerationError,
+                                        QLatin1String("OpenSSL crypto plugin failed to generate the key"));
+    }
     *key = keyTemplate;
-    key->setSecretKey(hashed);
+    key->setSecretKey(secretKey);
 
     return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
 }
@@ -156,32 +432,113 @@ Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::sign(
         Sailfish::Crypto::Key::Digest digest,
         QByteArray *signature)
 {
-    // TODO: support more operations and algorithms in this plugin!
-    Q_UNUSED(data);
-    Q_UNUSED(key);
-    Q_UNUSED(padding);
-    Q_UNUSED(digest);
-    Q_UNUSED(signature);
-    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                    QLatin1String("TODO: OpenSslCryptoPlugin::sign"));
+    const EVP_MD *md = Q_NULLPTR;
+    int rsaPadding = 0;
+    const Sailfish::Crypto::Result parametersResult = checkSignatureParameters(key, padding, digest, &md, &rsaPadding);
+    if (parametersResult.code() != Sailfish::Crypto::Result::Succeeded) {
+        return parametersResult;
+    }
+
+    if (key.privateKey().isEmpty()) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::EmptyPrivateKey,
+                                        QLatin1String("Cannot sign with empty private key"));
+    }
+
+    const QSharedPointer<EVP_PKEY> pkey = parsedKey(key, true);
+    if (!pkey) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginSigningError,
+                                        QLatin1String("OpenSSL crypto plugin failed to parse the private key"));
+    }
+
+    // write directly into the output buffer, which is trimmed afterwards.
+    QByteArray output;
+    output.resize(EVP_PKEY_size(pkey.data()));
+    const int size = osslevp_pkey_sign(pkey.data(), md, rsaPadding,
+                                       (const unsigned char *)data.constData(), data.size(),
+                                       (unsigned char *)output.data());
+    if (size <= 0) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginSigningError,
+                                        QLatin1String("OpenSSL crypto plugin failed to sign the data"));
+    }
+
+    output.resize(size);
+    *signature = output;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
 }
 
 Sailfish::Crypto::Result
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::verify(
         const QByteArray &data,
+        const QByteArray &signature,
         const Sailfish::Crypto::Key &key,
         Sailfish::Crypto::Key::SignaturePadding padding,
         Sailfish::Crypto::Key::Digest digest,
         bool *verified)
 {
-    // TODO: support more operations and algorithms in this plugin!
-    Q_UNUSED(data);
-    Q_UNUSED(key);
-    Q_UNUSED(padding);
-    Q_UNUSED(digest);
-    Q_UNUSED(verified);
-    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                    QLatin1String("TODO: OpenSslCryptoPlugin::verify"));
+    const EVP_MD *md = Q_NULLPTR;
+    int rsaPadding = 0;
+    const Sailfish::Crypto::Result parametersResult = checkSignatureParameters(key, padding, digest, &md, &rsaPadding);
+    if (parametersResult.code() != Sailfish::Crypto::Result::Succeeded) {
+        return parametersResult;
+    }
+
+    // the private key suffices if the public key was not provided.
+    const bool usePrivateKey = key.publicKey().isEmpty();
+    if (usePrivateKey && key.privateKey().isEmpty()) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::EmptyPublicKey,
+                                        QLatin1String("Cannot verify with empty public key"));
+    }
+
+    const QSharedPointer<EVP_PKEY> pkey = parsedKey(key, usePrivateKey);
+    if (!pkey) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginVerificationError,
+                                        QLatin1String("OpenSSL crypto plugin failed to parse the key"));
+    }
+
+    // an invalid signature is a successful verification which returns false.
+    *verified = !signature.isEmpty()
+            && osslevp_pkey_verify(pkey.data(), md, rsaPadding,
+                                   (const unsigned char *)data.constData(), data.size(),
+                                   (const unsigned char *)signature.constData(), signature.size()) == 1;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+QSharedPointer<EVP_PKEY>
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::parsedKey(
+        const Sailfish::Crypto::Key &key,
+        bool privateKey)
+{
+    const QByteArray encoded = privateKey ? key.privateKey() : key.publicKey();
+    const QPair<QString, QString> identifier(key.identifier().collectionName(), key.identifier().name());
+    const bool cacheable = !identifier.second.isEmpty();
+    QMap<QPair<QString, QString>, ParsedKey> &parsedKeys(privateKey ? m_parsedPrivateKeys : m_parsedPublicKeys);
+
+    if (cacheable) {
+        QMutexLocker locker(&m_parsedKeysMutex);
+        QMap<QPair<QString, QString>, ParsedKey>::const_iterator it = parsedKeys.constFind(identifier);
+        if (it != parsedKeys.constEnd() && it->encoded == encoded) {
+            return it->pkey;
+        }
+    }
+
+    // parse outside the lock, so that lookups of other keys are not held up.
+    EVP_PKEY *pkey = osslevp_pkey_decode((const unsigned char *)encoded.constData(), encoded.size(), privateKey ? 1 : 0);
+    if (!pkey) {
+        return QSharedPointer<EVP_PKEY>();
+    }
+    const QSharedPointer<EVP_PKEY> retn(pkey, EVP_PKEY_free);
+
+    if (cacheable) {
+        QMutexLocker locker(&m_parsedKeysMutex);
+        if (!parsedKeys.contains(identifier) && parsedKeys.size() >= MaxParsedKeys) {
+            parsedKeys.erase(parsedKeys.begin());
+        }
+        ParsedKey &parsed(parsedKeys[identifier]);
+        parsed.encoded = encoded;
+        parsed.pkey = retn;
+    }
+
+    return retn;
 }
 
 Sailfish::Crypto::Result
@@ -193,24 +550,10 @@ Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::encrypt(
         Sailfish::Crypto::Key::Digest digest,
         QByteArray *encrypted)
 {
-    if (key.algorithm() != Sailfish::Crypto::Key::Aes256) {
-        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support algorithms other than Aes256 - TODO!!"));
-    }
-
-    if (blockMode != Sailfish::Crypto::Key::BlockModeCBC) {
-        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support block modes other than CBC - TODO!!"));
-    }
-
-    if (padding != Sailfish::Crypto::Key::EncryptionPaddingNone) {
-        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support encryption padding other than None - TODO!!"));
-    }
-
-    if (digest != Sailfish::Crypto::Key::DigestSha256) {
-        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support digests other than Sha256 - TODO!!"));
+    const EVP_CIPHER *cipher = Q_NULLPTR;
+    const Sailfish::Crypto::Result parametersResult = checkCipherParameters(key, blockMode, padding, digest, &cipher);
+    if (parametersResult.code() != Sailfish::Crypto::Result::Succeeded) {
+        return parametersResult;
     }
 
     if (key.secretKey().isEmpty()) {
@@ -221,20 +564,25 @@ Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::encrypt(
     // generate initialisation vector and key hash
     QCryptographicHash keyHash(QCryptographicHash::Sha512);
     keyHash.addData(key.secretKey());
-    QCryptographicHash ivHash(QCryptographicHash::Sha256);
-    ivHash.addData(key.secretKey());
-    QByteArray initVector = ivHash.result();
-    if (initVector.size() > 16) {
-        initVector.chop(initVector.size() - 16);
-    } else while (initVector.size() < 16) {
-        initVector.append('\0');
+    const QByteArray initVector = blockMode == Sailfish::Crypto::Key::BlockModeCBC
+            ? derivedInitVector(key.secretKey())
+            : randomInitVector(blockMode == Sailfish::Crypto::Key::BlockModeGCM ? GcmInitVectorSize : AES_BLOCK_SIZE);
+    if (initVector.isEmpty()) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginEncryptionError,
+                                        QLatin1String("OpenSSL crypto plugin failed to generate an initialisation vector"));
     }
 
-    // encrypt plaintext
-    QByteArray ciphertext = aes_encrypt_plaintext(data, keyHash.result(), initVector);
+    // encrypt plaintext.  The random initialisation vector precedes the ciphertext.
+    QByteArray ciphertext;
+    if (blockMode != Sailfish::Crypto::Key::BlockModeCBC) {
+        ciphertext = initVector;
+    }
+    const bool succeeded = blockMode == Sailfish::Crypto::Key::BlockModeGCM
+            ? aes_gcm_encrypt_plaintext(cipher, data, keyHash.result(), initVector, &ciphertext)
+            : aes_encrypt_plaintext(cipher, data, keyHash.result(), initVector, &ciphertext);
 
     // return result.
-    if (ciphertext.size()) {
+    if (succeeded) {
         *encrypted = ciphertext;
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
     }
@@ -252,98 +600,595 @@ Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::decrypt(
         Sailfish::Crypto::Key::Digest digest,
         QByteArray *decrypted)
 {
+    const EVP_CIPHER *cipher = Q_NULLPTR;
+    const Sailfish::Crypto::Result parametersResult = checkCipherParameters(key, blockMode, padding, digest, &cipher);
+    if (parametersResult.code() != Sailfish::Crypto::Result::Succeeded) {
+        return parametersResult;
+    }
 
-    if (key.algorithm() != Sailfish::Crypto::Key::Aes256) {
+    if (key.secretKey().isEmpty()) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::EmptySecretKey,
+                                        QLatin1String("Cannot encrypt with empty secret key"));
+    }
+
+    // generate key hash, and find the initialisation vector
+    QCryptographicHash keyHash(QCryptographicHash::Sha512);
+    keyHash.addData(key.secretKey());
+    QByteArray initVector;
+    QByteArray ciphertext = data;
+    if (blockMode == Sailfish::Crypto::Key::BlockModeCBC) {
+        initVector = derivedInitVector(key.secretKey());
+    } else {
+        const int initVectorSize = blockMode == Sailfish::Crypto::Key::BlockModeGCM ? GcmInitVectorSize : AES_BLOCK_SIZE;
+        const int tagSize = blockMode == Sailfish::Crypto::Key::BlockModeGCM ? GcmTagSize : 0;
+        // the ciphertext of empty plaintext consists of the initialisation vector (and tag) alone.
+        if (data.size() < initVectorSize + tagSize) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDecryptionError,
+                                            QLatin1String("OpenSSL crypto plugin cannot decrypt truncated ciphertext"));
+        }
+        // refer to the input rather than copying it, as it outlives this call.
+        initVector = QByteArray::fromRawData(data.constData(), initVectorSize);
+        ciphertext = QByteArray::fromRawData(data.constData() + initVectorSize, data.size() - initVectorSize);
+    }
+
+    // decrypt ciphertext.  GCM ciphertext which fails authentication yields no plaintext.
+    QByteArray plaintext;
+    const bool succeeded = blockMode == Sailfish::Crypto::Key::BlockModeGCM
+            ? aes_gcm_decrypt_ciphertext(cipher, ciphertext, keyHash.result(), initVector, &plaintext)
+            : aes_decrypt_ciphertext(cipher, ciphertext, keyHash.result(), initVector, &plaintext);
+    if (!succeeded || (plaintext.size() == 1 && plaintext.at(0) == 0)) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDecryptionError,
+                                         QLatin1String("OpenSSL crypto plugin failed to decrypt the secret"));
+    }
+
+    // return result.
+    *decrypted = plaintext;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::generateRandomData(
+        const QString &csprngEngineName,
+        quint64 numberBytes,
+        QByteArray *randomData)
+{
+#ifdef SAILFISH_CRYPTO_BUILD_TEST_PLUGIN
+    // lets the autotests have an operation outstanding for long enough to
+    // interrupt it, e.g. by killing the plugin's host process.
+    if (csprngEngineName == QLatin1String("testslowengine")) {
+        QThread::sleep(3);
+        return generateRandomData(Sailfish::Crypto::CryptoManager::DefaultCsprngEngineName, numberBytes, randomData);
+    }
+#endif
+
+    if (csprngEngineName != Sailfish::Crypto::CryptoManager::DefaultCsprngEngineName) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support algorithms other than Aes256 - TODO!!"));
+                                        QLatin1String("The OpenSslCryptoPlugin doesn't support CSPRNG engines other than the default"));
     }
 
-    if (blockMode != Sailfish::Crypto::Key::BlockModeCBC) {
+    if (numberBytes > quint64(INT_MAX)) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support block modes other than CBC - TODO!!"));
+                                        QLatin1String("The OpenSslCryptoPlugin cannot generate that much random data at once"));
+    }
+
+    QByteArray output(int(numberBytes), '\0');
+    if (!randomBytes(output.data(), output.size())) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnknownError,
+                                        QLatin1String("OpenSSL crypto plugin failed to generate random data"));
+    }
+
+    *randomData = output;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::generateDigest(
+        const QByteArray &data,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *digestValue)
+{
+    const EVP_MD *md = evpDigest(digest);
+    if (!md) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                        QLatin1String("The OpenSslCryptoPlugin doesn't support that digest"));
     }
 
-    if (padding != Sailfish::Crypto::Key::EncryptionPaddingNone) {
+    QByteArray output;
+    output.resize(EVP_MAX_MD_SIZE);
+    const int size = osslevp_digest(md, (const unsigned char *)data.constData(), data.size(),
+                                    (unsigned char *)output.data());
+    if (size <= 0) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDigestError,
+                                        QLatin1String("OpenSSL crypto plugin failed to generate the digest"));
+    }
+
+    output.resize(size);
+    *digestValue = output;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::calculateMac(
+        const QByteArray &data,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Digest digest,
+        QByteArray *mac)
+{
+    const EVP_MD *md = evpDigest(digest);
+    if (!md) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                        QLatin1String("The OpenSslCryptoPlugin doesn't support that digest"));
+    }
+
+    if (key.secretKey().isEmpty()) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::EmptySecretKey,
+                                        QLatin1String("Cannot calculate MAC with empty secret key"));
+    }
+
+    QByteArray output;
+    output.resize(EVP_MAX_MD_SIZE);
+    const int size = osslevp_hmac(md,
+                                  (const unsigned char *)key.secretKey().constData(), key.secretKey().size(),
+                                  (const unsigned char *)data.constData(), data.size(),
+                                  (unsigned char *)output.data());
+    if (size <= 0) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDigestError,
+                                        QLatin1String("OpenSSL crypto plugin failed to calculate the MAC"));
+    }
+
+    output.resize(size);
+    *mac = output;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::initialiseCipherSession(
+        quint64 clientId,
+        const Sailfish::Crypto::Key &key,
+        Sailfish::Crypto::Key::Operation operation,
+        Sailfish::Crypto::Key::BlockMode blockMode,
+        Sailfish::Crypto::Key::EncryptionPadding padding,
+        Sailfish::Crypto::Key::Digest digest,
+        quint32 *cipherSessionToken)
+{
+    if (operation == Sailfish::Crypto::Key::GenerateDigest || operation == Sailfish::Crypto::Key::CalculateMac) {
+        const EVP_MD *md = evpDigest(digest);
+        if (!md) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedDigest,
+                                            QLatin1String("The OpenSslCryptoPlugin doesn't support that digest"));
+        }
+
+        const bool mac = operation == Sailfish::Crypto::Key::CalculateMac;
+        if (mac && key.secretKey().isEmpty()) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::EmptySecretKey,
+                                            QLatin1String("Cannot initialise MAC session with empty secret key"));
+        }
+
+        EVP_MD_CTX *context = osslevp_digest_session_init(md,
+                                                          mac ? (const unsigned char *)key.secretKey().constData() : NULL,
+                                                          mac ? key.secretKey().size() : 0);
+        if (!context) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDigestError,
+                                            QLatin1String("OpenSSL crypto plugin failed to initialise the digest session"));
+        }
+
+        return insertCipherSession(clientId, QSharedPointer<CipherSessionData>(new CipherSessionData(context, operation)), cipherSessionToken);
+    }
+
+    if (operation != Sailfish::Crypto::Key::Encrypt && operation != Sailfish::Crypto::Key::Decrypt) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support encryption padding other than None - TODO!!"));
+                                        QLatin1String("The OpenSslCryptoPlugin only supports encrypt, decrypt, digest and MAC cipher sessions"));
     }
 
-    if (digest != Sailfish::Crypto::Key::DigestSha256) {
+    const EVP_CIPHER *cipher = Q_NULLPTR;
+    const Sailfish::Crypto::Result parametersResult = checkCipherParameters(key, blockMode, padding, digest, &cipher);
+    if (parametersResult.code() != Sailfish::Crypto::Result::Succeeded) {
+        return parametersResult;
+    }
+
+    if (blockMode == Sailfish::Crypto::Key::BlockModeGCM) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::UnsupportedOperation,
-                                        QLatin1String("The OpenSslCryptoPlugin doesn't support digests other than Sha256 - TODO!!"));
+                                        QLatin1String("The OpenSslCryptoPlugin doesn't support GCM cipher sessions - TODO!!"));
     }
 
     if (key.secretKey().isEmpty()) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::EmptySecretKey,
-                                        QLatin1String("Cannot encrypt with empty secret key"));
+                                        QLatin1String("Cannot initialise cipher session with empty secret key"));
     }
 
-    // generate initialisation vector and key hash
+    {
+        QMutexLocker locker(&m_cipherSessionsMutex);
+        if (m_cipherSessions.value(clientId).size() >= MaxCipherSessionsPerClient) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginCipherSessionLimitReached,
+                                            QLatin1String("Too many cipher sessions are open for this client"));
+        }
+    }
+
+    // derive the same key and initialisation vector as encrypt() and decrypt(),
+    // so that the output of a session matches the layout of a single call.
+    // A CTR decrypt session reads its initialisation vector from its input.
     QCryptographicHash keyHash(QCryptographicHash::Sha512);
     keyHash.addData(key.secretKey());
-    QCryptographicHash ivHash(QCryptographicHash::Sha256);
-    ivHash.addData(key.secretKey());
-    QByteArray initVector = ivHash.result();
-    if (initVector.size() > 16) {
-        initVector.chop(initVector.size() - 16);
-    } else while (initVector.size() < 16) {
-        initVector.append('\0');
-    }
-
-    // decrypt ciphertext
-    QByteArray plaintext = aes_decrypt_ciphertext(data, keyHash.result(), initVector);
-    if (!plaintext.size() || (plaintext.size() == 1 && plaintext.at(0) == 0)) {
+    QByteArray initVector;
+    if (blockMode == Sailfish::Crypto::Key::BlockModeCBC) {
+        initVector = derivedInitVector(key.secretKey());
+    } else if (operation == Sailfish::Crypto::Key::Encrypt) {
+        initVector = randomInitVector(AES_BLOCK_SIZE);
+        if (initVector.isEmpty()) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginEncryptionError,
+                                            QLatin1String("OpenSSL crypto plugin failed to generate an initialisation vector"));
+        }
+    }
+
+    const QByteArray hashedKey = keyHash.result();
+    EVP_CIPHER_CTX *context = osslevp_aes_cipher_session_init(cipher,
+                                                              operation == Sailfish::Crypto::Key::Encrypt ? 1 : 0,
+                                                              initVector.isEmpty() ? NULL : (const unsigned char *)initVector.constData(),
+                                                              (const unsigned char *)hashedKey.constData(),
+                                                              hashedKey.size());
+    if (!context) {
+        return Sailfish::Crypto::Result(operation == Sailfish::Crypto::Key::Encrypt
+                                                ? Sailfish::Crypto::Result::CryptoPluginEncryptionError
+                                                : Sailfish::Crypto::Result::CryptoPluginDecryptionError,
+                                        QLatin1String("OpenSSL crypto plugin failed to initialise the cipher session"));
+    }
+
+    QSharedPointer<CipherSessionData> session(new CipherSessionData(context, operation));
+    if (blockMode != Sailfish::Crypto::Key::BlockModeCBC) {
+        session->initVector = initVector;
+        session->initVectorPending = true;
+    }
+    return insertCipherSession(clientId, session, cipherSessionToken);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::insertCipherSession(
+        quint64 clientId,
+        const QSharedPointer<CipherSessionData> &session,
+        quint32 *cipherSessionToken)
+{
+    QMutexLocker locker(&m_cipherSessionsMutex);
+    QMap<quint32, QSharedPointer<CipherSessionData> > &clientSessions(m_cipherSessions[clientId]);
+    if (clientSessions.size() >= MaxCipherSessionsPerClient) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginCipherSessionLimitReached,
+                                        QLatin1String("Too many cipher sessions are open for this client"));
+    }
+    quint32 token = m_nextCipherSessionToken++;
+    while (token == 0 || clientSessions.contains(token)) {
+        token = m_nextCipherSessionToken++;
+    }
+    clientSessions.insert(token, session);
+    *cipherSessionToken = token;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+QSharedPointer<Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::CipherSessionData>
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::cipherSession(
+        quint64 clientId,
+        quint32 cipherSessionToken)
+{
+    QMutexLocker locker(&m_cipherSessionsMutex);
+    return m_cipherSessions.value(clientId).value(cipherSessionToken);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::updateCipherSession(
+        quint64 clientId,
+        const QByteArray &data,
+        quint32 cipherSessionToken,
+        QByteArray *generatedData)
+{
+    QSharedPointer<CipherSessionData> session = cipherSession(clientId, cipherSessionToken);
+    if (!session) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginInvalidCipherSessionToken,
+                                        QLatin1String("No such cipher session exists"));
+    }
+
+    QMutexLocker sessionLocker(&session->mutex);
+    if (session->closed) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginInvalidCipherSessionToken,
+                                        QLatin1String("The cipher session has been closed"));
+    }
+
+    if (session->evpDigestContext) {
+        // digests and MACs are only output once the session is finalised.
+        if (!osslevp_digest_session_update(session->evpDigestContext, (const unsigned char *)data.constData(), data.size())) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDigestError,
+                                            QLatin1String("OpenSSL crypto plugin failed to update the digest session"));
+        }
+        generatedData->clear();
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
+    QByteArray input = data;
+    QByteArray prefix;
+    if (session->initVectorPending) {
+        if (session->operation == Sailfish::Crypto::Key::Encrypt) {
+            prefix = session->initVector;
+            session->initVectorPending = false;
+        } else {
+            const int remaining = AES_BLOCK_SIZE - session->initVector.size();
+            session->initVector.append(data.left(remaining));
+            input = data.mid(remaining);
+            if (session->initVector.size() < AES_BLOCK_SIZE) {
+                generatedData->clear();
+                return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+            }
+            if (!osslevp_aes_cipher_session_set_iv(session->evpCipherContext,
+                                                   (const unsigned char *)session->initVector.constData())) {
+                return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDecryptionError,
+                                                QLatin1String("OpenSSL crypto plugin failed to update the cipher session"));
+            }
+            session->initVectorPending = false;
+        }
+    }
+
+    // write directly into the output buffer, which is trimmed afterwards.
+    QByteArray output;
+    output.resize(input.size() + AES_BLOCK_SIZE);
+    const int size = osslevp_aes_cipher_session_update(session->evpCipherContext,
+                                                       (const unsigned char *)input.constData(),
+                                                       input.size(),
+                                                       (unsigned char *)output.data());
+    if (size < 0) {
+        return Sailfish::Crypto::Result(session->operation == Sailfish::Crypto::Key::Encrypt
+                                                ? Sailfish::Crypto::Result::CryptoPluginEncryptionError
+                                                : Sailfish::Crypto::Result::CryptoPluginDecryptionError,
+                                        QLatin1String("OpenSSL crypto plugin failed to update the cipher session"));
+    }
+
+    output.resize(size);
+    *generatedData = prefix.isEmpty() ? output : prefix + output;
+    return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+}
+
+Sailfish::Crypto::Result
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::finaliseCipherSession(
+        quint64 clientId,
+        quint32 cipherSessionToken,
+        QByteArray *generatedData)
+{
+    QSharedPointer<CipherSessionData> session;
+    {
+        QMutexLocker locker(&m_cipherSessionsMutex);
+        QMap<quint64, QMap<quint32, QSharedPointer<CipherSessionData> > >::iterator it = m_cipherSessions.find(clientId);
+        if (it != m_cipherSessions.end()) {
+            session = it->take(cipherSessionToken);
+            if (it->isEmpty()) {
+                m_cipherSessions.erase(it);
+            }
+        }
+    }
+
+    if (!session) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginInvalidCipherSessionToken,
+                                        QLatin1String("No such cipher session exists"));
+    }
+
+    QMutexLocker sessionLocker(&session->mutex);
+    if (session->closed) {
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginInvalidCipherSessionToken,
+                                        QLatin1String("The cipher session has been closed"));
+    }
+    session->closed = true;
+
+    if (session->evpDigestContext) {
+        QByteArray output;
+        output.resize(EVP_MAX_MD_SIZE);
+        const int size = osslevp_digest_session_final(session->evpDigestContext,
+                                                      session->operation == Sailfish::Crypto::Key::CalculateMac ? 1 : 0,
+                                                      (unsigned char *)output.data());
+        if (size <= 0) {
+            return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDigestError,
+                                            QLatin1String("OpenSSL crypto plugin failed to finalise the digest session"));
+        }
+        output.resize(size);
+        *generatedData = output;
+        return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
+    }
+
+    if (session->initVectorPending && session->operation == Sailfish::Crypto::Key::Decrypt) {
         return Sailfish::Crypto::Result(Sailfish::Crypto::Result::CryptoPluginDecryptionError,
-                                         QLatin1String("OpenSSL crypto plugin failed to decrypt the secret"));
+                                        QLatin1String("OpenSSL crypto plugin cannot decrypt truncated ciphertext"));
     }
 
-    // return result.
-    *decrypted = plaintext;
+    QByteArray output;
+    output.resize(AES_BLOCK_SIZE);
+    const int size = osslevp_aes_cipher_session_final(session->evpCipherContext, (unsigned char *)output.data());
+    if (size < 0) {
+        return Sailfish::Crypto::Result(session->operation == Sailfish::Crypto::Key::Encrypt
+                                                ? Sailfish::Crypto::Result::CryptoPluginEncryptionError
+                                                : Sailfish::Crypto::Result::CryptoPluginDecryptionError,
+                                        QLatin1String("OpenSSL crypto plugin failed to finalise the cipher session"));
+    }
+
+    output.resize(size);
+    *generatedData = session->initVectorPending ? session->initVector + output : output;
     return Sailfish::Crypto::Result(Sailfish::Crypto::Result::Succeeded);
 }
 
+void
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::closeCipherSessions(quint64 clientId)
+{
+    QMap<quint32, QSharedPointer<CipherSessionData> > sessions;
+    {
+        QMutexLocker locker(&m_cipherSessionsMutex);
+        sessions = m_cipherSessions.take(clientId);
+    }
+
+    // sessions in use by a worker thread are released once it is done with them.
+    Q_FOREACH (const QSharedPointer<CipherSessionData> &session, sessions) {
+        QMutexLocker sessionLocker(&session->mutex);
+        session->closed = true;
+    }
+}
+
+osslevp_cipher_context *
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::threadCipherContext(bool encrypt)
+{
+    if (!m_threadCipherContexts.hasLocalData()) {
+        m_threadCipherContexts.setLocalData(new ThreadCipherContexts);
+    }
+    ThreadCipherContexts *contexts = m_threadCipherContexts.localData();
+    return encrypt ? contexts->encryption : contexts->decryption;
+}
+
+bool
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::randomBytes(char *output, int size)
+{
+    if (size <= 0) {
+        return size == 0;
+    } else if (size > RandomBufferSize) {
+        // bulk requests are generated directly into the output.
+        return osslevp_random_bytes((unsigned char *)output, size) == 1;
+    }
+
+    if (!m_threadRandomBuffers.hasLocalData()) {
+        m_threadRandomBuffers.setLocalData(new ThreadRandomBuffer);
+    }
+    ThreadRandomBuffer *random = m_threadRandomBuffers.localData();
+
+    int copied = 0;
+    while (copied < size) {
+        if (random->offset == RandomBufferSize) {
+            if (random->generated >= RandomReseedInterval) {
+                if (!osslevp_random_reseed()) {
+                    return false;
+                }
+                random->generated = 0;
+            }
+            if (!osslevp_random_bytes(random->buffer, RandomBufferSize)) {
+                return false;
+            }
+            random->offset = 0;
+            random->generated += RandomBufferSize;
+        }
+
+        // handed out bytes are cleared, so that they cannot be read back from the buffer.
+        const int chunk = qMin(size - copied, RandomBufferSize - random->offset);
+        memcpy(output + copied, random->buffer + random->offset, chunk);
+        OPENSSL_cleanse(random->buffer + random->offset, chunk);
+        random->offset += chunk;
+        copied += chunk;
+    }
+    return true;
+}
+
+// CTR and GCM must never reuse an initialisation vector with the same key.
 QByteArray
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::randomInitVector(int size)
+{
+    QByteArray initVector(size, '\0');
+    if (!randomBytes(initVector.data(), initVector.size())) {
+        return QByteArray();
+    }
+    return initVector;
+}
+
+bool
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::aes_encrypt_plaintext(
+        const EVP_CIPHER *cipher,
         const QByteArray &plaintext,
         const QByteArray &key,
-        const QByteArray &init_vector)
+        const QByteArray &init_vector,
+        QByteArray *encrypted)
 {
-    QByteArray encryptedData;
-    unsigned char *encrypted = NULL;
-    int size = osslevp_aes_encrypt_plaintext((const unsigned char *)init_vector.constData(),
+    // write directly into the output buffer, which is trimmed afterwards.
+    const int offset = encrypted->size();
+    encrypted->resize(offset + plaintext.size() + AES_BLOCK_SIZE);
+    int size = osslevp_aes_encrypt_plaintext(threadCipherContext(true),
+                                             cipher,
+                                             (const unsigned char *)init_vector.constData(),
                                              (const unsigned char *)key.constData(),
                                              key.size(),
                                              (const unsigned char *)plaintext.constData(),
                                              plaintext.size(),
-                                             &encrypted);
-    if (size <= 0) {
-        return encryptedData;
-    }
-
-    encryptedData = QByteArray((const char *)encrypted, size);
-    free(encrypted);
-    return encryptedData;
+                                             (unsigned char *)encrypted->data() + offset);
+    encrypted->resize(offset + (size > 0 ? size : 0));
+    return size >= 0;
 }
 
-QByteArray
+bool
 Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::aes_decrypt_ciphertext(
+        const EVP_CIPHER *cipher,
         const QByteArray &ciphertext,
         const QByteArray &key,
-        const QByteArray &init_vector)
+        const QByteArray &init_vector,
+        QByteArray *decrypted)
 {
-    QByteArray decryptedData;
-    unsigned char *decrypted = NULL;
-    int size = osslevp_aes_decrypt_ciphertext((const unsigned char *)init_vector.constData(),
+    const int offset = decrypted->size();
+    decrypted->resize(offset + ciphertext.size() + AES_BLOCK_SIZE);
+    int size = osslevp_aes_decrypt_ciphertext(threadCipherContext(false),
+                                              cipher,
+                                              (const unsigned char *)init_vector.constData(),
                                               (const unsigned char *)key.constData(),
                                               key.size(),
                                               (const unsigned char *)ciphertext.constData(),
                                               ciphertext.size(),
-                                              &decrypted);
-    if (size <= 0) {
-        return decryptedData;
+                                              (unsigned char *)decrypted->data() + offset);
+    decrypted->resize(offset + (size > 0 ? size : 0));
+    return size >= 0;
+}
+
+bool
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::aes_gcm_encrypt_plaintext(
+        const EVP_CIPHER *cipher,
+        const QByteArray &plaintext,
+        const QByteArray &key,
+        const QByteArray &init_vector,
+        QByteArray *encrypted)
+{
+    // the tag is written directly after the ciphertext.
+    const int offset = encrypted->size();
+    encrypted->resize(offset + plaintext.size() + GcmTagSize);
+    unsigned char *output = (unsigned char *)encrypted->data() + offset;
+    int size = osslevp_aes_gcm_encrypt_plaintext(threadCipherContext(true),
+                                                 cipher,
+                                                 (const unsigned char *)init_vector.constData(),
+                                                 init_vector.size(),
+                                                 (const unsigned char *)key.constData(),
+                                                 key.size(),
+                                                 NULL,
+                                                 0,
+                                                 (const unsigned char *)plaintext.constData(),
+                                                 plaintext.size(),
+                                                 output,
+                                                 output + plaintext.size());
+    // GCM output is exactly as long as its input.
+    if (size != plaintext.size()) {
+        encrypted->resize(offset);
+        return false;
+    }
+    return true;
+}
+
+bool
+Sailfish::Crypto::Daemon::Plugins::OpenSslCryptoPlugin::aes_gcm_decrypt_ciphertext(
+        const EVP_CIPHER *cipher,
+        const QByteArray &ciphertext,
+        const QByteArray &key,
+        const QByteArray &init_vector,
+        QByteArray *decrypted)
+{
+    if (ciphertext.size() < GcmTagSize) {
+        return false;
     }
 
-    decryptedData = QByteArray((const char *)decrypted, size);
-    free(decrypted);
-    return decryptedData;
+    const int offset = decrypted->size();
+    const int ciphertextSize = ciphertext.size() - GcmTagSize;
+    decrypted->resize(offset + ciphertextSize);
+    int size = osslevp_aes_gcm_decrypt_ciphertext(threadCipherContext(false),
+                                                  cipher,
+                                                  (const unsigned char *)init_vector.constData(),
+                                                  init_vector.size(),
+                                                  (const unsigned char *)key.constData(),
+                                                  key.size(),
+                                                  NULL,
+                                                  0,
+                                                  (const unsigned char *)ciphertext.constData(),
+                                                  ciphertextSize,
+                                                  (const unsigned char *)ciphertext.constData() + ciphertextSize,
+                                                  (unsigned char *)decrypted->data() + offset);
+    decrypted->resize(offset + (size > 0 ? size : 0));
+    return size >= 0;
 }
@@ -10,9 +10,18 @@
 
 #include "Crypto/extensionplugins.h"
 
+#include <openssl/evp.h>
+
 #include <QObject>
 #include <QByteArray>
 #include <QCryptographicHash>
+#include <QMap>
+#include <QPair>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadStorage>
+
+struct osslevp_cipher_context;
 
 namespace Sailfish {
 
@@ -84,6 +93,7 @@ public:
 
     Sailfish::Crypto::Result verify(
             const QByteArray &data,
+            const QByteArray &signature,
             const Sailfish::Crypto::Key &key,
             Sailfish::Crypto::Key::SignaturePadding padding,
             Sailfish::Crypto::Key::Digest digest,
@@ -105,9 +115,81 @@ public:
             Sailfish::Crypto::Key::Digest digest,
             QByteArray *decrypted) Q_DECL_OVERRIDE;
 
+    Sailfish::Crypto::Result generateRandomData(
+            const QString &csprngEngineName,
+            quint64 numberBytes,
+            QByteArray *randomData) Q_DECL_OVERRIDE;
+
+    Sailfish::Crypto::Result generateDigest(
+            const QByteArray &data,
+            Sailfish::Crypto::Key::Digest digest,
+            QByteArray *digestValue) Q_DECL_OVERRIDE;
+
+    Sailfish::Crypto::Result calculateMac(
+            const QByteArray &data,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::Digest digest,
+            QByteArray *mac) Q_DECL_OVERRIDE;
+
+    Sailfish::Crypto::Result initialiseCipherSession(
+            quint64 clientId,
+            const Sailfish::Crypto::Key &key,
+            Sailfish::Crypto::Key::Operation operation,
+            Sailfish::Crypto::Key::BlockMode blockMode,
+            Sailfish::Crypto::Key::EncryptionPadding padding,
+            Sailfish::Crypto::Key::Digest digest,
+            quint32 *cipherSessionToken) Q_DECL_OVERRIDE;
+
+    Sailfish::Crypto::Result updateCipherSession(
+            quint64 clientId,
+            const QByteArray &data,
+            quint32 cipherSessionToken,
+            QByteArray *generatedData) Q_DECL_OVERRIDE;
+
+    Sailfish::Crypto::Result finaliseCipherSession(
+            quint64 clientId,
+            quint32 cipherSessionToken,
+            QByteArray *generatedData) Q_DECL_OVERRIDE;
+
+    void closeCipherSessions(quint64 clientId) Q_DECL_OVERRIDE;
+
 private:
-    QByteArray aes_encrypt_plaintext(const QByteArray &plaintext, const QByteArray &key, const QByteArray &init_vector);
-    QByteArray aes_decrypt_ciphertext(const QByteArray &ciphertext, const QByteArray &key, const QByteArray &init_vector);
+    struct CipherSessionData;
+    QSharedPointer<CipherSessionData> cipherSession(quint64 clientId, quint32 cipherSessionToken);
+    Sailfish::Crypto::Result insertCipherSession(quint64 clientId, const QSharedPointer<CipherSessionData> &session, quint32 *cipherSessionToken);
+
+    // append their output to the given buffer, which is left unchanged on failure.
+    bool aes_encrypt_plaintext(const EVP_CIPHER *cipher, const QByteArray &plaintext, const QByteArray &key, const QByteArray &init_vector, QByteArray *encrypted);
+    bool aes_decrypt_ciphertext(const EVP_CIPHER *cipher, const QByteArray &ciphertext, const QByteArray &key, const QByteArray &init_vector, QByteArray *decrypted);
+    bool aes_gcm_encrypt_plaintext(const EVP_CIPHER *cipher, const QByteArray &plaintext, const QByteArray &key, const QByteArray &init_vector, QByteArray *encrypted);
+    bool aes_gcm_decrypt_ciphertext(const EVP_CIPHER *cipher, const QByteArray &ciphertext, const QByteArray &key, const QByteArray &init_vector, QByteArray *decrypted);
+
+    // one-shot operations reuse a context (and key schedule) per worker thread.
+    struct ThreadCipherContexts;
+    osslevp_cipher_context *threadCipherContext(bool encrypt);
+    QThreadStorage<ThreadCipherContexts*> m_threadCipherContexts;
+
+    // small amounts of random data (such as initialisation vectors) are
+    // copied from a buffer per worker thread, which is refilled in blocks.
+    struct ThreadRandomBuffer;
+    bool randomBytes(char *output, int size);
+    QByteArray randomInitVector(int size);
+    QThreadStorage<ThreadRandomBuffer*> m_threadRandomBuffers;
+
+    // asymmetric keys are parsed once per identifier, and reparsed only if their data changes.
+    struct ParsedKey {
+        QByteArray encoded;
+        QSharedPointer<EVP_PKEY> pkey;
+    };
+    QSharedPointer<EVP_PKEY> parsedKey(const Sailfish::Crypto::Key &key, bool privateKey);
+    QMutex m_parsedKeysMutex;
+    QMap<QPair<QString, QString>, ParsedKey> m_parsedPrivateKeys;
+    QMap<QPair<QString, QString>, ParsedKey> m_parsedPublicKeys;
+
+    // cipher sessions may be used from several worker threads at once.
+    QMutex m_cipherSessionsMutex;
+    QMap<quint64, QMap<quint32, QSharedPointer<CipherSessionData> > > m_cipherSessions;
+    quint32 m_nextCipherSessionToken;
 };
 
 } // namespace Plugins
@@ -16,6 +16,10 @@
 #include <openssl/evp.h>
 #include <openssl/aes.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
+
+#define OSSLEVP_GCM_NONCE_LENGTH 12
+#define OSSLEVP_GCM_TAG_LENGTH 16
 
 #ifdef __cplusplus
 extern "C" {
@@ -237,6 +241,276 @@ int osslevp_aes_decrypt_ciphertext(const unsigned char *init_vector,
     return plaintext_length;
 }
 
+/*
+    int osslevp_aes_prepare_context(EVP_CIPHER_CTX *context,
+                                    int encrypt,
+                                    const unsigned char *init_vector,
+                                    const unsigned char *key,
+                                    int key_length)
+
+    Initialises the given \a context for AES-256-CBC encryption (if
+    \a encrypt is non-zero) or decryption with the given \a key and
+    16 byte \a init_vector, so that the key schedule can be reused by
+    osslevp_aes_crypt_with_context().  The key is padded as described for
+    osslevp_aes_encrypt_plaintext().  The caller must clean up the context
+    with EVP_CIPHER_CTX_cleanup().
+
+    Returns 1 on success, or 0 if the arguments are invalid or
+    initialisation otherwise fails.
+*/
+int osslevp_aes_prepare_context(EVP_CIPHER_CTX *context,
+                                int encrypt,
+                                const unsigned char *init_vector,
+                                const unsigned char *key,
+                                int key_length)
+{
+    unsigned char padded_key[32] = { 0 };
+    int result = 0;
+    int i = 0;
+
+    EVP_CIPHER_CTX_init(context);
+    if (init_vector == NULL || key_length <= 0 || key == NULL) {
+        fprintf(stderr, "%s\n", "invalid arguments, aborting context preparation");
+        return 0;
+    }
+
+    /* Create a 32-byte padded-key from the key */
+    for (i = 0; i < 32; ++i) {
+        padded_key[i] = i < key_length ? key[i] : '\0';
+    }
+
+    result = EVP_CipherInit_ex(context, EVP_aes_256_cbc(), NULL, padded_key, init_vector, encrypt ? 1 : 0);
+    OPENSSL_cleanse(padded_key, sizeof(padded_key));
+    if (!result) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to prepare cipher context");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+    int osslevp_aes_crypt_with_context(const EVP_CIPHER_CTX *prepared,
+                                       const unsigned char *input,
+                                       int input_length,
+                                       unsigned char **output)
+
+    Encrypts or decrypts (depending on how it was prepared by
+    osslevp_aes_prepare_context()) the \a input of the specified
+    \a input_length using a copy of the \a prepared context, which is
+    not modified and so may be shared between threads.
+    The result is stored in \a output, which the caller owns and must free().
+
+    Returns the length of the \a output on success, or -1 if the
+    arguments are invalid or the operation otherwise fails.
+*/
+int osslevp_aes_crypt_with_context(const EVP_CIPHER_CTX *prepared,
+                                   const unsigned char *input,
+                                   int input_length,
+                                   unsigned char **output)
+{
+    int output_length = input_length + AES_BLOCK_SIZE;
+    int update_length = 0;
+    int final_length = 0;
+    unsigned char *buffer = NULL;
+    EVP_CIPHER_CTX context;
+
+    if (prepared == NULL || input_length <= 0 || input == NULL || output == NULL) {
+        fprintf(stderr, "%s\n", "invalid arguments, aborting cipher operation");
+        return -1;
+    }
+
+    EVP_CIPHER_CTX_init(&context);
+    if (!EVP_CIPHER_CTX_copy(&context, prepared)) {
+        ERR_print_errors_fp(stderr);
+        EVP_CIPHER_CTX_cleanup(&context);
+        fprintf(stderr, "%s\n", "failed to copy prepared cipher context");
+        return -1;
+    }
+
+    buffer = (unsigned char *)malloc(output_length);
+    memset(buffer, 0, output_length);
+
+    if (!EVP_CipherUpdate(&context, buffer, &update_length, input, input_length)
+            || !EVP_CipherFinal_ex(&context, buffer+update_length, &final_length)) {
+        ERR_print_errors_fp(stderr);
+        EVP_CIPHER_CTX_cleanup(&context);
+        free(buffer);
+        fprintf(stderr, "%s\n", "failed to process cipher data");
+        return -1;
+    }
+
+    *output = buffer;
+    EVP_CIPHER_CTX_cleanup(&context);
+    return update_length + final_length;
+}
+
+/*
+    int osslevp_aes_gcm_prepare_context(EVP_CIPHER_CTX *context,
+                                        int encrypt,
+                                        const unsigned char *key,
+                                        int key_length)
+
+    Initialises the given \a context for AES-256-GCM encryption (if
+    \a encrypt is non-zero) or decryption with the given \a key, padded as
+    described for osslevp_aes_encrypt_plaintext().  No nonce is set; one is
+    supplied for each operation by osslevp_aes_gcm_encrypt_with_context()
+    or osslevp_aes_gcm_decrypt_with_context().  EVP selects the AES-NI and
+    PCLMULQDQ implementations automatically where the CPU supports them.
+    The caller must clean up the context with EVP_CIPHER_CTX_cleanup().
+
+    Returns 1 on success, or 0 if the arguments are invalid or
+    initialisation otherwise fails.
+*/
+int osslevp_aes_gcm_prepare_context(EVP_CIPHER_CTX *context,
+                                    int encrypt,
+                                    const unsigned char *key,
+                                    int key_length)
+{
+    unsigned char padded_key[32] = { 0 };
+    int result = 0;
+    int i = 0;
+
+    EVP_CIPHER_CTX_init(context);
+    if (key_length <= 0 || key == NULL) {
+        fprintf(stderr, "%s\n", "invalid arguments, aborting context preparation");
+        return 0;
+    }
+
+    /* Create a 32-byte padded-key from the key */
+    for (i = 0; i < 32; ++i) {
+        padded_key[i] = i < key_length ? key[i] : '\0';
+    }
+
+    result = EVP_CipherInit_ex(context, EVP_aes_256_gcm(), NULL, NULL, NULL, encrypt ? 1 : 0)
+          && EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_IVLEN, OSSLEVP_GCM_NONCE_LENGTH, NULL)
+          && EVP_CipherInit_ex(context, NULL, NULL, padded_key, NULL, -1);
+    OPENSSL_cleanse(padded_key, sizeof(padded_key));
+    if (!result) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "%s\n", "failed to prepare gcm cipher context");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+    int osslevp_aes_gcm_encrypt_with_context(const EVP_CIPHER_CTX *prepared,
+                                             const unsigned char *plaintext,
+                                             int plaintext_length,
+                                             unsigned char **encrypted)
+
+    Encrypts the \a plaintext of the specified \a plaintext_length with a
+    copy of the \a prepared context and a new random nonce.  The result,
+    stored in \a encrypted, is the nonce followed by the ciphertext followed
+    by the authentication tag.  The caller owns the content of the
+    \a encrypted buffer and must free().
+
+    Returns the length of the \a encrypted output on success, or -1 if the
+    arguments are invalid or encryption otherwise fails.
+*/
+int osslevp_aes_gcm_encrypt_with_context(const EVP_CIPHER_CTX *prepared,
+                                         const unsigned char *plaintext,
+                                         int plaintext_length,
+                                         unsigned char **encrypted)
+{
+    int encrypted_length = OSSLEVP_GCM_NONCE_LENGTH + plaintext_length + OSSLEVP_GCM_TAG_LENGTH;
+    int update_length = 0;
+    int final_length = 0;
+    unsigned char *buffer = NULL;
+    EVP_CIPHER_CTX context;
+
+    if (prepared == NULL || plaintext_length <= 0 || plaintext == NULL || encrypted == NULL) {
+        fprintf(stderr, "%s\n", "invalid arguments, aborting encryption");
+        return -1;
+    }
+
+    buffer = (unsigned char *)malloc(encrypted_length);
+    memset(buffer, 0, encrypted_length);
+    if (RAND_bytes(buffer, OSSLEVP_GCM_NONCE_LENGTH) != 1) {
+        ERR_print_errors_fp(stderr);
+        free(buffer);
+        fprintf(stderr, "%s\n", "failed to generate nonce");
+        return -1;
+    }
+
+    EVP_CIPHER_CTX_init(&context);
+    if (!EVP_CIPHER_CTX_copy(&context, prepared)
+            || !EVP_EncryptInit_ex(&context, NULL, NULL, NULL, buffer)
+            || !EVP_EncryptUpdate(&context, buffer + OSSLEVP_GCM_NONCE_LENGTH, &update_length,
+                                  plaintext, plaintext_length)
+            || !EVP_EncryptFinal_ex(&context, buffer + OSSLEVP_GCM_NONCE_LENGTH + update_length, &final_length)
+            || !EVP_CIPHER_CTX_ctrl(&context, EVP_CTRL_GCM_GET_TAG, OSSLEVP_GCM_TAG_LENGTH,
+                                    buffer + OSSLEVP_GCM_NONCE_LENGTH + update_length + final_length)) {
+        ERR_print_errors_fp(stderr);
+        EVP_CIPHER_CTX_cleanup(&context);
+        free(buffer);
+        fprintf(stderr, "%s\n", "failed to encrypt with gcm context");
+        return -1;
+    }
+
+    *encrypted = buffer;
+    EVP_CIPHER_CTX_cleanup(&context);
+    return OSSLEVP_GCM_NONCE_LENGTH + update_length + final_length + OSSLEVP_GCM_TAG_LENGTH;
+}
+
+/*
+    int osslevp_aes_gcm_decrypt_with_context(const EVP_CIPHER_CTX *prepared,
+                                             const unsigned char *encrypted,
+                                             int encrypted_length,
+                                             unsigned char **decrypted)
+
+    Decrypts and authenticates the \a encrypted data of the specified
+    \a encrypted_length, as produced by osslevp_aes_gcm_encrypt_with_context(),
+    with a copy of the \a prepared context.  The result is stored in
+    \a decrypted, which the caller owns and must free().
+
+    Returns the length of the \a decrypted output on success, or -1 if the
+    arguments are invalid, the data has been modified, or decryption
+    otherwise fails.
+*/
+int osslevp_aes_gcm_decrypt_with_context(const EVP_CIPHER_CTX *prepared,
+                                         const unsigned char *encrypted,
+                                         int encrypted_length,
+                                         unsigned char **decrypted)
+{
+    int ciphertext_length = encrypted_length - OSSLEVP_GCM_NONCE_LENGTH - OSSLEVP_GCM_TAG_LENGTH;
+    int update_length = 0;
+    int final_length = 0;
+    unsigned char tag[OSSLEVP_GCM_TAG_LENGTH];
+    unsigned char *plaintext = NULL;
+    EVP_CIPHER_CTX context;
+
+    if (prepared == NULL || ciphertext_length <= 0 || encrypted == NULL || decrypted == NULL) {
+        fprintf(stderr, "%s\n", "invalid arguments, aborting decryption");
+        return -1;
+    }
+
+    memcpy(tag, encrypted + OSSLEVP_GCM_NONCE_LENGTH + ciphertext_length, OSSLEVP_GCM_TAG_LENGTH);
+    plaintext = (unsigned char *)malloc(ciphertext_length + AES_BLOCK_SIZE);
+    memset(plaintext, 0, ciphertext_length + AES_BLOCK_SIZE);
+
+    EVP_CIPHER_CTX_init(&context);
+    if (!EVP_CIPHER_CTX_copy(&context, prepared)
+            || !EVP_DecryptInit_ex(&context, NULL, NULL, NULL, encrypted)
+            || !EVP_DecryptUpdate(&context, plaintext, &update_length,
+                                  encrypted + OSSLEVP_GCM_NONCE_LENGTH, ciphertext_length)
+            || !EVP_CIPHER_CTX_ctrl(&context, EVP_CTRL_GCM_SET_TAG, OSSLEVP_GCM_TAG_LENGTH, tag)
+            || EVP_DecryptFinal_ex(&context, plaintext + update_length, &final_length) <= 0) {
+        /* authentication failure is expected when probing legacy data, so don't report it */
+        EVP_CIPHER_CTX_cleanup(&context);
+        OPENSSL_cleanse(plaintext, ciphertext_length + AES_BLOCK_SIZE);
+        free(plaintext);
+        return -1;
+    }
+
+    *decrypted = plaintext;
+    EVP_CIPHER_CTX_cleanup(&context);
+    return update_length + final_length;
+}
+
 #ifdef __cplusplus
 }
 #endif
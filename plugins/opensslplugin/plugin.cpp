@@ -10,6 +10,77 @@
 
 Q_PLUGIN_METADATA(IID Sailfish_Secrets_EncryptionPlugin_IID)
 
+namespace {
+    // bounds the number of keys prepared at once, in case keys are not released.
+    const int MaxPreparedKeys = 32;
+
+    // AES-256-GCM secrets are stored as: magic, nonce, ciphertext, tag.
+    // Secrets without the magic were encrypted with AES-256-CBC and a key-derived IV,
+    // and remain readable until they are re-encrypted.
+    const char GcmMagic[] = { 'S', 'G', 'C', 'M' };
+    const int GcmMagicLength = sizeof(GcmMagic);
+
+    // prepared keys are looked up by a fingerprint, so that the cache never holds a copy of a key.
+    QByteArray keyFingerprint(const QByteArray &key)
+    {
+        QCryptographicHash fingerprint(QCryptographicHash::Sha256);
+        fingerprint.addData(QByteArrayLiteral("sailfish-secrets-openssl-prepared-key"));
+        fingerprint.addData(key);
+        return fingerprint.result();
+    }
+
+    bool hasGcmMagic(const QByteArray &encrypted)
+    {
+        return encrypted.size() > GcmMagicLength + OSSLEVP_GCM_NONCE_LENGTH + OSSLEVP_GCM_TAG_LENGTH
+                && memcmp(encrypted.constData(), GcmMagic, GcmMagicLength) == 0;
+    }
+
+    typedef int (*ContextFunction)(const EVP_CIPHER_CTX *, const unsigned char *, int, unsigned char **);
+
+    QByteArray cryptWithContext(ContextFunction function,
+                                const EVP_CIPHER_CTX *context,
+                                const char *input,
+                                int inputLength)
+    {
+        QByteArray outputData;
+        unsigned char *output = NULL;
+        int size = (*function)(context, (const unsigned char *)input, inputLength, &output);
+        if (size <= 0) {
+            return outputData;
+        }
+
+        outputData = QByteArray((const char *)output, size);
+        OPENSSL_cleanse(output, size);
+        free(output);
+        return outputData;
+    }
+}
+
+struct Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::PreparedKey
+{
+    PreparedKey() : valid(false)
+    {
+        EVP_CIPHER_CTX_init(&gcmEncryptionContext);
+        EVP_CIPHER_CTX_init(&gcmDecryptionContext);
+        EVP_CIPHER_CTX_init(&cbcDecryptionContext);
+    }
+    ~PreparedKey()
+    {
+        // runs once the entry has been evicted or released, and no operation still uses it.
+        EVP_CIPHER_CTX_cleanup(&gcmEncryptionContext);
+        EVP_CIPHER_CTX_cleanup(&gcmDecryptionContext);
+        EVP_CIPHER_CTX_cleanup(&cbcDecryptionContext);
+        OPENSSL_cleanse(&gcmEncryptionContext, sizeof(gcmEncryptionContext));
+        OPENSSL_cleanse(&gcmDecryptionContext, sizeof(gcmDecryptionContext));
+        OPENSSL_cleanse(&cbcDecryptionContext, sizeof(cbcDecryptionContext));
+    }
+
+    EVP_CIPHER_CTX gcmEncryptionContext;
+    EVP_CIPHER_CTX gcmDecryptionContext;
+    EVP_CIPHER_CTX cbcDecryptionContext; // for secrets which have not yet been re-encrypted
+    bool valid;
+};
+
 Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::OpenSslPlugin(QObject *parent)
     : Sailfish::Secrets::EncryptionPlugin(parent)
 {
@@ -18,19 +89,28 @@ Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::OpenSslPlugin(QObject *parent
 
 Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::~OpenSslPlugin()
 {
+    QMutexLocker locker(&m_preparedKeysMutex);
+    m_preparedKeys.clear();
 }
 
-Sailfish::Secrets::Result
-Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::encryptSecret(
-        const QByteArray &plaintext,
-        const QByteArray &key,
-        QByteArray *encrypted)
+QSharedPointer<Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::PreparedKey>
+Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::preparedKey(const QByteArray &key)
 {
+    const QByteArray fingerprint = keyFingerprint(key);
+    {
+        QMutexLocker locker(&m_preparedKeysMutex);
+        QSharedPointer<PreparedKey> prepared = m_preparedKeys.value(fingerprint);
+        if (prepared) {
+            return prepared;
+        }
+    }
+
     // generate initialisation vector and key hash
     QCryptographicHash keyHash(QCryptographicHash::Sha512);
     keyHash.addData(key);
     QCryptographicHash ivHash(QCryptographicHash::Sha256);
     ivHash.addData(key);
+    QByteArray derivedKey = keyHash.result();
     QByteArray initVector = ivHash.result();
     if (initVector.size() > 16) {
         initVector.chop(initVector.size() - 16);
@@ -38,12 +118,54 @@ Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::encryptSecret(
         initVector.append('\0');
     }
 
+    QSharedPointer<PreparedKey> prepared(new PreparedKey);
+    prepared->valid = osslevp_aes_gcm_prepare_context(&prepared->gcmEncryptionContext, 1,
+                                                      (const unsigned char *)derivedKey.constData(),
+                                                      derivedKey.size())
+                   && osslevp_aes_gcm_prepare_context(&prepared->gcmDecryptionContext, 0,
+                                                      (const unsigned char *)derivedKey.constData(),
+                                                      derivedKey.size())
+                   && osslevp_aes_prepare_context(&prepared->cbcDecryptionContext, 0,
+                                                  (const unsigned char *)initVector.constData(),
+                                                  (const unsigned char *)derivedKey.constData(),
+                                                  derivedKey.size());
+    derivedKey.fill('\0');
+    if (!prepared->valid) {
+        return QSharedPointer<PreparedKey>();
+    }
+
+    QMutexLocker locker(&m_preparedKeysMutex);
+    if (m_preparedKeys.size() >= MaxPreparedKeys) {
+        m_preparedKeys.clear();
+    }
+    m_preparedKeys.insert(fingerprint, prepared);
+    return prepared;
+}
+
+void
+Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::releaseKey(const QByteArray &key)
+{
+    const QByteArray fingerprint = keyFingerprint(key);
+    QMutexLocker locker(&m_preparedKeysMutex);
+    m_preparedKeys.remove(fingerprint);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::encryptSecret(
+        const QByteArray &plaintext,
+        const QByteArray &key,
+        QByteArray *encrypted)
+{
     // encrypt plaintext
-    QByteArray ciphertext = aes_encrypt_plaintext(plaintext, keyHash.result(), initVector);
+    QSharedPointer<PreparedKey> prepared = preparedKey(key);
+    QByteArray ciphertext = prepared
+            ? cryptWithContext(&osslevp_aes_gcm_encrypt_with_context, &prepared->gcmEncryptionContext,
+                               plaintext.constData(), plaintext.size())
+            : QByteArray();
 
     // return result.
     if (ciphertext.size()) {
-        *encrypted = ciphertext;
+        *encrypted = QByteArray(GcmMagic, GcmMagicLength) + ciphertext;
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
     }
 
@@ -57,20 +179,22 @@ Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::decryptSecret(
         const QByteArray &key,
         QByteArray *plaintext)
 {
-    // generate initialisation vector and key hash
-    QCryptographicHash keyHash(QCryptographicHash::Sha512);
-    keyHash.addData(key);
-    QCryptographicHash ivHash(QCryptographicHash::Sha256);
-    ivHash.addData(key);
-    QByteArray initVector = ivHash.result();
-    if (initVector.size() > 16) {
-        initVector.chop(initVector.size() - 16);
-    } else while (initVector.size() < 16) {
-        initVector.append('\0');
-    }
-
     // decrypt ciphertext
-    QByteArray decrypted = aes_decrypt_ciphertext(encrypted, keyHash.result(), initVector);
+    QSharedPointer<PreparedKey> prepared = preparedKey(key);
+    QByteArray decrypted;
+    if (prepared && hasGcmMagic(encrypted)) {
+        // a GCM secret which fails authentication has been tampered with, or the key is wrong.
+        // Never retry it as a legacy CBC secret.
+        decrypted = cryptWithContext(&osslevp_aes_gcm_decrypt_with_context, &prepared->gcmDecryptionContext,
+                                     encrypted.constData() + GcmMagicLength, encrypted.size() - GcmMagicLength);
+        if (decrypted.isEmpty()) {
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
+                                             QLatin1String("OpenSSL plugin failed to authenticate the secret"));
+        }
+    } else if (prepared && encrypted.size() % AES_BLOCK_SIZE == 0) {
+        decrypted = cryptWithContext(&osslevp_aes_crypt_with_context, &prepared->cbcDecryptionContext,
+                                     encrypted.constData(), encrypted.size());
+    }
     if (!decrypted.size() || (decrypted.size() == 1 && decrypted.at(0) == 0)) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginDecryptionError,
                                          QLatin1String("OpenSSL plugin failed to decrypt the secret"));
@@ -80,49 +204,3 @@ Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::decryptSecret(
     *plaintext = decrypted;
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
-
-QByteArray
-Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::aes_encrypt_plaintext(
-        const QByteArray &plaintext,
-        const QByteArray &key,
-        const QByteArray &init_vector)
-{
-    QByteArray encryptedData;
-    unsigned char *encrypted = NULL;
-    int size = osslevp_aes_encrypt_plaintext((const unsigned char *)init_vector.constData(),
-                                             (const unsigned char *)key.constData(),
-                                             key.size(),
-                                             (const unsigned char *)plaintext.constData(),
-                                             plaintext.size(),
-                                             &encrypted);
-    if (size <= 0) {
-        return encryptedData;
-    }
-
-    encryptedData = QByteArray((const char *)encrypted, size);
-    free(encrypted);
-    return encryptedData;
-}
-
-QByteArray
-Sailfish::Secrets::Daemon::Plugins::OpenSslPlugin::aes_decrypt_ciphertext(
-        const QByteArray &ciphertext,
-        const QByteArray &key,
-        const QByteArray &init_vector)
-{
-    QByteArray decryptedData;
-    unsigned char *decrypted = NULL;
-    int size = osslevp_aes_decrypt_ciphertext((const unsigned char *)init_vector.constData(),
-                                              (const unsigned char *)key.constData(),
-                                              key.size(),
-                                              (const unsigned char *)ciphertext.constData(),
-                                              ciphertext.size(),
-                                              &decrypted);
-    if (size <= 0) {
-        return decryptedData;
-    }
-
-    decryptedData = QByteArray((const char *)decrypted, size);
-    free(decrypted);
-    return decryptedData;
-}
@@ -13,6 +13,9 @@
 #include <QObject>
 #include <QByteArray>
 #include <QCryptographicHash>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
 
 namespace Sailfish {
 
@@ -42,14 +45,20 @@ public:
     QString name() const Q_DECL_OVERRIDE { return QLatin1String("org.sailfishos.secrets.plugin.encryption.openssl"); }
 
     Sailfish::Secrets::EncryptionPlugin::EncryptionType encryptionType() const Q_DECL_OVERRIDE { return Sailfish::Secrets::EncryptionPlugin::SoftwareEncryption; }
-    Sailfish::Secrets::EncryptionPlugin::EncryptionAlgorithm encryptionAlgorithm() const Q_DECL_OVERRIDE { return Sailfish::Secrets::EncryptionPlugin::AES_256_CBC; }
+    Sailfish::Secrets::EncryptionPlugin::EncryptionAlgorithm encryptionAlgorithm() const Q_DECL_OVERRIDE { return Sailfish::Secrets::EncryptionPlugin::AES_256_GCM; }
 
     Sailfish::Secrets::Result encryptSecret(const QByteArray &plaintext, const QByteArray &key, QByteArray *encrypted) Q_DECL_OVERRIDE;
     Sailfish::Secrets::Result decryptSecret(const QByteArray &encrypted, const QByteArray &key, QByteArray *plaintext) Q_DECL_OVERRIDE;
+    void releaseKey(const QByteArray &key) Q_DECL_OVERRIDE;
 
 private:
-    QByteArray aes_encrypt_plaintext(const QByteArray &plaintext, const QByteArray &key, const QByteArray &init_vector);
-    QByteArray aes_decrypt_ciphertext(const QByteArray &ciphertext, const QByteArray &key, const QByteArray &init_vector);
+    // The derived key (and legacy CBC initialisation vector), expanded into
+    // prepared encryption and decryption contexts which are copied for each operation.
+    struct PreparedKey;
+    QSharedPointer<PreparedKey> preparedKey(const QByteArray &key);
+
+    QMutex m_preparedKeysMutex;
+    QHash<QByteArray, QSharedPointer<PreparedKey> > m_preparedKeys; // keyed by fingerprint, not by key
 };
 
 } // namespace Plugins
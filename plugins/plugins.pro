@@ -1,7 +1,9 @@
 TEMPLATE=subdirs
 
 STORAGE_PLUGINS = \
-    sqliteplugin
+    sqliteplugin \
+    inmemoryplugin \
+    logstoreplugin
 
 ENCRYPTION_PLUGINS = \
     opensslplugin
@@ -7,4 +7,917 @@
 
 #include "plugin.h"
 
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QStandardPaths>
+
+#include <QtSql/QSqlError>
+
 Q_PLUGIN_METADATA(IID Sailfish_Secrets_EncryptedStoragePlugin_IID)
+
+Q_LOGGING_CATEGORY(lcSailfishSecretsPluginSqlCipher, "org.sailfishos.secrets.plugin.encryptedstorage.sqlcipher")
+
+namespace {
+    // the QtSql driver which is built against SQLCipher rather than SQLite.
+    // all connections (including the unencrypted metadata database) use it,
+    // so that only one sqlite library is ever loaded into the process.
+    const char *DriverName = "QSQLCIPHER";
+
+    // the defaults may be overridden via the environment.
+    const int DefaultKdfIterations = 64000;
+    const int DefaultCacheKBytes = 2048;
+
+    int configuredValue(const char *environmentVariable, int defaultValue)
+    {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue(environmentVariable, &ok);
+        return ok && value > 0 ? value : defaultValue;
+    }
+
+    bool execute(QSqlDatabase &database, const QString &statement)
+    {
+        QSqlQuery query(database);
+        if (!query.exec(statement)) {
+            qCWarning(lcSailfishSecretsPluginSqlCipher) << "Query failed:" << query.lastError().text();
+            return false;
+        }
+        return true;
+    }
+
+    // collection (and standalone secret) names are not used directly in file names.
+    QString databaseName(const QString &collectionName, const QString &secretName = QString())
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        hash.addData(collectionName.toUtf8());
+        if (!secretName.isEmpty()) {
+            hash.addData("/", 1);
+            hash.addData(secretName.toUtf8());
+        }
+        return QString::fromLatin1(hash.result().toHex());
+    }
+
+    // the key is given to SQLCipher as a hex-encoded passphrase, so that it
+    // can be quoted safely.  SQLCipher derives the page key from it via PBKDF2.
+    QString keyPragma(const char *pragma, const QByteArray &key)
+    {
+        return QString::fromLatin1("PRAGMA %1 = '%2';").arg(QLatin1String(pragma), QLatin1String(key.toHex()));
+    }
+
+    bool isStandalone(const QString &collectionName)
+    {
+        return collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0;
+    }
+}
+
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::SqlCipherPlugin(QObject *parent)
+    : Sailfish::Secrets::EncryptedStoragePlugin(parent)
+    , m_kdfIterations(configuredValue("SAILFISH_SECRETSD_SQLCIPHER_KDF_ITERATIONS", DefaultKdfIterations))
+    , m_cacheKBytes(configuredValue("SAILFISH_SECRETSD_SQLCIPHER_CACHE_KBYTES", DefaultCacheKBytes))
+    , m_connectionCount(0)
+{
+    const QString systemDataDirPath(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/system/");
+    const QString privilegedDataDirPath(systemDataDirPath + QLatin1String("privileged") + "/");
+
+    QString databaseSubdir(QLatin1String("Secrets/sqlcipherplugin"));
+    if (isTestPlugin()) {
+        databaseSubdir.append(QLatin1String("-test"));
+    }
+
+    m_databaseDirPath = privilegedDataDirPath + databaseSubdir;
+    QDir databaseDir(m_databaseDirPath);
+    if (!databaseDir.mkpath(m_databaseDirPath)) {
+        qCWarning(lcSailfishSecretsPluginSqlCipher) << "Permissions error: unable to create database directory:" << m_databaseDirPath;
+        return;
+    }
+
+    if (!QSqlDatabase::isDriverAvailable(QLatin1String(DriverName))) {
+        qCWarning(lcSailfishSecretsPluginSqlCipher) << "Secrets sqlcipher plugin: driver not available:" << DriverName;
+        return;
+    }
+
+    m_metadata = QSqlDatabase::addDatabase(QLatin1String(DriverName), QLatin1String("sqlcipherplugin-metadata"));
+    m_metadata.setDatabaseName(databaseDir.absoluteFilePath(QLatin1String("metadata.db")));
+    if (!m_metadata.open()) {
+        qCWarning(lcSailfishSecretsPluginSqlCipher) << "Secrets sqlcipher plugin: failed to open metadata database:" << m_metadata.lastError().text();
+        return;
+    }
+
+    if (!execute(m_metadata, QLatin1String("PRAGMA journal_mode = WAL;"))
+            || !execute(m_metadata, QLatin1String(
+                    "CREATE TABLE IF NOT EXISTS Databases ("
+                    "   DatabaseName TEXT NOT NULL,"
+                    "   KdfIterations INTEGER NOT NULL,"
+                    "   PRIMARY KEY (DatabaseName)) WITHOUT ROWID;"))) {
+        qCWarning(lcSailfishSecretsPluginSqlCipher) << "Secrets sqlcipher plugin: failed to prepare metadata database";
+        m_metadata.close();
+    }
+}
+
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::~SqlCipherPlugin()
+{
+    for (OpenDatabase *db : m_unlockedCollections) {
+        closeDatabase(db);
+        delete db;
+    }
+    m_unlockedCollections.clear();
+
+    if (m_metadata.isValid()) {
+        m_metadata.close();
+        m_metadata = QSqlDatabase();
+        QSqlDatabase::removeDatabase(QLatin1String("sqlcipherplugin-metadata"));
+    }
+}
+
+QString
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::databaseFile(
+        const QString &databaseName) const
+{
+    return QDir(m_databaseDirPath).absoluteFilePath(databaseName + QLatin1String(".db"));
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::lookupDatabase(
+        const QString &databaseName,
+        int *kdfIterations,
+        bool *found)
+{
+    if (!m_metadata.isOpen()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QLatin1String("Sqlcipher plugin metadata database is not open"));
+    }
+
+    QSqlQuery sq(m_metadata);
+    sq.prepare(QLatin1String("SELECT KdfIterations FROM Databases WHERE DatabaseName = ?;"));
+    sq.addBindValue(QVariant::fromValue<QString>(databaseName));
+    if (!sq.exec()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to execute select database query: %1").arg(sq.lastError().text()));
+    }
+
+    *found = sq.next();
+    *kdfIterations = *found ? sq.value(0).value<int>() : 0;
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::insertDatabase(
+        const QString &databaseName,
+        int kdfIterations)
+{
+    QSqlQuery iq(m_metadata);
+    iq.prepare(QLatin1String("INSERT OR REPLACE INTO Databases (DatabaseName, KdfIterations) VALUES (?,?);"));
+    iq.addBindValue(QVariant::fromValue<QString>(databaseName));
+    iq.addBindValue(QVariant::fromValue<int>(kdfIterations));
+    if (!iq.exec()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to execute insert database query: %1").arg(iq.lastError().text()));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// Removes the metadata of the database before its files, so that a partially
+// removed database is never mistaken for a valid one.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::deleteDatabase(
+        const QString &databaseName)
+{
+    QSqlQuery dq(m_metadata);
+    dq.prepare(QLatin1String("DELETE FROM Databases WHERE DatabaseName = ?;"));
+    dq.addBindValue(QVariant::fromValue<QString>(databaseName));
+    if (!dq.exec()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to execute delete database query: %1").arg(dq.lastError().text()));
+    }
+
+    const QString file = databaseFile(databaseName);
+    QFile::remove(file + QLatin1String("-journal"));
+    if (QFile::exists(file) && !QFile::remove(file)) {
+        qCWarning(lcSailfishSecretsPluginSqlCipher) << "Unable to remove database file:" << file;
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::openDatabase(
+        const QString &databaseName,
+        const QByteArray &key,
+        int kdfIterations,
+        bool create,
+        Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *db)
+{
+    if (key.isEmpty()) {
+        // SQLCipher would leave the database unencrypted.
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginEncryptionError,
+                                         QLatin1String("Empty key given"));
+    }
+
+    const QString file = databaseFile(databaseName);
+    if (!create && !QFile::exists(file)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin database file does not exist: %1").arg(databaseName));
+    }
+
+    db->connectionName = QString::fromLatin1("sqlcipherplugin-%1").arg(++m_connectionCount);
+    db->database = QSqlDatabase::addDatabase(QLatin1String(DriverName), db->connectionName);
+    db->database.setDatabaseName(file);
+    if (!db->database.open()) {
+        const QString errorText = db->database.lastError().text();
+        closeDatabase(db);
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to open database: %1").arg(errorText));
+    }
+
+    // the key and KDF parameters must be given before the first access.
+    // a warm page cache holds decrypted pages, so reads from an unlocked
+    // collection don't need to decrypt (or even read) anything.
+    if (!execute(db->database, keyPragma("key", key))
+            || !execute(db->database, QString::fromLatin1("PRAGMA kdf_iter = %1;").arg(kdfIterations))
+            || !execute(db->database, QString::fromLatin1("PRAGMA cache_size = -%1;").arg(m_cacheKBytes))
+            || !execute(db->database, QLatin1String("PRAGMA temp_store = MEMORY;"))) {
+        closeDatabase(db);
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QLatin1String("Sqlcipher plugin unable to configure database"));
+    }
+
+    // reading the schema fails if the key is incorrect.
+    bool decrypted = false;
+    {
+        QSqlQuery vq(db->database);
+        decrypted = vq.exec(QLatin1String("SELECT Count(*) FROM sqlite_master;")) && vq.next();
+    }
+    if (!decrypted) {
+        closeDatabase(db);
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::IncorrectAuthenticationKeyError,
+                                         QLatin1String("Sqlcipher plugin unable to decrypt database with the given key"));
+    }
+
+    if (create && !execute(db->database, QLatin1String(
+                "CREATE TABLE IF NOT EXISTS Secrets ("
+                "   SecretName TEXT NOT NULL,"
+                "   Secret BLOB,"
+                "   Timestamp DATE,"
+                "   PRIMARY KEY (SecretName)) WITHOUT ROWID;"))) {
+        closeDatabase(db);
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QLatin1String("Sqlcipher plugin unable to create secrets table"));
+    }
+
+    db->selectSecretQuery = QSqlQuery(db->database);
+    if (!db->selectSecretQuery.prepare(QLatin1String("SELECT Secret FROM Secrets WHERE SecretName = ?;"))) {
+        const QString errorText = db->selectSecretQuery.lastError().text();
+        closeDatabase(db);
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to prepare select secret query: %1").arg(errorText));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+void
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::closeDatabase(
+        Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *db)
+{
+    if (db->connectionName.isEmpty()) {
+        return;
+    }
+
+    // the connection can only be removed once no queries refer to it.
+    db->selectSecretQuery = QSqlQuery();
+    db->database.close();
+    db->database = QSqlDatabase();
+    QSqlDatabase::removeDatabase(db->connectionName);
+    db->connectionName.clear();
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::writeSecrets(
+        Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *db,
+        const QMap<QString, QByteArray> &secrets)
+{
+    QVariantList names, values;
+    for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); ++it) {
+        names.append(QVariant::fromValue<QString>(it.key()));
+        values.append(QVariant::fromValue<QByteArray>(it.value()));
+    }
+
+    QSqlQuery iq(db->database);
+    if (!iq.prepare(QLatin1String(
+                "INSERT OR REPLACE INTO Secrets (SecretName, Secret, Timestamp)"
+                " VALUES (?, ?, date('now'));"))) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to prepare insert secret query: %1").arg(iq.lastError().text()));
+    }
+    iq.addBindValue(names);
+    iq.addBindValue(values);
+
+    if (!db->database.transaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Sqlcipher plugin unable to begin transaction"));
+    }
+
+    if (!iq.execBatch()) {
+        const QString errorText = iq.lastError().text();
+        db->database.rollback();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to execute insert secret query: %1").arg(errorText));
+    }
+
+    if (!db->database.commit()) {
+        db->database.rollback();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Sqlcipher plugin unable to commit insert secret transaction"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::readSecret(
+        Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *db,
+        const QString &secretName,
+        QByteArray *secret,
+        bool *found)
+{
+    QSqlQuery &sq(db->selectSecretQuery);
+    sq.addBindValue(QVariant::fromValue<QString>(secretName));
+    if (!sq.exec()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to execute select secret query: %1").arg(sq.lastError().text()));
+    }
+
+    *found = sq.next();
+    if (*found) {
+        *secret = sq.value(0).value<QByteArray>();
+    }
+    sq.finish();
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::createCollection(
+        const QString &collectionName,
+        const QByteArray &key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    } else if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Reserved collection name given"));
+    }
+
+    const QString name = databaseName(collectionName);
+    int kdfIterations = 0;
+    bool found = false;
+    Sailfish::Secrets::Result result = lookupDatabase(name, &kdfIterations, &found);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    } else if (found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionAlreadyExistsError,
+                                         QString::fromUtf8("Collection already exists: %1").arg(collectionName));
+    }
+
+    // remove any file left behind by a previously failed creation.
+    QFile::remove(databaseFile(name));
+
+    OpenDatabase *db = new OpenDatabase;
+    result = openDatabase(name, key, m_kdfIterations, true, db);
+    if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+        result = insertDatabase(name, m_kdfIterations);
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            closeDatabase(db);
+            QFile::remove(databaseFile(name));
+        }
+    }
+
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        delete db;
+        return result;
+    }
+
+    // the collection is unlocked with the key it was created with.
+    m_unlockedCollections.insert(collectionName, db);
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::removeCollection(
+        const QString &collectionName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    } else if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Reserved collection name given"));
+    }
+
+    OpenDatabase *db = m_unlockedCollections.take(collectionName);
+    if (db) {
+        closeDatabase(db);
+        delete db;
+    }
+
+    return deleteDatabase(databaseName(collectionName));
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::isLocked(
+        const QString &collectionName,
+        bool *locked)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (isStandalone(collectionName)) {
+        // each standalone secret is accessed with its own key.
+        *locked = false;
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    int kdfIterations = 0;
+    bool found = false;
+    Sailfish::Secrets::Result result = lookupDatabase(databaseName(collectionName), &kdfIterations, &found);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    } else if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    }
+
+    *locked = !m_unlockedCollections.contains(collectionName);
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// A non-empty key unlocks the collection, an empty key locks it.
+// An incorrect key leaves the collection locked.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::setEncryptionKey(
+        const QString &collectionName,
+        const QByteArray &key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    if (key.isEmpty()) {
+        OpenDatabase *db = m_unlockedCollections.take(collectionName);
+        if (db) {
+            closeDatabase(db);
+            delete db;
+        }
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    } else if (m_unlockedCollections.contains(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    const QString name = databaseName(collectionName);
+    int kdfIterations = 0;
+    bool found = false;
+    Sailfish::Secrets::Result result = lookupDatabase(name, &kdfIterations, &found);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    } else if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    }
+
+    OpenDatabase *db = new OpenDatabase;
+    result = openDatabase(name, key, kdfIterations, false, db);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        delete db;
+        return result.errorCode() == Sailfish::Secrets::Result::IncorrectAuthenticationKeyError
+                ? Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded)
+                : result;
+    }
+
+    m_unlockedCollections.insert(collectionName, db);
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::reencrypt(
+        const QString &collectionName,
+        const QByteArray &oldkey,
+        const QByteArray &newkey)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Standalone secrets cannot be re-encrypted as a collection"));
+    } else if (newkey.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginEncryptionError,
+                                         QLatin1String("Empty key given"));
+    }
+
+    const QString name = databaseName(collectionName);
+    int kdfIterations = 0;
+    bool found = false;
+    Sailfish::Secrets::Result result = lookupDatabase(name, &kdfIterations, &found);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    } else if (!found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+    }
+
+    OpenDatabase temporary;
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    if (!db) {
+        result = openDatabase(name, oldkey, kdfIterations, false, &temporary);
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+        db = &temporary;
+    }
+
+    // rewrites every page of the database with the new key.
+    if (!execute(db->database, keyPragma("rekey", newkey))) {
+        result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::SecretsPluginEncryptionError,
+                                           QString::fromUtf8("Sqlcipher plugin unable to re-encrypt collection: %1").arg(collectionName));
+    }
+
+    closeDatabase(&temporary);
+    return result;
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::setSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        const QByteArray &secret)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Standalone secrets must be set with a key"));
+    }
+
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    if (!db) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromUtf8("Collection %1 is locked").arg(collectionName));
+    }
+
+    QMap<QString, QByteArray> secrets;
+    secrets.insert(secretName, secret);
+    return writeSecrets(db, secrets);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::getSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        QByteArray *secret)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Standalone secrets must be accessed with a key"));
+    }
+
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    if (!db) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromUtf8("Collection %1 is locked").arg(collectionName));
+    }
+
+    bool found = false;
+    Sailfish::Secrets::Result result = readSecret(db, secretName, secret, &found);
+    if (result.code() == Sailfish::Secrets::Result::Succeeded && !found) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("No such secret in collection"));
+    }
+    return result;
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::removeSecret(
+        const QString &collectionName,
+        const QString &secretName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (isStandalone(collectionName)) {
+        return deleteDatabase(databaseName(collectionName, secretName));
+    }
+
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    if (!db) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromUtf8("Collection %1 is locked").arg(collectionName));
+    }
+
+    QSqlQuery dq(db->database);
+    dq.prepare(QLatin1String("DELETE FROM Secrets WHERE SecretName = ?;"));
+    dq.addBindValue(QVariant::fromValue<QString>(secretName));
+    if (!dq.exec()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to execute delete secret query: %1").arg(dq.lastError().text()));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::getSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames,
+        QMap<QString, QByteArray> *secrets)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Standalone secrets must be accessed with a key"));
+    }
+
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    if (!db) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromUtf8("Collection %1 is locked").arg(collectionName));
+    }
+
+    for (const QString &secretName : secretNames) {
+        QByteArray secret;
+        bool found = false;
+        Sailfish::Secrets::Result result = readSecret(db, secretName, &secret, &found);
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        } else if (found) {
+            secrets->insert(secretName, secret);
+        }
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::setSecrets(
+        const QString &collectionName,
+        const QMap<QString, QByteArray> &secrets)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (secrets.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Standalone secrets must be set with a key"));
+    }
+
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    if (!db) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromUtf8("Collection %1 is locked").arg(collectionName));
+    }
+
+    return writeSecrets(db, secrets);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::removeSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (secretNames.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (isStandalone(collectionName)) {
+        for (const QString &secretName : secretNames) {
+            Sailfish::Secrets::Result result = deleteDatabase(databaseName(collectionName, secretName));
+            if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+                return result;
+            }
+        }
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    if (!db) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromUtf8("Collection %1 is locked").arg(collectionName));
+    } else if (secretNames.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QVariantList names;
+    for (const QString &secretName : secretNames) {
+        names.append(QVariant::fromValue<QString>(secretName));
+    }
+
+    QSqlQuery dq(db->database);
+    if (!dq.prepare(QLatin1String("DELETE FROM Secrets WHERE SecretName = ?;"))) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to prepare delete secrets query: %1").arg(dq.lastError().text()));
+    }
+    dq.addBindValue(names);
+
+    if (!db->database.transaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Sqlcipher plugin unable to begin transaction"));
+    }
+
+    if (!dq.execBatch()) {
+        const QString errorText = dq.lastError().text();
+        db->database.rollback();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to execute delete secrets query: %1").arg(errorText));
+    }
+
+    if (!db->database.commit()) {
+        db->database.rollback();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QLatin1String("Sqlcipher plugin unable to commit delete secrets transaction"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::enumerateSecrets(
+        const QString &collectionName,
+        const QString &cursor,
+        int maxCount,
+        QMap<QString, QByteArray> *secrets,
+        QString *nextCursor)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (isStandalone(collectionName)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
+                                         QLatin1String("Standalone secrets must be accessed with a key"));
+    } else if (maxCount <= 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromUtf8("Invalid maximum count given: %1").arg(maxCount));
+    }
+
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    if (!db) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionIsLockedError,
+                                         QString::fromUtf8("Collection %1 is locked").arg(collectionName));
+    }
+
+    // select one more than requested, to find whether any secrets remain.
+    QSqlQuery sq(db->database);
+    if (!sq.prepare(QLatin1String(
+                "SELECT SecretName, Secret FROM Secrets"
+                " WHERE SecretName > ?"
+                " ORDER BY SecretName"
+                " LIMIT ?;"))) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to prepare enumerate secrets query: %1").arg(sq.lastError().text()));
+    }
+    sq.addBindValue(QVariant::fromValue<QString>(cursor.isNull() ? QStringLiteral("") : cursor));
+    sq.addBindValue(QVariant::fromValue<int>(maxCount + 1));
+    if (!sq.exec()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlcipher plugin unable to execute enumerate secrets query: %1").arg(sq.lastError().text()));
+    }
+
+    QMap<QString, QByteArray> retn;
+    QString lastSecretName;
+    bool more = false;
+    while (sq.next()) {
+        if (retn.size() == maxCount) {
+            more = true;
+            break;
+        }
+        lastSecretName = sq.value(0).value<QString>();
+        retn.insert(lastSecretName, sq.value(1).value<QByteArray>());
+    }
+
+    *secrets = retn;
+    *nextCursor = more ? lastSecretName : QString();
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// Standalone secrets are each stored in their own database, which is only
+// open for the duration of the call.  Setting a standalone secret replaces
+// any previous database for it, as the secret may be given a different key.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::setSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        const QByteArray &secret,
+        const QByteArray &key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    }
+
+    QMap<QString, QByteArray> secrets;
+    secrets.insert(secretName, secret);
+
+    OpenDatabase temporary;
+    OpenDatabase *db = m_unlockedCollections.value(collectionName);
+    Sailfish::Secrets::Result result;
+    if (isStandalone(collectionName)) {
+        const QString name = databaseName(collectionName, secretName);
+        result = deleteDatabase(name);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = openDatabase(name, key, m_kdfIterations, true, &temporary);
+        }
+        if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = insertDatabase(name, m_kdfIterations);
+        }
+        db = &temporary;
+    } else if (!db) {
+        const QString name = databaseName(collectionName);
+        int kdfIterations = 0;
+        bool found = false;
+        result = lookupDatabase(name, &kdfIterations, &found);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded && !found) {
+            result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                               QString::fromUtf8("No such collection exists: %1").arg(collectionName));
+        } else if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = openDatabase(name, key, kdfIterations, false, &temporary);
+        }
+        db = &temporary;
+    }
+
+    if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+        result = writeSecrets(db, secrets);
+    }
+
+    closeDatabase(&temporary);
+    return result;
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::accessSecret(
+        const QString &collectionName,
+        const QString &secretName,
+        const QByteArray &key,
+        QByteArray *secret)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (secretName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QLatin1String("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QLatin1String("Empty collection name given"));
+    }
+
+    OpenDatabase temporary;
+    OpenDatabase *db = isStandalone(collectionName) ? Q_NULLPTR : m_unlockedCollections.value(collectionName);
+    Sailfish::Secrets::Result result;
+    if (!db) {
+        const QString name = isStandalone(collectionName)
+                ? databaseName(collectionName, secretName)
+                : databaseName(collectionName);
+        int kdfIterations = 0;
+        bool found = false;
+        result = lookupDatabase(name, &kdfIterations, &found);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded && !found) {
+            result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                               QLatin1String("No such secret exists"));
+        } else if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+            result = openDatabase(name, key, kdfIterations, false, &temporary);
+        }
+        db = &temporary;
+    }
+
+    if (result.code() == Sailfish::Secrets::Result::Succeeded) {
+        bool found = false;
+        result = readSecret(db, secretName, secret, &found);
+        if (result.code() == Sailfish::Secrets::Result::Succeeded && !found) {
+            result = Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                               QLatin1String("No such secret exists"));
+        }
+    }
+
+    closeDatabase(&temporary);
+    return result;
+}
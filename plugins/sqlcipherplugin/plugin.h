@@ -14,9 +14,13 @@
 #include <QObject>
 #include <QVector>
 #include <QString>
+#include <QHash>
 #include <QByteArray>
 #include <QCryptographicHash>
+#include <QMutex>
 #include <QMutexLocker>
+#include <QSqlDatabase>
+#include <QSqlQuery>
 
 namespace Sailfish {
 
@@ -26,6 +30,10 @@ namespace Daemon {
 
 namespace Plugins {
 
+// Stores each collection in its own SQLCipher database, encrypted page by page
+// with the collection key.  While a collection is unlocked its database remains
+// open, so that repeated reads are served from its (decrypted) page cache.
+// Standalone secrets are each stored in their own database, keyed with the secret's key.
 class Q_DECL_EXPORT SqlCipherPlugin : public Sailfish::Secrets::EncryptedStoragePlugin
 {
     Q_OBJECT
@@ -33,9 +41,8 @@ class Q_DECL_EXPORT SqlCipherPlugin : public Sailfish::Secrets::EncryptedStorage
     Q_INTERFACES(Sailfish::Secrets::EncryptedStoragePlugin)
 
 public:
-    SqlCipherPlugin(QObject *parent = Q_NULLPTR)
-        : Sailfish::Secrets::EncryptedStoragePlugin(parent) {}
-    ~SqlCipherPlugin() {}
+    SqlCipherPlugin(QObject *parent = Q_NULLPTR);
+    ~SqlCipherPlugin();
 
     bool isTestPlugin() const Q_DECL_OVERRIDE {
 #ifdef SAILFISH_SECRETS_BUILD_TEST_PLUGIN
@@ -50,91 +57,55 @@ public:
     Sailfish::Secrets::EncryptionPlugin::EncryptionType encryptionType() const Q_DECL_OVERRIDE { return Sailfish::Secrets::EncryptionPlugin::SoftwareEncryption; }
     Sailfish::Secrets::EncryptionPlugin::EncryptionAlgorithm encryptionAlgorithm() const Q_DECL_OVERRIDE { return Sailfish::Secrets::EncryptionPlugin::AES_256_CBC; }
 
-    Sailfish::Secrets::Result createCollection(const QString &collectionName, const QByteArray &key) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(key);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result removeCollection(const QString &collectionName) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result isLocked(const QString &collectionName, bool *locked) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(locked);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result setEncryptionKey(const QString &collectionName, const QByteArray &key) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(key);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result reencrypt(const QString &collectionName, const QByteArray &oldkey, const QByteArray &newkey) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(oldkey);
-        Q_UNUSED(newkey);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result setSecret(const QString &collectionName, const QString &secretName, const QByteArray &secret) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(secretName);
-        Q_UNUSED(secret);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result getSecret(const QString &collectionName, const QString &secretName, QByteArray *secret) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(secretName);
-        Q_UNUSED(secret);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result removeSecret(const QString &collectionName, const QString &secretName) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(secretName);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result setSecret(const QString &collectionName, const QString &secretName, const QByteArray &secret, const QByteArray &key) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(secretName);
-        Q_UNUSED(secret);
-        Q_UNUSED(key);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
-
-    Sailfish::Secrets::Result accessSecret(const QString &collectionName, const QString &secretName, const QByteArray &key, QByteArray *secret) Q_DECL_OVERRIDE
-    {
-        Q_UNUSED(collectionName);
-        Q_UNUSED(secretName);
-        Q_UNUSED(key);
-        Q_UNUSED(secret);
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::OperationNotSupportedError,
-                                         QLatin1String("TODO: SQLCIPHER"));
-    }
+    Sailfish::Secrets::Result createCollection(const QString &collectionName, const QByteArray &key) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeCollection(const QString &collectionName) Q_DECL_OVERRIDE;
+
+    Sailfish::Secrets::Result isLocked(const QString &collectionName, bool *locked) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result setEncryptionKey(const QString &collectionName, const QByteArray &key) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result reencrypt(const QString &collectionName, const QByteArray &oldkey, const QByteArray &newkey) Q_DECL_OVERRIDE;
+
+    Sailfish::Secrets::Result setSecret(const QString &collectionName, const QString &secretName, const QByteArray &secret) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result getSecret(const QString &collectionName, const QString &secretName, QByteArray *secret) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeSecret(const QString &collectionName, const QString &secretName) Q_DECL_OVERRIDE;
+
+    Sailfish::Secrets::Result getSecrets(const QString &collectionName, const QStringList &secretNames, QMap<QString, QByteArray> *secrets) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result setSecrets(const QString &collectionName, const QMap<QString, QByteArray> &secrets) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeSecrets(const QString &collectionName, const QStringList &secretNames) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result enumerateSecrets(const QString &collectionName, const QString &cursor, int maxCount,
+                                               QMap<QString, QByteArray> *secrets, QString *nextCursor) Q_DECL_OVERRIDE;
+
+    Sailfish::Secrets::Result setSecret(const QString &collectionName, const QString &secretName, const QByteArray &secret, const QByteArray &key) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result accessSecret(const QString &collectionName, const QString &secretName, const QByteArray &key, QByteArray *secret) Q_DECL_OVERRIDE;
+
+private:
+    // An unlocked collection, whose database remains open until it is locked.
+    struct OpenDatabase {
+        QString connectionName;
+        QSqlDatabase database;
+        QSqlQuery selectSecretQuery;
+    };
+
+    QString databaseFile(const QString &databaseName) const;
+    Sailfish::Secrets::Result lookupDatabase(const QString &databaseName, int *kdfIterations, bool *found);
+    Sailfish::Secrets::Result insertDatabase(const QString &databaseName, int kdfIterations);
+    Sailfish::Secrets::Result deleteDatabase(const QString &databaseName);
+
+    Sailfish::Secrets::Result openDatabase(const QString &databaseName, const QByteArray &key, int kdfIterations,
+                                           bool create, Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *db);
+    void closeDatabase(Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *db);
+
+    Sailfish::Secrets::Result writeSecrets(Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *db,
+                                           const QMap<QString, QByteArray> &secrets);
+    Sailfish::Secrets::Result readSecret(Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *db,
+                                         const QString &secretName, QByteArray *secret, bool *found);
+
+    QMutex m_mutex;
+    QString m_databaseDirPath;
+    QSqlDatabase m_metadata; // unencrypted: which collections exist, and their KDF parameters
+    QHash<QString, Sailfish::Secrets::Daemon::Plugins::SqlCipherPlugin::OpenDatabase *> m_unlockedCollections;
+    int m_kdfIterations;
+    int m_cacheKBytes;
+    int m_connectionCount;
 };
 
 } // namespace Plugins
@@ -3,6 +3,8 @@ CONFIG+=plugin
 TARGET=sailfishsecrets-sqlcipher
 TARGET = $$qtLibraryTarget($$TARGET)
 
+QT += sql
+
 include($$PWD/../../common.pri)
 include($$PWD/../../api/libsailfishsecrets/libsailfishsecrets.pri)
 
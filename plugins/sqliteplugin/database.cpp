@@ -8,6 +8,8 @@
 #include "database_p.h"
 
 #include <QtCore/QElapsedTimer>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QDateTime>
 #include <QtCore/QDate>
@@ -19,22 +21,53 @@
 
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
+#include <QtSql/QSqlRecord>
+
+#include <stdio.h>
+
+// Statements which are built dynamically would otherwise grow the
+// prepared query cache without bound.
+static const int PreparedQueryCacheCapacity = 64;
+
+// Statements which take at least this long are logged.  May be overridden
+// via SAILFISH_SECRETSD_SLOW_QUERY_MSEC (where 0 disables the log), as for
+// the daemon's own database.
+static const int DefaultSlowQueryThresholdMs = 100;
+
+// The statistics used by the query planner are refreshed by idle-time
+// maintenance once at least this many transactions have been committed.
+static const int AnalyzeAfterCommits = 1000;
 
 static const char *setupEnforceForeignKeys =
         "\n PRAGMA foreign_keys = ON;";
 
 static const char *setupEncoding =
-        "\n PRAGMA encoding = \"UTF-16\";";
+        "\n PRAGMA encoding = \"UTF-8\";";
 
 static const char *setupTempStore =
         "\n PRAGMA temp_store = MEMORY;";
 
+// the page size only takes effect when the database is created.
+static const char *setupPageSize =
+        "\n PRAGMA page_size = 4096;";
+
+// as does the auto vacuum mode, unless the database is rebuilt.  Free
+// pages are released by idle-time maintenance, see performMaintenance().
+static const char *setupAutoVacuum =
+        "\n PRAGMA %1.auto_vacuum = INCREMENTAL;";
+
+static const char *setupCacheSize =
+        "\n PRAGMA cache_size = -2048;"; // KiB
+
 static const char *setupJournal =
         "\n PRAGMA journal_mode = WAL;";
 
 static const char *setupSynchronous =
         "\n PRAGMA synchronous = FULL;";
 
+static const char *setupQueryOnly =
+        "\n PRAGMA query_only = 1;";
+
 static const char *createCollectionsTable =
         "\n CREATE TABLE Collections ("
         "   CollectionName TEXT NOT NULL,"
@@ -47,12 +80,59 @@ static const char *createSecretsTable =
         "   Secret BLOB,"
         "   Timestamp DATE,"
         "   FOREIGN KEY (CollectionName) REFERENCES Collections(CollectionName),"
-        "   PRIMARY KEY (CollectionName, SecretName));";
+        "   PRIMARY KEY (CollectionName, SecretName)) WITHOUT ROWID;";
+
+// the last secret re-encrypted by an interrupted collection re-encryption.
+static const char *createReencryptionProgressTable =
+        "\n CREATE TABLE ReencryptionProgress ("
+        "   CollectionName TEXT NOT NULL,"
+        "   LastSecretName TEXT NOT NULL,"
+        "   PRIMARY KEY (CollectionName));";
 
 static const char *createStatements[] =
 {
     createCollectionsTable,
     createSecretsTable,
+    createReencryptionProgressTable,
+};
+
+// Collections with reduced durability live in attached schemas with the same
+// tables: "normal" is a separate file synced with synchronous = NORMAL,
+// "inmemory" is never written to disk at all.
+static const char *attachDatabaseFile =
+        "\n ATTACH DATABASE '%1' AS %2;";
+
+static const char *setupAttachedJournal =
+        "\n PRAGMA %1.journal_mode = WAL;";
+
+static const char *setupAttachedSynchronous =
+        "\n PRAGMA %1.synchronous = %2;";
+
+static const char *attachInMemoryDatabase =
+        "\n ATTACH DATABASE ':memory:' AS %1;";
+
+// used to bind variable-length lists of secret names.
+static const char *createSecretNamesTable =
+        "\n CREATE TEMP TABLE IF NOT EXISTS SecretNames ("
+        "   SecretName TEXT NOT NULL,"
+        "   PRIMARY KEY (SecretName));";
+
+static const char *createDurabilitySchemaTables[] =
+{
+    "\n CREATE TABLE IF NOT EXISTS %1.Collections ("
+    "   CollectionName TEXT NOT NULL,"
+    "   PRIMARY KEY (CollectionName));",
+    "\n CREATE TABLE IF NOT EXISTS %1.Secrets ("
+    "   CollectionName TEXT NOT NULL,"
+    "   SecretName TEXT NOT NULL,"
+    "   Secret BLOB,"
+    "   Timestamp DATE,"
+    "   FOREIGN KEY (CollectionName) REFERENCES Collections(CollectionName),"
+    "   PRIMARY KEY (CollectionName, SecretName)) WITHOUT ROWID;",
+    "\n CREATE TABLE IF NOT EXISTS %1.ReencryptionProgress ("
+    "   CollectionName TEXT NOT NULL,"
+    "   LastSecretName TEXT NOT NULL,"
+    "   PRIMARY KEY (CollectionName));",
 };
 
 typedef bool (*UpgradeFunction)(QSqlDatabase &database);
@@ -62,11 +142,40 @@ struct UpgradeOperation {
     const char **statements;
 };
 
+// store the secrets in the primary key index itself, rather than in
+// a rowid table with a separate index on (CollectionName, SecretName).
+static const char *upgradeVersion1[] = {
+    "CREATE TABLE SecretsWithoutRowid ("
+    "   CollectionName TEXT NOT NULL,"
+    "   SecretName TEXT NOT NULL,"
+    "   Secret BLOB,"
+    "   Timestamp DATE,"
+    "   FOREIGN KEY (CollectionName) REFERENCES Collections(CollectionName),"
+    "   PRIMARY KEY (CollectionName, SecretName)) WITHOUT ROWID",
+    "INSERT INTO SecretsWithoutRowid SELECT CollectionName, SecretName, Secret, Timestamp FROM Secrets",
+    "DROP TABLE Secrets",
+    "ALTER TABLE SecretsWithoutRowid RENAME TO Secrets",
+    "PRAGMA user_version=2",
+    0 // NULL-terminated
+};
+
+// allow collection re-encryption to resume after an interruption.
+static const char *upgradeVersion2[] = {
+    "CREATE TABLE ReencryptionProgress ("
+    "   CollectionName TEXT NOT NULL,"
+    "   LastSecretName TEXT NOT NULL,"
+    "   PRIMARY KEY (CollectionName))",
+    "PRAGMA user_version=3",
+    0 // NULL-terminated
+};
+
 static UpgradeOperation upgradeVersions[] = {
     { 0, 0 },
+    { 0, upgradeVersion1 },
+    { 0, upgradeVersion2 },
 };
 
-static const int currentSchemaVersion = 1;
+static const int currentSchemaVersion = 3;
 
 static bool execute(QSqlDatabase &database, const QString &statement)
 {
@@ -81,6 +190,35 @@ static bool execute(QSqlDatabase &database, const QString &statement)
     }
 }
 
+static bool pragmaValue(QSqlDatabase &database, const QString &statement, int column, int *value)
+{
+    QSqlQuery query(database);
+    if (!query.exec(statement) || !query.next()) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << QString::fromLatin1("Query failed: %1\n%2")
+                .arg(query.lastError().text())
+                .arg(statement);
+        return false;
+    }
+    *value = query.value(column).toInt();
+    return true;
+}
+
+static bool incrementalVacuum(QSqlDatabase &database, const QString &schema, int pages)
+{
+    // each step of the statement releases one page.
+    const QString statement = QString::fromLatin1("PRAGMA %1.incremental_vacuum(%2)").arg(schema).arg(pages);
+    QSqlQuery query(database);
+    if (!query.exec(statement)) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << QString::fromLatin1("Query failed: %1\n%2")
+                .arg(query.lastError().text())
+                .arg(statement);
+        return false;
+    }
+    while (query.next()) {
+    }
+    return true;
+}
+
 static bool beginTransaction(QSqlDatabase &database)
 {
     // Use immediate lock acquisition; we should already have an IPC lock, so
@@ -187,6 +325,151 @@ static bool checkDatabase(QSqlDatabase &database)
     return false;
 }
 
+static bool copyTable(QSqlDatabase &source, QSqlDatabase &target, const QString &tableName)
+{
+    QSqlQuery selectQuery(source);
+    selectQuery.setForwardOnly(true);
+    if (!selectQuery.exec(QString::fromLatin1("SELECT * FROM \"%1\"").arg(tableName))) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to select rows to migrate from" << tableName << selectQuery.lastError().text();
+        return false;
+    }
+
+    const int columnCount = selectQuery.record().count();
+    QStringList placeholders;
+    for (int i = 0; i < columnCount; ++i) {
+        placeholders.append(QString::fromLatin1("?"));
+    }
+
+    QSqlQuery insertQuery(target);
+    if (!insertQuery.prepare(QString::fromLatin1("INSERT INTO \"%1\" VALUES (%2)")
+                                .arg(tableName, placeholders.join(QLatin1Char(','))))) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to prepare migrated rows for" << tableName << insertQuery.lastError().text();
+        return false;
+    }
+
+    while (selectQuery.next()) {
+        for (int i = 0; i < columnCount; ++i) {
+            insertQuery.bindValue(i, selectQuery.value(i));
+        }
+        if (!insertQuery.exec()) {
+            qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to insert migrated row into" << tableName << insertQuery.lastError().text();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Recreates the schema objects of the source database in the target
+// database, copying the rows of each table before its indexes are created.
+static bool copyDatabase(QSqlDatabase &source, QSqlDatabase &target)
+{
+    QSqlQuery schemaQuery(source);
+    if (!schemaQuery.exec(QLatin1String(
+                "SELECT type, name, sql FROM sqlite_master"
+                " WHERE sql IS NOT NULL"
+                " AND name NOT LIKE 'sqlite_%'"
+                " ORDER BY CASE type WHEN 'table' THEN 0 ELSE 1 END"))) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to select schema to migrate:" << schemaQuery.lastError().text();
+        return false;
+    }
+
+    QStringList types, names, statements;
+    while (schemaQuery.next()) {
+        types.append(schemaQuery.value(0).toString());
+        names.append(schemaQuery.value(1).toString());
+        statements.append(schemaQuery.value(2).toString());
+    }
+    schemaQuery.finish();
+
+    for (int i = 0; i < statements.size(); ++i) {
+        if (!execute(target, statements.at(i))) {
+            return false;
+        }
+        if (types.at(i) == QLatin1String("table") && !copyTable(source, target, names.at(i))) {
+            return false;
+        }
+    }
+
+    QSqlQuery versionQuery(source);
+    if (!versionQuery.exec(QLatin1String("PRAGMA user_version")) || !versionQuery.next()) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "User version query failed:" << versionQuery.lastError();
+        return false;
+    }
+
+    return execute(target, QString::fromLatin1("PRAGMA user_version=%1").arg(versionQuery.value(0).toInt()));
+}
+
+// The text encoding of a database cannot be changed once it has been created,
+// so a database which was created with another encoding is rebuilt as a new
+// UTF-8 database file, which then atomically replaces the original file.
+// Returns false if the database remains in its original encoding.
+static bool migrateEncoding(const QString &databaseFile, const QString &connectionName)
+{
+    const QString sourceConnectionName = connectionName + QLatin1String("-migrate-source");
+    const QString targetConnectionName = connectionName + QLatin1String("-migrate-target");
+    const QString migratedFile = databaseFile + QLatin1String(".utf8");
+
+    bool required = false;
+    bool migrated = false;
+    {
+        QSqlDatabase source = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), sourceConnectionName);
+        source.setDatabaseName(databaseFile);
+        if (!source.open()) {
+            qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to open secrets sqlite plugin database for encoding migration:" << source.lastError().text();
+            required = true;
+        } else {
+            QSqlQuery encodingQuery(source);
+            if (!encodingQuery.exec(QLatin1String("PRAGMA encoding")) || !encodingQuery.next()) {
+                qCWarning(lcSailfishSecretsPluginSqlite) << "Encoding query failed:" << encodingQuery.lastError();
+                required = true;
+            } else if (encodingQuery.value(0).toString() != QLatin1String("UTF-8")) {
+                qCWarning(lcSailfishSecretsPluginSqlite) << "Migrating secrets sqlite plugin database from encoding" << encodingQuery.value(0).toString();
+                required = true;
+
+                QFile::remove(migratedFile);
+                QSqlDatabase target = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), targetConnectionName);
+                target.setDatabaseName(migratedFile);
+                if (!target.open()) {
+                    qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to create migrated secrets sqlite plugin database:" << target.lastError().text();
+                } else {
+                    // the encoding and page size must be set before anything is written.
+                    migrated = execute(target, QLatin1String(setupEncoding))
+                            && execute(target, QLatin1String(setupPageSize))
+                            && beginTransaction(target)
+                            && finalizeTransaction(target, copyDatabase(source, target))
+                            && execute(target, QLatin1String("ANALYZE"));
+                    target.close();
+                }
+            }
+            encodingQuery.finish();
+            // closing the only connection checkpoints and removes the write-ahead log.
+            source.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(targetConnectionName);
+    QSqlDatabase::removeDatabase(sourceConnectionName);
+
+    if (!required) {
+        return true;
+    } else if (!migrated) {
+        QFile::remove(migratedFile);
+        return false;
+    }
+
+    // a stale write-ahead log must never be applied to the migrated file.
+    if ((QFile::exists(databaseFile + QLatin1String("-wal")) && !QFile::remove(databaseFile + QLatin1String("-wal")))
+            || ::rename(QFile::encodeName(migratedFile).constData(), QFile::encodeName(databaseFile).constData()) != 0) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to replace secrets sqlite plugin database with migrated database";
+        QFile::remove(migratedFile);
+        return false;
+    }
+    QFile::remove(databaseFile + QLatin1String("-shm"));
+
+    qCWarning(lcSailfishSecretsPluginSqlite) << "Migrated secrets sqlite plugin database to UTF-8 encoding";
+    return true;
+}
+
 static bool upgradeDatabase(QSqlDatabase &database)
 {
     if (!beginTransaction(database))
@@ -202,6 +485,9 @@ static bool configureDatabase(QSqlDatabase &database, QString &localeName)
     if (!execute(database,QLatin1String(setupEnforceForeignKeys))
         || !execute(database, QLatin1String(setupEncoding))
         || !execute(database, QLatin1String(setupTempStore))
+        || !execute(database, QLatin1String(setupPageSize))
+        || !execute(database, QString::fromLatin1(setupAutoVacuum).arg(QLatin1String("main")))
+        || !execute(database, QLatin1String(setupCacheSize))
         || !execute(database, QLatin1String(setupJournal))
         || !execute(database, QLatin1String(setupSynchronous))) {
         qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to configure secrets sqlite plugin database:" << database.lastError().text();
@@ -243,6 +529,32 @@ static bool executeCreationStatements(QSqlDatabase &database)
     return true;
 }
 
+static bool attachDatabases(QSqlDatabase &database,
+                            const QString &normalDatabaseFile,
+                            const QString &normalSchema,
+                            const QString &inMemorySchema)
+{
+    if (!execute(database, QString::fromLatin1(attachDatabaseFile).arg(normalDatabaseFile, normalSchema))
+            || !execute(database, QString::fromLatin1(setupAutoVacuum).arg(normalSchema))
+            || !execute(database, QString::fromLatin1(setupAttachedJournal).arg(normalSchema))
+            || !execute(database, QString::fromLatin1(setupAttachedSynchronous).arg(normalSchema, QLatin1String("NORMAL")))
+            || !execute(database, QString::fromLatin1(attachInMemoryDatabase).arg(inMemorySchema))
+            || !execute(database, QLatin1String(createSecretNamesTable))) {
+        return false;
+    }
+
+    const QString schemas[] = { normalSchema, inMemorySchema };
+    for (int i = 0; i < lengthOf(schemas); ++i) {
+        for (int j = 0; j < lengthOf(createDurabilitySchemaTables); ++j) {
+            if (!execute(database, QString::fromLatin1(createDurabilitySchemaTables[j]).arg(schemas[i]))) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 static bool prepareDatabase(QSqlDatabase &database, QString &localeName)
 {
     if (!configureDatabase(database, localeName))
@@ -255,6 +567,50 @@ static bool prepareDatabase(QSqlDatabase &database, QString &localeName)
     return finalizeTransaction(database, success);
 }
 
+// Runs the integrity check on its own connection, so that requests
+// can be served (and the database written, since it uses WAL journaling)
+// while the check is in progress.
+class Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::IntegrityCheck : public QRunnable
+{
+public:
+    IntegrityCheck(Sailfish::Secrets::Daemon::Plugins::Sqlite::Database *db) : m_db(db) {}
+
+    void run() Q_DECL_OVERRIDE
+    {
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        const QString connectionName = m_db->m_connectionName + QLatin1String("-integrity");
+        bool intact = false;
+        {
+            QSqlDatabase database = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), connectionName);
+            database.setDatabaseName(m_db->m_databaseFile);
+            if (!database.open()) {
+                qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to open secrets sqlite plugin database for integrity check:" << database.lastError().text();
+            } else {
+                ::execute(database, QLatin1String(setupQueryOnly));
+                intact = checkDatabase(database);
+                database.close();
+            }
+        }
+        QSqlDatabase::removeDatabase(connectionName);
+
+        m_db->m_integrityCheckDurationMs.storeRelease(static_cast<int>(timer.elapsed()));
+        if (intact) {
+            m_db->m_integrityStatus.storeRelease(Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::IntegrityOk);
+            qCDebug(lcSailfishSecretsPluginSqlite) << "Checked integrity of secrets sqlite plugin database in" << timer.elapsed() << "ms";
+        } else {
+            m_db->m_integrityStatus.storeRelease(Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::IntegrityCorrupt);
+            qCWarning(lcSailfishSecretsPluginSqlite) << "Integrity check of secrets sqlite plugin database failed - refusing further writes";
+        }
+    }
+
+private:
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database *m_db;
+};
+
 Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query::Query(const QSqlQuery &query)
     : m_query(query)
 {
@@ -274,17 +630,34 @@ void Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query::reportError(co
 Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Database()
     : m_mutex(QMutex::Recursive)
     , m_localeName(QLocale().name())
+    , m_preparedQueries(PreparedQueryCacheCapacity)
+    , m_groupCommit(false)
+    , m_groupTransactionOpen(false)
+    , m_groupedTransactions(0)
+    , m_integrityStatus(IntegrityUnknown)
+    , m_integrityCheckDurationMs(-1)
+    , m_mainSchema(QStringLiteral("main"))
+    , m_normalSchema(QStringLiteral("normal"))
+    , m_inMemorySchema(QStringLiteral("inmemory"))
+    , m_sharedAccessMutex(Q_NULLPTR)
 {
+    m_checkpointedFrames[0] = 0;
+    m_checkpointedFrames[1] = 0;
+    m_integrityCheckPool.setMaxThreadCount(1);
 }
 
 Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::~Database()
 {
-    m_database.close();
+    m_integrityCheckPool.waitForDone();
+    if (!m_sharedAccessMutex) {
+        // a shared connection is closed by its owner.
+        m_database.close();
+    }
 }
 
 QMutex *Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::accessMutex() const
 {
-    return const_cast<QMutex *>(&m_mutex);
+    return m_sharedAccessMutex ? m_sharedAccessMutex : const_cast<QMutex *>(&m_mutex);
 }
 
 // QDir::isReadable() doesn't support group permissions, only user permissions.
@@ -322,8 +695,18 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::open(const QString &c
     const QString databaseFile = databaseDir.absoluteFilePath(QLatin1String("secrets.db"));
     const bool databasePreexisting = QFile::exists(databaseFile);
 
+    // the attached reduced durability database must use the same encoding as the main database.
+    const QString normalDatabaseFile = databaseDir.absoluteFilePath(QLatin1String("secrets-normal.db"));
+    if (databasePreexisting && !migrateEncoding(databaseFile, connectionName)) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to migrate secrets sqlite plugin database encoding - continuing with the existing encoding";
+    } else if (QFile::exists(normalDatabaseFile) && !migrateEncoding(normalDatabaseFile, connectionName)) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to migrate reduced durability secrets sqlite plugin database encoding";
+    }
+
     m_database = QSqlDatabase::addDatabase(QString::fromLatin1("QSQLITE"), connectionName);
     m_database.setDatabaseName(databaseFile);
+    m_connectionName = connectionName;
+    m_databaseFile = databaseFile;
 
     if (!m_database.open()) {
         qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to open secrets sqlite plugin database:" << m_database.lastError().text();
@@ -342,12 +725,6 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::open(const QString &c
     }
 
     if (databasePreexisting) {
-        // Perform an integrity check
-        if (!checkDatabase(m_database)) {
-            qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to check integrity of secrets sqlite plugin database:" << m_database.lastError().text();
-            m_database.close();
-            return false;
-        }
         // Try to upgrade, if necessary
         if (!upgradeDatabase(m_database)) {
             qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to upgrade secrets sqlite plugin database:" << m_database.lastError().text();
@@ -356,10 +733,76 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::open(const QString &c
         }
     }
 
+    m_normalDatabaseFile = normalDatabaseFile;
+    if (!attachDatabases(m_database, m_normalDatabaseFile, m_normalSchema, m_inMemorySchema)) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Failed to attach reduced durability secrets sqlite plugin databases:" << m_database.lastError().text();
+        m_database.close();
+        return false;
+    }
+
+    // a newly created database doesn't need to be checked.
+    if (databasePreexisting) {
+        m_integrityStatus.storeRelease(IntegrityChecking);
+        m_integrityCheckPool.start(new IntegrityCheck(this));
+    } else {
+        m_integrityStatus.storeRelease(IntegrityOk);
+    }
+
     qCDebug(lcSailfishSecretsPluginSqlite) << "Opened secrets sqlite plugin database:" << databaseFile << "Locale:" << m_localeName;
     return true;
 }
 
+// Moves this database onto the given (already open) connection by attaching
+// its files to it, so that writes made via this database can be committed
+// atomically with the owner's writes to its own database.
+bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::share(
+        const QString &connectionName,
+        const QString &schemaName,
+        QMutex *accessMutex)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_database.isOpen() || m_sharedAccessMutex || withinTransaction()) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to share secrets sqlite plugin database in its current state";
+        return false;
+    }
+
+    if (!flushGroupCommit()) {
+        return false;
+    }
+
+    QSqlDatabase sharedDatabase = QSqlDatabase::database(connectionName, false);
+    if (!sharedDatabase.isOpen()) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to share secrets sqlite plugin database: connection not open:" << connectionName;
+        return false;
+    }
+
+    QMutexLocker sharedLocker(accessMutex);
+    const QString normalSchema = schemaName + QLatin1String("_normal");
+    const QString inMemorySchema = schemaName + QLatin1String("_inmemory");
+    if (!::execute(sharedDatabase, QString::fromLatin1(attachDatabaseFile).arg(m_databaseFile, schemaName))
+            || !::execute(sharedDatabase, QString::fromLatin1(setupAttachedJournal).arg(schemaName))
+            || !::execute(sharedDatabase, QString::fromLatin1(setupAttachedSynchronous).arg(schemaName, QLatin1String("FULL")))
+            || !attachDatabases(sharedDatabase, m_normalDatabaseFile, normalSchema, inMemorySchema)) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to attach secrets sqlite plugin database to connection:" << connectionName;
+        return false;
+    }
+
+    // the in-memory schema of the previous connection is discarded,
+    // so this must be done before any in-memory collections are created.
+    const QString ownConnectionName = m_database.connectionName();
+    m_preparedQueries.clear();
+    m_database.close();
+    m_database = sharedDatabase;
+    QSqlDatabase::removeDatabase(ownConnectionName);
+
+    m_mainSchema = schemaName;
+    m_normalSchema = normalSchema;
+    m_inMemorySchema = inMemorySchema;
+    m_sharedAccessMutex = accessMutex;
+    return true;
+}
+
 Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::operator QSqlDatabase &()
 {
     return m_database;
@@ -389,10 +832,30 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::localized() const
 // should ever access the secrets database.
 bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::beginTransaction()
 {
+    if (m_transactionSemaphore.loadAcquire() == 0
+            && m_integrityStatus.loadAcquire() == IntegrityCorrupt) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Integrity check failed - not beginning transaction on secrets sqlite plugin database";
+        return false;
+    }
+
     int oldSemaphoreValue = m_transactionSemaphore.fetchAndAddAcquire(1);
     if (oldSemaphoreValue == 0) {
         // start a new "outer" transaction.
-        return ::beginTransaction(m_database);
+        if (m_sharedAccessMutex) {
+            // nested within the owner's transaction, if it has begun one.
+            return ::execute(m_database, QString::fromLatin1("SAVEPOINT %1").arg(m_mainSchema));
+        }
+        if (!m_groupCommit) {
+            return ::beginTransaction(m_database);
+        }
+        // when grouping, each "outer" transaction is a savepoint within the group transaction.
+        if (!m_groupTransactionOpen) {
+            if (!::beginTransaction(m_database)) {
+                return false;
+            }
+            m_groupTransactionOpen = true;
+        }
+        return ::execute(m_database, QString::fromLatin1("SAVEPOINT grouped"));
     } else if (oldSemaphoreValue == 1) {
         // already in an "outer" transaction.  This is fine, and is
         // done within loadPlugins() code to minimise transactions on startup.
@@ -408,6 +871,15 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::commitTransaction()
 {
     int oldSemaphoreValue = m_transactionSemaphore.fetchAndAddAcquire(-1);
     if (oldSemaphoreValue == 1) {
+        m_commitsSinceAnalyze.ref();
+        if (m_sharedAccessMutex) {
+            return ::execute(m_database, QString::fromLatin1("RELEASE SAVEPOINT %1").arg(m_mainSchema));
+        }
+        if (m_groupTransactionOpen) {
+            // durable once the group is flushed.
+            ++m_groupedTransactions;
+            return ::execute(m_database, QString::fromLatin1("RELEASE SAVEPOINT grouped"));
+        }
         return ::commitTransaction(m_database);
     } else if (oldSemaphoreValue == 0) {
         // this is always an error in sailfishsecretsd code.
@@ -423,6 +895,15 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::rollbackTransaction()
 {
     int oldSemaphoreValue = m_transactionSemaphore.fetchAndAddAcquire(-1);
     if (oldSemaphoreValue == 1) {
+        if (m_sharedAccessMutex) {
+            return ::execute(m_database, QString::fromLatin1("ROLLBACK TO SAVEPOINT %1").arg(m_mainSchema))
+                && ::execute(m_database, QString::fromLatin1("RELEASE SAVEPOINT %1").arg(m_mainSchema));
+        }
+        if (m_groupTransactionOpen) {
+            // only discard the changes made since the savepoint, not the whole group.
+            return ::execute(m_database, QString::fromLatin1("ROLLBACK TO SAVEPOINT grouped"))
+                && ::execute(m_database, QString::fromLatin1("RELEASE SAVEPOINT grouped"));
+        }
         return ::rollbackTransaction(m_database);
     } else if (oldSemaphoreValue == 0) {
         // this is always an error in sailfishsecretsd code.
@@ -434,6 +915,117 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::rollbackTransaction()
     }
 }
 
+void Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::setGroupCommit(bool enabled)
+{
+    QMutexLocker locker(accessMutex());
+    if (m_sharedAccessMutex) {
+        // the owner of the shared connection decides when it is committed.
+        return;
+    }
+    if (!enabled) {
+        flushGroupCommit();
+    }
+    m_groupCommit = enabled;
+}
+
+// Commits every transaction committed since the last flush with a single sync.
+// If this fails, all of those transactions are lost.
+bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::flushGroupCommit()
+{
+    QMutexLocker locker(accessMutex());
+    if (!m_groupTransactionOpen) {
+        return true;
+    }
+    if (withinTransaction()) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to flush grouped transactions from within a transaction";
+        return false;
+    }
+
+    m_groupTransactionOpen = false;
+    m_groupedTransactions = 0;
+    const bool committed = ::commitTransaction(m_database);
+    if (!committed) {
+        ::rollbackTransaction(m_database);
+    }
+    return committed;
+}
+
+// The owner of a shared connection must ensure that none of its own
+// transactions are open; the reduced durability schema is maintained
+// together with the main schema, the in-memory schema never needs it.
+int Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::performMaintenance(int pageBudget)
+{
+    QMutex *mutex = accessMutex();
+    if (!mutex->tryLock()) {
+        return -1;
+    }
+    int pages = -1;
+    if (m_database.isOpen() && !withinTransaction() && !m_groupTransactionOpen
+            && m_integrityStatus.loadAcquire() != IntegrityCorrupt) {
+        const bool analyze = m_commitsSinceAnalyze.loadAcquire() >= AnalyzeAfterCommits;
+        bool analyzeMain = analyze, analyzeNormal = analyze;
+        pages = maintainSchema(m_mainSchema, &m_checkpointedFrames[0], &analyzeMain, pageBudget);
+        pages += maintainSchema(m_normalSchema, &m_checkpointedFrames[1], &analyzeNormal, pageBudget - pages);
+        if (analyze && !analyzeMain && !analyzeNormal) {
+            m_commitsSinceAnalyze.storeRelease(0);
+        }
+    }
+    mutex->unlock();
+    return pages;
+}
+
+int Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::maintainSchema(
+        const QString &schema,
+        int *checkpointedFrames,
+        bool *analyze,
+        int pageBudget)
+{
+    int pages = 0;
+
+    int frames = 0;
+    if (pragmaValue(m_database, QString::fromLatin1("PRAGMA %1.wal_checkpoint(PASSIVE)").arg(schema), 2, &frames)) {
+        // the count is of the frames checkpointed since the log was last reset.
+        pages += frames >= *checkpointedFrames ? frames - *checkpointedFrames : frames;
+        *checkpointedFrames = qMax(frames, 0);
+    }
+
+    int autoVacuum = 0, freePages = 0, pageCount = 0;
+    if (!pragmaValue(m_database, QString::fromLatin1("PRAGMA %1.auto_vacuum").arg(schema), 0, &autoVacuum)
+            || !pragmaValue(m_database, QString::fromLatin1("PRAGMA %1.freelist_count").arg(schema), 0, &freePages)
+            || !pragmaValue(m_database, QString::fromLatin1("PRAGMA %1.page_count").arg(schema), 0, &pageCount)) {
+        return pages;
+    }
+
+    if (freePages > 0 && pages < pageBudget) {
+        if (autoVacuum == 2) { // INCREMENTAL
+            const int vacuumPages = qMin(freePages, pageBudget - pages);
+            if (incrementalVacuum(m_database, schema, vacuumPages)) {
+                pages += vacuumPages;
+            }
+        } else if (autoVacuum == 0 && !m_sharedAccessMutex && pageCount <= pageBudget - pages) {
+            // databases created before incremental vacuuming was enabled are
+            // rebuilt with it, once.  A shared connection may have statements
+            // of its owner in progress, which would prevent the rebuild.
+            m_preparedQueries.clear();
+            if (::execute(m_database, QString::fromLatin1(setupAutoVacuum).arg(schema))
+                    && ::execute(m_database, QString::fromLatin1("VACUUM %1").arg(schema))) {
+                qCDebug(lcSailfishSecretsPluginSqlite) << "Rebuilt secrets sqlite plugin schema with incremental vacuuming:" << schema;
+            }
+            pages += pageCount;
+        }
+    }
+
+    // ANALYZE reads every page, so it is deferred until a step has the budget for it.
+    if (*analyze && pageCount <= pageBudget - pages) {
+        if (::execute(m_database, QString::fromLatin1("ANALYZE %1").arg(schema))) {
+            *analyze = false;
+        }
+        pages += pageCount;
+    }
+
+    return pages;
+}
+
 Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::prepare(const char *statement, QString *errorText)
 {
     return prepare(QString::fromLatin1(statement), errorText);
@@ -443,21 +1035,52 @@ Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query Sailfish::Secrets::D
 {
     QMutexLocker locker(accessMutex());
 
-    QHash<QString, QSqlQuery>::const_iterator it = m_preparedQueries.constFind(statement);
-    if (it == m_preparedQueries.constEnd()) {
-        QSqlQuery query(m_database);
-        query.setForwardOnly(true);
-        if (!query.prepare(statement)) {
-            qCWarning(lcSailfishSecretsPluginSqlite) << QString::fromLatin1("Failed to prepare query: %1\n%2")
-                    .arg(query.lastError().text())
-                    .arg(statement);
-            *errorText = query.lastError().text();
-            return Query(QSqlQuery());
-        }
-        it = m_preparedQueries.insert(statement, query);
+    QSqlQuery *cached = m_preparedQueries.object(statement);
+    if (cached) {
+        return Query(*cached);
     }
 
-    return Query(*it);
+    QSqlQuery query(m_database);
+    query.setForwardOnly(true);
+    if (!query.prepare(statement)) {
+        qCWarning(lcSailfishSecretsPluginSqlite) << QString::fromLatin1("Failed to prepare query: %1\n%2")
+                .arg(query.lastError().text())
+                .arg(statement);
+        *errorText = query.lastError().text();
+        return Query(QSqlQuery());
+    }
+    m_preparedQueries.insert(statement, new QSqlQuery(query));
+
+    return Query(query);
+}
+
+namespace {
+    int configuredSlowQueryThresholdMs()
+    {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue("SAILFISH_SECRETSD_SLOW_QUERY_MSEC", &ok);
+        return ok && value >= 0 ? value : DefaultSlowQueryThresholdMs;
+    }
+
+    // Logs the query if it was slow, with blobs (the encrypted secrets) replaced by their size.
+    void checkSlowQuery(const QSqlQuery &query, qint64 elapsedMs)
+    {
+        static const int threshold = configuredSlowQueryThresholdMs();
+        if (threshold <= 0 || elapsedMs < threshold) {
+            return;
+        }
+
+        QMap<QString, QVariant> bindings(query.boundValues());
+        for (QMap<QString, QVariant>::iterator it = bindings.begin(); it != bindings.end(); ++it) {
+            if (it.value().type() == QVariant::ByteArray) {
+                it.value() = QString::fromLatin1("<%1 bytes>").arg(it.value().toByteArray().size());
+            } else if (it.value().type() == QVariant::List) {
+                it.value() = QString::fromLatin1("<%1 values>").arg(it.value().toList().size());
+            }
+        }
+        qCWarning(lcSailfishSecretsPluginSqlite).nospace() << "Slow query in " << elapsedMs << "ms: "
+                << qPrintable(Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::expandQuery(query.lastQuery(), bindings));
+    }
 }
 
 bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::execute(QSqlQuery &query, QString *errorText)
@@ -468,6 +1091,7 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::execute(QSqlQuery &qu
     t.start();
 
     bool rv = query.exec();
+    checkSlowQuery(query, t.elapsed());
     if (rv) {
         if (debugSql) {
             const int n = query.isSelect() ? query.size() : query.numRowsAffected();
@@ -489,6 +1113,7 @@ bool Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::executeBatch(QSqlQuer
     t.start();
 
     bool rv = query.execBatch(mode);
+    checkSlowQuery(query, t.elapsed());
     if (rv) {
         if (debugSql) {
             const int n = query.isSelect() ? query.size() : query.numRowsAffected();
@@ -17,10 +17,12 @@
 #include <QtCore/QVariant>
 #include <QtCore/QString>
 #include <QtCore/QHash>
+#include <QtCore/QCache>
 #include <QtCore/QMutex>
 #include <QtCore/QMutexLocker>
 #include <QtCore/QAtomicInt>
 #include <QtCore/QScopedPointer>
+#include <QtCore/QThreadPool>
 #include <QtCore/QLoggingCategory>
 
 Q_DECLARE_LOGGING_CATEGORY(lcSailfishSecretsPluginSqlite)
@@ -87,6 +89,17 @@ public:
 
     bool open(const QString &databaseName, bool autoTest);
 
+    // Attaches this database to another (open) connection in this process,
+    // and uses that connection and the given access mutex from then on.
+    // Transactions become savepoints within the owner's transactions.
+    bool share(const QString &connectionName, const QString &schemaName, QMutex *accessMutex);
+    bool isShared() const { return m_sharedAccessMutex != Q_NULLPTR; }
+
+    // The schemas which hold the collections of each durability.
+    QString mainSchema() const { return m_mainSchema; }
+    QString normalSchema() const { return m_normalSchema; }
+    QString inMemorySchema() const { return m_inMemorySchema; }
+
     operator QSqlDatabase &();
     operator QSqlDatabase const &() const;
 
@@ -99,6 +112,30 @@ public:
     bool rollbackTransaction();
     bool withinTransaction() const { return m_transactionSemaphore.loadAcquire(); }
 
+    // When enabled, transactions committed via commitTransaction() are
+    // savepoints within one group transaction, which becomes durable
+    // (with a single sync) only when flushGroupCommit() is called.
+    void setGroupCommit(bool enabled);
+    bool groupCommitPending() const { return m_groupTransactionOpen && m_groupedTransactions > 0; }
+    bool flushGroupCommit();
+
+    // Performs one step of idle-time maintenance of the on-disk schemas,
+    // using roughly at most pageBudget pages of I/O.  Returns the number
+    // of pages used, or -1 if the database is in use.
+    int performMaintenance(int pageBudget);
+
+    // The integrity of a pre-existing database is checked in the background
+    // after open() returns.  If the check fails, no further transactions
+    // may be begun.
+    enum IntegrityStatus {
+        IntegrityUnknown = 0,
+        IntegrityChecking,
+        IntegrityOk,
+        IntegrityCorrupt
+    };
+    IntegrityStatus integrityStatus() const { return static_cast<IntegrityStatus>(m_integrityStatus.loadAcquire()); }
+    int integrityCheckDurationMs() const { return m_integrityCheckDurationMs.loadAcquire(); }
+
     Query prepare(const char *statement, QString *errorText);
     Query prepare(const QString &statement, QString *errorText);
 
@@ -110,11 +147,31 @@ public:
     static QString expandQuery(const QSqlQuery &query);
 
 private:
+    class IntegrityCheck;
+    friend class IntegrityCheck;
+
+    int maintainSchema(const QString &schema, int *checkpointedFrames, bool *analyze, int pageBudget);
+
     QSqlDatabase m_database;
     QMutex m_mutex;
     QString m_localeName;
-    QHash<QString, QSqlQuery> m_preparedQueries;
+    QString m_connectionName;
+    QString m_databaseFile;
+    QString m_normalDatabaseFile;
+    QCache<QString, QSqlQuery> m_preparedQueries; // least-recently-used statements are finalized
     QAtomicInt m_transactionSemaphore;
+    bool m_groupCommit;
+    bool m_groupTransactionOpen;
+    int m_groupedTransactions;
+    QAtomicInt m_integrityStatus;
+    QAtomicInt m_integrityCheckDurationMs;
+    QThreadPool m_integrityCheckPool;
+    QString m_mainSchema;
+    QString m_normalSchema;
+    QString m_inMemorySchema;
+    QMutex *m_sharedAccessMutex;
+    QAtomicInt m_commitsSinceAnalyze;
+    int m_checkpointedFrames[2];
 };
 
 } // namespace Sqlite
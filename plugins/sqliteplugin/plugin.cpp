@@ -7,10 +7,34 @@
 
 #include "plugin.h"
 
+#include <QtConcurrent/QtConcurrentMap>
+
 Q_PLUGIN_METADATA(IID Sailfish_Secrets_StoragePlugin_IID)
 
 Q_LOGGING_CATEGORY(lcSailfishSecretsPluginSqlite, "org.sailfishos.secrets.plugin.storage.sqlite")
 
+namespace {
+    // the number of secrets re-encrypted (and committed) at a time.
+    const int ReencryptionChunkSize = 64;
+
+    struct SecretReencryptor {
+        typedef void result_type;
+        SecretReencryptor(Sailfish::Secrets::EncryptionPlugin *plugin, const QByteArray &oldkey, const QByteArray &newkey)
+            : m_plugin(plugin), m_oldkey(oldkey), m_newkey(newkey) {}
+        void operator()(Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::ReencryptedSecret &secret) const {
+            QByteArray plaintext;
+            secret.result = m_plugin->decryptSecret(secret.encrypted, m_oldkey, &plaintext);
+            if (secret.result.code() == Sailfish::Secrets::Result::Succeeded) {
+                secret.result = m_plugin->encryptSecret(plaintext, m_newkey, &secret.reencrypted);
+            }
+            plaintext.fill('\0');
+        }
+        Sailfish::Secrets::EncryptionPlugin *m_plugin;
+        QByteArray m_oldkey;
+        QByteArray m_newkey;
+    };
+}
+
 Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::DatabaseLocker::~DatabaseLocker()
 {
     if (mutex()) {
@@ -81,6 +105,14 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::~SqlitePlugin()
 Sailfish::Secrets::Result
 Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::createCollection(
         const QString &collectionName)
+{
+    return createCollectionWithDurability(collectionName, Sailfish::Secrets::StoragePlugin::FullDurability);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::createCollectionWithDurability(
+        const QString &collectionName,
+        Sailfish::Secrets::StoragePlugin::Durability durability)
 {
     DatabaseLocker locker(m_db);
 
@@ -92,53 +124,34 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::createCollection(
                                          QString::fromUtf8("Reserved collection name given"));
     }
 
-    const QString selectCollectionsCountQuery = QStringLiteral(
-                 "SELECT"
-                    " Count(*)"
-                  " FROM Collections"
-                  " WHERE CollectionName = ?;"
-             );
-
-    QString errorText;
-    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query sq = m_db->prepare(selectCollectionsCountQuery, &errorText);
-    if (!errorText.isEmpty()) {
-        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
-                                         QString::fromUtf8("Sqlite plugin unable to prepare select collections query: %1").arg(errorText));
-    }
-
-    QVariantList values;
-    values << QVariant::fromValue<QString>(collectionName);
-    sq.bindValues(values);
-
     if (!m_db->beginTransaction()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
                                          QString::fromUtf8("Sqlite plugin unable to begin transaction"));
     }
 
-    if (!m_db->execute(sq, &errorText)) {
+    // the collection name must be unique across all of the durability schemas.
+    QString errorText;
+    const QString existingSchema = lookupCollectionSchema(collectionName, &errorText);
+    if (!errorText.isEmpty()) {
         m_db->rollbackTransaction();
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
                                          QString::fromUtf8("Sqlite plugin unable to execute select collections query: %1").arg(errorText));
     }
 
-    bool found = false;
-    if (sq.next()) {
-        found = sq.value(0).value<int>() > 0;
-    }
-
-    if (found) {
+    if (!existingSchema.isEmpty()) {
         m_db->rollbackTransaction();
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::CollectionAlreadyExistsError,
                                          QString::fromUtf8("Collection already exists: %1").arg(collectionName));
     }
 
+    const QString schema = durabilitySchema(durability);
     const QString insertCollectionQuery = QStringLiteral(
-                "INSERT INTO Collections ("
+                "INSERT INTO %1.Collections ("
                   "CollectionName"
                 ")"
                 " VALUES ("
                   "?"
-                ");");
+                ");").arg(schema);
 
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query iq = m_db->prepare(insertCollectionQuery, &errorText);
     if (!errorText.isEmpty()) {
@@ -163,6 +176,7 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::createCollection(
                                          QString::fromUtf8("Sqlite plugin unable to commit insert collection transaction"));
     }
 
+    m_collectionSchemas.insert(collectionName, schema);
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
@@ -181,12 +195,17 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::removeCollection(
                                          QString::fromUtf8("Reserved collection name given"));
     }
 
+    const QString schema = collectionSchema(collectionName);
     const QString deleteCollectionQuery = QStringLiteral(
-                "DELETE FROM Collections"
-                " WHERE CollectionName = ?;");
+                "DELETE FROM %1.Collections"
+                " WHERE CollectionName = ?;").arg(schema);
+    const QString deleteProgressQuery = QStringLiteral(
+                "DELETE FROM %1.ReencryptionProgress"
+                " WHERE CollectionName = ?;").arg(schema);
 
     QString errorText;
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query dq = m_db->prepare(deleteCollectionQuery, &errorText);
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query pq = m_db->prepare(deleteProgressQuery, &errorText);
     if (!errorText.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
                                          QString::fromUtf8("Sqlite plugin unable to prepare delete collection query: %1").arg(errorText));
@@ -195,13 +214,14 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::removeCollection(
     QVariantList values;
     values << QVariant::fromValue<QString>(collectionName);
     dq.bindValues(values);
+    pq.bindValues(values);
 
     if (!m_db->beginTransaction()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
                                          QString::fromUtf8("Sqlite plugin unable to begin transaction"));
     }
 
-    if (!m_db->execute(dq, &errorText)) {
+    if (!m_db->execute(pq, &errorText) || !m_db->execute(dq, &errorText)) {
         m_db->rollbackTransaction();
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
                                          QString::fromUtf8("Sqlite plugin unable to execute delete collection query: %1").arg(errorText));
@@ -213,6 +233,7 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::removeCollection(
                                          QString::fromUtf8("Sqlite plugin unable to commit delete collection transaction"));
     }
 
+    m_collectionSchemas.remove(collectionName);
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
@@ -233,13 +254,14 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::setSecret(
                                          QString::fromUtf8("Empty collection name given"));
     }
 
+    const QString schema = collectionSchema(collectionName);
     const QString selectSecretsCountQuery = QStringLiteral(
                  "SELECT"
                     " Count(*)"
-                  " FROM Secrets"
+                  " FROM %1.Secrets"
                   " WHERE CollectionName = ?"
                   " AND SecretName = ?;"
-             );
+             ).arg(schema);
 
     QString errorText;
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query sq = m_db->prepare(selectSecretsCountQuery, &errorText);
@@ -270,14 +292,14 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::setSecret(
     }
 
     const QString updateSecretQuery = QStringLiteral(
-                 "UPDATE Secrets"
+                 "UPDATE %1.Secrets"
                  " SET Secret = ?"
                  "   , Timestamp = date('now')"
                  " WHERE CollectionName = ?"
                  " AND SecretName = ?;"
-             );
+             ).arg(schema);
     const QString insertSecretQuery = QStringLiteral(
-                "INSERT INTO Secrets ("
+                "INSERT INTO %1.Secrets ("
                   "CollectionName,"
                   "SecretName,"
                   "Secret,"
@@ -285,7 +307,7 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::setSecret(
                 ")"
                 " VALUES ("
                   "?,?,?,date('now')"
-                ");");
+                ");").arg(schema);
 
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query iq = m_db->prepare(found ? updateSecretQuery : insertSecretQuery, &errorText);
     if (!errorText.isEmpty()) {
@@ -341,10 +363,10 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::getSecret(
     const QString selectSecretsCountQuery = QStringLiteral(
                  "SELECT"
                     " Secret"
-                  " FROM Secrets"
+                  " FROM %1.Secrets"
                   " WHERE CollectionName = ?"
                   " AND SecretName = ?;"
-             );
+             ).arg(collectionSchema(collectionName));
 
     QString errorText;
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query sq = m_db->prepare(selectSecretsCountQuery, &errorText);
@@ -391,6 +413,164 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::getSecret(
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::getSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames,
+        QMap<QString, QByteArray> *secrets)
+{
+    DatabaseLocker locker(m_db);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    }
+
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to begin transaction"));
+    }
+
+    // stay well below SQLITE_MAX_VARIABLE_NUMBER.  The number of bound names
+    // is rounded up to a power of two (by repeating the last name) so that
+    // only a handful of distinct statements end up in the prepared query cache.
+    const int MaxSecretNamesPerQuery = 512;
+    const QString schema = collectionSchema(collectionName);
+    QMap<QString, QByteArray> retn;
+    for (int offset = 0; offset < secretNames.size(); offset += MaxSecretNamesPerQuery) {
+        const QStringList chunk = secretNames.mid(offset, MaxSecretNamesPerQuery);
+        int placeholderCount = 1;
+        while (placeholderCount < chunk.size()) {
+            placeholderCount *= 2;
+        }
+
+        QString placeholders = QStringLiteral("?");
+        for (int i = 1; i < placeholderCount; ++i) {
+            placeholders.append(QStringLiteral(",?"));
+        }
+
+        const QString selectSecretsQuery = QStringLiteral(
+                     "SELECT"
+                        " SecretName,"
+                        " Secret"
+                      " FROM %1.Secrets"
+                      " WHERE CollectionName = ?"
+                      " AND SecretName IN (%2);"
+                 ).arg(schema, placeholders);
+
+        QString errorText;
+        Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query sq = m_db->prepare(selectSecretsQuery, &errorText);
+        if (!errorText.isEmpty()) {
+            m_db->rollbackTransaction();
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromUtf8("Sqlite plugin unable to prepare select secrets query: %1").arg(errorText));
+        }
+
+        QVariantList values;
+        values << QVariant::fromValue<QString>(collectionName);
+        for (int i = 0; i < placeholderCount; ++i) {
+            values << QVariant::fromValue<QString>(chunk.at(qMin(i, chunk.size() - 1)));
+        }
+        sq.bindValues(values);
+
+        if (!m_db->execute(sq, &errorText)) {
+            m_db->rollbackTransaction();
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromUtf8("Sqlite plugin unable to execute select secrets query: %1").arg(errorText));
+        }
+
+        while (sq.next()) {
+            retn.insert(sq.value(0).value<QString>(), sq.value(1).value<QByteArray>());
+        }
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to commit select secrets transaction"));
+    }
+
+    *secrets = retn;
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::setSecrets(
+        const QString &collectionName,
+        const QMap<QString, QByteArray> &secrets)
+{
+    DatabaseLocker locker(m_db);
+
+    if (secrets.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    }
+
+#ifdef SAILFISH_SECRETS_BUILD_TEST_PLUGIN
+    // lets the autotests check that the daemon undoes a batch which the plugin failed to write.
+    if (collectionName.startsWith(QLatin1String("testfailingwrites"))) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite test plugin failing write to collection %1").arg(collectionName));
+    }
+#endif
+
+    // (CollectionName, SecretName) is the primary key, so existing secrets are replaced.
+    const QString insertSecretsQuery = QStringLiteral(
+                "INSERT OR REPLACE INTO %1.Secrets ("
+                  "CollectionName,"
+                  "SecretName,"
+                  "Secret,"
+                  "Timestamp"
+                ")"
+                " VALUES ("
+                  "?,?,?,date('now')"
+                ");").arg(collectionSchema(collectionName));
+
+    QString errorText;
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query iq = m_db->prepare(insertSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to prepare insert secrets query: %1").arg(errorText));
+    }
+
+    QVariantList collectionNames;
+    QVariantList secretNames;
+    QVariantList secretValues;
+    for (QMap<QString, QByteArray>::const_iterator it = secrets.constBegin(); it != secrets.constEnd(); it++) {
+        collectionNames << QVariant::fromValue<QString>(collectionName);
+        secretNames << QVariant::fromValue<QString>(it.key());
+        secretValues << QVariant::fromValue<QByteArray>(it.value());
+    }
+
+    QVariantList ivalues;
+    ivalues << QVariant(collectionNames);
+    ivalues << QVariant(secretNames);
+    ivalues << QVariant(secretValues);
+    iq.bindValues(ivalues);
+
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to begin transaction"));
+    }
+
+    if (!m_db->executeBatch(iq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to execute insert secrets query: %1").arg(errorText));
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to commit insert secrets transaction"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
 Sailfish::Secrets::Result
 Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::removeSecret(
         const QString &collectionName,
@@ -408,9 +588,9 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::removeSecret(
     }
 
     const QString deleteSecretQuery = QStringLiteral(
-                "DELETE FROM Secrets"
+                "DELETE FROM %1.Secrets"
                 " WHERE CollectionName = ?"
-                " AND SecretName = ?;");
+                " AND SecretName = ?;").arg(collectionSchema(collectionName));
 
     QString errorText;
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query dq = m_db->prepare(deleteSecretQuery, &errorText);
@@ -444,6 +624,134 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::removeSecret(
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
 
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::removeSecrets(
+        const QString &collectionName,
+        const QStringList &secretNames)
+{
+    DatabaseLocker locker(m_db);
+
+    if (secretNames.contains(QString())) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
+                                         QString::fromUtf8("Empty secret name given"));
+    } else if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (secretNames.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    const QString deleteSecretsQuery = QStringLiteral(
+                "DELETE FROM %1.Secrets"
+                " WHERE CollectionName = ?"
+                " AND SecretName = ?;").arg(collectionSchema(collectionName));
+
+    QString errorText;
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query dq = m_db->prepare(deleteSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to prepare delete secrets query: %1").arg(errorText));
+    }
+
+    QVariantList collectionNames;
+    QVariantList names;
+    for (const QString &secretName : secretNames) {
+        collectionNames << QVariant::fromValue<QString>(collectionName);
+        names << QVariant::fromValue<QString>(secretName);
+    }
+
+    QVariantList values;
+    values << QVariant(collectionNames);
+    values << QVariant(names);
+    dq.bindValues(values);
+
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to begin transaction"));
+    }
+
+    if (!m_db->executeBatch(dq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to execute delete secrets query: %1").arg(errorText));
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to commit delete secrets transaction"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// The cursor is the name of the last secret returned, so each page is a
+// single range scan of the (CollectionName, SecretName) primary key.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::enumerateSecrets(
+        const QString &collectionName,
+        const QString &cursor,
+        int maxCount,
+        QMap<QString, QByteArray> *secrets,
+        QString *nextCursor)
+{
+    DatabaseLocker locker(m_db);
+
+    if (collectionName.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidCollectionError,
+                                         QString::fromUtf8("Empty collection name given"));
+    } else if (maxCount <= 0) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::UnknownError,
+                                         QString::fromUtf8("Invalid maximum count given: %1").arg(maxCount));
+    }
+
+    // select one more than requested, to find whether any secrets remain.
+    const QString selectSecretsQuery = QStringLiteral(
+                 "SELECT"
+                    " SecretName,"
+                    " Secret"
+                  " FROM %1.Secrets"
+                  " WHERE CollectionName = ?"
+                  " AND SecretName > ?"
+                  " ORDER BY SecretName"
+                  " LIMIT ?;"
+             ).arg(collectionSchema(collectionName));
+
+    QString errorText;
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query sq = m_db->prepare(selectSecretsQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to prepare enumerate secrets query: %1").arg(errorText));
+    }
+
+    QVariantList values;
+    values << QVariant::fromValue<QString>(collectionName);
+    values << QVariant::fromValue<QString>(cursor.isNull() ? QStringLiteral("") : cursor);
+    values << QVariant::fromValue<int>(maxCount + 1);
+    sq.bindValues(values);
+
+    if (!m_db->execute(sq, &errorText)) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to execute enumerate secrets query: %1").arg(errorText));
+    }
+
+    QMap<QString, QByteArray> retn;
+    QString lastSecretName;
+    bool more = false;
+    while (sq.next()) {
+        if (retn.size() == maxCount) {
+            more = true;
+            break;
+        }
+        lastSecretName = sq.value(0).value<QString>();
+        retn.insert(lastSecretName, sq.value(1).value<QByteArray>());
+    }
+
+    *secrets = retn;
+    *nextCursor = more ? lastSecretName : QString();
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
 Sailfish::Secrets::Result
 Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::reencryptSecrets(
         const QString &collectionName,          // non-empty, all secrets in this collection will be re-encrypted
@@ -452,52 +760,151 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::reencryptSecrets(
         const QByteArray &newkey,
         Sailfish::Secrets::EncryptionPlugin *plugin)
 {
-    DatabaseLocker locker(m_db);
-
     // Note: don't disallow collectionName=standalone, since that's how we store standalone secrets.
     if (collectionName.isEmpty() && secretNames.isEmpty()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
                                          QString::fromUtf8("Empty secret names given and empty collection name given"));
     }
 
-    QString selectSecretsQuery;
-    QVariantList values;
     if (collectionName.isEmpty()) {
+        QStringList names;
         for (const QString &secretName : secretNames) {
             if (!secretName.isEmpty()) {
-                values.append(QVariant::fromValue<QString>(secretName));
+                names.append(secretName);
             }
         }
-        if (values.isEmpty()) {
+        if (names.isEmpty()) {
             return Sailfish::Secrets::Result(Sailfish::Secrets::Result::InvalidSecretError,
                                              QString::fromUtf8("Empty secret names given"));
         }
-        selectSecretsQuery = QStringLiteral(
-                     "SELECT"
-                        " CollectionName,"
-                        " SecretName,"
-                        " Secret"
-                      " FROM Secrets"
-                      " WHERE CollectionName = 'standalone'"
-                      " AND SecretName IN ("
-                 );
-        for (int i = 0; i < values.size(); ++i) {
-            selectSecretsQuery.append(QStringLiteral("?,"));
+
+        for (int offset = 0; offset < names.size(); offset += ReencryptionChunkSize) {
+            const QStringList chunk = names.mid(offset, ReencryptionChunkSize);
+            Sailfish::Secrets::Result result = reencryptStandaloneSecretsChunk(chunk, oldkey, newkey, plugin);
+            if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+                return result;
+            }
+            emit reencryptionProgress(QString(), qMin(offset + ReencryptionChunkSize, names.size()), names.size());
         }
-        selectSecretsQuery.chop(1);
-        selectSecretsQuery.append(QStringLiteral(");"));
-    } else {
-        selectSecretsQuery = QStringLiteral(
-                     "SELECT"
-                        " CollectionName,"
-                        " SecretName,"
-                        " Secret"
-                      " FROM Secrets"
-                      " WHERE CollectionName = ?;"
-                 );
-        values.append(QVariant::fromValue<QString>(collectionName));
+
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
     }
 
+    // resume after the last secret re-encrypted by a previous (failed) attempt.
+    QString lastSecretName;
+    int remaining = 0;
+    Sailfish::Secrets::Result result = reencryptionProgressMarker(collectionName, &lastSecretName, &remaining);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        return result;
+    }
+
+    int reencrypted = 0;
+    bool finished = false;
+    while (!finished) {
+        // the database is only locked for the duration of each chunk.
+        result = reencryptCollectionSecretsChunk(collectionName, oldkey, newkey, plugin, &lastSecretName, &finished);
+        if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return result;
+        }
+        if (!finished) {
+            reencrypted = qMin(reencrypted + ReencryptionChunkSize, remaining);
+            emit reencryptionProgress(collectionName, reencrypted, remaining);
+        }
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::reencryptionProgressMarker(
+        const QString &collectionName,
+        QString *lastSecretName,
+        int *remaining)
+{
+    DatabaseLocker locker(m_db);
+
+    const QString schema = collectionSchema(collectionName);
+    const QString selectProgressQuery = QStringLiteral(
+                 "SELECT"
+                    " LastSecretName"
+                  " FROM %1.ReencryptionProgress"
+                  " WHERE CollectionName = ?;"
+             ).arg(schema);
+    const QString selectRemainingQuery = QStringLiteral(
+                 "SELECT"
+                    " Count(*)"
+                  " FROM %1.Secrets"
+                  " WHERE CollectionName = ?"
+                  " AND SecretName > ?;"
+             ).arg(schema);
+
+    QString errorText;
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query pq = m_db->prepare(selectProgressQuery, &errorText);
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query rq = m_db->prepare(selectRemainingQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to prepare select re-encryption progress query: %1").arg(errorText));
+    }
+
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to begin transaction"));
+    }
+
+    pq.addBindValue(QVariant::fromValue<QString>(collectionName));
+    if (!m_db->execute(pq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to execute select re-encryption progress query: %1").arg(errorText));
+    }
+
+    *lastSecretName = pq.next() ? pq.value(0).value<QString>() : QString::fromLatin1("");
+    pq.finish();
+
+    rq.addBindValue(QVariant::fromValue<QString>(collectionName));
+    rq.addBindValue(QVariant::fromValue<QString>(*lastSecretName));
+    if (!m_db->execute(rq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to execute select remaining secrets query: %1").arg(errorText));
+    }
+
+    *remaining = rq.next() ? rq.value(0).value<int>() : 0;
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to commit select re-encryption progress transaction"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// Re-encrypts the next chunk of secrets (in SecretName order) after lastSecretName,
+// and records the last secret of the chunk as the progress marker in the same transaction.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::reencryptCollectionSecretsChunk(
+        const QString &collectionName,
+        const QByteArray &oldkey,
+        const QByteArray &newkey,
+        Sailfish::Secrets::EncryptionPlugin *plugin,
+        QString *lastSecretName,
+        bool *finished)
+{
+    DatabaseLocker locker(m_db);
+
+    const QString schema = collectionSchema(collectionName);
+    const QString selectSecretsQuery = QStringLiteral(
+                 "SELECT"
+                    " SecretName,"
+                    " Secret"
+                  " FROM %1.Secrets"
+                  " WHERE CollectionName = ?"
+                  " AND SecretName > ?"
+                  " ORDER BY SecretName"
+                  " LIMIT ?;"
+             ).arg(schema);
+
     QString errorText;
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query sq = m_db->prepare(selectSecretsQuery, &errorText);
     if (!errorText.isEmpty()) {
@@ -505,6 +912,10 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::reencryptSecrets(
                                          QString::fromUtf8("Sqlite plugin unable to prepare select secrets query: %1").arg(errorText));
     }
 
+    QVariantList values;
+    values << QVariant::fromValue<QString>(collectionName);
+    values << QVariant::fromValue<QString>(*lastSecretName);
+    values << QVariant::fromValue<int>(ReencryptionChunkSize);
     sq.bindValues(values);
 
     if (!m_db->beginTransaction()) {
@@ -518,39 +929,198 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::reencryptSecrets(
                                          QString::fromUtf8("Sqlite plugin unable to execute select secrets query: %1").arg(errorText));
     }
 
-    // decrypt each value, re-encrypt it with the new key, and write it back to the database.
-    Sailfish::Secrets::Result reencryptionResult;
-    QVariantList vcollectionNames, vsecretNames, vsecrets;
+    QVector<ReencryptedSecret> chunk;
     while (sq.next()) {
-        vcollectionNames.append(sq.value(0));
-        vsecretNames.append(sq.value(1));
-        QByteArray oldEncrypted = sq.value(2).value<QByteArray>();
-        QByteArray plaintext;
-        reencryptionResult = plugin->decryptSecret(oldEncrypted, oldkey, &plaintext);
-        if (reencryptionResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        ReencryptedSecret secret;
+        secret.collectionName = collectionName;
+        secret.secretName = sq.value(0).value<QString>();
+        secret.encrypted = sq.value(1).value<QByteArray>();
+        chunk.append(secret);
+    }
+    sq.finish();
+
+    if (chunk.isEmpty()) {
+        // every secret has been re-encrypted.
+        const QString deleteProgressQuery = QStringLiteral(
+                    "DELETE FROM %1.ReencryptionProgress"
+                    " WHERE CollectionName = ?;").arg(schema);
+        Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query dq = m_db->prepare(deleteProgressQuery, &errorText);
+        if (!errorText.isEmpty()) {
             m_db->rollbackTransaction();
-            return reencryptionResult;
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromUtf8("Sqlite plugin unable to prepare delete re-encryption progress query: %1").arg(errorText));
         }
-        QByteArray newEncrypted;
-        reencryptionResult = plugin->encryptSecret(plaintext, newkey, &newEncrypted);
-        if (reencryptionResult.code() != Sailfish::Secrets::Result::Succeeded) {
+        dq.addBindValue(QVariant::fromValue<QString>(collectionName));
+        if (!m_db->execute(dq, &errorText)) {
             m_db->rollbackTransaction();
-            return reencryptionResult;
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                             QString::fromUtf8("Sqlite plugin unable to execute delete re-encryption progress query: %1").arg(errorText));
+        }
+        if (!m_db->commitTransaction()) {
+            m_db->rollbackTransaction();
+            return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                             QString::fromUtf8("Sqlite plugin unable to commit delete re-encryption progress transaction"));
+        }
+        *finished = true;
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    Sailfish::Secrets::Result result = writeReencryptedSecrets(schema, &chunk, oldkey, newkey, plugin);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        m_db->rollbackTransaction();
+        return result;
+    }
+
+    const QString updateProgressQuery = QStringLiteral(
+                "INSERT OR REPLACE INTO %1.ReencryptionProgress ("
+                  "CollectionName,"
+                  "LastSecretName"
+                ")"
+                " VALUES ("
+                  "?,?"
+                ");").arg(schema);
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query pq = m_db->prepare(updateProgressQuery, &errorText);
+    if (!errorText.isEmpty()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to prepare update re-encryption progress query: %1").arg(errorText));
+    }
+    pq.addBindValue(QVariant::fromValue<QString>(collectionName));
+    pq.addBindValue(QVariant::fromValue<QString>(chunk.last().secretName));
+    if (!m_db->execute(pq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to execute update re-encryption progress query: %1").arg(errorText));
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to commit update secret transaction"));
+    }
+
+    *lastSecretName = chunk.last().secretName;
+    *finished = false;
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::reencryptStandaloneSecretsChunk(
+        const QStringList &secretNames,
+        const QByteArray &oldkey,
+        const QByteArray &newkey,
+        Sailfish::Secrets::EncryptionPlugin *plugin)
+{
+    DatabaseLocker locker(m_db);
+
+    // standalone secrets are always stored with full durability.
+    // the names are bound via a temporary table rather than an IN (?,?,...) list,
+    // so that the statement text doesn't depend on the number of names.
+    const QString schema = m_db->mainSchema();
+    const QString selectSecretsQuery = QStringLiteral(
+                 "SELECT"
+                    " SecretName,"
+                    " Secret"
+                  " FROM %1.Secrets"
+                  " WHERE CollectionName = 'standalone'"
+                  " AND SecretName IN (SELECT SecretName FROM temp.SecretNames);"
+             ).arg(schema);
+
+    QString errorText;
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query sq = m_db->prepare(selectSecretsQuery, &errorText);
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query cq = m_db->prepare("DELETE FROM temp.SecretNames;", &errorText);
+    Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query nq = m_db->prepare(
+                "INSERT OR IGNORE INTO temp.SecretNames (SecretName) VALUES (?);", &errorText);
+    if (!errorText.isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to prepare select secrets query: %1").arg(errorText));
+    }
+
+    QVariantList names;
+    for (const QString &secretName : secretNames) {
+        names.append(QVariant::fromValue<QString>(secretName));
+    }
+    nq.addBindValue(names);
+
+    if (!m_db->beginTransaction()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to begin transaction"));
+    }
+
+    if (!m_db->execute(cq, &errorText) || !m_db->executeBatch(nq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to execute secret names query: %1").arg(errorText));
+    }
+
+    if (!m_db->execute(sq, &errorText)) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
+                                         QString::fromUtf8("Sqlite plugin unable to execute select secrets query: %1").arg(errorText));
+    }
+
+    QVector<ReencryptedSecret> chunk;
+    while (sq.next()) {
+        ReencryptedSecret secret;
+        secret.collectionName = QStringLiteral("standalone");
+        secret.secretName = sq.value(0).value<QString>();
+        secret.encrypted = sq.value(1).value<QByteArray>();
+        chunk.append(secret);
+    }
+    sq.finish();
+
+    Sailfish::Secrets::Result result = writeReencryptedSecrets(schema, &chunk, oldkey, newkey, plugin);
+    if (result.code() != Sailfish::Secrets::Result::Succeeded) {
+        m_db->rollbackTransaction();
+        return result;
+    }
+
+    if (!m_db->commitTransaction()) {
+        m_db->rollbackTransaction();
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
+                                         QString::fromUtf8("Sqlite plugin unable to commit update secret transaction"));
+    }
+
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+// Decrypts and re-encrypts the chunk in parallel, then writes it back.
+// Must be called within a transaction.
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::writeReencryptedSecrets(
+        const QString &schema,
+        QVector<ReencryptedSecret> *chunk,
+        const QByteArray &oldkey,
+        const QByteArray &newkey,
+        Sailfish::Secrets::EncryptionPlugin *plugin)
+{
+    if (chunk->isEmpty()) {
+        return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QtConcurrent::blockingMap(*chunk, SecretReencryptor(plugin, oldkey, newkey));
+
+    QVariantList vcollectionNames, vsecretNames, vsecrets;
+    for (const ReencryptedSecret &secret : *chunk) {
+        if (secret.result.code() != Sailfish::Secrets::Result::Succeeded) {
+            return secret.result;
         }
-        vsecrets.append(QVariant::fromValue<QByteArray>(newEncrypted));
+        vcollectionNames.append(QVariant::fromValue<QString>(secret.collectionName));
+        vsecretNames.append(QVariant::fromValue<QString>(secret.secretName));
+        vsecrets.append(QVariant::fromValue<QByteArray>(secret.reencrypted));
     }
 
     const QString updateSecretQuery = QStringLiteral(
-                 "UPDATE Secrets"
+                 "UPDATE %1.Secrets"
                  " SET Secret = ?"
                  "   , Timestamp = date('now')"
                  " WHERE CollectionName = ?"
                  " AND SecretName = ?;"
-             );
+             ).arg(schema);
 
+    QString errorText;
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query uq = m_db->prepare(updateSecretQuery, &errorText);
     if (!errorText.isEmpty()) {
-        m_db->rollbackTransaction();
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
                                          QString::fromUtf8("Sqlite plugin unable to prepare update secret query: %1").arg(errorText));
     }
@@ -559,17 +1129,131 @@ Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::reencryptSecrets(
     uq.addBindValue(vcollectionNames);
     uq.addBindValue(vsecretNames);
 
-    if (!m_db->execute(uq, &errorText)) {
-        m_db->rollbackTransaction();
+    if (!m_db->executeBatch(uq, &errorText)) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseQueryError,
                                          QString::fromUtf8("Sqlite plugin unable to execute update secret query: %1").arg(errorText));
     }
 
-    if (!m_db->commitTransaction()) {
-        m_db->rollbackTransaction();
+    return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
+}
+
+void
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::setWriteBatching(bool enabled)
+{
+    m_db->setGroupCommit(enabled);
+}
+
+bool
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::hasPendingWrites() const
+{
+    return m_db->groupCommitPending();
+}
+
+Sailfish::Secrets::Result
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::flush()
+{
+    if (!m_db->flushGroupCommit()) {
         return Sailfish::Secrets::Result(Sailfish::Secrets::Result::DatabaseTransactionError,
-                                         QString::fromUtf8("Sqlite plugin unable to commit update secret transaction"));
+                                         QString::fromUtf8("Sqlite plugin unable to commit grouped transactions"));
     }
 
     return Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded);
 }
+
+QString
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::durabilitySchema(
+        Sailfish::Secrets::StoragePlugin::Durability durability) const
+{
+    switch (durability) {
+        case Sailfish::Secrets::StoragePlugin::NormalDurability:   return m_db->normalSchema();
+        case Sailfish::Secrets::StoragePlugin::InMemoryDurability: return m_db->inMemorySchema();
+        default:                                                   return m_db->mainSchema();
+    }
+}
+
+// Returns the schema in which the given collection is stored,
+// or an empty string if the collection doesn't exist.
+QString
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::lookupCollectionSchema(
+        const QString &collectionName,
+        QString *errorText)
+{
+    const QString schemas[] = { m_db->mainSchema(), m_db->normalSchema(), m_db->inMemorySchema() };
+    for (unsigned i = 0; i < sizeof(schemas)/sizeof(schemas[0]); ++i) {
+        const QString &schema = schemas[i];
+        const QString selectCollectionsCountQuery = QStringLiteral(
+                     "SELECT"
+                        " Count(*)"
+                      " FROM %1.Collections"
+                      " WHERE CollectionName = ?;"
+                 ).arg(schema);
+
+        Sailfish::Secrets::Daemon::Plugins::Sqlite::Database::Query sq = m_db->prepare(selectCollectionsCountQuery, errorText);
+        if (!errorText->isEmpty()) {
+            return QString();
+        }
+
+        QVariantList values;
+        values << QVariant::fromValue<QString>(collectionName);
+        sq.bindValues(values);
+
+        if (!m_db->execute(sq, errorText)) {
+            return QString();
+        }
+
+        if (sq.next() && sq.value(0).value<int>() > 0) {
+            return schema;
+        }
+    }
+
+    return QString();
+}
+
+// Returns the schema in which the secrets of the given collection are stored.
+// Unknown collections are looked for in the main schema, which reports
+// the errors (e.g. foreign key violations) expected by the callers.
+QString
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::collectionSchema(
+        const QString &collectionName)
+{
+    if (collectionName.compare(QStringLiteral("standalone"), Qt::CaseInsensitive) == 0) {
+        return m_db->mainSchema();
+    }
+
+    QHash<QString, QString>::const_iterator it = m_collectionSchemas.constFind(collectionName);
+    if (it != m_collectionSchemas.constEnd()) {
+        return it.value();
+    }
+
+    QString errorText;
+    const QString schema = lookupCollectionSchema(collectionName, &errorText);
+    if (schema.isEmpty()) {
+        if (!errorText.isEmpty()) {
+            qCWarning(lcSailfishSecretsPluginSqlite) << "Unable to determine schema for collection" << collectionName << ":" << errorText;
+        }
+        return m_db->mainSchema();
+    }
+
+    m_collectionSchemas.insert(collectionName, schema);
+    return schema;
+}
+
+bool
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::shareDatabaseConnection(
+        const QString &connectionName,
+        const QString &schemaName,
+        QMutex *accessMutex)
+{
+    if (!m_db->share(connectionName, schemaName, accessMutex)) {
+        return false;
+    }
+
+    m_collectionSchemas.clear();
+    return true;
+}
+
+int
+Sailfish::Secrets::Daemon::Plugins::SqlitePlugin::performMaintenance(int pageBudget)
+{
+    return m_db->performMaintenance(pageBudget);
+}
@@ -16,6 +16,7 @@
 #include <QObject>
 #include <QVector>
 #include <QString>
+#include <QHash>
 #include <QByteArray>
 #include <QCryptographicHash>
 #include <QMutexLocker>
@@ -50,10 +51,16 @@ public:
     Sailfish::Secrets::StoragePlugin::StorageType storageType() const Q_DECL_OVERRIDE { return Sailfish::Secrets::StoragePlugin::FileSystemStorage; }
 
     Sailfish::Secrets::Result createCollection(const QString &collectionName) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result createCollectionWithDurability(const QString &collectionName, Sailfish::Secrets::StoragePlugin::Durability durability) Q_DECL_OVERRIDE;
     Sailfish::Secrets::Result removeCollection(const QString &collectionName) Q_DECL_OVERRIDE;
     Sailfish::Secrets::Result setSecret(const QString &collectionName, const QString &secretName, const QByteArray &secret) Q_DECL_OVERRIDE;
     Sailfish::Secrets::Result getSecret(const QString &collectionName, const QString &secretName, QByteArray *secret) Q_DECL_OVERRIDE;
     Sailfish::Secrets::Result removeSecret(const QString &collectionName, const QString &secretName) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result getSecrets(const QString &collectionName, const QStringList &secretNames, QMap<QString, QByteArray> *secrets) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result setSecrets(const QString &collectionName, const QMap<QString, QByteArray> &secrets) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result removeSecrets(const QString &collectionName, const QStringList &secretNames) Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result enumerateSecrets(const QString &collectionName, const QString &cursor, int maxCount,
+                                               QMap<QString, QByteArray> *secrets, QString *nextCursor) Q_DECL_OVERRIDE;
 
     Sailfish::Secrets::Result reencryptSecrets(
             const QString &collectionName,          // non-empty, all secrets in this collection will be re-encrypted
@@ -62,7 +69,52 @@ public:
             const QByteArray &newkey,
             Sailfish::Secrets::EncryptionPlugin *plugin) Q_DECL_OVERRIDE;
 
+    void setWriteBatching(bool enabled) Q_DECL_OVERRIDE;
+    bool hasPendingWrites() const Q_DECL_OVERRIDE;
+    Sailfish::Secrets::Result flush() Q_DECL_OVERRIDE;
+
+    bool shareDatabaseConnection(const QString &connectionName, const QString &schemaName, QMutex *accessMutex) Q_DECL_OVERRIDE;
+
+    int performMaintenance(int pageBudget) Q_DECL_OVERRIDE;
+
+private:
+    QString durabilitySchema(Sailfish::Secrets::StoragePlugin::Durability durability) const;
+    QString lookupCollectionSchema(const QString &collectionName, QString *errorText);
+    QString collectionSchema(const QString &collectionName);
+
+public:
+    struct ReencryptedSecret {
+        QString collectionName;
+        QString secretName;
+        QByteArray encrypted;
+        QByteArray reencrypted;
+        Sailfish::Secrets::Result result;
+    };
+
 private:
+    Sailfish::Secrets::Result reencryptionProgressMarker(
+            const QString &collectionName,
+            QString *lastSecretName,
+            int *remaining);
+    Sailfish::Secrets::Result reencryptCollectionSecretsChunk(
+            const QString &collectionName,
+            const QByteArray &oldkey,
+            const QByteArray &newkey,
+            Sailfish::Secrets::EncryptionPlugin *plugin,
+            QString *lastSecretName,
+            bool *finished);
+    Sailfish::Secrets::Result reencryptStandaloneSecretsChunk(
+            const QStringList &secretNames,
+            const QByteArray &oldkey,
+            const QByteArray &newkey,
+            Sailfish::Secrets::EncryptionPlugin *plugin);
+    Sailfish::Secrets::Result writeReencryptedSecrets(
+            const QString &schema,
+            QVector<ReencryptedSecret> *chunk,
+            const QByteArray &oldkey,
+            const QByteArray &newkey,
+            Sailfish::Secrets::EncryptionPlugin *plugin);
+
     class DatabaseLocker : public QMutexLocker
     {
     public:
@@ -74,6 +126,7 @@ private:
         Sailfish::Secrets::Daemon::Plugins::Sqlite::Database *m_db;
     };
     Sailfish::Secrets::Daemon::Plugins::Sqlite::Database *m_db;
+    QHash<QString, QString> m_collectionSchemas; // collection name -> schema
 };
 
 } // namespace Plugins
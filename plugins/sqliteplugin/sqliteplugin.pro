@@ -3,6 +3,8 @@ CONFIG+=plugin
 TARGET=sailfishsecrets-sqlite
 TARGET = $$qtLibraryTarget($$TARGET)
 
+QT += concurrent
+
 include($$PWD/../../common.pri)
 include($$PWD/../../api/libsailfishsecrets/libsailfishsecrets.pri)
 
@@ -0,0 +1,14 @@
+TEMPLATE=lib
+CONFIG+=plugin
+TARGET=sailfishsecrets-testinmemory
+TARGET = $$qtLibraryTarget($$TARGET)
+
+include($$PWD/../../../common.pri)
+include($$PWD/../../../api/libsailfishsecrets/libsailfishsecrets.pri)
+
+DEFINES+=SAILFISH_SECRETS_BUILD_TEST_PLUGIN
+HEADERS+=$$PWD/../../inmemoryplugin/lockedmemory_p.h $$PWD/../../inmemoryplugin/plugin.h
+SOURCES+=$$PWD/../../inmemoryplugin/lockedmemory.cpp $$PWD/../../inmemoryplugin/plugin.cpp
+
+target.path=/usr/lib/sailfishsecrets/
+INSTALLS += target
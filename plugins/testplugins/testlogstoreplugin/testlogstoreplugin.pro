@@ -0,0 +1,14 @@
+TEMPLATE=lib
+CONFIG+=plugin
+TARGET=sailfishsecrets-testlogstore
+TARGET = $$qtLibraryTarget($$TARGET)
+
+include($$PWD/../../../common.pri)
+include($$PWD/../../../api/libsailfishsecrets/libsailfishsecrets.pri)
+
+DEFINES+=SAILFISH_SECRETS_BUILD_TEST_PLUGIN
+HEADERS+=$$PWD/../../logstoreplugin/logstore_p.h $$PWD/../../logstoreplugin/plugin.h
+SOURCES+=$$PWD/../../logstoreplugin/logstore.cpp $$PWD/../../logstoreplugin/plugin.cpp
+
+target.path=/usr/lib/sailfishsecrets/
+INSTALLS += target
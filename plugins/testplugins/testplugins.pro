@@ -1,12 +1,15 @@
 TEMPLATE=subdirs
 
 STORAGE_PLUGINS = \
-    testsqliteplugin
+    testsqliteplugin \
+    testinmemoryplugin \
+    testlogstoreplugin
 
 ENCRYPTION_PLUGINS = \
     testopensslplugin
 
-ENCRYPTEDSTORAGE_PLUGINS =
+ENCRYPTEDSTORAGE_PLUGINS = \
+    testsqlcipherplugin
 
 AUTHENTICATION_PLUGINS = \
     testinappauthplugin
@@ -0,0 +1,16 @@
+TEMPLATE=lib
+CONFIG+=plugin
+TARGET=sailfishsecrets-testsqlcipher
+TARGET = $$qtLibraryTarget($$TARGET)
+
+QT += sql
+
+include($$PWD/../../../common.pri)
+include($$PWD/../../../api/libsailfishsecrets/libsailfishsecrets.pri)
+
+DEFINES+=SAILFISH_SECRETS_BUILD_TEST_PLUGIN
+HEADERS+=$$PWD/../../sqlcipherplugin/plugin.h
+SOURCES+=$$PWD/../../sqlcipherplugin/plugin.cpp
+
+target.path=/usr/lib/sailfishsecrets/
+INSTALLS += target
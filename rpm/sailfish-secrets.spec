@@ -37,6 +37,7 @@ Group:      Applications/System
 BuildRequires:  pkgconfig(Qt5Core)
 BuildRequires:  pkgconfig(Qt5DBus)
 BuildRequires:  pkgconfig(dbus-1)
+BuildRequires:  pkgconfig(sqlite3)
 BuildRequires:  pkgconfig(libcrypto)
 BuildRequires:  qt5-plugin-sqldriver-sqlite
 Requires:   %{name} = %{version}-%{release}
@@ -148,10 +149,16 @@ rm -rf %{buildroot}
 %files -n sailfishsecretsdaemon
 %defattr(-,root,root,-)
 %{_bindir}/sailfishsecretsd
+/usr/lib/systemd/user/sailfish-secretsd.service
+/usr/lib/systemd/user/sailfish-secretsd.socket
+%{_datadir}/dbus-1/services/org.sailfishos.secrets.daemon.discovery.service
+%{_datadir}/dbus-1/services/org.sailfishos.crypto.daemon.discovery.service
 
 %files -n sailfishsecretsdaemonplugins
 %defattr(-,root,root,-)
 %{_libdir}/sailfishsecrets/libsailfishsecrets-inappauth.so
+%{_libdir}/sailfishsecrets/libsailfishsecrets-inmemory.so
+%{_libdir}/sailfishsecrets/libsailfishsecrets-logstore.so
 %{_libdir}/sailfishsecrets/libsailfishsecrets-openssl.so
 %{_libdir}/sailfishsecrets/libsailfishsecrets-sqlcipher.so
 %{_libdir}/sailfishsecrets/libsailfishsecrets-sqlite.so
@@ -164,13 +171,22 @@ rm -rf %{buildroot}
 %defattr(-,root,root,-)
 /opt/tests/Sailfish/Secrets/tst_secrets
 /opt/tests/Sailfish/Secrets/tst_secrets.qml
+/opt/tests/Sailfish/Secrets/bench_secrets
+/opt/tests/Sailfish/Secrets/bench_secrets.qml
+/opt/tests/Sailfish/Secrets/bench_secretsplugins
+/opt/tests/Sailfish/Secrets/secrets-loadgen
 %{_libdir}/sailfishsecrets/libsailfishsecrets-testinappauth.so
+%{_libdir}/sailfishsecrets/libsailfishsecrets-testinmemory.so
+%{_libdir}/sailfishsecrets/libsailfishsecrets-testlogstore.so
 %{_libdir}/sailfishsecrets/libsailfishsecrets-testopenssl.so
+%{_libdir}/sailfishsecrets/libsailfishsecrets-testsqlcipher.so
 %{_libdir}/sailfishsecrets/libsailfishsecrets-testsqlite.so
 
 %files -n libsailfishcrypto-tests
 %defattr(-,root,root,-)
 /opt/tests/Sailfish/Crypto/tst_crypto
+/opt/tests/Sailfish/Crypto/bench_crypto
+/opt/tests/Sailfish/Crypto/bench_cryptoplugins
 %{_libdir}/sailfishcrypto/libsailfishcrypto-testopenssl.so
 
 %post
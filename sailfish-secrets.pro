@@ -1,9 +1,10 @@
 TEMPLATE = subdirs
-SUBDIRS = api daemon plugins tests
+SUBDIRS = api daemon plugins tests tools
 
 daemon.depends = api
 plugins.depends = api
 tests.depends = api
+tools.depends = api
 
 OTHER_FILES += \
     $$PWD/LICENSE \
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include <QtTest>
+#include <QObject>
+#include <QEventLoop>
+#include <QTimer>
+#include <QDBusPendingCallWatcher>
+
+#include "Crypto/cryptomanager.h"
+#include "Crypto/key.h"
+#include "Crypto/result.h"
+
+namespace {
+    const int MaxWait = 10000;
+
+    // Processes events while waiting, as for the replies of the functional tests,
+    // but without polling, so that it doesn't add any latency to the measurement.
+    bool waitForReply(const QDBusPendingCall &call)
+    {
+        if (call.isFinished()) {
+            return true;
+        }
+
+        QEventLoop loop;
+        QDBusPendingCallWatcher watcher(call);
+        QObject::connect(&watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), &loop, SLOT(quit()));
+        QTimer::singleShot(MaxWait, &loop, SLOT(quit()));
+        loop.exec();
+        return call.isFinished();
+    }
+}
+
+// Benchmarks of the crypto operations which are performed most often,
+// which measure the round trip to the daemon running in autotest mode.
+// Run with e.g. "-csv -o bench_crypto.csv" or "-xml" for output which
+// can be compared across releases.
+class bench_crypto : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void encrypt_data();
+    void encrypt();
+    void decrypt_data();
+    void decrypt();
+    void sign_data();
+    void sign();
+    void verify_data();
+    void verify();
+
+private:
+    void addPayloadRows();
+    void addSignatureRows();
+    Sailfish::Crypto::Key generateKey(const Sailfish::Crypto::Key &keyTemplate);
+    const Sailfish::Crypto::Key &signingKey(int algorithm) const;
+    Sailfish::Crypto::Key::SignaturePadding signaturePadding(int algorithm) const;
+
+    Sailfish::Crypto::CryptoManager cm;
+    Sailfish::Crypto::Key m_aesKey;
+    Sailfish::Crypto::Key m_rsaKey;
+    Sailfish::Crypto::Key m_ecKey;
+};
+
+Sailfish::Crypto::Key bench_crypto::generateKey(const Sailfish::Crypto::Key &keyTemplate)
+{
+    QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply = cm.generateKey(
+            keyTemplate,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    if (!waitForReply(reply) || reply.isError()
+            || reply.argumentAt<0>().code() != Sailfish::Crypto::Result::Succeeded) {
+        return Sailfish::Crypto::Key();
+    }
+    return reply.argumentAt<1>();
+}
+
+void bench_crypto::initTestCase()
+{
+    // the keys are generated once, as generation isn't what is measured.
+    Sailfish::Crypto::Key keyTemplate;
+    keyTemplate.setAlgorithm(Sailfish::Crypto::Key::Aes256);
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setBlockModes(Sailfish::Crypto::Key::BlockModeCBC);
+    keyTemplate.setEncryptionPaddings(Sailfish::Crypto::Key::EncryptionPaddingNone);
+    keyTemplate.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone);
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+    m_aesKey = generateKey(keyTemplate);
+    QVERIFY(!m_aesKey.secretKey().isEmpty());
+
+    keyTemplate = Sailfish::Crypto::Key();
+    keyTemplate.setAlgorithm(Sailfish::Crypto::Key::Rsa2048);
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingRsaPkcs1);
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Sign | Sailfish::Crypto::Key::Verify);
+    m_rsaKey = generateKey(keyTemplate);
+    QVERIFY(!m_rsaKey.privateKey().isEmpty());
+
+    keyTemplate.setAlgorithm(Sailfish::Crypto::Key::NistEcc256);
+    keyTemplate.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone);
+    m_ecKey = generateKey(keyTemplate);
+    QVERIFY(!m_ecKey.privateKey().isEmpty());
+}
+
+void bench_crypto::addPayloadRows()
+{
+    QTest::addColumn<int>("payloadSize");
+
+    // multiples of the block size, as no padding is used.
+    QTest::newRow("16 bytes") << 16;
+    QTest::newRow("1024 bytes") << 1024;
+    QTest::newRow("65536 bytes") << 65536;
+    QTest::newRow("1048576 bytes") << 1048576;
+}
+
+void bench_crypto::addSignatureRows()
+{
+    QTest::addColumn<int>("algorithm");
+    QTest::addColumn<int>("payloadSize");
+
+    const int payloadSizes[] = { 16, 1024, 65536, 1048576 };
+    for (size_t i = 0; i < sizeof(payloadSizes) / sizeof(payloadSizes[0]); ++i) {
+        QTest::newRow(QByteArray("rsa2048 " + QByteArray::number(payloadSizes[i]) + " bytes").constData())
+                << static_cast<int>(Sailfish::Crypto::Key::Rsa2048) << payloadSizes[i];
+        QTest::newRow(QByteArray("ecc256 " + QByteArray::number(payloadSizes[i]) + " bytes").constData())
+                << static_cast<int>(Sailfish::Crypto::Key::NistEcc256) << payloadSizes[i];
+    }
+}
+
+const Sailfish::Crypto::Key &bench_crypto::signingKey(int algorithm) const
+{
+    return algorithm == Sailfish::Crypto::Key::Rsa2048 ? m_rsaKey : m_ecKey;
+}
+
+Sailfish::Crypto::Key::SignaturePadding bench_crypto::signaturePadding(int algorithm) const
+{
+    return algorithm == Sailfish::Crypto::Key::Rsa2048
+            ? Sailfish::Crypto::Key::SignaturePaddingRsaPkcs1
+            : Sailfish::Crypto::Key::SignaturePaddingNone;
+}
+
+void bench_crypto::encrypt_data()
+{
+    addPayloadRows();
+}
+
+void bench_crypto::encrypt()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray plaintext(payloadSize, 'p');
+    QBENCHMARK {
+        QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply = cm.encrypt(
+                plaintext,
+                m_aesKey,
+                Sailfish::Crypto::Key::BlockModeCBC,
+                Sailfish::Crypto::Key::EncryptionPaddingNone,
+                Sailfish::Crypto::Key::DigestSha256,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        QVERIFY(waitForReply(reply));
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    }
+}
+
+void bench_crypto::decrypt_data()
+{
+    addPayloadRows();
+}
+
+void bench_crypto::decrypt()
+{
+    QFETCH(int, payloadSize);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> encryptReply = cm.encrypt(
+            QByteArray(payloadSize, 'p'),
+            m_aesKey,
+            Sailfish::Crypto::Key::BlockModeCBC,
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    QVERIFY(waitForReply(encryptReply));
+    QCOMPARE(encryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    const QByteArray ciphertext = encryptReply.argumentAt<1>();
+
+    QBENCHMARK {
+        QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply = cm.decrypt(
+                ciphertext,
+                m_aesKey,
+                Sailfish::Crypto::Key::BlockModeCBC,
+                Sailfish::Crypto::Key::EncryptionPaddingNone,
+                Sailfish::Crypto::Key::DigestSha256,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        QVERIFY(waitForReply(reply));
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    }
+}
+
+void bench_crypto::sign_data()
+{
+    addSignatureRows();
+}
+
+void bench_crypto::sign()
+{
+    QFETCH(int, algorithm);
+    QFETCH(int, payloadSize);
+
+    const QByteArray data(payloadSize, 'd');
+    QBENCHMARK {
+        QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply = cm.sign(
+                data,
+                signingKey(algorithm),
+                signaturePadding(algorithm),
+                Sailfish::Crypto::Key::DigestSha256,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        QVERIFY(waitForReply(reply));
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    }
+}
+
+void bench_crypto::verify_data()
+{
+    addSignatureRows();
+}
+
+void bench_crypto::verify()
+{
+    QFETCH(int, algorithm);
+    QFETCH(int, payloadSize);
+
+    const QByteArray data(payloadSize, 'd');
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> signReply = cm.sign(
+            data,
+            signingKey(algorithm),
+            signaturePadding(algorithm),
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    QVERIFY(waitForReply(signReply));
+    QCOMPARE(signReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    const QByteArray signature = signReply.argumentAt<1>();
+
+    // verified with only the public key, as a client would.
+    Sailfish::Crypto::Key publicKey(signingKey(algorithm));
+    publicKey.setPrivateKey(QByteArray());
+    QBENCHMARK {
+        QDBusPendingReply<Sailfish::Crypto::Result, bool> reply = cm.verify(
+                data,
+                signature,
+                publicKey,
+                signaturePadding(algorithm),
+                Sailfish::Crypto::Key::DigestSha256,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        QVERIFY(waitForReply(reply));
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+        QCOMPARE(reply.argumentAt<1>(), true);
+    }
+}
+
+#include "bench_crypto.moc"
+QTEST_MAIN(bench_crypto)
@@ -0,0 +1,7 @@
+TEMPLATE = app
+TARGET = bench_crypto
+target.path = /opt/tests/Sailfish/Crypto/
+include($$PWD/../../api/libsailfishcrypto/libsailfishcrypto.pri)
+QT += testlib
+SOURCES += bench_crypto.cpp
+INSTALLS += target
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include <QtTest>
+#include <QObject>
+#include <QPluginLoader>
+
+#include "Crypto/extensionplugins.h"
+#include "Crypto/key.h"
+#include "Crypto/result.h"
+
+#include "evp_p.h"
+
+// Benchmarks of the crypto plugin called directly, without D-Bus or the
+// daemon's request queue, so that plugin cost can be told apart from IPC cost.
+// The test plugin build is loaded as the daemon loads it in autotest mode.
+class bench_cryptoplugins : public QObject
+{
+    Q_OBJECT
+
+public:
+    bench_cryptoplugins() : m_cipherContext(Q_NULLPTR), m_cryptoPlugin(Q_NULLPTR) {}
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void evpAesEncrypt_data();
+    void evpAesEncrypt();
+    void evpAesDecrypt_data();
+    void evpAesDecrypt();
+    void evpAesGcmEncrypt_data();
+    void evpAesGcmEncrypt();
+
+    void encrypt_data();
+    void encrypt();
+    void decrypt_data();
+    void decrypt();
+
+private:
+    void addPayloadRows();
+
+    osslevp_cipher_context *m_cipherContext;
+    QPluginLoader m_cryptoLoader;
+    Sailfish::Crypto::CryptoPlugin *m_cryptoPlugin;
+    Sailfish::Crypto::Key m_aesKey;
+};
+
+void bench_cryptoplugins::initTestCase()
+{
+    QVERIFY(osslevp_init());
+    m_cipherContext = osslevp_cipher_context_new();
+    QVERIFY(m_cipherContext);
+
+    m_cryptoLoader.setFileName(QStringLiteral("/usr/lib/sailfishcrypto/libsailfishcrypto-testopenssl.so"));
+    m_cryptoPlugin = qobject_cast<Sailfish::Crypto::CryptoPlugin*>(m_cryptoLoader.instance());
+    QVERIFY2(m_cryptoPlugin, qPrintable(m_cryptoLoader.errorString()));
+
+    Sailfish::Crypto::Key keyTemplate;
+    keyTemplate.setAlgorithm(Sailfish::Crypto::Key::Aes256);
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setBlockModes(Sailfish::Crypto::Key::BlockModeCBC);
+    keyTemplate.setEncryptionPaddings(Sailfish::Crypto::Key::EncryptionPaddingNone);
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+    QCOMPARE(m_cryptoPlugin->generateKey(keyTemplate, &m_aesKey).code(), Sailfish::Crypto::Result::Succeeded);
+    QVERIFY(!m_aesKey.secretKey().isEmpty());
+}
+
+void bench_cryptoplugins::cleanupTestCase()
+{
+    osslevp_cipher_context_free(m_cipherContext);
+    m_cryptoLoader.unload();
+}
+
+void bench_cryptoplugins::addPayloadRows()
+{
+    QTest::addColumn<int>("payloadSize");
+
+    // multiples of the block size, as no padding is used.
+    QTest::newRow("16 bytes") << 16;
+    QTest::newRow("1024 bytes") << 1024;
+    QTest::newRow("65536 bytes") << 65536;
+    QTest::newRow("1048576 bytes") << 1048576;
+}
+
+void bench_cryptoplugins::evpAesEncrypt_data()
+{
+    addPayloadRows();
+}
+
+void bench_cryptoplugins::evpAesEncrypt()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray plaintext(payloadSize, 'p');
+    const QByteArray key(32, 'k');
+    const QByteArray initVector(16, 'i');
+    QByteArray encrypted(payloadSize + AES_BLOCK_SIZE, Qt::Uninitialized);
+    QBENCHMARK {
+        QVERIFY(osslevp_aes_encrypt_plaintext(
+                m_cipherContext, EVP_aes_256_cbc(),
+                reinterpret_cast<const unsigned char *>(initVector.constData()),
+                reinterpret_cast<const unsigned char *>(key.constData()), key.size(),
+                reinterpret_cast<const unsigned char *>(plaintext.constData()), plaintext.size(),
+                reinterpret_cast<unsigned char *>(encrypted.data())) > 0);
+    }
+}
+
+void bench_cryptoplugins::evpAesDecrypt_data()
+{
+    addPayloadRows();
+}
+
+void bench_cryptoplugins::evpAesDecrypt()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray key(32, 'k');
+    const QByteArray initVector(16, 'i');
+    QByteArray encrypted(payloadSize + AES_BLOCK_SIZE, Qt::Uninitialized);
+    const int encryptedLength = osslevp_aes_encrypt_plaintext(
+            m_cipherContext, EVP_aes_256_cbc(),
+            reinterpret_cast<const unsigned char *>(initVector.constData()),
+            reinterpret_cast<const unsigned char *>(key.constData()), key.size(),
+            reinterpret_cast<const unsigned char *>(QByteArray(payloadSize, 'p').constData()), payloadSize,
+            reinterpret_cast<unsigned char *>(encrypted.data()));
+    QVERIFY(encryptedLength > 0);
+
+    QByteArray decrypted(encryptedLength + AES_BLOCK_SIZE, Qt::Uninitialized);
+    QBENCHMARK {
+        QVERIFY(osslevp_aes_decrypt_ciphertext(
+                m_cipherContext, EVP_aes_256_cbc(),
+                reinterpret_cast<const unsigned char *>(initVector.constData()),
+                reinterpret_cast<const unsigned char *>(key.constData()), key.size(),
+                reinterpret_cast<const unsigned char *>(encrypted.constData()), encryptedLength,
+                reinterpret_cast<unsigned char *>(decrypted.data())) >= 0);
+    }
+}
+
+void bench_cryptoplugins::evpAesGcmEncrypt_data()
+{
+    addPayloadRows();
+}
+
+void bench_cryptoplugins::evpAesGcmEncrypt()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray plaintext(payloadSize, 'p');
+    const QByteArray key(32, 'k');
+    const QByteArray initVector(12, 'i');
+    QByteArray encrypted(payloadSize, Qt::Uninitialized);
+    unsigned char tag[16];
+    QBENCHMARK {
+        QVERIFY(osslevp_aes_gcm_encrypt_plaintext(
+                m_cipherContext, EVP_aes_256_gcm(),
+                reinterpret_cast<const unsigned char *>(initVector.constData()), initVector.size(),
+                reinterpret_cast<const unsigned char *>(key.constData()), key.size(),
+                NULL, 0,
+                reinterpret_cast<const unsigned char *>(plaintext.constData()), plaintext.size(),
+                reinterpret_cast<unsigned char *>(encrypted.data()), tag) >= 0);
+    }
+}
+
+void bench_cryptoplugins::encrypt_data()
+{
+    addPayloadRows();
+}
+
+void bench_cryptoplugins::encrypt()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray plaintext(payloadSize, 'p');
+    QBENCHMARK {
+        QByteArray encrypted;
+        QCOMPARE(m_cryptoPlugin->encrypt(plaintext, m_aesKey,
+                                         Sailfish::Crypto::Key::BlockModeCBC,
+                                         Sailfish::Crypto::Key::EncryptionPaddingNone,
+                                         Sailfish::Crypto::Key::DigestSha256,
+                                         &encrypted).code(),
+                 Sailfish::Crypto::Result::Succeeded);
+    }
+}
+
+void bench_cryptoplugins::decrypt_data()
+{
+    addPayloadRows();
+}
+
+void bench_cryptoplugins::decrypt()
+{
+    QFETCH(int, payloadSize);
+
+    QByteArray encrypted;
+    QCOMPARE(m_cryptoPlugin->encrypt(QByteArray(payloadSize, 'p'), m_aesKey,
+                                     Sailfish::Crypto::Key::BlockModeCBC,
+                                     Sailfish::Crypto::Key::EncryptionPaddingNone,
+                                     Sailfish::Crypto::Key::DigestSha256,
+                                     &encrypted).code(),
+             Sailfish::Crypto::Result::Succeeded);
+
+    QBENCHMARK {
+        QByteArray decrypted;
+        QCOMPARE(m_cryptoPlugin->decrypt(encrypted, m_aesKey,
+                                         Sailfish::Crypto::Key::BlockModeCBC,
+                                         Sailfish::Crypto::Key::EncryptionPaddingNone,
+                                         Sailfish::Crypto::Key::DigestSha256,
+                                         &decrypted).code(),
+                 Sailfish::Crypto::Result::Succeeded);
+    }
+}
+
+#include "bench_cryptoplugins.moc"
+QTEST_MAIN(bench_cryptoplugins)
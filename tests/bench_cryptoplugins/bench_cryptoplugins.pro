@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = bench_cryptoplugins
+target.path = /opt/tests/Sailfish/Crypto/
+include($$PWD/../../api/libsailfishcrypto/libsailfishcrypto.pri)
+QT += testlib
+CONFIG += link_pkgconfig
+PKGCONFIG += libcrypto
+INCLUDEPATH += $$PWD/../../plugins/opensslcryptoplugin
+SOURCES += bench_cryptoplugins.cpp
+INSTALLS += target
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include <QtTest>
+#include <QObject>
+#include <QEventLoop>
+#include <QTimer>
+#include <QDBusPendingCallWatcher>
+#include <QQuickView>
+#include <QQuickItem>
+
+#include "Secrets/secretmanager.h"
+#include "Secrets/secret.h"
+
+namespace {
+    const int MaxWait = 10000;
+
+    // the number of requests which are in flight at once in the throughput benchmarks.
+    const int PipelineDepth = 32;
+
+    // Unlike waitForFinished(), this processes events while waiting, as the
+    // ui flows of custom lock collections require event handling; and unlike
+    // polling it doesn't add any latency to the measurement.
+    bool waitForReply(const QDBusPendingCall &call)
+    {
+        if (call.isFinished()) {
+            return true;
+        }
+
+        QEventLoop loop;
+        QDBusPendingCallWatcher watcher(call);
+        QObject::connect(&watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), &loop, SLOT(quit()));
+        QTimer::singleShot(MaxWait, &loop, SLOT(quit()));
+        loop.exec();
+        return call.isFinished();
+    }
+
+    QString secretName(int index)
+    {
+        return QStringLiteral("benchsecret%1").arg(index);
+    }
+}
+
+// Benchmarks of the secrets requests which are performed most often,
+// which measure the round trip to the daemon running in autotest mode.
+// Run with e.g. "-csv -o bench_secrets.csv" or "-xml" for output which
+// can be compared across releases.
+class bench_secrets : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void init();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void getSecret_data();
+    void getSecret();
+    void getSecretThroughput_data();
+    void getSecretThroughput();
+    void setSecret_data();
+    void setSecret();
+    void deleteSecrets_data();
+    void deleteSecrets();
+
+private:
+    void addRows();
+    bool createCollection(int collectionSize, int secretSize, bool customLock);
+    bool deleteCollection();
+
+    QQuickView *m_view;
+    Sailfish::Secrets::SecretManager m;
+};
+
+void bench_secrets::initTestCase()
+{
+    // construct the in-process authentication key UI, used by the custom lock collections.
+    m_view = new QQuickView(QUrl::fromLocalFile(QStringLiteral("%1/bench_secrets.qml").arg(QCoreApplication::applicationDirPath())));
+    m_view->show();
+    QObject *uiView = m_view->rootObject()->findChild<QObject*>("uiview");
+    QVERIFY(uiView);
+    QMetaObject::invokeMethod(uiView, "setSecretManager", Qt::DirectConnection, Q_ARG(QObject*, &m));
+}
+
+void bench_secrets::cleanupTestCase()
+{
+    delete m_view;
+}
+
+void bench_secrets::init()
+{
+    // a collection left behind by a failed or interrupted row would fail the next one.
+    deleteCollection();
+}
+
+void bench_secrets::addRows()
+{
+    QTest::addColumn<int>("collectionSize");
+    QTest::addColumn<int>("secretSize");
+    QTest::addColumn<bool>("customLock");
+
+    const int collectionSizes[] = { 1, 64, 512 };
+    const int secretSizes[] = { 16, 1024, 65536 };
+    for (int lock = 0; lock < 2; ++lock) {
+        for (size_t i = 0; i < sizeof(collectionSizes) / sizeof(collectionSizes[0]); ++i) {
+            for (size_t j = 0; j < sizeof(secretSizes) / sizeof(secretSizes[0]); ++j) {
+                const QByteArray tag = QStringLiteral("%1 %2 secrets %3 bytes")
+                        .arg(lock ? QLatin1String("customlock") : QLatin1String("devicelock"))
+                        .arg(collectionSizes[i]).arg(secretSizes[j]).toLatin1();
+                QTest::newRow(tag.constData()) << collectionSizes[i] << secretSizes[j] << bool(lock);
+            }
+        }
+    }
+}
+
+bool bench_secrets::createCollection(int collectionSize, int secretSize, bool customLock)
+{
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = customLock
+            ? m.createCollection(
+                    QLatin1String("benchcollection"),
+                    Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                    Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                    Sailfish::Secrets::SecretManager::InAppAuthenticationPluginName,
+                    Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked,
+                    0,
+                    Sailfish::Secrets::SecretManager::OwnerOnlyMode,
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode)
+            : m.createCollection(
+                    QLatin1String("benchcollection"),
+                    Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                    Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                    Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                    Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    if (!waitForReply(reply) || reply.isError()
+            || reply.argumentAt<0>().code() != Sailfish::Secrets::Result::Succeeded) {
+        return false;
+    }
+
+    QMap<QString, QByteArray> batch;
+    for (int i = 0; i < collectionSize; ++i) {
+        batch.insert(secretName(i), QByteArray(secretSize, char('a' + i % 26)));
+    }
+    reply = m.setSecrets(
+                QLatin1String("benchcollection"),
+                batch,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    return waitForReply(reply) && !reply.isError()
+            && reply.argumentAt<0>().code() == Sailfish::Secrets::Result::Succeeded;
+}
+
+bool bench_secrets::deleteCollection()
+{
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.deleteCollection(
+                QLatin1String("benchcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    return waitForReply(reply) && !reply.isError()
+            && reply.argumentAt<0>().code() == Sailfish::Secrets::Result::Succeeded;
+}
+
+void bench_secrets::getSecret_data()
+{
+    addRows();
+}
+
+void bench_secrets::getSecret()
+{
+    QFETCH(int, collectionSize);
+    QFETCH(int, secretSize);
+    QFETCH(bool, customLock);
+    QVERIFY(createCollection(collectionSize, secretSize, customLock));
+
+    int index = 0;
+    QBENCHMARK {
+        QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> reply = m.getSecret(
+                    QLatin1String("benchcollection"),
+                    secretName(index++ % collectionSize),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        QVERIFY(waitForReply(reply));
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QCOMPARE(reply.argumentAt<1>().size(), secretSize);
+    }
+
+    QVERIFY(deleteCollection());
+}
+
+void bench_secrets::getSecretThroughput_data()
+{
+    addRows();
+}
+
+void bench_secrets::getSecretThroughput()
+{
+    QFETCH(int, collectionSize);
+    QFETCH(int, secretSize);
+    QFETCH(bool, customLock);
+    QVERIFY(createCollection(collectionSize, secretSize, customLock));
+
+    // each iteration measures PipelineDepth requests which are queued by the daemon together.
+    QBENCHMARK {
+        QList<QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> > replies;
+        for (int i = 0; i < PipelineDepth; ++i) {
+            replies.append(m.getSecret(
+                    QLatin1String("benchcollection"),
+                    secretName(i % collectionSize),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode));
+        }
+        for (int i = 0; i < replies.size(); ++i) {
+            QVERIFY(waitForReply(replies.at(i)));
+            QCOMPARE(replies.at(i).argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        }
+    }
+
+    QVERIFY(deleteCollection());
+}
+
+void bench_secrets::setSecret_data()
+{
+    addRows();
+}
+
+void bench_secrets::setSecret()
+{
+    QFETCH(int, collectionSize);
+    QFETCH(int, secretSize);
+    QFETCH(bool, customLock);
+    QVERIFY(createCollection(collectionSize, secretSize, customLock));
+
+    // existing secrets are overwritten, so that the collection size stays the same.
+    const QByteArray data(secretSize, 'z');
+    int index = 0;
+    QBENCHMARK {
+        QDBusPendingReply<Sailfish::Secrets::Result> reply = m.setSecret(
+                    QLatin1String("benchcollection"),
+                    secretName(index++ % collectionSize),
+                    data,
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        QVERIFY(waitForReply(reply));
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QVERIFY(deleteCollection());
+}
+
+void bench_secrets::deleteSecrets_data()
+{
+    addRows();
+}
+
+void bench_secrets::deleteSecrets()
+{
+    QFETCH(int, collectionSize);
+    QFETCH(int, secretSize);
+    QFETCH(bool, customLock);
+    QVERIFY(createCollection(collectionSize, secretSize, customLock));
+
+    // a secret can only be deleted once, so this measures emptying the whole collection.
+    QBENCHMARK_ONCE {
+        for (int i = 0; i < collectionSize; ++i) {
+            QDBusPendingReply<Sailfish::Secrets::Result> reply = m.deleteSecret(
+                        QLatin1String("benchcollection"),
+                        secretName(i),
+                        Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+            QVERIFY(waitForReply(reply));
+            QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        }
+    }
+
+    QVERIFY(deleteCollection());
+}
+
+#include "bench_secrets.moc"
+QTEST_MAIN(bench_secrets)
@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = bench_secrets
+target.path = /opt/tests/Sailfish/Secrets/
+include($$PWD/../../api/libsailfishsecrets/libsailfishsecrets.pri)
+QT += testlib gui qml quick
+SOURCES += bench_secrets.cpp
+OTHER_FILES += bench_secrets.qml
+testdata.files += bench_secrets.qml
+testdata.path = /opt/tests/Sailfish/Secrets/
+INSTALLS += target testdata
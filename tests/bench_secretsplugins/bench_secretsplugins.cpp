@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include <QtTest>
+#include <QObject>
+#include <QPluginLoader>
+#include <QTemporaryDir>
+
+#include "Secrets/extensionplugins.h"
+#include "Secrets/result.h"
+
+#include "evp_p.h"
+
+namespace {
+    const int CollectionSecrets = 64;
+
+    QString secretName(int index)
+    {
+        return QStringLiteral("benchsecret%1").arg(index);
+    }
+}
+
+// Benchmarks of the secrets plugins called directly, without D-Bus or the
+// daemon's request queue, so that plugin cost can be told apart from IPC cost.
+// The test plugin builds are loaded as the daemon loads them in autotest
+// mode, with the sqlite database kept in a temporary directory.
+class bench_secretsplugins : public QObject
+{
+    Q_OBJECT
+
+public:
+    bench_secretsplugins() : m_encryptionPlugin(Q_NULLPTR), m_storagePlugin(Q_NULLPTR) {}
+
+public slots:
+    void init();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void evpAesEncrypt_data();
+    void evpAesEncrypt();
+    void evpAesEncryptWithContext_data();
+    void evpAesEncryptWithContext();
+    void evpAesGcmEncryptWithContext_data();
+    void evpAesGcmEncryptWithContext();
+
+    void encryptSecret_data();
+    void encryptSecret();
+    void decryptSecret_data();
+    void decryptSecret();
+
+    void storageSetSecret_data();
+    void storageSetSecret();
+    void storageGetSecret_data();
+    void storageGetSecret();
+    void storageReencryptSecrets_data();
+    void storageReencryptSecrets();
+
+private:
+    void addPayloadRows();
+    bool populateCollection(int collectionSize, int secretSize, const QByteArray &key);
+
+    QTemporaryDir m_dataDir;
+    QPluginLoader m_encryptionLoader;
+    QPluginLoader m_storageLoader;
+    Sailfish::Secrets::EncryptionPlugin *m_encryptionPlugin;
+    Sailfish::Secrets::StoragePlugin *m_storagePlugin;
+};
+
+void bench_secretsplugins::initTestCase()
+{
+    QVERIFY(m_dataDir.isValid());
+    // the sqlite plugin opens its database when it is instantiated.
+    qputenv("XDG_DATA_HOME", m_dataDir.path().toUtf8());
+
+    QVERIFY(osslevp_init());
+
+    m_encryptionLoader.setFileName(QStringLiteral("/usr/lib/sailfishsecrets/libsailfishsecrets-testopenssl.so"));
+    m_encryptionPlugin = qobject_cast<Sailfish::Secrets::EncryptionPlugin*>(m_encryptionLoader.instance());
+    QVERIFY2(m_encryptionPlugin, qPrintable(m_encryptionLoader.errorString()));
+
+    m_storageLoader.setFileName(QStringLiteral("/usr/lib/sailfishsecrets/libsailfishsecrets-testsqlite.so"));
+    m_storagePlugin = qobject_cast<Sailfish::Secrets::StoragePlugin*>(m_storageLoader.instance());
+    QVERIFY2(m_storagePlugin, qPrintable(m_storageLoader.errorString()));
+}
+
+void bench_secretsplugins::cleanupTestCase()
+{
+    m_storageLoader.unload();
+    m_encryptionLoader.unload();
+}
+
+void bench_secretsplugins::init()
+{
+    // a collection left behind by a failed row would fail the next one.
+    if (m_storagePlugin) {
+        m_storagePlugin->removeCollection(QLatin1String("benchcollection"));
+    }
+}
+
+void bench_secretsplugins::addPayloadRows()
+{
+    QTest::addColumn<int>("payloadSize");
+
+    QTest::newRow("16 bytes") << 16;
+    QTest::newRow("1024 bytes") << 1024;
+    QTest::newRow("65536 bytes") << 65536;
+    QTest::newRow("1048576 bytes") << 1048576;
+}
+
+bool bench_secretsplugins::populateCollection(int collectionSize, int secretSize, const QByteArray &key)
+{
+    if (m_storagePlugin->createCollection(QLatin1String("benchcollection")).code() != Sailfish::Secrets::Result::Succeeded) {
+        return false;
+    }
+
+    // stored encrypted, as the daemon stores them, so that they can be re-encrypted.
+    QMap<QString, QByteArray> secrets;
+    for (int i = 0; i < collectionSize; ++i) {
+        QByteArray encrypted;
+        if (m_encryptionPlugin->encryptSecret(QByteArray(secretSize, char('a' + i % 26)), key, &encrypted).code()
+                != Sailfish::Secrets::Result::Succeeded) {
+            return false;
+        }
+        secrets.insert(secretName(i), encrypted);
+    }
+    return m_storagePlugin->setSecrets(QLatin1String("benchcollection"), secrets).code() == Sailfish::Secrets::Result::Succeeded;
+}
+
+void bench_secretsplugins::evpAesEncrypt_data()
+{
+    addPayloadRows();
+}
+
+void bench_secretsplugins::evpAesEncrypt()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray plaintext(payloadSize, 'p');
+    const QByteArray key(32, 'k');
+    const QByteArray initVector(16, 'i');
+    QBENCHMARK {
+        unsigned char *encrypted = NULL;
+        const int encryptedLength = osslevp_aes_encrypt_plaintext(
+                reinterpret_cast<const unsigned char *>(initVector.constData()),
+                reinterpret_cast<const unsigned char *>(key.constData()), key.size(),
+                reinterpret_cast<const unsigned char *>(plaintext.constData()), plaintext.size(),
+                &encrypted);
+        free(encrypted);
+        QVERIFY(encryptedLength > 0);
+    }
+}
+
+void bench_secretsplugins::evpAesEncryptWithContext_data()
+{
+    addPayloadRows();
+}
+
+void bench_secretsplugins::evpAesEncryptWithContext()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray plaintext(payloadSize, 'p');
+    const QByteArray key(32, 'k');
+    const QByteArray initVector(16, 'i');
+    EVP_CIPHER_CTX prepared;
+    QVERIFY(osslevp_aes_prepare_context(&prepared, 1,
+            reinterpret_cast<const unsigned char *>(initVector.constData()),
+            reinterpret_cast<const unsigned char *>(key.constData()), key.size()));
+
+    int encryptedLength = 0;
+    QBENCHMARK {
+        unsigned char *encrypted = NULL;
+        encryptedLength = osslevp_aes_crypt_with_context(
+                &prepared,
+                reinterpret_cast<const unsigned char *>(plaintext.constData()), plaintext.size(),
+                &encrypted);
+        free(encrypted);
+    }
+
+    EVP_CIPHER_CTX_cleanup(&prepared);
+    QVERIFY(encryptedLength > 0);
+}
+
+void bench_secretsplugins::evpAesGcmEncryptWithContext_data()
+{
+    addPayloadRows();
+}
+
+void bench_secretsplugins::evpAesGcmEncryptWithContext()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray plaintext(payloadSize, 'p');
+    const QByteArray key(32, 'k');
+    EVP_CIPHER_CTX prepared;
+    QVERIFY(osslevp_aes_gcm_prepare_context(&prepared, 1,
+            reinterpret_cast<const unsigned char *>(key.constData()), key.size()));
+
+    int encryptedLength = 0;
+    QBENCHMARK {
+        unsigned char *encrypted = NULL;
+        encryptedLength = osslevp_aes_gcm_encrypt_with_context(
+                &prepared,
+                reinterpret_cast<const unsigned char *>(plaintext.constData()), plaintext.size(),
+                &encrypted);
+        free(encrypted);
+    }
+
+    EVP_CIPHER_CTX_cleanup(&prepared);
+    QVERIFY(encryptedLength > 0);
+}
+
+void bench_secretsplugins::encryptSecret_data()
+{
+    addPayloadRows();
+}
+
+void bench_secretsplugins::encryptSecret()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray plaintext(payloadSize, 'p');
+    const QByteArray key(32, 'k');
+    QBENCHMARK {
+        QByteArray encrypted;
+        QCOMPARE(m_encryptionPlugin->encryptSecret(plaintext, key, &encrypted).code(),
+                 Sailfish::Secrets::Result::Succeeded);
+    }
+    m_encryptionPlugin->releaseKey(key);
+}
+
+void bench_secretsplugins::decryptSecret_data()
+{
+    addPayloadRows();
+}
+
+void bench_secretsplugins::decryptSecret()
+{
+    QFETCH(int, payloadSize);
+
+    const QByteArray key(32, 'k');
+    QByteArray encrypted;
+    QCOMPARE(m_encryptionPlugin->encryptSecret(QByteArray(payloadSize, 'p'), key, &encrypted).code(),
+             Sailfish::Secrets::Result::Succeeded);
+
+    QBENCHMARK {
+        QByteArray decrypted;
+        QCOMPARE(m_encryptionPlugin->decryptSecret(encrypted, key, &decrypted).code(),
+                 Sailfish::Secrets::Result::Succeeded);
+    }
+    m_encryptionPlugin->releaseKey(key);
+}
+
+void bench_secretsplugins::storageSetSecret_data()
+{
+    addPayloadRows();
+}
+
+void bench_secretsplugins::storageSetSecret()
+{
+    QFETCH(int, payloadSize);
+    QVERIFY(populateCollection(CollectionSecrets, payloadSize, QByteArray(32, 'k')));
+
+    // existing secrets are overwritten, so that the collection size stays the same.
+    const QByteArray data(payloadSize, 'z');
+    int index = 0;
+    QBENCHMARK {
+        QCOMPARE(m_storagePlugin->setSecret(QLatin1String("benchcollection"), secretName(index++ % CollectionSecrets), data).code(),
+                 Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QCOMPARE(m_storagePlugin->removeCollection(QLatin1String("benchcollection")).code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void bench_secretsplugins::storageGetSecret_data()
+{
+    addPayloadRows();
+}
+
+void bench_secretsplugins::storageGetSecret()
+{
+    QFETCH(int, payloadSize);
+    QVERIFY(populateCollection(CollectionSecrets, payloadSize, QByteArray(32, 'k')));
+
+    int index = 0;
+    QBENCHMARK {
+        QByteArray secret;
+        QCOMPARE(m_storagePlugin->getSecret(QLatin1String("benchcollection"), secretName(index++ % CollectionSecrets), &secret).code(),
+                 Sailfish::Secrets::Result::Succeeded);
+    }
+
+    QCOMPARE(m_storagePlugin->removeCollection(QLatin1String("benchcollection")).code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void bench_secretsplugins::storageReencryptSecrets_data()
+{
+    QTest::addColumn<int>("collectionSize");
+    QTest::addColumn<int>("payloadSize");
+
+    QTest::newRow("64 secrets 16 bytes") << 64 << 16;
+    QTest::newRow("64 secrets 1024 bytes") << 64 << 1024;
+    QTest::newRow("512 secrets 16 bytes") << 512 << 16;
+    QTest::newRow("512 secrets 1024 bytes") << 512 << 1024;
+}
+
+void bench_secretsplugins::storageReencryptSecrets()
+{
+    QFETCH(int, collectionSize);
+    QFETCH(int, payloadSize);
+
+    QByteArray oldKey(32, 'k');
+    QByteArray newKey(32, 'n');
+    QVERIFY(populateCollection(collectionSize, payloadSize, oldKey));
+
+    // the keys are swapped after each pass, so that every iteration re-encrypts the whole collection.
+    QBENCHMARK {
+        QCOMPARE(m_storagePlugin->reencryptSecrets(QLatin1String("benchcollection"), QVector<QString>(),
+                                                   oldKey, newKey, m_encryptionPlugin).code(),
+                 Sailfish::Secrets::Result::Succeeded);
+        qSwap(oldKey, newKey);
+    }
+
+    m_encryptionPlugin->releaseKey(oldKey);
+    m_encryptionPlugin->releaseKey(newKey);
+    QCOMPARE(m_storagePlugin->removeCollection(QLatin1String("benchcollection")).code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+#include "bench_secretsplugins.moc"
+QTEST_MAIN(bench_secretsplugins)
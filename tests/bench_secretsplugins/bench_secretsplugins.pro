@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = bench_secretsplugins
+target.path = /opt/tests/Sailfish/Secrets/
+include($$PWD/../../api/libsailfishsecrets/libsailfishsecrets.pri)
+QT += testlib
+CONFIG += link_pkgconfig
+PKGCONFIG += libcrypto
+INCLUDEPATH += $$PWD/../../plugins/opensslplugin
+SOURCES += bench_secretsplugins.cpp
+INSTALLS += target
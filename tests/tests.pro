@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = tst_secrets tst_crypto
+SUBDIRS = tst_secrets tst_crypto bench_secrets bench_crypto bench_secretsplugins bench_cryptoplugins
@@ -8,12 +8,18 @@
 #include <QtTest>
 #include <QObject>
 #include <QDBusReply>
+#include <QDBusInterface>
+#include <QDBusArgument>
+#include <QBuffer>
+#include <QDataStream>
 
 #include "Crypto/cryptomanager.h"
 #include "Crypto/key.h"
 #include "Crypto/result.h"
 #include "Crypto/x509certificate.h"
 
+#include <signal.h>
+
 // Cannot use waitForFinished() for some replies, as ui flows require user interaction / event handling.
 #define WAIT_FOR_FINISHED_WITHOUT_BLOCKING(dbusreply)       \
     do {                                                    \
@@ -24,6 +30,46 @@
         }                                                   \
     } while (0)
 
+namespace {
+    // Nested maps and lists in a DBus reply are received as QDBusArguments.
+    QVariant demarshall(const QVariant &value)
+    {
+        if (value.userType() != qMetaTypeId<QDBusArgument>()) {
+            return value;
+        }
+        const QDBusArgument argument = value.value<QDBusArgument>();
+        if (argument.currentType() == QDBusArgument::MapType) {
+            QVariantMap map = qdbus_cast<QVariantMap>(argument);
+            for (QVariantMap::iterator it = map.begin(); it != map.end(); ++it) {
+                *it = demarshall(*it);
+            }
+            return map;
+        } else if (argument.currentType() == QDBusArgument::ArrayType) {
+            QVariantList list = qdbus_cast<QVariantList>(argument);
+            for (QVariantList::iterator it = list.begin(); it != list.end(); ++it) {
+                *it = demarshall(*it);
+            }
+            return list;
+        }
+        return value;
+    }
+
+    // The host processes of the plugin, which are only reported if the daemon was
+    // started with e.g. SAILFISH_SECRETSD_CRYPTO_PLUGIN_HOSTS=<plugin name>:1
+    QVariantList pluginHosts(const QString &pluginName)
+    {
+        QDBusInterface statistics(QStringLiteral("org.sailfishos.secrets.daemon.statistics"),
+                                  QStringLiteral("/Sailfish/Secrets/Statistics"),
+                                  QStringLiteral("org.sailfishos.secrets.daemon.statistics"));
+        QDBusReply<QVariantMap> reply = statistics.call(QStringLiteral("statistics"));
+        if (!reply.isValid()) {
+            return QVariantList();
+        }
+        const QVariantMap crypto = demarshall(reply.value().value(QStringLiteral("crypto"))).toMap();
+        return crypto.value(QStringLiteral("pluginHosts")).toMap().value(pluginName).toList();
+    }
+}
+
 class tst_crypto : public QObject
 {
     Q_OBJECT
@@ -35,7 +81,19 @@ public slots:
 private slots:
     void getPluginInfo();
     void generateKeyEncryptDecrypt();
+    void cipherSessionEncryptDecrypt();
+    void generateKeySignVerify_data();
+    void generateKeySignVerify();
+    void encryptDecryptBlockModes_data();
+    void encryptDecryptBlockModes();
+    void batchSignVerifyEncrypt();
+    void digestAndMac();
+    void generateRandomData();
+    void hostedPluginOperations();
+    void hostedPluginHostExit();
     void validateCertificateChain();
+    void keySerialisation();
+    void findKeys();
 
 private:
     Sailfish::Crypto::CryptoManager cm;
@@ -58,6 +116,16 @@ void tst_crypto::getPluginInfo()
     QVector<Sailfish::Crypto::CryptoPluginInfo> cryptoPlugins = reply.argumentAt<1>();
     QVERIFY(cryptoPlugins.size());
     QCOMPARE(cryptoPlugins.first().name(), QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+
+    // the cached plugin info is the same, whether or not it was fetched on this call.
+    for (int i = 0; i < 2; ++i) {
+        QVector<Sailfish::Crypto::CryptoPluginInfo> cachedCryptoPlugins;
+        QStringList cachedStoragePlugins;
+        QCOMPARE(cm.cachedPluginInfo(&cachedCryptoPlugins, &cachedStoragePlugins).code(), Sailfish::Crypto::Result::Succeeded);
+        QCOMPARE(cachedCryptoPlugins.size(), cryptoPlugins.size());
+        QCOMPARE(cachedCryptoPlugins.first().name(), cryptoPlugins.first().name());
+        QCOMPARE(cachedStoragePlugins, reply.argumentAt<2>());
+    }
 }
 
 void tst_crypto::generateKeyEncryptDecrypt()
@@ -113,6 +181,631 @@ void tst_crypto::generateKeyEncryptDecrypt()
     QCOMPARE(decrypted, plaintext);
 }
 
+void tst_crypto::cipherSessionEncryptDecrypt()
+{
+    Sailfish::Crypto::Key keyTemplate;
+    keyTemplate.setAlgorithm(Sailfish::Crypto::Key::Aes256);
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setBlockModes(Sailfish::Crypto::Key::BlockModeCBC);
+    keyTemplate.setEncryptionPaddings(Sailfish::Crypto::Key::EncryptionPaddingNone);
+    keyTemplate.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone);
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply = cm.generateKey(
+            keyTemplate,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    Sailfish::Crypto::Key fullKey = reply.argumentAt<1>();
+    QVERIFY(!fullKey.secretKey().isEmpty());
+
+    // encrypt the plaintext in chunks which are not a multiple of the block size.
+    QByteArray plaintext;
+    for (int i = 0; i < 100; ++i) {
+        plaintext.append(QByteArray::number(i)).append(" Test plaintext data ");
+    }
+
+    QByteArray encrypted;
+    QDBusPendingReply<Sailfish::Crypto::Result, quint32> initReply = cm.initialiseCipherSession(
+            fullKey,
+            Sailfish::Crypto::Key::Encrypt,
+            Sailfish::Crypto::Key::BlockModeCBC,
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(initReply);
+    QVERIFY(initReply.isValid());
+    QCOMPARE(initReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    quint32 cipherSessionToken = initReply.argumentAt<1>();
+    for (int offset = 0; offset < plaintext.size(); offset += 37) {
+        QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> updateReply = cm.updateCipherSession(
+                plaintext.mid(offset, 37),
+                cipherSessionToken,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        WAIT_FOR_FINISHED_WITHOUT_BLOCKING(updateReply);
+        QVERIFY(updateReply.isValid());
+        QCOMPARE(updateReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+        encrypted.append(updateReply.argumentAt<1>());
+    }
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> finalReply = cm.finaliseCipherSession(
+            cipherSessionToken,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(finalReply);
+    QVERIFY(finalReply.isValid());
+    QCOMPARE(finalReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    encrypted.append(finalReply.argumentAt<1>());
+
+    // the session output must match that of a single encrypt() call.
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> encryptReply = cm.encrypt(
+            plaintext,
+            fullKey,
+            Sailfish::Crypto::Key::BlockModeCBC,
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(encryptReply);
+    QVERIFY(encryptReply.isValid());
+    QCOMPARE(encryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(encrypted, encryptReply.argumentAt<1>());
+
+    // the finalised session may not be used again.
+    finalReply = cm.finaliseCipherSession(
+            cipherSessionToken,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(finalReply);
+    QVERIFY(finalReply.isValid());
+    QCOMPARE(finalReply.argumentAt<0>().errorCode(), Sailfish::Crypto::Result::CryptoPluginInvalidCipherSessionToken);
+
+    // decrypt the ciphertext in a session, and ensure that the roundtrip works.
+    QByteArray decrypted;
+    initReply = cm.initialiseCipherSession(
+            fullKey,
+            Sailfish::Crypto::Key::Decrypt,
+            Sailfish::Crypto::Key::BlockModeCBC,
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(initReply);
+    QVERIFY(initReply.isValid());
+    QCOMPARE(initReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    cipherSessionToken = initReply.argumentAt<1>();
+    for (int offset = 0; offset < encrypted.size(); offset += 100) {
+        QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> updateReply = cm.updateCipherSession(
+                encrypted.mid(offset, 100),
+                cipherSessionToken,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        WAIT_FOR_FINISHED_WITHOUT_BLOCKING(updateReply);
+        QVERIFY(updateReply.isValid());
+        QCOMPARE(updateReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+        decrypted.append(updateReply.argumentAt<1>());
+    }
+    finalReply = cm.finaliseCipherSession(
+            cipherSessionToken,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(finalReply);
+    QVERIFY(finalReply.isValid());
+    QCOMPARE(finalReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    decrypted.append(finalReply.argumentAt<1>());
+    QCOMPARE(decrypted, plaintext);
+}
+
+void tst_crypto::generateKeySignVerify_data()
+{
+    QTest::addColumn<int>("algorithm");
+    QTest::addColumn<int>("padding");
+
+    QTest::newRow("rsa pss") << static_cast<int>(Sailfish::Crypto::Key::Rsa2048) << static_cast<int>(Sailfish::Crypto::Key::SignaturePaddingRsaPss);
+    QTest::newRow("rsa pkcs1") << static_cast<int>(Sailfish::Crypto::Key::Rsa2048) << static_cast<int>(Sailfish::Crypto::Key::SignaturePaddingRsaPkcs1);
+    QTest::newRow("ecdsa") << static_cast<int>(Sailfish::Crypto::Key::NistEcc256) << static_cast<int>(Sailfish::Crypto::Key::SignaturePaddingNone);
+}
+
+void tst_crypto::generateKeySignVerify()
+{
+    QFETCH(int, algorithm);
+    QFETCH(int, padding);
+
+    // test generating an asymmetric key pair
+    Sailfish::Crypto::Key keyTemplate;
+    keyTemplate.setAlgorithm(static_cast<Sailfish::Crypto::Key::Algorithm>(algorithm));
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setSignaturePaddings(static_cast<Sailfish::Crypto::Key::SignaturePadding>(padding));
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Sign | Sailfish::Crypto::Key::Verify);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply = cm.generateKey(
+            keyTemplate,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    Sailfish::Crypto::Key fullKey = reply.argumentAt<1>();
+    QVERIFY(!fullKey.privateKey().isEmpty());
+    QVERIFY(!fullKey.publicKey().isEmpty());
+
+    // test signing some data with the private key
+    QByteArray data = "Test data to sign";
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> signReply = cm.sign(
+            data,
+            fullKey,
+            static_cast<Sailfish::Crypto::Key::SignaturePadding>(padding),
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(signReply);
+    QVERIFY(signReply.isValid());
+    QCOMPARE(signReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QByteArray signature = signReply.argumentAt<1>();
+    QVERIFY(!signature.isEmpty());
+
+    // test verifying the signature with only the public key
+    Sailfish::Crypto::Key publicKey(fullKey);
+    publicKey.setPrivateKey(QByteArray());
+    QDBusPendingReply<Sailfish::Crypto::Result, bool> verifyReply = cm.verify(
+            data,
+            signature,
+            publicKey,
+            static_cast<Sailfish::Crypto::Key::SignaturePadding>(padding),
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(verifyReply);
+    QVERIFY(verifyReply.isValid());
+    QCOMPARE(verifyReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(verifyReply.argumentAt<1>(), true);
+
+    // and ensure that modified data does not verify.
+    verifyReply = cm.verify(
+            data + "modified",
+            signature,
+            publicKey,
+            static_cast<Sailfish::Crypto::Key::SignaturePadding>(padding),
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(verifyReply);
+    QVERIFY(verifyReply.isValid());
+    QCOMPARE(verifyReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(verifyReply.argumentAt<1>(), false);
+}
+
+void tst_crypto::encryptDecryptBlockModes_data()
+{
+    QTest::addColumn<int>("algorithm");
+    QTest::addColumn<int>("blockMode");
+    QTest::addColumn<QByteArray>("plaintext");
+
+    const QByteArray plaintext("Test plaintext data which is longer than one block");
+    QTest::newRow("aes128 cbc") << static_cast<int>(Sailfish::Crypto::Key::Aes128) << static_cast<int>(Sailfish::Crypto::Key::BlockModeCBC) << plaintext;
+    QTest::newRow("aes128 ctr") << static_cast<int>(Sailfish::Crypto::Key::Aes128) << static_cast<int>(Sailfish::Crypto::Key::BlockModeCTR) << plaintext;
+    QTest::newRow("aes128 gcm") << static_cast<int>(Sailfish::Crypto::Key::Aes128) << static_cast<int>(Sailfish::Crypto::Key::BlockModeGCM) << plaintext;
+    QTest::newRow("aes256 ctr") << static_cast<int>(Sailfish::Crypto::Key::Aes256) << static_cast<int>(Sailfish::Crypto::Key::BlockModeCTR) << plaintext;
+    QTest::newRow("aes256 gcm") << static_cast<int>(Sailfish::Crypto::Key::Aes256) << static_cast<int>(Sailfish::Crypto::Key::BlockModeGCM) << plaintext;
+    // the ciphertext of empty plaintext is the initialisation vector (and tag) alone.
+    QTest::newRow("aes256 ctr empty") << static_cast<int>(Sailfish::Crypto::Key::Aes256) << static_cast<int>(Sailfish::Crypto::Key::BlockModeCTR) << QByteArray();
+    QTest::newRow("aes256 gcm empty") << static_cast<int>(Sailfish::Crypto::Key::Aes256) << static_cast<int>(Sailfish::Crypto::Key::BlockModeGCM) << QByteArray();
+}
+
+void tst_crypto::encryptDecryptBlockModes()
+{
+    QFETCH(int, algorithm);
+    QFETCH(int, blockMode);
+    QFETCH(QByteArray, plaintext);
+
+    Sailfish::Crypto::Key keyTemplate;
+    keyTemplate.setAlgorithm(static_cast<Sailfish::Crypto::Key::Algorithm>(algorithm));
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setBlockModes(static_cast<Sailfish::Crypto::Key::BlockMode>(blockMode));
+    keyTemplate.setEncryptionPaddings(Sailfish::Crypto::Key::EncryptionPaddingNone);
+    keyTemplate.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone);
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply = cm.generateKey(
+            keyTemplate,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    Sailfish::Crypto::Key fullKey = reply.argumentAt<1>();
+    QVERIFY(!fullKey.secretKey().isEmpty());
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> encryptReply = cm.encrypt(
+            plaintext,
+            fullKey,
+            static_cast<Sailfish::Crypto::Key::BlockMode>(blockMode),
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(encryptReply);
+    QVERIFY(encryptReply.isValid());
+    QCOMPARE(encryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QByteArray encrypted = encryptReply.argumentAt<1>();
+    QVERIFY(!encrypted.isEmpty());
+    QVERIFY(!encrypted.contains(plaintext) || plaintext.isEmpty());
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> decryptReply = cm.decrypt(
+            encrypted,
+            fullKey,
+            static_cast<Sailfish::Crypto::Key::BlockMode>(blockMode),
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(decryptReply);
+    QVERIFY(decryptReply.isValid());
+    QCOMPARE(decryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(decryptReply.argumentAt<1>(), plaintext);
+
+    if (blockMode != Sailfish::Crypto::Key::BlockModeGCM) {
+        return;
+    }
+
+    // GCM ciphertext which has been tampered with (or whose tag has) fails authentication,
+    // as does ciphertext too short to hold the initialisation vector and tag.
+    QList<QByteArray> tampered;
+    tampered << encrypted;
+    tampered.last()[encrypted.size() - 1] = encrypted.at(encrypted.size() - 1) ^ 0x01;
+    if (!plaintext.isEmpty()) {
+        tampered << encrypted;
+        tampered.last()[encrypted.size() - 17] = encrypted.at(encrypted.size() - 17) ^ 0x01;
+    }
+    tampered << encrypted.left(encrypted.size() - plaintext.size() - 1);
+    Q_FOREACH (const QByteArray &ciphertext, tampered) {
+        decryptReply = cm.decrypt(
+                ciphertext,
+                fullKey,
+                Sailfish::Crypto::Key::BlockModeGCM,
+                Sailfish::Crypto::Key::EncryptionPaddingNone,
+                Sailfish::Crypto::Key::DigestSha256,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        WAIT_FOR_FINISHED_WITHOUT_BLOCKING(decryptReply);
+        QVERIFY(decryptReply.isValid());
+        QCOMPARE(decryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Failed);
+        QCOMPARE(decryptReply.argumentAt<0>().errorCode(), Sailfish::Crypto::Result::CryptoPluginDecryptionError);
+        QVERIFY(decryptReply.argumentAt<1>().isEmpty());
+    }
+}
+
+void tst_crypto::batchSignVerifyEncrypt()
+{
+    QVector<QByteArray> data;
+    for (int i = 0; i < 16; ++i) {
+        data.append(QByteArray("Test data to sign ") + QByteArray::number(i));
+    }
+
+    // test signing a batch of data with one key
+    Sailfish::Crypto::Key keyTemplate;
+    keyTemplate.setAlgorithm(Sailfish::Crypto::Key::NistEcc256);
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone);
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Sign | Sailfish::Crypto::Key::Verify);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply = cm.generateKey(
+            keyTemplate,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    Sailfish::Crypto::Key signingKey = reply.argumentAt<1>();
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> > signReply = cm.signBatch(
+            data,
+            signingKey,
+            Sailfish::Crypto::Key::SignaturePaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(signReply);
+    QVERIFY(signReply.isValid());
+    QCOMPARE(signReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QVector<QByteArray> signatures = signReply.argumentAt<1>();
+    QCOMPARE(signatures.size(), data.size());
+
+    // test verifying the batch with only the public key, with one signature swapped
+    qSwap(signatures[3], signatures[4]);
+    Sailfish::Crypto::Key publicKey(signingKey);
+    publicKey.setPrivateKey(QByteArray());
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> > verifyReply = cm.verifyBatch(
+            data,
+            signatures,
+            publicKey,
+            Sailfish::Crypto::Key::SignaturePaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(verifyReply);
+    QVERIFY(verifyReply.isValid());
+    QCOMPARE(verifyReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QVector<bool> verified = verifyReply.argumentAt<1>();
+    QCOMPARE(verified.size(), data.size());
+    for (int i = 0; i < verified.size(); ++i) {
+        QCOMPARE(verified.at(i), i != 3 && i != 4);
+    }
+
+    // test encrypting a batch, and that each item decrypts on its own.
+    keyTemplate = Sailfish::Crypto::Key();
+    keyTemplate.setAlgorithm(Sailfish::Crypto::Key::Aes256);
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setBlockModes(Sailfish::Crypto::Key::BlockModeCBC);
+    keyTemplate.setEncryptionPaddings(Sailfish::Crypto::Key::EncryptionPaddingNone);
+    keyTemplate.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone);
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+    reply = cm.generateKey(
+            keyTemplate,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    Sailfish::Crypto::Key cipherKey = reply.argumentAt<1>();
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<QByteArray> > encryptReply = cm.encryptBatch(
+            data,
+            cipherKey,
+            Sailfish::Crypto::Key::BlockModeCBC,
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(encryptReply);
+    QVERIFY(encryptReply.isValid());
+    QCOMPARE(encryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QVector<QByteArray> encrypted = encryptReply.argumentAt<1>();
+    QCOMPARE(encrypted.size(), data.size());
+    for (int i = 0; i < encrypted.size(); ++i) {
+        QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> decryptReply = cm.decrypt(
+                encrypted.at(i),
+                cipherKey,
+                Sailfish::Crypto::Key::BlockModeCBC,
+                Sailfish::Crypto::Key::EncryptionPaddingNone,
+                Sailfish::Crypto::Key::DigestSha256,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        WAIT_FOR_FINISHED_WITHOUT_BLOCKING(decryptReply);
+        QVERIFY(decryptReply.isValid());
+        QCOMPARE(decryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+        QCOMPARE(decryptReply.argumentAt<1>(), data.at(i));
+    }
+}
+
+void tst_crypto::digestAndMac()
+{
+    const QByteArray data("The quick brown fox jumps over the lazy dog");
+
+    // test generating a digest, which needs no key
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> digestReply = cm.generateDigest(
+            data,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(digestReply);
+    QVERIFY(digestReply.isValid());
+    QCOMPARE(digestReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(digestReply.argumentAt<1>(), QCryptographicHash::hash(data, QCryptographicHash::Sha256));
+
+    // test calculating an HMAC, against the well-known HMAC-SHA256 value for this data and key
+    Sailfish::Crypto::Key macKey;
+    macKey.setAlgorithm(Sailfish::Crypto::Key::Aes256);
+    macKey.setOperations(Sailfish::Crypto::Key::CalculateMac);
+    macKey.setSecretKey(QByteArray("key"));
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> macReply = cm.calculateMac(
+            data,
+            macKey,
+            Sailfish::Crypto::Key::DigestSha256,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(macReply);
+    QVERIFY(macReply.isValid());
+    QCOMPARE(macReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    const QByteArray mac = macReply.argumentAt<1>();
+    QCOMPARE(mac, QByteArray::fromHex("f7bc83f430538424b13298e6aa6fb143ef4d59a14946175997479dbc2d1a3cd8"));
+
+    // test that digest and MAC sessions produce the same output from chunks of the data
+    QList<Sailfish::Crypto::Key::Operation> operations;
+    operations << Sailfish::Crypto::Key::GenerateDigest << Sailfish::Crypto::Key::CalculateMac;
+    Q_FOREACH (Sailfish::Crypto::Key::Operation operation, operations) {
+        QDBusPendingReply<Sailfish::Crypto::Result, quint32> initReply = cm.initialiseCipherSession(
+                operation == Sailfish::Crypto::Key::CalculateMac ? macKey : Sailfish::Crypto::Key(),
+                operation,
+                Sailfish::Crypto::Key::BlockModeUnknown,
+                Sailfish::Crypto::Key::EncryptionPaddingUnknown,
+                Sailfish::Crypto::Key::DigestSha256,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        WAIT_FOR_FINISHED_WITHOUT_BLOCKING(initReply);
+        QVERIFY(initReply.isValid());
+        QCOMPARE(initReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+        const quint32 token = initReply.argumentAt<1>();
+
+        for (int i = 0; i < data.size(); i += 10) {
+            QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> updateReply = cm.updateCipherSession(
+                    data.mid(i, 10),
+                    token,
+                    QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+            WAIT_FOR_FINISHED_WITHOUT_BLOCKING(updateReply);
+            QVERIFY(updateReply.isValid());
+            QCOMPARE(updateReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+            QVERIFY(updateReply.argumentAt<1>().isEmpty());
+        }
+
+        QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> finaliseReply = cm.finaliseCipherSession(
+                token,
+                QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        WAIT_FOR_FINISHED_WITHOUT_BLOCKING(finaliseReply);
+        QVERIFY(finaliseReply.isValid());
+        QCOMPARE(finaliseReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+        QCOMPARE(finaliseReply.argumentAt<1>(), operation == Sailfish::Crypto::Key::CalculateMac
+                                                        ? mac
+                                                        : digestReply.argumentAt<1>());
+    }
+}
+
+void tst_crypto::generateRandomData()
+{
+    // test that small requests, served from the plugin's buffer, don't repeat
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply = cm.generateRandomData(
+            32,
+            Sailfish::Crypto::CryptoManager::DefaultCsprngEngineName,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    const QByteArray first = reply.argumentAt<1>();
+    QCOMPARE(first.size(), 32);
+
+    reply = cm.generateRandomData(
+            32,
+            Sailfish::Crypto::CryptoManager::DefaultCsprngEngineName,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(reply.argumentAt<1>().size(), 32);
+    QVERIFY(reply.argumentAt<1>() != first);
+
+    // test a bulk request, which is larger than the buffer
+    reply = cm.generateRandomData(
+            64 * 1024,
+            Sailfish::Crypto::CryptoManager::DefaultCsprngEngineName,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(reply.argumentAt<1>().size(), 64 * 1024);
+
+    // test that an unknown engine is rejected
+    reply = cm.generateRandomData(
+            32,
+            QLatin1String("no-such-engine"),
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Failed);
+}
+
+void tst_crypto::hostedPluginOperations()
+{
+    const QString pluginName = QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl");
+    const QVariantList hosts = pluginHosts(pluginName);
+    if (hosts.isEmpty()) {
+        QSKIP("The openssl crypto plugin is not hosted out of process");
+    }
+    Q_FOREACH (const QVariant &host, hosts) {
+        QVERIFY(host.toMap().value(QStringLiteral("running")).toBool());
+        QVERIFY(host.toMap().value(QStringLiteral("pid")).toLongLong() > 0);
+    }
+
+    // test an operation which waits for the host
+    Sailfish::Crypto::Key keyTemplate;
+    keyTemplate.setAlgorithm(Sailfish::Crypto::Key::Aes256);
+    keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    keyTemplate.setBlockModes(Sailfish::Crypto::Key::BlockModeCBC);
+    keyTemplate.setEncryptionPaddings(Sailfish::Crypto::Key::EncryptionPaddingNone);
+    keyTemplate.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone);
+    keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    keyTemplate.setOperations(Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> reply = cm.generateKey(
+            keyTemplate,
+            pluginName);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    Sailfish::Crypto::Key fullKey = reply.argumentAt<1>();
+    QVERIFY(!fullKey.secretKey().isEmpty());
+
+    // test operations which are submitted to the host asynchronously
+    QByteArray plaintext = "Test plaintext data";
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> encryptReply = cm.encrypt(
+            plaintext,
+            fullKey,
+            Sailfish::Crypto::Key::BlockModeCBC,
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            pluginName);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(encryptReply);
+    QVERIFY(encryptReply.isValid());
+    QCOMPARE(encryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QByteArray encrypted = encryptReply.argumentAt<1>();
+    QVERIFY(!encrypted.isEmpty());
+    QVERIFY(encrypted != plaintext);
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> decryptReply = cm.decrypt(
+            encrypted,
+            fullKey,
+            Sailfish::Crypto::Key::BlockModeCBC,
+            Sailfish::Crypto::Key::EncryptionPaddingNone,
+            Sailfish::Crypto::Key::DigestSha256,
+            pluginName);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(decryptReply);
+    QVERIFY(decryptReply.isValid());
+    QCOMPARE(decryptReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(decryptReply.argumentAt<1>(), plaintext);
+
+    // none of the operations should be left pending in the hosts
+    Q_FOREACH (const QVariant &host, pluginHosts(pluginName)) {
+        QCOMPARE(host.toMap().value(QStringLiteral("pendingCount")).toInt(), 0);
+    }
+}
+
+void tst_crypto::hostedPluginHostExit()
+{
+    const QString pluginName = QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl");
+    if (pluginHosts(pluginName).isEmpty()) {
+        QSKIP("The openssl crypto plugin is not hosted out of process");
+    }
+
+    // the test plugin takes a few seconds to use this engine, so the request
+    // is still outstanding in its host when the host is killed.
+    QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply = cm.generateRandomData(
+            32,
+            QLatin1String("testslowengine"),
+            pluginName);
+
+    QVariantMap busyHost;
+    for (int i = 0; i < 20 && busyHost.isEmpty(); ++i) {
+        Q_FOREACH (const QVariant &host, pluginHosts(pluginName)) {
+            if (host.toMap().value(QStringLiteral("pendingCount")).toInt() > 0) {
+                busyHost = host.toMap();
+            }
+        }
+        if (busyHost.isEmpty()) {
+            QTest::qWait(50);
+        }
+    }
+    QVERIFY(!busyHost.isEmpty());
+    QVERIFY(!reply.isFinished());
+    const qint64 pid = busyHost.value(QStringLiteral("pid")).toLongLong();
+    QVERIFY(pid > 0);
+    QCOMPARE(::kill(pid_t(pid), SIGKILL), 0);
+
+    // the outstanding request fails, rather than waiting forever or taking down the daemon
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Failed);
+    QCOMPARE(reply.argumentAt<0>().errorCode(), Sailfish::Crypto::Result::DaemonError);
+
+    // the host is restarted
+    const int exitCount = busyHost.value(QStringLiteral("exitCount")).toInt();
+    bool restarted = false;
+    for (int i = 0; i < 100 && !restarted; ++i) {
+        Q_FOREACH (const QVariant &host, pluginHosts(pluginName)) {
+            const QVariantMap stats = host.toMap();
+            if (stats.value(QStringLiteral("exitCount")).toInt() > exitCount
+                    && stats.value(QStringLiteral("running")).toBool()
+                    && stats.value(QStringLiteral("pid")).toLongLong() != pid) {
+                restarted = true;
+            }
+        }
+        if (!restarted) {
+            QTest::qWait(100);
+        }
+    }
+    QVERIFY(restarted);
+
+    // and later requests succeed
+    reply = cm.generateRandomData(
+            32,
+            Sailfish::Crypto::CryptoManager::DefaultCsprngEngineName,
+            pluginName);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(reply.argumentAt<1>().size(), 32);
+}
+
 void tst_crypto::validateCertificateChain()
 {
     // TODO: do this test properly, this currently just tests datatype copy semantics
@@ -127,6 +820,139 @@ void tst_crypto::validateCertificateChain()
     WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Failed); // plugin doesn't support this operation yet. TODO.
+
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<bool> > batchReply = cm.validateCertificateChains(
+            QVector<QVector<Sailfish::Crypto::Certificate> >() << chain << chain,
+            QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(batchReply);
+    QVERIFY(batchReply.isValid());
+    QCOMPARE(batchReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Failed); // as above.
+
+    // the encoded form of a certificate is kept by copies, and discarded once its fields are modified.
+    const QByteArray encoded("\x30\x03\x02\x01\x01", 5);
+    Sailfish::Crypto::Certificate decoded = Sailfish::Crypto::Certificate::fromEncoded(encoded);
+    QCOMPARE(decoded.type(), Sailfish::Crypto::Certificate::X509);
+    QCOMPARE(decoded.toEncoded(), encoded);
+    Sailfish::Crypto::X509Certificate x509 = Sailfish::Crypto::X509Certificate::fromCertificate(decoded);
+    QCOMPARE(x509.toEncoded(), encoded);
+    x509.setSignatureValue(QByteArray("testing"));
+    QVERIFY(x509.toEncoded().isEmpty());
+    QCOMPARE(decoded.toEncoded(), encoded);
+
+    // the fields of a DER-encoded certificate are decoded, including its validity,
+    // which is given as a UTCTime and a GeneralizedTime respectively.
+    const QByteArray der = QByteArray::fromHex(
+            "308201073081ae020101300a06082a8648ce3d040302300f310d300b06035504030c0474657374"
+            "3020170d3230303130313030303030305a180f32303530303130313030303030305a300f310d30"
+            "0b06035504030c04746573743059301306072a8648ce3d020106082a8648ce3d03010703420004"
+            "d96d03a7c4405c7ae76da99a2193c56960f4f77cbea1d49cda6562d3fc1d9d5d92228c3f45559b"
+            "0e321c9a10faf39d10288098018830db1592832980710cf636300a06082a8648ce3d0403020348"
+            "0030450220642e32ca66adde3ffd844fbc7d35caec36e4d9a09878d5ac441fa72a930dbc270221"
+            "00e6eaeb0d63eb9abcda51b2cefb1f81b17863ff0ed76700544b601b7c43cb7b6a");
+    const Sailfish::Crypto::X509Certificate selfSigned = Sailfish::Crypto::X509Certificate::fromCertificate(
+            Sailfish::Crypto::Certificate::fromEncoded(der));
+    const Sailfish::Crypto::X509Certificate::TbsCertificate tbs = selfSigned.tbsCertificate();
+    QCOMPARE(tbs.version, QStringLiteral("1"));
+    QCOMPARE(tbs.serialNumber, QStringLiteral("01"));
+    QCOMPARE(tbs.signature.algorithm, QStringLiteral("1.2.840.10045.4.3.2"));
+    QCOMPARE(tbs.validity.notBefore, QDateTime(QDate(2020, 1, 1), QTime(0, 0), Qt::UTC));
+    QCOMPARE(tbs.validity.notAfter, QDateTime(QDate(2050, 1, 1), QTime(0, 0), Qt::UTC));
+    QCOMPARE(tbs.subject.relativeDistinguishedNames.size(), 1);
+    QCOMPARE(tbs.subject.relativeDistinguishedNames.first().type, QStringLiteral("CN"));
+    QCOMPARE(tbs.subject.relativeDistinguishedNames.first().value, QStringLiteral("test"));
+    QCOMPARE(tbs.subjectPublicKeyInfo.algorithm.algorithm, QStringLiteral("1.2.840.10045.2.1"));
+    QCOMPARE(selfSigned.publicKey().size(), 65);
+    QCOMPARE(selfSigned.signatureValue().size(), 71);
+
+    // and a truncated encoding has no fields.
+    const Sailfish::Crypto::X509Certificate truncated = Sailfish::Crypto::X509Certificate::fromCertificate(
+            Sailfish::Crypto::Certificate::fromEncoded(der.left(der.size() - 1)));
+    QVERIFY(!truncated.tbsCertificate().validity.notAfter.isValid());
+    QVERIFY(truncated.publicKey().isEmpty());
+}
+
+void tst_crypto::keySerialisation()
+{
+    Sailfish::Crypto::Key key;
+    key.setIdentifier(Sailfish::Crypto::Key::Identifier(QLatin1String("keyName"), QLatin1String("collectionName")));
+    key.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+    key.setAlgorithm(Sailfish::Crypto::Key::Aes256);
+    key.setOperations(Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+    key.setBlockModes(Sailfish::Crypto::Key::BlockModeCBC);
+    key.setEncryptionPaddings(Sailfish::Crypto::Key::EncryptionPaddingNone);
+    key.setSignaturePaddings(Sailfish::Crypto::Key::SignaturePaddingNone);
+    key.setDigests(Sailfish::Crypto::Key::DigestSha256);
+    key.setSecretKey(QByteArray(32, 'k'));
+    key.setValidityEnd(QDateTime(QDate(2030, 1, 1), QTime(12, 0), Qt::UTC));
+    key.setCustomParameters(QVector<QByteArray>() << QByteArray("first") << QByteArray() << QByteArray("third"));
+    key.setFilterData(QLatin1String("account"), QLatin1String("example@example.com"));
+    key.setFilterData(QLatin1String("purpose"), QString());
+
+    const QByteArray serialised = Sailfish::Crypto::Key::serialise(key);
+    Sailfish::Crypto::Key deserialised = Sailfish::Crypto::Key::deserialise(serialised);
+    QCOMPARE(deserialised.identifier().name(), key.identifier().name());
+    QCOMPARE(deserialised.identifier().collectionName(), key.identifier().collectionName());
+    QCOMPARE(deserialised.algorithm(), key.algorithm());
+    QCOMPARE(deserialised.operations(), key.operations());
+    QCOMPARE(deserialised.digests(), key.digests());
+    QCOMPARE(deserialised.secretKey(), key.secretKey());
+    QVERIFY(deserialised.publicKey().isEmpty());
+    QVERIFY(!deserialised.validityStart().isValid());
+    QCOMPARE(deserialised.validityEnd(), key.validityEnd());
+    QCOMPARE(deserialised.customParameters(), key.customParameters());
+    QCOMPARE(deserialised.filterData(), key.filterData());
+    QVERIFY(deserialised.hasFilterData(QLatin1String("purpose")));
+
+    // truncated data is rejected.
+    QVERIFY(Sailfish::Crypto::Key::deserialise(serialised.left(serialised.size() - 1)).secretKey().isEmpty());
+
+    // keys which were stored in the previous, QDataStream-based format can still be read.
+    QByteArray legacy;
+    QBuffer buffer(&legacy);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream out(&buffer);
+    out << (quint32)0x4B657900 << (qint32)100;
+    out.setVersion(QDataStream::Qt_5_6);
+    out << key.identifier().name() << key.identifier().collectionName();
+    out << static_cast<int>(key.origin()) << static_cast<int>(key.algorithm()) << static_cast<int>(key.operations())
+        << static_cast<int>(key.blockModes()) << static_cast<int>(key.encryptionPaddings())
+        << static_cast<int>(key.signaturePaddings()) << static_cast<int>(key.digests());
+    out << key.publicKey() << key.privateKey() << key.secretKey();
+    out << key.validityStart() << key.validityEnd();
+    out << key.customParameters();
+    buffer.close();
+
+    deserialised = Sailfish::Crypto::Key::deserialise(legacy);
+    QCOMPARE(deserialised.identifier().name(), key.identifier().name());
+    QCOMPARE(deserialised.algorithm(), key.algorithm());
+    QCOMPARE(deserialised.secretKey(), key.secretKey());
+    QCOMPARE(deserialised.validityEnd(), key.validityEnd());
+    QCOMPARE(deserialised.customParameters(), key.customParameters());
+    QVERIFY(deserialised.filterData().isEmpty());
+}
+
+void tst_crypto::findKeys()
+{
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier> > allReply = cm.storedKeyIdentifiers();
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(allReply);
+    QVERIFY(allReply.isValid());
+    QCOMPARE(allReply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+
+    // an empty filter matches every stored key.
+    QDBusPendingReply<Sailfish::Crypto::Result, QVector<Sailfish::Crypto::Key::Identifier> > reply = cm.findKeys(Sailfish::Crypto::Key::FilterData());
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QCOMPARE(reply.argumentAt<1>().size(), allReply.argumentAt<1>().size());
+
+    Sailfish::Crypto::Key::FilterData filter;
+    filter.insert(QLatin1String("tst_crypto"), QLatin1String("no such key"));
+    filter.insert(QLatin1String("purpose"), QLatin1String("signing"));
+    reply = cm.findKeys(filter);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Crypto::Result::Succeeded);
+    QVERIFY(reply.argumentAt<1>().isEmpty());
 }
 
 #include "tst_crypto.moc"
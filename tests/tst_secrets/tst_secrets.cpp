@@ -8,11 +8,18 @@
 #include <QtTest>
 #include <QObject>
 #include <QDBusReply>
+#include <QDBusInterface>
+#include <QDBusArgument>
+#include <QDBusUnixFileDescriptor>
+#include <QTemporaryFile>
+#include <QTemporaryDir>
+#include <QPluginLoader>
 #include <QQuickView>
 #include <QQuickItem>
 
 #include "Secrets/secretmanager.h"
 #include "Secrets/secret.h"
+#include "Secrets/extensionplugins.h"
 
 // Cannot use waitForFinished() for some replies, as ui flows require user interaction / event handling.
 #define WAIT_FOR_FINISHED_WITHOUT_BLOCKING(dbusreply)       \
@@ -24,6 +31,105 @@
         }                                                   \
     } while (0)
 
+namespace {
+    // Loads the test build of the logstore plugin into the test process, with
+    // its segment kept in a temporary directory, so that the segment file can
+    // be damaged between loads as a crash would leave it.
+    class LogStorePluginLoader
+    {
+    public:
+        LogStorePluginLoader()
+            : m_dataHome(qgetenv("XDG_DATA_HOME"))
+            , m_loader(QStringLiteral("/usr/lib/sailfishsecrets/libsailfishsecrets-testlogstore.so"))
+        {
+            qputenv("XDG_DATA_HOME", m_dataDir.path().toUtf8());
+        }
+
+        ~LogStorePluginLoader()
+        {
+            m_loader.unload();
+            if (m_dataHome.isEmpty()) {
+                qunsetenv("XDG_DATA_HOME");
+            } else {
+                qputenv("XDG_DATA_HOME", m_dataHome);
+            }
+        }
+
+        bool isValid() const { return m_dataDir.isValid(); }
+        QString segmentFilePath() const
+        {
+            return m_dataDir.path() + QStringLiteral("/system/privileged/Secrets/logstoreplugin-test/secrets.log");
+        }
+
+        // the segment is opened when the plugin is instantiated.
+        Sailfish::Secrets::StoragePlugin *load()
+        {
+            return qobject_cast<Sailfish::Secrets::StoragePlugin*>(m_loader.instance());
+        }
+        // destroys the plugin, which waits for any compaction and closes the segment.
+        void unload() { m_loader.unload(); }
+
+    private:
+        QByteArray m_dataHome;
+        QTemporaryDir m_dataDir;
+        QPluginLoader m_loader;
+    };
+
+    // Nested maps and lists in a DBus reply are received as QDBusArguments.
+    QVariant demarshall(const QVariant &value)
+    {
+        if (value.userType() != qMetaTypeId<QDBusArgument>()) {
+            return value;
+        }
+        const QDBusArgument argument = value.value<QDBusArgument>();
+        if (argument.currentType() == QDBusArgument::MapType) {
+            QVariantMap map = qdbus_cast<QVariantMap>(argument);
+            for (QVariantMap::iterator it = map.begin(); it != map.end(); ++it) {
+                *it = demarshall(*it);
+            }
+            return map;
+        } else if (argument.currentType() == QDBusArgument::ArrayType) {
+            QVariantList list = qdbus_cast<QVariantList>(argument);
+            for (QVariantList::iterator it = list.begin(); it != list.end(); ++it) {
+                *it = demarshall(*it);
+            }
+            return list;
+        }
+        return value;
+    }
+
+    // The statistics of the secrets request queue.
+    QVariantMap secretsQueueStatistics()
+    {
+        QDBusInterface statistics(QStringLiteral("org.sailfishos.secrets.daemon.statistics"),
+                                  QStringLiteral("/Sailfish/Secrets/Statistics"),
+                                  QStringLiteral("org.sailfishos.secrets.daemon.statistics"));
+        QDBusReply<QVariantMap> reply = statistics.call(QStringLiteral("statistics"));
+        if (!reply.isValid()) {
+            return QVariantMap();
+        }
+        return demarshall(reply.value().value(QStringLiteral("secrets"))).toMap();
+    }
+
+    // Writes a large secret into the collection.  The daemon handles the write
+    // on its main thread, so any requests sent immediately after it are all
+    // received before its request queue next runs, and are queued together.
+    QDBusPendingReply<Sailfish::Secrets::Result> beginLargeWrite(
+            Sailfish::Secrets::SecretManager &manager,
+            const QString &collectionName)
+    {
+        QByteArray largeSecret;
+        for (int i = 0; largeSecret.size() < 8 * 1024 * 1024; ++i) {
+            largeSecret.append(QByteArray::number(i));
+        }
+        return manager.setSecret(
+                    collectionName,
+                    QLatin1String("testlargesecretname"),
+                    largeSecret,
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    }
+}
+
 class tst_secrets : public QObject
 {
     Q_OBJECT
@@ -35,12 +141,31 @@ public slots:
 private slots:
     void createDeleteDeviceLockCollection();
     void writeReadDeleteDeviceLockCollectionSecret();
+    void writeReadDeleteLargeDeviceLockCollectionSecret();
     void writeReadDeleteStandaloneDeviceLockSecret();
+    void writeReadMultipleDeviceLockCollectionSecrets();
+    void setDeviceLockCollectionSecrets();
+    void modifyDeviceLockKey();
+    void enumerateDeviceLockCollectionSecretNames();
+    void exportImportDeviceLockCollection();
+    void secretChangedNotifications();
 
     void createDeleteCustomLockCollection();
     void writeReadDeleteCustomLockCollectionSecret();
     void writeReadDeleteStandaloneCustomLockSecret();
 
+    void writeReadDeletePluginSecrets_data();
+    void writeReadDeletePluginSecrets();
+    void inMemoryPluginCapacity();
+    void logStorePluginReplay();
+    void logStorePluginCompaction();
+
+    void secretEncoding();
+    void requestDeadlines();
+    void requestCoalescing();
+    void requestAdmission();
+    void requestCancellation();
+
 private:
     Sailfish::Secrets::SecretManager m;
 };
@@ -129,6 +254,94 @@ void tst_secrets::writeReadDeleteDeviceLockCollectionSecret()
 }
 
 
+void tst_secrets::writeReadDeleteLargeDeviceLockCollectionSecret()
+{
+    // larger than the daemon's default chunk size, and not a multiple of it.
+    QByteArray largeSecret;
+    for (int i = 0; largeSecret.size() < 3 * 1024 * 1024 + 7; ++i) {
+        largeSecret.append(QByteArray::number(i));
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                largeSecret,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretReply.waitForFinished();
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QVERIFY(secretReply.argumentAt<1>() == largeSecret);
+
+    // overwriting the large secret with a small one replaces it entirely.
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    secretReply = m.getSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretReply.waitForFinished();
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(secretReply.argumentAt<1>(), QByteArray("testsecretvalue"));
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                largeSecret,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.deleteSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    secretReply = m.getSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretReply.waitForFinished();
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
 void tst_secrets::writeReadDeleteStandaloneDeviceLockSecret()
 {
     QDBusPendingReply<Sailfish::Secrets::Result> reply = m.setSecret(
@@ -167,147 +380,1188 @@ void tst_secrets::writeReadDeleteStandaloneDeviceLockSecret()
     QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
 }
 
-void tst_secrets::createDeleteCustomLockCollection()
+void tst_secrets::writeReadMultipleDeviceLockCollectionSecrets()
 {
-    // construct the in-process authentication key UI.
-    QQuickView v(QUrl::fromLocalFile(QStringLiteral("%1/tst_secrets.qml").arg(QCoreApplication::applicationDirPath())));
-    v.show();
-    QObject *uiView = v.rootObject()->findChild<QObject*>("uiview");
-    QVERIFY(uiView);
-    QMetaObject::invokeMethod(uiView, "setSecretManager", Qt::DirectConnection, Q_ARG(QObject*, &m));
-
     QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
                 QLatin1String("testcollection"),
                 Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
                 Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
-                Sailfish::Secrets::SecretManager::InAppAuthenticationPluginName,
-                Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked,
-                0,
-                Sailfish::Secrets::SecretManager::OwnerOnlyMode,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname2"),
+                QByteArray("testsecretvalue2"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 
+    // nonexistent secrets should be omitted from the result.
+    QDBusPendingReply<Sailfish::Secrets::Result, QMap<QString, QByteArray> > secretsReply = m.getSecrets(
+                QLatin1String("testcollection"),
+                QStringList() << QLatin1String("testsecretname")
+                              << QLatin1String("testsecretname2")
+                              << QLatin1String("nonexistentsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretsReply.waitForFinished();
+    QVERIFY(secretsReply.isValid());
+    QCOMPARE(secretsReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QMap<QString, QByteArray> secrets = secretsReply.argumentAt<1>();
+    QCOMPARE(secrets.size(), 2);
+    QCOMPARE(secrets.value(QLatin1String("testsecretname")), QByteArray("testsecretvalue"));
+    QCOMPARE(secrets.value(QLatin1String("testsecretname2")), QByteArray("testsecretvalue2"));
+
     reply = m.deleteCollection(
                 QLatin1String("testcollection"),
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    reply.waitForFinished();
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 }
 
-void tst_secrets::writeReadDeleteCustomLockCollectionSecret()
+void tst_secrets::setDeviceLockCollectionSecrets()
 {
-    // construct the in-process authentication key UI.
-    QQuickView v(QUrl::fromLocalFile(QStringLiteral("%1/tst_secrets.qml").arg(QCoreApplication::applicationDirPath())));
-    v.show();
-    QObject *uiView = v.rootObject()->findChild<QObject*>("uiview");
-    QVERIFY(uiView);
-    QMetaObject::invokeMethod(uiView, "setSecretManager", Qt::DirectConnection, Q_ARG(QObject*, &m));
+    // in test builds, the sqlite plugin fails every batch write to a collection
+    // whose name starts with "testfailingwrites".
+    const QStringList collectionNames = QStringList() << QLatin1String("testcollection")
+                                                      << QLatin1String("testfailingwritescollection");
+    Q_FOREACH (const QString &collectionName, collectionNames) {
+        QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                    collectionName,
+                    Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                    Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                    Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                    Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+        reply.waitForFinished();
+        QVERIFY(reply.isValid());
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+        reply = m.setSecret(
+                    collectionName,
+                    QLatin1String("testsecretname"),
+                    QByteArray("testsecretvalue"),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        reply.waitForFinished();
+        QVERIFY(reply.isValid());
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+        // overwrite the existing secret and add new ones in a single batch.
+        QMap<QString, QByteArray> batch;
+        batch.insert(QLatin1String("testsecretname"), QByteArray("testsecretvalue1"));
+        batch.insert(QLatin1String("testsecretname2"), QByteArray("testsecretvalue2"));
+        batch.insert(QLatin1String("testsecretname3"), QByteArray("testsecretvalue3"));
+        reply = m.setSecrets(
+                    collectionName,
+                    batch,
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        reply.waitForFinished();
+        QVERIFY(reply.isValid());
+        const bool failingWrites = collectionName.startsWith(QLatin1String("testfailingwrites"));
+        QCOMPARE(reply.argumentAt<0>().code(), failingWrites ? Sailfish::Secrets::Result::Failed
+                                                             : Sailfish::Secrets::Result::Succeeded);
+
+        // a failed batch leaves the collection as it was: the existing secret
+        // keeps its value, and none of the new secrets exist.
+        QMap<QString, QByteArray> expected;
+        if (failingWrites) {
+            expected.insert(QLatin1String("testsecretname"), QByteArray("testsecretvalue"));
+        } else {
+            expected = batch;
+        }
+        QDBusPendingReply<Sailfish::Secrets::Result, QMap<QString, QByteArray> > secretsReply = m.getSecrets(
+                    collectionName,
+                    batch.keys(),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        secretsReply.waitForFinished();
+        QVERIFY(secretsReply.isValid());
+        QCOMPARE(secretsReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QCOMPARE(secretsReply.argumentAt<1>(), expected);
+
+        QDBusPendingReply<Sailfish::Secrets::Result, QStringList, qint64> namesReply = m.secretNames(
+                    collectionName, 0, 10);
+        namesReply.waitForFinished();
+        QVERIFY(namesReply.isValid());
+        QCOMPARE(namesReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QStringList secretNames = namesReply.argumentAt<1>();
+        secretNames.sort();
+        QCOMPARE(secretNames, QStringList(expected.keys()));
+
+        // secrets which don't exist yet can be set once the batch has failed.
+        if (failingWrites) {
+            reply = m.setSecret(
+                        collectionName,
+                        QLatin1String("testsecretname2"),
+                        QByteArray("testsecretvalue2"),
+                        Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+            reply.waitForFinished();
+            QVERIFY(reply.isValid());
+            QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        }
+
+        reply = m.deleteCollection(
+                    collectionName,
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        reply.waitForFinished();
+        QVERIFY(reply.isValid());
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    }
+}
+
+void tst_secrets::modifyDeviceLockKey()
+{
+    // the autotest daemon starts with the placeholder device lock key.
+    const QByteArray originalDeviceLockKey("example_device_lock_key");
+    const QByteArray newDeviceLockKey("testnewdevicelockkey");
 
     QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
                 QLatin1String("testcollection"),
                 Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
                 Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
-                Sailfish::Secrets::SecretManager::InAppAuthenticationPluginName,
-                Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked,
-                0,
-                Sailfish::Secrets::SecretManager::OwnerOnlyMode,
-                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 
+    QMap<QString, QByteArray> secrets;
+    secrets.insert(QLatin1String("testsecretname"), QByteArray("testsecretvalue"));
+    secrets.insert(QLatin1String("testsecretname2"), QByteArray("testsecretvalue2"));
+    secrets.insert(QLatin1String("testsecretname3"), QByteArray("testsecretvalue3"));
     reply = m.setSecret(
                 QLatin1String("testcollection"),
                 QLatin1String("testsecretname"),
-                QByteArray("testsecretvalue"),
+                secrets.value(QLatin1String("testsecretname")),
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    reply.waitForFinished();
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 
-    QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+    reply = m.setSecrets(
                 QLatin1String("testcollection"),
-                QLatin1String("testsecretname"),
+                secrets,
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(secretReply);
-    QVERIFY(secretReply.isValid());
-    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
-    QCOMPARE(secretReply.argumentAt<1>(), QByteArray("testsecretvalue"));
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 
-    reply = m.deleteSecret(
-                QLatin1String("testcollection"),
-                QLatin1String("testsecretname"),
+    // the old key must be given correctly.
+    reply = m.modifyDeviceLockKey(QByteArray("incorrectdevicelockkey"), newDeviceLockKey);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+    QCOMPARE(reply.argumentAt<0>().errorCode(), Sailfish::Secrets::Result::IncorrectAuthenticationKeyError);
+
+    // a standalone device lock secret is encrypted with the key itself,
+    // so the key can't be changed while one exists.
+    reply = m.setSecret(
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                QLatin1String("teststandalonesecretname"),
+                QByteArray("teststandalonesecretvalue"),
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode,
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    reply.waitForFinished();
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 
-    // ensure that the delete worked properly.
-    secretReply = m.getSecret(
-                QLatin1String("testcollection"),
-                QLatin1String("testsecretname"),
+    reply = m.modifyDeviceLockKey(originalDeviceLockKey, newDeviceLockKey);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+    QCOMPARE(reply.argumentAt<0>().errorCode(), Sailfish::Secrets::Result::OperationNotSupportedError);
+
+    reply = m.deleteSecret(
+                QLatin1String("teststandalonesecretname"),
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(secretReply);
-    QVERIFY(secretReply.isValid());
-    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    // the collection's data key is rewrapped with the new key, and the
+    // collection is unlocked with it again.  Change the key twice, so that
+    // the second change must unwrap the data key wrapped by the first.
+    const QList<QPair<QByteArray, QByteArray> > keyChanges = QList<QPair<QByteArray, QByteArray> >()
+            << qMakePair(originalDeviceLockKey, newDeviceLockKey)
+            << qMakePair(newDeviceLockKey, originalDeviceLockKey);
+    for (int i = 0; i < keyChanges.size(); ++i) {
+        reply = m.modifyDeviceLockKey(keyChanges.at(i).first, keyChanges.at(i).second);
+        reply.waitForFinished();
+        QVERIFY(reply.isValid());
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+        QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+                    QLatin1String("testcollection"),
+                    QLatin1String("testsecretname"),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        secretReply.waitForFinished();
+        QVERIFY(secretReply.isValid());
+        QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QCOMPARE(secretReply.argumentAt<1>(), secrets.value(QLatin1String("testsecretname")));
+
+        QDBusPendingReply<Sailfish::Secrets::Result, QMap<QString, QByteArray> > secretsReply = m.getSecrets(
+                    QLatin1String("testcollection"),
+                    secrets.keys(),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        secretsReply.waitForFinished();
+        QVERIFY(secretsReply.isValid());
+        QCOMPARE(secretsReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QCOMPARE(secretsReply.argumentAt<1>(), secrets);
+
+        // secrets written after the change are encrypted with the same data key.
+        const QString secretName = QString::fromLatin1("testsecretnameafterchange%1").arg(i);
+        const QByteArray secretValue = QByteArray("testsecretvalueafterchange") + QByteArray::number(i);
+        reply = m.setSecret(
+                    QLatin1String("testcollection"),
+                    secretName,
+                    secretValue,
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        reply.waitForFinished();
+        QVERIFY(reply.isValid());
+        QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        secrets.insert(secretName, secretValue);
+
+        secretReply = m.getSecret(
+                    QLatin1String("testcollection"),
+                    secretName,
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        secretReply.waitForFinished();
+        QVERIFY(secretReply.isValid());
+        QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QCOMPARE(secretReply.argumentAt<1>(), secretValue);
+    }
 
     reply = m.deleteCollection(
                 QLatin1String("testcollection"),
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    reply.waitForFinished();
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 }
 
-
-void tst_secrets::writeReadDeleteStandaloneCustomLockSecret()
+void tst_secrets::enumerateDeviceLockCollectionSecretNames()
 {
-    // construct the in-process authentication key UI.
-    QQuickView v(QUrl::fromLocalFile(QStringLiteral("%1/tst_secrets.qml").arg(QCoreApplication::applicationDirPath())));
-    v.show();
-    QObject *uiView = v.rootObject()->findChild<QObject*>("uiview");
-    QVERIFY(uiView);
-    QMetaObject::invokeMethod(uiView, "setSecretManager", Qt::DirectConnection, Q_ARG(QObject*, &m));
-
-    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.setSecret(
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
                 Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
                 Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
-                Sailfish::Secrets::SecretManager::InAppAuthenticationPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList> collectionsReply = m.collectionNames();
+    collectionsReply.waitForFinished();
+    QVERIFY(collectionsReply.isValid());
+    QCOMPARE(collectionsReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QVERIFY(collectionsReply.argumentAt<1>().contains(QLatin1String("testcollection")));
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
                 QLatin1String("testsecretname"),
                 QByteArray("testsecretvalue"),
-                Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked,
-                0,
-                Sailfish::Secrets::SecretManager::OwnerOnlyMode,
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    reply.waitForFinished();
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 
-    QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
-                QLatin1String("testsecretname"),
+    QMap<QString, QByteArray> batch;
+    batch.insert(QLatin1String("testsecretname2"), QByteArray("testsecretvalue2"));
+    batch.insert(QLatin1String("testsecretname3"), QByteArray("testsecretvalue3"));
+    batch.insert(QLatin1String("testsecretname4"), QByteArray("testsecretvalue4"));
+    reply = m.setSecrets(
+                QLatin1String("testcollection"),
+                batch,
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(secretReply);
-    QVERIFY(secretReply.isValid());
-    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
-    QCOMPARE(secretReply.argumentAt<1>(), QByteArray("testsecretvalue"));
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 
     reply = m.deleteSecret(
-                QLatin1String("testsecretname"),
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname3"),
                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    reply.waitForFinished();
     QVERIFY(reply.isValid());
     QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 
-    // ensure that the delete worked properly.
-    secretReply = m.getSecret(
-                    QLatin1String("testsecretname"),
-                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
-    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(secretReply);
-    QVERIFY(secretReply.isValid());
-    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+    // page through the names two at a time.
+    QStringList secretNames;
+    qint64 cursor = 0;
+    int pages = 0;
+    do {
+        QDBusPendingReply<Sailfish::Secrets::Result, QStringList, qint64> namesReply = m.secretNames(
+                    QLatin1String("testcollection"), cursor, 2);
+        namesReply.waitForFinished();
+        QVERIFY(namesReply.isValid());
+        QCOMPARE(namesReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QVERIFY(namesReply.argumentAt<1>().size() <= 2);
+        secretNames.append(namesReply.argumentAt<1>());
+        cursor = namesReply.argumentAt<2>();
+        QVERIFY(++pages <= 3);
+    } while (cursor);
+
+    QCOMPARE(secretNames, QStringList() << QLatin1String("testsecretname")
+                                        << QLatin1String("testsecretname2")
+                                        << QLatin1String("testsecretname4"));
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::exportImportDeviceLockCollection()
+{
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QMap<QString, QByteArray> batch;
+    batch.insert(QLatin1String("testsecretname"), QByteArray("testsecretvalue"));
+    batch.insert(QLatin1String("testsecretname2"), QByteArray("testsecretvalue2"));
+    batch.insert(QLatin1String("testlargesecretname"), QByteArray(3 * 1024 * 1024, 'x'));
+    reply = m.setSecrets(
+                QLatin1String("testcollection"),
+                batch,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QTemporaryFile archive;
+    QVERIFY(archive.open());
+    const QByteArray archiveKey("testarchivekey");
+    QDBusPendingReply<Sailfish::Secrets::Result, int> archiveReply = m.exportSecrets(
+                QDBusUnixFileDescriptor(archive.handle()), archiveKey);
+    archiveReply.waitForFinished();
+    QVERIFY(archiveReply.isValid());
+    QCOMPARE(archiveReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(archiveReply.argumentAt<1>(), 3);
+    QVERIFY(archive.size() > 0);
+    QVERIFY(archive.seek(0));
+    QVERIFY(!archive.readAll().contains("testsecretvalue"));
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    // the wrong key can't read the archive.
+    QVERIFY(archive.seek(0));
+    archiveReply = m.importSecrets(QDBusUnixFileDescriptor(archive.handle()), QByteArray("wrongarchivekey"));
+    archiveReply.waitForFinished();
+    QVERIFY(archiveReply.isValid());
+    QCOMPARE(archiveReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+
+    QVERIFY(archive.seek(0));
+    archiveReply = m.importSecrets(QDBusUnixFileDescriptor(archive.handle()), archiveKey);
+    archiveReply.waitForFinished();
+    QVERIFY(archiveReply.isValid());
+    QCOMPARE(archiveReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(archiveReply.argumentAt<1>(), 3);
+
+    for (QMap<QString, QByteArray>::const_iterator it = batch.constBegin(); it != batch.constEnd(); it++) {
+        QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+                    QLatin1String("testcollection"),
+                    it.key(),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+        secretReply.waitForFinished();
+        QVERIFY(secretReply.isValid());
+        QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QCOMPARE(secretReply.argumentAt<1>(), it.value());
+    }
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::secretChangedNotifications()
+{
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.subscribeNotifications(QStringList() << QLatin1String("testcollection"));
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QSignalSpy changedSpy(&m, SIGNAL(secretChanged(QString,QString)));
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QTRY_COMPARE(changedSpy.count(), 1);
+    QCOMPARE(changedSpy.at(0).at(0).toString(), QLatin1String("testcollection"));
+    QCOMPARE(changedSpy.at(0).at(1).toString(), QLatin1String("testsecretname"));
+
+    reply = m.deleteSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QTRY_COMPARE(changedSpy.count(), 2);
+
+    // after unsubscribing, no further notifications are received.
+    reply = m.subscribeNotifications(QStringList());
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QTest::qWait(100);
+    QCOMPARE(changedSpy.count(), 2);
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::createDeleteCustomLockCollection()
+{
+    // construct the in-process authentication key UI.
+    QQuickView v(QUrl::fromLocalFile(QStringLiteral("%1/tst_secrets.qml").arg(QCoreApplication::applicationDirPath())));
+    v.show();
+    QObject *uiView = v.rootObject()->findChild<QObject*>("uiview");
+    QVERIFY(uiView);
+    QMetaObject::invokeMethod(uiView, "setSecretManager", Qt::DirectConnection, Q_ARG(QObject*, &m));
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::InAppAuthenticationPluginName,
+                Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked,
+                0,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::writeReadDeleteCustomLockCollectionSecret()
+{
+    // construct the in-process authentication key UI.
+    QQuickView v(QUrl::fromLocalFile(QStringLiteral("%1/tst_secrets.qml").arg(QCoreApplication::applicationDirPath())));
+    v.show();
+    QObject *uiView = v.rootObject()->findChild<QObject*>("uiview");
+    QVERIFY(uiView);
+    QMetaObject::invokeMethod(uiView, "setSecretManager", Qt::DirectConnection, Q_ARG(QObject*, &m));
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::InAppAuthenticationPluginName,
+                Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked,
+                0,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(secretReply);
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(secretReply.argumentAt<1>(), QByteArray("testsecretvalue"));
+
+    reply = m.deleteSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    // ensure that the delete worked properly.
+    secretReply = m.getSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(secretReply);
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+
+void tst_secrets::writeReadDeleteStandaloneCustomLockSecret()
+{
+    // construct the in-process authentication key UI.
+    QQuickView v(QUrl::fromLocalFile(QStringLiteral("%1/tst_secrets.qml").arg(QCoreApplication::applicationDirPath())));
+    v.show();
+    QObject *uiView = v.rootObject()->findChild<QObject*>("uiview");
+    QVERIFY(uiView);
+    QMetaObject::invokeMethod(uiView, "setSecretManager", Qt::DirectConnection, Q_ARG(QObject*, &m));
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.setSecret(
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::InAppAuthenticationPluginName,
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked,
+                0,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(secretReply);
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(secretReply.argumentAt<1>(), QByteArray("testsecretvalue"));
+
+    reply = m.deleteSecret(
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(reply);
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    // ensure that the delete worked properly.
+    secretReply = m.getSecret(
+                    QLatin1String("testsecretname"),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    WAIT_FOR_FINISHED_WITHOUT_BLOCKING(secretReply);
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+}
+
+void tst_secrets::writeReadDeletePluginSecrets_data()
+{
+    QTest::addColumn<QString>("storagePluginName");
+    QTest::addColumn<QString>("encryptionPluginName");
+
+    // an encrypted storage plugin is named as both the storage and the encryption plugin.
+    QTest::newRow("sqlcipher") << QStringLiteral("org.sailfishos.secrets.plugin.encryptedstorage.sqlcipher")
+                               << QStringLiteral("org.sailfishos.secrets.plugin.encryptedstorage.sqlcipher");
+    QTest::newRow("inmemory") << QStringLiteral("org.sailfishos.secrets.plugin.storage.inmemory")
+                              << Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName;
+    QTest::newRow("logstore") << QStringLiteral("org.sailfishos.secrets.plugin.storage.logstore")
+                              << Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName;
+}
+
+void tst_secrets::writeReadDeletePluginSecrets()
+{
+    QFETCH(QString, storagePluginName);
+    QFETCH(QString, encryptionPluginName);
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testplugincollection"),
+                storagePluginName,
+                encryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.setSecret(
+                QLatin1String("testplugincollection"),
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+                QLatin1String("testplugincollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretReply.waitForFinished();
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(secretReply.argumentAt<1>(), QByteArray("testsecretvalue"));
+
+    // overwrite the secret and add another in a single batch.
+    QMap<QString, QByteArray> batch;
+    batch.insert(QLatin1String("testsecretname"), QByteArray("testsecretvalue1"));
+    batch.insert(QLatin1String("testsecretname2"), QByteArray(4096, 'x'));
+    reply = m.setSecrets(
+                QLatin1String("testplugincollection"),
+                batch,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QMap<QString, QByteArray> > secretsReply = m.getSecrets(
+                QLatin1String("testplugincollection"),
+                batch.keys(),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretsReply.waitForFinished();
+    QVERIFY(secretsReply.isValid());
+    QCOMPARE(secretsReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(secretsReply.argumentAt<1>(), batch);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList, qint64> namesReply = m.secretNames(
+                QLatin1String("testplugincollection"), 0, 10);
+    namesReply.waitForFinished();
+    QVERIFY(namesReply.isValid());
+    QCOMPARE(namesReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QStringList secretNames = namesReply.argumentAt<1>();
+    secretNames.sort();
+    QCOMPARE(secretNames, QStringList(batch.keys()));
+
+    reply = m.deleteSecret(
+                QLatin1String("testplugincollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    // ensure that the delete worked properly.
+    secretReply = m.getSecret(
+                QLatin1String("testplugincollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretReply.waitForFinished();
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+
+    reply = m.deleteCollection(
+                QLatin1String("testplugincollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    // test a standalone secret in the same plugins.
+    reply = m.setSecret(
+                storagePluginName,
+                encryptionPluginName,
+                QLatin1String("testpluginsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    secretReply = m.getSecret(
+                QLatin1String("testpluginsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretReply.waitForFinished();
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(secretReply.argumentAt<1>(), QByteArray("testsecretvalue"));
+
+    reply = m.deleteSecret(
+                QLatin1String("testpluginsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::inMemoryPluginCapacity()
+{
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testinmemorycollection"),
+                QLatin1String("org.sailfishos.secrets.plugin.storage.inmemory"),
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    // larger than the plugin's locked memory, at its default capacity.
+    reply = m.setSecret(
+                QLatin1String("testinmemorycollection"),
+                QLatin1String("testsecretname"),
+                QByteArray(1024 * 1024, 'x'),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+
+    // the failed write must not have used up any of the capacity.
+    reply = m.setSecret(
+                QLatin1String("testinmemorycollection"),
+                QLatin1String("testsecretname"),
+                QByteArray(64 * 1024, 'y'),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+                QLatin1String("testinmemorycollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretReply.waitForFinished();
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(secretReply.argumentAt<1>(), QByteArray(64 * 1024, 'y'));
+
+    // deleting the collection releases its memory for reuse.
+    reply = m.deleteCollection(
+                QLatin1String("testinmemorycollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::logStorePluginReplay()
+{
+    LogStorePluginLoader loader;
+    QVERIFY(loader.isValid());
+    const QString collectionName = QLatin1String("testlogcollection");
+
+    Sailfish::Secrets::StoragePlugin *plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->createCollection(collectionName).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(plugin->setSecret(collectionName, QLatin1String("a"), QByteArray("valuea")).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(plugin->setSecret(collectionName, QLatin1String("b"), QByteArray("valueb")).code(), Sailfish::Secrets::Result::Succeeded);
+    loader.unload();
+
+    QFile segment(loader.segmentFilePath());
+    const qint64 intactSize = segment.size();
+    QVERIFY(intactSize > 0);
+
+    // test that a partially written record at the end of the segment is discarded.
+    plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->setSecret(collectionName, QLatin1String("c"), QByteArray(1000, 'c')).code(), Sailfish::Secrets::Result::Succeeded);
+    loader.unload();
+    QVERIFY(segment.size() > intactSize);
+    QVERIFY(segment.resize(segment.size() - 10));
+
+    QByteArray value;
+    plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("a"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("valuea"));
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("b"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("valueb"));
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("c"), &value).code(), Sailfish::Secrets::Result::Failed);
+    loader.unload();
+    QCOMPARE(segment.size(), intactSize);
+
+    // test that a batch is replayed all or none: the first record of this batch
+    // is intact, but the second (of the same length) is torn.
+    QMap<QString, QByteArray> batch;
+    batch.insert(QLatin1String("d"), QByteArray(1000, 'd'));
+    batch.insert(QLatin1String("e"), QByteArray(1000, 'e'));
+    plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->setSecrets(collectionName, batch).code(), Sailfish::Secrets::Result::Succeeded);
+    loader.unload();
+    const qint64 batchSize = segment.size() - intactSize;
+    QVERIFY(segment.resize(intactSize + batchSize / 2 + 10));
+
+    plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("d"), &value).code(), Sailfish::Secrets::Result::Failed);
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("e"), &value).code(), Sailfish::Secrets::Result::Failed);
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("a"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("valuea"));
+    loader.unload();
+
+    // test that garbage after the last record is discarded, so that records
+    // appended after it are replayed too.
+    QVERIFY(segment.open(QIODevice::Append));
+    QCOMPARE(segment.write(QByteArray(64, char(0xff))), qint64(64));
+    segment.close();
+
+    plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("b"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("valueb"));
+    QCOMPARE(plugin->setSecret(collectionName, QLatin1String("f"), QByteArray("valuef")).code(), Sailfish::Secrets::Result::Succeeded);
+    loader.unload();
+
+    plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("f"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("valuef"));
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("a"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("valuea"));
+}
+
+void tst_secrets::logStorePluginCompaction()
+{
+    LogStorePluginLoader loader;
+    QVERIFY(loader.isValid());
+    const QString collectionName = QLatin1String("testlogcollection");
+
+    Sailfish::Secrets::StoragePlugin *plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->createCollection(collectionName).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(plugin->setSecret(collectionName, QLatin1String("small"), QByteArray("smallvalue")).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(plugin->setSecret(collectionName, QLatin1String("removed"), QByteArray(1024, 'r')).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(plugin->removeSecret(collectionName, QLatin1String("removed")).code(), Sailfish::Secrets::Result::Succeeded);
+
+    // overwriting a large secret leaves most of the segment superseded,
+    // which schedules a compaction once the segment is large enough.
+    for (int i = 0; i < 40; ++i) {
+        QCOMPARE(plugin->setSecret(collectionName, QLatin1String("large"), QByteArray(64 * 1024, char('a' + i % 26))).code(),
+                 Sailfish::Secrets::Result::Succeeded);
+    }
+    // reads and writes continue while the compaction runs.
+    QByteArray value;
+    QCOMPARE(plugin->setSecret(collectionName, QLatin1String("late"), QByteArray("latevalue")).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("small"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("smallvalue"));
+    loader.unload();
+
+    // only the live records are left, and the compacted segment replays as the original did.
+    QVERIFY(QFileInfo(loader.segmentFilePath()).size() < 40 * 64 * 1024 / 2);
+    QVERIFY(!QFile::exists(loader.segmentFilePath() + QLatin1String(".compact")));
+
+    plugin = loader.load();
+    QVERIFY(plugin);
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("large"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray(64 * 1024, char('a' + 39 % 26)));
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("small"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("smallvalue"));
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("late"), &value).code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(value, QByteArray("latevalue"));
+    QCOMPARE(plugin->getSecret(collectionName, QLatin1String("removed"), &value).code(), Sailfish::Secrets::Result::Failed);
+}
+
+void tst_secrets::secretEncoding()
+{
+    const QByteArray blob("\x00:secret\xff", 9);
+    const Sailfish::Secrets::Secret secret(blob);
+    QCOMPARE(secret.type(), Sailfish::Secrets::Secret::Blob);
+    QCOMPARE(secret.blob(), blob);
+
+    const QByteArray encoded = secret.toByteArray();
+    QCOMPARE(encoded.size(), 2 + 3 * 4 + blob.size());
+    const Sailfish::Secrets::Secret decoded = Sailfish::Secrets::Secret::fromByteArray(encoded);
+    QCOMPARE(decoded.type(), Sailfish::Secrets::Secret::Blob);
+    QCOMPARE(decoded.blob(), blob);
+    QVERIFY(decoded == secret);
+
+    // a truncated encoding yields no data.
+    const Sailfish::Secrets::Secret truncated = Sailfish::Secrets::Secret::fromByteArray(encoded.left(encoded.size() - 1));
+    QCOMPARE(truncated.type(), Sailfish::Secrets::Secret::Unknown);
+    QVERIFY(truncated.data().isEmpty());
+
+    // the legacy encoding (":"-separated base64url-encoded type and data) can still be read.
+    const QByteArray legacy = QByteArray("Blob").toBase64(QByteArray::Base64UrlEncoding)
+            + ':' + blob.toBase64(QByteArray::Base64UrlEncoding);
+    const Sailfish::Secrets::Secret legacyDecoded = Sailfish::Secrets::Secret::fromByteArray(legacy);
+    QCOMPARE(legacyDecoded.type(), Sailfish::Secrets::Secret::Blob);
+    QCOMPARE(legacyDecoded.blob(), blob);
+}
+
+void tst_secrets::requestDeadlines()
+{
+    // the deadline is sent via the connection shared with m,
+    // so it mustn't be applied to the requests made via m.
+    Sailfish::Secrets::SecretManager deadlineManager;
+    QCOMPARE(deadlineManager.requestTimeout(), -1);
+    deadlineManager.setRequestTimeout(60000);
+    QCOMPARE(deadlineManager.requestTimeout(), 60000);
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = deadlineManager.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList> collectionsReply = m.collectionNames();
+    collectionsReply.waitForFinished();
+    QVERIFY(collectionsReply.isValid());
+    QCOMPARE(collectionsReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QVERIFY(collectionsReply.argumentAt<1>().contains(QLatin1String("testcollection")));
+
+    deadlineManager.setRequestTimeout(-5);
+    QCOMPARE(deadlineManager.requestTimeout(), -1);
+
+    reply = deadlineManager.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::requestCoalescing()
+{
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    const QVariantMap before = secretsQueueStatistics();
+    QVERIFY(before.contains(QStringLiteral("coalescedCount")));
+
+    // identical reads which are queued together are handled once,
+    // and each is given the result.
+    reply = beginLargeWrite(m, QLatin1String("testcollection"));
+    QList<QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> > secretReplies;
+    for (int i = 0; i < 20; ++i) {
+        secretReplies.append(m.getSecret(
+                    QLatin1String("testcollection"),
+                    QLatin1String("testsecretname"),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode));
+    }
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    for (int i = 0; i < secretReplies.size(); ++i) {
+        secretReplies[i].waitForFinished();
+        QVERIFY(secretReplies[i].isValid());
+        QCOMPARE(secretReplies[i].argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+        QCOMPARE(secretReplies[i].argumentAt<1>(), QByteArray("testsecretvalue"));
+    }
+
+    const QVariantMap after = secretsQueueStatistics();
+    QVERIFY(after.value(QStringLiteral("coalescedCount")).toULongLong()
+            > before.value(QStringLiteral("coalescedCount")).toULongLong());
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::requestAdmission()
+{
+    const QVariantMap before = secretsQueueStatistics();
+    const int maxRequestsPerCaller = before.value(QStringLiteral("admissionLimits")).toMap()
+            .value(QStringLiteral("maxRequestsPerCaller")).toInt();
+    if (maxRequestsPerCaller <= 0 || maxRequestsPerCaller > 1024) {
+        QSKIP("The daemon does not limit the requests per client to a testable number");
+    }
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    // once this client has the limit of requests in flight, the next is
+    // rejected rather than queued, with a hint of when to retry.
+    reply = beginLargeWrite(m, QLatin1String("testcollection"));
+    QList<QDBusPendingReply<Sailfish::Secrets::Result, QStringList> > collectionsReplies;
+    for (int i = 0; i <= maxRequestsPerCaller; ++i) {
+        collectionsReplies.append(m.collectionNames());
+    }
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    for (int i = 0; i < maxRequestsPerCaller; ++i) {
+        collectionsReplies[i].waitForFinished();
+        QVERIFY(collectionsReplies[i].isValid());
+        QCOMPARE(collectionsReplies[i].argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    }
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList> rejectedReply = collectionsReplies.last();
+    rejectedReply.waitForFinished();
+    QVERIFY(rejectedReply.isValid());
+    QCOMPARE(rejectedReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Failed);
+    QCOMPARE(rejectedReply.argumentAt<0>().errorCode(), Sailfish::Secrets::Result::SecretsDaemonRequestQueueFullError);
+    const QRegularExpressionMatch retryAfter = QRegularExpression(QStringLiteral("retry after (\\d+) msec"))
+            .match(rejectedReply.argumentAt<0>().errorMessage());
+    QVERIFY(retryAfter.hasMatch());
+    QVERIFY(retryAfter.captured(1).toInt() >= 10);
+    QVERIFY(retryAfter.captured(1).toInt() <= 5000);
+
+    const QVariantMap after = secretsQueueStatistics();
+    QCOMPARE(after.value(QStringLiteral("rejectedCount")).toULongLong(),
+             before.value(QStringLiteral("rejectedCount")).toULongLong() + 1);
+
+    // once the queue has drained, requests are admitted again.
+    QTest::qWait(retryAfter.captured(1).toInt());
+    QDBusPendingReply<Sailfish::Secrets::Result, QStringList> collectionsReply = m.collectionNames();
+    collectionsReply.waitForFinished();
+    QVERIFY(collectionsReply.isValid());
+    QCOMPARE(collectionsReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QVERIFY(collectionsReply.argumentAt<1>().contains(QLatin1String("testcollection")));
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+}
+
+void tst_secrets::requestCancellation()
+{
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m.createCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    reply = m.setSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                QByteArray("testsecretvalue"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+
+    const QVariantMap before = secretsQueueStatistics();
+    QVERIFY(before.contains(QStringLiteral("cancelledCount")));
+
+    // the requests are still queued when the cancellation arrives, so each
+    // of them fails, while the request already handled is unaffected.
+    reply = beginLargeWrite(m, QLatin1String("testcollection"));
+    QList<QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> > secretReplies;
+    for (int i = 0; i < 10; ++i) {
+        secretReplies.append(m.getSecret(
+                    QLatin1String("testcollection"),
+                    QLatin1String("testsecretname"),
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode));
+    }
+    QDBusPendingReply<Sailfish::Secrets::Result> cancelReply = m.cancelRequests();
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    cancelReply.waitForFinished();
+    QVERIFY(cancelReply.isValid());
+    QCOMPARE(cancelReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    for (int i = 0; i < secretReplies.size(); ++i) {
+        secretReplies[i].waitForFinished();
+        QVERIFY(secretReplies[i].isError());
+        QCOMPARE(secretReplies[i].error().message(), QStringLiteral("Request was cancelled"));
+    }
+
+    const QVariantMap after = secretsQueueStatistics();
+    QCOMPARE(after.value(QStringLiteral("cancelledCount")).toULongLong(),
+             before.value(QStringLiteral("cancelledCount")).toULongLong() + secretReplies.size());
+    QCOMPARE(after.value(QStringLiteral("queueDepth")).toInt(), 0);
+
+    // later requests are handled as usual.
+    QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> secretReply = m.getSecret(
+                QLatin1String("testcollection"),
+                QLatin1String("testsecretname"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    secretReply.waitForFinished();
+    QVERIFY(secretReply.isValid());
+    QCOMPARE(secretReply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
+    QCOMPARE(secretReply.argumentAt<1>(), QByteArray("testsecretvalue"));
+
+    reply = m.deleteCollection(
+                QLatin1String("testcollection"),
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    reply.waitForFinished();
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>().code(), Sailfish::Secrets::Result::Succeeded);
 }
 
 #include "tst_secrets.moc"
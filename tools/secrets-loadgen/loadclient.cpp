@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "loadclient.h"
+
+#include "Secrets/result.h"
+#include "Crypto/result.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QEventLoop>
+
+#include <stdlib.h>
+
+namespace {
+    const int MaxWait = 30000;
+
+    // multiples of the block size, as the encrypt requests use no padding.
+    const int CipherBlockSize = 16;
+
+    QString secretName(int index)
+    {
+        return QStringLiteral("loadgensecret%1").arg(index);
+    }
+}
+
+QDataStream &operator<<(QDataStream &out, const LoadGen::Sample &sample)
+{
+    out << sample.operation << sample.errorCode << sample.latencyUsecs;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, LoadGen::Sample &sample)
+{
+    in >> sample.operation >> sample.errorCode >> sample.latencyUsecs;
+    return in;
+}
+
+LoadGen::AutomaticUiView::AutomaticUiView(Sailfish::Secrets::SecretManager *manager, QObject *parent)
+    : QObject(parent)
+{
+    registerWithSecretManager(manager);
+}
+
+void LoadGen::AutomaticUiView::performRequest(const Sailfish::Secrets::UiRequest &request)
+{
+    // the response is sent once the request has been delivered, as the in-process ui does.
+    Sailfish::Secrets::UiResponse response(request.type());
+    response.setConfirmation(true);
+    response.setAuthenticationKey(QByteArray("loadgenauthenticationkey"));
+    QMetaObject::invokeMethod(this, "sendResponseHelper", Qt::QueuedConnection,
+                              Q_ARG(Sailfish::Secrets::Result, Sailfish::Secrets::Result(Sailfish::Secrets::Result::Succeeded)),
+                              Q_ARG(Sailfish::Secrets::UiResponse, response));
+}
+
+void LoadGen::AutomaticUiView::continueRequest(const Sailfish::Secrets::UiRequest &request)
+{
+    performRequest(request);
+}
+
+void LoadGen::AutomaticUiView::cancelRequest()
+{
+}
+
+void LoadGen::AutomaticUiView::finishRequest()
+{
+}
+
+void LoadGen::AutomaticUiView::sendResponseHelper(
+        const Sailfish::Secrets::Result &result,
+        const Sailfish::Secrets::UiResponse &response)
+{
+    sendResponse(result, response);
+}
+
+LoadGen::LoadClient::LoadClient(const LoadGen::ClientOptions &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_collectionName(QStringLiteral("loadgencollection%1").arg(options.index))
+    , m_secretManager(Sailfish::Secrets::SecretManager::MinimalInitialisationMode)
+    , m_uiView(Q_NULLPTR)
+    , m_elapsedMs(0)
+    , m_nextSecret(0)
+    , m_running(false)
+{
+    // each client makes a different sequence of choices, but the same one on every run.
+    srand(options.index + 1);
+
+    if (m_options.customLock) {
+        m_uiView = new LoadGen::AutomaticUiView(&m_secretManager, this);
+    }
+
+    m_durationTimer.setSingleShot(true);
+    connect(&m_durationTimer, &QTimer::timeout,
+            this, &LoadGen::LoadClient::durationElapsed);
+}
+
+bool LoadGen::LoadClient::waitForReply(const QDBusPendingCall &call) const
+{
+    if (call.isFinished()) {
+        return true;
+    }
+
+    // events are processed while waiting, as the custom lock ui flow requires.
+    QEventLoop loop;
+    QDBusPendingCallWatcher watcher(call);
+    QObject::connect(&watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), &loop, SLOT(quit()));
+    QTimer::singleShot(MaxWait, &loop, SLOT(quit()));
+    loop.exec();
+    return call.isFinished();
+}
+
+bool LoadGen::LoadClient::prepare()
+{
+    // a collection left behind by an interrupted run would fail the creation.
+    cleanup();
+
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m_options.customLock
+            ? m_secretManager.createCollection(
+                    m_collectionName,
+                    Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                    Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                    Sailfish::Secrets::SecretManager::InAppAuthenticationPluginName,
+                    Sailfish::Secrets::SecretManager::CustomLockKeepUnlocked,
+                    0,
+                    Sailfish::Secrets::SecretManager::OwnerOnlyMode,
+                    Sailfish::Secrets::SecretManager::InProcessUserInteractionMode)
+            : m_secretManager.createCollection(
+                    m_collectionName,
+                    Sailfish::Secrets::SecretManager::DefaultStoragePluginName,
+                    Sailfish::Secrets::SecretManager::DefaultEncryptionPluginName,
+                    Sailfish::Secrets::SecretManager::DeviceLockKeepUnlocked,
+                    Sailfish::Secrets::SecretManager::OwnerOnlyMode);
+    if (!waitForReply(reply) || reply.isError()
+            || reply.argumentAt<0>().code() != Sailfish::Secrets::Result::Succeeded) {
+        qWarning() << "client" << m_options.index << "unable to create collection:"
+                   << (reply.isError() ? reply.error().message() : reply.argumentAt<0>().errorMessage());
+        return false;
+    }
+
+    QMap<QString, QByteArray> secrets;
+    for (int i = 0; i < m_options.collectionSize; ++i) {
+        secrets.insert(secretName(i), QByteArray(m_options.payloadSizes.first(), char('a' + i % 26)));
+    }
+    reply = m_secretManager.setSecrets(m_collectionName, secrets,
+                                       Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    if (!waitForReply(reply) || reply.isError()
+            || reply.argumentAt<0>().code() != Sailfish::Secrets::Result::Succeeded) {
+        qWarning() << "client" << m_options.index << "unable to populate collection:"
+                   << (reply.isError() ? reply.error().message() : reply.argumentAt<0>().errorMessage());
+        return false;
+    }
+
+    if (m_options.cryptoRatio > 0) {
+        Sailfish::Crypto::Key keyTemplate;
+        keyTemplate.setAlgorithm(Sailfish::Crypto::Key::Aes256);
+        keyTemplate.setOrigin(Sailfish::Crypto::Key::OriginDevice);
+        keyTemplate.setBlockModes(Sailfish::Crypto::Key::BlockModeCBC);
+        keyTemplate.setEncryptionPaddings(Sailfish::Crypto::Key::EncryptionPaddingNone);
+        keyTemplate.setDigests(Sailfish::Crypto::Key::DigestSha256);
+        keyTemplate.setOperations(Sailfish::Crypto::Key::Encrypt | Sailfish::Crypto::Key::Decrypt);
+        QDBusPendingReply<Sailfish::Crypto::Result, Sailfish::Crypto::Key> keyReply = m_cryptoManager.generateKey(
+                keyTemplate, QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl"));
+        if (!waitForReply(keyReply) || keyReply.isError()
+                || keyReply.argumentAt<0>().code() != Sailfish::Crypto::Result::Succeeded) {
+            qWarning() << "client" << m_options.index << "unable to generate key:"
+                       << (keyReply.isError() ? keyReply.error().message() : keyReply.argumentAt<0>().errorMessage());
+            return false;
+        }
+        m_key = keyReply.argumentAt<1>();
+    }
+
+    return true;
+}
+
+bool LoadGen::LoadClient::cleanup()
+{
+    QDBusPendingReply<Sailfish::Secrets::Result> reply = m_secretManager.deleteCollection(
+                m_collectionName,
+                Sailfish::Secrets::SecretManager::InProcessUserInteractionMode);
+    return waitForReply(reply) && !reply.isError()
+            && reply.argumentAt<0>().code() == Sailfish::Secrets::Result::Succeeded;
+}
+
+void LoadGen::LoadClient::start()
+{
+    m_running = true;
+    m_timer.start();
+    m_durationTimer.start(m_options.durationMs);
+    for (int i = 0; i < m_options.concurrency; ++i) {
+        sendRequest();
+    }
+}
+
+LoadGen::Operation LoadGen::LoadClient::chooseOperation()
+{
+    const double choice = double(rand()) / RAND_MAX;
+    if (choice < m_options.cryptoRatio) {
+        return LoadGen::EncryptOperation;
+    }
+    const double secretsChoice = double(rand()) / RAND_MAX;
+    return secretsChoice < m_options.readRatio
+            ? LoadGen::GetSecretOperation
+            : LoadGen::SetSecretOperation;
+}
+
+int LoadGen::LoadClient::choosePayloadSize()
+{
+    return m_options.payloadSizes.at(rand() % m_options.payloadSizes.size());
+}
+
+void LoadGen::LoadClient::sendRequest()
+{
+    PendingRequest request;
+    request.operation = chooseOperation();
+    request.startNsecs = m_timer.nsecsElapsed();
+
+    switch (request.operation) {
+        case LoadGen::GetSecretOperation: {
+            // consecutive reads walk the collection, so that they are not served from one cached row.
+            watchRequest(m_secretManager.getSecret(
+                                 m_collectionName,
+                                 secretName(m_nextSecret++ % m_options.collectionSize),
+                                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode),
+                         request);
+            break;
+        }
+        case LoadGen::SetSecretOperation: {
+            // existing secrets are overwritten, so that the collection size stays the same.
+            watchRequest(m_secretManager.setSecret(
+                                 m_collectionName,
+                                 secretName(rand() % m_options.collectionSize),
+                                 QByteArray(choosePayloadSize(), 'z'),
+                                 Sailfish::Secrets::SecretManager::InProcessUserInteractionMode),
+                         request);
+            break;
+        }
+        default: {
+            const int payloadSize = (choosePayloadSize() + CipherBlockSize - 1) / CipherBlockSize * CipherBlockSize;
+            watchRequest(m_cryptoManager.encrypt(
+                                 QByteArray(payloadSize, 'p'),
+                                 m_key,
+                                 Sailfish::Crypto::Key::BlockModeCBC,
+                                 Sailfish::Crypto::Key::EncryptionPaddingNone,
+                                 Sailfish::Crypto::Key::DigestSha256,
+                                 QLatin1String("org.sailfishos.crypto.plugin.crypto.openssl")),
+                         request);
+            break;
+        }
+    }
+}
+
+void LoadGen::LoadClient::watchRequest(const QDBusPendingCall &call, const PendingRequest &request)
+{
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    m_pending.insert(watcher, request);
+    connect(watcher, &QDBusPendingCallWatcher::finished,
+            this, &LoadGen::LoadClient::requestFinished);
+}
+
+void LoadGen::LoadClient::requestFinished(QDBusPendingCallWatcher *watcher)
+{
+    const PendingRequest request = m_pending.take(watcher);
+    watcher->deleteLater();
+
+    Sample sample;
+    sample.operation = request.operation;
+    sample.latencyUsecs = quint32((m_timer.nsecsElapsed() - request.startNsecs) / 1000);
+    if (watcher->isError()) {
+        sample.errorCode = LoadGen::DBusErrorCode;
+    } else if (request.operation == LoadGen::EncryptOperation) {
+        QDBusPendingReply<Sailfish::Crypto::Result, QByteArray> reply = *watcher;
+        sample.errorCode = reply.argumentAt<0>().errorCode();
+    } else if (request.operation == LoadGen::GetSecretOperation) {
+        QDBusPendingReply<Sailfish::Secrets::Result, QByteArray> reply = *watcher;
+        sample.errorCode = reply.argumentAt<0>().errorCode();
+    } else {
+        QDBusPendingReply<Sailfish::Secrets::Result> reply = *watcher;
+        sample.errorCode = reply.argumentAt<0>().errorCode();
+    }
+    m_samples.append(sample);
+
+    if (m_running) {
+        sendRequest();
+    } else if (m_pending.isEmpty()) {
+        m_elapsedMs = m_timer.elapsed();
+        emit finished();
+    }
+}
+
+void LoadGen::LoadClient::durationElapsed()
+{
+    // the requests in flight are still measured, but no more are sent.
+    m_running = false;
+    if (m_pending.isEmpty()) {
+        m_elapsedMs = m_timer.elapsed();
+        emit finished();
+    }
+}
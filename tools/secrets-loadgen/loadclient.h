@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#ifndef SAILFISHSECRETS_TOOLS_LOADCLIENT_H
+#define SAILFISHSECRETS_TOOLS_LOADCLIENT_H
+
+#include "Secrets/secretmanager.h"
+#include "Secrets/uiview.h"
+#include "Crypto/cryptomanager.h"
+#include "Crypto/key.h"
+
+#include <QtDBus/QDBusPendingCallWatcher>
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QDataStream>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtCore/QList>
+#include <QtCore/QTimer>
+
+namespace LoadGen {
+
+enum Operation {
+    GetSecretOperation = 0,
+    SetSecretOperation,
+    EncryptOperation,
+    OperationCount
+};
+
+// The error code of a reply which was a D-Bus error rather than a Result.
+const qint32 DBusErrorCode = -1;
+
+// One completed request, as written by a client process to the controller.
+struct Sample {
+    quint8 operation;
+    qint32 errorCode;
+    quint32 latencyUsecs;
+};
+
+// The workload of one client process, passed to it on its command line.
+struct ClientOptions {
+    int index;
+    int concurrency;
+    int durationMs;
+    int collectionSize;
+    bool customLock;
+    double readRatio;
+    double cryptoRatio;
+    QList<int> payloadSizes;
+};
+
+// Answers the authentication key requests of custom lock collections
+// without any user interaction, as the in-process ui of the autotests does.
+class AutomaticUiView : public QObject, public Sailfish::Secrets::UiView
+{
+    Q_OBJECT
+
+public:
+    AutomaticUiView(Sailfish::Secrets::SecretManager *manager, QObject *parent = Q_NULLPTR);
+
+protected:
+    void performRequest(const Sailfish::Secrets::UiRequest &request) Q_DECL_OVERRIDE;
+    void continueRequest(const Sailfish::Secrets::UiRequest &request) Q_DECL_OVERRIDE;
+    void cancelRequest() Q_DECL_OVERRIDE;
+    void finishRequest() Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+    void sendResponseHelper(const Sailfish::Secrets::Result &result,
+                            const Sailfish::Secrets::UiResponse &response);
+};
+
+// Keeps a fixed number of requests in flight against the daemon for the
+// duration of the run, and records the latency and result of each.
+class LoadClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadClient(const ClientOptions &options, QObject *parent = Q_NULLPTR);
+
+    bool prepare();
+    void start();
+    bool cleanup();
+
+    qint64 elapsedMs() const { return m_elapsedMs; }
+    const QVector<Sample> &samples() const { return m_samples; }
+
+Q_SIGNALS:
+    void finished();
+
+private Q_SLOTS:
+    void requestFinished(QDBusPendingCallWatcher *watcher);
+    void durationElapsed();
+
+private:
+    struct PendingRequest {
+        Operation operation;
+        qint64 startNsecs;
+    };
+
+    bool waitForReply(const QDBusPendingCall &call) const;
+    Operation chooseOperation();
+    int choosePayloadSize();
+    void sendRequest();
+    void watchRequest(const QDBusPendingCall &call, const PendingRequest &request);
+
+    ClientOptions m_options;
+    QString m_collectionName;
+    Sailfish::Secrets::SecretManager m_secretManager;
+    Sailfish::Crypto::CryptoManager m_cryptoManager;
+    AutomaticUiView *m_uiView;
+    Sailfish::Crypto::Key m_key;
+    QHash<QDBusPendingCallWatcher *, PendingRequest> m_pending;
+    QVector<Sample> m_samples;
+    QElapsedTimer m_timer;
+    QTimer m_durationTimer;
+    qint64 m_elapsedMs;
+    int m_nextSecret;
+    bool m_running;
+};
+
+} // namespace LoadGen
+
+QDataStream &operator<<(QDataStream &out, const LoadGen::Sample &sample);
+QDataStream &operator>>(QDataStream &in, LoadGen::Sample &sample);
+
+Q_DECLARE_TYPEINFO(LoadGen::Sample, Q_PRIMITIVE_TYPE);
+
+#endif // SAILFISHSECRETS_TOOLS_LOADCLIENT_H
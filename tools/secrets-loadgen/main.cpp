@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2017 Jolla Ltd.
+ * Contact: Chris Adams <chris.adams@jollamobile.com>
+ * All rights reserved.
+ * BSD 3-Clause License, see LICENSE.
+ */
+
+#include "loadclient.h"
+
+#include "Secrets/result.h"
+#include "Crypto/result.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QEventLoop>
+#include <QtCore/QProcess>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QtCore/QMap>
+#include <QtCore/qmath.h>
+
+#include <algorithm>
+
+// secrets-loadgen runs a number of client processes against sailfishsecretsd
+// (normally started with --test) at once, and reports the throughput, latency
+// percentiles and errors of the requests they made.  As the daemon identifies
+// the application by the command line of the calling process, each client is
+// given the application id which it runs as on its command line.
+
+namespace {
+    // written by a client once it has created its collection, and by the
+    // controller once every client has, so that the clients start together.
+    const char ReadyMarker = 'R';
+    const char StartMarker = 'S';
+
+    const char *operationName(int operation)
+    {
+        switch (operation) {
+            case LoadGen::GetSecretOperation: return "getSecret";
+            case LoadGen::SetSecretOperation: return "setSecret";
+            default: return "encrypt";
+        }
+    }
+
+    QString errorName(int operation, qint32 errorCode)
+    {
+        if (errorCode == LoadGen::DBusErrorCode) {
+            return QStringLiteral("DBusError");
+        }
+        if (operation == LoadGen::EncryptOperation) {
+            switch (errorCode) {
+                case Sailfish::Crypto::Result::DaemonError: return QStringLiteral("DaemonError");
+                case Sailfish::Crypto::Result::StorageError: return QStringLiteral("StorageError");
+                case Sailfish::Crypto::Result::CryptoPluginEncryptionError: return QStringLiteral("CryptoPluginEncryptionError");
+                default: break;
+            }
+        } else {
+            switch (errorCode) {
+                case Sailfish::Secrets::Result::SecretsDaemonRequestQueueFullError: return QStringLiteral("SecretsDaemonRequestQueueFullError");
+                case Sailfish::Secrets::Result::SecretsDaemonRequestPidError: return QStringLiteral("SecretsDaemonRequestPidError");
+                case Sailfish::Secrets::Result::CollectionIsLockedError: return QStringLiteral("CollectionIsLockedError");
+                case Sailfish::Secrets::Result::DatabaseQueryError: return QStringLiteral("DatabaseQueryError");
+                case Sailfish::Secrets::Result::DatabaseTransactionError: return QStringLiteral("DatabaseTransactionError");
+                default: break;
+            }
+        }
+        return QStringLiteral("error %1").arg(errorCode);
+    }
+
+    // the nearest-rank percentile of sorted latencies.
+    quint32 percentile(const QVector<quint32> &sorted, double fraction)
+    {
+        if (sorted.isEmpty()) {
+            return 0;
+        }
+        const int rank = qCeil(fraction * sorted.size()) - 1;
+        return sorted.at(qBound(0, rank, sorted.size() - 1));
+    }
+
+    QList<int> parsePayloadSizes(const QString &value)
+    {
+        QList<int> sizes;
+        Q_FOREACH (const QString &size, value.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+            bool ok = false;
+            const int parsed = size.trimmed().toInt(&ok);
+            if (ok && parsed > 0) {
+                sizes.append(parsed);
+            }
+        }
+        return sizes;
+    }
+
+    int runClient(const LoadGen::ClientOptions &options)
+    {
+        LoadGen::LoadClient client(options);
+        const bool prepared = client.prepare();
+
+        QFile output;
+        QFile input;
+        if (!output.open(stdout, QIODevice::WriteOnly) || !input.open(stdin, QIODevice::ReadOnly)) {
+            return 1;
+        }
+
+        // the controller starts the run once every client is ready, or has failed.
+        output.putChar(prepared ? ReadyMarker : '\0');
+        output.flush();
+        char marker = 0;
+        if (!prepared || !input.getChar(&marker) || marker != StartMarker) {
+            return 1;
+        }
+
+        QEventLoop loop;
+        QObject::connect(&client, &LoadGen::LoadClient::finished, &loop, &QEventLoop::quit);
+        client.start();
+        loop.exec();
+        client.cleanup();
+
+        QDataStream out(&output);
+        out << qint64(client.elapsedMs()) << client.samples();
+        return (out.status() == QDataStream::Ok && output.flush()) ? 0 : 1;
+    }
+
+    struct OperationReport {
+        OperationReport() : errors(0) {}
+        QVector<quint32> latencies;
+        int errors;
+        QMap<QString, int> errorCounts;
+    };
+
+    int runController(const QStringList &clientArguments, int clients, int applications)
+    {
+        QTextStream err(stderr);
+        QList<QProcess *> processes;
+        for (int i = 0; i < clients; ++i) {
+            QProcess *process = new QProcess;
+            process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+            QStringList arguments(clientArguments);
+            arguments << QStringLiteral("--client") << QString::number(i)
+                      << QStringLiteral("--application-id")
+                      << QStringLiteral("secrets-loadgen-application%1").arg(i % applications);
+            process->start(QCoreApplication::applicationFilePath(), arguments);
+            processes.append(process);
+        }
+
+        bool ready = true;
+        Q_FOREACH (QProcess *process, processes) {
+            char marker = 0;
+            if (!process->waitForStarted(-1)
+                    || (process->bytesAvailable() == 0 && !process->waitForReadyRead(-1))
+                    || !process->getChar(&marker) || marker != ReadyMarker) {
+                ready = false;
+            }
+        }
+        if (!ready) {
+            err << "Not every client could prepare its collection, is sailfishsecretsd running?\n";
+        }
+
+        Q_FOREACH (QProcess *process, processes) {
+            if (ready) {
+                process->putChar(StartMarker);
+            }
+            process->closeWriteChannel();
+        }
+
+        OperationReport reports[LoadGen::OperationCount];
+        double throughput = 0;
+        int failedClients = 0;
+        Q_FOREACH (QProcess *process, processes) {
+            process->waitForFinished(-1);
+            QDataStream in(process);
+            qint64 elapsedMs = 0;
+            QVector<LoadGen::Sample> samples;
+            in >> elapsedMs >> samples;
+            if (process->exitCode() != 0 || in.status() != QDataStream::Ok) {
+                failedClients++;
+            } else if (elapsedMs > 0) {
+                throughput += samples.size() * 1000.0 / elapsedMs;
+            }
+
+            Q_FOREACH (const LoadGen::Sample &sample, samples) {
+                OperationReport &report(reports[qMin<int>(sample.operation, LoadGen::OperationCount - 1)]);
+                report.latencies.append(sample.latencyUsecs);
+                if (sample.errorCode != 0) {
+                    report.errors++;
+                    report.errorCounts[errorName(sample.operation, sample.errorCode)]++;
+                }
+            }
+            delete process;
+        }
+
+        QTextStream out(stdout);
+        out << "clients: " << clients << ", applications: " << applications
+            << ", throughput: " << QString::number(throughput, 'f', 1) << " requests/s\n";
+        out << "operation    requests   errors   p50 us   p99 us  p999 us   max us\n";
+        for (int operation = 0; operation < LoadGen::OperationCount; ++operation) {
+            OperationReport &report(reports[operation]);
+            if (report.latencies.isEmpty()) {
+                continue;
+            }
+            std::sort(report.latencies.begin(), report.latencies.end());
+            out << qSetFieldWidth(10) << left << operationName(operation) << qSetFieldWidth(11) << right
+                << report.latencies.size() << qSetFieldWidth(9) << report.errors
+                << percentile(report.latencies, 0.5)
+                << percentile(report.latencies, 0.99)
+                << percentile(report.latencies, 0.999)
+                << report.latencies.last() << qSetFieldWidth(0) << "\n";
+            for (QMap<QString, int>::const_iterator it = report.errorCounts.constBegin();
+                    it != report.errorCounts.constEnd(); ++it) {
+                out << "    " << it.key() << ": " << it.value()
+                    << " (" << QString::number(100.0 * it.value() / report.latencies.size(), 'f', 2) << "%)\n";
+            }
+        }
+        if (failedClients) {
+            out << failedClients << " of " << clients << " clients failed\n";
+        }
+        return (ready && failedClients == 0) ? 0 : 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Generates load from many client processes against sailfishsecretsd."));
+    parser.addHelpOption();
+    QCommandLineOption clientsOption(QStringLiteral("clients"), QStringLiteral("Number of client processes."), QStringLiteral("count"), QStringLiteral("8"));
+    QCommandLineOption applicationsOption(QStringLiteral("applications"), QStringLiteral("Number of distinct application ids the clients run as (default: one per client)."), QStringLiteral("count"));
+    QCommandLineOption concurrencyOption(QStringLiteral("concurrency"), QStringLiteral("Requests in flight per client."), QStringLiteral("count"), QStringLiteral("4"));
+    QCommandLineOption durationOption(QStringLiteral("duration"), QStringLiteral("Duration of the run in seconds."), QStringLiteral("seconds"), QStringLiteral("10"));
+    QCommandLineOption secretsOption(QStringLiteral("secrets"), QStringLiteral("Secrets in the collection of each client."), QStringLiteral("count"), QStringLiteral("64"));
+    QCommandLineOption readRatioOption(QStringLiteral("read-ratio"), QStringLiteral("Fraction of secrets requests which are reads rather than writes."), QStringLiteral("ratio"), QStringLiteral("0.8"));
+    QCommandLineOption cryptoRatioOption(QStringLiteral("crypto-ratio"), QStringLiteral("Fraction of requests which are encrypt requests to the crypto api."), QStringLiteral("ratio"), QStringLiteral("0"));
+    QCommandLineOption payloadSizesOption(QStringLiteral("payload-sizes"), QStringLiteral("Comma-separated payload sizes in bytes, chosen between at random."), QStringLiteral("sizes"), QStringLiteral("16,1024,65536"));
+    QCommandLineOption customLockOption(QStringLiteral("custom-lock-ratio"), QStringLiteral("Fraction of clients whose collection is custom lock rather than device lock protected."), QStringLiteral("ratio"), QStringLiteral("0"));
+    QCommandLineOption clientOption(QStringLiteral("client"), QStringLiteral("Internal: run as the client with the given index."), QStringLiteral("index"));
+    QCommandLineOption applicationIdOption(QStringLiteral("application-id"), QStringLiteral("Internal: the application id the client runs as."), QStringLiteral("id"));
+    parser.addOption(clientsOption);
+    parser.addOption(applicationsOption);
+    parser.addOption(concurrencyOption);
+    parser.addOption(durationOption);
+    parser.addOption(secretsOption);
+    parser.addOption(readRatioOption);
+    parser.addOption(cryptoRatioOption);
+    parser.addOption(payloadSizesOption);
+    parser.addOption(customLockOption);
+    parser.addOption(clientOption);
+    parser.addOption(applicationIdOption);
+    parser.process(app);
+
+    const int clients = qMax(1, parser.value(clientsOption).toInt());
+    const int applications = parser.isSet(applicationsOption)
+            ? qBound(1, parser.value(applicationsOption).toInt(), clients)
+            : clients;
+    const double customLockRatio = qBound(0.0, parser.value(customLockOption).toDouble(), 1.0);
+
+    LoadGen::ClientOptions options;
+    options.index = parser.value(clientOption).toInt();
+    options.concurrency = qMax(1, parser.value(concurrencyOption).toInt());
+    options.durationMs = qMax(1, int(parser.value(durationOption).toDouble() * 1000));
+    options.collectionSize = qMax(1, parser.value(secretsOption).toInt());
+    options.readRatio = qBound(0.0, parser.value(readRatioOption).toDouble(), 1.0);
+    options.cryptoRatio = qBound(0.0, parser.value(cryptoRatioOption).toDouble(), 1.0);
+    options.payloadSizes = parsePayloadSizes(parser.value(payloadSizesOption));
+    // the first clients get the custom lock collections.
+    options.customLock = options.index < int(customLockRatio * clients + 0.5);
+    if (options.payloadSizes.isEmpty()) {
+        QTextStream(stderr) << "Invalid payload sizes: " << parser.value(payloadSizesOption) << "\n";
+        return 1;
+    }
+
+    if (parser.isSet(clientOption)) {
+        return runClient(options);
+    }
+
+    // the clients are passed the workload options unchanged.
+    QStringList clientArguments;
+    clientArguments << QStringLiteral("--clients") << QString::number(clients)
+                    << QStringLiteral("--concurrency") << QString::number(options.concurrency)
+                    << QStringLiteral("--duration") << parser.value(durationOption)
+                    << QStringLiteral("--secrets") << QString::number(options.collectionSize)
+                    << QStringLiteral("--read-ratio") << QString::number(options.readRatio)
+                    << QStringLiteral("--crypto-ratio") << QString::number(options.cryptoRatio)
+                    << QStringLiteral("--payload-sizes") << parser.value(payloadSizesOption)
+                    << QStringLiteral("--custom-lock-ratio") << QString::number(customLockRatio);
+    return runController(clientArguments, clients, applications);
+}
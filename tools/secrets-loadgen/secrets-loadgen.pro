@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = secrets-loadgen
+target.path = /opt/tests/Sailfish/Secrets/
+include($$PWD/../../api/libsailfishsecrets/libsailfishsecrets.pri)
+include($$PWD/../../api/libsailfishcrypto/libsailfishcrypto.pri)
+HEADERS += loadclient.h
+SOURCES += loadclient.cpp main.cpp
+INSTALLS += target